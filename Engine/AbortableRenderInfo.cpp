@@ -57,6 +57,7 @@ struct AbortableRenderInfoPrivate
     bool canAbort;
     QAtomicInt aborted;
     U64 age;
+    RenderPriorityEnum priority;
     mutable QMutex threadsMutex;
     ThreadSet threadsForThisRender;
     mutable QMutex timerMutex;
@@ -71,6 +72,7 @@ struct AbortableRenderInfoPrivate
         , canAbort(canAbort)
         , aborted()
         , age(age)
+        , priority(eRenderPriorityInteractive)
         , threadsMutex()
         , threadsForThisRender()
         , timerMutex()
@@ -111,6 +113,18 @@ AbortableRenderInfo::getRenderAge() const
     return _imp->age;
 }
 
+void
+AbortableRenderInfo::setRenderPriority(RenderPriorityEnum priority)
+{
+    _imp->priority = priority;
+}
+
+RenderPriorityEnum
+AbortableRenderInfo::getRenderPriority() const
+{
+    return _imp->priority;
+}
+
 bool
 AbortableRenderInfo::canAbort() const
 {
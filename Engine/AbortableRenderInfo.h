@@ -120,6 +120,21 @@ public:
      **/
     U64 getRenderAge() const;
 
+    /**
+     * @brief The priority class of this render, eRenderPriorityInteractive by default. The tasks of renders with a higher priority
+     * are run first by the render scheduler, see WorkStealingScheduler. This must be set before the render starts.
+     **/
+    void setRenderPriority(RenderPriorityEnum priority);
+    RenderPriorityEnum getRenderPriority() const;
+
+    /**
+     * @brief The priority to pass to QThreadPool::start() for the runnables of a render with the given priority class
+     **/
+    static int getThreadPoolPriority(RenderPriorityEnum priority)
+    {
+        return (int)eRenderPriorityBackground - (int)priority;
+    }
+
     /**
      * @brief Registers the thread as part of this render request. Whenever AbortableThread::setAbortInfo is called, the thread is automatically registered
      * in this class as to be part of this render. This is used to monitor running threads for a specific render and to know if a thread has stalled when
@@ -0,0 +1,158 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+#include "AdaptiveTileSplitter.h"
+
+#include <algorithm> // std::min, std::max
+#include <cassert>
+#include <cmath>
+#include <map>
+
+#include <QtCore/QMutex>
+
+// Weight of a new render in the average cost per pixel of a plug-in
+#define TILE_COST_SMOOTHING 0.25
+
+NATRON_NAMESPACE_ENTER
+
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+struct PluginRenderCost
+{
+    // Average time spent rendering a pixel
+    double secondsPerPixel;
+    double tilesPerThread;
+
+    PluginRenderCost()
+        : secondsPerPixel(0.)
+        , tilesPerThread(1.)
+    {
+    }
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+
+struct AdaptiveTileSplitterPrivate
+{
+    mutable QMutex costsMutex;
+    std::map<std::string, PluginRenderCost> costs;
+
+    AdaptiveTileSplitterPrivate()
+        : costsMutex()
+        , costs()
+    {
+    }
+};
+
+AdaptiveTileSplitter::AdaptiveTileSplitter()
+    : _imp( new AdaptiveTileSplitterPrivate() )
+{
+}
+
+AdaptiveTileSplitter::~AdaptiveTileSplitter()
+{
+}
+
+int
+AdaptiveTileSplitter::getTilesCount(const std::string& pluginID,
+                                    const RectI& rect,
+                                    int nThreads) const
+{
+    if ( (nThreads <= 1) || rect.isNull() ) {
+        return 1;
+    }
+
+    PluginRenderCost cost;
+    {
+        QMutexLocker k(&_imp->costsMutex);
+        std::map<std::string, PluginRenderCost>::const_iterator found = _imp->costs.find(pluginID);
+        if ( found == _imp->costs.end() ) {
+            return nThreads;
+        }
+        cost = found->second;
+    }
+
+    int maxTiles = (int)std::ceil(nThreads * cost.tilesPerThread);
+    double renderTime = cost.secondsPerPixel * (double)rect.width() * (double)rect.height();
+    double tilesForOverhead = std::floor(renderTime / NATRON_TILE_MIN_RENDER_TIME);
+
+    return std::max( 1, (int)std::min( (double)maxTiles, tilesForOverhead ) );
+}
+
+std::vector<RectI>
+AdaptiveTileSplitter::splitRect(const std::string& pluginID,
+                                const RectI& rect,
+                                int nThreads) const
+{
+    int nTiles = getTilesCount(pluginID, rect, nThreads);
+
+    if (nTiles <= 1) {
+        return std::vector<RectI>(1, rect);
+    }
+
+    return rect.splitIntoSmallerRects(nTiles);
+}
+
+void
+AdaptiveTileSplitter::addRenderTimes(const std::string& pluginID,
+                                     const std::vector<RectI>& tiles,
+                                     const std::vector<double>& timesSpent)
+{
+    assert( tiles.size() == timesSpent.size() );
+    double totalTime = 0.;
+    double maxTime = 0.;
+    double nPixels = 0.;
+    for (std::size_t i = 0; i < tiles.size() && i < timesSpent.size(); ++i) {
+        totalTime += timesSpent[i];
+        maxTime = std::max(maxTime, timesSpent[i]);
+        nPixels += (double)tiles[i].width() * (double)tiles[i].height();
+    }
+    if ( (totalTime <= 0.) || (nPixels <= 0.) ) {
+        return;
+    }
+
+    double secondsPerPixel = totalTime / nPixels;
+    QMutexLocker k(&_imp->costsMutex);
+    std::map<std::string, PluginRenderCost>::iterator found = _imp->costs.find(pluginID);
+    if ( found == _imp->costs.end() ) {
+        found = _imp->costs.insert( std::make_pair( pluginID, PluginRenderCost() ) ).first;
+        found->second.secondsPerPixel = secondsPerPixel;
+    } else {
+        found->second.secondsPerPixel += TILE_COST_SMOOTHING * (secondsPerPixel - found->second.secondsPerPixel);
+    }
+
+    if (tiles.size() > 1) {
+        // The render lasts as long as the slowest tile: split finer when some tiles are much slower than the others
+        double meanTime = totalTime / tiles.size();
+        if (maxTime > 1.5 * meanTime) {
+            found->second.tilesPerThread = std::min(found->second.tilesPerThread * 2., (double)NATRON_TILE_MAX_TILES_PER_THREAD);
+        } else if (maxTime < 1.1 * meanTime) {
+            found->second.tilesPerThread = std::max(found->second.tilesPerThread * 0.9, 1.);
+        }
+    }
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,90 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_AdaptiveTileSplitter_h
+#define Natron_Engine_AdaptiveTileSplitter_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <string>
+#include <vector>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Engine/RectI.h"
+#include "Engine/EngineFwd.h"
+
+///Below this time (in seconds) the render of a tile is dominated by the overhead of a render action call
+#define NATRON_TILE_MIN_RENDER_TIME 0.002
+
+///Maximum number of tiles per thread for effects whose tiles take uneven times to render
+#define NATRON_TILE_MAX_TILES_PER_THREAD 8
+
+NATRON_NAMESPACE_ENTER
+
+
+/**
+ * @brief Splits the rectangles that the host renders with frame threading (eRenderSafetyFullySafeFrame)
+ * into tiles, using a cost model of each plug-in learned from the time spent rendering the previous tiles.
+ *
+ * Until a plug-in was timed, rectangles are split in as many tiles as there are threads. Afterwards,
+ * cheap effects get fewer, bigger tiles so that each tile takes at least NATRON_TILE_MIN_RENDER_TIME,
+ * and the number of tiles per thread grows for effects whose tiles took uneven times to render, so that
+ * idle threads can steal the remaining tiles instead of waiting for the slowest one.
+ **/
+struct AdaptiveTileSplitterPrivate;
+class AdaptiveTileSplitter
+{
+public:
+
+    AdaptiveTileSplitter();
+
+    ~AdaptiveTileSplitter();
+
+    /**
+     * @brief Returns the number of tiles to render the given rectangle with nThreads threads
+     **/
+    int getTilesCount(const std::string& pluginID, const RectI& rect, int nThreads) const;
+
+    /**
+     * @brief Splits the given rectangle in at most getTilesCount() tiles, as square as possible, see RectI::splitIntoSmallerRects()
+     **/
+    std::vector<RectI> splitRect(const std::string& pluginID, const RectI& rect, int nThreads) const;
+
+    /**
+     * @brief Updates the cost model of the plug-in with the time in seconds spent rendering each of the tiles of a rectangle
+     **/
+    void addRenderTimes(const std::string& pluginID, const std::vector<RectI>& tiles, const std::vector<double>& timesSpent);
+
+private:
+
+    boost::scoped_ptr<AdaptiveTileSplitterPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_AdaptiveTileSplitter_h
@@ -54,6 +54,7 @@
 #include <cstring> // for std::memcpy
 #include <sstream> // stringstream
 #include <locale>
+#include <algorithm> // min, max
 
 #include <QtCore/QtGlobal> // for Q_OS_*
 #if defined(Q_OS_LINUX)
@@ -90,6 +91,7 @@
 #include <QtCore/QTextCodec>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QSettings>
+#include <QtCore/QThread>
 #include <QtCore/QThreadPool>
 #include <QtCore/QTextStream>
 #include <QtNetwork/QAbstractSocket>
@@ -106,6 +108,7 @@
 
 #include "Engine/AppInstance.h"
 #include "Engine/Backdrop.h"
+#include "Engine/BufferPool.h"
 #include "Engine/CLArgs.h"
 #include "Engine/DiskCacheNode.h"
 #include "Engine/Dot.h"
@@ -116,7 +119,7 @@
 #include "Engine/JoinViewsNode.h"
 #include "Engine/LibraryBinary.h"
 #include "Engine/Log.h"
-#include "Engine/MemoryInfo.h" // getSystemTotalRAM, printAsRAM
+#include "Engine/MemoryInfo.h" // getEffectiveTotalRAM, getCgroupMemoryInfo, printAsRAM
 #include "Engine/Node.h"
 #include "Engine/OfxImageEffectInstance.h"
 #include "Engine/OfxEffectInstance.h"
@@ -505,6 +508,7 @@ AppManager::loadFromArgs(const CLArgs& cl)
     }
 
     _imp->idealThreadCount = QThread::idealThreadCount();
+    _imp->renderScheduler.reset( new WorkStealingScheduler(_imp->idealThreadCount) );
 
 
     QThreadPool::globalInstance()->setExpiryTimeout(-1); //< make threads never exit on their own
@@ -585,14 +589,22 @@ AppManager::~AppManager()
 
     _imp->_backgroundIPC.reset();
 
+    // Prints the statistics a last time, the caches are still alive
+    _imp->cacheStatisticsDumpThread.reset();
+    _imp->cacheMemoryBudgetThread.reset();
+
     try {
         _imp->saveCaches();
     } catch (std::runtime_error&) {
         // ignore errors
     }
+    // The entries released from now on keep their data on disk, they must remain in the index
+    _imp->_diskCache->closeIndex();
+    _imp->_viewerCache->closeIndex();
 
     ///Caches may have launched some threads to delete images, wait for them to be done
     QThreadPool::globalInstance()->waitForDone();
+    _imp->renderScheduler.reset();
 
     ///Kill caches now because decreaseNCacheFilesOpened can be called
     _imp->_nodeCache->waitForDeleterThread();
@@ -1068,13 +1080,23 @@ bool
 AppManager::loadInternalAfterInitGui(const CLArgs& cl)
 {
     try {
-        size_t maxCacheRAM = _imp->_settings->getRamMaximumPercent() * getSystemTotalRAM();
+        size_t maxCacheRAM = _imp->_settings->getRamMaximumPercent() * getEffectiveTotalRAM();
         U64 viewerCacheSize = _imp->_settings->getMaximumViewerDiskCacheSize();
         U64 maxDiskCacheNode = _imp->_settings->getMaximumDiskCacheNodeSize();
 
-        _imp->_nodeCache = boost::make_shared<Cache<Image> >("NodeCache", NATRON_CACHE_VERSION, maxCacheRAM, 1.);
-        _imp->_diskCache = boost::make_shared<Cache<Image> >("DiskCache", NATRON_CACHE_VERSION, maxDiskCacheNode, 0.);
-        _imp->_viewerCache = boost::make_shared<Cache<FrameEntry> >("ViewerCache", NATRON_CACHE_VERSION, viewerCacheSize, 0.);
+        // Split the caches in enough buckets so that render threads looking up different entries rarely contend on the same lock
+        int nCacheBuckets = std::max(1, QThread::idealThreadCount() * 4);
+
+        _imp->_nodeCache = boost::make_shared<Cache<Image> >("NodeCache", NATRON_CACHE_VERSION, maxCacheRAM, 1., nCacheBuckets);
+        _imp->_diskCache = boost::make_shared<Cache<Image> >("DiskCache", NATRON_CACHE_VERSION, maxDiskCacheNode, 0., nCacheBuckets);
+        _imp->_viewerCache = boost::make_shared<Cache<FrameEntry> >("ViewerCache", NATRON_CACHE_VERSION, viewerCacheSize, 0., nCacheBuckets);
+        _imp->_nodeCache->setCompressionEnabled( _imp->_settings->isCompressedCachingEnabled(), _imp->_settings->isCompressedCachingHalfFloatEnabled() );
+        setApplicationsCachesCostAwareEviction( _imp->_settings->isCostAwareCacheEvictionEnabled() );
+        setApplicationsCachesFreeOnIdle( _imp->_settings->isFreeEvictedImagesOnIdleEnabled() );
+        setCachesMemoryPressureAdaptationEnabled( _imp->_settings->isCacheMemoryPressureAdaptationEnabled() );
+        setNodeCacheTiled( _imp->_settings->isTiledNodeCacheEnabled() );
+        BufferPool::setMaximumIdleBytes( (U64)(maxCacheRAM * NATRON_BUFFER_POOL_MAX_IDLE_PORTION) );
+        BufferPool::setHugePagesEnabled( _imp->_settings->isHugePagesForImagesEnabled() );
         _imp->setViewerCacheTileSize();
     } catch (std::logic_error&) {
         // ignore
@@ -1098,6 +1120,17 @@ AppManager::loadInternalAfterInitGui(const CLArgs& cl)
         _imp->restoreCaches();
     }
 
+    if ( _imp->_nodeCache && _imp->_settings->isSharedNodeCacheEnabled() ) {
+        QString sharedCachePath = getDiskCacheLocation();
+        StrUtils::ensureLastPathSeparator(sharedCachePath);
+        sharedCachePath.append( QString::fromUtf8("SharedNodeCache") );
+        try {
+            _imp->_nodeCache->openSharedIndex( sharedCachePath.toStdString() );
+        } catch (const std::exception & e) {
+            qDebug() << "Failed to share the node cache:" << e.what();
+        }
+    }
+
     setLoadingStatus( tr("Loading plugin cache...") );
 
 
@@ -1146,6 +1179,13 @@ AppManager::loadInternalAfterInitGui(const CLArgs& cl)
         args = cl;
     }
 
+    _imp->renderTraceEnabled = args.isRenderTraceEnabled();
+
+    if ( isBackground() && (args.getCacheStatsInterval() > 0) ) {
+        _imp->cacheStatisticsDumpThread.reset( new CacheStatisticsDumpThread( args.getCacheStatsInterval() ) );
+        _imp->cacheStatisticsDumpThread->start();
+    }
+
     AppInstancePtr mainInstance = newAppInstance(args, false);
 
     hideSplashScreen();
@@ -1432,9 +1472,18 @@ AppManager::wipeAndCreateDiskCacheStructure()
     clearAllCaches();
 
     assert(_imp->_diskCache);
+    _imp->_diskCache->closeIndex();
     _imp->cleanUpCacheDiskStructure( _imp->_diskCache->getCachePath(), false );
     assert(_imp->_viewerCache);
+    _imp->_viewerCache->closeIndex();
     _imp->cleanUpCacheDiskStructure( _imp->_viewerCache->getCachePath() , true);
+
+    try {
+        _imp->_diskCache->createIndex();
+        _imp->_viewerCache->createIndex();
+    } catch (const std::exception & e) {
+        qDebug() << "Failed to create the disk cache index:" << e.what();
+    }
 }
 
 AppInstancePtr
@@ -1457,6 +1506,12 @@ AppManager::isLoaded() const
     return _imp->_loaded;
 }
 
+bool
+AppManager::isRenderTraceEnabled() const
+{
+    return _imp->renderTraceEnabled;
+}
+
 void
 AppManager::abortAnyProcessing()
 {
@@ -1493,10 +1548,110 @@ AppManager::writeToOutputPipe(const QString & longMessage,
 void
 AppManager::setApplicationsCachesMaximumMemoryPercent(double p)
 {
-    size_t maxCacheRAM = p * getSystemTotalRAM_conditionnally();
+    double budgetFactor;
+    {
+        QMutexLocker k(&_imp->cacheMemoryBudgetMutex);
+        budgetFactor = _imp->cacheMemoryBudgetFactor;
+    }
+    size_t maxCacheRAM = p * budgetFactor * getSystemTotalRAM_conditionnally();
+    bool shrinking = maxCacheRAM < _imp->_nodeCache->getMaximumSize();
 
     _imp->_nodeCache->setMaximumCacheSize(maxCacheRAM);
     _imp->_nodeCache->setMaximumInMemorySize(1);
+
+    BufferPool::setMaximumIdleBytes( (U64)(maxCacheRAM * NATRON_BUFFER_POOL_MAX_IDLE_PORTION) );
+    if (shrinking) {
+        // Do not wait for the next image to be cached to get back under the new budget
+        _imp->_nodeCache->evictInMemoryEntriesUntil(NATRON_CACHE_LIMIT_PERCENT);
+
+        // Give back the memory kept for image buffers to the system
+        BufferPool::releaseIdleMemory();
+    }
+}
+
+void
+AppManager::setApplicationsCachesMemoryBudgetFactor(double factor)
+{
+    double previousFactor;
+    {
+        QMutexLocker k(&_imp->cacheMemoryBudgetMutex);
+        previousFactor = _imp->cacheMemoryBudgetFactor;
+        _imp->cacheMemoryBudgetFactor = factor;
+    }
+    setApplicationsCachesMaximumMemoryPercent( _imp->_settings->getRamMaximumPercent() );
+
+    // The budget grows back in small steps once the pressure is gone: only report when it is back to the maximum
+    if ( (factor > previousFactor) && (factor < 1.) ) {
+        return;
+    }
+    writeToErrorLog_mt_safe( tr("Cache"), QDateTime::currentDateTime(),
+                             tr("The memory budget of the caches is now %1 (%2% of the maximum set in the preferences).")
+                             .arg( printAsRAM( getCachesMemoryBudget() ) )
+                             .arg( (int)(factor * 100) ) );
+}
+
+U64
+AppManager::getCachesMemoryBudget() const
+{
+    return _imp->_nodeCache->getMaximumSize();
+}
+
+void
+AppManager::setCachesMemoryPressureAdaptationEnabled(bool enabled)
+{
+    CgroupMemoryInfo info;
+
+    if ( enabled && !_imp->cacheMemoryBudgetThread && getCgroupMemoryInfo(&info) ) {
+        _imp->cacheMemoryBudgetThread.reset( new CacheMemoryBudgetThread() );
+        _imp->cacheMemoryBudgetThread->start();
+    } else if (!enabled && _imp->cacheMemoryBudgetThread) {
+        _imp->cacheMemoryBudgetThread.reset();
+        setApplicationsCachesMemoryBudgetFactor(1.);
+    }
+}
+
+void
+AppManager::setNodeCacheTiled(bool tiled)
+{
+    _imp->nodeCacheTiled.fetchAndStoreRelease(tiled ? 1 : 0);
+}
+
+bool
+AppManager::isNodeCacheTiled() const
+{
+    return _imp->nodeCacheTiled.fetchAndAddAcquire(0) != 0;
+}
+
+void
+AppManager::setApplicationsCachesCompression(bool enabled,
+                                             bool packHalfFloat)
+{
+    // Only the node cache keeps entries in RAM: the entries of the other caches are evicted to the disk
+    _imp->_nodeCache->setCompressionEnabled(enabled, packHalfFloat);
+}
+
+void
+AppManager::setApplicationsCachesCostAwareEviction(bool enabled)
+{
+    // The other caches evict their entries to the disk, where the least recently used entries are discarded
+    if (enabled) {
+        // The entries of the cache carry the clock of the policy when they were last accessed: a new policy starting
+        // its clock from 0 would evict all the entries inserted from now on before any of the older ones.
+        if (!_imp->costAwareEvictionPolicy) {
+            _imp->costAwareEvictionPolicy = boost::make_shared<CostAwareCacheEvictionPolicy>();
+        }
+        _imp->_nodeCache->setEvictionPolicy(_imp->costAwareEvictionPolicy);
+    } else {
+        _imp->_nodeCache->setEvictionPolicy( boost::make_shared<LRUCacheEvictionPolicy>() );
+    }
+}
+
+void
+AppManager::setApplicationsCachesFreeOnIdle(bool enabled)
+{
+    _imp->_nodeCache->setFreeEvictedEntriesOnIdle(enabled);
+    _imp->_diskCache->setFreeEvictedEntriesOnIdle(enabled);
+    _imp->_viewerCache->setFreeEvictedEntriesOnIdle(enabled);
 }
 
 void
@@ -2445,6 +2600,36 @@ AppManager::removeFromViewerCache(U64 hash)
     _imp->_viewerCache->removeEntry(hash);
 }
 
+bool
+AppManager::isNodeCacheShared() const
+{
+    return _imp->_nodeCache && _imp->_nodeCache->isSharedIndexOpened();
+}
+
+void
+AppManager::publishImageToSharedNodeCache(const ImagePtr & image) const
+{
+    if ( !image || ( image->getCacheAPI() != _imp->_nodeCache.get() ) || (image->getStorageMode() != eStorageModeRAM) ) {
+        return;
+    }
+
+    // Only images that are entirely rendered are shared
+    std::list<RectI> restToRender;
+#if NATRON_ENABLE_TRIMAP
+    bool isBeingRenderedElsewhere = false;
+    image->getRestToRender_trimap(image->getBounds(), restToRender, &isBeingRenderedElsewhere);
+    if (isBeingRenderedElsewhere) {
+        return;
+    }
+#else
+    image->getRestToRender(image->getBounds(), restToRender);
+#endif
+    if ( !restToRender.empty() ) {
+        return;
+    }
+    _imp->_nodeCache->publishSharedEntry(image);
+}
+
 void
 AppManager::getMemoryStatsForCacheEntryHolder(const CacheEntryHolder* holder,
                                               std::size_t* ramOccupied,
@@ -2521,9 +2706,10 @@ AppManager::setNumberOfThreads(int threadsNb)
 
 bool
 AppManager::getImage(const ImageKey & key,
-                     std::list<ImagePtr>* returnValue) const
+                     std::list<ImagePtr>* returnValue,
+                     int mipMapLevel) const
 {
-    return _imp->_nodeCache->get(key, returnValue);
+    return _imp->_nodeCache->get(key, returnValue, mipMapLevel);
 }
 
 bool
@@ -2536,9 +2722,10 @@ AppManager::getImageOrCreate(const ImageKey & key,
 
 bool
 AppManager::getImage_diskCache(const ImageKey & key,
-                               std::list<ImagePtr>* returnValue) const
+                               std::list<ImagePtr>* returnValue,
+                               int mipMapLevel) const
 {
-    return _imp->_diskCache->get(key, returnValue);
+    return _imp->_diskCache->get(key, returnValue, mipMapLevel);
 }
 
 bool
@@ -2579,7 +2766,32 @@ AppManager::isAggressiveCachingEnabled() const
 U64
 AppManager::getCachesTotalMemorySize() const
 {
-    return  _imp->_nodeCache->getMemoryCacheSize();
+    // Also count the buffers kept idle by the image buffer allocator, they are not available to the system either
+    U64 reserved, inUse;
+
+    getImageBuffersMemoryStats(&reserved, &inUse);
+
+    return  _imp->_nodeCache->getMemoryCacheSize() + (reserved > inUse ? reserved - inUse : 0);
+}
+
+void
+AppManager::getImageBuffersMemoryStats(U64* reservedBytes,
+                                       U64* inUseBytes) const
+{
+    BufferPool::getMemoryStats(reservedBytes, inUseBytes);
+}
+
+void
+AppManager::getImageBuffersHugePagesStats(U64* requestedBytes,
+                                          U64* hugePageBytes) const
+{
+    BufferPool::getHugePagesStats(requestedBytes, hugePageBytes);
+}
+
+void
+AppManager::setImageBuffersHugePagesEnabled(bool enabled)
+{
+    BufferPool::setHugePagesEnabled(enabled);
 }
 
 U64
@@ -2588,6 +2800,53 @@ AppManager::getCachesTotalDiskSize() const
     return  _imp->_diskCache->getDiskCacheSize() + _imp->_viewerCache->getDiskCacheSize();
 }
 
+std::string
+AppManager::getCachesStatisticsReport() const
+{
+    std::stringstream ss;
+    CacheStatisticsData nodeCacheStats, diskCacheStats, viewerCacheStats;
+
+    _imp->_nodeCache->getStatistics(&nodeCacheStats);
+    _imp->_diskCache->getStatistics(&diskCacheStats);
+    _imp->_viewerCache->getStatistics(&viewerCacheStats);
+    nodeCacheStats.print(_imp->_nodeCache->cacheName(), ss);
+    diskCacheStats.print(_imp->_diskCache->cacheName(), ss);
+    viewerCacheStats.print(_imp->_viewerCache->cacheName(), ss);
+    ss << _imp->_nodeCache->cacheName() << " total memoryBudget " << getCachesMemoryBudget() << '\n';
+
+    return ss.str();
+}
+
+QVariantMap
+AppManager::getCachesStatistics() const
+{
+    QVariantMap ret;
+    CacheStatisticsData nodeCacheStats, diskCacheStats, viewerCacheStats;
+
+    _imp->_nodeCache->getStatistics(&nodeCacheStats);
+    _imp->_diskCache->getStatistics(&diskCacheStats);
+    _imp->_viewerCache->getStatistics(&viewerCacheStats);
+
+    QVariantMap nodeCacheMap = nodeCacheStats.toVariantMap();
+    QVariantMap nodeCacheTotal = nodeCacheMap[QString::fromUtf8("total")].toMap();
+    nodeCacheTotal[QString::fromUtf8("memoryBudget")] = (qulonglong)getCachesMemoryBudget();
+    nodeCacheMap[QString::fromUtf8("total")] = nodeCacheTotal;
+
+    ret[QString::fromUtf8( _imp->_nodeCache->cacheName().c_str() )] = nodeCacheMap;
+    ret[QString::fromUtf8( _imp->_diskCache->cacheName().c_str() )] = diskCacheStats.toVariantMap();
+    ret[QString::fromUtf8( _imp->_viewerCache->cacheName().c_str() )] = viewerCacheStats.toVariantMap();
+
+    return ret;
+}
+
+void
+AppManager::resetCachesStatistics()
+{
+    _imp->_nodeCache->resetStatistics();
+    _imp->_diskCache->resetStatistics();
+    _imp->_viewerCache->resetStatistics();
+}
+
 CacheSignalEmitterPtr
 AppManager::getOrActivateViewerCacheSignalEmitter() const
 {
@@ -2625,6 +2884,7 @@ AppManager::registerEngineMetaTypes() const
     qRegisterMetaType<RectD>("RectD");
     qRegisterMetaType<RenderStatsPtr>("RenderStatsPtr");
     qRegisterMetaType<RenderStatsMap>("RenderStatsMap");
+    qRegisterMetaType<RenderTraceEventList>("RenderTraceEventList");
     qRegisterMetaType<ViewIdx>("ViewIdx");
     qRegisterMetaType<ViewSpec>("ViewSpec");
     qRegisterMetaType<NodePtr>("NodePtr");
@@ -2890,10 +3150,18 @@ void
 AppManager::checkCacheFreeMemoryIsGoodEnough()
 {
     ///Before allocating the memory check that there's enough space to fit in memory
-    size_t systemRAMToKeepFree = getSystemTotalRAM() * appPTR->getCurrentSettings()->getUnreachableRamPercent();
+    size_t systemRAMToKeepFree = getEffectiveTotalRAM() * appPTR->getCurrentSettings()->getUnreachableRamPercent();
     size_t totalFreeRAM = getAmountFreePhysicalRAM();
 
     while (totalFreeRAM <= systemRAMToKeepFree) {
+        // The entries evicted but not destroyed yet are about to release their RAM, do not evict other entries for it
+        std::size_t evictedPendingBytes = _imp->_nodeCache->getEvictedEntriesPendingBytes();
+        if (evictedPendingBytes > 0) {
+            _imp->_nodeCache->freeEvictedEntries();
+            if (totalFreeRAM + evictedPendingBytes > systemRAMToKeepFree) {
+                break;
+            }
+        }
 #ifdef NATRON_DEBUG_CACHE
         qDebug() << "Total system free RAM is below the threshold:" << printAsRAM(totalFreeRAM)
         << ", clearing least recently used NodeCache image...";
@@ -3717,6 +3985,18 @@ AppManager::getAppTLS() const
     return &_imp->globalTLS;
 }
 
+WorkStealingScheduler*
+AppManager::getRenderScheduler() const
+{
+    return _imp->renderScheduler.get();
+}
+
+AdaptiveTileSplitter*
+AppManager::getTileSplitter() const
+{
+    return &_imp->tileSplitter;
+}
+
 
 QString
 AppManager::getBoostVersion() const
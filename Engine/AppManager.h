@@ -43,6 +43,7 @@ CLANG_DIAG_ON(deprecated)
 #include <QtCore/QString>
 #include <QtCore/QProcess>
 #include <QtCore/QMap>
+#include <QtCore/QVariant>
 
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/scoped_ptr.hpp>
@@ -153,6 +154,11 @@ public:
 
     bool isLoaded() const;
 
+    /**
+     * @brief Returns true if writers write the timeline of each frame along with the render statistics, see CLArgs::isRenderTraceEnabled()
+     **/
+    bool isRenderTraceEnabled() const;
+
     AppInstancePtr newAppInstance(const CLArgs& cl, bool makeEmptyInstance);
     AppInstancePtr newBackgroundInstance(const CLArgs& cl, bool makeEmptyInstance);
 
@@ -198,8 +204,9 @@ public:
 
     /**
      * @brief Attempts to load an image from cache, returns true if it could find a matching image, false otherwise.
+     * @param mipMapLevel The mip-map level looked up if known, only used by the cache statistics.
      **/
-    bool getImage(const ImageKey & key, std::list<ImagePtr>* returnValue) const;
+    bool getImage(const ImageKey & key, std::list<ImagePtr>* returnValue, int mipMapLevel = -1) const;
 
     /**
      * @brief Same as getImage, but if it couldn't find a matching image in the cache, it will create one with the given parameters.
@@ -207,7 +214,7 @@ public:
     bool getImageOrCreate(const ImageKey & key, const ImageParamsPtr& params,
                           ImagePtr* returnValue) const;
 
-    bool getImage_diskCache(const ImageKey & key, std::list<ImagePtr>* returnValue) const;
+    bool getImage_diskCache(const ImageKey & key, std::list<ImagePtr>* returnValue, int mipMapLevel = -1) const;
 
     bool getImageOrCreate_diskCache(const ImageKey & key, const ImageParamsPtr& params,
                                     ImagePtr* returnValue) const;
@@ -221,11 +228,72 @@ public:
 
 
     U64 getCachesTotalMemorySize() const;
+
+    /**
+     * @brief Returns the memory reserved by the allocator of the image buffers, including idle buffers kept for
+     * later allocations, and the memory actually in use.
+     **/
+    void getImageBuffersMemoryStats(U64* reservedBytes, U64* inUseBytes) const;
+
+    /**
+     * @brief Returns the memory of the large image buffers mapped while huge pages were enabled and how much of it
+     * is backed by huge pages.
+     **/
+    void getImageBuffersHugePagesStats(U64* requestedBytes, U64* hugePageBytes) const;
+
+    void setImageBuffersHugePagesEnabled(bool enabled);
+
     U64 getCachesTotalDiskSize() const;
+
+    /**
+     * @brief Returns the hit/miss/eviction counters of the node cache, the DiskCache nodes cache and the viewer cache,
+     * in total, per node and per mip-map level, one counter per line.
+     **/
+    std::string getCachesStatisticsReport() const;
+
+    /**
+     * @brief Same as getCachesStatisticsReport() but as a map: cache name -> scope -> counter name -> value.
+     **/
+    QVariantMap getCachesStatistics() const;
+
+    void resetCachesStatistics();
+
     CacheSignalEmitterPtr getOrActivateViewerCacheSignalEmitter() const;
 
     void setApplicationsCachesMaximumMemoryPercent(double p);
 
+    void setApplicationsCachesCompression(bool enabled, bool packHalfFloat);
+
+    void setApplicationsCachesCostAwareEviction(bool enabled);
+
+    void setApplicationsCachesFreeOnIdle(bool enabled);
+
+    /**
+     * @brief Sets the portion of the memory budget set in the settings that the memory caches may use, see
+     * CacheMemoryBudgetThread. Entries are evicted right away if the caches are above their new budget.
+     **/
+    void setApplicationsCachesMemoryBudgetFactor(double factor);
+
+    /**
+     * @brief Returns the maximum size of the memory caches, taking into account the memory limit and pressure of the
+     * control group of the process.
+     **/
+    U64 getCachesMemoryBudget() const;
+
+    /**
+     * @brief If enabled and the process belongs to a control group with a memory controller, the memory budget of the
+     * caches follows the memory pressure of the control group.
+     **/
+    void setCachesMemoryPressureAdaptationEnabled(bool enabled);
+
+    /**
+     * @brief If enabled, the node cache stores the output of the nodes as fixed-size tiles instead of entire images,
+     * see ImageTiles. Images already in the node cache are kept until evicted.
+     **/
+    void setNodeCacheTiled(bool tiled);
+
+    bool isNodeCacheTiled() const;
+
     void setApplicationsCachesMaximumViewerDiskSpace(unsigned long long size);
 
     void setApplicationsCachesMaximumDiskSpace(unsigned long long size);
@@ -235,6 +303,18 @@ public:
 
     void removeFromNodeCache(U64 hash);
     void removeFromViewerCache(U64 hash);
+
+    /**
+     * @brief Returns true if the node cache is shared with the other processes of this computer, see
+     * Settings::isSharedNodeCacheEnabled()
+     **/
+    bool isNodeCacheShared() const;
+
+    /**
+     * @brief Makes an image of the node cache available to the other processes sharing the node cache, once it is
+     * entirely rendered. Does nothing otherwise.
+     **/
+    void publishImageToSharedNodeCache(const ImagePtr & image) const;
     /**
      * @brief Given the following tree version, removes all images from the node cache with a matching
      * tree version. This is useful to wipe the cache for one particular node.
@@ -498,6 +578,8 @@ public:
     OFX::Host::ImageEffect::Descriptor* getPluginContextAndDescribe(OFX::Host::ImageEffect::ImageEffectPlugin* plugin,
                                                                     ContextEnum* ctx);
     AppTLS* getAppTLS() const;
+    WorkStealingScheduler* getRenderScheduler() const;
+    AdaptiveTileSplitter* getTileSplitter() const;
     const OfxHost* getOFXHost() const;
     GPUContextPool* getGPUContextPool() const;
 
@@ -36,7 +36,9 @@
 #include <cstddef>
 #include <cstdlib>
 #include <cassert>
+#include <algorithm> // min, max
 #include <stdexcept>
+#include <iostream>
 #include <sstream> // stringstream
 
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
@@ -66,6 +68,7 @@ GCC_DIAG_ON(unused-parameter)
 #include "Engine/Format.h"
 #include "Engine/FrameEntry.h"
 #include "Engine/Image.h"
+#include "Engine/MemoryInfo.h" // refreshCgroupMemoryInfo
 #include "Engine/OfxHost.h"
 #include "Engine/OSGLContext.h"
 #include "Engine/ProcessHandler.h" // ProcessInputChannel
@@ -99,9 +102,16 @@ AppManagerPrivate::AppManagerPrivate()
     , _nodeCache()
     , _diskCache()
     , _viewerCache()
+    , costAwareEvictionPolicy()
     , diskCachesLocationMutex()
     , diskCachesLocation()
     , _backgroundIPC()
+    , cacheStatisticsDumpThread()
+    , renderTraceEnabled(false)
+    , cacheMemoryBudgetThread()
+    , cacheMemoryBudgetMutex()
+    , cacheMemoryBudgetFactor(1.)
+    , nodeCacheTiled(0)
     , _loaded(false)
     , _binaryPath()
     , _nodesGlobalMemoryUse(0)
@@ -115,6 +125,8 @@ AppManagerPrivate::AppManagerPrivate()
     , nThreadsPerEffect(0)
     , useThreadPool(true)
     , nThreadsMutex()
+    , renderScheduler()
+    , tileSplitter()
     , runningThreadsCount()
     , lastProjectLoadedCreatedDuringRC2Or3(false)
     , commandLineArgsUtf8()
@@ -316,26 +328,134 @@ template <typename T>
 void
 saveCache(Cache<T>* cache)
 {
-    std::string cacheRestoreFilePath = cache->getRestoreFilePath();
-    FStreamsSupport::ofstream ofile;
-    FStreamsSupport::open(&ofile, cacheRestoreFilePath);
+    typename Cache<T>::CacheTOC toc;
+    cache->save(&toc);
+    try {
+        cache->writeIndex(toc);
+    } catch (const std::exception & e) {
+        qDebug() << "Failed to write the disk cache index:" << e.what();
+    }
+}
+
+CacheStatisticsDumpThread::CacheStatisticsDumpThread(int intervalSeconds)
+    : QThread()
+    , _intervalSeconds(intervalSeconds)
+    , _mustQuitMutex()
+    , _mustQuitCond()
+    , _mustQuit(false)
+{
+    setObjectName( QString::fromUtf8("CacheStatisticsDump") );
+}
 
-    if (!ofile) {
-        std::cerr << "Failed to save cache to " << cacheRestoreFilePath.c_str() << std::endl;
+CacheStatisticsDumpThread::~CacheStatisticsDumpThread()
+{
+    quitThread();
+}
 
+void
+CacheStatisticsDumpThread::quitThread()
+{
+    if ( !isRunning() ) {
         return;
     }
+    {
+        QMutexLocker k(&_mustQuitMutex);
+        _mustQuit = true;
+        _mustQuitCond.wakeOne();
+    }
+    wait();
+}
+
+void
+CacheStatisticsDumpThread::run()
+{
+    for (;;) {
+        bool mustQuit;
+        {
+            QMutexLocker k(&_mustQuitMutex);
+            if (!_mustQuit) {
+                _mustQuitCond.wait(&_mustQuitMutex, _intervalSeconds * 1000);
+            }
+            mustQuit = _mustQuit;
+        }
+        std::cout << appPTR->getCachesStatisticsReport() << std::flush;
+        if (mustQuit) {
+            return;
+        }
+    }
+}
+
+CacheMemoryBudgetThread::CacheMemoryBudgetThread()
+    : QThread()
+    , _mustQuitMutex()
+    , _mustQuitCond()
+    , _mustQuit(false)
+{
+    setObjectName( QString::fromUtf8("CacheMemoryBudget") );
+}
 
+CacheMemoryBudgetThread::~CacheMemoryBudgetThread()
+{
+    quitThread();
+}
 
-    typename Cache<T>::CacheTOC toc;
-    cache->save(&toc);
-    unsigned int version = cache->cacheVersion();
-    try {
-        boost::archive::binary_oarchive oArchive(ofile);
-        oArchive << version;
-        oArchive << toc;
-    } catch (const std::exception & e) {
-        qDebug() << "Failed to serialize the cache table of contents:" << e.what();
+void
+CacheMemoryBudgetThread::quitThread()
+{
+    if ( !isRunning() ) {
+        return;
+    }
+    {
+        QMutexLocker k(&_mustQuitMutex);
+        _mustQuit = true;
+        _mustQuitCond.wakeOne();
+    }
+    wait();
+}
+
+void
+CacheMemoryBudgetThread::run()
+{
+    double budgetFactor = 1.;
+    U64 limit = 0;
+    CgroupMemoryInfo info;
+
+    refreshCgroupMemoryInfo(&info);
+    U64 limitReachedCount = info.limitReachedCount;
+
+    for (;;) {
+        {
+            QMutexLocker k(&_mustQuitMutex);
+            if (!_mustQuit) {
+                _mustQuitCond.wait(&_mustQuitMutex, NATRON_CACHE_MEMORY_BUDGET_INTERVAL_MS);
+            }
+            if (_mustQuit) {
+                return;
+            }
+        }
+
+        // This also refreshes the values returned by getCgroupMemoryInfo() to the rest of the application
+        if ( !refreshCgroupMemoryInfo(&info) ) {
+            continue;
+        }
+        bool limitReached = info.limitReachedCount > limitReachedCount;
+        limitReachedCount = info.limitReachedCount;
+
+        double newBudgetFactor = budgetFactor;
+        if ( limitReached || (info.pressure >= NATRON_CACHE_MEMORY_PRESSURE_STALL_PERCENT) ||
+             ( info.limit && (info.usage >= info.limit * NATRON_CACHE_MEMORY_PRESSURE_USAGE) ) ) {
+            newBudgetFactor = std::max(NATRON_CACHE_MEMORY_PRESSURE_MIN_BUDGET, budgetFactor * NATRON_CACHE_MEMORY_PRESSURE_SHRINK);
+        } else if ( (info.pressure < NATRON_CACHE_MEMORY_PRESSURE_STALL_PERCENT / 2) &&
+                    ( !info.limit || (info.usage < info.limit * NATRON_CACHE_MEMORY_RELIEF_USAGE) ) ) {
+            newBudgetFactor = std::min(1., budgetFactor + NATRON_CACHE_MEMORY_PRESSURE_GROW);
+        }
+
+        // The limit of a running container may be changed too
+        if ( (newBudgetFactor != budgetFactor) || (info.limit != limit) ) {
+            budgetFactor = newBudgetFactor;
+            limit = info.limit;
+            appPTR->setApplicationsCachesMemoryBudgetFactor(budgetFactor);
+        }
     }
 }
 
@@ -353,39 +473,30 @@ void
 restoreCache(AppManagerPrivate* p,
              Cache<T>* cache)
 {
-    if ( p->checkForCacheDiskStructure( cache->getCachePath(), cache->isTileCache() ) ) {
-        std::string settingsFilePath = cache->getRestoreFilePath();
-        FStreamsSupport::ifstream ifile;
-        FStreamsSupport::open(&ifile, settingsFilePath);
-        if (!ifile) {
-            std::cerr << "Failure to open cache restore file at: " << settingsFilePath << std::endl;
+    typename Cache<T>::CacheTOC tableOfContents;
+    bool indexRead = false;
 
-            return;
-        }
-        typename Cache<T>::CacheTOC tableOfContents;
-        unsigned int cacheVersion = 0x1; //< default to 1 before NATRON_CACHE_VERSION was introduced
+    if ( p->checkForCacheDiskStructure( cache->getCachePath(), cache->isTileCache() ) ) {
         try {
-            boost::archive::binary_iarchive iArchive(ifile);
-            if (cache->cacheVersion() >= NATRON_CACHE_VERSION) {
-                iArchive >> cacheVersion;
-            }
-            //Only load caches with same version, otherwise wipe it!
-            if ( cacheVersion == cache->cacheVersion() ) {
-                iArchive >> tableOfContents;
-            } else {
-                p->cleanUpCacheDiskStructure( cache->getCachePath(), cache->isTileCache() );
-            }
+            indexRead = cache->openIndex(&tableOfContents);
         } catch (const std::exception & e) {
-            qDebug() << "Exception when reading disk cache TOC:" << e.what();
+            qDebug() << "Exception when reading the disk cache index:" << e.what();
+        }
+        if (!indexRead) {
+            //The index was written by another version or is unreadable: the files on disk are not referenced anymore
+            cache->closeIndex();
             p->cleanUpCacheDiskStructure( cache->getCachePath(), cache->isTileCache() );
-
-            return;
         }
+    }
 
-        QFile restoreFile( QString::fromUtf8( settingsFilePath.c_str() ) );
-        restoreFile.remove();
-
-        cache->restore(tableOfContents);
+    try {
+        if (indexRead) {
+            cache->restore(tableOfContents);
+        } else {
+            cache->createIndex();
+        }
+    } catch (const std::exception & e) {
+        qDebug() << "Failed to restore the disk cache index:" << e.what();
     }
 }
 
@@ -404,7 +515,7 @@ AppManagerPrivate::checkForCacheDiskStructure(const QString & cachePath, bool is
     if ( !settingsFilePath.endsWith( QChar::fromLatin1('/') ) ) {
         settingsFilePath += QChar::fromLatin1('/');
     }
-    settingsFilePath += QString::fromUtf8("restoreFile." NATRON_CACHE_FILE_EXT);
+    settingsFilePath += QString::fromUtf8(NATRON_CACHE_INDEX_FILE_NAME);
 
     if ( !QFile::exists(settingsFilePath) ) {
         cleanUpCacheDiskStructure(cachePath, isTiled);
@@ -43,6 +43,8 @@
 #include <QtCore/QString>
 #include <QtCore/QAtomicInt>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
 
 
 #if defined(Q_OS_LINUX) || defined(Q_OS_FREEBSD)
@@ -53,6 +55,7 @@
 #include "Engine/OSGLContext_mac.h"
 #endif
 
+#include "Engine/AdaptiveTileSplitter.h"
 #include "Engine/AppManager.h"
 #include "Engine/Cache.h"
 #include "Engine/FrameEntry.h"
@@ -60,6 +63,7 @@
 #include "Engine/GPUContextPool.h"
 #include "Engine/GenericSchedulerThreadWatcher.h"
 #include "Engine/TLSHolder.h"
+#include "Engine/WorkStealingScheduler.h"
 
 // include breakpad after Engine, because it includes /usr/include/AssertMacros.h on OS X which defines a check(x) macro, which conflicts with boost
 #ifdef NATRON_USE_BREAKPAD
@@ -78,8 +82,86 @@ GCC_DIAG_ON(deprecated)
 
 #include "Engine/EngineFwd.h"
 
+///Interval (in milliseconds) at which the memory limit and pressure of the control group of the process are checked
+#define NATRON_CACHE_MEMORY_BUDGET_INTERVAL_MS 1000
+
+///Portion of the memory limit of the control group above which the memory budget of the caches is shrunk
+#define NATRON_CACHE_MEMORY_PRESSURE_USAGE 0.9
+
+///Portion of the memory limit of the control group under which the memory budget of the caches may grow back
+#define NATRON_CACHE_MEMORY_RELIEF_USAGE 0.8
+
+///Percentage of time processes of the control group were stalled waiting for memory above which the budget is shrunk
+#define NATRON_CACHE_MEMORY_PRESSURE_STALL_PERCENT 10.
+
+///Factor applied to the memory budget of the caches at each check under pressure
+#define NATRON_CACHE_MEMORY_PRESSURE_SHRINK 0.75
+
+///Lowest portion of the configured memory budget of the caches that pressure may leave
+#define NATRON_CACHE_MEMORY_PRESSURE_MIN_BUDGET 0.1
+
+///Portion of the configured memory budget of the caches given back at each check without pressure
+#define NATRON_CACHE_MEMORY_PRESSURE_GROW 0.05
+
 NATRON_NAMESPACE_ENTER
 
+/**
+ * @brief Prints the cache statistics on the standard output at a regular interval, see the --cache-stats
+ * command-line option. The statistics are printed a last time when the thread is stopped.
+ **/
+class CacheStatisticsDumpThread
+    : public QThread
+{
+public:
+
+    CacheStatisticsDumpThread(int intervalSeconds);
+
+    virtual ~CacheStatisticsDumpThread();
+
+    /**
+     * @brief Stops the thread and waits for it to return. Must be called before the caches are destroyed.
+     **/
+    void quitThread();
+
+private:
+
+    virtual void run() OVERRIDE FINAL;
+
+    int _intervalSeconds;
+    QMutex _mustQuitMutex;
+    QWaitCondition _mustQuitCond;
+    bool _mustQuit;
+};
+
+/**
+ * @brief Adapts the memory budget of the caches to the memory limit and pressure of the control group of the process,
+ * e.g: when rendering in a container, so that the caches do not get the process killed for running out of memory.
+ * The budget is shrunk as soon as the memory usage gets close to the limit, the limit is reached or processes stall
+ * waiting for memory, and grows back slowly once the pressure is gone.
+ **/
+class CacheMemoryBudgetThread
+    : public QThread
+{
+public:
+
+    CacheMemoryBudgetThread();
+
+    virtual ~CacheMemoryBudgetThread();
+
+    /**
+     * @brief Stops the thread and waits for it to return. Must be called before the caches are destroyed.
+     **/
+    void quitThread();
+
+private:
+
+    virtual void run() OVERRIDE FINAL;
+
+    QMutex _mustQuitMutex;
+    QWaitCondition _mustQuitCond;
+    bool _mustQuit;
+};
+
 struct AppManagerPrivate
 {
     Q_DECLARE_TR_FUNCTIONS(AppManagerPrivate)
@@ -106,9 +188,16 @@ public:
     ImageCachePtr _nodeCache; //< Images cache
     ImageCachePtr _diskCache; //< Images disk cache (used by DiskCache nodes)
     FrameEntryCachePtr _viewerCache; //< Viewer textures cache
+    CacheEvictionPolicyPtr costAwareEvictionPolicy; //< kept across eviction policy switches so that its clock is preserved
     mutable QMutex diskCachesLocationMutex;
     QString diskCachesLocation;
     boost::scoped_ptr<ProcessInputChannel> _backgroundIPC; //< object used to communicate with the main app
+    boost::scoped_ptr<CacheStatisticsDumpThread> cacheStatisticsDumpThread; //< only in background mode with --cache-stats
+    bool renderTraceEnabled; //< true with --render-trace
+    boost::scoped_ptr<CacheMemoryBudgetThread> cacheMemoryBudgetThread; //< only in a control group with a memory controller
+    mutable QMutex cacheMemoryBudgetMutex; //< protects cacheMemoryBudgetFactor
+    double cacheMemoryBudgetFactor; //< portion of the memory budget set in the settings the caches may use under memory pressure
+    mutable QAtomicInt nodeCacheTiled; //< non-zero if the node cache stores tiles, see ImageTiles
     //if this app is background, see the ProcessInputChannel def
     bool _loaded; //< true when the first instance is completely loaded.
     QString _binaryPath; //< the path to the application's binary
@@ -124,6 +213,8 @@ public:
     int nThreadsPerEffect;  // the value held by the corresponding Knob in the Settings, stored here for faster access (3 RW lock vs 1 mutex here)
     bool useThreadPool; // whether the multi-thread suite should use the global thread pool (of QtConcurrent) or not
     mutable QMutex nThreadsMutex; // protects nThreadsToRender & nThreadsPerEffect & useThreadPool
+    boost::scoped_ptr<WorkStealingScheduler> renderScheduler; //< runs the tiles of renders using host frame threading
+    AdaptiveTileSplitter tileSplitter; //< splits the rectangles rendered using host frame threading in tiles
 
     //The idea here is to keep track of the number of threads launched by Natron (except the ones of the global thread pool of QtConcurrent)
     //So that we can properly have an estimation of how much the cores of the CPU are used.
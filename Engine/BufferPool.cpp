@@ -0,0 +1,781 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "BufferPool.h"
+
+#include <algorithm> // min
+#include <cstdlib> // malloc, free, atoi
+#include <cstring> // strncmp
+#include <fstream>
+#include <list>
+#include <map>
+#include <new> // bad_alloc
+#include <sstream> // ostringstream
+#include <vector>
+
+#ifdef __NATRON_LINUX__
+#include <dirent.h>
+#include <sched.h> // sched_getcpu
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThreadStorage>
+
+// log2 of NATRON_BUFFER_POOL_MIN_BYTES and NATRON_BUFFER_POOL_MAX_BYTES
+#define POOL_MIN_BYTES_LOG 14
+#define POOL_MAX_BYTES_LOG 28
+
+// Each power of 2 is split in 2^POOL_SUBCLASSES_LOG size classes
+#define POOL_SUBCLASSES_LOG 3
+
+#define POOL_N_CLASSES ( ( (POOL_MAX_BYTES_LOG - POOL_MIN_BYTES_LOG) << POOL_SUBCLASSES_LOG ) + 1 )
+
+// Memory is accounted in KiB so that it fits in a QAtomicInt
+#define POOL_DEFAULT_MAX_IDLE_KB 262144
+
+// Idle buffers are kept separately for each NUMA node, up to that many nodes
+#define POOL_MAX_NUMA_NODES 8
+
+#ifdef __NATRON_LINUX__
+// From <numaif.h>, which is not available everywhere
+#ifndef MPOL_F_NODE
+#define MPOL_F_NODE (1 << 0)
+#endif
+#ifndef MPOL_F_ADDR
+#define MPOL_F_ADDR (1 << 1)
+#endif
+#endif
+
+NATRON_NAMESPACE_ENTER
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+/**
+ * @brief Returns the size class of a buffer of nBytes and the size of the buffers of this class,
+ * or -1 if such buffers are not pooled, in which case classBytes is nBytes.
+ **/
+int
+getSizeClass(std::size_t nBytes,
+             std::size_t* classBytes)
+{
+    if ( (nBytes < NATRON_BUFFER_POOL_MIN_BYTES) || (nBytes > NATRON_BUFFER_POOL_MAX_BYTES) ) {
+        *classBytes = nBytes;
+
+        return -1;
+    }
+
+    int p = 0;
+    while ( (nBytes >> (p + 1)) != 0 ) {
+        ++p;
+    }
+
+    // Round up to the next multiple of a subclass step
+    std::size_t step = (std::size_t)1 << (p - POOL_SUBCLASSES_LOG);
+    std::size_t rounded = ( (nBytes + step - 1) / step ) * step;
+    if ( rounded == ( (std::size_t)1 << (p + 1) ) ) {
+        ++p;
+    }
+    *classBytes = rounded;
+
+    return ( (p - POOL_MIN_BYTES_LOG) << POOL_SUBCLASSES_LOG ) + (int)( rounded >> (p - POOL_SUBCLASSES_LOG) ) - (1 << POOL_SUBCLASSES_LOG);
+}
+
+std::size_t
+getClassBytes(int sizeClass)
+{
+    int p = POOL_MIN_BYTES_LOG + (sizeClass >> POOL_SUBCLASSES_LOG);
+    std::size_t m = (1 << POOL_SUBCLASSES_LOG) + ( sizeClass & ( (1 << POOL_SUBCLASSES_LOG) - 1 ) );
+
+    return m << (p - POOL_SUBCLASSES_LOG);
+}
+
+int
+toKB(std::size_t nBytes)
+{
+    return (int)( (nBytes + 1023) >> 10 );
+}
+
+struct ThreadCache
+{
+    // Only contended by releaseIdleMemory()
+    QMutex lock;
+    std::vector<void*> idleBuffers[POOL_N_CLASSES];
+    std::size_t idleBytes;
+
+    ThreadCache();
+
+    ~ThreadCache();
+};
+
+#ifdef __NATRON_LINUX__
+/**
+ * @brief A buffer mapped while huge pages were enabled
+ **/
+struct HugePageMapping
+{
+    // The length actually mapped, to be given to munmap()
+    std::size_t length;
+
+    // True if the mapping is backed by explicit huge pages, otherwise it is advised for transparent huge pages
+    bool explicitHugePages;
+};
+
+typedef std::map<char*, HugePageMapping> HugePageMappings;
+#endif
+
+struct GlobalPool
+{
+    // The NUMA node of each CPU, empty if the system has a single node
+    std::vector<int> cpuNodes;
+    int nNodes;
+
+    QMutex classLocks[POOL_N_CLASSES];
+    std::vector<void*> idleBuffers[POOL_MAX_NUMA_NODES][POOL_N_CLASSES];
+
+    // Idle memory of the global pool and of the thread caches, bounded by maximumIdleKB
+    QAtomicInt idleKB;
+    QAtomicInt maximumIdleKB;
+
+    // Memory in use plus idle memory, including the thread caches
+    QAtomicInt reservedKB;
+    QAtomicInt inUseKB;
+
+    // Protects threadCaches
+    QMutex threadCachesLock;
+    std::list<ThreadCache*> threadCaches;
+    QThreadStorage<ThreadCache*> localCache;
+
+    QAtomicInt hugePagesEnabled;
+
+#ifdef __NATRON_LINUX__
+    // Size of the explicit huge pages reserved by the system, 0 if unknown
+    std::size_t explicitHugePageBytes;
+    std::size_t systemPageBytes;
+
+    // Protects hugePageMappings
+    QMutex hugePageMappingsLock;
+    HugePageMappings hugePageMappings;
+#endif
+
+    GlobalPool()
+        : cpuNodes()
+        , nNodes(1)
+        , idleKB(0)
+        , maximumIdleKB(POOL_DEFAULT_MAX_IDLE_KB)
+        , reservedKB(0)
+        , inUseKB(0)
+        , threadCachesLock()
+        , threadCaches()
+        , localCache()
+        , hugePagesEnabled(0)
+#ifdef __NATRON_LINUX__
+        , explicitHugePageBytes(0)
+        , systemPageBytes( (std::size_t)sysconf(_SC_PAGESIZE) )
+        , hugePageMappingsLock()
+        , hugePageMappings()
+#endif
+    {
+        readNumaTopology();
+        readExplicitHugePageSize();
+    }
+
+    void readExplicitHugePageSize()
+    {
+#ifdef __NATRON_LINUX__
+        // e.g: "Hugepagesize:       2048 kB", this may be 1 GB
+        std::ifstream meminfo("/proc/meminfo");
+        std::string line;
+        while ( std::getline(meminfo, line) ) {
+            if (line.compare(0, 13, "Hugepagesize:") == 0) {
+                explicitHugePageBytes = (std::size_t)std::atol( line.c_str() + 13 ) * 1024;
+                break;
+            }
+        }
+#endif
+    }
+
+    void readNumaTopology()
+    {
+#ifdef __NATRON_LINUX__
+        std::vector<int> nodes;
+        int maxNode = 0;
+        for (int cpu = 0;; ++cpu) {
+            std::ostringstream path;
+            path << "/sys/devices/system/cpu/cpu" << cpu;
+            DIR* dir = opendir( path.str().c_str() );
+            if (!dir) {
+                break;
+            }
+            int node = 0;
+            for (struct dirent* e = readdir(dir); e; e = readdir(dir)) {
+                if ( (std::strncmp(e->d_name, "node", 4) == 0) && (e->d_name[4] >= '0') && (e->d_name[4] <= '9') ) {
+                    node = std::min(std::atoi(e->d_name + 4), POOL_MAX_NUMA_NODES - 1);
+                    break;
+                }
+            }
+            closedir(dir);
+            nodes.push_back(node);
+            maxNode = std::max(maxNode, node);
+        }
+        if (maxNode > 0) {
+            cpuNodes = nodes;
+            nNodes = maxNode + 1;
+        }
+#endif
+    }
+};
+
+// Never destroyed: buffers may be freed by threads still running during the static destruction
+GlobalPool* pool = new GlobalPool;
+
+/**
+ * @brief Returns the NUMA node of the CPU the calling thread is running on
+ **/
+int
+getCurrentNode()
+{
+#ifdef __NATRON_LINUX__
+    if ( !pool->cpuNodes.empty() ) {
+        int cpu = sched_getcpu();
+        if ( (cpu >= 0) && ( cpu < (int)pool->cpuNodes.size() ) ) {
+            return pool->cpuNodes[cpu];
+        }
+    }
+#endif
+
+    return 0;
+}
+
+/**
+ * @brief Returns the NUMA node holding the memory of the given buffer. A buffer that was never written
+ * has no node yet: the node of the calling thread is returned.
+ **/
+int
+getBufferNode(void* ptr)
+{
+#ifdef __NATRON_LINUX__
+    if (pool->nNodes > 1) {
+        // get_mempolicy() allocates the page if it is not resident: only query pages that were touched
+        char* page = (char*)( ( (std::size_t)ptr / pool->systemPageBytes ) * pool->systemPageBytes );
+        unsigned char resident = 0;
+        int node = -1;
+        if ( (mincore(page, pool->systemPageBytes, &resident) == 0) && (resident & 1) &&
+             (syscall(SYS_get_mempolicy, &node, (unsigned long*)0, 0UL, ptr, (unsigned long)(MPOL_F_NODE | MPOL_F_ADDR) ) == 0) &&
+             (node >= 0) && (node < pool->nNodes) ) {
+            return node;
+        }
+
+        return getCurrentNode();
+    }
+#else
+    Q_UNUSED(ptr);
+#endif
+
+    return 0;
+}
+
+#ifdef __NATRON_LINUX__
+std::size_t
+roundUp(std::size_t nBytes,
+        std::size_t multiple)
+{
+    return ( (nBytes + multiple - 1) / multiple ) * multiple;
+}
+
+/**
+ * @brief Maps length bytes aligned on a huge page, so that transparent huge pages can back the whole mapping
+ **/
+void*
+mapAligned(std::size_t length)
+{
+    std::size_t paddedLength = length + NATRON_BUFFER_POOL_HUGE_PAGE_BYTES;
+    void* mapped = mmap(0, paddedLength, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mapped == MAP_FAILED) {
+        return 0;
+    }
+
+    // Unmap the unaligned head and the tail
+    char* begin = (char*)mapped;
+    char* aligned = (char*)roundUp( (std::size_t)begin, NATRON_BUFFER_POOL_HUGE_PAGE_BYTES );
+    if (aligned > begin) {
+        munmap(begin, aligned - begin);
+    }
+    char* end = begin + paddedLength;
+    if (end > aligned + length) {
+        munmap(aligned + length, end - (aligned + length) );
+    }
+
+    return aligned;
+}
+
+/**
+ * @brief Maps a buffer of nBytes backed by huge pages. Explicit huge pages are used if the system reserved some and
+ * rounding the buffer to their size wastes at most 1/8th of it, otherwise the buffer is advised for transparent huge pages.
+ * The mapping is recorded in hugePageMappings.
+ **/
+void*
+mapHugePages(std::size_t nBytes)
+{
+    HugePageMapping mapping;
+    void* ret = 0;
+
+#ifdef MAP_HUGETLB
+    if (pool->explicitHugePageBytes > 0) {
+        mapping.length = roundUp(nBytes, pool->explicitHugePageBytes);
+        if (mapping.length - nBytes <= nBytes / 8) {
+            void* mapped = mmap(0, mapping.length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mapped != MAP_FAILED) {
+                ret = mapped;
+                mapping.explicitHugePages = true;
+            }
+        }
+    }
+#endif
+    if (!ret) {
+        mapping.length = roundUp(nBytes, pool->systemPageBytes);
+        mapping.explicitHugePages = false;
+        ret = mapAligned(mapping.length);
+        if (!ret) {
+            return 0;
+        }
+#ifdef MADV_HUGEPAGE
+        // The kernel may still back the buffer with small pages, see getHugePagesStats()
+        madvise(ret, mapping.length, MADV_HUGEPAGE);
+#endif
+    }
+
+    QMutexLocker k(&pool->hugePageMappingsLock);
+    pool->hugePageMappings.insert( std::make_pair( (char*)ret, mapping ) );
+
+    return ret;
+}
+
+#endif // __NATRON_LINUX__
+
+/**
+ * @brief Allocates a buffer from the system. Large buffers are mapped with huge pages if enabled, otherwise
+ * they are allocated with malloc, which maps them without touching them in most cases: their pages are placed on
+ * the NUMA node of the thread that writes them first.
+ **/
+void*
+systemAllocate(std::size_t nBytes)
+{
+#ifdef __NATRON_LINUX__
+    if ( (nBytes >= NATRON_BUFFER_POOL_HUGE_PAGE_BYTES) && pool->hugePagesEnabled.fetchAndAddRelaxed(0) ) {
+        return mapHugePages(nBytes);
+    }
+#endif
+
+    return malloc(nBytes);
+}
+
+void
+systemFree(void* ptr,
+           std::size_t nBytes)
+{
+#ifdef __NATRON_LINUX__
+    // The buffer may have been allocated before huge pages were disabled
+    if (nBytes >= NATRON_BUFFER_POOL_HUGE_PAGE_BYTES) {
+        std::size_t length = 0;
+        {
+            QMutexLocker k(&pool->hugePageMappingsLock);
+            HugePageMappings::iterator found = pool->hugePageMappings.find( (char*)ptr );
+            if ( found != pool->hugePageMappings.end() ) {
+                length = found->second.length;
+                pool->hugePageMappings.erase(found);
+            }
+        }
+        if (length > 0) {
+            munmap(ptr, length);
+
+            return;
+        }
+    }
+#else
+    Q_UNUSED(nBytes);
+#endif
+    free(ptr);
+}
+
+ThreadCache::ThreadCache()
+    : lock()
+    , idleBytes(0)
+{
+    QMutexLocker k(&pool->threadCachesLock);
+
+    pool->threadCaches.push_back(this);
+}
+
+/**
+ * @brief Frees a buffer of the given class, or keeps it in the global pool if the pool has room for it.
+ * The buffer must not be counted in the idle memory yet.
+ **/
+void
+giveToGlobalPool(int sizeClass,
+                 void* ptr,
+                 std::size_t classBytes)
+{
+    int kb = toKB(classBytes);
+
+    if ( pool->idleKB.fetchAndAddRelaxed(kb) + kb <= pool->maximumIdleKB.fetchAndAddRelaxed(0) ) {
+        int node = getBufferNode(ptr);
+        QMutexLocker k(&pool->classLocks[sizeClass]);
+        pool->idleBuffers[node][sizeClass].push_back(ptr);
+
+        return;
+    }
+    pool->idleKB.fetchAndAddRelaxed(-kb);
+    pool->reservedKB.fetchAndAddRelaxed(-kb);
+    systemFree(ptr, classBytes);
+}
+
+ThreadCache::~ThreadCache()
+{
+    {
+        QMutexLocker k(&pool->threadCachesLock);
+        pool->threadCaches.remove(this);
+    }
+    for (int i = 0; i < POOL_N_CLASSES; ++i) {
+        std::size_t classBytes = getClassBytes(i);
+        int kb = toKB(classBytes);
+        for (std::size_t j = 0; j < idleBuffers[i].size(); ++j) {
+            pool->idleKB.fetchAndAddRelaxed(-kb);
+            giveToGlobalPool(i, idleBuffers[i][j], classBytes);
+        }
+    }
+}
+
+/**
+ * @brief Gives back to the system the idle buffers of the thread caches, largest first, until the idle memory
+ * fits in maximumIdleKB.
+ **/
+void
+trimThreadCaches(int maximumIdleKB)
+{
+    QMutexLocker k(&pool->threadCachesLock);
+
+    for (int i = POOL_N_CLASSES - 1; i >= 0 && pool->idleKB.fetchAndAddRelaxed(0) > maximumIdleKB; --i) {
+        std::size_t classBytes = getClassBytes(i);
+        int kb = toKB(classBytes);
+        for (std::list<ThreadCache*>::iterator it = pool->threadCaches.begin(); it != pool->threadCaches.end(); ++it) {
+            QMutexLocker k2(&(*it)->lock);
+            std::vector<void*>& idle = (*it)->idleBuffers[i];
+            while ( !idle.empty() && (pool->idleKB.fetchAndAddRelaxed(0) > maximumIdleKB) ) {
+                systemFree(idle.back(), classBytes);
+                idle.pop_back();
+                (*it)->idleBytes -= classBytes;
+                pool->idleKB.fetchAndAddRelaxed(-kb);
+                pool->reservedKB.fetchAndAddRelaxed(-kb);
+            }
+        }
+    }
+}
+
+ThreadCache*
+getThreadCache()
+{
+    if ( !pool->localCache.hasLocalData() ) {
+        pool->localCache.setLocalData(new ThreadCache);
+    }
+
+    return pool->localCache.localData();
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+namespace BufferPool {
+void*
+allocate(std::size_t nBytes)
+{
+    std::size_t classBytes;
+    int sizeClass = getSizeClass(nBytes, &classBytes);
+    int kb = toKB(classBytes);
+
+    if (sizeClass != -1) {
+        ThreadCache* cache = getThreadCache();
+        {
+            QMutexLocker k(&cache->lock);
+            std::vector<void*>& idle = cache->idleBuffers[sizeClass];
+            if ( !idle.empty() ) {
+                void* ret = idle.back();
+                idle.pop_back();
+                cache->idleBytes -= classBytes;
+                pool->idleKB.fetchAndAddRelaxed(-kb);
+                pool->inUseKB.fetchAndAddRelaxed(kb);
+
+                return ret;
+            }
+        }
+        {
+            // Prefer buffers whose memory is on the node of the calling thread
+            int currentNode = getCurrentNode();
+            QMutexLocker k(&pool->classLocks[sizeClass]);
+            for (int i = 0; i < pool->nNodes; ++i) {
+                std::vector<void*>& idle = pool->idleBuffers[(currentNode + i) % pool->nNodes][sizeClass];
+                if ( !idle.empty() ) {
+                    void* ret = idle.back();
+                    idle.pop_back();
+                    pool->idleKB.fetchAndAddRelaxed(-kb);
+                    pool->inUseKB.fetchAndAddRelaxed(kb);
+
+                    return ret;
+                }
+            }
+        }
+    }
+
+    void* ret = systemAllocate(classBytes);
+    if (!ret) {
+        throw std::bad_alloc();
+    }
+    pool->reservedKB.fetchAndAddRelaxed(kb);
+    pool->inUseKB.fetchAndAddRelaxed(kb);
+
+    return ret;
+}
+
+void
+deallocate(void* ptr,
+           std::size_t nBytes)
+{
+    if (!ptr) {
+        return;
+    }
+
+    std::size_t classBytes;
+    int sizeClass = getSizeClass(nBytes, &classBytes);
+    int kb = toKB(classBytes);
+
+    pool->inUseKB.fetchAndAddRelaxed(-kb);
+
+    if (sizeClass != -1) {
+        ThreadCache* cache = getThreadCache();
+        {
+            // The thread caches share the idle memory budget with the global pool
+            QMutexLocker k(&cache->lock);
+            if (cache->idleBytes + classBytes <= NATRON_BUFFER_POOL_THREAD_CACHE_BYTES) {
+                if ( pool->idleKB.fetchAndAddRelaxed(kb) + kb <= pool->maximumIdleKB.fetchAndAddRelaxed(0) ) {
+                    cache->idleBuffers[sizeClass].push_back(ptr);
+                    cache->idleBytes += classBytes;
+
+                    return;
+                }
+                pool->idleKB.fetchAndAddRelaxed(-kb);
+            }
+        }
+        giveToGlobalPool(sizeClass, ptr, classBytes);
+
+        return;
+    }
+
+    pool->reservedKB.fetchAndAddRelaxed(-kb);
+    systemFree(ptr, classBytes);
+}
+
+std::size_t
+getAllocationSize(std::size_t nBytes)
+{
+    std::size_t classBytes;
+
+    getSizeClass(nBytes, &classBytes);
+
+    return classBytes;
+}
+
+void
+getMemoryStats(U64* reservedBytes,
+               U64* inUseBytes)
+{
+    *reservedBytes = (U64)pool->reservedKB.fetchAndAddRelaxed(0) << 10;
+    *inUseBytes = (U64)pool->inUseKB.fetchAndAddRelaxed(0) << 10;
+}
+
+void
+setMaximumIdleBytes(U64 maximumIdleBytes)
+{
+    int maximumIdleKB = (int)std::min( (U64)(maximumIdleBytes >> 10), (U64)0x7fffffff );
+
+    pool->maximumIdleKB.fetchAndStoreRelaxed(maximumIdleKB);
+
+    // Free the largest idle buffers first until the pool fits
+    for (int i = POOL_N_CLASSES - 1; i >= 0 && pool->idleKB.fetchAndAddRelaxed(0) > maximumIdleKB; --i) {
+        std::vector<void*> toFree;
+        int kb = toKB( getClassBytes(i) );
+        {
+            QMutexLocker k(&pool->classLocks[i]);
+            for (int n = 0; n < pool->nNodes; ++n) {
+                std::vector<void*>& idle = pool->idleBuffers[n][i];
+                while ( !idle.empty() && (pool->idleKB.fetchAndAddRelaxed(0) > maximumIdleKB) ) {
+                    toFree.push_back( idle.back() );
+                    idle.pop_back();
+                    pool->idleKB.fetchAndAddRelaxed(-kb);
+                    pool->reservedKB.fetchAndAddRelaxed(-kb);
+                }
+            }
+        }
+        for (std::size_t j = 0; j < toFree.size(); ++j) {
+            systemFree( toFree[j], getClassBytes(i) );
+        }
+    }
+
+    // Then the buffers kept by the threads
+    if (pool->idleKB.fetchAndAddRelaxed(0) > maximumIdleKB) {
+        trimThreadCaches(maximumIdleKB);
+    }
+}
+
+void
+setHugePagesEnabled(bool enabled)
+{
+    if ( pool->hugePagesEnabled.fetchAndStoreRelaxed(enabled ? 1 : 0) != (enabled ? 1 : 0) ) {
+        // Idle buffers were mapped with the previous mode
+        releaseIdleMemory();
+    }
+}
+
+void
+getHugePagesStats(U64* requestedBytes,
+                  U64* hugePageBytes)
+{
+    *requestedBytes = 0;
+    *hugePageBytes = 0;
+#ifdef __NATRON_LINUX__
+    QMutexLocker k(&pool->hugePageMappingsLock);
+    if ( pool->hugePageMappings.empty() ) {
+        return;
+    }
+
+    // Transparent huge pages are only allocated when the buffer is written, and may be split later:
+    // count the huge pages that actually back the mappings, see the AnonHugePages field of proc(5)
+    std::vector<std::pair<char*, char*> > thpRanges;
+    for (HugePageMappings::const_iterator it = pool->hugePageMappings.begin(); it != pool->hugePageMappings.end(); ++it) {
+        *requestedBytes += it->second.length;
+        if (it->second.explicitHugePages) {
+            *hugePageBytes += it->second.length;
+        } else {
+            thpRanges.push_back( std::make_pair(it->first, it->first + it->second.length) );
+        }
+    }
+    if ( thpRanges.empty() ) {
+        return;
+    }
+
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    std::size_t overlap = 0;
+    while ( std::getline(smaps, line) ) {
+        if (line.compare(0, 14, "AnonHugePages:") == 0) {
+            // Adjacent mappings may have been merged by the kernel in a single area
+            U64 anonHugePages = (U64)std::atol( line.c_str() + 14 ) * 1024;
+            *hugePageBytes += std::min( (U64)overlap, anonHugePages );
+            continue;
+        }
+        // Areas start with "start-end perms ..." in hexadecimal
+        std::size_t dash = line.find('-');
+        std::size_t space = line.find(' ');
+        if ( (dash == std::string::npos) || (space == std::string::npos) || (dash > space) ||
+             (line.find_first_not_of("0123456789abcdef") != dash) ) {
+            continue;
+        }
+        char* begin = (char*)std::strtoul(line.c_str(), 0, 16);
+        char* end = (char*)std::strtoul(line.c_str() + dash + 1, 0, 16);
+        overlap = 0;
+        for (std::size_t i = 0; i < thpRanges.size(); ++i) {
+            char* b = std::max(begin, thpRanges[i].first);
+            char* e = std::min(end, thpRanges[i].second);
+            if (e > b) {
+                overlap += e - b;
+            }
+        }
+    }
+#endif
+}
+
+void
+flushThreadCache()
+{
+    ThreadCache* cache = getThreadCache();
+    QMutexLocker k(&cache->lock);
+
+    for (int i = 0; i < POOL_N_CLASSES; ++i) {
+        std::size_t classBytes = getClassBytes(i);
+        int kb = toKB(classBytes);
+        for (std::size_t j = 0; j < cache->idleBuffers[i].size(); ++j) {
+            pool->idleKB.fetchAndAddRelaxed(-kb);
+            giveToGlobalPool(i, cache->idleBuffers[i][j], classBytes);
+        }
+        cache->idleBuffers[i].clear();
+    }
+    cache->idleBytes = 0;
+}
+
+void
+releaseIdleMemory()
+{
+    {
+        QMutexLocker k(&pool->threadCachesLock);
+        for (std::list<ThreadCache*>::iterator it = pool->threadCaches.begin(); it != pool->threadCaches.end(); ++it) {
+            QMutexLocker k2(&(*it)->lock);
+            for (int i = 0; i < POOL_N_CLASSES; ++i) {
+                int kb = toKB( getClassBytes(i) );
+                std::size_t classBytes = getClassBytes(i);
+                for (std::size_t j = 0; j < (*it)->idleBuffers[i].size(); ++j) {
+                    systemFree( (*it)->idleBuffers[i][j], classBytes );
+                    pool->idleKB.fetchAndAddRelaxed(-kb);
+                    pool->reservedKB.fetchAndAddRelaxed(-kb);
+                }
+                (*it)->idleBuffers[i].clear();
+            }
+            (*it)->idleBytes = 0;
+        }
+    }
+
+    for (int i = 0; i < POOL_N_CLASSES; ++i) {
+        std::vector<void*> toFree;
+        {
+            QMutexLocker k(&pool->classLocks[i]);
+            for (int n = 0; n < pool->nNodes; ++n) {
+                toFree.insert( toFree.end(), pool->idleBuffers[n][i].begin(), pool->idleBuffers[n][i].end() );
+                pool->idleBuffers[n][i].clear();
+            }
+        }
+        std::size_t classBytes = getClassBytes(i);
+        int kb = toKB(classBytes);
+        for (std::size_t j = 0; j < toFree.size(); ++j) {
+            systemFree(toFree[j], classBytes);
+            pool->idleKB.fetchAndAddRelaxed(-kb);
+            pool->reservedKB.fetchAndAddRelaxed(-kb);
+        }
+    }
+}
+} // namespace BufferPool
+
+NATRON_NAMESPACE_EXIT
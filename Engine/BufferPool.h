@@ -0,0 +1,125 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_BUFFERPOOL_H
+#define NATRON_ENGINE_BUFFERPOOL_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+///Buffers smaller than that are allocated with malloc, the system allocator handles them well
+#define NATRON_BUFFER_POOL_MIN_BYTES 16384
+
+///Buffers larger than that are allocated with malloc, they are too rare to be worth keeping around
+#define NATRON_BUFFER_POOL_MAX_BYTES 268435456
+
+///Maximum amount of idle memory kept by each thread for its own allocations, within the budget of BufferPool::setMaximumIdleBytes()
+#define NATRON_BUFFER_POOL_THREAD_CACHE_BYTES 67108864
+
+///Buffers of at least that size may be backed by huge pages, see BufferPool::setHugePagesEnabled()
+#define NATRON_BUFFER_POOL_HUGE_PAGE_BYTES 2097152
+
+///Fraction of the RAM cache size that may be kept idle by the pool, see BufferPool::setMaximumIdleBytes()
+#define NATRON_BUFFER_POOL_MAX_IDLE_PORTION 0.1
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Pooled allocator for the image buffers, see RamBuffer.
+ * Sizes are rounded up to a size class (8 classes per power of 2, so at most 12.5% of a buffer is wasted). Freed buffers
+ * are kept idle in a cache local to the thread that freed them, then in a global pool, and reused for allocations of
+ * the same size class, which avoids the contention and the fragmentation of the system allocator under heavy tiled rendering.
+ * The amount of idle memory is bounded by setMaximumIdleBytes() and idle memory is given back to the system
+ * by releaseIdleMemory().
+ * On NUMA systems, idle buffers are kept per node and reused preferably by threads running on the node holding their
+ * memory. Large buffers are not touched by the pool so that their pages are placed on the node of the thread
+ * that renders into them first.
+ * All functions are MT-safe.
+ **/
+namespace BufferPool
+{
+/**
+ * @brief Returns a buffer of at least nBytes.
+ * This function throws a std::bad_alloc upon failure.
+ **/
+void* allocate(std::size_t nBytes);
+
+/**
+ * @brief Gives back a buffer returned by allocate(nBytes), nBytes must be the same.
+ **/
+void deallocate(void* ptr, std::size_t nBytes);
+
+/**
+ * @brief Returns the number of bytes actually reserved by allocate(nBytes). Two sizes with the same allocation size
+ * can use the same buffer.
+ **/
+std::size_t getAllocationSize(std::size_t nBytes);
+
+/**
+ * @brief Returns the memory reserved by the allocator, i.e: the memory in use plus the idle buffers,
+ * and the memory in use.
+ **/
+void getMemoryStats(U64* reservedBytes, U64* inUseBytes);
+
+/**
+ * @brief Sets the maximum amount of idle memory kept by the global pool and the thread caches altogether.
+ * Idle buffers beyond that are given back to the system.
+ **/
+void setMaximumIdleBytes(U64 maximumIdleBytes);
+
+/**
+ * @brief If enabled, buffers of at least NATRON_BUFFER_POOL_HUGE_PAGE_BYTES are mapped with huge pages, which reduces
+ * the TLB misses when processing large images. Explicit huge pages are used when the system reserved some, otherwise
+ * the buffers are aligned and advised for transparent huge pages. If disabled, they are allocated with malloc.
+ * This is only implemented on Linux.
+ **/
+void setHugePagesEnabled(bool enabled);
+
+/**
+ * @brief Returns the memory of the buffers currently mapped while huge pages were enabled, idle buffers included,
+ * and how much of it is actually backed by huge pages. Transparent huge pages are read from /proc/self/smaps,
+ * this is not meant to be called at a high rate.
+ **/
+void getHugePagesStats(U64* requestedBytes, U64* hugePageBytes);
+
+/**
+ * @brief Moves the idle buffers cached by the calling thread to the global pool, so that other threads may reuse them.
+ * Threads that free buffers they do not allocate, such as the cache deleter threads, should call this once done.
+ **/
+void flushThreadCache();
+
+/**
+ * @brief Gives back all idle buffers, including the ones cached by the threads, to the system.
+ **/
+void releaseIdleMemory();
+}
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_BUFFERPOOL_H
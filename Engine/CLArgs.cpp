@@ -67,6 +67,8 @@ public:
     std::list<std::pair<int, std::pair<int, int> > > frameRanges;
     bool rangeSet;
     bool enableRenderStats;
+    bool enableRenderTrace;
+    int cacheStatsInterval;
     bool isEmpty;
     mutable QString imageFilename;
     QString breakpadPipeFilePath;
@@ -94,6 +96,8 @@ public:
         , frameRanges()
         , rangeSet(false)
         , enableRenderStats(false)
+        , enableRenderTrace(false)
+        , cacheStatsInterval(0)
         , isEmpty(true)
         , imageFilename()
         , breakpadPipeFilePath()
@@ -230,6 +234,8 @@ CLArgs::operator=(const CLArgs& other)
     _imp->frameRanges = other._imp->frameRanges;
     _imp->rangeSet = other._imp->rangeSet;
     _imp->enableRenderStats = other._imp->enableRenderStats;
+    _imp->enableRenderTrace = other._imp->enableRenderTrace;
+    _imp->cacheStatsInterval = other._imp->cacheStatsInterval;
     _imp->isEmpty = other._imp->isEmpty;
     _imp->imageFilename = other._imp->imageFilename;
     _imp->exportDocsPath = other._imp->exportDocsPath;
@@ -339,7 +345,19 @@ CLArgs::printUsage(const std::string& programName)
         "     breakdown contains information about each nodes, render times etc...\n"
         "     This option is useful for debugging purposes or to control that a render\n"
         "     is working correctly.\n"
-        "     **Please note** that it does not work when writing video files."
+        "     **Please note** that it does not work when writing video files.\n"
+        "  --render-trace\n"
+        "     Same as --render-stats, and also write the timeline of the render of\n"
+        "     each frame to a file with a -trace.json extension. It contains the\n"
+        "     time spent by each render thread in renderRoI, the render and\n"
+        "     getRegionOfDefinition actions, cache lookups, image conversions and\n"
+        "     disk cache reads, in the Chrome trace event format: open it in\n"
+        "     Perfetto (https://ui.perfetto.dev) or chrome://tracing.\n"
+        "  --cache-stats <seconds>\n"
+        "     Print the statistics of the caches (hits, misses, evictions, disk\n"
+        "     traffic, in total, per node and per mip-map level) on the standard\n"
+        "     output every given number of seconds, and once the render is done.\n"
+        "     This option is only used in background mode.\n"
         "Sample uses:\n"
         "  %1 /Users/Me/MyNatronProjects/MyProject.ntp\n"
         "  %1 -b -w MyWriter /Users/Me/MyNatronProjects/MyProject.ntp\n"
@@ -518,6 +536,18 @@ CLArgs::areRenderStatsEnabled() const
     return _imp->enableRenderStats;
 }
 
+bool
+CLArgs::isRenderTraceEnabled() const
+{
+    return _imp->enableRenderTrace;
+}
+
+int
+CLArgs::getCacheStatsInterval() const
+{
+    return _imp->cacheStatsInterval;
+}
+
 bool
 CLArgs::isPythonScript() const
 {
@@ -799,6 +829,33 @@ CLArgsPrivate::parse()
         }
     }
 
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("render-trace"), QString() );
+        if ( it != args.end() ) {
+            enableRenderStats = true;
+            enableRenderTrace = true;
+            args.erase(it);
+        }
+    }
+
+    {
+        QStringList::iterator it = hasToken( QString::fromUtf8("cache-stats"), QString() );
+        if ( it != args.end() ) {
+            it = args.erase(it);
+            bool ok = false;
+            if ( it != args.end() ) {
+                cacheStatsInterval = it->toInt(&ok);
+                args.erase(it);
+            }
+            if ( !ok || (cacheStatsInterval <= 0) ) {
+                std::cout << tr("You must specify the interval in seconds between two dumps of the cache statistics").toStdString() << std::endl;
+                error = 1;
+
+                return;
+            }
+        }
+    }
+
     {
         QStringList::iterator it = hasToken( QString::fromUtf8(NATRON_BREAKPAD_PROCESS_PID), QString() );
         if ( it != args.end() ) {
@@ -139,6 +139,16 @@ public:
 
     bool areRenderStatsEnabled() const;
 
+    /**
+     * @brief Returns true if the timeline of each frame rendered by writers is written along with the render statistics.
+     **/
+    bool isRenderTraceEnabled() const;
+
+    /**
+     * @brief Returns the interval in seconds between two dumps of the cache statistics, or 0 if they are not dumped.
+     **/
+    int getCacheStatsInterval() const;
+
     const QString& getBreakpadProcessExecutableFilePath() const;
 
     qint64 getBreakpadProcessPID() const;
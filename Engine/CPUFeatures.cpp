@@ -0,0 +1,95 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CPUFeatures.h"
+
+#include <algorithm> // min
+
+#include <QtCore/QAtomicInt>
+
+#ifdef NATRON_USE_X86_SIMD
+#include <cpuid.h>
+#endif
+
+NATRON_NAMESPACE_ENTER
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+SIMDInstructionSetEnum
+detectSIMDInstructionSet()
+{
+#ifdef NATRON_USE_X86_SIMD
+    __builtin_cpu_init();
+    unsigned int eax, ebx, ecx, edx;
+    bool hasF16C = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_F16C);
+
+    // These also check that the operating system saves the AVX registers
+    if ( __builtin_cpu_supports("avx2") && hasF16C ) {
+        return eSIMDInstructionSetAVX2;
+    }
+    if ( __builtin_cpu_supports("sse4.2") ) {
+        return eSIMDInstructionSetSSE42;
+    }
+#endif
+
+    return eSIMDInstructionSetNone;
+}
+
+// The instruction set in use, -1 until first used
+QAtomicInt currentInstructionSet(-1);
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+namespace CPUFeatures
+{
+SIMDInstructionSetEnum
+getSupportedSIMDInstructionSet()
+{
+    static const SIMDInstructionSetEnum supported = detectSIMDInstructionSet();
+
+    return supported;
+}
+
+SIMDInstructionSetEnum
+getSIMDInstructionSet()
+{
+    int instructionSet = currentInstructionSet.fetchAndAddRelaxed(0);
+
+    if (instructionSet < 0) {
+        instructionSet = (int)getSupportedSIMDInstructionSet();
+        currentInstructionSet.testAndSetRelaxed(-1, instructionSet);
+    }
+
+    return (SIMDInstructionSetEnum)instructionSet;
+}
+
+void
+setSIMDInstructionSet(SIMDInstructionSetEnum instructionSet)
+{
+    currentInstructionSet.fetchAndStoreRelaxed( std::min( (int)instructionSet, (int)getSupportedSIMDInstructionSet() ) );
+}
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,76 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_CPUFEATURES_H
+#define NATRON_ENGINE_CPUFEATURES_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+/*
+ * SIMD kernels are compiled for x86 with GCC >= 4.9 and clang, which can compile a function for an instruction set
+ * that is not enabled for the rest of the program, so that the instruction set is selected at runtime according
+ * to the CPU. Other compilers and architectures only use the scalar code.
+ * AVX2 kernels may also use the F16C half-float conversions: the AVX2 instruction set is only selected on CPUs
+ * that have them.
+ */
+#if ( defined(__x86_64__) || defined(__i386__) ) && \
+    ( defined(__clang__) || ( defined(__GNUC__) && ( (__GNUC__ > 4) || ( (__GNUC__ == 4) && (__GNUC_MINOR__ >= 9) ) ) ) )
+#define NATRON_USE_X86_SIMD 1
+#define NATRON_TARGET_SSE42 __attribute__( ( target("sse4.2") ) )
+#define NATRON_TARGET_AVX2 __attribute__( ( target("avx2,f16c") ) )
+#endif
+
+NATRON_NAMESPACE_ENTER
+
+enum SIMDInstructionSetEnum
+{
+    eSIMDInstructionSetNone = 0, // scalar code only
+    eSIMDInstructionSetSSE42,
+    eSIMDInstructionSetAVX2
+};
+
+namespace CPUFeatures
+{
+/**
+ * @brief Returns the most capable instruction set supported by the CPU and the operating system that SIMD kernels
+ * are compiled for.
+ **/
+SIMDInstructionSetEnum getSupportedSIMDInstructionSet();
+
+/**
+ * @brief Returns the instruction set SIMD kernels use, by default the one returned by getSupportedSIMDInstructionSet().
+ **/
+SIMDInstructionSetEnum getSIMDInstructionSet();
+
+/**
+ * @brief Makes SIMD kernels use the given instruction set, or the supported one if the CPU does not support it.
+ * This is meant for tests and benchmarks comparing the kernels with the scalar code. MT-safe.
+ **/
+void setSIMDInstructionSet(SIMDInstructionSetEnum instructionSet);
+}
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CPUFEATURES_H
@@ -28,7 +28,24 @@
 #include <cassert>
 #include <stdexcept>
 
+#include "Engine/CacheSerialization.h"
+#include "Engine/FrameEntry.h"
+#include "Engine/Image.h"
+
 NATRON_NAMESPACE_ENTER
+
+// Writing the records of the disk cache index requires the serialization of the entries, which is only available here
+template void Cache<Image>::writePendingIndexRecords(int) const;
+template void Cache<FrameEntry>::writePendingIndexRecords(int) const;
+
+// Same for the records of the shared index
+template void Cache<Image>::publishSharedEntry(const Cache<Image>::EntryTypePtr&) const;
+template void Cache<FrameEntry>::publishSharedEntry(const Cache<FrameEntry>::EntryTypePtr&) const;
+template void Cache<Image>::writeSharedEntry(const Cache<Image>::EntryTypePtr&) const;
+template void Cache<FrameEntry>::writeSharedEntry(const Cache<FrameEntry>::EntryTypePtr&) const;
+template bool Cache<Image>::getSharedEntries(Cache<Image>::CacheBucket&, const ImageKey&, std::list<ImagePtr>*) const;
+template bool Cache<FrameEntry>::getSharedEntries(Cache<FrameEntry>::CacheBucket&, const FrameKey&, std::list<FrameEntryPtr>*) const;
+
 NATRON_NAMESPACE_EXIT
 
 NATRON_NAMESPACE_USING
@@ -33,6 +33,7 @@
 #include <fstream>
 #include <functional>
 #include <list>
+#include <map>
 #include <set>
 #include <cstddef>
 #include <utility>
@@ -44,6 +45,7 @@
 #include "Global/StrUtils.h"
 
 GCC_DIAG_OFF(deprecated)
+#include <QtCore/QAtomicInt>
 #include <QtCore/QMutex>
 #include <QtCore/QThread>
 #include <QtCore/QWaitCondition>
@@ -58,11 +60,18 @@ GCC_DIAG_ON(deprecated)
 #endif
 
 #include "Engine/AppManager.h" //for access to settings
+#include "Engine/BufferPool.h"
 #include "Engine/CacheEntry.h"
+#include "Engine/CacheEvictionPolicy.h"
+#include "Engine/CacheIndex.h"
+#include "Engine/CacheStatistics.h"
 #include "Engine/ImageLocker.h"
+#include "Engine/LockFreeQueue.h"
 #include "Engine/LRUHashTable.h"
-#include "Engine/MemoryInfo.h" // getSystemTotalRAM
+#include "Engine/MemoryInfo.h" // getEffectiveTotalRAM
+#include "Engine/RenderStats.h"
 #include "Engine/Settings.h"
+#include "Engine/SharedCacheIndex.h"
 #include "Engine/StandardPaths.h"
 
 #include "Engine/EngineFwd.h"
@@ -72,6 +81,33 @@ GCC_DIAG_ON(deprecated)
 
 #define NATRON_TILE_CACHE_FILE_SIZE_BYTES 2000000000
 
+//Maximum number of buckets a cache can be split into, see Cache::getBucketIndex()
+#define NATRON_CACHE_MAX_BUCKETS 256
+
+///Maximum number of entries waiting to be recorded in the disk cache index examined by a single get() call
+#define NATRON_CACHE_INDEX_PENDING_ENTRIES_CHECKS 16
+
+///Maximum fraction of the in-memory portion that may be occupied by entries kept compressed in RAM, see Cache::setCompressionEnabled()
+#define NATRON_CACHE_COMPRESSED_PORTION_MAX 0.5
+
+///Maximum number of entries destroyed at once by the DeleterThread of a cache
+#define NATRON_CACHE_DELETER_MAX_BATCH 256
+
+///Time (in milliseconds) without new entries after which the DeleterThread destroys the entries it holds, with the free on idle policy
+#define NATRON_CACHE_DELETER_IDLE_MS 50
+
+///Number of threads writing to disk the entries evicted from the in-memory portion, see CacheWriteBehindQueue
+#define NATRON_CACHE_WRITE_BEHIND_THREADS 2
+
+///Maximum amount of data waiting to be written to disk by the write-behind threads of a cache
+#define NATRON_CACHE_WRITE_BEHIND_MAX_BYTES 536870912
+
+///Maximum fraction of the in-memory portion of a cache that may be waiting to be written to disk, see CacheWriteBehindQueue
+#define NATRON_CACHE_WRITE_BEHIND_MAX_PORTION 0.25
+
+///Time (in milliseconds) a write-behind thread waits before examining again an entry that was still in use
+#define NATRON_CACHE_WRITE_BEHIND_RETRY_MS 10
+
 ///When defined, number of opened files, memory size and disk size of the cache are printed whenever there's activity.
 //#define NATRON_DEBUG_CACHE
 
@@ -80,30 +116,56 @@ NATRON_NAMESPACE_ENTER
 /**
  * @brief The point of this thread is to delete the content of the list in a separate thread so the thread calling
  * get() doesn't wait for all the entries to be deleted (which can be expensive for large images)
+ * Entries are handed off through a LockFreeQueue, so that the threads evicting entries never wait for each other.
+ * The thread destroys the entries by batches of at most NATRON_CACHE_DELETER_MAX_BATCH entries and notifies
+ * the cache once per batch.
+ * With the free on idle policy, see setFreeOnIdle(), entries are only destroyed once no entry was handed off for
+ * NATRON_CACHE_DELETER_IDLE_MS, so that freeing memory does not compete with the threads evicting entries, unless
+ * the cache needs memory, see freePendingEntries(). The RAM held meanwhile is given by getPendingBytes().
  **/
 template <typename T>
 class DeleterThread
     : public QThread
 {
-    mutable QMutex _entriesQueueMutex;
-    std::list<boost::shared_ptr<T> >_entriesQueue;
-    QWaitCondition _entriesQueueNotEmptyCond;
+    enum ThreadStateEnum
+    {
+        eThreadStateStopped = 0,
+        eThreadStateRunning,
+        eThreadStateQuitting
+    };
+
+    // A NULL entry asks the thread to quit, see quitThread()
+    LockFreeQueue<boost::shared_ptr<T> > _entriesQueue;
+
+    // Number of entries handed off and not destroyed yet
+    mutable QAtomicInt _pendingEntriesCount;
+
+    // RAM held by these entries, in KiB so that it fits in a QAtomicInt
+    mutable QAtomicInt _pendingKB;
+
+    // Serializes starting the thread in appendToQueue() and quitThread()
+    QMutex _threadStateMutex;
+
+    // A ThreadStateEnum, only written while holding _threadStateMutex
+    QAtomicInt _threadState;
+    QAtomicInt _freeOnIdle;
+
+    // Set by freePendingEntries()
+    QAtomicInt _freeRequested;
     CacheAPI* cache;
-    QMutex mustQuitMutex;
-    QWaitCondition mustQuitCond;
-    bool mustQuit;
 
 public:
 
     DeleterThread(CacheAPI* cache)
         : QThread()
-        , _entriesQueueMutex()
         , _entriesQueue()
-        , _entriesQueueNotEmptyCond()
+        , _pendingEntriesCount(0)
+        , _pendingKB(0)
+        , _threadStateMutex()
+        , _threadState(eThreadStateStopped)
+        , _freeOnIdle(0)
+        , _freeRequested(0)
         , cache(cache)
-        , mustQuitMutex()
-        , mustQuitCond()
-        , mustQuit(false)
     {
         setObjectName( QString::fromUtf8("CacheDeleter") );
     }
@@ -118,81 +180,360 @@ public:
             return;
         }
 
-        {
-            QMutexLocker k(&_entriesQueueMutex);
-            _entriesQueue.insert( _entriesQueue.begin(), entriesToDelete.begin(), entriesToDelete.end() );
-        }
-        if ( !isRunning() ) {
-            start();
-        } else {
-            QMutexLocker k(&_entriesQueueMutex);
-            _entriesQueueNotEmptyCond.wakeOne();
+        _pendingEntriesCount.fetchAndAddRelaxed( (int)entriesToDelete.size() );
+        _pendingKB.fetchAndAddRelaxed( getHeldKB( entriesToDelete.begin(), entriesToDelete.end() ) );
+        _entriesQueue.push(entriesToDelete);
+
+        // While the thread runs, the entries pushed are popped before the request to quit of quitThread().
+        // Otherwise wait for quitThread() to return and start the thread again.
+        if (_threadState.fetchAndAddOrdered(0) != eThreadStateRunning) {
+            QMutexLocker k(&_threadStateMutex);
+            if (_threadState.fetchAndAddOrdered(0) == eThreadStateStopped) {
+                start();
+                _threadState.fetchAndStoreOrdered(eThreadStateRunning);
+            }
         }
     }
 
     void quitThread()
     {
-        if ( !isRunning() ) {
+        QMutexLocker k(&_threadStateMutex);
+
+        if (_threadState.fetchAndAddOrdered(0) != eThreadStateRunning) {
+            return;
+        }
+        _threadState.fetchAndStoreOrdered(eThreadStateQuitting);
+        _entriesQueue.push( boost::shared_ptr<T>() );
+        wait();
+        _threadState.fetchAndStoreOrdered(eThreadStateStopped);
+    }
+
+    bool isWorking() const
+    {
+        return _pendingEntriesCount.fetchAndAddRelaxed(0) > 0;
+    }
+
+    /**
+     * @brief Returns the RAM held by the entries handed off and not destroyed yet
+     **/
+    std::size_t getPendingBytes() const
+    {
+        return (std::size_t)std::max(0, (int)_pendingKB.fetchAndAddRelaxed(0) ) * 1024;
+    }
+
+    void setFreeOnIdle(bool enabled)
+    {
+        _freeOnIdle.fetchAndStoreRelaxed(enabled ? 1 : 0);
+    }
+
+    /**
+     * @brief Makes the thread destroy the entries it holds without waiting for the queue to be idle.
+     **/
+    void freePendingEntries()
+    {
+        if ( !_freeOnIdle.fetchAndAddRelaxed(0) ) {
             return;
         }
-        QMutexLocker k(&mustQuitMutex);
-        assert(!mustQuit);
-        mustQuit = true;
+        _freeRequested.fetchAndStoreOrdered(1);
+        _entriesQueue.wakeConsumer();
+    }
+
+private:
+
+    template <typename Iterator>
+    static int getHeldKB(Iterator begin,
+                         Iterator end)
+    {
+        int ret = 0;
+
+        for (Iterator it = begin; it != end; ++it) {
+            if ( !(*it)->isStoredOnDisk() ) {
+                ret += (int)( ( (*it)->size() + 1023 ) / 1024 );
+            }
+        }
+
+        return ret;
+    }
+
+    void destroyBatch(std::vector<boost::shared_ptr<T> >& batch)
+    {
+        for (typename std::vector<boost::shared_ptr<T> >::iterator it = batch.begin(); it != batch.end(); ++it) {
+            (*it)->scheduleForDestruction();
+        }
+        int nEntries = (int)batch.size();
+        int heldKB = getHeldKB( batch.begin(), batch.end() );
+        // After this, the images are guaranteed to be freed
+        batch.clear();
+        _pendingEntriesCount.fetchAndAddRelaxed(-nEntries);
+        _pendingKB.fetchAndAddRelaxed(-heldKB);
+        cache->notifyMemoryDeallocated();
+    }
+
+    virtual void run() OVERRIDE FINAL
+    {
+        std::vector<boost::shared_ptr<T> > batch;
+        bool quit = false;
+
+        for (;; ) {
+            boost::shared_ptr<T> front;
+            while ( ( batch.size() < NATRON_CACHE_DELETER_MAX_BATCH ) && _entriesQueue.tryPop(&front) ) {
+                if (front) {
+                    batch.push_back(front);
+                } else {
+                    quit = true;
+                }
+                front.reset();
+            }
+
+            if ( !batch.empty() ) {
+                // Keep collecting entries while they keep coming
+                if ( !quit && ( batch.size() < NATRON_CACHE_DELETER_MAX_BATCH ) && _freeOnIdle.fetchAndAddRelaxed(0) &&
+                     !_freeRequested.fetchAndStoreOrdered(0) && _entriesQueue.wait(NATRON_CACHE_DELETER_IDLE_MS) ) {
+                    continue;
+                }
+                destroyBatch(batch);
+            }
+
+            if (quit) {
+                return;
+            }
+
+            if ( _entriesQueue.isEmpty() ) {
+                // This thread never allocates buffers, let the render threads reuse the ones it freed
+                BufferPool::flushThreadCache();
+                _entriesQueue.wait();
+            }
+        }
+    }
+};
+
+
+/**
+ * @brief Writes to disk, from dedicated threads, the entries stored on disk that were evicted from the in-memory portion
+ * of a cache, so that the thread evicting an entry only hands it off and never waits for the disk.
+ * The queue is bounded by setMaximumQueuedBytes(): appendToQueue() returns false rather than waiting when it is full.
+ * Entries are processed by CacheType::processWriteBehindEntry(), or by CacheType::writeSharedEntry() for the entries
+ * published to the other processes.
+ **/
+template <typename T, typename CacheType>
+class CacheWriteBehindQueue
+{
+    class WriterThread
+        : public QThread
+    {
+        CacheWriteBehindQueue* _queue;
+
+    public:
+
+        WriterThread(CacheWriteBehindQueue* queue)
+            : QThread()
+            , _queue(queue)
+        {
+            setObjectName( QString::fromUtf8("CacheWriter") );
+        }
+
+        virtual ~WriterThread()
+        {
+        }
 
+    private:
+
+        virtual void run() OVERRIDE FINAL
         {
-            QMutexLocker k2(&_entriesQueueMutex);
-            _entriesQueue.push_back( boost::shared_ptr<T>() );
-            _entriesQueueNotEmptyCond.wakeOne();
+            _queue->processQueue();
+        }
+    };
+
+    friend class WriterThread;
+    typedef boost::shared_ptr<WriterThread> WriterThreadPtr;
+
+    struct QueuedEntry
+    {
+        boost::shared_ptr<T> entry;
+        std::size_t size;
+
+        // Set by processWriteBehindEntry() once the data are on disk, so that they are not written again
+        // if the entry has to be examined again
+        bool written;
+
+        // If true, the data are copied to a file shared with the other processes, see Cache::publishSharedEntry()
+        bool publish;
+    };
+
+    const CacheType* _cache;
+    mutable QMutex _queueMutex;
+    std::list<QueuedEntry> _queue;
+    // Size of the entries queued or being written
+    std::size_t _queuedBytes;
+    std::size_t _maximumQueuedBytes;
+    // Number of entries refused by appendToQueue() because the queue was full
+    U64 _droppedEntries;
+    int _nWritingThreads;
+    QWaitCondition _queueNotEmptyCond;
+    QWaitCondition _queueIdleCond;
+    bool _mustQuit;
+    std::vector<WriterThreadPtr> _threads;
+
+public:
+
+    CacheWriteBehindQueue(const CacheType* cache)
+        : _cache(cache)
+        , _queueMutex()
+        , _queue()
+        , _queuedBytes(0)
+        , _maximumQueuedBytes(NATRON_CACHE_WRITE_BEHIND_MAX_BYTES)
+        , _droppedEntries(0)
+        , _nWritingThreads(0)
+        , _queueNotEmptyCond()
+        , _queueIdleCond()
+        , _mustQuit(false)
+        , _threads()
+    {
+    }
+
+    ~CacheWriteBehindQueue()
+    {
+        quitThreads();
+    }
+
+    /**
+     * @brief Hands off the entry to the write-behind threads. Returns false without waiting if size bytes do not fit in the queue,
+     * unless the queue is empty, or if the threads were asked to quit.
+     * @param publish If true, the entry is published to the other processes rather than written to its own file.
+     **/
+    bool appendToQueue(const boost::shared_ptr<T>& entry,
+                       std::size_t size,
+                       bool publish = false)
+    {
+        QMutexLocker k(&_queueMutex);
+
+        if (_mustQuit) {
+            return false;
         }
-        while (mustQuit) {
-            mustQuitCond.wait(&mustQuitMutex);
+        if ( (_queuedBytes > 0) && (_queuedBytes + size > _maximumQueuedBytes) ) {
+            if (_droppedEntries == 0) {
+                qDebug() << "The disk cache cannot keep up with the evicted entries, some of them are dropped";
+            }
+            ++_droppedEntries;
+
+            return false;
+        }
+        QueuedEntry e;
+        e.entry = entry;
+        e.size = size;
+        e.written = false;
+        e.publish = publish;
+        _queue.push_back(e);
+        _queuedBytes += size;
+        if ( _threads.empty() ) {
+            for (int i = 0; i < NATRON_CACHE_WRITE_BEHIND_THREADS; ++i) {
+                WriterThreadPtr thread( new WriterThread(this) );
+                thread->start();
+                _threads.push_back(thread);
+            }
+        } else {
+            _queueNotEmptyCond.wakeOne();
         }
+
+        return true;
     }
 
-    bool isWorking() const
+    std::size_t getQueuedBytes() const
+    {
+        QMutexLocker k(&_queueMutex);
+
+        return _queuedBytes;
+    }
+
+    void setMaximumQueuedBytes(std::size_t maximumQueuedBytes)
+    {
+        QMutexLocker k(&_queueMutex);
+
+        _maximumQueuedBytes = maximumQueuedBytes;
+    }
+
+    /**
+     * @brief Returns the number of entries refused by appendToQueue() because the queue was full.
+     **/
+    U64 getDroppedEntriesCount() const
+    {
+        QMutexLocker k(&_queueMutex);
+
+        return _droppedEntries;
+    }
+
+    /**
+     * @brief Blocks until all queued entries have been processed.
+     **/
+    void waitForIdle()
     {
-        QMutexLocker k(&_entriesQueueMutex);
+        QMutexLocker k(&_queueMutex);
+
+        while ( !_threads.empty() && ( !_queue.empty() || (_nWritingThreads > 0) ) ) {
+            _queueIdleCond.wait(&_queueMutex);
+        }
+    }
 
-        return !_entriesQueue.empty();
+    /**
+     * @brief Processes the queued entries, then stops the threads. Entries appended afterwards are refused.
+     **/
+    void quitThreads()
+    {
+        std::vector<WriterThreadPtr> threads;
+        {
+            QMutexLocker k(&_queueMutex);
+            _mustQuit = true;
+            threads.swap(_threads);
+            _queueNotEmptyCond.wakeAll();
+        }
+        for (std::size_t i = 0; i < threads.size(); ++i) {
+            threads[i]->wait();
+        }
     }
 
 private:
 
-    virtual void run() OVERRIDE FINAL
+    void processQueue()
     {
+        QMutexLocker k(&_queueMutex);
+
         for (;; ) {
-            bool quit;
-            {
-                QMutexLocker k(&mustQuitMutex);
-                quit = mustQuit;
+            while ( _queue.empty() && !_mustQuit ) {
+                _queueNotEmptyCond.wait(&_queueMutex);
             }
+            if ( _queue.empty() ) {
+                return;
+            }
+            QueuedEntry front = _queue.front();
+            _queue.pop_front();
+            ++_nWritingThreads;
+
+            k.unlock();
+            bool done = true;
+            if (front.publish) {
+                _cache->writeSharedEntry(front.entry);
+            } else {
+                done = _cache->processWriteBehindEntry(front.entry, &front.written);
+            }
+            if (done) {
+                // Released without holding the queue mutex
+                front.entry.reset();
+            }
+            k.relock();
 
-            {
-                boost::shared_ptr<T> front;
-                {
-                    QMutexLocker k(&_entriesQueueMutex);
-                    if ( quit && _entriesQueue.empty() ) {
-                        _entriesQueueMutex.unlock();
-                        QMutexLocker k(&mustQuitMutex);
-                        assert(mustQuit);
-                        mustQuit = false;
-                        mustQuitCond.wakeOne();
-
-                        return;
-                    }
-                    while ( _entriesQueue.empty() ) {
-                        _entriesQueueNotEmptyCond.wait(&_entriesQueueMutex);
-                    }
-
-                    assert( !_entriesQueue.empty() );
-                    front = _entriesQueue.front();
-                    _entriesQueue.pop_front();
-                }
-                if (front) {
-                    front->scheduleForDestruction();
+            --_nWritingThreads;
+            if ( done || _mustQuit ) {
+                // When quitting, an entry that is still in use is left in RAM
+                _queuedBytes = front.size > _queuedBytes ? 0 : _queuedBytes - front.size;
+            } else {
+                _queue.push_back(front);
+                if ( _queue.size() == 1 ) {
+                    _queueNotEmptyCond.wait(&_queueMutex, NATRON_CACHE_WRITE_BEHIND_RETRY_MS);
                 }
-            } // front. After this scope, the image is guaranteed to be freed
-            cache->notifyMemoryDeallocated();
+            }
+            if ( _queue.empty() && (_nWritingThreads == 0) ) {
+                _queueIdleCond.wakeAll();
+            }
         }
     }
 };
@@ -201,36 +542,44 @@ private:
 /**
  * @brief The point of this thread is to remove entries that we are sure are no longer needed
  * e.g: they may have a hash that can no longer be produced
+ * Requests are handed off through a LockFreeQueue, as for DeleterThread.
  **/
 class CacheCleanerThread
     : public QThread
 {
-    mutable QMutex _requestQueueMutex;
     struct CleanRequest
     {
         std::string holderID;
         U64 nodeHash;
         bool removeAll;
+
+        // Asks the thread to quit, see quitThread()
+        bool quit;
+
+        CleanRequest()
+            : holderID()
+            , nodeHash(0)
+            , removeAll(false)
+            , quit(false)
+        {
+        }
     };
 
-    std::list<CleanRequest> _requestsQueues;
-    QWaitCondition _requestsQueueNotEmptyCond;
+    LockFreeQueue<CleanRequest> _requestsQueue;
+
+    // Number of requests appended and not processed yet
+    mutable QAtomicInt _pendingRequestsCount;
+    QAtomicInt _started;
     CacheAPI* cache;
-    QMutex mustQuitMutex;
-    QWaitCondition mustQuitCond;
-    bool mustQuit;
 
 public:
 
     CacheCleanerThread(CacheAPI* cache)
         : QThread()
-        , _requestQueueMutex()
-        , _requestsQueues()
-        , _requestsQueueNotEmptyCond()
+        , _requestsQueue()
+        , _pendingRequestsCount(0)
+        , _started(0)
         , cache(cache)
-        , mustQuitMutex()
-        , mustQuitCond()
-        , mustQuit(false)
     {
         setObjectName( QString::fromUtf8("CacheCleaner") );
     }
@@ -243,47 +592,32 @@ public:
                        U64 nodeHash,
                        bool removeAll)
     {
-        {
-            QMutexLocker k(&_requestQueueMutex);
-            CleanRequest r;
-            r.holderID = holderID;
-            r.nodeHash = nodeHash;
-            r.removeAll = removeAll;
-            _requestsQueues.push_back(r);
-        }
-        if ( !isRunning() ) {
+        CleanRequest r;
+        r.holderID = holderID;
+        r.nodeHash = nodeHash;
+        r.removeAll = removeAll;
+        _pendingRequestsCount.fetchAndAddRelaxed(1);
+        _requestsQueue.push(r);
+        if ( _started.testAndSetOrdered(0, 1) ) {
             start();
-        } else {
-            QMutexLocker k(&_requestQueueMutex);
-            _requestsQueueNotEmptyCond.wakeOne();
         }
     }
 
     void quitThread()
     {
-        if ( !isRunning() ) {
+        if ( !_started.fetchAndAddAcquire(0) ) {
             return;
         }
-        QMutexLocker k(&mustQuitMutex);
-        assert(!mustQuit);
-        mustQuit = true;
-
-        {
-            QMutexLocker k2(&_requestQueueMutex);
-            CleanRequest r;
-            _requestsQueues.push_back(r);
-            _requestsQueueNotEmptyCond.wakeOne();
-        }
-        while (mustQuit) {
-            mustQuitCond.wait(&mustQuitMutex);
-        }
+        CleanRequest r;
+        r.quit = true;
+        _requestsQueue.push(r);
+        wait();
+        _started.fetchAndStoreRelease(0);
     }
 
     bool isWorking() const
     {
-        QMutexLocker k(&_requestQueueMutex);
-
-        return !_requestsQueues.empty();
+        return _pendingRequestsCount.fetchAndAddRelaxed(0) > 0;
     }
 
 private:
@@ -291,35 +625,16 @@ private:
     virtual void run() OVERRIDE FINAL
     {
         for (;; ) {
-            bool quit;
-            {
-                QMutexLocker k(&mustQuitMutex);
-                quit = mustQuit;
+            CleanRequest front;
+            if ( !_requestsQueue.tryPop(&front) ) {
+                _requestsQueue.wait();
+                continue;
             }
-
-            {
-                CleanRequest front;
-                {
-                    QMutexLocker k(&_requestQueueMutex);
-                    if ( quit && _requestsQueues.empty() ) {
-                        _requestQueueMutex.unlock();
-                        QMutexLocker k(&mustQuitMutex);
-                        assert(mustQuit);
-                        mustQuit = false;
-                        mustQuitCond.wakeOne();
-
-                        return;
-                    }
-                    while ( _requestsQueues.empty() ) {
-                        _requestsQueueNotEmptyCond.wait(&_requestQueueMutex);
-                    }
-
-                    assert( !_requestsQueues.empty() );
-                    front = _requestsQueues.front();
-                    _requestsQueues.pop_front();
-                }
-                cache->removeAllEntriesWithDifferentNodeHashForHolderPrivate(front.holderID, front.nodeHash, front.removeAll);
+            if (front.quit) {
+                return;
             }
+            cache->removeAllEntriesWithDifferentNodeHashForHolderPrivate(front.holderID, front.nodeHash, front.removeAll);
+            _pendingRequestsCount.fetchAndAddRelaxed(-1);
         }
     }
 };
@@ -381,12 +696,20 @@ Q_SIGNALS:
 
 /*
  * ValueType must be derived of CacheEntryHelper
+ *
+ * The cache is split into buckets. Each entry lives in exactly one bucket,
+ * selected from its hash key. Each bucket has its own locks, LRU containers and
+ * size accounting, so that threads accessing entries with different hashes
+ * do not contend with each other. Eviction of entries when the cache is full
+ * is coordinated across buckets by evictInMemoryEntriesUntil() and
+ * evictDiskEntriesUntil(), which never hold more than one bucket lock at a time.
  */
 template<typename EntryType>
 class Cache
     : public CacheAPI
 {
     friend class CacheCleanerThread;
+    friend class CacheWriteBehindQueue<EntryType, Cache<EntryType> >;
 public:
 
     typedef typename EntryType::hash_type hash_type;
@@ -395,6 +718,7 @@ public:
     typedef typename EntryType::param_t param_t;
     typedef boost::shared_ptr<param_t> ParamsTypePtr;
     typedef boost::shared_ptr<EntryType> EntryTypePtr;
+    typedef boost::weak_ptr<EntryType> EntryTypeWPtr;
 
     struct SerializedEntry;
 
@@ -465,24 +789,106 @@ public:
 
 private:
 
+    /**
+     * @brief A bucket holds a subset of the cache entries: all entries whose hash
+     * maps to this bucket (see getBucketIndex()) are stored in its containers.
+     **/
+    struct CacheBucket
+    {
+        // Protects memoryCache, compressedCache & diskCache
+        mutable QMutex lock;
+
+        // Prevents get() and getOrCreate() to be called simultaneously for entries of this bucket
+        mutable QMutex getLock;
+
+        // These are mutable because we need to modify the LRU list even when we call get()
+        mutable CacheContainer memoryCache;
+
+        // Entries evicted from memoryCache whose buffer is kept compressed in RAM, see setCompressionEnabled()
+        mutable CacheContainer compressedCache;
+        mutable CacheContainer diskCache;
+
+        // Protects memoryCacheSize, compressedCacheSize & diskCacheSize
+        mutable QMutex sizeLock;
+
+        // current size of the entries of this bucket in bytes
+        // memoryCacheSize includes compressedCacheSize, the size of the compressed buffers
+        std::size_t memoryCacheSize;
+        std::size_t compressedCacheSize;
+        std::size_t diskCacheSize;
+
+        // Counters of the entries of this bucket, see Cache::getStatistics()
+        mutable CacheStatistics statistics;
+
+        // Evictions found while the bucket is locked, recorded in the statistics once it is unlocked.
+        // Protected by lock, see CacheBucketLocker.
+        mutable CacheEvictionRecords pendingEvictions;
+
+        CacheBucket()
+            : lock()
+            , getLock()
+            , memoryCache()
+            , compressedCache()
+            , diskCache()
+            , sizeLock()
+            , memoryCacheSize(0)
+            , compressedCacheSize(0)
+            , diskCacheSize(0)
+            , statistics()
+            , pendingEvictions()
+        {
+        }
+    };
+
+    typedef boost::shared_ptr<CacheBucket> CacheBucketPtr;
+
+    /**
+     * @brief Locks CacheBucket::lock and records the time spent waiting for it. The evictions found while
+     * the bucket is locked, see recordEviction(), are added to the statistics once it is unlocked.
+     **/
+    class CacheBucketLocker
+    {
+    public:
+
+        CacheBucketLocker(const CacheBucket& bucket)
+            : _bucket(bucket)
+            , _locker(&bucket.lock, &bucket.statistics)
+        {
+        }
+
+        ~CacheBucketLocker()
+        {
+            CacheEvictionRecords evictions;
+
+            if ( !_bucket.pendingEvictions.empty() ) {
+                evictions.swap(_bucket.pendingEvictions);
+            }
+            _locker.unlock();
+            if ( !evictions.empty() ) {
+                _bucket.statistics.recordEvictions(evictions);
+            }
+        }
+
+    private:
+
+        const CacheBucket& _bucket;
+        CacheStatisticsMutexLocker _locker;
+    };
 
     std::size_t _maximumInMemorySize;     // the maximum size of the in-memory portion of the cache.(in % of the maximum cache size)
     std::size_t _maximumCacheSize;     // maximum size allowed for the cache
+    bool _compressionEnabled; // if true, entries stored in RAM are compressed rather than destroyed when evicted from the in-memory portion
+    bool _compressionPackHalfFloat; // if true, 32-bit floating point buffers are stored as 16-bit floats when this is lossless
+    CacheEvictionPolicyPtr _evictionPolicy; // selects the entries evicted from the in-memory portion
+    mutable QMutex _maximumSizeLock; // protects _maximumInMemorySize, _maximumCacheSize, the compression settings & _evictionPolicy
 
-    /*mutable because we need to change modify it in the sealEntryInternal function which
-         is called by an external object that have a const ref to the cache.
-     */
-    mutable std::size_t _memoryCacheSize;     // current size of the cache in bytes
-    mutable std::size_t _diskCacheSize;
-    mutable QMutex _sizeLock; // protects _memoryCacheSize & _diskCacheSize & _maximumInMemorySize & _maximumCacheSize
-    mutable QMutex _lock; //protects _memoryCache & _diskCache
-    mutable QMutex _getLock;  //prevents get() and getOrCreate() to be called simultaneously
+    // The buckets, their count is always a power of 2 so that getBucketIndex() can use a mask
+    std::vector<CacheBucketPtr> _buckets;
+    int _bucketsMask;
 
+    // Index of the next bucket the eviction coordinator should look at, so that eviction is spread evenly across buckets
+    mutable QAtomicInt _nextEvictionBucket;
 
-    /*These 2 are mutable because we need to modify the LRU list even
-         when we call get() and we want this function to be const.*/
-    mutable CacheContainer _memoryCache;
-    mutable CacheContainer _diskCache;
     const std::string _cacheName;
     const unsigned int _version;
 
@@ -490,11 +896,12 @@ private:
          be const somehow .*/
     mutable CacheSignalEmitterPtr _signalEmitter;
 
-    ///Store the system physical total RAM in a member
+    ///Store the physical total RAM the process may use in a member
     std::size_t _maxPhysicalRAM;
     bool _tearingDown;
     mutable DeleterThread<EntryType> _deleterThread;
-    mutable QWaitCondition _memoryFullCondition; //< protected by _sizeLock
+    mutable QMutex _memoryFullMutex;
+    mutable QWaitCondition _memoryFullCondition; //< protected by _memoryFullMutex
     mutable CacheCleanerThread _cleanerThread;
 
     // If tiled, the cache will consist only of a few large files that each contain tiles of the same size.
@@ -512,30 +919,81 @@ private:
     // When set these are used for fast search of a free tile
     TileCacheFileWPtr _nextAvailableCacheFile;
     int _nextAvailableCacheFileIndex;
+
+    // The persistent index of the disk portion, only opened for caches that are restored at startup
+    mutable CacheIndex _index;
+
+    struct IndexPendingEntry
+    {
+        U64 hash;
+        EntryTypeWPtr entry;
+    };
+
+    typedef std::list<IndexPendingEntry> IndexPendingEntryList;
+    typedef std::multimap<U64, typename IndexPendingEntryList::iterator> IndexPendingEntryMap;
+
+    // Entries stored on disk that are not yet recorded in the index because they may still be written to, in the order
+    // they were created. They are also indexed by hash so that removeIndexEntry() does not visit all of them: the
+    // location of the data of a tile is only known once the entry is allocated.
+    // No other lock of the cache may be taken while holding _indexPendingEntriesMutex, hence no entry may be released
+    // while holding it either (its destructor may free its tile).
+    mutable QMutex _indexPendingEntriesMutex;
+    mutable IndexPendingEntryList _indexPendingEntries;
+    mutable IndexPendingEntryMap _indexPendingEntriesByHash;
+
+    // Paths of the files of the entries stored on disk whose data are not written yet, see reserveEntryFilePath()
+    mutable QMutex _reservedFilePathsMutex;
+    mutable std::set<std::string> _reservedFilePaths;
+
+    // Writes the entries evicted from the in-memory portion to disk
+    mutable CacheWriteBehindQueue<EntryType, Cache<EntryType> > _writeBehindQueue;
+
+    struct SharedPublishedEntry
+    {
+        U64 hash;
+        std::string record;
+        std::string filePath;
+        std::size_t size;
+    };
+
+    // The index of the entries shared with the other processes of the host, see openSharedIndex()
+    mutable SharedCacheIndex _sharedIndex;
+
+    // The entries this process published in the shared index, oldest first, and the size of their files
+    mutable QMutex _sharedPublishedMutex;
+    mutable std::list<SharedPublishedEntry> _sharedPublished;
+    mutable std::size_t _sharedPublishedBytes;
+    mutable U64 _sharedPublishedFilesCount;
 public:
 
 
+    /**
+     * @param nBuckets The number of buckets the cache is split into. It is rounded up to the next power of 2
+     * and clamped to NATRON_CACHE_MAX_BUCKETS. A value of 1 makes the cache behave as a single LRU protected by a single lock.
+     **/
     Cache(const std::string & cacheName,
           unsigned int version,
           U64 maximumCacheSize,      // total size
-          double maximumInMemoryPercentage //how much should live in RAM
+          double maximumInMemoryPercentage, //how much should live in RAM
+          int nBuckets = 1
           )
         : CacheAPI()
         , _maximumInMemorySize(maximumCacheSize * maximumInMemoryPercentage)
         , _maximumCacheSize(maximumCacheSize)
-        , _memoryCacheSize(0)
-        , _diskCacheSize(0)
-        , _sizeLock()
-        , _lock()
-        , _getLock()
-        , _memoryCache()
-        , _diskCache()
+        , _compressionEnabled(false)
+        , _compressionPackHalfFloat(false)
+        , _evictionPolicy( boost::make_shared<LRUCacheEvictionPolicy>() )
+        , _maximumSizeLock()
+        , _buckets()
+        , _bucketsMask(0)
+        , _nextEvictionBucket(0)
         , _cacheName(cacheName)
         , _version(version)
         , _signalEmitter()
-        , _maxPhysicalRAM( getSystemTotalRAM() )
+        , _maxPhysicalRAM( getEffectiveTotalRAM() )
         , _tearingDown(false)
         , _deleterThread(this)
+        , _memoryFullMutex()
         , _memoryFullCondition()
         , _cleanerThread(this)
         , _tileCacheMutex()
@@ -545,17 +1003,53 @@ public:
         , _cacheFiles()
         , _nextAvailableCacheFile()
         , _nextAvailableCacheFileIndex(-1)
+        , _index()
+        , _indexPendingEntriesMutex()
+        , _indexPendingEntries()
+        , _indexPendingEntriesByHash()
+        , _reservedFilePathsMutex()
+        , _reservedFilePaths()
+        , _writeBehindQueue(this)
+        , _sharedIndex()
+        , _sharedPublishedMutex()
+        , _sharedPublished()
+        , _sharedPublishedBytes(0)
+        , _sharedPublishedFilesCount(0)
     {
         _signalEmitter = boost::make_shared<CacheSignalEmitter>();
+
+        int bucketsCount = 1;
+        while (bucketsCount < nBuckets && bucketsCount < NATRON_CACHE_MAX_BUCKETS) {
+            bucketsCount *= 2;
+        }
+        _bucketsMask = bucketsCount - 1;
+        _buckets.resize(bucketsCount);
+        for (int i = 0; i < bucketsCount; ++i) {
+            _buckets[i] = boost::make_shared<CacheBucket>();
+        }
     }
 
     virtual ~Cache()
     {
-        QMutexLocker locker(&_lock);
+        closeSharedIndex();
 
+        // Write the entries that were handed off before tearing down
+        _writeBehindQueue.quitThreads();
         _tearingDown = true;
-        _memoryCache.clear();
-        _diskCache.clear();
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            CacheBucketLocker locker(*_buckets[i]);
+            _buckets[i]->memoryCache.clear();
+            _buckets[i]->compressedCache.clear();
+            _buckets[i]->diskCache.clear();
+        }
+    }
+
+    /**
+     * @brief Returns the number of buckets the cache is split into
+     **/
+    int getBucketsCount() const
+    {
+        return (int)_buckets.size();
     }
 
     virtual bool isTileCache() const OVERRIDE FINAL
@@ -585,6 +1079,7 @@ public:
 
     void waitForDeleterThread()
     {
+        _writeBehindQueue.quitThreads();
         _deleterThread.quitThread();
         _cleanerThread.quitThread();
     }
@@ -597,33 +1092,92 @@ public:
      * this class can be used to cache other parameters along with the value_type.
      * @param [out] returnValue The returnValue, contains the cache entry if the return value
      * of the function is true, otherwise the pointer is left untouched.
+     * @param mipMapLevel The mip-map level looked up if known, -1 otherwise. This is only used by the statistics.
      * @returns True if the cache successfully found an entry matching the params.
      * False otherwise.
      **/
     bool get(const typename EntryType::key_type & key,
-             std::list<EntryTypePtr>* returnValue) const
+             std::list<EntryTypePtr>* returnValue,
+             int mipMapLevel = -1) const
     {
-        ///Be atomic, so it cannot be created by another thread in the meantime
-        QMutexLocker getlocker(&_getLock);
+        CacheBucket& bucket = getBucket( key.getHash() );
+        bool movedBackInMemory = false;
+        bool ret;
+        {
+            ///Be atomic, so it cannot be created by another thread in the meantime
+            CacheStatisticsMutexLocker getlocker(&bucket.getLock, &bucket.statistics);
+
+            {
+                ///lock the bucket before reading it.
+                CacheBucketLocker locker(bucket);
 
-        ///lock the cache before reading it.
-        QMutexLocker locker(&_lock);
+                ret = getInternal(bucket, key, returnValue, &movedBackInMemory);
+            }
+
+            // Fall back on the entries published by the other processes of the host
+            if ( !ret && _sharedIndex.isOpened() ) {
+                ret = getSharedEntries(bucket, key, returnValue);
+                movedBackInMemory = ret;
+            }
+        }
+        if (ret) {
+            // Entries taken back from the compressed entries are decompressed without holding the bucket locks
+            decompressEntries(returnValue);
+            ret = !returnValue->empty();
+        }
+        bucket.statistics.recordLookup(key.getCacheHolderIndex(), mipMapLevel, ret);
+        if ( ret && (mipMapLevel < 0) ) {
+            for (typename std::list<EntryTypePtr>::const_iterator it = returnValue->begin(); it != returnValue->end(); ++it) {
+                bucket.statistics.recordHit( (*it)->getMipMapLevel() );
+            }
+        }
+        if (movedBackInMemory) {
+            // The entry was put back into RAM or decompressed, make sure we do not exceed the RAM limit
+            evictInMemoryEntriesUntil(1.);
+        }
+        writePendingIndexRecords(NATRON_CACHE_INDEX_PENDING_ENTRIES_CHECKS);
 
-        return getInternal(key, returnValue);
+        return ret;
     } // get
 
 private:
 
+    /**
+     * @brief Returns the index of the bucket holding the entries with the given hash.
+     * The hash is mixed beforehand so that keys differing only by a few bits spread evenly.
+     **/
+    int getBucketIndex(U64 hash) const
+    {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
 
+        return (int)(hash & (U64)_bucketsMask);
+    }
 
-    virtual TileCacheFilePtr getTileCacheFile(const std::string& filepath, std::size_t dataOffset) OVERRIDE FINAL WARN_UNUSED_RETURN
+    CacheBucket& getBucket(U64 hash) const
     {
-        QMutexLocker k(&_tileCacheMutex);
-        assert(_isTiled);
-        if (!_isTiled) {
-            throw std::logic_error("allocTile() but cache is not tiled!");
-        }
-        for (std::set<TileCacheFilePtr>::iterator it = _cacheFiles.begin(); it != _cacheFiles.end(); ++it) {
+        return *_buckets[getBucketIndex(hash)];
+    }
+
+    /**
+     * @brief Returns the next bucket the eviction coordinator should try to evict from.
+     **/
+    CacheBucket& getNextEvictionBucket() const
+    {
+        int index = _nextEvictionBucket.fetchAndAddRelaxed(1);
+
+        return *_buckets[index & _bucketsMask];
+    }
+
+    virtual TileCacheFilePtr getTileCacheFile(const std::string& filepath, std::size_t dataOffset) OVERRIDE FINAL WARN_UNUSED_RETURN
+    {
+        QMutexLocker k(&_tileCacheMutex);
+        assert(_isTiled);
+        if (!_isTiled) {
+            throw std::logic_error("allocTile() but cache is not tiled!");
+        }
+        for (std::set<TileCacheFilePtr>::iterator it = _cacheFiles.begin(); it != _cacheFiles.end(); ++it) {
             if ((*it)->file->path() == filepath) {
                 int index = dataOffset / _tileByteSize;
 
@@ -732,52 +1286,64 @@ private:
             /**
              * @brief Free a tile from the cache that was previously allocated with allocTile. It will be made available again for other entries.
              **/
-    virtual void freeTile(const TileCacheFilePtr& file, std::size_t dataOffset) OVERRIDE FINAL
+    virtual void freeTile(U64 hash,
+                          const TileCacheFilePtr& file,
+                          std::size_t dataOffset) OVERRIDE FINAL
     {
-        QMutexLocker k(&_tileCacheMutex);
+        std::string tileFilePath;
+        {
+            QMutexLocker k(&_tileCacheMutex);
 
-        assert(_isTiled);
-        if (!_isTiled) {
-            throw std::logic_error("allocTile() but cache is not tiled!");
-        }
-        std::set<TileCacheFilePtr>::iterator foundTileFile = _cacheFiles.find(file);
-        assert(foundTileFile != _cacheFiles.end());
-        if (foundTileFile == _cacheFiles.end()) {
-            return;
-        }
-        int index = dataOffset / _tileByteSize;
-
-        // The dataOffset should be a multiple of the tile size
-        assert(_tileByteSize * index == dataOffset);
-        assert(index >= 0 && index < (int)(*foundTileFile)->usedTiles.size());
-        assert((*foundTileFile)->usedTiles[index]);
-        (*foundTileFile)->usedTiles[index] = false;
-
-        // If the file does not have any tile associated, remove it
-        // A use_count of 2 means that the tile file is only referenced by the cache itself and the entry calling
-        // the freeTile() function, hence once its freed, no tile should be using it anymore
-        if ((*foundTileFile).use_count() <= 2) {
-            // Do not remove the file except if we are clearing the cache
-            if (_clearingCache) {
-                (*foundTileFile)->file->remove();
-                _cacheFiles.erase(foundTileFile);
+            assert(_isTiled);
+            if (!_isTiled) {
+                throw std::logic_error("allocTile() but cache is not tiled!");
+            }
+            std::set<TileCacheFilePtr>::iterator foundTileFile = _cacheFiles.find(file);
+            assert(foundTileFile != _cacheFiles.end());
+            if (foundTileFile == _cacheFiles.end()) {
+                return;
+            }
+            int index = dataOffset / _tileByteSize;
+
+            // The dataOffset should be a multiple of the tile size
+            assert(_tileByteSize * index == dataOffset);
+            assert(index >= 0 && index < (int)(*foundTileFile)->usedTiles.size());
+            assert((*foundTileFile)->usedTiles[index]);
+            (*foundTileFile)->usedTiles[index] = false;
+            tileFilePath = (*foundTileFile)->file->path();
+
+            // If the file does not have any tile associated, remove it
+            // A use_count of 2 means that the tile file is only referenced by the cache itself and the entry calling
+            // the freeTile() function, hence once its freed, no tile should be using it anymore
+            if ((*foundTileFile).use_count() <= 2) {
+                // Do not remove the file except if we are clearing the cache
+                if (_clearingCache) {
+                    (*foundTileFile)->file->remove();
+                    _cacheFiles.erase(foundTileFile);
+                } else {
+                    // Invalidate this portion of the cache
+                    (*foundTileFile)->file->flush(MemoryFile::eFlushTypeInvalidate, (*foundTileFile)->file->data() + dataOffset, _tileByteSize);
+                }
             } else {
-                // Invalidate this portion of the cache
-                (*foundTileFile)->file->flush(MemoryFile::eFlushTypeInvalidate, (*foundTileFile)->file->data() + dataOffset, _tileByteSize);
+                _nextAvailableCacheFile = *foundTileFile;
+                _nextAvailableCacheFileIndex = index;
             }
-        } else {
-            _nextAvailableCacheFile = *foundTileFile;
-            _nextAvailableCacheFileIndex = index;
         }
+
+        // Not under _tileCacheMutex: this may release the last reference to entries, which would free their tile
+        removeIndexEntry(hash, tileFilePath, dataOffset);
     }
 
 
-    void createInternal(const typename EntryType::key_type & key,
+
+
+    void createInternal(CacheBucket& bucket,
+                        const typename EntryType::key_type & key,
                         const ParamsTypePtr & params,
                         ImageLockerHelper<EntryType>* entryLocker,
                         EntryTypePtr* returnValue) const
     {
-        //_lock must not be taken here
+        //bucket.lock must not be taken here
 
         ///Before allocating the memory check that there's enough space to fit in memory
         appPTR->checkCacheFreeMemoryIsGoodEnough();
@@ -796,31 +1362,10 @@ private:
             ++safeCounter;
         }
 
-        U64 memoryCacheSize, maximumInMemorySize;
-        {
-            QMutexLocker k(&_sizeLock);
-            memoryCacheSize = _memoryCacheSize;
-            maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
-        }
         {
-            QMutexLocker locker(&_lock);
-            std::list<EntryTypePtr> entriesToBeDeleted;
-            double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
             ///While the current cache size can't fit the new entry, erase the last recently used entries.
-            ///Also if the total free RAM is under the limit of the system free RAM to keep free, erase LRU entries.
-            while (occupationPercentage > NATRON_CACHE_LIMIT_PERCENT) {
-                std::list<EntryTypePtr> deleted;
-                if ( !tryEvictInMemoryEntry(deleted) ) {
-                    break;
-                }
-
-                for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    entriesToBeDeleted.push_back(*it);
-                    memoryCacheSize -= (*it)->size();
-                }
-
-                occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
-            }
+            std::list<EntryTypePtr> entriesToBeDeleted;
+            evictInMemoryEntriesUntil(NATRON_CACHE_LIMIT_PERCENT, &entriesToBeDeleted);
 
             if ( !entriesToBeDeleted.empty() ) {
                 ///Launch a separate thread whose function will be to delete all the entries to be deleted
@@ -832,41 +1377,24 @@ private:
             }
         }
         {
-            //If _maximumcacheSize == 0 we don't return 1 otherwise we would cause a deadlock
-            QMutexLocker k(&_sizeLock);
-            double occupationPercentage =  _maximumCacheSize == 0 ? 0.99 : (double)_memoryCacheSize / _maximumCacheSize;
+            QMutexLocker k(&_memoryFullMutex);
+            double occupationPercentage = getMemoryOccupationOfMaximumSize();
 
-            //_memoryCacheSize member will get updated while images are being destroyed by the parallel thread.
+            //_memoryCacheSize of the buckets will get updated while images are being destroyed by the parallel thread.
             //we wait for cache memory occupation to be < 100% to be sure we don't hit swap here
+            if ( occupationPercentage >= 1. ) {
+                _deleterThread.freePendingEntries();
+            }
             while ( occupationPercentage >= 1. && _deleterThread.isWorking() ) {
-                _memoryFullCondition.wait(&_sizeLock);
-                occupationPercentage =  _maximumCacheSize == 0 ? 0.99 : (double)_memoryCacheSize / _maximumCacheSize;
+                _memoryFullCondition.wait(&_memoryFullMutex);
+                occupationPercentage = getMemoryOccupationOfMaximumSize();
             }
         }
         if (_isTiled) {
-
-            QMutexLocker locker(&_lock);
             // For tiled caches, we insert directly into the disk cache, so make sure there is room for it
             std::list<EntryTypePtr> entriesToBeDeleted;
-            U64 diskCacheSize, maximumDiskCacheSize;
-            {
-                QMutexLocker k(&_sizeLock);
-                diskCacheSize = _diskCacheSize;
-                maximumDiskCacheSize = std::max( (std::size_t)1, _maximumCacheSize - _maximumInMemorySize );
-            }
-            double diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
-            while (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
-                std::list<EntryTypePtr> deleted;
-                if ( !tryEvictDiskEntry(deleted) ) {
-                    break;
-                }
+            evictDiskEntriesUntil(NATRON_CACHE_LIMIT_PERCENT, &entriesToBeDeleted);
 
-                for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    diskCacheSize -= (*it)->size();
-                    entriesToBeDeleted.push_back(*it);
-                }
-                diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
-            }
             if ( !entriesToBeDeleted.empty() ) {
                 ///Launch a separate thread whose function will be to delete all the entries to be deleted
                 _deleterThread.appendToQueue(entriesToBeDeleted);
@@ -878,7 +1406,7 @@ private:
 
         }
         {
-            QMutexLocker locker(&_lock);
+            CacheBucketLocker locker(bucket);
 
             try {
                 returnValue->reset( new EntryType(key, params, this ) );
@@ -889,7 +1417,7 @@ private:
             }
 
             // For a tiled cache, all entries must have the same size
-            assert(!_isTiled || (*returnValue)->getSizeInBytesFromParams() == _tileByteSize);
+            assert(!_isTiled || !*returnValue || (*returnValue)->getSizeInBytesFromParams() == _tileByteSize);
 
             if (*returnValue) {
 
@@ -897,23 +1425,210 @@ private:
                 if (entryLocker) {
                     entryLocker->lock(*returnValue);
                 }
-                sealEntry(*returnValue, _isTiled ? false : true);
+                sealEntry(bucket, *returnValue, _isTiled ? false : true);
+                bucket.statistics.recordInsert( key.getCacheHolderIndex(), (*returnValue)->getMipMapLevel() );
             }
         }
+        // The data of other entries stored on disk are only written once evicted from the in-memory portion,
+        // see processWriteBehindEntry()
+        if ( _isTiled && *returnValue && ( (*returnValue)->getParams()->getStorageInfo().mode == eStorageModeDisk ) ) {
+            addPendingIndexEntry(*returnValue);
+        }
     } // createInternal
 
+    /**
+     * @brief Called once an entry stored on disk was created. It is recorded in the index of the disk portion
+     * by writePendingIndexRecords() once nothing but the cache uses it anymore, i.e: once its data were written.
+     **/
+    void addPendingIndexEntry(const EntryTypePtr& entry) const
+    {
+        if ( !_index.isOpened() ) {
+            return;
+        }
+        IndexPendingEntry pending;
+        pending.hash = entry->getHashKey();
+        pending.entry = entry;
+
+        QMutexLocker k(&_indexPendingEntriesMutex);
+        _indexPendingEntries.push_back(pending);
+        _indexPendingEntriesByHash.insert( std::make_pair( pending.hash, --_indexPendingEntries.end() ) );
+    }
+
+    /**
+     * @brief Removes a pending entry from the list and the map, _indexPendingEntriesMutex must be locked.
+     * @returns The entry following it in the list.
+     **/
+    typename IndexPendingEntryList::iterator eraseIndexPendingEntry(typename IndexPendingEntryList::iterator it) const
+    {
+        std::pair<typename IndexPendingEntryMap::iterator, typename IndexPendingEntryMap::iterator> range = _indexPendingEntriesByHash.equal_range(it->hash);
+        for (typename IndexPendingEntryMap::iterator found = range.first; found != range.second; ++found) {
+            if (found->second == it) {
+                _indexPendingEntriesByHash.erase(found);
+                break;
+            }
+        }
+
+        return _indexPendingEntries.erase(it);
+    }
+
+    void clearIndexPendingEntries() const
+    {
+        QMutexLocker k(&_indexPendingEntriesMutex);
+
+        _indexPendingEntries.clear();
+        _indexPendingEntriesByHash.clear();
+    }
+
+    /**
+     * @brief Records in the index the pending entries that are no longer used, examining at most maxEntries of them.
+     * This does nothing if another thread is already doing it.
+     * Implemented in CacheSerialization.h
+     **/
+    void writePendingIndexRecords(int maxEntries) const;
+
+    /**
+     * @brief Records in the index that the data at the given location were removed from the disk.
+     **/
+    void removeIndexEntry(U64 hash,
+                          const std::string& filePath,
+                          std::size_t dataOffset) const
+    {
+        // When tearing down, the entries are released but their data stay on disk
+        if ( _tearingDown || !_index.isOpened() ) {
+            return;
+        }
+        // Released after _indexPendingEntriesMutex
+        std::list<EntryTypePtr> pendingEntries;
+        QMutexLocker k(&_indexPendingEntriesMutex);
+
+        // The entry may still be waiting to be recorded: it must not be recorded after its removal
+        std::pair<typename IndexPendingEntryMap::iterator, typename IndexPendingEntryMap::iterator> range = _indexPendingEntriesByHash.equal_range(hash);
+        for (typename IndexPendingEntryMap::iterator it = range.first; it != range.second;) {
+            EntryTypePtr entry = it->second->entry.lock();
+            if ( !entry || ( ( entry->getOffsetInFile() == dataOffset ) && ( entry->getFilePath() == filePath ) ) ) {
+                _indexPendingEntries.erase(it->second);
+                _indexPendingEntriesByHash.erase(it++);
+            } else {
+                ++it;
+            }
+            if (entry) {
+                pendingEntries.push_back(entry);
+            }
+        }
+        _index.appendRemove(filePath, dataOffset);
+    }
+
+    /**
+     * @brief Returns the in-memory size of the cache relative to the maximum size of the cache.
+     * If the maximum size is 0 we don't return 1 otherwise we would cause a deadlock
+     **/
+    double getMemoryOccupationOfMaximumSize() const
+    {
+        std::size_t maximumCacheSize = getMaximumSize();
+
+        return maximumCacheSize == 0 ? 0.99 : (double)getMemoryCacheSize() / maximumCacheSize;
+    }
+
+    /**
+     * @brief The eviction coordinator of the in-memory portion. Each bucket only knows about the LRU order of its own entries,
+     * so the buckets are visited in a round-robin fashion and their least recently used entry is evicted,
+     * until the in-memory occupation of the whole cache is below maxOccupation or there is nothing left to evict.
+     * Evicted entries are appended to entriesToBeDeleted and should be destroyed without holding any lock.
+     * Only one bucket lock is taken at a time: this must not be called while holding a bucket lock.
+     **/
+    void evictInMemoryEntriesUntil(double maxOccupation,
+                                   std::list<EntryTypePtr>* entriesToBeDeleted) const
+    {
+        // The RAM of the entries handed off to the write-behind threads or to the deleter thread is about to be released:
+        // do not evict other entries for it
+        std::size_t memoryCacheSize = getMemoryCacheSize();
+        std::size_t releasedBytes = _writeBehindQueue.getQueuedBytes() + _deleterThread.getPendingBytes();
+        memoryCacheSize = releasedBytes > memoryCacheSize ? 0 : memoryCacheSize - releasedBytes;
+        std::size_t maximumInMemorySize = std::max( (std::size_t)1, getMaximumMemorySize() );
+
+        // Number of consecutive buckets in which nothing could be evicted
+        int nBucketsFailed = 0;
+        const int nBuckets = (int)_buckets.size();
+
+        while ( ( (double)memoryCacheSize / maximumInMemorySize > maxOccupation ) && (nBucketsFailed < nBuckets) ) {
+            CacheBucket& bucket = getNextEvictionBucket();
+            std::size_t freedBytes = 0;
+            EntryTypePtr entryToCompress;
+            bool evicted;
+            {
+                CacheBucketLocker locker(bucket);
+                evicted = tryEvictInMemoryEntry(bucket, *entriesToBeDeleted, &freedBytes, &entryToCompress);
+            }
+            if (entryToCompress) {
+                compressEvictedEntry(entryToCompress, entriesToBeDeleted, &freedBytes);
+            }
+            if (!evicted) {
+                ++nBucketsFailed;
+                continue;
+            }
+            nBucketsFailed = 0;
+            memoryCacheSize = freedBytes > memoryCacheSize ? 0 : memoryCacheSize - freedBytes;
+        }
+    }
+
+    void evictInMemoryEntriesUntil(double maxOccupation) const
+    {
+        std::list<EntryTypePtr> entriesToBeDeleted;
+
+        evictInMemoryEntriesUntil(maxOccupation, &entriesToBeDeleted);
+        if ( !entriesToBeDeleted.empty() ) {
+            _deleterThread.appendToQueue(entriesToBeDeleted);
+            entriesToBeDeleted.clear();
+        }
+    }
+
+    /**
+     * @brief Same as evictInMemoryEntriesUntil() but for the disk portion of the cache.
+     **/
+    void evictDiskEntriesUntil(double maxOccupation,
+                               std::list<EntryTypePtr>* entriesToBeDeleted) const
+    {
+        std::size_t diskCacheSize = getDiskCacheSize();
+        std::size_t maximumDiskCacheSize;
+        {
+            QMutexLocker k(&_maximumSizeLock);
+            maximumDiskCacheSize = std::max( (std::size_t)1, _maximumCacheSize - _maximumInMemorySize );
+        }
+
+        int nBucketsFailed = 0;
+        const int nBuckets = (int)_buckets.size();
+
+        while ( ( (double)diskCacheSize / maximumDiskCacheSize >= maxOccupation ) && (nBucketsFailed < nBuckets) ) {
+            CacheBucket& bucket = getNextEvictionBucket();
+            std::size_t freedBytes = 0;
+            bool evicted;
+            {
+                CacheBucketLocker locker(bucket);
+                evicted = tryEvictDiskEntry(bucket, *entriesToBeDeleted, &freedBytes);
+            }
+            if (!evicted) {
+                ++nBucketsFailed;
+                continue;
+            }
+            nBucketsFailed = 0;
+            diskCacheSize = freedBytes > diskCacheSize ? 0 : diskCacheSize - freedBytes;
+        }
+    }
+
 public:
 
     void swapOrInsert(const EntryTypePtr& entryToBeEvicted,
                       const EntryTypePtr& newEntry)
     {
-        QMutexLocker locker(&_lock);
-
         const typename EntryType::key_type& key = entryToBeEvicted->getKey();
         typename EntryType::hash_type hash = entryToBeEvicted->getHashKey();
+        CacheBucket& bucket = getBucket(hash);
+
+        CacheBucketLocker locker(bucket);
+
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache(hash);
-        if ( memoryCached != _memoryCache.end() ) {
+        CacheIterator memoryCached = bucket.memoryCache(hash);
+        if ( memoryCached != bucket.memoryCache.end() ) {
             std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
             for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                 if ( ( (*it)->getKey() == key ) && ( (*it)->getParams() == entryToBeEvicted->getParams() ) ) {
@@ -925,8 +1640,8 @@ public:
             ret.push_back(newEntry);
         } else {
             ///Look in disk cache
-            CacheIterator diskCached = _diskCache(hash);
-            if ( diskCached != _diskCache.end() ) {
+            CacheIterator diskCached = bucket.diskCache(hash);
+            if ( diskCached != bucket.diskCache.end() ) {
                 ///Remove the old entry
                 std::list<EntryTypePtr> & ret = getValueFromIterator(diskCached);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
@@ -937,7 +1652,7 @@ public:
                 }
             }
             ///Insert in mem cache
-            _memoryCache.insert(hash, newEntry);
+            bucket.memoryCache.insert(hash, newEntry);
         }
     }
 
@@ -975,30 +1690,56 @@ public:
     {
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
-
+        CacheBucket& bucket = getBucket( key.getHash() );
+        bool movedBackInMemory = false;
+        bool found = false;
         {
             ///Be atomic, so it cannot be created by another thread in the meantime
-            QMutexLocker getlocker(&_getLock);
+            CacheStatisticsMutexLocker getlocker(&bucket.getLock, &bucket.statistics);
             std::list<EntryTypePtr> entries;
             bool didGetSucceed;
             {
-                QMutexLocker locker(&_lock);
-                didGetSucceed = getInternal(key, &entries);
+                CacheBucketLocker locker(bucket);
+                didGetSucceed = getInternal(bucket, key, &entries, &movedBackInMemory);
             }
             if (didGetSucceed) {
                 for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
                     if (*(*it)->getParams() == *params) {
                         *returnValue = *it;
-
-                        return true;
+                        found = true;
+                        break;
                     }
                 }
             }
 
-            createInternal(key, params, locker, returnValue);
-
-            return false;
+            if (found) {
+                bucket.statistics.recordLookup( key.getCacheHolderIndex(), (*returnValue)->getMipMapLevel(), true );
+            } else {
+                createInternal(bucket, key, params, locker, returnValue);
+                // The level looked up is the one of the entry created
+                bucket.statistics.recordLookup( key.getCacheHolderIndex(), *returnValue ? (int)(*returnValue)->getMipMapLevel() : -1, false );
+            }
         } // getlocker
+
+        if (found) {
+            // An entry taken back from the compressed entries is decompressed without holding the bucket locks
+            std::list<EntryTypePtr> foundEntries(1, *returnValue);
+            decompressEntries(&foundEntries);
+            if ( foundEntries.empty() ) {
+                // The entry could not be decompressed and was removed from the cache: create it again
+                returnValue->reset();
+
+                return getOrCreate(key, params, locker, returnValue);
+            }
+        }
+
+        if (movedBackInMemory) {
+            // The entry was put back into RAM or decompressed, make sure we do not exceed the RAM limit
+            evictInMemoryEntriesUntil(1.);
+        }
+        writePendingIndexRecords(NATRON_CACHE_INDEX_PENDING_ENTRIES_CHECKS);
+
+        return found;
     }
 
     /**
@@ -1017,13 +1758,20 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            if ( !_isTiled && evictedFromMemory.second->isStoredOnDisk() ) {
-                evictedFromMemory.second->removeAnyBackingFile();
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            CacheBucket& bucket = *_buckets[i];
+            CacheBucketLocker locker(bucket);
+            std::pair<hash_type, EntryTypePtr> evictedFromMemory = bucket.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                if ( !_isTiled && evictedFromMemory.second->isStoredOnDisk() ) {
+                    evictedFromMemory.second->removeAnyBackingFile();
+                }
+                evictedFromMemory = bucket.memoryCache.evict();
+            }
+            std::pair<hash_type, EntryTypePtr> evictedFromCompressed = bucket.compressedCache.evict();
+            while (evictedFromCompressed.second) {
+                evictedFromCompressed = bucket.compressedCache.evict();
             }
-            evictedFromMemory = _memoryCache.evict();
         }
 
         if (_signalEmitter) {
@@ -1031,6 +1779,9 @@ public:
             _signalEmitter->emitSignalClearedInMemoryPortion();
         }
 
+        // Give back the buffers of the destroyed entries to the system
+        BufferPool::releaseIdleMemory();
+
         {
             QMutexLocker k(&_tileCacheMutex);
             _clearingCache = false;
@@ -1047,19 +1798,22 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-
-        /// An entry which has a use_count greater than 1 is not removable:
-        /// The backing file must not be removed because it might be read/written to
-        /// at the same time. The best we can do is just let it here in the cache.
-        std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
-        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-        //we'll let the user of these entries purge the extra entries left in the cache later on
-        while (evictedFromDisk.second) {
-            if (!_isTiled) {
-                evictedFromDisk.second->removeAnyBackingFile();
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            CacheBucket& bucket = *_buckets[i];
+            CacheBucketLocker locker(bucket);
+
+            /// An entry which has a use_count greater than 1 is not removable:
+            /// The backing file must not be removed because it might be read/written to
+            /// at the same time. The best we can do is just let it here in the cache.
+            std::pair<hash_type, EntryTypePtr> evictedFromDisk = bucket.diskCache.evict();
+            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+            //we'll let the user of these entries purge the extra entries left in the cache later on
+            while (evictedFromDisk.second) {
+                if (!_isTiled) {
+                    evictedFromDisk.second->removeAnyBackingFile();
+                }
+                evictedFromDisk = bucket.diskCache.evict();
             }
-            evictedFromDisk = _diskCache.evict();
         }
 
 
@@ -1076,57 +1830,82 @@ public:
             ///block signals otherwise the we would be spammed of notifications
             _signalEmitter->blockSignals(true);
         }
-        QMutexLocker locker(&_lock);
-        std::pair<hash_type, EntryTypePtr> evictedFromMemory = _memoryCache.evict();
-        while (evictedFromMemory.second) {
-            // Move back the entry on disk if it can be store on disk
-            // For tiled caches, the tile is sharing the same file with other entries
-            // so we cannot close it, just remove the entry
-            if ( evictedFromMemory.second->isStoredOnDisk() && !_isTiled) {
-                evictedFromMemory.second->deallocate();
-                /*insert it back into the disk portion */
-
-                U64 diskCacheSize, maximumCacheSize;
-                {
-                    QMutexLocker k(&_sizeLock);
-                    diskCacheSize = _diskCacheSize;
-                    maximumCacheSize = _maximumCacheSize;
-                }
-
-                /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
-                while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
-                    {
-                        std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
-                        //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
-                        //we'll let the user of these entries purge the extra entries left in the cache later on
-                        if (!evictedFromDisk.second) {
-                            break;
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            CacheBucket& bucket = *_buckets[i];
+            CacheBucketLocker locker(bucket);
+            std::pair<hash_type, EntryTypePtr> evictedFromMemory = bucket.memoryCache.evict();
+            while (evictedFromMemory.second) {
+                // Move back the entry on disk if it can be store on disk
+                // For tiled caches, the tile is sharing the same file with other entries
+                // so we cannot close it, just remove the entry
+                // The file of a shared entry belongs to another process, just remove the entry
+                if ( evictedFromMemory.second->isStoredOnDisk() && !_isTiled && !evictedFromMemory.second->isSharedFile() ) {
+                    // Hand off the entry to the write-behind threads. If too much data is already waiting to be written,
+                    // this is not a render thread: write it right away.
+                    evictedFromMemory.second->setWriteBehindPending(true);
+                    if ( !_writeBehindQueue.appendToQueue( evictedFromMemory.second, evictedFromMemory.second->size() ) ) {
+                        evictedFromMemory.second->setWriteBehindPending(false);
+                        bool isNew = evictedFromMemory.second->hasUnwrittenData();
+                        try {
+                            evictedFromMemory.second->writeBackingFile();
+                            recordDiskWrite( bucket, evictedFromMemory.second, evictedFromMemory.second->size() );
+                            evictedFromMemory.second->deallocate();
+                        } catch (const std::exception & e) {
+                            qDebug() << "Error while writing cache entry to disk: " << e.what();
+                            evictedFromMemory.second->scheduleForDestruction();
+                            evictedFromMemory = bucket.memoryCache.evict();
+                            continue;
+                        }
+                        if (isNew) {
+                            addPendingIndexEntry(evictedFromMemory.second);
                         }
-                        ///Erase the file from the disk if we reach the limit.
-                        evictedFromDisk.second->removeAnyBackingFile();
                     }
-                    {
-                        QMutexLocker k(&_sizeLock);
-                        diskCacheSize = _diskCacheSize;
-                        maximumCacheSize = _maximumCacheSize;
+                    /*insert it back into the disk portion */
+
+                    U64 diskCacheSize = getDiskCacheSize();
+                    U64 maximumCacheSize = getMaximumSize();
+
+                    /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
+                    while (diskCacheSize + evictedFromMemory.second->size() >= maximumCacheSize) {
+                        {
+                            std::pair<hash_type, EntryTypePtr> evictedFromDisk = bucket.diskCache.evict();
+                            //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
+                            //we'll let the user of these entries purge the extra entries left in the cache later on
+                            if (!evictedFromDisk.second) {
+                                break;
+                            }
+                            ///Erase the file from the disk if we reach the limit.
+                            evictedFromDisk.second->removeAnyBackingFile();
+                        }
+                        diskCacheSize = getDiskCacheSize();
+                        maximumCacheSize = getMaximumSize();
                     }
-                }
 
-                /*update the disk cache size*/
-                CacheIterator existingDiskCacheEntry = _diskCache( evictedFromMemory.second->getHashKey() );
-                /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-                if ( existingDiskCacheEntry == _diskCache.end() ) {
-                    _diskCache.insert(evictedFromMemory.second->getHashKey(), evictedFromMemory.second);
+                    /*update the disk cache size*/
+                    CacheIterator existingDiskCacheEntry = bucket.diskCache( evictedFromMemory.second->getHashKey() );
+                    /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
+                    if ( existingDiskCacheEntry == bucket.diskCache.end() ) {
+                        bucket.diskCache.insert(evictedFromMemory.second->getHashKey(), evictedFromMemory.second);
+                    }
                 }
+
+                evictedFromMemory = bucket.memoryCache.evict();
             }
 
-            evictedFromMemory = _memoryCache.evict();
+            // Compressed entries only live in RAM
+            std::pair<hash_type, EntryTypePtr> evictedFromCompressed = bucket.compressedCache.evict();
+            while (evictedFromCompressed.second) {
+                evictedFromCompressed = bucket.compressedCache.evict();
+            }
         }
 
         _signalEmitter->blockSignals(false);
         if (emitSignals) {
             _signalEmitter->emitSignalClearedInMemoryPortion();
         }
+
+        // Give back the buffers of the destroyed entries to the system
+        BufferPool::releaseIdleMemory();
     } // clearInMemoryPortion
 
     void clearExceedingEntries()
@@ -1135,52 +1914,8 @@ public:
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
         std::list<EntryTypePtr> entriesToBeDeleted;
 
-        {
-            QMutexLocker locker(&_lock);
-            U64 memoryCacheSize, maximumInMemorySize;
-            {
-                QMutexLocker k(&_sizeLock);
-                memoryCacheSize = _memoryCacheSize;
-                maximumInMemorySize = std::max( (std::size_t)1, _maximumInMemorySize );
-            }
-            double occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
-            while (occupationPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
-                std::list<EntryTypePtr> deleted;
-                if ( !tryEvictInMemoryEntry(deleted) ) {
-                    break;
-                }
-
-                for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    if ( !(*it)->isStoredOnDisk() ) {
-                        memoryCacheSize -= (*it)->size();
-                    }
-                    entriesToBeDeleted.push_back(*it);
-                }
-                occupationPercentage = (double)memoryCacheSize / maximumInMemorySize;
-            }
-
-            U64 diskCacheSize, maximumDiskCacheSize;
-            {
-                QMutexLocker k(&_sizeLock);
-                diskCacheSize = _diskCacheSize;
-                maximumDiskCacheSize = std::max( (std::size_t)1, _maximumCacheSize - _maximumInMemorySize );
-            }
-            double diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
-            while (diskPercentage >= NATRON_CACHE_LIMIT_PERCENT) {
-                std::list<EntryTypePtr> deleted;
-                if ( !tryEvictDiskEntry(deleted) ) {
-                    break;
-                }
-
-                for (typename std::list<EntryTypePtr>::iterator it = deleted.begin(); it != deleted.end(); ++it) {
-                    diskCacheSize -= (*it)->size();
-                    entriesToBeDeleted.push_back(*it);
-                }
-                diskPercentage = (double)diskCacheSize / maximumDiskCacheSize;
-            }
-            
-
-        }
+        evictInMemoryEntriesUntil(NATRON_CACHE_LIMIT_PERCENT, &entriesToBeDeleted);
+        evictDiskEntriesUntil(NATRON_CACHE_LIMIT_PERCENT, &entriesToBeDeleted);
     }
 
     /**
@@ -1190,15 +1925,18 @@ public:
      **/
     void getCopy(std::list<EntryTypePtr>* copy) const
     {
-        QMutexLocker locker(&_lock);
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[i];
+            CacheBucketLocker locker(bucket);
 
-        for (CacheIterator it = _memoryCache.begin(); it != _memoryCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert( copy->end(), entries.begin(), entries.end() );
-        }
-        for (CacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
-            const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
-            copy->insert( copy->end(), entries.begin(), entries.end() );
+            for (CacheIterator it = bucket.memoryCache.begin(); it != bucket.memoryCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert( copy->end(), entries.begin(), entries.end() );
+            }
+            for (CacheIterator it = bucket.diskCache.begin(); it != bucket.diskCache.end(); ++it) {
+                const std::list<EntryTypePtr> & entries = getValueFromIterator(it);
+                copy->insert( copy->end(), entries.begin(), entries.end() );
+            }
         }
     }
 
@@ -1206,19 +1944,32 @@ public:
      * @brief Removes the last recently used entry from the in-memory cache.
      * This is expensive since it takes the lock. Returns false
      * if there's nothing left to evict.
+     * Since each bucket has its own LRU order, the entry is taken from the next bucket
+     * in the eviction order that has something to evict.
      **/
     bool evictLRUInMemoryEntry() const
     {
         ///Make sure the shared_ptrs live in this list and are destroyed not while under the lock
         ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
         std::list<EntryTypePtr> entriesToBeDeleted;
-        bool ret;
-        {
-            QMutexLocker locker(&_lock);
-            ret = tryEvictInMemoryEntry(entriesToBeDeleted);
+
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            CacheBucket& bucket = getNextEvictionBucket();
+            EntryTypePtr entryToCompress;
+            bool evicted;
+            {
+                CacheBucketLocker locker(bucket);
+                evicted = tryEvictInMemoryEntry(bucket, entriesToBeDeleted, 0, &entryToCompress);
+            }
+            if (entryToCompress) {
+                compressEvictedEntry(entryToCompress, &entriesToBeDeleted, 0);
+            }
+            if (evicted) {
+                return true;
+            }
         }
 
-        return ret;
+        return false;
     }
 
     /**
@@ -1228,97 +1979,134 @@ public:
      **/
     bool evictLRUDiskEntry() const
     {
-
-        QMutexLocker locker(&_lock);
         std::list<EntryTypePtr> entriesToBeDeleted;
-        return tryEvictDiskEntry(entriesToBeDeleted);
+
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            CacheBucket& bucket = getNextEvictionBucket();
+            CacheBucketLocker locker(bucket);
+            if ( tryEvictDiskEntry(bucket, entriesToBeDeleted, 0) ) {
+                return true;
+            }
+        }
+
+        return false;
     }
 
     /**
      * @brief To be called by a CacheEntry whenever it's size changes.
      * This way the cache can keep track of the real memory footprint.
      **/
-    virtual void notifyEntrySizeChanged(std::size_t oldSize,
+    virtual void notifyEntrySizeChanged(U64 hash,
+                                        std::size_t oldSize,
                                         std::size_t newSize) const OVERRIDE FINAL
     {
+        CacheBucket& bucket = getBucket(hash);
+
         ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache
-        QMutexLocker k(&_sizeLock);
+        QMutexLocker k(&bucket.sizeLock);
 
         ///This function can only be called for RAM buffers or while a memory mapped file is mapped into the RAM, so
         ///we just have to modify the RAM size.
 
-        ///Avoid overflows, _memoryCacheSize may not always fallback to 0
+        ///Avoid overflows, memoryCacheSize may not always fallback to 0
         qint64 diff = (qint64)newSize - (qint64)oldSize;
 
         if (diff < 0) {
-            _memoryCacheSize = diff > (qint64)_memoryCacheSize ? 0 : _memoryCacheSize + diff;
+            bucket.memoryCacheSize = -diff > (qint64)bucket.memoryCacheSize ? 0 : bucket.memoryCacheSize + diff;
         } else {
-            _memoryCacheSize += diff;
+            bucket.memoryCacheSize += diff;
         }
 #ifdef NATRON_DEBUG_CACHE
-        qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
+        qDebug() << cacheName().c_str() << " bucket memory size: " << printAsRAM(bucket.memoryCacheSize);
 #endif
     }
 
     /**
      * @brief To be called by a CacheEntry on allocation.
      **/
-    virtual void notifyEntryAllocated(double time,
+    virtual void notifyEntryAllocated(U64 hash,
+                                      double time,
                                       std::size_t size,
                                       StorageModeEnum storage) const OVERRIDE FINAL
     {
-        ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache, hence the
-        ///lock should already be taken.
-        QMutexLocker k(&_sizeLock);
+        CacheBucket& bucket = getBucket(hash);
 
-        if (storage == eStorageModeDisk) {
-            if (_isTiled) {
-                // For tile caches, we do not control which portion of the cache is in memory, so just keep track of the disk portion
-                _diskCacheSize += size;
+        {
+            ///The entry has notified it's memory layout has changed, it must have been due to an action from the cache, hence the
+            ///lock should already be taken.
+            QMutexLocker k(&bucket.sizeLock);
+
+            if (storage == eStorageModeDisk) {
+                if (_isTiled) {
+                    // For tile caches, we do not control which portion of the cache is in memory, so just keep track of the disk portion
+                    bucket.diskCacheSize += size;
+                } else {
+                    bucket.memoryCacheSize += size;
+                }
             } else {
-                _memoryCacheSize += size;
-                appPTR->increaseNCacheFilesOpened();
+                bucket.memoryCacheSize += size;
             }
-        } else {
-            _memoryCacheSize += size;
+#ifdef NATRON_DEBUG_CACHE
+            qDebug() << cacheName().c_str() << " bucket memory size: " << printAsRAM(bucket.memoryCacheSize);
+#endif
+        }
+        if ( (storage == eStorageModeDisk) && !_isTiled ) {
+            appPTR->increaseNCacheFilesOpened();
         }
 
         _signalEmitter->emitAddedEntry(time);
-
-
-#ifdef NATRON_DEBUG_CACHE
-        qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
-#endif
     }
 
     /**
      * @brief To be called by a CacheEntry on destruction.
      **/
-    virtual void notifyEntryDestroyed(double time,
+    virtual void notifyEntryDestroyed(U64 hash,
+                                      double time,
                                       std::size_t size,
                                       StorageModeEnum storage) const OVERRIDE FINAL
     {
-        QMutexLocker k(&_sizeLock);
+        CacheBucket& bucket = getBucket(hash);
+
+        {
+            QMutexLocker k(&bucket.sizeLock);
 
-        if (storage == eStorageModeRAM) {
-            _memoryCacheSize = size > _memoryCacheSize ? 0 : _memoryCacheSize - size;
+            if (storage == eStorageModeRAM) {
+                bucket.memoryCacheSize = size > bucket.memoryCacheSize ? 0 : bucket.memoryCacheSize - size;
 #ifdef NATRON_DEBUG_CACHE
-            qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
+                qDebug() << cacheName().c_str() << " bucket memory size: " << printAsRAM(bucket.memoryCacheSize);
 #endif
-        } else if (storage == eStorageModeDisk) {
-            _diskCacheSize = size > _diskCacheSize ? 0 : _diskCacheSize - size;
+            } else if (storage == eStorageModeDisk) {
+                bucket.diskCacheSize = size > bucket.diskCacheSize ? 0 : bucket.diskCacheSize - size;
 #ifdef NATRON_DEBUG_CACHE
-            qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
+                qDebug() << cacheName().c_str() << " bucket disk size: " << printAsRAM(bucket.diskCacheSize);
 #endif
+            }
         }
 
-
         _signalEmitter->emitRemovedEntry(time, (int)storage);
     }
 
+    virtual void notifyEntryDataRemovedFromDisk(U64 hash,
+                                                const std::string& filePath,
+                                                std::size_t dataOffset) const OVERRIDE FINAL
+    {
+        removeIndexEntry(hash, filePath, dataOffset);
+    }
+
+    virtual void notifyEntryCompressedSizeChanged(U64 hash,
+                                                  std::size_t oldCompressedSize,
+                                                  std::size_t newCompressedSize) const OVERRIDE FINAL
+    {
+        CacheBucket& bucket = getBucket(hash);
+        QMutexLocker k(&bucket.sizeLock);
+
+        bucket.compressedCacheSize = oldCompressedSize > bucket.compressedCacheSize ? 0 : bucket.compressedCacheSize - oldCompressedSize;
+        bucket.compressedCacheSize += newCompressedSize;
+    }
+
     virtual void notifyMemoryDeallocated() const OVERRIDE FINAL
     {
-        QMutexLocker k(&_sizeLock);
+        QMutexLocker k(&_memoryFullMutex);
 
         _memoryFullCondition.wakeAll();
     }
@@ -1327,7 +2115,8 @@ public:
      * @brief To be called whenever an entry is deallocated from memory and put back on disk or whenever
      * it is reallocated in the RAM.
      **/
-    virtual void notifyEntryStorageChanged(StorageModeEnum oldStorage,
+    virtual void notifyEntryStorageChanged(U64 hash,
+                                           StorageModeEnum oldStorage,
                                            StorageModeEnum newStorage,
                                            double time,
                                            std::size_t size) const OVERRIDE FINAL
@@ -1337,34 +2126,38 @@ public:
         if (_tearingDown) {
             return;
         }
-        QMutexLocker k(&_sizeLock);
+        CacheBucket& bucket = getBucket(hash);
 
         assert(oldStorage != newStorage);
         assert(newStorage != eStorageModeNone);
-        if (oldStorage == eStorageModeRAM) {
-            _memoryCacheSize = size > _memoryCacheSize ? 0 : _memoryCacheSize - size;
-            _diskCacheSize += size;
+        {
+            QMutexLocker k(&bucket.sizeLock);
+
+            if (oldStorage == eStorageModeRAM) {
+                bucket.memoryCacheSize = size > bucket.memoryCacheSize ? 0 : bucket.memoryCacheSize - size;
+                bucket.diskCacheSize += size;
+            } else if (oldStorage == eStorageModeDisk) {
+                bucket.memoryCacheSize += size;
+                bucket.diskCacheSize = size > bucket.diskCacheSize ? 0 : bucket.diskCacheSize - size;
+            } else {
+                if (newStorage == eStorageModeRAM) {
+                    bucket.memoryCacheSize += size;
+                } else if (newStorage == eStorageModeDisk) {
+                    bucket.diskCacheSize += size;
+                }
+            }
 #ifdef NATRON_DEBUG_CACHE
-            qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
-            qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
+            qDebug() << cacheName().c_str() << " bucket memory size: " << printAsRAM(bucket.memoryCacheSize);
+            qDebug() << cacheName().c_str() << " bucket disk size: " << printAsRAM(bucket.diskCacheSize);
 #endif
+        }
+
+        if (oldStorage == eStorageModeRAM) {
             ///We switched from RAM to DISK that means the MemoryFile object has been destroyed hence the file has been closed.
             appPTR->decreaseNCacheFilesOpened();
         } else if (oldStorage == eStorageModeDisk) {
-            _memoryCacheSize += size;
-            _diskCacheSize = size > _diskCacheSize ? 0 : _diskCacheSize - size;
-#ifdef NATRON_DEBUG_CACHE
-            qDebug() << cacheName().c_str() << " memory size: " << printAsRAM(_memoryCacheSize);
-            qDebug() << cacheName().c_str() << " disk size: " << printAsRAM(_diskCacheSize);
-#endif
             ///We switched from DISK to RAM that means the MemoryFile object has been created and the file opened
             appPTR->increaseNCacheFilesOpened();
-        } else {
-            if (newStorage == eStorageModeRAM) {
-                _memoryCacheSize += size;
-            } else if (newStorage == eStorageModeDisk) {
-                _diskCacheSize += size;
-            }
         }
 
         _signalEmitter->emitEntryStorageChanged(time, (int)oldStorage, (int)newStorage);
@@ -1376,6 +2169,20 @@ public:
         appPTR->decreaseNCacheFilesOpened();
     }
 
+    virtual bool reserveEntryFilePath(const std::string& filePath) const OVERRIDE FINAL
+    {
+        QMutexLocker k(&_reservedFilePathsMutex);
+
+        return _reservedFilePaths.insert(filePath).second;
+    }
+
+    virtual void releaseEntryFilePath(const std::string& filePath) const OVERRIDE FINAL
+    {
+        QMutexLocker k(&_reservedFilePathsMutex);
+
+        _reservedFilePaths.erase(filePath);
+    }
+
     // const data member: no need to take the lock
     const std::string & cacheName() const
     {
@@ -1402,56 +2209,257 @@ public:
         return cacheFolderName;
     }
 
-    std::string getRestoreFilePath() const
+    std::string getIndexFilePath() const
     {
         QString newCachePath( getCachePath() );
         StrUtils::ensureLastPathSeparator(newCachePath);
 
-        newCachePath.append( QString::fromUtf8("restoreFile." NATRON_CACHE_FILE_EXT) );
+        newCachePath.append( QString::fromUtf8(NATRON_CACHE_INDEX_FILE_NAME) );
 
         return newCachePath.toStdString();
     }
 
-    void setMaximumCacheSize(U64 newSize)
-    {
-        QMutexLocker k(&_sizeLock);
-
-        _maximumCacheSize = newSize;
-    }
+    /**
+     * @brief Opens the persistent index of the disk portion of the cache and fills tableOfContents with the entries
+     * it references, which can then be passed to restore().
+     * @returns False if there was no valid index, in which case the index is left closed.
+     * This function might throw an exception upon failure to map the index.
+     * Implemented in CacheSerialization.h
+     **/
+    bool openIndex(CacheTOC* tableOfContents);
 
-    void setMaximumInMemorySize(double percentage)
+    /**
+     * @brief Starts a new empty index of the disk portion of the cache, replacing any existing one.
+     * This function might throw an exception upon failure to create the index.
+     **/
+    void createIndex()
     {
-        QMutexLocker k(&_sizeLock);
-
-        _maximumInMemorySize = _maximumCacheSize * percentage;
+        _index.create( getIndexFilePath(), _version );
     }
 
-    std::size_t getMaximumSize() const
+    /**
+     * @brief Closes the index, e.g: before removing the cache directory
+     **/
+    void closeIndex()
     {
-        QMutexLocker k(&_sizeLock);
+        clearIndexPendingEntries();
+        _index.close();
+    }
+
+    /**
+     * @brief Replaces the content of the index by the given entries.
+     * Implemented in CacheSerialization.h
+     **/
+    void writeIndex(const CacheTOC & tableOfContents);
+
+    /**
+     * @brief Shares the entries of this cache with the other processes of the host opening the same directory,
+     * see SharedCacheIndex. Entries published by publishSharedEntry() are then found by get() in the other processes,
+     * which map their files rather than computing them again.
+     * This function might throw an exception upon failure to create or map the index.
+     **/
+    void openSharedIndex(const std::string& directoryPath)
+    {
+        _sharedIndex.open(directoryPath, _version);
+    }
+
+    /**
+     * @brief Withdraws the entries published by this process and closes the shared index. The other processes
+     * keep the files they already mapped until they release them.
+     **/
+    void closeSharedIndex()
+    {
+        if ( !_sharedIndex.isOpened() ) {
+            return;
+        }
+        std::list<SharedPublishedEntry> published;
+        {
+            QMutexLocker k(&_sharedPublishedMutex);
+            published.swap(_sharedPublished);
+            _sharedPublishedBytes = 0;
+        }
+        for (typename std::list<SharedPublishedEntry>::const_iterator it = published.begin(); it != published.end(); ++it) {
+            _sharedIndex.unpublish(it->hash, it->record);
+        }
+        _sharedIndex.close();
+    }
+
+    bool isSharedIndexOpened() const
+    {
+        return _sharedIndex.isOpened();
+    }
+
+    /**
+     * @brief Hands off an entry stored in RAM to the write-behind threads, which copy its data to a file and publish
+     * it in the shared index, see writeSharedEntry(), so that the other processes of the host can map it.
+     * An entry is published only once, and not at all if the write-behind queue is full.
+     * The entry must not be written to anymore.
+     * Implemented in CacheSerialization.h
+     **/
+    void publishSharedEntry(const EntryTypePtr& entry) const;
+
+    void setMaximumCacheSize(U64 newSize)
+    {
+        QMutexLocker k(&_maximumSizeLock);
+
+        _maximumCacheSize = newSize;
+    }
+
+    void setMaximumInMemorySize(double percentage)
+    {
+        QMutexLocker k(&_maximumSizeLock);
+
+        _maximumInMemorySize = _maximumCacheSize * percentage;
+
+        // A small cache must not hold most of its RAM in entries waiting for the disk
+        _writeBehindQueue.setMaximumQueuedBytes( std::min( (std::size_t)NATRON_CACHE_WRITE_BEHIND_MAX_BYTES,
+                                                           (std::size_t)(_maximumInMemorySize * NATRON_CACHE_WRITE_BEHIND_MAX_PORTION) ) );
+    }
+
+    /**
+     * @brief Returns the number of entries destroyed rather than written to disk because too much data were already
+     * waiting to be written, see CacheWriteBehindQueue.
+     **/
+    U64 getWriteBehindDroppedEntriesCount() const
+    {
+        return _writeBehindQueue.getDroppedEntriesCount();
+    }
+
+    std::size_t getMaximumSize() const
+    {
+        QMutexLocker k(&_maximumSizeLock);
 
         return _maximumCacheSize;
     }
 
     std::size_t getMaximumMemorySize() const
     {
-        QMutexLocker k(&_sizeLock);
+        QMutexLocker k(&_maximumSizeLock);
 
         return _maximumInMemorySize;
     }
 
+    /**
+     * @brief If enabled, entries stored in RAM are compressed rather than destroyed when evicted from the in-memory portion,
+     * and decompressed by get(). Compressed entries count in the in-memory portion and may occupy up to
+     * NATRON_CACHE_COMPRESSED_PORTION_MAX of it.
+     * @param packHalfFloat If true, 32-bit floating point buffers are stored as 16-bit floats when this is lossless,
+     * e.g: for images read from half-float files.
+     **/
+    void setCompressionEnabled(bool enabled,
+                               bool packHalfFloat)
+    {
+        QMutexLocker k(&_maximumSizeLock);
+
+        _compressionEnabled = enabled;
+        _compressionPackHalfFloat = packHalfFloat;
+    }
+
+    /**
+     * @brief Sets the policy selecting the entries evicted from the in-memory portion of the cache, including
+     * the compressed entries. The disk portion always evicts its least recently used entries.
+     **/
+    void setEvictionPolicy(const CacheEvictionPolicyPtr& policy)
+    {
+        assert(policy);
+        QMutexLocker k(&_maximumSizeLock);
+
+        _evictionPolicy = policy;
+    }
+
+    /**
+     * @brief If enabled, the entries evicted from the cache are only destroyed once the cache stopped evicting
+     * entries for a while or needs memory, rather than as soon as possible. See DeleterThread.
+     **/
+    void setFreeEvictedEntriesOnIdle(bool enabled)
+    {
+        _deleterThread.setFreeOnIdle(enabled);
+    }
+
+    /**
+     * @brief Returns the RAM still held by the entries evicted from the cache and not destroyed yet. It is still counted
+     * by getMemoryCacheSize().
+     **/
+    std::size_t getEvictedEntriesPendingBytes() const
+    {
+        return _deleterThread.getPendingBytes();
+    }
+
+    /**
+     * @brief Makes the entries evicted from the cache be destroyed without waiting for the cache to be idle
+     **/
+    void freeEvictedEntries() const
+    {
+        _deleterThread.freePendingEntries();
+    }
+
+    CacheEvictionPolicyPtr getEvictionPolicy() const
+    {
+        QMutexLocker k(&_maximumSizeLock);
+
+        return _evictionPolicy;
+    }
+
+    /**
+     * @brief Returns the size of the compressed entries of the cache, summed over all buckets
+     **/
+    std::size_t getCompressedCacheSize() const
+    {
+        std::size_t ret = 0;
+
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            QMutexLocker k(&_buckets[i]->sizeLock);
+            ret += _buckets[i]->compressedCacheSize;
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief Returns the in-memory size of the cache, summed over all buckets
+     **/
     std::size_t getMemoryCacheSize() const
     {
-        QMutexLocker k(&_sizeLock);
+        std::size_t ret = 0;
 
-        return _memoryCacheSize;
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            QMutexLocker k(&_buckets[i]->sizeLock);
+            ret += _buckets[i]->memoryCacheSize;
+        }
+
+        return ret;
     }
 
+    /**
+     * @brief Returns the disk size of the cache, summed over all buckets
+     **/
     std::size_t getDiskCacheSize() const
     {
-        QMutexLocker k(&_sizeLock);
+        std::size_t ret = 0;
 
-        return _diskCacheSize;
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            QMutexLocker k(&_buckets[i]->sizeLock);
+            ret += _buckets[i]->diskCacheSize;
+        }
+
+        return ret;
+    }
+
+    /**
+     * @brief Adds the hit/miss/insert/eviction counters of all buckets to statistics.
+     **/
+    void getStatistics(CacheStatisticsData* statistics) const
+    {
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            _buckets[i]->statistics.accumulate(statistics);
+        }
+    }
+
+    void resetStatistics()
+    {
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            _buckets[i]->statistics.reset();
+        }
     }
 
     CacheSignalEmitterPtr activateSignalEmitter() const
@@ -1462,7 +2470,7 @@ public:
     /** @brief This function can be called to remove a specific entry from the cache. For example a frame
      * that has had its render aborted but already belong to the cache.
      **/
-    void removeEntry(EntryTypePtr entry)
+    void removeEntry(EntryTypePtr entry) const
     {
         ///early return if entry is NULL
         if (!entry) {
@@ -1471,9 +2479,10 @@ public:
         std::list<EntryTypePtr> toRemove;
 
         {
-            QMutexLocker l(&_lock);
-            CacheIterator existingEntry = _memoryCache( entry->getHashKey() );
-            if ( existingEntry != _memoryCache.end() ) {
+            CacheBucket& bucket = getBucket( entry->getHashKey() );
+            CacheBucketLocker l(bucket);
+            CacheIterator existingEntry = bucket.memoryCache( entry->getHashKey() );
+            if ( existingEntry != bucket.memoryCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     if ( (*it)->getKey() == entry->getKey() ) {
@@ -1483,11 +2492,11 @@ public:
                     }
                 }
                 if ( ret.empty() ) {
-                    _memoryCache.erase(existingEntry);
+                    bucket.memoryCache.erase(existingEntry);
                 }
             } else {
-                existingEntry = _diskCache( entry->getHashKey() );
-                if ( existingEntry != _diskCache.end() ) {
+                existingEntry = bucket.diskCache( entry->getHashKey() );
+                if ( existingEntry != bucket.diskCache.end() ) {
                     std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                     for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                         if ( (*it)->getKey() == entry->getKey() ) {
@@ -1497,11 +2506,27 @@ public:
                         }
                     }
                     if ( ret.empty() ) {
-                        _diskCache.erase(existingEntry);
+                        bucket.diskCache.erase(existingEntry);
                     }
                 }
             }
-        } // QMutexLocker l(&_lock);
+            if ( toRemove.empty() ) {
+                existingEntry = bucket.compressedCache( entry->getHashKey() );
+                if ( existingEntry != bucket.compressedCache.end() ) {
+                    std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
+                    for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                        if ( (*it)->getKey() == entry->getKey() ) {
+                            toRemove.push_back(*it);
+                            ret.erase(it);
+                            break;
+                        }
+                    }
+                    if ( ret.empty() ) {
+                        bucket.compressedCache.erase(existingEntry);
+                    }
+                }
+            }
+        } // CacheBucketLocker l(bucket);
         if ( !toRemove.empty() ) {
             _deleterThread.appendToQueue(toRemove);
 
@@ -1515,25 +2540,34 @@ public:
     {
         std::list<EntryTypePtr> toRemove;
         {
-            QMutexLocker l(&_lock);
-            CacheIterator existingEntry = _memoryCache( hash);
-            if ( existingEntry != _memoryCache.end() ) {
+            CacheBucket& bucket = getBucket(hash);
+            CacheBucketLocker l(bucket);
+            CacheIterator existingEntry = bucket.memoryCache(hash);
+            if ( existingEntry != bucket.memoryCache.end() ) {
                 std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                 for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                     toRemove.push_back(*it);
                 }
-                _memoryCache.erase(existingEntry);
+                bucket.memoryCache.erase(existingEntry);
             } else {
-                existingEntry = _diskCache( hash );
-                if ( existingEntry != _diskCache.end() ) {
+                existingEntry = bucket.diskCache(hash);
+                if ( existingEntry != bucket.diskCache.end() ) {
                     std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
                     for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
                         toRemove.push_back(*it);
                     }
-                    _diskCache.erase(existingEntry);
+                    bucket.diskCache.erase(existingEntry);
+                }
+            }
+            existingEntry = bucket.compressedCache(hash);
+            if ( existingEntry != bucket.compressedCache.end() ) {
+                std::list<EntryTypePtr> & ret = getValueFromIterator(existingEntry);
+                for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                    toRemove.push_back(*it);
                 }
+                bucket.compressedCache.erase(existingEntry);
             }
-        } // QMutexLocker l(&_lock);
+        } // CacheBucketLocker l(bucket);
 
         if ( !toRemove.empty() ) {
             _deleterThread.appendToQueue(toRemove);
@@ -1548,10 +2582,31 @@ public:
      */
     void save(CacheTOC* tableOfContents);
 
-
     /*Restores the cache from disk.*/
     void restore(const CacheTOC & tableOfContents);
 
+private:
+
+    /*Conversions between entries, their serialization and the records of the index,
+       implemented in CacheSerialization.h*/
+    static void serializeEntry(const EntryTypePtr& entry, SerializedEntry* serialization);
+
+    static void toIndexEntry(const SerializedEntry& serialization, CacheIndex::Entry* indexEntry);
+
+    static bool fromIndexEntry(const CacheIndex::Entry& indexEntry, SerializedEntry* serialization);
+
+    static bool deserializeEntry(const std::string& data, SerializedEntry* serialization);
+
+    /**
+     * @brief Maps the files of the entries matching the key published by the other processes in the shared index,
+     * and inserts them in the in-memory portion of the bucket. bucket.getLock must be locked, bucket.lock must not.
+     * Implemented in CacheSerialization.h
+     **/
+    bool getSharedEntries(CacheBucket& bucket,
+                          const typename EntryType::key_type & key,
+                          std::list<EntryTypePtr>* returnValue) const;
+
+public:
 
     void removeAllEntriesWithDifferentNodeHashForHolderPublic(const CacheEntryHolder* holder,
                                                               U64 nodeHash)
@@ -1577,29 +2632,46 @@ public:
         *diskOccupied = 0;
 
         std::string holderID = holder->getCacheID();
-        QMutexLocker locker(&_lock);
 
-        for (CacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
-            std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
-            if ( !entries.empty() ) {
-                const EntryTypePtr & front = entries.front();
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            const CacheBucket& bucket = *_buckets[i];
+            CacheBucketLocker locker(bucket);
+
+            for (CacheIterator memIt = bucket.memoryCache.begin(); memIt != bucket.memoryCache.end(); ++memIt) {
+                std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
 
-                if (front->getKey().getCacheHolderID() == holderID) {
-                    for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
-                        *ramOccupied += (*it)->size();
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *ramOccupied += (*it)->size();
+                        }
                     }
                 }
             }
-        }
 
-        for (CacheIterator memIt = _diskCache.begin(); memIt != _diskCache.end(); ++memIt) {
-            std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
-            if ( !entries.empty() ) {
-                const EntryTypePtr & front = entries.front();
+            for (CacheIterator memIt = bucket.compressedCache.begin(); memIt != bucket.compressedCache.end(); ++memIt) {
+                std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
 
-                if (front->getKey().getCacheHolderID() == holderID) {
-                    for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
-                        *diskOccupied += (*it)->size();
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *ramOccupied += (*it)->size();
+                        }
+                    }
+                }
+            }
+
+            for (CacheIterator memIt = bucket.diskCache.begin(); memIt != bucket.diskCache.end(); ++memIt) {
+                std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
+
+                    if (front->getKey().getCacheHolderID() == holderID) {
+                        for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                            *diskOccupied += (*it)->size();
+                        }
                     }
                 }
             }
@@ -1613,11 +2685,13 @@ private:
                                                                        bool removeAll) OVERRIDE FINAL
     {
         std::list<EntryTypePtr> toDelete;
-        CacheContainer newMemCache, newDiskCache;
-        {
-            QMutexLocker locker(&_lock);
 
-            for (CacheIterator memIt = _memoryCache.begin(); memIt != _memoryCache.end(); ++memIt) {
+        for (std::size_t i = 0; i < _buckets.size(); ++i) {
+            CacheBucket& bucket = *_buckets[i];
+            CacheContainer newMemCache, newCompressedCache, newDiskCache;
+            CacheBucketLocker locker(bucket);
+
+            for (CacheIterator memIt = bucket.memoryCache.begin(); memIt != bucket.memoryCache.end(); ++memIt) {
                 std::list<EntryTypePtr> & entries = getValueFromIterator(memIt);
                 if ( !entries.empty() ) {
                     const EntryTypePtr & front = entries.front();
@@ -1634,7 +2708,24 @@ private:
                 }
             }
 
-            for (CacheIterator dIt = _diskCache.begin(); dIt != _diskCache.end(); ++dIt) {
+            for (CacheIterator cIt = bucket.compressedCache.begin(); cIt != bucket.compressedCache.end(); ++cIt) {
+                std::list<EntryTypePtr> & entries = getValueFromIterator(cIt);
+                if ( !entries.empty() ) {
+                    const EntryTypePtr & front = entries.front();
+
+                    if ( (front->getKey().getCacheHolderID() == holderID) &&
+                         ( ( front->getKey().getTreeVersion() != nodeHash) || removeAll ) ) {
+                        for (typename std::list<EntryTypePtr>::iterator it = entries.begin(); it != entries.end(); ++it) {
+                            toDelete.push_back(*it);
+                        }
+                    } else {
+                        typename EntryType::hash_type hash = front->getHashKey();
+                        newCompressedCache.insert(hash, entries);
+                    }
+                }
+            }
+
+            for (CacheIterator dIt = bucket.diskCache.begin(); dIt != bucket.diskCache.end(); ++dIt) {
                 std::list<EntryTypePtr> & entries = getValueFromIterator(dIt);
                 if ( !entries.empty() ) {
                     const EntryTypePtr & front = entries.front();
@@ -1651,9 +2742,18 @@ private:
                 }
             }
 
-            _memoryCache = newMemCache;
-            _diskCache = newDiskCache;
-        } // QMutexLocker locker(&_lock);
+            bucket.memoryCache = newMemCache;
+            bucket.compressedCache = newCompressedCache;
+            bucket.diskCache = newDiskCache;
+        } // for each bucket
+
+        if (removeAll) {
+            // The holder has no entry left, e.g: the node was deleted
+            int holderIndex = CacheStatistics::getHolderIndex(holderID);
+            for (std::size_t i = 0; i < _buckets.size(); ++i) {
+                _buckets[i]->statistics.removeHolder(holderIndex);
+            }
+        }
 
         if ( !toDelete.empty() ) {
             _deleterThread.appendToQueue(toDelete);
@@ -1664,22 +2764,33 @@ private:
         }
     } // removeAllEntriesWithDifferentNodeHashForHolderPrivate
 
-    bool getInternal(const typename EntryType::key_type & key,
-                     std::list<EntryTypePtr>* returnValue) const
+    /**
+     * @param [out] movedBackInMemory Set to true if the entry was living in the disk portion and has been mapped again in RAM,
+     * or was taken back from the compressed entries.
+     * The caller should then decompress the returned entries with decompressEntries() and make sure the in-memory portion
+     * does not exceed its limit, after the bucket lock has been released.
+     **/
+    bool getInternal(CacheBucket& bucket,
+                     const typename EntryType::key_type & key,
+                     std::list<EntryTypePtr>* returnValue,
+                     bool* movedBackInMemory) const
     {
         ///Private should be locked
-        assert( !_lock.tryLock() );
+        assert( !bucket.lock.tryLock() );
+
+        CacheEvictionPolicyPtr evictionPolicy = getEvictionPolicy();
 
         ///find a matching value in the internal memory container
-        CacheIterator memoryCached = _memoryCache( key.getHash() );
+        CacheIterator memoryCached = bucket.memoryCache( key.getHash() );
 
-        if ( memoryCached != _memoryCache.end() ) {
+        if ( memoryCached != bucket.memoryCache.end() ) {
             ///we found something with a matching hash key. There may be several entries linked to
             ///this key, we need to find one with matching params
             std::list<EntryTypePtr> & ret = getValueFromIterator(memoryCached);
             for (typename std::list<EntryTypePtr>::const_iterator it = ret.begin(); it != ret.end(); ++it) {
                 if ( (*it)->getKey() == key ) {
                     returnValue->push_back(*it);
+                    evictionPolicy->onEntryAccessed( it->get() );
 
                     ///Q_EMIT the added signal otherwise when first reading something that's already cached
                     ///the timeline wouldn't update
@@ -1691,10 +2802,39 @@ private:
 
             return returnValue->size() > 0;
         } else {
+            ///fallback on the compressed entries
+            CacheIterator compressedCached = bucket.compressedCache( key.getHash() );
+            if ( compressedCached != bucket.compressedCache.end() ) {
+                std::list<EntryTypePtr> & ret = getValueFromIterator(compressedCached);
+                for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+                    if ( (*it)->getKey() == key ) {
+                        EntryTypePtr entry = *it;
+                        ret.erase(it);
+                        if ( ret.empty() ) {
+                            bucket.compressedCache.erase(compressedCached);
+                        }
+
+                        //put it back into the in-memory portion, it is decompressed by the caller once the bucket lock is released
+                        bucket.memoryCache.insert(entry->getHashKey(), entry);
+
+                        // The in-memory portion may now exceed its limit: the caller will evict entries once the bucket lock is released
+                        *movedBackInMemory = true;
+
+                        returnValue->push_back(entry);
+                        evictionPolicy->onEntryAccessed( entry.get() );
+                        if (_signalEmitter) {
+                            _signalEmitter->emitAddedEntry( key.getTime() );
+                        }
+
+                        return true;
+                    }
+                }
+            }
+
             ///fallback on the disk cache internal container
-            CacheIterator diskCached = _diskCache( key.getHash() );
+            CacheIterator diskCached = bucket.diskCache( key.getHash() );
 
-            if ( diskCached == _diskCache.end() ) {
+            if ( diskCached == bucket.diskCache.end() ) {
                 /*the entry was neither in memory or disk, just allocate a new one*/
                 return false;
             } else {
@@ -1710,9 +2850,13 @@ private:
                         /*If we found 1 entry in the list that has exactly the same key params,
                          we re-open the mapping to the RAM put the entry
                          back into the memoryCache.*/
-                        if (!_isTiled) {
+                        if ( !_isTiled && (*it)->isWriteBehindPending() ) {
+                            // Not written yet: its data are still in RAM, cancel the write
+                            (*it)->setWriteBehindPending(false);
+                        } else if (!_isTiled) {
                             try {
                                 (*it)->reOpenFileMapping();
+                                bucket.statistics.recordDiskRead( key.getCacheHolderIndex(), (*it)->getMipMapLevel(), (*it)->size() );
                             } catch (const std::exception & e) {
                                 qDebug() << "Error while reopening cache file: " << e.what();
                                 ret.erase(it);
@@ -1724,34 +2868,17 @@ private:
 
                                 return false;
                             }
-
+                        }
+                        if (!_isTiled) {
                             //put it back into the RAM
-                            _memoryCache.insert( (*it)->getHashKey(), *it );
+                            bucket.memoryCache.insert( (*it)->getHashKey(), *it );
 
-
-                            U64 memoryCacheSize, maximumInMemorySize;
-                            {
-                                QMutexLocker k(&_sizeLock);
-                                memoryCacheSize = _memoryCacheSize;
-                                maximumInMemorySize = _maximumInMemorySize;
-                            }
-                            std::list<EntryTypePtr> entriesToBeDeleted;
-
-                            //now clear extra entries from the disk cache so it doesn't exceed the RAM limit.
-                            while (memoryCacheSize > maximumInMemorySize) {
-                                if ( !tryEvictInMemoryEntry(entriesToBeDeleted) ) {
-                                    break;
-                                }
-
-                                {
-                                    QMutexLocker k(&_sizeLock);
-                                    memoryCacheSize = _memoryCacheSize;
-                                    maximumInMemorySize = _maximumInMemorySize;
-                                }
-                            }
+                            // The in-memory portion may now exceed its limit: the caller will evict entries once the bucket lock is released
+                            *movedBackInMemory = true;
                         }
                         
                         returnValue->push_back(*it);
+                        evictionPolicy->onEntryAccessed( it->get() );
                         ///Q_EMIT the added signal otherwise when first reading something that's already cached
                         ///the timeline wouldn't update
                         if (_signalEmitter) {
@@ -1763,7 +2890,7 @@ private:
                             ret.erase(it);
 
                             ///Remove it from the disk cache
-                            _diskCache.erase(diskCached);
+                            bucket.diskCache.erase(diskCached);
                         }
 
                         return true;
@@ -1780,25 +2907,28 @@ private:
     /** @brief Inserts into the cache an entry that was previously allocated by the createInternal()
      * function. This is called directly by createInternal() if the allocation was successful
      **/
-    void sealEntry(const EntryTypePtr & entry,
+    void sealEntry(CacheBucket& bucket,
+                   const EntryTypePtr & entry,
                    bool inMemory) const
     {
-        assert( !_lock.tryLock() );   // must be locked
+        assert( !bucket.lock.tryLock() );   // must be locked
         typename EntryType::hash_type hash = entry->getHashKey();
 
+        getEvictionPolicy()->onEntryAccessed( entry.get() );
+
         if (inMemory) {
             /*if the entry doesn't exist on the memory cache,make a new list and insert it*/
-            CacheIterator existingEntry = _memoryCache(hash);
-            if ( existingEntry == _memoryCache.end() ) {
-                _memoryCache.insert(hash, entry);
+            CacheIterator existingEntry = bucket.memoryCache(hash);
+            if ( existingEntry == bucket.memoryCache.end() ) {
+                bucket.memoryCache.insert(hash, entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
             }
         } else {
-            CacheIterator existingEntry = _diskCache(hash);
-            if ( existingEntry == _diskCache.end() ) {
-                _diskCache.insert(hash, entry);
+            CacheIterator existingEntry = bucket.diskCache(hash);
+            if ( existingEntry == bucket.diskCache.end() ) {
+                bucket.diskCache.insert(hash, entry);
             } else {
                 /*append to the existing list*/
                 getValueFromIterator(existingEntry).push_back(entry);
@@ -1806,41 +2936,117 @@ private:
         }
     }
 
-    bool tryEvictInMemoryEntry(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    /**
+     * @brief Evicts the entry of the in-memory portion of the given bucket selected by the eviction policy,
+     * by default the least recently used one.
+     * If compression is enabled, an entry stored in RAM is moved to the compressed entries of the bucket
+     * rather than destroyed. Compressed entries are destroyed first when they exceed their share of the in-memory portion
+     * or when there is nothing else to evict.
+     * @param freedBytes If non NULL, set to the amount of RAM released (or about to be released by the deleter thread)
+     * by the eviction.
+     * @param [out] entryToCompress Set to the entry moved to the compressed entries: the caller must compress it
+     * with compressEvictedEntry() once the bucket lock has been released.
+     **/
+    bool tryEvictInMemoryEntry(CacheBucket& bucket,
+                               std::list<EntryTypePtr> & entriesToBeDeleted,
+                               std::size_t* freedBytes,
+                               EntryTypePtr* entryToCompress) const
     {
-        assert( !_lock.tryLock() );
-        std::pair<hash_type, EntryTypePtr> evicted = _memoryCache.evict();
+        assert( !bucket.lock.tryLock() );
+
+        bool compressionEnabled;
+        std::size_t maximumCompressedSize;
+        CacheEvictionPolicyPtr evictionPolicy;
+        {
+            QMutexLocker k(&_maximumSizeLock);
+            compressionEnabled = _compressionEnabled;
+            maximumCompressedSize = (std::size_t)(_maximumInMemorySize * NATRON_CACHE_COMPRESSED_PORTION_MAX);
+            evictionPolicy = _evictionPolicy;
+        }
+
+        // Entries are spread evenly across buckets by their hash: compare the compressed entries of this bucket
+        // against its share of the compressed portion rather than locking every bucket to sum their sizes.
+        maximumCompressedSize /= _buckets.size();
+        std::size_t bucketCompressedSize;
+        {
+            QMutexLocker k(&bucket.sizeLock);
+            bucketCompressedSize = bucket.compressedCacheSize;
+        }
+        if ( ( !compressionEnabled || (bucketCompressedSize >= maximumCompressedSize) ) &&
+             tryEvictCompressedEntry(bucket, entriesToBeDeleted, freedBytes) ) {
+            return true;
+        }
+
+        std::pair<hash_type, EntryTypePtr> evicted = evictWithPolicy(*evictionPolicy, bucket.memoryCache);
         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
         //we'll let the user of these entries purge the extra entries left in the cache later on
         if (!evicted.second) {
-            return false;
+            return tryEvictCompressedEntry(bucket, entriesToBeDeleted, freedBytes);
+        }
+
+        std::size_t evictedSize = evicted.second->size();
+        if (freedBytes) {
+            *freedBytes = evictedSize;
         }
 
         // If it is stored on disk, remove it from memory
         // If the cache is tiled, the entry is sharing the same file with other entries so we cannot close the file.
         // Just deallocate it
-        if ( !evicted.second->isStoredOnDisk()) {
-            entriesToBeDeleted.push_back(evicted.second);
+        // The file of a shared entry belongs to another process: destroy the entry, its data can be mapped again
+        // from the shared index
+        if ( !evicted.second->isStoredOnDisk() || evicted.second->isSharedFile() ) {
+            if (compressionEnabled) {
+                // Compressing is EXPENSIVE: the caller does it once the bucket lock is released, see compressEvictedEntry().
+                // No RAM is released until then.
+                if (freedBytes) {
+                    *freedBytes = 0;
+                }
+                evicted.second->setCompressionPending();
+                CacheIterator existingCompressedEntry = bucket.compressedCache(evicted.first);
+                if ( existingCompressedEntry == bucket.compressedCache.end() ) {
+                    bucket.compressedCache.insert(evicted.first, evicted.second);
+                } else {
+                    getValueFromIterator(existingCompressedEntry).push_back(evicted.second);
+                }
+                *entryToCompress = evicted.second;
+            } else {
+                entriesToBeDeleted.push_back(evicted.second);
+                recordEviction(bucket, evicted.second, eCacheEvictionReasonDestroyed);
+            }
         } else {
 
             assert( evicted.second.unique() );
 
-            ///This is EXPENSIVE! it calls msync
-            evicted.second->deallocate();
+            if (!_isTiled) {
+                // Only hand off the entry to the write-behind threads, which write its data and release its RAM,
+                // see processWriteBehindEntry(). Meanwhile get() takes it back from the disk portion without reading the disk.
+                // If too much data is already waiting to be written, drop the entry rather than waiting for the disk.
+                evicted.second->setWriteBehindPending(true);
+                if ( !_writeBehindQueue.appendToQueue(evicted.second, evictedSize) ) {
+                    evicted.second->setWriteBehindPending(false);
+                    entriesToBeDeleted.push_back(evicted.second);
+                    recordEviction(bucket, evicted.second, eCacheEvictionReasonWriteBehindFull);
+
+                    return true;
+                }
+            } else {
+                evicted.second->deallocate();
+            }
+            recordEviction(bucket, evicted.second, eCacheEvictionReasonMovedToDisk);
 
             /*insert it back into the disk portion */
 
-            U64 diskCacheSize, maximumCacheSize, maximumInMemorySize;
+            U64 diskCacheSize = getDiskCacheSize();
+            U64 maximumCacheSize, maximumInMemorySize;
             {
-                QMutexLocker k(&_sizeLock);
-                diskCacheSize = _diskCacheSize;
+                QMutexLocker k(&_maximumSizeLock);
                 maximumInMemorySize = _maximumInMemorySize;
                 maximumCacheSize = _maximumCacheSize;
             }
 
             /*before that we need to clear the disk cache if it exceeds the maximum size allowed*/
-            while ( ( diskCacheSize  + evicted.second->size() ) >= (maximumCacheSize - maximumInMemorySize) ) {
-                std::pair<hash_type, EntryTypePtr> evictedFromDisk = _diskCache.evict();
+            while ( ( diskCacheSize  + evictedSize ) >= (maximumCacheSize - maximumInMemorySize) ) {
+                std::pair<hash_type, EntryTypePtr> evictedFromDisk = bucket.diskCache.evict();
                 //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
                 //we'll let the user of these entries purge the extra entries left in the cache later on
                 if (!evictedFromDisk.second) {
@@ -1849,11 +3055,12 @@ private:
 
                 ///Erase the file from the disk if we reach the limit.
                 evictedFromDisk.second->removeAnyBackingFile();
+                recordEviction(bucket, evictedFromDisk.second, eCacheEvictionReasonRemovedFromDisk);
 
                 entriesToBeDeleted.push_back(evictedFromDisk.second);
 
                 {
-                    QMutexLocker k(&_sizeLock);
+                    QMutexLocker k(&_maximumSizeLock);
                     maximumInMemorySize = _maximumInMemorySize;
                     maximumCacheSize = _maximumCacheSize;
                 }
@@ -1861,13 +3068,13 @@ private:
                 //The entry is not yet deleted for real since it's done in a separate thread when this function
                 ///size() will return 0 at this point, we have to recompute it
                 std::size_t fsize = evictedFromDisk.second->getElementsCountFromParams();
-                diskCacheSize -= fsize;
+                diskCacheSize = fsize > diskCacheSize ? 0 : diskCacheSize - fsize;
             }
 
-            CacheIterator existingDiskCacheEntry = _diskCache(evicted.first);
+            CacheIterator existingDiskCacheEntry = bucket.diskCache(evicted.first);
             /*if the entry doesn't exist on the disk cache,make a new list and insert it*/
-            if ( existingDiskCacheEntry == _diskCache.end() ) {
-                _diskCache.insert(evicted.first, evicted.second);
+            if ( existingDiskCacheEntry == bucket.diskCache.end() ) {
+                bucket.diskCache.insert(evicted.first, evicted.second);
             } else {   /*append to the existing list*/
                 getValueFromIterator(existingDiskCacheEntry).push_back(evicted.second);
             }
@@ -1876,21 +3083,275 @@ private:
         return true;
     } // tryEvictEntry
 
-    bool tryEvictDiskEntry(std::list<EntryTypePtr> & entriesToBeDeleted) const
+    /**
+     * @brief Compresses an entry moved to the compressed entries by tryEvictInMemoryEntry(). This must be called without
+     * holding any bucket lock. If the entry cannot be compressed enough, it is destroyed, unless it was taken back by get()
+     * in the meantime.
+     * @param freedBytes If non NULL, set to the amount of RAM released (or about to be released by the deleter thread).
+     **/
+    void compressEvictedEntry(const EntryTypePtr& entry,
+                              std::list<EntryTypePtr>* entriesToBeDeleted,
+                              std::size_t* freedBytes) const
+    {
+        bool packHalfFloat;
+        {
+            QMutexLocker k(&_maximumSizeLock);
+            packHalfFloat = _compressionPackHalfFloat;
+        }
+        CacheBucket& bucket = getBucket( entry->getHashKey() );
+        std::size_t evictedSize = entry->size();
+
+        if ( entry->compress(packHalfFloat) ) {
+            if (freedBytes) {
+                *freedBytes = evictedSize - entry->size();
+            }
+            bucket.statistics.recordEvictions( CacheEvictionRecords( 1, makeEvictionRecord(entry, eCacheEvictionReasonCompressed) ) );
+
+            return;
+        }
+
+        CacheBucketLocker k(bucket);
+        CacheIterator existingCompressedEntry = bucket.compressedCache( entry->getHashKey() );
+        if ( existingCompressedEntry == bucket.compressedCache.end() ) {
+            return;
+        }
+        std::list<EntryTypePtr> & ret = getValueFromIterator(existingCompressedEntry);
+        for (typename std::list<EntryTypePtr>::iterator it = ret.begin(); it != ret.end(); ++it) {
+            if (*it == entry) {
+                ret.erase(it);
+                if ( ret.empty() ) {
+                    bucket.compressedCache.erase(existingCompressedEntry);
+                }
+                if (freedBytes) {
+                    *freedBytes = evictedSize;
+                }
+                entriesToBeDeleted->push_back(entry);
+                recordEviction(bucket, entry, eCacheEvictionReasonDestroyed);
+                break;
+            }
+        }
+    }
+
+    /**
+     * @brief Decompresses the entries handed out by get() or getOrCreate() that were taken back from the compressed entries.
+     * Entries that cannot be decompressed are removed from the cache and from the list.
+     * This must be called without holding any bucket lock.
+     **/
+    void decompressEntries(std::list<EntryTypePtr>* entries) const
+    {
+        typename std::list<EntryTypePtr>::iterator it = entries->begin();
+
+        while ( it != entries->end() ) {
+            try {
+                (*it)->decompress();
+                ++it;
+            } catch (const std::exception & e) {
+                qDebug() << "Error while decompressing cache entry: " << e.what();
+                removeEntry(*it);
+                it = entries->erase(it);
+            }
+        }
+    }
+
+    static CacheEvictionRecord makeEvictionRecord(const EntryTypePtr& entry,
+                                                  CacheEvictionReasonEnum reason)
+    {
+        CacheEvictionRecord ret;
+
+        ret.holderIndex = entry->getKey().getCacheHolderIndex();
+        ret.mipMapLevel = entry->getMipMapLevel();
+        ret.reason = reason;
+
+        return ret;
+    }
+
+    /**
+     * @brief Records an eviction while the bucket is locked by a CacheBucketLocker: it is added to the statistics
+     * once the bucket is unlocked.
+     **/
+    static void recordEviction(CacheBucket& bucket,
+                               const EntryTypePtr& entry,
+                               CacheEvictionReasonEnum reason)
+    {
+        assert( !bucket.lock.tryLock() );
+        bucket.pendingEvictions.push_back( makeEvictionRecord(entry, reason) );
+    }
+
+    static void recordDiskWrite(CacheBucket& bucket,
+                                const EntryTypePtr& entry,
+                                std::size_t bytes)
+    {
+        bucket.statistics.recordDiskWrite(entry->getKey().getCacheHolderIndex(), entry->getMipMapLevel(), bytes);
+    }
+
+    /**
+     * @brief Called by the write-behind threads for each entry handed off by publishSharedEntry(): copies its data to a
+     * file and publishes it in the shared index. The files of this process occupy at most the size of the in-memory
+     * portion: beyond that the oldest published entries are withdrawn.
+     * Implemented in CacheSerialization.h
+     **/
+    void writeSharedEntry(const EntryTypePtr& entry) const;
+
+    /**
+     * @brief Called by the write-behind threads for each entry handed off by tryEvictInMemoryEntry(): writes its data
+     * to disk without holding any lock, then releases its RAM unless it was taken back by get() meanwhile.
+     * @param written Set to true once the data are written, so that an entry examined again is not written again.
+     * @returns False if the entry is still used elsewhere and should be examined again later.
+     **/
+    bool processWriteBehindEntry(const EntryTypePtr& entry,
+                                 bool* written) const
     {
+        CacheBucket& bucket = getBucket( entry->getHashKey() );
+        {
+            CacheBucketLocker locker(bucket);
+            if ( !entry->isWriteBehindPending() ) {
+                return true;
+            }
+            // Referenced by the disk portion and the caller only: nothing may be reading its RAM.
+            // Do not write an entry still in use, it would be written again each time it is examined.
+            if (entry.use_count() > 2) {
+                return false;
+            }
+        }
+
+        // The entry may be taken back concurrently, in which case it is written again when evicted again
+        bool isNew = entry->hasUnwrittenData();
+        bool writeFailed = false;
+        if (!*written) {
+            try {
+                RenderTraceSpan traceSpan(eRenderTraceEventTypeDiskCacheWrite);
+                entry->writeBackingFile();
+                *written = true;
+            } catch (const std::exception & e) {
+                qDebug() << "Error while writing cache entry to disk: " << e.what();
+                writeFailed = true;
+            }
+        }
+
+        {
+            CacheBucketLocker locker(bucket);
+            if ( !entry->isWriteBehindPending() ) {
+                return true;
+            }
+            if (writeFailed) {
+                // Remove it from the disk portion, it is destroyed once released by the caller
+                entry->setWriteBehindPending(false);
+                CacheIterator diskCached = bucket.diskCache( entry->getHashKey() );
+                if ( diskCached != bucket.diskCache.end() ) {
+                    std::list<EntryTypePtr> & entries = getValueFromIterator(diskCached);
+                    entries.remove(entry);
+                    if ( entries.empty() ) {
+                        bucket.diskCache.erase(diskCached);
+                    }
+                }
+                entry->scheduleForDestruction();
+
+                return true;
+            }
+            if (entry.use_count() > 2) {
+                return false;
+            }
+            entry->setWriteBehindPending(false);
+            recordDiskWrite( bucket, entry, entry->size() );
+            entry->deallocate();
+        }
+
+        if (isNew) {
+            addPendingIndexEntry(entry);
+        }
+        notifyMemoryDeallocated();
 
-        assert( !_lock.tryLock() );
-        std::pair<hash_type, EntryTypePtr> evicted = _diskCache.evict();
+        return true;
+    } // processWriteBehindEntry
+
+    /**
+     * @brief Functor passed to the containers to rank the eviction candidates
+     **/
+    struct EvictionScore
+    {
+        const CacheEvictionPolicy* policy;
+
+        EvictionScore(const CacheEvictionPolicy* p)
+            : policy(p)
+        {
+        }
+
+        double operator()(const EntryTypePtr& entry) const
+        {
+            return policy->getEvictionScore( entry.get() );
+        }
+    };
+
+    /**
+     * @brief Evicts from the given container of a bucket the entry selected by the policy.
+     **/
+    std::pair<hash_type, EntryTypePtr> evictWithPolicy(CacheEvictionPolicy& policy,
+                                                       CacheContainer& container) const
+    {
+        std::pair<hash_type, EntryTypePtr> evicted;
+        int nCandidates = policy.getEvictionCandidatesCount();
+
+        if (nCandidates <= 1) {
+            evicted = container.evict();
+        } else {
+            evicted = container.evictLowestScore( nCandidates, EvictionScore(&policy) );
+        }
+        if (evicted.second) {
+            policy.onEntryEvicted( evicted.second.get() );
+        }
+
+        return evicted;
+    }
+
+    /**
+     * @brief Evicts the entry kept compressed in the given bucket selected by the eviction policy.
+     * @param freedBytes If non NULL, set to the amount of RAM about to be released by the deleter thread.
+     **/
+    bool tryEvictCompressedEntry(CacheBucket& bucket,
+                                 std::list<EntryTypePtr> & entriesToBeDeleted,
+                                 std::size_t* freedBytes) const
+    {
+        assert( !bucket.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evicted = evictWithPolicy(*getEvictionPolicy(), bucket.compressedCache);
+        if (!evicted.second) {
+            return false;
+        }
+        if (freedBytes) {
+            *freedBytes = evicted.second->size();
+        }
+        entriesToBeDeleted.push_back(evicted.second);
+        recordEviction(bucket, evicted.second, eCacheEvictionReasonDestroyed);
+
+        return true;
+    }
+
+    /**
+     * @brief Evicts the least recently used entry of the disk portion of the given bucket.
+     * @param freedBytes If non NULL, set to the amount of disk space released by the eviction.
+     **/
+    bool tryEvictDiskEntry(CacheBucket& bucket,
+                           std::list<EntryTypePtr> & entriesToBeDeleted,
+                           std::size_t* freedBytes) const
+    {
+
+        assert( !bucket.lock.tryLock() );
+        std::pair<hash_type, EntryTypePtr> evicted = bucket.diskCache.evict();
         //if the cache couldn't evict that means all entries are used somewhere and we shall not remove them!
         //we'll let the user of these entries purge the extra entries left in the cache later on
         if (!evicted.second) {
             return false;
         }
+        if (freedBytes) {
+            ///size() may return 0 for an entry that is not mapped, recompute it from the params
+            *freedBytes = evicted.second->getElementsCountFromParams();
+        }
         if (!_isTiled) {
             // Erase the file from the disk if we reach the limit.
             evicted.second->removeAnyBackingFile();
         }
         entriesToBeDeleted.push_back(evicted.second);
+        recordEviction(bucket, evicted.second, eCacheEvictionReasonRemovedFromDisk);
+
         return true;
     }
 
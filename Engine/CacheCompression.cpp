@@ -0,0 +1,493 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheCompression.h"
+
+#include <algorithm> // min
+#include <cstring> // memcpy
+
+#include "Global/GlobalDefines.h"
+
+// Number of bits of the hash table used to find matches
+#define LZ_HASH_LOG 16
+
+// Matches shorter than that are not encoded
+#define LZ_MIN_MATCH 4
+
+// Offsets are encoded on 2 bytes
+#define LZ_MAX_OFFSET 65535
+
+NATRON_NAMESPACE_ENTER
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+enum CompressionFlagEnum
+{
+    eCompressionFlagHalfFloat = 0x1 // 32-bit floats were stored as 16-bit floats
+};
+
+struct CompressedHeader
+{
+    U64 nBytes; // size of the original buffer
+    U32 flags; // a combination of CompressionFlagEnum
+    U32 elementSize; // size of the elements that were split in planes
+};
+
+/*
+ * Conversions between 32-bit and 16-bit floats. Only floats that can be represented exactly
+ * as 16-bit floats are ever converted, see packHalfFloats().
+ */
+static U32
+halfToFloatBits(U16 h)
+{
+    U32 sign = (U32)(h >> 15) << 31;
+    int exponent = (h >> 10) & 0x1f;
+    U32 mantissa = h & 0x3ff;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            return sign;
+        }
+        // Denormalized half: normalize it
+        exponent = 1;
+        while ( !(mantissa & 0x400) ) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        mantissa &= 0x3ff;
+
+        return sign | ( (U32)(exponent + 112) << 23 ) | (mantissa << 13);
+    } else if (exponent == 31) {
+        // Infinity or NaN
+        return sign | 0x7f800000 | (mantissa << 13);
+    }
+
+    return sign | ( (U32)(exponent + 112) << 23 ) | (mantissa << 13);
+}
+
+/*
+ * Returns the 16-bit float closest to the given float by truncation. The caller checks whether the conversion
+ * is exact by converting it back.
+ */
+static U16
+floatBitsToHalf(U32 f)
+{
+    U16 sign = (U16)( (f >> 16) & 0x8000 );
+    int exponent = (f >> 23) & 0xff;
+    U32 mantissa = f & 0x7fffff;
+
+    if (exponent == 0xff) {
+        return sign | 0x7c00 | (U16)(mantissa >> 13);
+    }
+    int halfExponent = exponent - 127 + 15;
+    if (halfExponent >= 31) {
+        return sign | 0x7c00;
+    } else if (halfExponent >= 1) {
+        return sign | (U16)(halfExponent << 10) | (U16)(mantissa >> 13);
+    } else if ( (exponent == 0) || (halfExponent < -10) ) {
+        return sign;
+    }
+    // Denormalized half
+    int shift = 126 - exponent;
+
+    return sign | (U16)( (mantissa | 0x800000) >> shift );
+}
+
+/*
+ * Stores nElements 32-bit floats as 16-bit floats, low bytes first then high bytes.
+ * Returns false as soon as a float cannot be represented exactly.
+ */
+static bool
+packHalfFloats(const unsigned char* src,
+               std::size_t nElements,
+               unsigned char* dst)
+{
+    unsigned char* lowBytes = dst;
+    unsigned char* highBytes = dst + nElements;
+
+    for (std::size_t i = 0; i < nElements; ++i) {
+        U32 f;
+        std::memcpy(&f, src + i * 4, 4);
+        U16 h = floatBitsToHalf(f);
+        if (halfToFloatBits(h) != f) {
+            return false;
+        }
+        lowBytes[i] = (unsigned char)(h & 0xff);
+        highBytes[i] = (unsigned char)(h >> 8);
+    }
+
+    return true;
+}
+
+static void
+unpackHalfFloats(const unsigned char* src,
+                 std::size_t nElements,
+                 unsigned char* dst)
+{
+    const unsigned char* lowBytes = src;
+    const unsigned char* highBytes = src + nElements;
+
+    for (std::size_t i = 0; i < nElements; ++i) {
+        U32 f = halfToFloatBits( (U16)(lowBytes[i] | (highBytes[i] << 8)) );
+        std::memcpy(dst + i * 4, &f, 4);
+    }
+}
+
+/*
+ * Splits the bytes of the elements in planes: the first bytes of all elements, then their second bytes, etc...
+ * The bytes that do not make a full element are appended as is.
+ */
+static void
+shuffleBytes(const unsigned char* src,
+             std::size_t nBytes,
+             std::size_t elementSize,
+             unsigned char* dst)
+{
+    std::size_t nElements = nBytes / elementSize;
+
+    for (std::size_t plane = 0; plane < elementSize; ++plane) {
+        unsigned char* dstPlane = dst + plane * nElements;
+        const unsigned char* srcPix = src + plane;
+        for (std::size_t i = 0; i < nElements; ++i, srcPix += elementSize) {
+            dstPlane[i] = *srcPix;
+        }
+    }
+    std::size_t remainder = nBytes - nElements * elementSize;
+    if (remainder) {
+        std::memcpy(dst + nElements * elementSize, src + nElements * elementSize, remainder);
+    }
+}
+
+static void
+unshuffleBytes(const unsigned char* src,
+               std::size_t nBytes,
+               std::size_t elementSize,
+               unsigned char* dst)
+{
+    std::size_t nElements = nBytes / elementSize;
+
+    for (std::size_t plane = 0; plane < elementSize; ++plane) {
+        const unsigned char* srcPlane = src + plane * nElements;
+        unsigned char* dstPix = dst + plane;
+        for (std::size_t i = 0; i < nElements; ++i, dstPix += elementSize) {
+            *dstPix = srcPlane[i];
+        }
+    }
+    std::size_t remainder = nBytes - nElements * elementSize;
+    if (remainder) {
+        std::memcpy(dst + nElements * elementSize, src + nElements * elementSize, remainder);
+    }
+}
+
+/*
+ * The LZ77 codec. The compressed stream is a list of sequences, each made of:
+ * - a token byte: the high 4 bits are the number of literals, the low 4 bits the length of the match minus LZ_MIN_MATCH.
+ * A value of 15 means that the length continues on the following bytes, each adding up to 255.
+ * - the literals, copied as is
+ * - the offset of the match, on 2 bytes (little endian), then the rest of the length of the match if any.
+ * The last sequence only has literals.
+ */
+static inline U32
+read32(const unsigned char* p)
+{
+    U32 v;
+
+    std::memcpy(&v, p, 4);
+
+    return v;
+}
+
+static inline U32
+hashSequence(U32 sequence)
+{
+    return (sequence * 2654435761U) >> (32 - LZ_HASH_LOG);
+}
+
+static inline unsigned char*
+writeLength(unsigned char* op,
+            std::size_t length)
+{
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char)length;
+
+    return op;
+}
+
+static inline bool
+readLength(const unsigned char** ip,
+           const unsigned char* iend,
+           std::size_t* length)
+{
+    for (;;) {
+        if (*ip == iend) {
+            return false;
+        }
+        unsigned char b = *(*ip)++;
+        *length += b;
+        if (b != 255) {
+            return true;
+        }
+    }
+}
+
+/*
+ * Writes a sequence. A matchLength of 0 writes the last sequence, made of literals only.
+ * Returns NULL if there is not enough room left in the output.
+ */
+static unsigned char*
+writeSequence(unsigned char* op,
+              unsigned char* oend,
+              const unsigned char* literals,
+              std::size_t literalsLength,
+              std::size_t offset,
+              std::size_t matchLength)
+{
+    std::size_t maxNeeded = 1 + literalsLength + literalsLength / 255 + 1 + 2 + matchLength / 255 + 1;
+
+    if ( (std::size_t)(oend - op) < maxNeeded ) {
+        return 0;
+    }
+    unsigned char* token = op++;
+    unsigned char tokenValue = (unsigned char)(std::min(literalsLength, (std::size_t)15) << 4);
+    if (literalsLength >= 15) {
+        op = writeLength(op, literalsLength - 15);
+    }
+    std::memcpy(op, literals, literalsLength);
+    op += literalsLength;
+
+    if (matchLength > 0) {
+        std::size_t length = matchLength - LZ_MIN_MATCH;
+        tokenValue |= (unsigned char)std::min(length, (std::size_t)15);
+        *op++ = (unsigned char)(offset & 0xff);
+        *op++ = (unsigned char)(offset >> 8);
+        if (length >= 15) {
+            op = writeLength(op, length - 15);
+        }
+    }
+    *token = tokenValue;
+
+    return op;
+}
+
+/*
+ * Returns the size of the compressed data, or 0 if it does not fit in dstCapacity.
+ */
+static std::size_t
+lzCompress(const unsigned char* src,
+           std::size_t nBytes,
+           unsigned char* dst,
+           std::size_t dstCapacity)
+{
+    unsigned char* op = dst;
+    unsigned char* const oend = dst + dstCapacity;
+
+    // Position + 1 of the last occurrence of each hashed sequence, 0 if none
+    std::vector<U32> table(1 << LZ_HASH_LOG, 0);
+    std::size_t anchor = 0;
+    std::size_t ip = 0;
+
+    if (nBytes >= LZ_MIN_MATCH) {
+        const std::size_t limit = nBytes - LZ_MIN_MATCH;
+        while (ip <= limit) {
+            U32 sequence = read32(src + ip);
+            U32 h = hashSequence(sequence);
+            std::size_t ref = table[h];
+            table[h] = (U32)(ip + 1);
+
+            if ( (ref != 0) && (ip - (ref - 1) <= LZ_MAX_OFFSET) && (read32(src + ref - 1) == sequence) ) {
+                std::size_t matchPos = ref - 1;
+                std::size_t matchLength = LZ_MIN_MATCH;
+                while ( (ip + matchLength + 4 <= nBytes) && (read32(src + matchPos + matchLength) == read32(src + ip + matchLength)) ) {
+                    matchLength += 4;
+                }
+                while ( (ip + matchLength < nBytes) && (src[matchPos + matchLength] == src[ip + matchLength]) ) {
+                    ++matchLength;
+                }
+                op = writeSequence(op, oend, src + anchor, ip - anchor, ip - matchPos, matchLength);
+                if (!op) {
+                    return 0;
+                }
+                ip += matchLength;
+                anchor = ip;
+            } else {
+                // Skip faster through data that does not compress
+                ip += 1 + ( (ip - anchor) >> 6 );
+            }
+        }
+    }
+    op = writeSequence(op, oend, src + anchor, nBytes - anchor, 0, 0);
+    if (!op) {
+        return 0;
+    }
+
+    return op - dst;
+} // lzCompress
+
+static bool
+lzDecompress(const unsigned char* src,
+             std::size_t srcSize,
+             unsigned char* dst,
+             std::size_t nBytes)
+{
+    const unsigned char* ip = src;
+    const unsigned char* const iend = src + srcSize;
+    unsigned char* op = dst;
+    unsigned char* const oend = dst + nBytes;
+
+    while (ip < iend) {
+        unsigned char token = *ip++;
+        std::size_t literalsLength = token >> 4;
+        if ( (literalsLength == 15) && !readLength(&ip, iend, &literalsLength) ) {
+            return false;
+        }
+        if ( ( (std::size_t)(iend - ip) < literalsLength ) || ( (std::size_t)(oend - op) < literalsLength ) ) {
+            return false;
+        }
+        std::memcpy(op, ip, literalsLength);
+        op += literalsLength;
+        ip += literalsLength;
+        if (ip == iend) {
+            // Last sequence
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return false;
+        }
+        std::size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        std::size_t matchLength = token & 0xf;
+        if ( (matchLength == 15) && !readLength(&ip, iend, &matchLength) ) {
+            return false;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if ( (offset == 0) || ( offset > (std::size_t)(op - dst) ) || ( (std::size_t)(oend - op) < matchLength ) ) {
+            return false;
+        }
+        const unsigned char* match = op - offset;
+        if (offset >= matchLength) {
+            std::memcpy(op, match, matchLength);
+            op += matchLength;
+        } else {
+            // The match overlaps the output, e.g: a repeated pattern
+            for (std::size_t i = 0; i < matchLength; ++i) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op == oend;
+} // lzDecompress
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+namespace CacheCompression
+{
+bool
+compress(const void* data,
+         std::size_t nBytes,
+         std::size_t elementSize,
+         bool packHalfFloat,
+         std::vector<unsigned char>* compressed)
+{
+    compressed->clear();
+
+    // Positions in the buffer are stored on 32 bits by the LZ codec
+    if ( (nBytes == 0) || (elementSize == 0) || (nBytes >= 0xFFFFFFFF) ) {
+        return false;
+    }
+    const unsigned char* src = (const unsigned char*)data;
+    CompressedHeader header;
+    header.nBytes = nBytes;
+    header.flags = 0;
+    header.elementSize = (U32)elementSize;
+
+    std::vector<unsigned char> planes;
+    if ( packHalfFloat && (elementSize == 4) && (nBytes % 4 == 0) ) {
+        planes.resize(nBytes / 2);
+        if ( packHalfFloats(src, nBytes / 4, &planes[0]) ) {
+            header.flags |= eCompressionFlagHalfFloat;
+        } else {
+            planes.clear();
+        }
+    }
+    if ( planes.empty() ) {
+        planes.resize(nBytes);
+        shuffleBytes(src, nBytes, elementSize, &planes[0]);
+    }
+
+    std::size_t maxCompressedSize = (std::size_t)(nBytes * NATRON_CACHE_COMPRESSION_MAX_RATIO);
+    if ( maxCompressedSize <= sizeof(CompressedHeader) ) {
+        return false;
+    }
+    std::vector<unsigned char> buffer(maxCompressedSize);
+    std::size_t compressedSize = lzCompress(&planes[0], planes.size(), &buffer[sizeof(CompressedHeader)], maxCompressedSize - sizeof(CompressedHeader));
+    if (compressedSize == 0) {
+        return false;
+    }
+    std::memcpy( &buffer[0], &header, sizeof(CompressedHeader) );
+
+    // Only keep the used part of the buffer
+    compressed->assign( buffer.begin(), buffer.begin() + sizeof(CompressedHeader) + compressedSize );
+
+    return true;
+} // compress
+
+bool
+decompress(const std::vector<unsigned char>& compressed,
+           void* data,
+           std::size_t nBytes)
+{
+    if ( (nBytes == 0) || ( compressed.size() <= sizeof(CompressedHeader) ) ) {
+        return false;
+    }
+    CompressedHeader header;
+    std::memcpy( &header, &compressed[0], sizeof(CompressedHeader) );
+    if ( (header.nBytes != nBytes) || (header.elementSize == 0) ) {
+        return false;
+    }
+    bool halfFloat = (header.flags & eCompressionFlagHalfFloat) != 0;
+    if ( halfFloat && ( (header.elementSize != 4) || (nBytes % 4 != 0) ) ) {
+        return false;
+    }
+
+    std::vector<unsigned char> planes(halfFloat ? nBytes / 2 : nBytes);
+    if ( !lzDecompress(&compressed[sizeof(CompressedHeader)], compressed.size() - sizeof(CompressedHeader), &planes[0], planes.size()) ) {
+        return false;
+    }
+    if (halfFloat) {
+        unpackHalfFloats(&planes[0], nBytes / 4, (unsigned char*)data);
+    } else {
+        unshuffleBytes(&planes[0], nBytes, header.elementSize, (unsigned char*)data);
+    }
+
+    return true;
+} // decompress
+} // namespace CacheCompression
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,74 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_CACHECOMPRESSION_H
+#define NATRON_ENGINE_CACHECOMPRESSION_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+#include <vector>
+
+#include "Engine/EngineFwd.h"
+
+///A compressed buffer must be at most that fraction of the original buffer, otherwise it is not worth keeping it compressed
+#define NATRON_CACHE_COMPRESSION_MAX_RATIO 0.8
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Lossless compression of the buffers of the cache entries kept compressed in RAM.
+ * The bytes of the elements are first split in planes (all first bytes, then all second bytes, ...) which makes
+ * image data much more compressible, then compressed with a fast LZ77 codec.
+ **/
+namespace CacheCompression
+{
+/**
+ * @brief Compresses nBytes of data made of elements of elementSize bytes into compressed.
+ * @param packHalfFloat If true and elements are 32-bit floats that can all be represented exactly as 16-bit floats,
+ * they are stored as 16-bit floats before compression.
+ * @returns False if the data could not be compressed below NATRON_CACHE_COMPRESSION_MAX_RATIO of its size,
+ * in which case compressed is left empty.
+ * This function might throw a std::bad_alloc.
+ **/
+bool compress(const void* data,
+              std::size_t nBytes,
+              std::size_t elementSize,
+              bool packHalfFloat,
+              std::vector<unsigned char>* compressed);
+
+/**
+ * @brief Decompresses a buffer compressed with compress() into data, which must be exactly as large as the
+ * original buffer.
+ * @returns False if the compressed buffer is corrupted or does not match nBytes.
+ **/
+bool decompress(const std::vector<unsigned char>& compressed,
+                void* data,
+                std::size_t nBytes);
+}
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CACHECOMPRESSION_H
@@ -62,6 +62,8 @@
 #endif
 
 #include "Engine/Hash64.h"
+#include "Engine/BufferPool.h"
+#include "Engine/CacheCompression.h"
 #include "Engine/CacheEntryHolder.h"
 #include "Engine/MemoryFile.h"
 #include "Engine/NonKeyParams.h"
@@ -115,33 +117,34 @@ public:
         if (size == 0) {
             return;
         }
-        count = size;
-        if (data) {
-            free(data);
-            data = 0;
-        }
-        if (count == 0) {
+        if ( data && ( BufferPool::getAllocationSize(count * sizeof(T)) == BufferPool::getAllocationSize(size * sizeof(T)) ) ) {
+            // The buffer already has the right size
+            count = size;
+
             return;
         }
-        data = (T*)malloc( size * sizeof(T) );
-        if (!data) {
-            throw std::bad_alloc();
+        if (data) {
+            BufferPool::deallocate( data, count * sizeof(T) );
+            data = 0;
         }
+        count = 0;
+        data = (T*)BufferPool::allocate( size * sizeof(T) );
+        count = size;
     }
 
     void clear()
     {
-        count = 0;
         if (data) {
-            free(data);
+            BufferPool::deallocate( data, count * sizeof(T) );
             data = 0;
         }
+        count = 0;
     }
 
     ~RamBuffer()
     {
         if (data) {
-            free(data);
+            BufferPool::deallocate( data, count * sizeof(T) );
             data = 0;
         }
     }
@@ -185,18 +188,20 @@ public:
     /**
      * @brief To be called by a CacheEntry whenever it's size is changed.
      * This way the cache can keep track of the real memory footprint.
+     * For all notifications below, the hash of the entry identifies the bucket of the cache
+     * accounting for its size.
      **/
-    virtual void notifyEntrySizeChanged(size_t oldSize, size_t newSize) const = 0;
+    virtual void notifyEntrySizeChanged(U64 hash, size_t oldSize, size_t newSize) const = 0;
 
     /**
      * @brief To be called by a CacheEntry on allocation.
      **/
-    virtual void notifyEntryAllocated(double time, size_t size, StorageModeEnum storage) const = 0;
+    virtual void notifyEntryAllocated(U64 hash, double time, size_t size, StorageModeEnum storage) const = 0;
 
     /**
      * @brief To be called by a CacheEntry on destruction.
      **/
-    virtual void notifyEntryDestroyed(double time, size_t size, StorageModeEnum storage) const = 0;
+    virtual void notifyEntryDestroyed(U64 hash, double time, size_t size, StorageModeEnum storage) const = 0;
 
     /**
      * @brief Called by the Cache deleter thread to wake up sleeping threads that were attempting to create a new image
@@ -212,9 +217,21 @@ public:
      * @brief To be called whenever an entry is deallocated from memory and put back on disk or whenever
      * it is reallocated in the RAM.
      **/
-    virtual void notifyEntryStorageChanged(StorageModeEnum oldStorage, StorageModeEnum newStorage,
+    virtual void notifyEntryStorageChanged(U64 hash, StorageModeEnum oldStorage, StorageModeEnum newStorage,
                                            double time, size_t size) const = 0;
 
+    /**
+     * @brief To be called when the data of an entry stored on disk are removed from the disk, so that they are no
+     * longer referenced by the index of the disk portion of the cache.
+     **/
+    virtual void notifyEntryDataRemovedFromDisk(U64 hash, const std::string& filePath, std::size_t dataOffset) const = 0;
+
+    /**
+     * @brief To be called by a CacheEntry whenever its buffer is compressed in RAM, decompressed or released while compressed,
+     * so that the cache can keep track of the size of its compressed entries.
+     **/
+    virtual void notifyEntryCompressedSizeChanged(U64 hash, std::size_t oldCompressedSize, std::size_t newCompressedSize) const = 0;
+
     /**
      * @brief Remove from the cache all entries that matches the holderID and have a different nodeHash than the given one.
      * @param removeAll If true, remove even entries that match the nodeHash
@@ -238,8 +255,20 @@ public:
 
     /**
      * @brief Free a tile from the cache that was previously allocated with allocTile. It will be made available again for other entries.
+     * @param hash The hash of the entry that used the tile
      **/
-    virtual void freeTile(const TileCacheFilePtr& file, std::size_t dataOffset) = 0;
+    virtual void freeTile(U64 hash, const TileCacheFilePtr& file, std::size_t dataOffset) = 0;
+
+    /**
+     * @brief Reserves the path of the file of an entry stored on disk whose data are not written yet, so that no other
+     * entry picks the same file. Returns false if the path is already reserved.
+     **/
+    virtual bool reserveEntryFilePath(const std::string& filePath) const = 0;
+
+    /**
+     * @brief Releases a path reserved by reserveEntryFilePath().
+     **/
+    virtual void releaseEntryFilePath(const std::string& filePath) const = 0;
 
 #ifdef DEBUG
     static bool checkFileNameMatchesHash(const std::string &originalFileName,
@@ -318,6 +347,10 @@ class AbstractCacheEntryBase : boost::noncopyable
 public:
 
     AbstractCacheEntryBase()
+        : _evictionInfoMutex()
+        , _computationCost(0.)
+        , _accessCount(0)
+        , _evictionClock(0.)
     {
 
     }
@@ -327,6 +360,48 @@ public:
 
     }
 
+    /**
+     * @brief Adds to the time, in seconds, that was spent computing the content of this entry, e.g: rendering the
+     * portion of an image. This is used by the cost-aware eviction policy to keep expensive entries longer in the cache.
+     * This function is MT-safe.
+     **/
+    void addComputationCost(double seconds)
+    {
+        QMutexLocker k(&_evictionInfoMutex);
+
+        _computationCost += seconds;
+    }
+
+    double getComputationCost() const
+    {
+        QMutexLocker k(&_evictionInfoMutex);
+
+        return _computationCost;
+    }
+
+    /**
+     * @brief Called by the cache eviction policy whenever the entry is inserted in the cache or returned by the cache.
+     * @param evictionClock The clock of the eviction policy at the time of the access.
+     **/
+    void notifyAccessedByCache(double evictionClock)
+    {
+        QMutexLocker k(&_evictionInfoMutex);
+
+        ++_accessCount;
+        _evictionClock = evictionClock;
+    }
+
+    void getEvictionInfo(double* computationCost,
+                         U64* accessCount,
+                         double* evictionClock) const
+    {
+        QMutexLocker k(&_evictionInfoMutex);
+
+        *computationCost = _computationCost;
+        *accessCount = _accessCount;
+        *evictionClock = _evictionClock;
+    }
+
     virtual TileCacheFilePtr allocTile(std::size_t *dataOffset) = 0;
     virtual void freeTile(const TileCacheFilePtr& file, std::size_t dataOffset) = 0;
     virtual TileCacheFilePtr getTileCacheFile(const std::string& filepath, std::size_t dataOffset) = 0;
@@ -336,7 +411,20 @@ public:
     virtual double getTime() const = 0;
     virtual U64 getElementsCountFromParams() const = 0;
 
+    /**
+     * @brief Returns the mip-map level of the data of the entry, used to break down the cache statistics.
+     **/
+    virtual unsigned int getMipMapLevel() const = 0;
+
     virtual void syncBackingFile() const = 0;
+
+private:
+
+    // Protects _computationCost, _accessCount & _evictionClock
+    mutable QMutex _evictionInfoMutex;
+    double _computationCost;
+    U64 _accessCount;
+    double _evictionClock;
 };
 
 
@@ -393,7 +481,10 @@ public:
         , _entry(0)
         , _cacheFile()
         , _cacheFileDataOffset(0)
+        , _compressedBuffer()
+        , _compressedElementsCount(0)
         , _storageMode(eStorageModeRAM)
+        , _isSharedFile(false)
     {
     }
 
@@ -414,8 +505,13 @@ public:
         _buffer->resize(count);
     }
 
-    void allocateMMAP(U64 count,
-                      const std::string& path)
+    /**
+     * @brief Allocates in RAM the buffer of an entry stored on disk. The data are only written to the file at the given path
+     * by writeToBackingFile(), once the entry is evicted from the in-memory portion of the cache, so that the threads
+     * producing the data never wait for the disk.
+     **/
+    void allocateRAMForDisk(U64 count,
+                            const std::string& path)
     {
         assert( _path.empty() );
         if (_backingFile) {
@@ -423,26 +519,74 @@ public:
         }
         _storageMode = eStorageModeDisk;
         _path = path;
-        try {
-            _backingFile.reset( new MemoryFile(_path, MemoryFile::eFileOpenModeEnumIfExistsKeepElseCreate) );
-        } catch (const std::runtime_error & r) {
-            qDebug() << r.what();
-            // if opening the file mapping failed, just call allocate again, but this time on RAM!
-            _backingFile.reset();
-            _path.clear();
-            allocateRAM(count);
+        if (!_buffer) {
+            _buffer.reset( new RamBuffer<DataType>() );
+        }
+        _buffer->resize(count);
+    }
+
+    /**
+     * @brief Returns true if the buffer is stored on disk but its data are only held in RAM, see allocateRAMForDisk().
+     **/
+    bool hasUnwrittenData() const
+    {
+        return _storageMode == eStorageModeDisk && !_backingFile && !_cacheFile && _buffer && _buffer->size() > 0;
+    }
+
+    /**
+     * @brief Writes the data held in RAM to the backing file, or schedules the write of the mapped file if it is opened.
+     * The buffer is left untouched: deallocate() releases it.
+     * This function throws a std::runtime_error upon failure.
+     **/
+    void writeToBackingFile() const
+    {
+        if (_backingFile) {
+            if ( !_backingFile->flush(MemoryFile::eFlushTypeAsync, 0, 0) ) {
+                throw std::runtime_error("Failed to flush RAM data to backing file.");
+            }
 
             return;
         }
+        if ( !hasUnwrittenData() ) {
+            return;
+        }
+        writeToFile(_path);
+    }
 
-        assert(_backingFile);
-
-        if ( !path.empty() && (count != 0) ) {
-            //if the backing file has already the good size and we just wanted to re-open the mapping
-            _backingFile->resize(count);
+    /**
+     * @brief Writes the data held in RAM to the file at the given path, replacing it.
+     * This function throws a std::runtime_error upon failure.
+     **/
+    void writeToFile(const std::string& path) const
+    {
+        if ( !_buffer || (_buffer->size() == 0) || !_compressedBuffer.empty() ) {
+            throw std::runtime_error("No data to write to " + path);
+        }
+        std::size_t nBytes = _buffer->size() * sizeof(DataType);
+        MemoryFile file(path, nBytes, MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate);
+        if ( !file.data() ) {
+            throw std::runtime_error("Failed to map backing file " + path);
+        }
+        std::memcpy(file.data(), _buffer->getData(), nBytes);
+        if ( !file.flush(MemoryFile::eFlushTypeAsync, 0, 0) ) {
+            throw std::runtime_error("Failed to flush RAM data to backing file.");
         }
     }
 
+    /**
+     * @brief Marks the backing file as owned by another process, see Cache::openSharedIndex(): it is mapped but never
+     * removed.
+     **/
+    void setSharedFile()
+    {
+        _isSharedFile = true;
+    }
+
+    bool isSharedFile() const
+    {
+        return _isSharedFile;
+    }
+
     void allocateGLTexture(const RectI& rectangle,
                            U32 target)
     {
@@ -524,9 +668,13 @@ public:
             }
         } else if (_storageMode == eStorageModeDisk) {
             if (other._storageMode == eStorageModeDisk) {
-                assert(_backingFile);
+                // Either buffer may be mapped or not yet written, see allocateRAMForDisk()
                 _backingFile.swap(other._backingFile);
+                _buffer.swap(other._buffer);
                 _path = other._path;
+            } else if ( hasUnwrittenData() ) {
+                _buffer->resize( other._buffer->size() );
+                std::memcpy( _buffer->getData(), other._buffer->getData(), other._buffer->size() * sizeof(DataType) );
             } else {
                 _backingFile->resize( other._buffer->size() * sizeof(DataType) );
                 assert( _backingFile->data() );
@@ -551,7 +699,9 @@ public:
     {
         assert(!_backingFile && _storageMode == eStorageModeDisk);
         try{
-            _backingFile.reset( new MemoryFile(_path, MemoryFile::eFileOpenModeEnumIfExistsKeepElseCreate) );
+            // The file of another process may have been withdrawn: never create it, nor write to it
+            _backingFile.reset( new MemoryFile(_path, _isSharedFile ? MemoryFile::eFileOpenModeEnumIfExistsReadOnlyElseFail :
+                                               MemoryFile::eFileOpenModeEnumIfExistsKeepElseCreate) );
         } catch (const std::exception & e) {
             _backingFile.reset();
             throw std::bad_alloc();
@@ -572,12 +722,57 @@ public:
         _storageMode = eStorageModeDisk;
     }
 
+    /**
+     * @brief Compresses the buffer stored in RAM and releases it: the data are not accessible until decompress() is called.
+     * @param elementSize The size in bytes of the elements of the buffer, e.g: 4 for 32-bit floating point images
+     * @returns False if the buffer is not stored in RAM or could not be compressed enough, in which case it is left untouched.
+     **/
+    bool compress(std::size_t elementSize,
+                  bool packHalfFloat)
+    {
+        if ( (_storageMode != eStorageModeRAM) || !_buffer || (_buffer->size() == 0) || !_compressedBuffer.empty() ) {
+            return false;
+        }
+        if ( !CacheCompression::compress(_buffer->getData(), _buffer->size() * sizeof(DataType), elementSize, packHalfFloat, &_compressedBuffer) ) {
+            return false;
+        }
+        _compressedElementsCount = _buffer->size();
+        _buffer->clear();
+
+        return true;
+    }
+
+    /**
+     * @brief Restores the buffer compressed by compress(). Upon failure the buffer is left compressed.
+     * This function throws a std::bad_alloc if the allocation fails or a std::runtime_error if the compressed data are corrupted.
+     **/
+    void decompress()
+    {
+        if ( _compressedBuffer.empty() ) {
+            return;
+        }
+        allocateRAM(_compressedElementsCount);
+        if ( !CacheCompression::decompress( _compressedBuffer, _buffer->getData(), _compressedElementsCount * sizeof(DataType) ) ) {
+            _buffer->clear();
+            throw std::runtime_error("Corrupted compressed cache entry");
+        }
+        std::vector<unsigned char>().swap(_compressedBuffer);
+        _compressedElementsCount = 0;
+    }
+
+    bool isCompressed() const
+    {
+        return !_compressedBuffer.empty();
+    }
+
     void deallocate()
     {
         if (_storageMode == eStorageModeRAM) {
             if (_buffer) {
                 _buffer->clear();
             }
+            std::vector<unsigned char>().swap(_compressedBuffer);
+            _compressedElementsCount = 0;
         } else if (_storageMode == eStorageModeDisk) {
             if (_backingFile) {
                 bool flushOk = _backingFile->flush(MemoryFile::eFlushTypeAsync, 0, 0);
@@ -589,6 +784,9 @@ public:
                 assert(_entry);
                 _entry->freeTile(_cacheFile, _cacheFileDataOffset);
                 _cacheFile.reset();
+            } else if (_buffer) {
+                // Data not written by writeToBackingFile() are lost
+                _buffer->clear();
             }
         } else if (_storageMode == eStorageModeGLTex) {
             if (_glTexture) {
@@ -609,16 +807,27 @@ public:
     bool removeAnyBackingFile() const
     {
         if (_storageMode == eStorageModeDisk && !_cacheFile) {
-            if (_backingFile) {
+            if (_isSharedFile) {
+                // The other process removes the file, only close the mapping
+                bool wasMapped = (bool)_backingFile;
+                _backingFile.reset();
+
+                return wasMapped;
+            } else if (_backingFile) {
                 _backingFile->remove();
                 _backingFile.reset();
 
                 return true;
             } else {
+                // Data not written yet are accounted as an opened file, see allocateRAMForDisk()
+                bool hadUnwrittenData = hasUnwrittenData();
+                if (_buffer) {
+                    _buffer->clear();
+                }
                 int ret_code = std::remove( _path.c_str() );
                 Q_UNUSED(ret_code);
 
-                return false;
+                return hadUnwrittenData;
             }
         }
 
@@ -631,6 +840,10 @@ public:
     size_t size() const
     {
         if (_storageMode == eStorageModeRAM) {
+            if ( !_compressedBuffer.empty() ) {
+                return _compressedBuffer.size();
+            }
+
             return _buffer ? _buffer->size() * sizeof(DataType) : 0;
         } else if (_storageMode == eStorageModeDisk) {
             if (_backingFile) {
@@ -639,7 +852,7 @@ public:
                 assert(_entry);
                 return _entry->getCacheTileSizeBytes();
             } else {
-                return 0;
+                return _buffer ? _buffer->size() * sizeof(DataType) : 0;
             }
         } else if (_storageMode == eStorageModeGLTex) {
             return _glTexture ? _glTexture->getSize() : 0;
@@ -650,7 +863,7 @@ public:
 
     bool isAllocated() const
     {
-        return (_buffer && _buffer->size() > 0) || ( _backingFile && _backingFile->data() ) || _cacheFile || _glTexture;
+        return (_buffer && _buffer->size() > 0) || !_compressedBuffer.empty() || ( _backingFile && _backingFile->data() ) || _cacheFile || _glTexture;
     }
 
     DataType* writable()
@@ -661,7 +874,7 @@ public:
             } else if (_cacheFile) {
                 return (DataType*)(_cacheFile->file->data() + _cacheFileDataOffset);
             } else {
-                return NULL;
+                return _buffer ? _buffer->getData() : NULL;
             }
         } else if (_storageMode == eStorageModeRAM) {
             return _buffer ? _buffer->getData() : NULL;
@@ -679,7 +892,7 @@ public:
             } else if (_cacheFile) {
                 return (const DataType*)(_cacheFile->file->data() + _cacheFileDataOffset);
             } else {
-                return 0;
+                return _buffer ? _buffer->getData() : NULL;
             }
         } else if (_storageMode == eStorageModeRAM) {
             return _buffer ? _buffer->getData() : NULL;
@@ -733,9 +946,16 @@ private:
     TileCacheFilePtr _cacheFile;
     std::size_t _cacheFileDataOffset;
 
+    // Set when the RAM buffer is compressed, see compress()
+    std::vector<unsigned char> _compressedBuffer;
+    U64 _compressedElementsCount;
+
     // Used when we store images as OpenGL textures
     boost::scoped_ptr<Texture> _glTexture;
     StorageModeEnum _storageMode;
+
+    // True if the backing file belongs to another process, see setSharedFile()
+    bool _isSharedFile;
 };
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -771,6 +991,10 @@ public:
         , _cache()
         , _entryLock(QReadWriteLock::Recursive)
         , _removeBackingFileBeforeDestruction(false)
+        , _reservedFilePath()
+        , _writeBehindPending(false)
+        , _compressionPending(false)
+        , _sharedPublished(false)
     {
     }
 
@@ -789,6 +1013,10 @@ public:
         , _cache(cache)
         , _entryLock(QReadWriteLock::Recursive)
         , _removeBackingFileBeforeDestruction(false)
+        , _reservedFilePath()
+        , _writeBehindPending(false)
+        , _compressionPending(false)
+        , _sharedPublished(false)
     {
     }
 
@@ -798,6 +1026,9 @@ public:
             removeAnyBackingFile();
         }
         deallocate();
+        if ( _cache && !_reservedFilePath.empty() ) {
+            _cache->releaseEntryFilePath(_reservedFilePath);
+        }
     }
 
     const CacheAPI* getCacheAPI() const
@@ -850,7 +1081,7 @@ public:
         }
 
         if (_cache) {
-            _cache->notifyEntryAllocated( getTime(), size(), storageInfo.mode );
+            _cache->notifyEntryAllocated( getHashKey(), getTime(), size(), storageInfo.mode );
         }
     }
 
@@ -875,9 +1106,9 @@ public:
 
         if (_cache) {
             if (_cache->isTileCache()) {
-                _cache->notifyEntryAllocated(getTime(), size, eStorageModeDisk);
+                _cache->notifyEntryAllocated(getHashKey(), getTime(), size, eStorageModeDisk);
             } else {
-                _cache->notifyEntryStorageChanged(eStorageModeNone, eStorageModeDisk, getTime(), size);
+                _cache->notifyEntryStorageChanged(getHashKey(), eStorageModeNone, eStorageModeDisk, getTime(), size);
             }
         }
     }
@@ -952,8 +1183,92 @@ public:
             _data.reOpenFileMapping();
         }
         if (_cache) {
-            _cache->notifyEntryStorageChanged( eStorageModeDisk, eStorageModeRAM, getTime(), size() );
+            _cache->notifyEntryStorageChanged( getHashKey(), eStorageModeDisk, eStorageModeRAM, getTime(), size() );
+        }
+    }
+
+    /**
+     * @brief Returns true if the entry is stored on disk but its data were not written to its file yet.
+     **/
+    bool hasUnwrittenData() const
+    {
+        QReadLocker k(&_entryLock);
+
+        return _data.hasUnwrittenData();
+    }
+
+    /**
+     * @brief Writes the data of an entry stored on disk to its file, see Buffer::writeToBackingFile().
+     * This is called by the cache write-behind threads once the entry has been evicted from the in-memory portion,
+     * deallocate() then releases the RAM.
+     * This function throws a std::runtime_error upon failure.
+     **/
+    void writeBackingFile() const
+    {
+        QReadLocker k(&_entryLock);
+
+        _data.writeToBackingFile();
+    }
+
+    /**
+     * @brief True while the entry sits in the disk portion of the cache waiting for writeBackingFile().
+     * This is protected by the lock of the cache bucket holding the entry.
+     **/
+    bool isWriteBehindPending() const
+    {
+        return _writeBehindPending;
+    }
+
+    void setWriteBehindPending(bool pending)
+    {
+        _writeBehindPending = pending;
+    }
+
+    /**
+     * @brief Copies the data of an entry stored in RAM to the file at the given path, so that other processes can map
+     * it, see Cache::publishSharedEntry().
+     * This function throws a std::runtime_error upon failure.
+     **/
+    void writeDataToFile(const std::string& filePath) const
+    {
+        QReadLocker k(&_entryLock);
+
+        _data.writeToFile(filePath);
+    }
+
+    /**
+     * @brief Returns true the first time it is called, so that an entry is published only once in the shared index
+     * of the cache.
+     **/
+    bool markSharedPublished()
+    {
+        QWriteLocker k(&_entryLock);
+
+        if (_sharedPublished) {
+            return false;
         }
+        _sharedPublished = true;
+
+        return true;
+    }
+
+    /**
+     * @brief Marks the entry as mapping a file published by another process in the shared index of the cache.
+     * Such an entry is destroyed rather than written when evicted, and its file is never removed by this process.
+     * Must be called before restoreMetadataFromFile().
+     **/
+    void setSharedFile()
+    {
+        QWriteLocker k(&_entryLock);
+
+        _data.setSharedFile();
+    }
+
+    bool isSharedFile() const
+    {
+        QReadLocker k(&_entryLock);
+
+        return _data.isSharedFile();
     }
 
     /**
@@ -963,35 +1278,121 @@ public:
     {
         std::size_t sz = size();
         bool dataAllocated;
+        std::size_t compressedSize = 0;
         double time = getTime();
         {
             QWriteLocker k(&_entryLock);
             dataAllocated = _data.isAllocated();
+            if ( _data.isCompressed() ) {
+                compressedSize = _data.size();
+            }
             _data.deallocate();
         }
 
         if (_cache) {
+            if (compressedSize > 0) {
+                _cache->notifyEntryCompressedSizeChanged(getHashKey(), compressedSize, 0);
+            }
             const CacheEntryStorageInfo& info = _params->getStorageInfo();
             if (info.mode == eStorageModeDisk) {
                 if (dataAllocated) {
                     if (_cache->isTileCache()) {
-                         _cache->notifyEntryDestroyed(time, sz, eStorageModeDisk);
+                         _cache->notifyEntryDestroyed(getHashKey(), time, sz, eStorageModeDisk);
                     } else {
-                        _cache->notifyEntryStorageChanged( eStorageModeRAM, eStorageModeDisk, time, sz );
+                        _cache->notifyEntryStorageChanged( getHashKey(), eStorageModeRAM, eStorageModeDisk, time, sz );
                     }
                 }
             } else if (info.mode == eStorageModeRAM) {
                 if (dataAllocated) {
-                    _cache->notifyEntryDestroyed(time, sz, eStorageModeRAM);
+                    _cache->notifyEntryDestroyed(getHashKey(), time, sz, eStorageModeRAM);
                 }
             } else if (info.mode == eStorageModeGLTex) {
                 if (dataAllocated) {
-                    _cache->notifyEntryDestroyed(time, sz, eStorageModeGLTex);
+                    _cache->notifyEntryDestroyed(getHashKey(), time, sz, eStorageModeGLTex);
                 }
             }
         }
     }
 
+    /**
+     * @brief Called by the cache, under the lock of its bucket, when the entry is moved to the compressed entries.
+     * The compression itself is done later by compress() once the bucket lock has been released: if the entry is
+     * handed out by the cache meanwhile, decompress() cancels the request.
+     **/
+    void setCompressionPending()
+    {
+        QWriteLocker k(&_entryLock);
+
+        _compressionPending = true;
+    }
+
+    /**
+     * @brief Compresses the buffer of an entry stored in RAM, see Buffer::compress(). This is called by the cache
+     * after setCompressionPending(), without holding any cache lock.
+     * @returns False if the buffer was left untouched, e.g: because the entry was handed out by the cache in the meantime.
+     **/
+    bool compress(bool packHalfFloat)
+    {
+        std::size_t oldSize = size();
+        std::size_t compressedSize;
+        {
+            QWriteLocker k(&_entryLock);
+            if (!_compressionPending) {
+                return false;
+            }
+            _compressionPending = false;
+            if ( !_data.compress(_params->getStorageInfo().dataTypeSize, packHalfFloat) ) {
+                return false;
+            }
+            compressedSize = _data.size();
+        }
+
+        if (_cache) {
+            _cache->notifyEntrySizeChanged( getHashKey(), oldSize, size() );
+            _cache->notifyEntryCompressedSizeChanged(getHashKey(), 0, compressedSize);
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Restores the buffer compressed by compress() and cancels any pending compression. This is called by the cache
+     * before handing out the entry, without holding any cache lock.
+     * This function throws a std::bad_alloc if the allocation fails or a std::runtime_error if the compressed data are corrupted.
+     **/
+    void decompress()
+    {
+        {
+            QReadLocker k(&_entryLock);
+            if ( !_compressionPending && !_data.isCompressed() ) {
+                return;
+            }
+        }
+        std::size_t oldSize = size();
+        std::size_t compressedSize;
+        {
+            QWriteLocker k(&_entryLock);
+            _compressionPending = false;
+            if ( !_data.isCompressed() ) {
+                return;
+            }
+            compressedSize = _data.size();
+            _data.decompress();
+        }
+
+        if (_cache) {
+            _cache->notifyEntryCompressedSizeChanged(getHashKey(), compressedSize, 0);
+            _cache->notifyEntrySizeChanged( getHashKey(), oldSize, size() );
+        }
+    }
+
+    bool isCompressed() const
+    {
+        QReadLocker k(&_entryLock);
+
+        return _data.isCompressed();
+    }
+
     /**
      * @brief Returns the size of the cache entry in bytes. This is made virtual
      * so derived class could add any extra size related to a buffer it may have (@see Image::size())
@@ -1054,20 +1455,25 @@ public:
 
         bool isAlloc;
         bool hasRemovedFile;
+        std::string filePath;
+        std::size_t dataOffset;
         {
             QWriteLocker k(&_entryLock);
             isAlloc = _data.isAllocated();
+            filePath = _data.getFilePath();
+            dataOffset = _data.getOffsetInFile();
             hasRemovedFile = _data.removeAnyBackingFile();
         }
 
         if (hasRemovedFile) {
             _cache->backingFileClosed();
         }
+        _cache->notifyEntryDataRemovedFromDisk(getHashKey(), filePath, dataOffset);
         if (isAlloc) {
-            _cache->notifyEntryDestroyed(getTime(), getElementsCountFromParams(), eStorageModeRAM);
+            _cache->notifyEntryDestroyed(getHashKey(), getTime(), getElementsCountFromParams(), eStorageModeRAM);
         } else {
             ///size() will return 0 at this point, we have to recompute it
-            _cache->notifyEntryDestroyed(getTime(), getElementsCountFromParams(), eStorageModeDisk);
+            _cache->notifyEntryDestroyed(getHashKey(), getTime(), getElementsCountFromParams(), eStorageModeDisk);
         }
     }
 
@@ -1142,8 +1548,10 @@ protected:
         size_t oldSize = size();
 
         _data.swap(other._data);
+        // The file path of the other buffer may have been taken, see Buffer::swap()
+        _reservedFilePath.swap(other._reservedFilePath);
         if (_cache) {
-            _cache->notifyEntrySizeChanged( oldSize, size() );
+            _cache->notifyEntrySizeChanged( getHashKey(), oldSize, size() );
         }
     }
 
@@ -1158,7 +1566,7 @@ private:
     virtual void freeTile(const TileCacheFilePtr& file, std::size_t dataOffset) OVERRIDE FINAL
     {
         assert(_cache);
-        const_cast<CacheAPI*>(_cache)->freeTile(file,dataOffset);
+        const_cast<CacheAPI*>(_cache)->freeTile(getHashKey(), file, dataOffset);
     }
 
     virtual TileCacheFilePtr getTileCacheFile(const std::string& filepath, std::size_t dataOffset) OVERRIDE FINAL
@@ -1200,13 +1608,13 @@ private:
                 }
 
                 assert( !fileName.empty() );
-                //Check if the filename already exists, if so append a 0-based index after the hash (separated by a '_')
-                //and try again
+                //Check if the filename already exists or is reserved by an entry whose data are not written yet,
+                //if so append a 0-based index after the hash (separated by a '_') and try again
                 int index = 0;
-                if ( CacheAPI::fileExists(fileName) ) {
+                if ( CacheAPI::fileExists(fileName) || !_cache->reserveEntryFilePath(fileName) ) {
                     fileName.insert(fileName.size() - 4, "_0");
                 }
-                while ( CacheAPI::fileExists(fileName) ) {
+                while ( CacheAPI::fileExists(fileName) || !_cache->reserveEntryFilePath(fileName) ) {
                     ++index;
                     std::stringstream ss;
                     ss << index;
@@ -1217,8 +1625,9 @@ private:
                     qDebug() << "WARNING: Cache entry filename is not the same as the serialized hash key";
                 }
 #endif
+                _reservedFilePath = fileName;
                 U64 count = getElementsCountFromParams();
-                _data.allocateMMAP(count, fileName);
+                _data.allocateRAMForDisk(count, fileName);
             }
         } else if (info.mode == eStorageModeRAM) {
             U64 count = getElementsCountFromParams();
@@ -1253,6 +1662,18 @@ protected:
     const CacheAPI* _cache;
     mutable QReadWriteLock _entryLock;
     bool _removeBackingFileBeforeDestruction;
+
+    // The path reserved in the cache by allocate(), released on destruction
+    std::string _reservedFilePath;
+
+    // Protected by the lock of the cache bucket, see isWriteBehindPending()
+    bool _writeBehindPending;
+
+    // Protected by _entryLock, see setCompressionPending()
+    bool _compressionPending;
+
+    // Protected by _entryLock, see markSharedPublished()
+    bool _sharedPublished;
 };
 
 NATRON_NAMESPACE_EXIT
@@ -0,0 +1,93 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheEvictionPolicy.h"
+
+#include <algorithm> // max
+
+#include <QtCore/QMutexLocker>
+
+#include "Engine/CacheEntry.h"
+
+NATRON_NAMESPACE_ENTER
+
+CostAwareCacheEvictionPolicy::CostAwareCacheEvictionPolicy()
+    : CacheEvictionPolicy()
+    , _clockMutex()
+    , _clock(0.)
+{
+}
+
+CostAwareCacheEvictionPolicy::~CostAwareCacheEvictionPolicy()
+{
+}
+
+void
+CostAwareCacheEvictionPolicy::onEntryAccessed(AbstractCacheEntryBase* entry)
+{
+    double clock;
+    {
+        QMutexLocker k(&_clockMutex);
+        clock = _clock;
+    }
+
+    entry->notifyAccessedByCache(clock);
+}
+
+void
+CostAwareCacheEvictionPolicy::onEntryEvicted(const AbstractCacheEntryBase* entry)
+{
+    double score = getEvictionScore(entry);
+    QMutexLocker k(&_clockMutex);
+
+    _clock = std::max(_clock, score);
+}
+
+int
+CostAwareCacheEvictionPolicy::getEvictionCandidatesCount() const
+{
+    return NATRON_CACHE_COST_AWARE_EVICTION_CANDIDATES;
+}
+
+double
+CostAwareCacheEvictionPolicy::getEvictionScore(const AbstractCacheEntryBase* entry) const
+{
+    double cost;
+    U64 accessCount;
+    double clock;
+
+    entry->getEvictionInfo(&cost, &accessCount, &clock);
+
+    // The cost of an entry is only known once it has been computed, hence it is not baked in the score
+    // when the entry is accessed.
+    cost = std::max(cost, NATRON_CACHE_COST_AWARE_MIN_COST);
+
+    // Express the size in MB so that the frequency/cost term does not vanish compared to the clock
+    double sizeMB = std::max( (double)entry->size(), 1. ) / (1024. * 1024.);
+
+    return clock + (double)std::max(accessCount, (U64)1) * cost / sizeMB;
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,144 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_CACHEEVICTIONPOLICY_H
+#define NATRON_ENGINE_CACHEEVICTIONPOLICY_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <QtCore/QMutex>
+
+#include "Engine/EngineFwd.h"
+
+///Number of least recently used entries examined by the cost-aware eviction policy to select the entry to evict
+#define NATRON_CACHE_COST_AWARE_EVICTION_CANDIDATES 16
+
+///Entries that took less than that (in seconds) to compute are considered to have cost that much
+#define NATRON_CACHE_COST_AWARE_MIN_COST 0.001
+
+NATRON_NAMESPACE_ENTER
+
+class AbstractCacheEntryBase;
+
+/**
+ * @brief Decides which entry of the in-memory portion of a cache is evicted first.
+ * The cache examines the getEvictionCandidatesCount() least recently used entries that can be evicted and evicts
+ * the one with the lowest getEvictionScore().
+ * The same policy is used concurrently by all buckets of a cache: implementations must be MT-safe.
+ **/
+class CacheEvictionPolicy
+{
+public:
+
+    CacheEvictionPolicy()
+    {
+    }
+
+    virtual ~CacheEvictionPolicy()
+    {
+    }
+
+    /**
+     * @brief Called whenever the entry is inserted in the in-memory portion of the cache or returned by the cache.
+     **/
+    virtual void onEntryAccessed(AbstractCacheEntryBase* entry) = 0;
+
+    /**
+     * @brief Called once the entry has been selected for eviction.
+     **/
+    virtual void onEntryEvicted(const AbstractCacheEntryBase* entry) = 0;
+
+    virtual int getEvictionCandidatesCount() const = 0;
+
+    virtual double getEvictionScore(const AbstractCacheEntryBase* entry) const = 0;
+};
+
+/**
+ * @brief Evicts the least recently used entry. This is the default policy.
+ **/
+class LRUCacheEvictionPolicy
+    : public CacheEvictionPolicy
+{
+public:
+
+    LRUCacheEvictionPolicy()
+        : CacheEvictionPolicy()
+    {
+    }
+
+    virtual ~LRUCacheEvictionPolicy()
+    {
+    }
+
+    virtual void onEntryAccessed(AbstractCacheEntryBase* /*entry*/) OVERRIDE FINAL
+    {
+    }
+
+    virtual void onEntryEvicted(const AbstractCacheEntryBase* /*entry*/) OVERRIDE FINAL
+    {
+    }
+
+    virtual int getEvictionCandidatesCount() const OVERRIDE FINAL
+    {
+        return 1;
+    }
+
+    virtual double getEvictionScore(const AbstractCacheEntryBase* /*entry*/) const OVERRIDE FINAL
+    {
+        return 0.;
+    }
+};
+
+/**
+ * @brief Greedy-Dual-Size-Frequency eviction: the score of an entry is
+ * clock + accessCount * computationCost / size
+ * where clock is the value of the policy clock when the entry was last accessed. The clock is raised to the score
+ * of each evicted entry, so that entries that are not accessed anymore eventually get evicted, however expensive they were.
+ * Entries that were expensive to compute, that are small or that are accessed often are kept longer: a playback
+ * of cheap frames, each accessed once, does not flush the expensive intermediate images that are accessed at each frame.
+ **/
+class CostAwareCacheEvictionPolicy
+    : public CacheEvictionPolicy
+{
+public:
+
+    CostAwareCacheEvictionPolicy();
+
+    virtual ~CostAwareCacheEvictionPolicy();
+
+    virtual void onEntryAccessed(AbstractCacheEntryBase* entry) OVERRIDE FINAL;
+    virtual void onEntryEvicted(const AbstractCacheEntryBase* entry) OVERRIDE FINAL;
+    virtual int getEvictionCandidatesCount() const OVERRIDE FINAL;
+    virtual double getEvictionScore(const AbstractCacheEntryBase* entry) const OVERRIDE FINAL;
+
+private:
+
+    mutable QMutex _clockMutex;
+    double _clock;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CACHEEVICTIONPOLICY_H
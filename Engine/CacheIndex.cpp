@@ -0,0 +1,490 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheIndex.h"
+
+#include <cstring> // memcpy, memset
+#include <map>
+#include <utility>
+#include <cassert>
+#include <stdexcept>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/crc.hpp>
+#endif
+
+#include <QtCore/QMutex>
+#include <QtCore/QFile>
+#include <QtCore/QDebug>
+
+#include "Engine/MemoryFile.h"
+
+// Identifies an index file
+#define NATRON_CACHE_INDEX_MAGIC 0x4E435849
+// Identifies the start of a record
+#define NATRON_CACHE_INDEX_RECORD_MAGIC 0x4E435852
+// Increment when the layout of the index changes
+#define NATRON_CACHE_INDEX_VERSION 1
+// The index file grows by chunks of that many bytes
+#define NATRON_CACHE_INDEX_GROW_SIZE (1024 * 1024)
+// Below that number of records the index is never worth rewriting
+#define NATRON_CACHE_INDEX_MIN_RECORDS_COMPACTION 4096
+
+NATRON_NAMESPACE_ENTER
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+enum RecordTypeEnum
+{
+    eRecordTypeAdd = 1,
+    eRecordTypeRemove
+};
+
+struct IndexHeader
+{
+    U32 magic;
+    U32 indexVersion;
+    U32 cacheVersion;
+    U32 reserved;
+};
+
+// A record is a RecordHeader followed by 'size' bytes: a RecordPayloadHeader, the file path and the entry data,
+// padded with zeroes so that the next record is 8-bytes aligned.
+struct RecordHeader
+{
+    U32 magic;
+    U32 type;
+    U32 size;
+    U32 checksum; //< CRC-32 of type, size and the 'size' bytes following the header
+};
+
+struct RecordPayloadHeader
+{
+    U64 dataOffset;
+    U32 filePathLength;
+    U32 dataLength;
+};
+
+U32
+computeRecordChecksum(U32 type,
+                      U32 size,
+                      const char* payload)
+{
+    boost::crc_32_type crc;
+
+    crc.process_bytes( &type, sizeof(type) );
+    crc.process_bytes( &size, sizeof(size) );
+    crc.process_bytes(payload, size);
+
+    return crc.checksum();
+}
+
+std::size_t
+getRecordPayloadSize(const std::string& filePath,
+                     const std::string& data)
+{
+    std::size_t size = sizeof(RecordPayloadHeader) + filePath.size() + data.size();
+
+    return (size + 7) & ~(std::size_t)7;
+}
+
+/**
+ * @brief Writes a record at dst which must have room for sizeof(RecordHeader) + getRecordPayloadSize() bytes.
+ * The header is written last, so that an interrupted write always leaves an invalid record.
+ * Returns the number of bytes written.
+ **/
+std::size_t
+writeRecord(char* dst,
+            RecordTypeEnum type,
+            const std::string& filePath,
+            U64 dataOffset,
+            const std::string& data)
+{
+    std::size_t payloadSize = getRecordPayloadSize(filePath, data);
+    char* payload = dst + sizeof(RecordHeader);
+
+    std::memset(payload, 0, payloadSize);
+
+    RecordPayloadHeader payloadHeader;
+    payloadHeader.dataOffset = dataOffset;
+    payloadHeader.filePathLength = (U32)filePath.size();
+    payloadHeader.dataLength = (U32)data.size();
+    std::memcpy( payload, &payloadHeader, sizeof(payloadHeader) );
+    if ( !filePath.empty() ) {
+        std::memcpy( payload + sizeof(payloadHeader), filePath.c_str(), filePath.size() );
+    }
+    if ( !data.empty() ) {
+        std::memcpy( payload + sizeof(payloadHeader) + filePath.size(), data.c_str(), data.size() );
+    }
+
+    RecordHeader header;
+    header.magic = NATRON_CACHE_INDEX_RECORD_MAGIC;
+    header.type = (U32)type;
+    header.size = (U32)payloadSize;
+    header.checksum = computeRecordChecksum(header.type, header.size, payload);
+    std::memcpy( dst, &header, sizeof(header) );
+
+    return sizeof(header) + payloadSize;
+}
+
+void
+writeIndexHeader(char* dst,
+                 unsigned int cacheVersion)
+{
+    IndexHeader header;
+
+    header.magic = NATRON_CACHE_INDEX_MAGIC;
+    header.indexVersion = NATRON_CACHE_INDEX_VERSION;
+    header.cacheVersion = cacheVersion;
+    header.reserved = 0;
+    std::memcpy( dst, &header, sizeof(header) );
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+
+struct CacheIndexPrivate
+{
+    // Protects all members
+    mutable QMutex lock;
+    std::string filePath;
+    boost::scoped_ptr<MemoryFile> file;
+
+    // Offset in the file at which the next record is written
+    std::size_t end;
+
+    // Number of records in the file and number of entries they reference
+    std::size_t nRecords;
+    std::size_t nEntries;
+
+    CacheIndexPrivate()
+        : lock()
+        , filePath()
+        , file()
+        , end(0)
+        , nRecords(0)
+        , nEntries(0)
+    {
+    }
+
+    /**
+     * @brief Reads the records of the file, stopping at the first invalid one.
+     **/
+    bool readRecords(unsigned int cacheVersion, std::list<CacheIndex::Entry>* entries);
+
+    /**
+     * @brief Makes sure the mapping has room for a record of the given size followed by an empty record header,
+     * which marks the end of the index.
+     **/
+    void ensureCapacity(std::size_t recordSize);
+
+    void appendRecord(RecordTypeEnum type, const std::string& filePath, U64 dataOffset, const std::string& data);
+};
+
+bool
+CacheIndexPrivate::readRecords(unsigned int cacheVersion,
+                               std::list<CacheIndex::Entry>* entries)
+{
+    char* data = file->data();
+    std::size_t size = file->size();
+
+    if ( !data || (size < sizeof(IndexHeader) + sizeof(RecordHeader)) ) {
+        return false;
+    }
+    IndexHeader header;
+    std::memcpy( &header, data, sizeof(header) );
+    if ( (header.magic != NATRON_CACHE_INDEX_MAGIC) || (header.indexVersion != NATRON_CACHE_INDEX_VERSION) || (header.cacheVersion != cacheVersion) ) {
+        return false;
+    }
+
+    // The entries referenced by the records read so far, the last record for a given location wins
+    typedef std::map<std::pair<std::string, U64>, std::string> EntriesMap;
+    EntriesMap liveEntries;
+    std::size_t offset = sizeof(IndexHeader);
+    nRecords = 0;
+    while (offset + sizeof(RecordHeader) <= size) {
+        RecordHeader recordHeader;
+        std::memcpy( &recordHeader, data + offset, sizeof(recordHeader) );
+        if (recordHeader.magic != NATRON_CACHE_INDEX_RECORD_MAGIC) {
+            break;
+        }
+        const char* payload = data + offset + sizeof(RecordHeader);
+        if ( (recordHeader.size < sizeof(RecordPayloadHeader)) || (recordHeader.size > size - offset - sizeof(RecordHeader)) ) {
+            break;
+        }
+        if (computeRecordChecksum(recordHeader.type, recordHeader.size, payload) != recordHeader.checksum) {
+            break;
+        }
+        RecordPayloadHeader payloadHeader;
+        std::memcpy( &payloadHeader, payload, sizeof(payloadHeader) );
+        if ( (std::size_t)payloadHeader.filePathLength + payloadHeader.dataLength > recordHeader.size - sizeof(RecordPayloadHeader) ) {
+            break;
+        }
+        std::pair<std::string, U64> location(std::string(payload + sizeof(payloadHeader), payloadHeader.filePathLength), payloadHeader.dataOffset);
+        if (recordHeader.type == eRecordTypeAdd) {
+            liveEntries[location] = std::string(payload + sizeof(payloadHeader) + payloadHeader.filePathLength, payloadHeader.dataLength);
+        } else if (recordHeader.type == eRecordTypeRemove) {
+            liveEntries.erase(location);
+        } else {
+            break;
+        }
+        ++nRecords;
+        offset += sizeof(RecordHeader) + recordHeader.size;
+    }
+
+    // Anything past the last valid record is either the unused part of the file or a record that was being written
+    // when the application was killed: clear it so that it is not mistaken for a record later on.
+    if (offset < size) {
+        std::memset(data + offset, 0, size - offset);
+    }
+    end = offset;
+    nEntries = liveEntries.size();
+
+    for (EntriesMap::const_iterator it = liveEntries.begin(); it != liveEntries.end(); ++it) {
+        CacheIndex::Entry entry;
+        entry.filePath = it->first.first;
+        entry.dataOffset = it->first.second;
+        entry.data = it->second;
+        entries->push_back(entry);
+    }
+
+    return true;
+} // CacheIndexPrivate::readRecords
+
+void
+CacheIndexPrivate::ensureCapacity(std::size_t recordSize)
+{
+    std::size_t requiredSize = end + recordSize + sizeof(RecordHeader);
+
+    if ( requiredSize <= file->size() ) {
+        return;
+    }
+    std::size_t newSize = file->size();
+    while (newSize < requiredSize) {
+        newSize += NATRON_CACHE_INDEX_GROW_SIZE;
+    }
+    // The file is extended with zeroes which marks the end of the records
+    file->resize(newSize);
+}
+
+void
+CacheIndexPrivate::appendRecord(RecordTypeEnum type,
+                                const std::string& entryFilePath,
+                                U64 dataOffset,
+                                const std::string& data)
+{
+    if (!file) {
+        return;
+    }
+    std::size_t recordSize = sizeof(RecordHeader) + getRecordPayloadSize(entryFilePath, data);
+    try {
+        ensureCapacity(recordSize);
+    } catch (const std::exception& e) {
+        qDebug() << "Failed to grow the cache index" << filePath.c_str() << ":" << e.what();
+
+        return;
+    }
+    end += writeRecord(file->data() + end, type, entryFilePath, dataOffset, data);
+    ++nRecords;
+}
+
+CacheIndex::CacheIndex()
+    : _imp( new CacheIndexPrivate() )
+{
+}
+
+CacheIndex::~CacheIndex()
+{
+    close();
+}
+
+bool
+CacheIndex::open(const std::string& filePath,
+                 unsigned int cacheVersion,
+                 std::list<Entry>* entries)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->file.reset();
+    _imp->filePath = filePath;
+
+    QString indexPath = QString::fromUtf8( filePath.c_str() );
+    QString tmpIndexPath = indexPath + QString::fromUtf8(".tmp");
+    if ( QFile::exists(tmpIndexPath) ) {
+        if ( !QFile::exists(indexPath) ) {
+            // The application was killed during rewrite() after the old index was removed: the new one is complete
+            QFile::rename(tmpIndexPath, indexPath);
+        } else {
+            // The application was killed while writing the new index
+            QFile::remove(tmpIndexPath);
+        }
+    }
+    if ( !QFile::exists(indexPath) ) {
+        return false;
+    }
+
+    _imp->file.reset( new MemoryFile(filePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail) );
+    if ( !_imp->readRecords(cacheVersion, entries) ) {
+        entries->clear();
+        _imp->file.reset();
+
+        return false;
+    }
+
+    return true;
+}
+
+void
+CacheIndex::create(const std::string& filePath,
+                   unsigned int cacheVersion)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->file.reset();
+    _imp->filePath = filePath;
+    QFile::remove( QString::fromUtf8( ( filePath + ".tmp" ).c_str() ) );
+
+    _imp->file.reset( new MemoryFile(filePath, MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate) );
+    _imp->file->resize(NATRON_CACHE_INDEX_GROW_SIZE);
+    writeIndexHeader(_imp->file->data(), cacheVersion);
+    _imp->end = sizeof(IndexHeader);
+    _imp->nRecords = 0;
+    _imp->nEntries = 0;
+    _imp->file->flush(MemoryFile::eFlushTypeSync, 0, 0);
+}
+
+void
+CacheIndex::close()
+{
+    QMutexLocker k(&_imp->lock);
+
+    if (_imp->file) {
+        _imp->file->flush(MemoryFile::eFlushTypeSync, 0, 0);
+        _imp->file.reset();
+    }
+}
+
+bool
+CacheIndex::isOpened() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->file.get() != 0;
+}
+
+void
+CacheIndex::appendAdd(const Entry& entry)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->appendRecord(eRecordTypeAdd, entry.filePath, entry.dataOffset, entry.data);
+    ++_imp->nEntries;
+}
+
+void
+CacheIndex::appendRemove(const std::string& filePath,
+                         U64 dataOffset)
+{
+    QMutexLocker k(&_imp->lock);
+
+    _imp->appendRecord( eRecordTypeRemove, filePath, dataOffset, std::string() );
+    if (_imp->nEntries > 0) {
+        --_imp->nEntries;
+    }
+}
+
+void
+CacheIndex::rewrite(const std::list<Entry>& entries)
+{
+    QMutexLocker k(&_imp->lock);
+
+    if (!_imp->file) {
+        return;
+    }
+
+    IndexHeader header;
+    std::memcpy( &header, _imp->file->data(), sizeof(header) );
+
+    std::size_t indexSize = sizeof(IndexHeader) + sizeof(RecordHeader);
+    for (std::list<Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        indexSize += sizeof(RecordHeader) + getRecordPayloadSize(it->filePath, it->data);
+    }
+    indexSize = (indexSize / NATRON_CACHE_INDEX_GROW_SIZE + 1) * NATRON_CACHE_INDEX_GROW_SIZE;
+
+    std::string tmpFilePath = _imp->filePath + ".tmp";
+    std::size_t end = sizeof(IndexHeader);
+    try {
+        MemoryFile tmpFile(tmpFilePath, indexSize, MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate);
+        writeIndexHeader(tmpFile.data(), header.cacheVersion);
+        for (std::list<Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+            end += writeRecord(tmpFile.data() + end, eRecordTypeAdd, it->filePath, it->dataOffset, it->data);
+        }
+        if ( !tmpFile.flush(MemoryFile::eFlushTypeSync, 0, 0) ) {
+            throw std::runtime_error("Failed to write " + tmpFilePath);
+        }
+    } catch (const std::exception& e) {
+        qDebug() << "Failed to rewrite the cache index:" << e.what();
+        QFile::remove( QString::fromUtf8( tmpFilePath.c_str() ) );
+
+        return;
+    }
+
+    // The new index is complete, replace the old one. If the application gets killed in between, open()
+    // picks up the temporary file.
+    _imp->file.reset();
+    QString indexPath = QString::fromUtf8( _imp->filePath.c_str() );
+    QFile::remove(indexPath);
+    QFile::rename(QString::fromUtf8( tmpFilePath.c_str() ), indexPath);
+
+    _imp->file.reset( new MemoryFile(_imp->filePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseCreate) );
+    if ( !_imp->file->data() ) {
+        _imp->file->resize(indexSize);
+        writeIndexHeader(_imp->file->data(), header.cacheVersion);
+        end = sizeof(IndexHeader);
+    }
+    _imp->end = end;
+    _imp->nRecords = entries.size();
+    _imp->nEntries = entries.size();
+} // CacheIndex::rewrite
+
+bool
+CacheIndex::needsCompaction() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->file && _imp->nRecords > NATRON_CACHE_INDEX_MIN_RECORDS_COMPACTION && _imp->nRecords > 2 * _imp->nEntries;
+}
+
+void
+CacheIndex::flush(bool synchronous)
+{
+    QMutexLocker k(&_imp->lock);
+
+    if (_imp->file) {
+        _imp->file->flush(synchronous ? MemoryFile::eFlushTypeSync : MemoryFile::eFlushTypeAsync, 0, 0);
+    }
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,129 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_CACHEINDEX_H
+#define NATRON_ENGINE_CACHEINDEX_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <string>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+///Name of the index file, located at the root of the cache directory
+#define NATRON_CACHE_INDEX_FILE_NAME "index." NATRON_CACHE_FILE_EXT
+
+NATRON_NAMESPACE_ENTER
+
+struct CacheIndexPrivate;
+
+/**
+ * @brief The persistent index of the disk portion of a cache: a journal of records mapped in memory, which is only
+ * ever appended to. An "add" record is appended once an entry is stored on disk and a "remove" record once its data
+ * is removed from the disk. Entries are identified by the file holding their data and the offset of the data in
+ * this file.
+ * Each record carries a checksum: a record that was partially written when the application was killed is detected
+ * and the index is read up to the last valid record, so that only the last records may be lost.
+ * Obsolete records are dropped whenever the index is rewritten, see rewrite().
+ * This class is MT-safe.
+ **/
+class CacheIndex
+{
+public:
+
+    struct Entry
+    {
+        std::string filePath;
+        U64 dataOffset;
+        std::string data; //< the serialized cache entry
+
+        Entry()
+            : filePath()
+            , dataOffset(0)
+            , data()
+        {
+        }
+    };
+
+    CacheIndex();
+
+    ~CacheIndex();
+
+    /**
+     * @brief Maps the index file in memory and reads back the entries that are still referenced by it.
+     * @returns False if the file does not exist, is not an index or was written for another version of the cache,
+     * in which case the index is left closed.
+     * This function might throw an exception upon failure to map the file.
+     **/
+    bool open(const std::string& filePath, unsigned int cacheVersion, std::list<Entry>* entries);
+
+    /**
+     * @brief Creates an empty index, replacing any existing file.
+     * This function might throw an exception upon failure to create the file.
+     **/
+    void create(const std::string& filePath, unsigned int cacheVersion);
+
+    /**
+     * @brief Flushes and closes the index. Records appended while the index is closed are ignored.
+     **/
+    void close();
+
+    bool isOpened() const;
+
+    void appendAdd(const Entry& entry);
+
+    void appendRemove(const std::string& filePath, U64 dataOffset);
+
+    /**
+     * @brief Replaces the content of the index by the given entries. The new index is written to a temporary file
+     * which replaces the index only once complete, so that a valid index exists at any time.
+     **/
+    void rewrite(const std::list<Entry>& entries);
+
+    /**
+     * @brief Returns true if most of the records of the index are obsolete and the index would be worth rewriting.
+     **/
+    bool needsCompaction() const;
+
+    /**
+     * @brief Ensures the records appended so far are written to the disk.
+     * @param synchronous If false, the write is only scheduled.
+     **/
+    void flush(bool synchronous);
+
+private:
+
+    boost::scoped_ptr<CacheIndexPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CACHEINDEX_H
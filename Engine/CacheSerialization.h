@@ -31,7 +31,9 @@
 #include <list>
 #include <set>
 #include <cstddef>
+#include <sstream> // stringstream
 #include <stdexcept>
+#include <cstdio> // remove
 
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/shared_ptr.hpp>
@@ -69,6 +71,69 @@ GCC_DIAG_ON(unused-parameter)
 
 NATRON_NAMESPACE_ENTER
 
+/*Fills the serialization of an entry stored on disk*/
+template<typename EntryType>
+void
+Cache<EntryType>::serializeEntry(const EntryTypePtr& entry,
+                                 SerializedEntry* serialization)
+{
+    serialization->hash = entry->getHashKey();
+    serialization->params = entry->getParams();
+    serialization->key = entry->getKey();
+    serialization->size = entry->dataSize();
+    serialization->filePath = entry->getFilePath();
+    serialization->dataOffsetInFile = entry->getOffsetInFile();
+}
+
+/*Converts the serialization of an entry to a record of the disk cache index*/
+template<typename EntryType>
+void
+Cache<EntryType>::toIndexEntry(const SerializedEntry& serialization,
+                               CacheIndex::Entry* indexEntry)
+{
+    std::ostringstream ss;
+    {
+        boost::archive::binary_oarchive oArchive(ss, boost::archive::no_header);
+        oArchive << serialization;
+    }
+    indexEntry->filePath = serialization.filePath;
+    indexEntry->dataOffset = serialization.dataOffsetInFile;
+    indexEntry->data = ss.str();
+}
+
+/*Reads the serialization of an entry written by toIndexEntry(). Returns false if it cannot be read.*/
+template<typename EntryType>
+bool
+Cache<EntryType>::deserializeEntry(const std::string& data,
+                                   SerializedEntry* serialization)
+{
+    try {
+        std::istringstream ss(data);
+        boost::archive::binary_iarchive iArchive(ss, boost::archive::no_header);
+        iArchive >> *serialization;
+    } catch (const std::exception & e) {
+        qDebug() << "Failed to read a cache index entry:" << e.what();
+
+        return false;
+    }
+
+    return true;
+}
+
+/*Converts a record of the disk cache index to the serialization of an entry. Returns false if it cannot be read.*/
+template<typename EntryType>
+bool
+Cache<EntryType>::fromIndexEntry(const CacheIndex::Entry& indexEntry,
+                                 SerializedEntry* serialization)
+{
+    if ( !deserializeEntry(indexEntry.data, serialization) ) {
+        return false;
+    }
+
+    // The location identifies the entry in the index, it must match
+    return serialization->filePath == indexEntry.filePath && serialization->dataOffsetInFile == indexEntry.dataOffset;
+}
+
 /*Saves cache to disk as a settings file.
  */
 template<typename EntryType>
@@ -76,20 +141,18 @@ void
 Cache<EntryType>::save(CacheTOC* tableOfContents)
 {
     clearInMemoryPortion(false);
-    {
-        QMutexLocker l(&_lock);     // must be locked
+    // Make sure the data of the entries of the disk portion are on disk
+    _writeBehindQueue.waitForIdle();
+    for (std::size_t i = 0; i < _buckets.size(); ++i) {
+        CacheBucket& bucket = *_buckets[i];
+        CacheBucketLocker l(bucket);     // must be locked
 
-        for (CacheIterator it = _diskCache.begin(); it != _diskCache.end(); ++it) {
+        for (CacheIterator it = bucket.diskCache.begin(); it != bucket.diskCache.end(); ++it) {
             std::list<EntryTypePtr> & listOfValues  = getValueFromIterator(it);
             for (typename std::list<EntryTypePtr>::const_iterator it2 = listOfValues.begin(); it2 != listOfValues.end(); ++it2) {
                 if ( (*it2)->isStoredOnDisk() ) {
                     SerializedEntry serialization;
-                    serialization.hash = (*it2)->getHashKey();
-                    serialization.params = (*it2)->getParams();
-                    serialization.key = (*it2)->getKey();
-                    serialization.size = (*it2)->dataSize();
-                    serialization.filePath = (*it2)->getFilePath();
-                    serialization.dataOffsetInFile = (*it2)->getOffsetInFile();
+                    serializeEntry(*it2, &serialization);
 
                     (*it2)->syncBackingFile();
                     
@@ -114,6 +177,9 @@ Cache<EntryType>::restore(const CacheTOC & tableOfContents)
     ///so that the memory freeing (which might be expensive for large images) doesn't happen while under the lock
     std::list<EntryTypePtr> entriesToBeDeleted;
 
+    // The entries that could actually be restored
+    CacheTOC restoredEntries;
+
     std::set<QString> usedFilePaths;
     for (typename CacheTOC::const_iterator it =
              tableOfContents.begin(); it != tableOfContents.end(); ++it) {
@@ -140,7 +206,7 @@ Cache<EntryType>::restore(const CacheTOC & tableOfContents)
 
         try {
             value = new EntryType(it->key, it->params, this);
-            if (it->size != getTileSizeBytes()) {
+            if ( _isTiled && (it->size != getTileSizeBytes()) ) {
                 delete value;
                 continue;
             }
@@ -154,9 +220,16 @@ Cache<EntryType>::restore(const CacheTOC & tableOfContents)
         const std::string& filePath = value->getFilePath();
         usedFilePaths.insert(QString::fromUtf8(filePath.c_str()));
         {
-            QMutexLocker locker(&_lock);
-            sealEntry(EntryTypePtr(value), false /*inMemory*/);
+            CacheBucket& bucket = getBucket( value->getHashKey() );
+            CacheBucketLocker locker(bucket);
+            sealEntry(bucket, EntryTypePtr(value), false /*inMemory*/);
         }
+        restoredEntries.push_back(*it);
+    }
+
+    // Drop from the index the entries that could not be restored and the obsolete records
+    if ( ( restoredEntries.size() != tableOfContents.size() ) || _index.needsCompaction() ) {
+        writeIndex(restoredEntries);
     }
 
     // Remove from the cache all files that are not referenced by the table of contents
@@ -165,7 +238,11 @@ Cache<EntryType>::restore(const CacheTOC & tableOfContents)
         QDir cacheFolder(cachePath);
         QString absolutePath = cacheFolder.absolutePath();
         QStringList etr = cacheFolder.entryList(QDir::NoDotAndDotDot);
+        QString indexFileName = QString::fromUtf8(NATRON_CACHE_INDEX_FILE_NAME);
         for (QStringList::iterator it = etr.begin(); it!=etr.end(); ++it) {
+            if ( it->startsWith(indexFileName) ) {
+                continue;
+            }
             QString entryFilePath = absolutePath + QLatin1Char('/') + *it;
 
             std::set<QString>::iterator foundUsed = usedFilePaths.find(entryFilePath);
@@ -197,6 +274,228 @@ Cache<EntryType>::restore(const CacheTOC & tableOfContents)
     }
 }
 
+template<typename EntryType>
+bool
+Cache<EntryType>::openIndex(CacheTOC* tableOfContents)
+{
+    clearIndexPendingEntries();
+
+    std::list<CacheIndex::Entry> indexEntries;
+    if ( !_index.open(getIndexFilePath(), _version, &indexEntries) ) {
+        return false;
+    }
+    for (std::list<CacheIndex::Entry>::const_iterator it = indexEntries.begin(); it != indexEntries.end(); ++it) {
+        SerializedEntry serialization;
+        if ( fromIndexEntry(*it, &serialization) ) {
+            tableOfContents->push_back(serialization);
+        }
+    }
+
+    return true;
+}
+
+template<typename EntryType>
+void
+Cache<EntryType>::writeIndex(const CacheTOC & tableOfContents)
+{
+    std::list<CacheIndex::Entry> indexEntries;
+
+    for (typename CacheTOC::const_iterator it = tableOfContents.begin(); it != tableOfContents.end(); ++it) {
+        CacheIndex::Entry indexEntry;
+        toIndexEntry(*it, &indexEntry);
+        indexEntries.push_back(indexEntry);
+    }
+    _index.rewrite(indexEntries);
+}
+
+template<typename EntryType>
+void
+Cache<EntryType>::writePendingIndexRecords(int maxEntries) const
+{
+    // Released after _indexPendingEntriesMutex
+    std::list<EntryTypePtr> examinedEntries;
+
+    // Another thread is already writing records, let it do the job
+    if ( !_indexPendingEntriesMutex.tryLock() ) {
+        return;
+    }
+    bool hasWrittenRecords = false;
+    int nExamined = 0;
+    typename IndexPendingEntryList::iterator it = _indexPendingEntries.begin();
+    while ( it != _indexPendingEntries.end() && nExamined < maxEntries ) {
+        ++nExamined;
+        EntryTypePtr entry = it->entry.lock();
+        if (!entry) {
+            it = eraseIndexPendingEntry(it);
+            continue;
+        }
+        examinedEntries.push_back(entry);
+
+        // Only referenced by the cache, the list above and the local variable: the entry is no longer written to
+        if (entry.use_count() > 3) {
+            // Examine it again later
+            _indexPendingEntries.splice(_indexPendingEntries.end(), _indexPendingEntries, it++);
+            continue;
+        }
+        it = eraseIndexPendingEntry(it);
+        // It may have fallen back on RAM storage
+        if ( !entry->isStoredOnDisk() ) {
+            continue;
+        }
+        SerializedEntry serialization;
+        serializeEntry(entry, &serialization);
+        CacheIndex::Entry indexEntry;
+        try {
+            toIndexEntry(serialization, &indexEntry);
+        } catch (const std::exception & e) {
+            qDebug() << "Failed to write a disk cache index entry:" << e.what();
+            continue;
+        }
+        _index.appendAdd(indexEntry);
+        hasWrittenRecords = true;
+    }
+    _indexPendingEntriesMutex.unlock();
+
+    if (hasWrittenRecords) {
+        _index.flush(false);
+    }
+}
+
+template<typename EntryType>
+void
+Cache<EntryType>::publishSharedEntry(const EntryTypePtr& entry) const
+{
+    if ( !_sharedIndex.isOpened() || entry->isSharedFile() || !entry->markSharedPublished() ) {
+        return;
+    }
+    std::size_t maximumSize = getMaximumMemorySize();
+    std::size_t size = entry->dataSize();
+    if ( (size == 0) || (size > maximumSize) ) {
+        return;
+    }
+    // Writing the file is left to the write-behind threads, this is a render thread
+    _writeBehindQueue.appendToQueue(entry, size, true);
+} // publishSharedEntry
+
+template<typename EntryType>
+void
+Cache<EntryType>::writeSharedEntry(const EntryTypePtr& entry) const
+{
+    if ( !_sharedIndex.isOpened() ) {
+        return;
+    }
+    std::size_t maximumSize = getMaximumMemorySize();
+    std::size_t size = entry->dataSize();
+    if ( (size == 0) || (size > maximumSize) ) {
+        return;
+    }
+
+    SharedPublishedEntry published;
+    published.hash = entry->getHashKey();
+    published.size = size;
+    {
+        QMutexLocker k(&_sharedPublishedMutex);
+        std::stringstream ss;
+        ss << _sharedIndex.getProcessFilesPath() << std::hex << published.hash << '_' << std::dec << _sharedPublishedFilesCount << "." NATRON_CACHE_FILE_EXT;
+        published.filePath = ss.str();
+        ++_sharedPublishedFilesCount;
+    }
+
+    // The other processes restore the entry as one stored on disk, whose file is the copy of its data
+    SerializedEntry serialization;
+    serializeEntry(entry, &serialization);
+    ParamsTypePtr params = boost::make_shared<param_t>(*serialization.params);
+    params->getStorageInfo().mode = eStorageModeDisk;
+    serialization.params = params;
+    serialization.size = size;
+    serialization.filePath = published.filePath;
+    serialization.dataOffsetInFile = 0;
+
+    CacheIndex::Entry indexEntry;
+    try {
+        RenderTraceSpan traceSpan(eRenderTraceEventTypeDiskCacheWrite);
+        entry->writeDataToFile(published.filePath);
+        toIndexEntry(serialization, &indexEntry);
+    } catch (const std::exception & e) {
+        qDebug() << "Failed to publish a cache entry:" << e.what();
+        std::remove( published.filePath.c_str() );
+
+        return;
+    }
+    published.record = indexEntry.data;
+    if ( !_sharedIndex.publish(published.hash, published.record) ) {
+        std::remove( published.filePath.c_str() );
+
+        return;
+    }
+
+    std::list<SharedPublishedEntry> withdrawn;
+    {
+        QMutexLocker k(&_sharedPublishedMutex);
+        _sharedPublished.push_back(published);
+        _sharedPublishedBytes += size;
+        while ( (_sharedPublishedBytes > maximumSize) && !_sharedPublished.empty() ) {
+            withdrawn.splice( withdrawn.end(), _sharedPublished, _sharedPublished.begin() );
+            _sharedPublishedBytes -= withdrawn.back().size;
+        }
+    }
+    // The processes that mapped these files keep their data until they release them
+    for (typename std::list<SharedPublishedEntry>::const_iterator it = withdrawn.begin(); it != withdrawn.end(); ++it) {
+        _sharedIndex.unpublish(it->hash, it->record);
+        std::remove( it->filePath.c_str() );
+    }
+} // writeSharedEntry
+
+template<typename EntryType>
+bool
+Cache<EntryType>::getSharedEntries(CacheBucket& bucket,
+                                   const typename EntryType::key_type & key,
+                                   std::list<EntryTypePtr>* returnValue) const
+{
+    std::list<std::string> records;
+
+    _sharedIndex.lookup(key.getHash(), &records);
+
+    const std::string& processFilesPath = _sharedIndex.getProcessFilesPath();
+    for (std::list<std::string>::const_iterator it = records.begin(); it != records.end(); ++it) {
+        SerializedEntry serialization;
+        // Records may be for another key with the same hash, or published by this process
+        if ( !deserializeEntry(*it, &serialization) || !(serialization.key == key) || !serialization.params ||
+             (serialization.filePath.compare(0, processFilesPath.size(), processFilesPath) == 0) ) {
+            continue;
+        }
+
+        EntryTypePtr entry;
+        try {
+            entry.reset( new EntryType(serialization.key, serialization.params, this) );
+            entry->setSharedFile();
+            entry->restoreMetadataFromFile(serialization.size, serialization.filePath, 0);
+            entry->reOpenFileMapping();
+        } catch (const std::exception & e) {
+            // The other process may have withdrawn the entry meanwhile
+            if (entry) {
+                entry->scheduleForDestruction();
+            }
+            continue;
+        }
+        if (entry->dataSize() != serialization.size) {
+            entry->scheduleForDestruction();
+            continue;
+        }
+        bucket.statistics.recordDiskRead( key.getCacheHolderIndex(), entry->getMipMapLevel(), serialization.size );
+        {
+            CacheBucketLocker locker(bucket);
+            sealEntry(bucket, entry, true);
+        }
+        returnValue->push_back(entry);
+        if (_signalEmitter) {
+            _signalEmitter->emitAddedEntry( key.getTime() );
+        }
+    }
+
+    return !returnValue->empty();
+} // getSharedEntries
+
 template<typename EntryType>
 struct Cache<EntryType>::SerializedEntry
 {
@@ -0,0 +1,379 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "CacheStatistics.h"
+
+#include <cassert>
+#include <sstream> // stringstream
+
+#include <QtCore/QMutexLocker>
+
+#include "Engine/Timer.h"
+
+NATRON_NAMESPACE_ENTER
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+const char* const evictionReasonNames[eCacheEvictionReasonCount] = {
+    "evictedToDisk",
+    "evictedCompressed",
+    "evictedDestroyed",
+    "removedFromDisk",
+    "droppedWriteBehindFull",
+};
+
+// Maps the CacheEntryHolder IDs to the indices used by the counters. IDs are never removed: a key of a deleted
+// holder may still be alive and must keep its index.
+struct HolderRegistry
+{
+    QMutex lock;
+    std::map<std::string, int> indices;
+    std::vector<std::string> ids;
+};
+
+HolderRegistry holderRegistry;
+
+std::string
+getHolderID(int holderIndex)
+{
+    QMutexLocker k(&holderRegistry.lock);
+
+    assert( holderIndex >= 0 && holderIndex < (int)holderRegistry.ids.size() );
+
+    return holderRegistry.ids[holderIndex];
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+CacheCounters::CacheCounters()
+    : hits(0)
+    , misses(0)
+    , inserts(0)
+    , bytesReadFromDisk(0)
+    , bytesWrittenToDisk(0)
+{
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        evictions[i] = 0;
+    }
+}
+
+void
+CacheCounters::add(const CacheCounters& other)
+{
+    hits += other.hits;
+    misses += other.misses;
+    inserts += other.inserts;
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        evictions[i] += other.evictions[i];
+    }
+    bytesReadFromDisk += other.bytesReadFromDisk;
+    bytesWrittenToDisk += other.bytesWrittenToDisk;
+}
+
+bool
+CacheCounters::isNull() const
+{
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        if (evictions[i] != 0) {
+            return false;
+        }
+    }
+
+    return hits == 0 && misses == 0 && inserts == 0 && bytesReadFromDisk == 0 && bytesWrittenToDisk == 0;
+}
+
+void
+CacheCounters::print(const std::string& scope,
+                     std::ostream& os) const
+{
+    os << scope << " hits " << hits << '\n';
+    os << scope << " misses " << misses << '\n';
+    os << scope << " inserts " << inserts << '\n';
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        os << scope << ' ' << evictionReasonNames[i] << ' ' << evictions[i] << '\n';
+    }
+    os << scope << " bytesReadFromDisk " << bytesReadFromDisk << '\n';
+    os << scope << " bytesWrittenToDisk " << bytesWrittenToDisk << '\n';
+}
+
+QVariantMap
+CacheCounters::toVariantMap() const
+{
+    QVariantMap ret;
+
+    ret[QString::fromUtf8("hits")] = (qulonglong)hits;
+    ret[QString::fromUtf8("misses")] = (qulonglong)misses;
+    ret[QString::fromUtf8("inserts")] = (qulonglong)inserts;
+    for (int i = 0; i < eCacheEvictionReasonCount; ++i) {
+        ret[QString::fromUtf8(evictionReasonNames[i])] = (qulonglong)evictions[i];
+    }
+    ret[QString::fromUtf8("bytesReadFromDisk")] = (qulonglong)bytesReadFromDisk;
+    ret[QString::fromUtf8("bytesWrittenToDisk")] = (qulonglong)bytesWrittenToDisk;
+
+    return ret;
+}
+
+CacheStatisticsData::CacheStatisticsData()
+    : totals()
+    , lockWaitSeconds(0.)
+    , holders()
+    , mipMapLevels()
+{
+}
+
+void
+CacheStatisticsData::add(const CacheStatisticsData& other)
+{
+    totals.add(other.totals);
+    lockWaitSeconds += other.lockWaitSeconds;
+    for (std::map<std::string, CacheCounters>::const_iterator it = other.holders.begin(); it != other.holders.end(); ++it) {
+        holders[it->first].add(it->second);
+    }
+    for (std::map<unsigned int, CacheCounters>::const_iterator it = other.mipMapLevels.begin(); it != other.mipMapLevels.end(); ++it) {
+        mipMapLevels[it->first].add(it->second);
+    }
+}
+
+void
+CacheStatisticsData::print(const std::string& cacheName,
+                           std::ostream& os) const
+{
+    totals.print(cacheName + " total", os);
+    os << cacheName << " total lockWaitSeconds " << lockWaitSeconds << '\n';
+    for (std::map<std::string, CacheCounters>::const_iterator it = holders.begin(); it != holders.end(); ++it) {
+        it->second.print(cacheName + " node:" + it->first, os);
+    }
+    for (std::map<unsigned int, CacheCounters>::const_iterator it = mipMapLevels.begin(); it != mipMapLevels.end(); ++it) {
+        std::stringstream ss;
+        ss << cacheName << " mipmap:" << it->first;
+        it->second.print(ss.str(), os);
+    }
+}
+
+QVariantMap
+CacheStatisticsData::toVariantMap() const
+{
+    QVariantMap ret;
+    QVariantMap total = totals.toVariantMap();
+
+    total[QString::fromUtf8("lockWaitSeconds")] = lockWaitSeconds;
+    ret[QString::fromUtf8("total")] = total;
+    for (std::map<std::string, CacheCounters>::const_iterator it = holders.begin(); it != holders.end(); ++it) {
+        ret[QString::fromUtf8( ("node:" + it->first).c_str() )] = it->second.toVariantMap();
+    }
+    for (std::map<unsigned int, CacheCounters>::const_iterator it = mipMapLevels.begin(); it != mipMapLevels.end(); ++it) {
+        ret[QString::fromUtf8("mipmap:") + QString::number(it->first)] = it->second.toVariantMap();
+    }
+
+    return ret;
+}
+
+CacheStatistics::CacheStatistics()
+    : _lock()
+    , _totals()
+    , _lockWaitSeconds(0.)
+    , _holders()
+    , _mipMapLevels()
+{
+}
+
+int
+CacheStatistics::getHolderIndex(const std::string& holderID)
+{
+    QMutexLocker k(&holderRegistry.lock);
+    std::map<std::string, int>::iterator found = holderRegistry.indices.find(holderID);
+
+    if ( found != holderRegistry.indices.end() ) {
+        return found->second;
+    }
+    int index = (int)holderRegistry.ids.size();
+    holderRegistry.ids.push_back(holderID);
+    holderRegistry.indices.insert( std::make_pair(holderID, index) );
+
+    return index;
+}
+
+CacheCounters&
+CacheStatistics::getHolderCounters(int holderIndex)
+{
+    assert(holderIndex >= 0);
+    if ( holderIndex >= (int)_holders.size() ) {
+        _holders.resize(holderIndex + 1);
+    }
+
+    return _holders[holderIndex];
+}
+
+void
+CacheStatistics::recordLookup(int holderIndex,
+                              int mipMapLevel,
+                              bool hit)
+{
+    QMutexLocker k(&_lock);
+    CacheCounters& holder = getHolderCounters(holderIndex);
+
+    if (hit) {
+        ++_totals.hits;
+        ++holder.hits;
+        if (mipMapLevel >= 0) {
+            ++_mipMapLevels[mipMapLevel].hits;
+        }
+    } else {
+        ++_totals.misses;
+        ++holder.misses;
+        if (mipMapLevel >= 0) {
+            ++_mipMapLevels[mipMapLevel].misses;
+        }
+    }
+}
+
+void
+CacheStatistics::recordHit(unsigned int mipMapLevel)
+{
+    QMutexLocker k(&_lock);
+
+    ++_mipMapLevels[mipMapLevel].hits;
+}
+
+void
+CacheStatistics::recordInsert(int holderIndex,
+                              unsigned int mipMapLevel)
+{
+    QMutexLocker k(&_lock);
+
+    ++_totals.inserts;
+    ++getHolderCounters(holderIndex).inserts;
+    ++_mipMapLevels[mipMapLevel].inserts;
+}
+
+void
+CacheStatistics::recordEvictions(const CacheEvictionRecords& evictions)
+{
+    QMutexLocker k(&_lock);
+
+    for (CacheEvictionRecords::const_iterator it = evictions.begin(); it != evictions.end(); ++it) {
+        ++_totals.evictions[it->reason];
+        ++getHolderCounters(it->holderIndex).evictions[it->reason];
+        ++_mipMapLevels[it->mipMapLevel].evictions[it->reason];
+    }
+}
+
+void
+CacheStatistics::recordDiskRead(int holderIndex,
+                                unsigned int mipMapLevel,
+                                U64 bytes)
+{
+    QMutexLocker k(&_lock);
+
+    _totals.bytesReadFromDisk += bytes;
+    getHolderCounters(holderIndex).bytesReadFromDisk += bytes;
+    _mipMapLevels[mipMapLevel].bytesReadFromDisk += bytes;
+}
+
+void
+CacheStatistics::recordDiskWrite(int holderIndex,
+                                 unsigned int mipMapLevel,
+                                 U64 bytes)
+{
+    QMutexLocker k(&_lock);
+
+    _totals.bytesWrittenToDisk += bytes;
+    getHolderCounters(holderIndex).bytesWrittenToDisk += bytes;
+    _mipMapLevels[mipMapLevel].bytesWrittenToDisk += bytes;
+}
+
+void
+CacheStatistics::recordLockWait(double seconds)
+{
+    QMutexLocker k(&_lock);
+
+    _lockWaitSeconds += seconds;
+}
+
+void
+CacheStatistics::removeHolder(int holderIndex)
+{
+    QMutexLocker k(&_lock);
+
+    if ( holderIndex < (int)_holders.size() ) {
+        _holders[holderIndex] = CacheCounters();
+    }
+}
+
+void
+CacheStatistics::accumulate(CacheStatisticsData* data) const
+{
+    QMutexLocker k(&_lock);
+
+    data->totals.add(_totals);
+    data->lockWaitSeconds += _lockWaitSeconds;
+    for (std::size_t i = 0; i < _holders.size(); ++i) {
+        if ( !_holders[i].isNull() ) {
+            data->holders[getHolderID(i)].add(_holders[i]);
+        }
+    }
+    for (std::map<unsigned int, CacheCounters>::const_iterator it = _mipMapLevels.begin(); it != _mipMapLevels.end(); ++it) {
+        data->mipMapLevels[it->first].add(it->second);
+    }
+}
+
+void
+CacheStatistics::reset()
+{
+    QMutexLocker k(&_lock);
+
+    _totals = CacheCounters();
+    _lockWaitSeconds = 0.;
+    _holders.clear();
+    _mipMapLevels.clear();
+}
+
+CacheStatisticsMutexLocker::CacheStatisticsMutexLocker(QMutex* mutex,
+                                                       CacheStatistics* statistics)
+    : _mutex(mutex)
+    , _locked(true)
+{
+    if ( !_mutex->tryLock() ) {
+        TimeLapse timer;
+        _mutex->lock();
+        statistics->recordLockWait( timer.getTimeSinceCreation() );
+    }
+}
+
+CacheStatisticsMutexLocker::~CacheStatisticsMutexLocker()
+{
+    unlock();
+}
+
+void
+CacheStatisticsMutexLocker::unlock()
+{
+    if (_locked) {
+        _mutex->unlock();
+        _locked = false;
+    }
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,217 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_CACHESTATISTICS_H
+#define NATRON_ENGINE_CACHESTATISTICS_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <QtCore/QMutex>
+#include <QtCore/QVariant>
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Why an entry left the in-memory or the disk portion of a cache.
+ **/
+enum CacheEvictionReasonEnum
+{
+    // The entry is stored on disk and was moved from the in-memory portion to the disk portion
+    eCacheEvictionReasonMovedToDisk = 0,
+
+    // The entry is kept compressed in RAM
+    eCacheEvictionReasonCompressed,
+
+    // The entry was destroyed from the in-memory portion, compressed or not
+    eCacheEvictionReasonDestroyed,
+
+    // The entry was destroyed from the disk portion and its file removed
+    eCacheEvictionReasonRemovedFromDisk,
+
+    // The entry should have been moved to disk but too much data were waiting to be written
+    eCacheEvictionReasonWriteBehindFull,
+
+    eCacheEvictionReasonCount
+};
+
+struct CacheCounters
+{
+    // Lookups that returned entries and lookups that did not
+    U64 hits;
+    U64 misses;
+
+    // Entries created by the cache
+    U64 inserts;
+    U64 evictions[eCacheEvictionReasonCount];
+    U64 bytesReadFromDisk;
+    U64 bytesWrittenToDisk;
+
+    CacheCounters();
+
+    void add(const CacheCounters& other);
+
+    bool isNull() const;
+
+    /**
+     * @brief Prints one line per counter, prefixed by the given scope
+     **/
+    void print(const std::string& scope, std::ostream& os) const;
+
+    /**
+     * @brief Returns the counters by name, the names are the ones used by print()
+     **/
+    QVariantMap toVariantMap() const;
+};
+
+/**
+ * @brief An eviction found while a bucket of the cache is locked, recorded once it is unlocked.
+ **/
+struct CacheEvictionRecord
+{
+    int holderIndex;
+    unsigned int mipMapLevel;
+    CacheEvictionReasonEnum reason;
+};
+
+typedef std::vector<CacheEvictionRecord> CacheEvictionRecords;
+
+struct CacheStatisticsData
+{
+    CacheCounters totals;
+
+    // Time spent waiting for the locks of the cache by lookups
+    double lockWaitSeconds;
+
+    // Counters per CacheEntryHolder, e.g: per node
+    std::map<std::string, CacheCounters> holders;
+
+    // Counters per mip-map level. Lookups are counted at the level requested when the caller gives it,
+    // otherwise the hits count the levels of the entries returned and misses are not broken down.
+    std::map<unsigned int, CacheCounters> mipMapLevels;
+
+    CacheStatisticsData();
+
+    void add(const CacheStatisticsData& other);
+
+    /**
+     * @brief Prints one line per counter, in the form "<cacheName> <scope> <counter> <value>".
+     * The scope is "total", "node:<holderID>" or "mipmap:<level>".
+     **/
+    void print(const std::string& cacheName, std::ostream& os) const;
+
+    /**
+     * @brief Returns the counters in a map whose keys are the scopes used by print(), each scope
+     * being itself a map of the counters, see CacheCounters::toVariantMap().
+     **/
+    QVariantMap toVariantMap() const;
+};
+
+/**
+ * @brief Counters of a cache bucket, see Cache::getStatistics(). All functions are MT-safe.
+ **/
+class CacheStatistics
+{
+public:
+
+    CacheStatistics();
+
+    /**
+     * @brief Returns the index of the given CacheEntryHolder ID in the counters. A given ID always has the same index,
+     * keys compute it once, see KeyHelper::getCacheHolderIndex().
+     **/
+    static int getHolderIndex(const std::string& holderID);
+
+    /**
+     * @param mipMapLevel The mip-map level requested by the lookup or -1 if unknown.
+     **/
+    void recordLookup(int holderIndex, int mipMapLevel, bool hit);
+
+    /**
+     * @brief Counts the hit of a lookup whose mip-map level was unknown at the level of an entry returned
+     **/
+    void recordHit(unsigned int mipMapLevel);
+    void recordInsert(int holderIndex, unsigned int mipMapLevel);
+    void recordEvictions(const CacheEvictionRecords& evictions);
+    void recordDiskRead(int holderIndex, unsigned int mipMapLevel, U64 bytes);
+    void recordDiskWrite(int holderIndex, unsigned int mipMapLevel, U64 bytes);
+    void recordLockWait(double seconds);
+
+    /**
+     * @brief Discards the counters of a holder, once all its entries are removed from the cache.
+     **/
+    void removeHolder(int holderIndex);
+
+    /**
+     * @brief Adds the counters to data
+     **/
+    void accumulate(CacheStatisticsData* data) const;
+
+    void reset();
+
+private:
+
+    CacheCounters& getHolderCounters(int holderIndex);
+
+    mutable QMutex _lock;
+    CacheCounters _totals;
+    double _lockWaitSeconds;
+
+    // Indexed by the holder index
+    std::vector<CacheCounters> _holders;
+    std::map<unsigned int, CacheCounters> _mipMapLevels;
+};
+
+/**
+ * @brief Same as QMutexLocker, but the time spent waiting for the mutex is recorded in the statistics.
+ * The uncontended case does not read the clock.
+ **/
+class CacheStatisticsMutexLocker
+{
+public:
+
+    CacheStatisticsMutexLocker(QMutex* mutex,
+                               CacheStatistics* statistics);
+
+    ~CacheStatisticsMutexLocker();
+
+    void unlock();
+
+private:
+
+    QMutex* _mutex;
+    bool _locked;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_CACHESTATISTICS_H
@@ -59,6 +59,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/DiskCacheNode.h"
 #include "Engine/Image.h"
 #include "Engine/ImageParams.h"
+#include "Engine/ImageTiles.h"
 #include "Engine/KnobFile.h"
 #include "Engine/KnobTypes.h"
 #include "Engine/Log.h"
@@ -77,6 +78,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/RotoDrawableItem.h"
 #include "Engine/ReadNode.h"
 #include "Engine/Settings.h"
+#include "Engine/ThreadPool.h"
 #include "Engine/Timer.h"
 #include "Engine/Transform.h"
 #include "Engine/UndoCommand.h"
@@ -845,6 +847,7 @@ EffectInstance::getImage(int inputNb,
     EffectInstance::InputImagesMap inputImagesThreadLocal;
     OSGLContextPtr glContext;
     AbortableRenderInfoPtr renderInfo;
+    RenderStatsPtr stats;
     if ( !tls || ( !tls->currentRenderArgs.validArgs && tls->frameArgs.empty() ) ) {
         /*
            This is either a huge bug or an unknown thread that called clipGetImage from the OpenFX plug-in.
@@ -876,6 +879,7 @@ EffectInstance::getImage(int inputNb,
             isAnalysisPass = frameRenderArgs->isAnalysis;
             glContext = frameRenderArgs->openGLContext.lock();
             renderInfo = frameRenderArgs->abortInfo.lock();
+            stats = frameRenderArgs->stats;
         } else {
             //This is a bug, when entering here, frameArgs TLS should always have been set, except for unknown threads.
             nodeHash = getHash();
@@ -1055,7 +1059,7 @@ EffectInstance::getImage(int inputNb,
         }
 
         if (mapToClipPrefs) {
-            inputImg = convertPlanesFormatsIfNeeded(getApp(), inputImg, pixelRoI, clipPrefComps, depth, node->usesAlpha0ToConvertFromRGBToRGBA(), eImagePremultiplicationPremultiplied, channelForMask);
+            inputImg = convertPlanesFormatsIfNeeded(getApp(), inputImg, pixelRoI, clipPrefComps, depth, node->usesAlpha0ToConvertFromRGBToRGBA(), eImagePremultiplicationPremultiplied, channelForMask, stats, node);
         }
 
         return inputImg;
@@ -1151,7 +1155,7 @@ EffectInstance::getImage(int inputNb,
 
 
     if (mapToClipPrefs) {
-        inputImg = convertPlanesFormatsIfNeeded(getApp(), inputImg, pixelRoI, clipPrefComps, depth, node->usesAlpha0ToConvertFromRGBToRGBA(), outputPremult, channelForMask);
+        inputImg = convertPlanesFormatsIfNeeded(getApp(), inputImg, pixelRoI, clipPrefComps, depth, node->usesAlpha0ToConvertFromRGBToRGBA(), outputPremult, channelForMask, stats, node);
     }
 
 #ifdef DEBUG
@@ -1482,7 +1486,13 @@ getOrCreateFromCacheInternal(const ImageKey & key,
     } else {
         assert(params->getStorageInfo().mode != eStorageModeGLTex);
 
-        if (params->getStorageInfo().mode == eStorageModeRAM) {
+        if ( (params->getStorageInfo().mode == eStorageModeRAM) && appPTR->isNodeCacheTiled() ) {
+            // The image is rendered outside of the cache, its tiles are stored in the cache once rendered, see ImageTiles
+            *image = boost::make_shared<Image>( key, params, (const CacheAPI*)0 );
+            (*image)->allocateMemory();
+
+            return;
+        } else if (params->getStorageInfo().mode == eStorageModeRAM) {
             appPTR->getImageOrCreate(key, params, image);
         } else if (params->getStorageInfo().mode == eStorageModeDisk) {
             appPTR->getImageOrCreate_diskCache(key, params, image);
@@ -1640,28 +1650,42 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool /*useCache*/,
     ImageList cachedImages;
     bool isCached = false;
 
-    ///Find first something in the input images list
-    if ( !inputImages.empty() ) {
-        for (InputImagesMap::const_iterator it = inputImages.begin(); it != inputImages.end(); ++it) {
-            for (ImageList::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
-                if ( !it2->get() ) {
-                    continue;
-                }
-                const ImageKey & imgKey = (*it2)->getKey();
-                if (imgKey == key) {
-                    cachedImages.push_back(*it2);
-                    isCached = true;
+    {
+        RenderTraceSpan traceSpan(stats, getNode(), eRenderTraceEventTypeCacheLookup);
+
+        ///Find first something in the input images list
+        if ( !inputImages.empty() ) {
+            for (InputImagesMap::const_iterator it = inputImages.begin(); it != inputImages.end(); ++it) {
+                for (ImageList::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
+                    if ( !it2->get() ) {
+                        continue;
+                    }
+                    const ImageKey & imgKey = (*it2)->getKey();
+                    if (imgKey == key) {
+                        cachedImages.push_back(*it2);
+                        isCached = true;
+                    }
                 }
             }
         }
-    }
 
-    if (!isCached) {
-        // For textures, we lookup for a RAM image, if found we convert it to a texture
-        if ( (storage == eStorageModeRAM) || (storage == eStorageModeGLTex) ) {
-            isCached = appPTR->getImage(key, &cachedImages);
-        } else if (storage == eStorageModeDisk) {
-            isCached = appPTR->getImage_diskCache(key, &cachedImages);
+        if (!isCached) {
+            // For textures, we lookup for a RAM image, if found we convert it to a texture
+            if ( (storage == eStorageModeRAM) || (storage == eStorageModeGLTex) ) {
+                isCached = appPTR->getImage(key, &cachedImages, mipMapLevel);
+            } else if (storage == eStorageModeDisk) {
+                RenderTraceSpan diskTraceSpan(stats, getNode(), eRenderTraceEventTypeDiskCacheIO);
+                isCached = appPTR->getImage_diskCache(key, &cachedImages, mipMapLevel);
+            }
+        }
+
+        if ( !isCached && ( (storage == eStorageModeRAM) || (storage == eStorageModeGLTex) ) && appPTR->isNodeCacheTiled() ) {
+            // Gather the cached tiles, the bitmap of the image tells which parts remain to render
+            ImagePtr assembledImage = ImageTiles::assemble(key, mipMapLevel, boundsParam ? *boundsParam : roi, roi, rodParam, components, bitdepth);
+            if (assembledImage) {
+                cachedImages.push_back(assembledImage);
+                isCached = true;
+            }
         }
     }
 
@@ -1733,6 +1757,7 @@ EffectInstance::getImageFromCacheAndConvertIfNeeded(bool /*useCache*/,
 
 
             if (imageToConvert->getMipMapLevel() != mipMapLevel) {
+                RenderTraceSpan traceSpan(stats, getNode(), eRenderTraceEventTypeImageConversion);
                 ImageParamsPtr oldParams = imageToConvert->getParams();
 
                 assert(imageToConvert->getMipMapLevel() < mipMapLevel);
@@ -2152,8 +2177,14 @@ EffectInstance::Implementation::tiledRenderingFunctor(EffectInstance::Implementa
     if (callingThread != curThread) {
         ///We are in the case of host frame threading, see kOfxImageEffectPluginPropHostFrameThreading
         ///We know that in the renderAction, TLS will be needed, so we do a deep copy of the TLS from the caller thread
-        ///to this thread
-        appPTR->getAppTLS()->copyTLS(callingThread, curThread);
+        ///to this thread.
+        ///The caller thread renders tiles too, so its TLS may be modified at any time: copy the snapshot taken before
+        ///it started instead.
+        if (args.tlsSnapshot) {
+            args.tlsSnapshot->copyTo(curThread);
+        } else {
+            appPTR->getAppTLS()->copyTLS(callingThread, curThread);
+        }
     }
 
 
@@ -2177,8 +2208,11 @@ EffectInstance::Implementation::tiledRenderingFunctor(EffectInstance::Implementa
                                                                         args.processChannels,
                                                                         args.planes);
 
-    //Exit of the host frame threading thread
-    appPTR->getAppTLS()->cleanupTLSForThread();
+    //Exit of the host frame threading thread. The calling thread also runs tiles while it waits for the others,
+    //its TLS is still needed by the render that spawned the tiles.
+    if (callingThread != curThread) {
+        appPTR->getAppTLS()->cleanupTLSForThread();
+    }
 
     return ret;
 }
@@ -2398,13 +2432,10 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
                                               const ImagePremultiplicationEnum originalImagePremultiplication,
                                               ImagePlanesToRender & planes)
 {
-    TimeLapsePtr timeRecorder;
+    // The render time is also recorded on the output images, for the cost-aware eviction policy of the cache
+    TimeLapsePtr timeRecorder = boost::make_shared<TimeLapse>();
     const ParallelRenderArgsPtr& frameArgs = tls->frameArgs.back();
 
-    if (frameArgs->stats) {
-        timeRecorder = boost::make_shared<TimeLapse>();
-    }
-
     const EffectInstance::PlaneToRender & firstPlane = planes.planes.begin()->second;
     const double time = tls->currentRenderArgs.time;
     const ViewIdx view = tls->currentRenderArgs.view;
@@ -2532,6 +2563,7 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
                         ///Convert format first if needed
                         ImagePtr sourceImage;
                         if ( ( it->second.fullscaleImage->getComponents() != idIt->second->getComponents() ) || ( it->second.fullscaleImage->getBitDepth() != idIt->second->getBitDepth() ) ) {
+                            RenderTraceSpan traceSpan(frameArgs->stats, _publicInterface->getNode(), eRenderTraceEventTypeImageConversion);
                             sourceImage = boost::make_shared<Image>(it->second.fullscaleImage->getComponents(),
                                                                     idIt->second->getRoD(),
                                                                     idIt->second->getBounds(),
@@ -2572,6 +2604,7 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
 
                         ///Convert format if needed or copy
                         if ( ( it->second.downscaleImage->getComponents() != idIt->second->getComponents() ) || ( it->second.downscaleImage->getBitDepth() != idIt->second->getBitDepth() ) ) {
+                            RenderTraceSpan traceSpan(frameArgs->stats, _publicInterface->getNode(), eRenderTraceEventTypeImageConversion);
                             ViewerColorSpaceEnum colorspace = _publicInterface->getApp()->getDefaultColorSpaceForBitDepth( idIt->second->getBitDepth() );
                             ViewerColorSpaceEnum dstColorspace = _publicInterface->getApp()->getDefaultColorSpaceForBitDepth( it->second.fullscaleImage->getBitDepth() );
                             RectI convertWindow;
@@ -2696,7 +2729,11 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
             }
         }
 
-        StatusEnum st = _publicInterface->render_public(actionArgs);
+        StatusEnum st;
+        {
+            RenderTraceSpan traceSpan(frameArgs->stats, _publicInterface->getNode(), eRenderTraceEventTypeRenderAction);
+            st = _publicInterface->render_public(actionArgs);
+        }
 
         if (planes.useOpenGL) {
             glDisable(GL_SCISSOR_TEST);
@@ -2782,6 +2819,7 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
 
                 if ( ( it->second.renderMappedImage->getComponents() != it->second.tmpImage->getComponents() ) ||
                      ( it->second.renderMappedImage->getBitDepth() != it->second.tmpImage->getBitDepth() ) ) {
+                    RenderTraceSpan traceSpan(frameArgs->stats, _publicInterface->getNode(), eRenderTraceEventTypeImageConversion);
                     it->second.tmpImage->convertToFormat( it->second.tmpImage->getBounds(),
                                                           _publicInterface->getApp()->getDefaultColorSpaceForBitDepth( it->second.tmpImage->getBitDepth() ),
                                                           _publicInterface->getApp()->getDefaultColorSpaceForBitDepth( it->second.renderMappedImage->getBitDepth() ),
@@ -2824,16 +2862,15 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
                 }
 
                 if (mappedOriginalInputImage) {
-                    it->second.tmpImage->copyUnProcessedChannels(renderMappedRectToRender, planes.outputPremult, originalImagePremultiplication, processChannels, mappedOriginalInputImage, true);
-                    if (useMaskMix) {
-                        it->second.tmpImage->applyMaskMix(renderMappedRectToRender, maskImage.get(), mappedOriginalInputImage.get(), doMask, false, mix);
-                    }
+                    it->second.tmpImage->copyUnProcessedChannelsAndApplyMaskMix(renderMappedRectToRender, planes.outputPremult, originalImagePremultiplication, processChannels, mappedOriginalInputImage, true,
+                                                                                 useMaskMix, maskImage.get(), doMask, false, mix);
                 }
                 if ( ( it->second.fullscaleImage->getComponents() != it->second.tmpImage->getComponents() ) ||
                      ( it->second.fullscaleImage->getBitDepth() != it->second.tmpImage->getBitDepth() ) ) {
                     /*
                      * BitDepth/Components conversion required as well as downscaling, do conversion to a tmp buffer
                      */
+                    RenderTraceSpan traceSpan(frameArgs->stats, _publicInterface->getNode(), eRenderTraceEventTypeImageConversion);
 #ifdef BOOST_NO_CXX11_VARIADIC_TEMPLATES
                     ImagePtr tmp( new Image(it->second.fullscaleImage->getComponents(),
                                             it->second.tmpImage->getRoD(),
@@ -2867,6 +2904,7 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
                     /*
                      *  Downscaling required only
                      */
+                    RenderTraceSpan traceSpan(frameArgs->stats, _publicInterface->getNode(), eRenderTraceEventTypeImageConversion);
                     it->second.tmpImage->downscaleMipMap( it->second.tmpImage->getRoD(),
                                                           actionArgs.roi, 0, mipMapLevel, false, it->second.downscaleImage.get() );
                     if (it->second.tmpImage != it->second.fullscaleImage) {
@@ -2886,7 +2924,7 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
                         /*
                          * BitDepth/Components conversion required
                          */
-
+                        RenderTraceSpan traceSpan(frameArgs->stats, _publicInterface->getNode(), eRenderTraceEventTypeImageConversion);
 
                         it->second.tmpImage->convertToFormat( it->second.tmpImage->getBounds(),
                                                               _publicInterface->getApp()->getDefaultColorSpaceForBitDepth( it->second.tmpImage->getBitDepth() ),
@@ -2901,15 +2939,23 @@ EffectInstance::Implementation::renderHandler(const EffectTLSDataPtr& tls,
                     }
                 }
 
-                it->second.downscaleImage->copyUnProcessedChannels(actionArgs.roi, planes.outputPremult, originalImagePremultiplication, processChannels, originalInputImage, true, glContext);
-                if (useMaskMix) {
-                    it->second.downscaleImage->applyMaskMix(actionArgs.roi, maskImage.get(), originalInputImage.get(), doMask, false, mix, glContext);
-                }
+                it->second.downscaleImage->copyUnProcessedChannelsAndApplyMaskMix(actionArgs.roi, planes.outputPremult, originalImagePremultiplication, processChannels, originalInputImage, true,
+                                                                                  useMaskMix, maskImage.get(), doMask, false, mix, glContext);
             } // if (renderFullScaleThenDownscale) {
         } // if (it->second.isAllocatedOnTheFly) {
 
+        double timeSpent = timeRecorder->getTimeSinceCreation();
+
+        ///The images are shared with the cache: the longer they took to render, the longer they are kept in it
+        if (it->second.fullscaleImage) {
+            it->second.fullscaleImage->addComputationCost(timeSpent);
+        }
+        if ( it->second.downscaleImage && (it->second.downscaleImage != it->second.fullscaleImage) ) {
+            it->second.downscaleImage->addComputationCost(timeSpent);
+        }
+
         if ( frameArgs->stats && frameArgs->stats->isInDepthProfilingEnabled() ) {
-            frameArgs->stats->addRenderInfosForNode( _publicInterface->getNode(),  NodePtr(), it->first.getChannelsLabel(), renderMappedRectToRender, timeRecorder->getTimeSinceCreation() );
+            frameArgs->stats->addRenderInfosForNode( _publicInterface->getNode(),  NodePtr(), it->first.getChannelsLabel(), renderMappedRectToRender, timeSpent );
         }
     } // for (std::map<ImagePlaneDesc,PlaneToRender>::const_iterator it = outputPlanes.begin(); it != outputPlanes.end(); ++it) {
 
@@ -3057,11 +3103,26 @@ EffectInstance::onSignificantEvaluateAboutToBeCalled(KnobI* knob)
     if (isMT) {
         node->refreshIdentityState();
 
+        //A NULL knob means that anything may have changed
+        if (!knob) {
+            node->invalidateKnobContentHash(0);
+        }
+
         //Increments the knobs age following a change
         node->incrementKnobsAge();
     }
 }
 
+void
+EffectInstance::onKnobValueChangeRegistered(KnobI* knob)
+{
+    NodePtr node = getNode();
+
+    if (node) {
+        node->invalidateKnobContentHash(knob);
+    }
+}
+
 void
 EffectInstance::evaluate(bool isSignificant,
                          bool refreshMetadatas)
@@ -3906,6 +3967,8 @@ EffectInstance::getRegionOfDefinition_public(U64 hash,
         RenderScale scaleOne(1.);
         {
             RECURSIVE_ACTION();
+            ParallelRenderArgsPtr frameArgs = getParallelRenderArgsTLS();
+            RenderTraceSpan traceSpan(frameArgs ? frameArgs->stats : RenderStatsPtr(), getNode(), eRenderTraceEventTypeGetRegionOfDefinition);
 
 
             ret = getRegionOfDefinition(hash, time, supportsRenderScaleMaybe() == eSupportsNo ? scaleOne : scale, view, rod);
@@ -4884,6 +4947,7 @@ EffectInstance::aboutToRestoreDefaultValues()
     ///Invalidate the cache by incrementing the age
     NodePtr node = getNode();
 
+    node->invalidateKnobContentHash(0);
     node->incrementKnobsAge();
 
     if ( node->areKeyframesVisibleOnTimeline() ) {
@@ -5423,7 +5487,9 @@ EffectInstance::getDefaultMetadata(NodeMetadata &metadata)
         if (input) {
             //Update deepest bitdepth and most components only if the infos are relevant, i.e: only if the clip is connected
             hasSetCompsAndDepth = true;
-            if ( getSizeOfForBitDepth(deepestBitDepth) < getSizeOfForBitDepth(rawDepth) ) {
+            // half and short have the same size, but half has the range of float
+            if ( ( getSizeOfForBitDepth(deepestBitDepth) < getSizeOfForBitDepth(rawDepth) ) ||
+                 ( (deepestBitDepth == eImageBitDepthShort) && (rawDepth == eImageBitDepthHalf) ) ) {
                 deepestBitDepth = rawDepth;
             }
 
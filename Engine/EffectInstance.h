@@ -2189,7 +2189,9 @@ private:
                                                                  ImageBitDepthEnum targetDepth,
                                                                  bool useAlpha0ForRGBToRGBAConversion,
                                                                  ImagePremultiplicationEnum outputPremult,
-                                                                 int channelForAlpha);
+                                                                 int channelForAlpha,
+                                                                 const RenderStatsPtr& stats,
+                                                                 const NodePtr& node);
 
 
     /**
@@ -2229,6 +2231,7 @@ private:
 
 
     virtual void onSignificantEvaluateAboutToBeCalled(KnobI* knob) OVERRIDE FINAL;
+    virtual void onKnobValueChangeRegistered(KnobI* knob) OVERRIDE FINAL;
     virtual void onAllKnobsSlaved(bool isSlave, KnobHolder* master) OVERRIDE FINAL;
     enum RenderingFunctorRetEnum
     {
@@ -335,6 +335,7 @@ public:
         bool byPassCache;
         std::bitset<4> processChannels;
         ImagePlanesToRenderPtr planes;
+        const TLSSnapshot* tlsSnapshot; // copy of the TLS of the calling thread, taken before it started rendering tiles
     };
 
     RenderingFunctorRetEnum tiledRenderingFunctor(TiledRenderingFunctorArgs & args,  const RectToRender & specificData,
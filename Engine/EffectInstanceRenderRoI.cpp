@@ -39,7 +39,6 @@
 #include <QtCore/QThreadPool>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QCoreApplication>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
 #include <QtConcurrentRun> // QtCore on Qt4, QtConcurrent on Qt5
 
 #if !defined(SBK_RUN) && !defined(Q_MOC_RUN)
@@ -51,6 +50,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 
 #include "Global/QtCompat.h"
 
+#include "Engine/AdaptiveTileSplitter.h"
 #include "Engine/AppInstance.h"
 #include "Engine/AppManager.h"
 #include "Engine/BlockingBackgroundRender.h"
@@ -58,6 +58,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/Cache.h"
 #include "Engine/Image.h"
 #include "Engine/ImageParams.h"
+#include "Engine/ImageTiles.h"
 #include "Engine/KnobFile.h"
 #include "Engine/KnobTypes.h"
 #include "Engine/Log.h"
@@ -79,12 +80,28 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/ThreadPool.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/ViewerInstance.h"
+#include "Engine/WorkStealingScheduler.h"
 
 //#define NATRON_ALWAYS_ALLOCATE_FULL_IMAGE_BOUNDS
 
 
 NATRON_NAMESPACE_ENTER
 
+/*
+ * @brief Runs the render of one tile and stores its return code, for the tasks of the work-stealing scheduler
+ */
+template <typename RET>
+static void
+storeTiledRenderingFunctorRet(const boost::function<RET ()>& functor,
+                              RET* ret,
+                              double* timeSpent)
+{
+    TimeLapse timeRecorder;
+
+    *ret = functor();
+    *timeSpent = timeRecorder.getTimeSinceCreation();
+}
+
 /*
  * @brief Split all rects to render in smaller rects and check if each one of them is identity.
  * For identity rectangles, we just call renderRoI again on the identity input in the tiledRenderingFunctor.
@@ -172,7 +189,9 @@ EffectInstance::convertPlanesFormatsIfNeeded(const AppInstancePtr& app,
                                              ImageBitDepthEnum targetDepth,
                                              bool useAlpha0ForRGBToRGBAConversion,
                                              ImagePremultiplicationEnum outputPremult,
-                                             int channelForAlpha)
+                                             int channelForAlpha,
+                                             const RenderStatsPtr& stats,
+                                             const NodePtr& node)
 {
     // Do not do any conversion for OpenGL textures, OpenGL is managing it for us.
     if (inputImage->getStorageMode() == eStorageModeGLTex) {
@@ -183,6 +202,8 @@ EffectInstance::convertPlanesFormatsIfNeeded(const AppInstancePtr& app,
     if (!imageConversionNeeded) {
         return inputImage;
     } else {
+        RenderTraceSpan traceSpan(stats, node, eRenderTraceEventTypeImageConversion);
+
         /**
          * Lock the downscaled image so it cannot be resized while creating the temp image and calling convertToFormat.
          **/
@@ -375,6 +396,8 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         assert(!frameArgs->request || frameArgs->nodeHash == frameArgs->request->nodeHash);
     }
 
+    RenderTraceSpan traceSpan(frameArgs->stats, getNode(), eRenderTraceEventTypeRenderRoI);
+
     ///For writer we never want to cache otherwise the next time we want to render it will skip writing the image on disk!
     bool byPassCache = args.byPassCache;
 
@@ -700,7 +723,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
                                 premult = eImagePremultiplicationOpaque;
                             }
 
-                            ImagePtr tmp = convertPlanesFormatsIfNeeded(app, it->second, args.roi, *compIt, inputArgs->bitdepth, useAlpha0ForRGBToRGBAConversion, premult, -1);
+                            ImagePtr tmp = convertPlanesFormatsIfNeeded(app, it->second, args.roi, *compIt, inputArgs->bitdepth, useAlpha0ForRGBToRGBAConversion, premult, -1, frameArgs->stats, getNode());
                             assert(tmp);
                             convertedPlanes[it->first] = tmp;
                         }
@@ -893,6 +916,10 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
     } else {
         // in Analysis, the node upstream of the analysis node should always cache
         createInCache = (frameArgs->isAnalysis && frameArgs->treeRoot->getEffectInstance().get() == args.caller) ? true : shouldCacheOutput(isFrameVaryingOrAnimated, args.time, args.view, frameArgs->visitsCount);
+        // Images pre-rendered by the RenderTaskGraph are picked up from the cache by the render of their outputs
+        if (!createInCache && requestPassData && requestPassData->finalData.isPreRendered) {
+            createInCache = true;
+        }
     }
     ///Do we want to render the graph upstream at scale 1 or at the requested render scale ? (user setting)
     bool renderScaleOneUpstreamIfRenderScaleSupportDisabled = getNode()->useScaleOneImagesWhenRenderScaleSupportIsDisabled();
@@ -1267,9 +1294,10 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         // If the plug-in is eRenderSafetyFullySafeFrame that means it wants the host to perform SMP aka slice up the RoI into chunks
         // but if the effect doesn't support tiles it won't work.
         // Also check that the number of threads indicating by the settings are appropriate for this render mode.
+        // The tiles are run by the work-stealing scheduler, which does not need to fall back to a serial render
+        // when the thread pool is saturated by nested renders.
         if ( !frameArgs->tilesSupported || (nbThreads == -1) || (nbThreads == 1) ||
-            ( (nbThreads == 0) && (appPTR->getHardwareIdealThreadCount() == 1) ) ||
-            ( QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount() )) {
+            ( (nbThreads == 0) && (appPTR->getHardwareIdealThreadCount() == 1) ) ) {
             safety = eRenderSafetyFullySafe;
         }
     }
@@ -1379,6 +1407,29 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         }
     }
 
+    /*
+     * If the plug-in wants host frame threading, split the rectangles in tiles rendered by different threads.
+     * This is done once the input images are fetched: they are shared by the tiles of a rectangle.
+     * When rendering at full scale then downscaling, tiles would have to be aligned on the mipmap level, do not split.
+     */
+    if ( (safety == eRenderSafetyFullySafeFrame) && !planesToRender->useOpenGL && !renderFullScaleThenDownscale ) {
+        const int nThreads = appPTR->getRenderScheduler()->getMaxWorkerCount();
+        const std::string pluginID = getPluginID();
+        std::list<RectToRender> tiles;
+        for (std::list<RectToRender>::const_iterator it = planesToRender->rectsToRender.begin(); it != planesToRender->rectsToRender.end(); ++it) {
+            if (it->isIdentity) {
+                tiles.push_back(*it);
+                continue;
+            }
+            std::vector<RectI> splits = appPTR->getTileSplitter()->splitRect(pluginID, it->rect, nThreads);
+            for (std::vector<RectI>::const_iterator it2 = splits.begin(); it2 != splits.end(); ++it2) {
+                tiles.push_back(*it);
+                tiles.back().rect = *it2;
+            }
+        }
+        planesToRender->rectsToRender.swap(tiles);
+    }
+
     ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
     ////////////////////////////// End Pre-render input images ////////////////////////////////////////////////////////////
 
@@ -1432,6 +1483,13 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
                                    &it->second.fullscaleImage,
                                    &it->second.downscaleImage);
             } else {
+                if ( ImageTiles::isTile(it->second.fullscaleImage) ) {
+                    // A tile of the node cache was handed out by the cache lookup, render the rest in a copy of it
+                    it->second.fullscaleImage = ImageTiles::detach(it->second.fullscaleImage,
+                                                                   renderFullScaleThenDownscale ? upscaledImageBounds : downscaledImageBounds);
+                    it->second.downscaleImage = it->second.fullscaleImage;
+                }
+
                 /*
                  * There might be a situation  where the RoD of the cached image
                  * is not the same as this RoD even though the hash is the same.
@@ -1752,6 +1810,22 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
             }
         }
 
+        // In tiled mode the images were rendered outside of the cache, store the tiles this render completed
+        if ( createInCache && hasSomethingToRender && (renderRetCode != eRenderRoIStatusRenderFailed) && appPTR->isNodeCacheTiled() ) {
+            ImageTiles::store(it->second.fullscaleImage);
+            if (it->second.downscaleImage != it->second.fullscaleImage) {
+                ImageTiles::store(it->second.downscaleImage);
+            }
+        }
+
+        // Let the other processes sharing the node cache read the images this render completed
+        if ( hasSomethingToRender && (renderRetCode != eRenderRoIStatusRenderFailed) && appPTR->isNodeCacheShared() ) {
+            appPTR->publishImageToSharedNodeCache(it->second.fullscaleImage);
+            if (it->second.downscaleImage != it->second.fullscaleImage) {
+                appPTR->publishImageToSharedNodeCache(it->second.downscaleImage);
+            }
+        }
+
         //We have to return the downscale image, so make sure it has been computed
         if ( (renderRetCode != eRenderRoIStatusRenderFailed) &&
              renderFullScaleThenDownscale &&
@@ -1789,7 +1863,7 @@ EffectInstance::renderRoI(const RenderRoIArgs & args,
         assert(comp);
         ///The image might need to be converted to fit the original requested format
         if (comp) {
-            it->second.downscaleImage = convertPlanesFormatsIfNeeded(getApp(), it->second.downscaleImage, originalRoI, *comp, args.bitdepth, useAlpha0ForRGBToRGBAConversion, planesToRender->outputPremult, -1);
+            it->second.downscaleImage = convertPlanesFormatsIfNeeded(getApp(), it->second.downscaleImage, originalRoI, *comp, args.bitdepth, useAlpha0ForRGBToRGBAConversion, planesToRender->outputPremult, -1, frameArgs->stats, getNode());
             assert(it->second.downscaleImage->getComponents() == *comp && it->second.downscaleImage->getBitDepth() == args.bitdepth);
 
             StorageModeEnum imageStorage = it->second.downscaleImage->getStorageMode();
@@ -1981,6 +2055,7 @@ EffectInstance::renderRoIInternal(EffectInstance* self,
             tiledArgs->processChannels = processChannels;
             tiledArgs->planes = planesToRender;
             tiledArgs->compsNeeded = compsNeeded;
+            tiledArgs->tlsSnapshot = 0;
 
 
 #ifdef NATRON_HOSTFRAMETHREADING_SEQUENTIAL
@@ -1995,15 +2070,48 @@ EffectInstance::renderRoIInternal(EffectInstance* self,
 
 #else
 
+            // This thread renders tiles while the other threads copy its TLS: they copy a snapshot of it instead
+            boost::scoped_ptr<TLSSnapshot> tlsSnapshot(new TLSSnapshot);
+            tiledArgs->tlsSnapshot = tlsSnapshot.get();
 
-            QFuture<RenderingFunctorRetEnum> ret = QtConcurrent::mapped( planesToRender->rectsToRender,
-                                                                         boost::bind(&EffectInstance::Implementation::tiledRenderingFunctor,
-                                                                                     self->_imp.get(),
-                                                                                     *tiledArgs,
-                                                                                     _1,
-                                                                                     currentThread) );
-            ret.waitForFinished();
-            QFuture<EffectInstance::RenderingFunctorRetEnum>::const_iterator it2;
+            // Tiles that were not started when the render got aborted are skipped and stay marked as aborted
+            std::vector<EffectInstance::RenderingFunctorRetEnum> ret(planesToRender->rectsToRender.size(), EffectInstance::eRenderingFunctorRetAborted);
+            std::vector<double> timesSpent(ret.size(), 0.);
+            std::vector<WorkStealingScheduler::Task> tasks;
+            tasks.reserve( ret.size() );
+            int i = 0;
+            for (std::list<RectToRender>::const_iterator it = planesToRender->rectsToRender.begin(); it != planesToRender->rectsToRender.end(); ++it, ++i) {
+                boost::function<EffectInstance::RenderingFunctorRetEnum ()> functor = boost::bind(&EffectInstance::Implementation::tiledRenderingFunctor,
+                                                                                                 self->_imp.get(),
+                                                                                                 boost::ref(*tiledArgs),
+                                                                                                 boost::cref(*it),
+                                                                                                 currentThread);
+                tasks.push_back( boost::bind(&storeTiledRenderingFunctorRet<EffectInstance::RenderingFunctorRetEnum>, functor, &ret[i], &timesSpent[i]) );
+            }
+            try {
+                appPTR->getRenderScheduler()->run( tasks, frameArgs->abortInfo.lock() );
+            } catch (const std::exception& e) {
+                qDebug() << "Error while rendering tiles:" << e.what();
+                renderStatus = eRenderingFunctorRetFailed;
+            }
+            tiledArgs->tlsSnapshot = 0;
+            tlsSnapshot.reset();
+
+            // Learn the cost of the tiles for the next renders of this plug-in, see AdaptiveTileSplitter
+            if ( (renderStatus == eRenderingFunctorRetOK) &&
+                 ( std::count(ret.begin(), ret.end(), EffectInstance::eRenderingFunctorRetOK) == (int)ret.size() ) ) {
+                std::vector<RectI> renderedTiles;
+                std::vector<double> renderedTimes;
+                i = 0;
+                for (std::list<RectToRender>::const_iterator it = planesToRender->rectsToRender.begin(); it != planesToRender->rectsToRender.end(); ++it, ++i) {
+                    if (!it->isIdentity) {
+                        renderedTiles.push_back(it->rect);
+                        renderedTimes.push_back(timesSpent[i]);
+                    }
+                }
+                appPTR->getTileSplitter()->addRenderTimes(self->getPluginID(), renderedTiles, renderedTimes);
+            }
+            std::vector<EffectInstance::RenderingFunctorRetEnum>::const_iterator it2;
 
 #endif
             for (it2 = ret.begin(); it2 != ret.end(); ++it2) {
@@ -68,6 +68,7 @@ DEPENDPATH += $$PWD/../Global
 
 SOURCES += \
     AbortableRenderInfo.cpp \
+    AdaptiveTileSplitter.cpp \
     AppInstance.cpp \
     AppManager.cpp \
     AppManagerPrivate.cpp \
@@ -75,8 +76,14 @@ SOURCES += \
     Bezier.cpp \
     BezierCP.cpp \
     BlockingBackgroundRender.cpp \
+    BufferPool.cpp \
     CLArgs.cpp \
+    CPUFeatures.cpp \
     Cache.cpp \
+    CacheCompression.cpp \
+    CacheEvictionPolicy.cpp \
+    CacheIndex.cpp \
+    CacheStatistics.cpp \
     CoonsRegularization.cpp \
     CreateNodeArgs.cpp \
     Curve.cpp \
@@ -105,11 +112,14 @@ SOURCES += \
     HostOverlaySupport.cpp \
     Image.cpp \
     ImageConvert.cpp \
+    ImageConvertSIMD.cpp \
     ImageCopyChannels.cpp \
     ImageKey.cpp \
     ImageMaskMix.cpp \
+    ImageMipMapSIMD.cpp \
     ImageParamsSerialization.cpp \
     ImagePlaneDesc.cpp \
+    ImageTiles.cpp \
     Interpolation.cpp \
     JoinViewsNode.cpp \
     Knob.cpp \
@@ -152,6 +162,7 @@ SOURCES += \
     OutputEffectInstance.cpp \
     OutputSchedulerThread.cpp \
     ParallelRenderArgs.cpp \
+    PlaybackPrefetcher.cpp \
     Plugin.cpp \
     PluginMemory.cpp \
     PrecompNode.cpp \
@@ -171,6 +182,7 @@ SOURCES += \
     RectD.cpp \
     RectI.cpp \
     RenderStats.cpp \
+    RenderTaskGraph.cpp \
     RotoContext.cpp \
     RotoDrawableItem.cpp \
     RotoItem.cpp \
@@ -182,6 +194,7 @@ SOURCES += \
     RotoUndoCommand.cpp \
     ScriptObject.cpp \
     Settings.cpp \
+    SharedCacheIndex.cpp \
     Smooth1D.cpp \
     StandardPaths.cpp \
     StringAnimationManager.cpp \
@@ -201,6 +214,7 @@ SOURCES += \
     Transform.cpp \
     Utils.cpp \
     ViewerInstance.cpp \
+    WorkStealingScheduler.cpp \
     WriteNode.cpp \
     ../Global/glad_source.c \
     ../Global/FStreamsSupport.cpp \
@@ -259,6 +273,7 @@ SOURCES += \
 
 HEADERS += \
     AbortableRenderInfo.h \
+    AdaptiveTileSplitter.h \
     AfterQuitProcessingI.h \
     AppInstance.h \
     AppManager.h \
@@ -270,12 +285,18 @@ HEADERS += \
     BezierCPSerialization.h \
     BezierSerialization.h \
     BlockingBackgroundRender.h \
+    BufferPool.h \
     BufferableObject.h \
     CLArgs.h \
+    CPUFeatures.h \
     Cache.h \
+    CacheCompression.h \
     CacheEntry.h \
     CacheEntryHolder.h \
+    CacheEvictionPolicy.h \
+    CacheIndex.h \
     CacheSerialization.h \
+    CacheStatistics.h \
     ChoiceOption.h \
     CoonsRegularization.h \
     CreateNodeArgs.h \
@@ -307,16 +328,20 @@ HEADERS += \
     GenericSchedulerThreadWatcher.h \
     GroupInput.h \
     GroupOutput.h \
+    Half.h \
     Hash64.h \
     HistogramCPU.h \
     HostOverlaySupport.h \
     Image.h \
+    ImageConvertSIMD.h \
     ImageKey.h \
     ImageLocker.h \
+    ImageMipMapSIMD.h \
     ImageParams.h \
     ImageParamsSerialization.h \
     ImagePlaneDesc.h \
     ImageSerialization.h \
+    ImageTiles.h \
     Interpolation.h \
     JoinViewsNode.h \
     KeyHelper.h \
@@ -329,6 +354,7 @@ HEADERS += \
     KnobTypes.h \
     LRUHashTable.h \
     LibraryBinary.h \
+    LockFreeQueue.h \
     Log.h \
     LogEntry.h \
     Lut.h \
@@ -366,6 +392,7 @@ HEADERS += \
     OutputSchedulerThread.h \
     OverlaySupport.h \
     ParallelRenderArgs.h \
+    PlaybackPrefetcher.h \
     Plugin.h \
     PluginActionShortcut.h \
     PluginMemory.h \
@@ -389,6 +416,8 @@ HEADERS += \
     RectI.h \
     RectISerialization.h \
     RenderStats.h \
+    RenderTaskGraph.h \
+    RenderTaskGraphPrivate.h \
     RotoContext.h \
     RotoContextPrivate.h \
     RotoContextSerialization.h \
@@ -407,6 +436,7 @@ HEADERS += \
     RotoUndoCommand.h \
     ScriptObject.h \
     Settings.h \
+    SharedCacheIndex.h \
     Singleton.h \
     Smooth1D.h \
     StandardPaths.h \
@@ -438,6 +468,7 @@ HEADERS += \
     ViewIdx.h \
     ViewerInstance.h \
     ViewerInstancePrivate.h \
+    WorkStealingScheduler.h \
     WriteNode.h \
     fstream_mingw.h \
     ../Global/Enums.h \
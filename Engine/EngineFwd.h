@@ -121,6 +121,7 @@ class AbortableRenderInfo;
 class AbortableThread;
 class AbstractOfxEffectInstance;
 class ActionsCache;
+class AdaptiveTileSplitter;
 class AfterQuitProcessingI;
 class AppInstance;
 class AppTLS;
@@ -131,6 +132,7 @@ class BlockingBackgroundRender;
 class BufferableObject;
 class CLArgs;
 class CacheEntryHolder;
+class CacheEvictionPolicy;
 class CacheSignalEmitter;
 class ChoiceExtraData;
 class CreateNodeArgs;
@@ -156,6 +158,7 @@ class GenericThreadExecOnMainThreadArgs;
 class GenericThreadStartArgs;
 class GenericWatcherCallerArgs;
 class GroupKnobSerialization;
+class Half;
 class Hash64;
 class HostOverlayKnobs;
 class HostOverlayKnobsCornerPin;
@@ -222,6 +225,7 @@ class OutputSchedulerThreadStartArgs;
 class OverlaySupport;
 class ParallelRenderArgs;
 class ParallelRenderArgsSetter;
+class PlaybackPrefetcher;
 class Plugin;
 class PluginGroupNode;
 class PluginMemory;
@@ -235,6 +239,7 @@ class RectD;
 class RectI;
 class RenderEngine;
 class RenderStats;
+class RenderTaskGraph;
 class RenderingFlagSetter;
 class RotoContext;
 class RotoDrawableItem;
@@ -271,6 +276,7 @@ class ViewerArgs;
 class ViewerCurrentFrameRequestSchedulerStartArgs;
 class ViewerInstance;
 class ViewerParallelRenderArgsSetter;
+class WorkStealingScheduler;
 namespace Color {
 class Lut;
 }
@@ -330,6 +336,7 @@ typedef boost::shared_ptr<Bezier> BezierPtr;
 typedef boost::shared_ptr<BezierCP> BezierCPPtr;
 typedef boost::shared_ptr<BezierSerialization> BezierSerializationPtr;
 typedef boost::shared_ptr<BufferableObject> BufferableObjectPtr;
+typedef boost::shared_ptr<CacheEvictionPolicy> CacheEvictionPolicyPtr;
 typedef boost::shared_ptr<CacheSignalEmitter> CacheSignalEmitterPtr;
 typedef boost::shared_ptr<Curve> CurvePtr;
 typedef boost::shared_ptr<EffectInstance> EffectInstancePtr;
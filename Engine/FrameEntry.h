@@ -76,6 +76,11 @@ public:
 
     const U8* pixelAt(int x, int y ) const WARN_UNUSED_RETURN;
 
+    virtual unsigned int getMipMapLevel() const OVERRIDE FINAL
+    {
+        return _key.getMipMapLevel();
+    }
+
     void copy(const FrameEntry& other);
 
 
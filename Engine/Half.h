@@ -0,0 +1,200 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_HALF_H
+#define NATRON_ENGINE_HALF_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstring> // memcpy
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Conversions between floats and the bits of IEEE 754 half-precision floats (1 sign bit, 5 exponent bits and
+ * 10 mantissa bits), as stored in images of depth eImageBitDepthHalf.
+ * Floats are rounded to the nearest half, ties to even, and NaNs stay NaNs: the results are exactly those of the
+ * F16C instructions used by ImageConvertSIMD::floatToHalf() and ImageConvertSIMD::halfToFloat().
+ * Only integer operations are used, so that the results do not depend on the denormals mode of the FPU.
+ **/
+inline unsigned short
+floatToHalfBits(float value)
+{
+    unsigned int x;
+
+    std::memcpy( &x, &value, sizeof(x) );
+
+    unsigned int sign = (x >> 16) & 0x8000;
+    unsigned int absx = x & 0x7fffffff;
+
+    if (absx >= 0x7f800000) {
+        // infinity, or NaN made quiet keeping the upper bits of its payload
+        return (unsigned short)( absx > 0x7f800000 ? ( sign | 0x7e00 | ( (absx >> 13) & 0x3ff ) ) : (sign | 0x7c00) );
+    }
+    if (absx >= 0x477ff000) {
+        // 65520 and above round to infinity
+        return (unsigned short)(sign | 0x7c00);
+    }
+    if (absx < 0x38800000) {
+        // below the smallest normal half (2^-14): the result is a denormal, counting multiples of 2^-24
+        if (absx <= 0x33000000) {
+            // at most 2^-25, which is a tie that rounds to 0
+            return (unsigned short)sign;
+        }
+        unsigned int mantissa = (absx & 0x7fffff) | 0x800000;
+        unsigned int shift = 126 - (absx >> 23);
+        unsigned int bits = mantissa >> shift;
+        unsigned int remainder = mantissa & ( (1u << shift) - 1 );
+        unsigned int halfway = 1u << (shift - 1);
+        if ( (remainder > halfway) || ( (remainder == halfway) && (bits & 1) ) ) {
+            ++bits;
+        }
+
+        return (unsigned short)(sign | bits);
+    }
+
+    // normal: rebias the exponent from 127 to 15 and round the mantissa, a carry correctly increments the exponent
+    unsigned int bits = (absx - 0x38000000) >> 13;
+    unsigned int remainder = absx & 0x1fff;
+    if ( (remainder > 0x1000) || ( (remainder == 0x1000) && (bits & 1) ) ) {
+        ++bits;
+    }
+
+    return (unsigned short)(sign | bits);
+} // floatToHalfBits
+
+inline float
+halfBitsToFloat(unsigned short bits)
+{
+    unsigned int sign = (unsigned int)(bits & 0x8000) << 16;
+    int exponent = (bits >> 10) & 0x1f;
+    unsigned int mantissa = bits & 0x3ff;
+    unsigned int x;
+
+    if (exponent == 0x1f) {
+        // infinity or NaN, NaNs are made quiet
+        x = sign | 0x7f800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+    } else if (exponent != 0) {
+        x = sign | ( (unsigned int)(exponent + 112) << 23 ) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        x = sign;
+    } else {
+        // denormal: normalize the mantissa
+        exponent = 1;
+        while ( !(mantissa & 0x400) ) {
+            mantissa <<= 1;
+            --exponent;
+        }
+        x = sign | ( (unsigned int)(exponent + 112) << 23 ) | ( (mantissa & 0x3ff) << 13 );
+    }
+    float value;
+    std::memcpy( &value, &x, sizeof(value) );
+
+    return value;
+}
+
+/**
+ * @brief The type of the pixels of images of depth eImageBitDepthHalf. It converts implicitly from and to float so
+ * that the templated image processing code can use it like float, with values that are not normalized
+ * (i.e: the template parameter maxValue is 1, as for float). All arithmetic is done in float: the result is rounded
+ * to a half when it is stored.
+ **/
+class Half
+{
+public:
+
+    Half()
+        : _bits(0)
+    {
+    }
+
+    Half(float value)
+        : _bits( floatToHalfBits(value) )
+    {
+    }
+
+    operator float() const
+    {
+        return halfBitsToFloat(_bits);
+    }
+
+    Half& operator+=(float value)
+    {
+        _bits = floatToHalfBits( halfBitsToFloat(_bits) + value );
+
+        return *this;
+    }
+
+    Half& operator-=(float value)
+    {
+        _bits = floatToHalfBits( halfBitsToFloat(_bits) - value );
+
+        return *this;
+    }
+
+    Half& operator*=(float value)
+    {
+        _bits = floatToHalfBits( halfBitsToFloat(_bits) * value );
+
+        return *this;
+    }
+
+    Half& operator/=(float value)
+    {
+        _bits = floatToHalfBits( halfBitsToFloat(_bits) / value );
+
+        return *this;
+    }
+
+    unsigned short bits() const
+    {
+        return _bits;
+    }
+
+    static Half fromBits(unsigned short bits)
+    {
+        Half h;
+
+        h._bits = bits;
+
+        return h;
+    }
+
+    bool isNan() const
+    {
+        return (_bits & 0x7fff) > 0x7c00;
+    }
+
+private:
+
+    unsigned short _bits;
+};
+
+// Images of depth eImageBitDepthHalf are arrays of Half
+typedef char HalfSizeCheck[sizeof(Half) == sizeof(unsigned short) ? 1 : -1];
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_HALF_H
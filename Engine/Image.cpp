@@ -29,16 +29,25 @@
 #include <cassert>
 #include <cstring> // for std::memcpy, std::memset
 #include <stdexcept>
+#include <vector>
 
 #if !defined(SBK_RUN) && !defined(Q_MOC_RUN)
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
 #include <boost/math/special_functions/fpclassify.hpp>
+// /usr/local/include/boost/bind/arg.hpp:37:9: warning: unused typedef 'boost_static_assert_typedef_37' [-Wunused-local-typedef]
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #endif
 
+CLANG_DIAG_OFF(deprecated)
 #include <QtCore/QDebug>
+#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
+#include <QtCore/QThreadPool>
+CLANG_DIAG_ON(deprecated)
 
 #include "Engine/AppManager.h"
+#include "Engine/ImageMipMapSIMD.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/GPUContextPool.h"
 #include "Engine/OSGLContext.h"
@@ -46,164 +55,313 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 
 NATRON_NAMESPACE_ENTER
 
-#define BM_GET(i, j) (&_map[( i - _bounds.bottom() ) * _bounds.width() + ( j - _bounds.left() )])
-
 #define PIXEL_UNAVAILABLE 2
 
-template <int trimap>
+// Masks of values of the pixels of Bitmap, see Bitmap::hasValues() and Bitmap::getValuesBbox()
+#define BM_MASK(value) ( 1 << (value) )
+#define BM_MASK_NOT_RENDERED ( BM_MASK(0) | BM_MASK(PIXEL_UNAVAILABLE) )
+
+///Size of the source rows of the bands in which buildMipMapLevel() splits its roi
+#define NATRON_MIPMAP_BAND_BYTES (512 * 1024)
+
+void
+Bitmap::initialize(const RectI & bounds)
+{
+    _bounds = bounds;
+    if ( bounds.isNull() ) {
+        _tiles.clear();
+    } else {
+        _tiles = bounds.downscalePowerOfTwoSmallestEnclosing(NATRON_BITMAP_TILE_SIZE_LOG2);
+    }
+
+    TileState state;
+    state.value = 0;
+    state.count[0] = state.count[1] = state.count[2] = 0;
+
+    std::size_t nTiles = _tiles.isNull() ? 0 : (std::size_t)_tiles.area();
+    _tileStates.assign(nTiles, state);
+    _tilePixels.clear();
+    _tilePixels.resize(nTiles);
+    _mixedTilesCount = 0;
+}
+
+std::size_t
+Bitmap::getMemorySize() const
+{
+    return _tileStates.size() * ( sizeof(TileState) + sizeof(std::vector<char>) ) +
+           (std::size_t)_mixedTilesCount * NATRON_BITMAP_TILE_SIZE * NATRON_BITMAP_TILE_SIZE;
+}
+
 RectI
-minimalNonMarkedBbox_internal(const RectI& roi,
-                              const RectI& _bounds,
-                              const std::vector<char>& _map,
-                              bool* isBeingRenderedElsewhere)
+Bitmap::getTileRect(int tx,
+                    int ty) const
 {
-    RectI bbox;
+    RectI tile(tx * NATRON_BITMAP_TILE_SIZE, ty * NATRON_BITMAP_TILE_SIZE, (tx + 1) * NATRON_BITMAP_TILE_SIZE, (ty + 1) * NATRON_BITMAP_TILE_SIZE);
+    RectI ret;
 
-    assert( _bounds.contains(roi) );
-    bbox = roi;
-
-    //find bottom
-    for (int i = bbox.bottom(); i < bbox.top(); ++i) {
-        const char* buf = BM_GET( i, bbox.left() );
-
-        if (trimap) {
-            const char* lineEnd = buf + bbox.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (!*buf) {
-                    buf = 0;
+    tile.intersect(_bounds, &ret);
+
+    return ret;
+}
+
+char*
+Bitmap::getTilePixelsForWrite(int tileIndex,
+                              const RectI& tileRect)
+{
+    TileState& state = _tileStates[tileIndex];
+    std::vector<char>& pixels = _tilePixels[tileIndex];
+
+    if (state.value != eTileMixed) {
+        pixels.assign(NATRON_BITMAP_TILE_SIZE * NATRON_BITMAP_TILE_SIZE, state.value);
+        state.count[0] = state.count[1] = state.count[2] = 0;
+        state.count[(int)state.value] = (int)tileRect.area();
+        state.value = eTileMixed;
+        ++_mixedTilesCount;
+    }
+
+    return &pixels.front();
+}
+
+void
+Bitmap::setTileValue(int tileIndex,
+                     char value)
+{
+    TileState& state = _tileStates[tileIndex];
+
+    if (state.value == eTileMixed) {
+        std::vector<char>().swap(_tilePixels[tileIndex]);
+        --_mixedTilesCount;
+    }
+    state.value = value;
+}
+
+void
+Bitmap::writeTilePixels(int tx,
+                        int ty,
+                        int x1,
+                        int x2,
+                        int y,
+                        const char* values,
+                        char value)
+{
+    int tileIndex = getTileIndex(tx, ty);
+    TileState& state = _tileStates[tileIndex];
+
+    if (state.value != eTileMixed) {
+        // nothing to do if the values are those of the tile
+        bool sameValues = true;
+        if (values) {
+            for (int i = 0; i < x2 - x1; ++i) {
+                if (values[i] != state.value) {
+                    sameValues = false;
                     break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    metUnavailablePixel = true;
                 }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else if (metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag if the whole row is not 0
-                ++bbox.y1;
-            } else {
-                ++bbox.y1;
             }
         } else {
-            const char* lineEnd = buf + bbox.width();
-            while (buf < lineEnd) {
-                if ( !*buf || (*buf == PIXEL_UNAVAILABLE) ) {
-                    buf = 0;
-                    break;
-                }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else {
-                ++bbox.y1;
-            }
+            sameValues = (value == state.value);
+        }
+        if (sameValues) {
+            return;
         }
     }
 
-    //find top (will do zero iteration if the bbox is already empty)
-    for (int i = bbox.top() - 1; i >= bbox.bottom(); --i) {
-        const char* buf = BM_GET( i, bbox.left() );
+    const RectI tileRect = getTileRect(tx, ty);
+    assert(tileRect.x1 <= x1 && x2 <= tileRect.x2 && tileRect.y1 <= y && y < tileRect.y2);
+    char* row = getTilePixelsForWrite(tileIndex, tileRect) +
+                (y - ty * NATRON_BITMAP_TILE_SIZE) * NATRON_BITMAP_TILE_SIZE + (x1 - tx * NATRON_BITMAP_TILE_SIZE);
 
-        if (trimap) {
-            const char* lineEnd = buf + bbox.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (!*buf) {
-                    buf = 0;
-                    break;
-                } else if (*buf == PIXEL_UNAVAILABLE) {
-                    metUnavailablePixel = true;
+    for (int i = 0; i < x2 - x1; ++i) {
+        char v = values ? values[i] : value;
+        --state.count[(int)row[i]];
+        ++state.count[(int)v];
+        row[i] = v;
+    }
+
+    // the tile may be uniform again
+    int area = (int)tileRect.area();
+    for (int v = 0; v < 3; ++v) {
+        if (state.count[v] == area) {
+            setTileValue(tileIndex, (char)v);
+            break;
+        }
+    }
+} // Bitmap::writeTilePixels
+
+bool
+Bitmap::hasValues(const RectI& rect,
+                  int valuesMask) const
+{
+    RectI r;
+
+    if ( rect.isNull() || !rect.intersect(_bounds, &r) ) {
+        return false;
+    }
+    const RectI tiles = r.downscalePowerOfTwoSmallestEnclosing(NATRON_BITMAP_TILE_SIZE_LOG2);
+    for (int ty = tiles.y1; ty < tiles.y2; ++ty) {
+        for (int tx = tiles.x1; tx < tiles.x2; ++tx) {
+            int tileIndex = getTileIndex(tx, ty);
+            const TileState& state = _tileStates[tileIndex];
+            if (state.value != eTileMixed) {
+                if ( BM_MASK(state.value) & valuesMask ) {
+                    return true;
                 }
-                ++buf;
-            }
-            if (!buf) {
-                break;
-            } else if (metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag if the whole row is not 0
-                --bbox.y2;
-            } else {
-                --bbox.y2;
+                continue;
             }
-        } else {
-            const char* lineEnd = buf + bbox.width();
-            while (buf < lineEnd) {
-                if ( !*buf || (*buf == PIXEL_UNAVAILABLE) ) {
-                    buf = 0;
-                    break;
+            bool tileHasValues = false;
+            for (int v = 0; v < 3; ++v) {
+                if ( state.count[v] && ( BM_MASK(v) & valuesMask ) ) {
+                    tileHasValues = true;
                 }
-                ++buf;
             }
-            if (!buf) {
-                break;
-            } else {
-                --bbox.y2;
+            if (!tileHasValues) {
+                continue;
+            }
+            RectI tr;
+            getTileRect(tx, ty).intersect(r, &tr);
+            const char* row = &_tilePixels[tileIndex].front() +
+                              (tr.y1 - ty * NATRON_BITMAP_TILE_SIZE) * NATRON_BITMAP_TILE_SIZE + (tr.x1 - tx * NATRON_BITMAP_TILE_SIZE);
+            for (int y = tr.y1; y < tr.y2; ++y, row += NATRON_BITMAP_TILE_SIZE) {
+                for (int i = 0; i < tr.x2 - tr.x1; ++i) {
+                    if ( BM_MASK(row[i]) & valuesMask ) {
+                        return true;
+                    }
+                }
             }
         }
     }
 
-    // avoid making bbox.width() iterations for nothing
-    if ( bbox.isNull() ) {
-        return bbox;
+    return false;
+} // Bitmap::hasValues
+
+bool
+Bitmap::hasValuesOutside(const RectI& rect,
+                         const RectI& inner,
+                         int valuesMask) const
+{
+    if ( inner.isNull() ) {
+        return hasValues(rect, valuesMask);
     }
+    assert( rect.contains(inner) );
 
-    //find left
-    for (int j = bbox.left(); j < bbox.right(); ++j) {
-        const char* pix = BM_GET(bbox.bottom(), j);
-        bool metUnavailablePixel = false;
+    return ( hasValues(RectI(rect.x1, rect.y1, rect.x2, inner.y1), valuesMask) ||
+             hasValues(RectI(rect.x1, inner.y2, rect.x2, rect.y2), valuesMask) ||
+             hasValues(RectI(rect.x1, inner.y1, inner.x1, inner.y2), valuesMask) ||
+             hasValues(RectI(inner.x2, inner.y1, rect.x2, inner.y2), valuesMask) );
+}
 
-        for ( int i = bbox.bottom(); i < bbox.top(); ++i, pix += _bounds.width() ) {
-            if (!*pix) {
-                pix = 0;
-                break;
-            } else if (*pix == PIXEL_UNAVAILABLE) {
-                if (trimap) {
-                    metUnavailablePixel = true;
-                } else {
-                    pix = 0;
-                    break;
+RectI
+Bitmap::getValuesBbox(const RectI& rect,
+                      int valuesMask) const
+{
+    RectI r;
+
+    if ( rect.isNull() || !rect.intersect(_bounds, &r) ) {
+        return RectI();
+    }
+
+    RectI bbox;
+    bool bboxSet = false;
+    const RectI tiles = r.downscalePowerOfTwoSmallestEnclosing(NATRON_BITMAP_TILE_SIZE_LOG2);
+    for (int ty = tiles.y1; ty < tiles.y2; ++ty) {
+        for (int tx = tiles.x1; tx < tiles.x2; ++tx) {
+            RectI tr;
+            getTileRect(tx, ty).intersect(r, &tr);
+            if ( bboxSet && bbox.contains(tr) ) {
+                continue;
+            }
+            int tileIndex = getTileIndex(tx, ty);
+            const TileState& state = _tileStates[tileIndex];
+            if (state.value != eTileMixed) {
+                if ( BM_MASK(state.value) & valuesMask ) {
+                    if (bboxSet) {
+                        bbox.merge(tr);
+                    } else {
+                        bbox = tr;
+                        bboxSet = true;
+                    }
                 }
+                continue;
             }
-        }
-        if (pix) {
-            ++bbox.x1;
-            if (trimap && metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag is the whole column is not 0
+            const char* row = &_tilePixels[tileIndex].front() +
+                              (tr.y1 - ty * NATRON_BITMAP_TILE_SIZE) * NATRON_BITMAP_TILE_SIZE + (tr.x1 - tx * NATRON_BITMAP_TILE_SIZE);
+            for (int y = tr.y1; y < tr.y2; ++y, row += NATRON_BITMAP_TILE_SIZE) {
+                int first = -1;
+                int last = -1;
+                for (int i = 0; i < tr.x2 - tr.x1; ++i) {
+                    if ( BM_MASK(row[i]) & valuesMask ) {
+                        if (first < 0) {
+                            first = i;
+                        }
+                        last = i;
+                    }
+                }
+                if (first >= 0) {
+                    RectI found(tr.x1 + first, y, tr.x1 + last + 1, y + 1);
+                    if (bboxSet) {
+                        bbox.merge(found);
+                    } else {
+                        bbox = found;
+                        bboxSet = true;
+                    }
+                }
             }
-        } else {
-            break;
         }
     }
 
-    //find right
-    for (int j = bbox.right() - 1; j >= bbox.left(); --j) {
-        const char* pix = BM_GET(bbox.bottom(), j);
-        bool metUnavailablePixel = false;
+    return bboxSet ? bbox : RectI();
+} // Bitmap::getValuesBbox
 
-        for ( int i = bbox.bottom(); i < bbox.top(); ++i, pix += _bounds.width() ) {
-            if (!*pix) {
-                pix = 0;
-                break;
-            } else if (*pix == PIXEL_UNAVAILABLE) {
-                if (trimap) {
-                    metUnavailablePixel = true;
-                } else {
-                    pix = 0;
-                    break;
-                }
-            }
-        }
-        if (pix) {
-            --bbox.x2;
-            if (trimap && metUnavailablePixel) {
-                *isBeingRenderedElsewhere = true; //< only flag is the whole column is not 0
-            }
+void
+Bitmap::getRow(int x1,
+               int x2,
+               int y,
+               char* values) const
+{
+    assert(_bounds.x1 <= x1 && x2 <= _bounds.x2 && _bounds.y1 <= y && y < _bounds.y2);
+    if (x2 <= x1) {
+        return;
+    }
+    const RectI tiles = RectI(x1, y, x2, y + 1).downscalePowerOfTwoSmallestEnclosing(NATRON_BITMAP_TILE_SIZE_LOG2);
+    for (int tx = tiles.x1; tx < tiles.x2; ++tx) {
+        int sx1 = std::max(x1, tx * NATRON_BITMAP_TILE_SIZE);
+        int sx2 = std::min(x2, (tx + 1) * NATRON_BITMAP_TILE_SIZE);
+        int tileIndex = getTileIndex(tx, tiles.y1);
+        const TileState& state = _tileStates[tileIndex];
+        if (state.value != eTileMixed) {
+            std::memset(values + (sx1 - x1), state.value, sx2 - sx1);
         } else {
-            break;
+            const char* row = &_tilePixels[tileIndex].front() +
+                              (y - tiles.y1 * NATRON_BITMAP_TILE_SIZE) * NATRON_BITMAP_TILE_SIZE + (sx1 - tx * NATRON_BITMAP_TILE_SIZE);
+            std::memcpy(values + (sx1 - x1), row, sx2 - sx1);
         }
     }
+}
+
+char
+Bitmap::getValueAt(int x,
+                   int y) const
+{
+    assert(_bounds.x1 <= x && x < _bounds.x2 && _bounds.y1 <= y && y < _bounds.y2);
+    char value;
+    getRow(x, x + 1, y, &value);
+
+    return value;
+}
+
+template <int trimap>
+RectI
+Bitmap::minimalNonMarkedBbox_internal(const RectI& roi,
+                                      bool* isBeingRenderedElsewhere) const
+{
+    assert( _bounds.contains(roi) );
+
+    // With the trimap, the pixels being rendered elsewhere are not rendered again: they are flagged instead, unless
+    // they are in the bounding box of the pixels to render.
+    RectI bbox = getValuesBbox(roi, trimap ? BM_MASK(0) : BM_MASK_NOT_RENDERED);
+
+    if ( trimap && hasValuesOutside(roi, bbox, BM_MASK(PIXEL_UNAVAILABLE)) ) {
+        *isBeingRenderedElsewhere = true;
+    }
 
     return bbox;
 } // minimalNonMarkedBbox_internal
@@ -211,11 +369,9 @@ minimalNonMarkedBbox_internal(const RectI& roi,
 
 template <int trimap>
 void
-minimalNonMarkedRects_internal(const RectI & roi,
-                               const RectI& _bounds,
-                               const std::vector<char>& _map,
-                               std::list<RectI>& ret,
-                               bool* isBeingRenderedElsewhere)
+Bitmap::minimalNonMarkedRects_internal(const RectI & roi,
+                                       std::list<RectI>& ret,
+                                       bool* isBeingRenderedElsewhere) const
 {
     assert(ret.empty());
     ///Any out of bounds portion is pushed to the rectangles to render
@@ -251,7 +407,7 @@ minimalNonMarkedRects_internal(const RectI & roi,
         return;
     }
 
-    RectI bboxM = minimalNonMarkedBbox_internal<trimap>(intersection, _bounds, _map, isBeingRenderedElsewhere);
+    RectI bboxM = minimalNonMarkedBbox_internal<trimap>(intersection, isBeingRenderedElsewhere);
     assert( (trimap && isBeingRenderedElsewhere) || (!trimap && !isBeingRenderedElsewhere) );
 
     //#define NATRON_BITMAP_DISABLE_OPTIMIZATION
@@ -284,181 +440,48 @@ minimalNonMarkedRects_internal(const RectI & roi,
     // CXXXXXXXXXXDDD
     // CXXXXXXXXXXDDD
     // AAAAAAAAAAAAAA
+    //
+    // X is the bounding box of the pixels that are rendered (and being rendered elsewhere with the trimap),
+    // A, B, C and D are what is left around it.
+    RectI bboxX = getValuesBbox(bboxM, trimap ? ( BM_MASK(1) | BM_MASK(PIXEL_UNAVAILABLE) ) : BM_MASK(1) );
 
-    // First, find if there's an "A" rectangle, and push it to the result
-    //find bottom
-    RectI bboxX = bboxM;
-    RectI bboxA = bboxX;
-    bboxA.set_top( bboxX.bottom() );
-    for (int i = bboxX.bottom(); i < bboxX.top(); ++i) {
-        const char* buf = BM_GET( i, bboxX.left() );
-        if (trimap) {
-            const char* lineEnd = buf + bboxX.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (*buf == 1) {
-                    buf = 0;
-                    break;
-                } else if ( (*buf == PIXEL_UNAVAILABLE) && trimap ) {
-                    buf = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-                ++buf;
-            }
-            if (buf) {
-                ++bboxX.y1;
-                bboxA.y2 = bboxX.y1;
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        } else {
-            if ( !memchr( buf, 1, bboxX.width() ) ) {
-                ++bboxX.y1;
-                bboxA.y2 = bboxX.y1;
-            } else {
-                break;
-            }
-        }
-    }
-    if ( !bboxA.isNull() ) { // empty boxes should not be pushed
-        ret.push_back(bboxA);
+    if ( bboxX.isNull() ) {
+        ret.push_back(bboxM);
+
+        return;
     }
 
-    // Now, find the "B" rectangle
-    //find top
-    RectI bboxB = bboxX;
-    bboxB.set_bottom( bboxX.top() );
-    for (int i = bboxX.top() - 1; i >= bboxX.bottom(); --i) {
-        const char* buf = BM_GET( i, bboxX.left() );
+    RectI bboxA(bboxM.x1, bboxM.y1, bboxM.x2, bboxX.y1);
+    RectI bboxB(bboxM.x1, bboxX.y2, bboxM.x2, bboxM.y2);
+    RectI bboxC(bboxM.x1, bboxX.y1, bboxX.x1, bboxX.y2);
+    RectI bboxD(bboxX.x2, bboxX.y1, bboxM.x2, bboxX.y2);
 
-        if (trimap) {
-            const char* lineEnd = buf + bboxX.width();
-            bool metUnavailablePixel = false;
-            while (buf < lineEnd) {
-                if (*buf == 1) {
-                    buf = 0;
-                    break;
-                } else if ( (*buf == PIXEL_UNAVAILABLE) && trimap ) {
-                    buf = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-                ++buf;
-            }
-            if (buf) {
-                --bboxX.y2;
-                bboxB.y1 = bboxX.y2;
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        } else {
-            if ( !memchr( buf, 1, bboxX.width() ) ) {
-                --bboxX.y2;
-                bboxB.y1 = bboxX.y2;
-            } else {
-                break;
-            }
+    if ( trimap && !*isBeingRenderedElsewhere ) {
+        // flag if the rows and columns of X next to A, B, C and D have pixels being rendered elsewhere
+        if ( hasValues(RectI(bboxM.x1, bboxX.y1, bboxM.x2, bboxX.y1 + 1), BM_MASK(PIXEL_UNAVAILABLE)) ||
+             hasValues(RectI(bboxM.x1, bboxX.y2 - 1, bboxM.x2, bboxX.y2), BM_MASK(PIXEL_UNAVAILABLE)) ||
+             hasValues(RectI(bboxX.x1, bboxX.y1, bboxX.x1 + 1, bboxX.y2), BM_MASK(PIXEL_UNAVAILABLE)) ||
+             hasValues(RectI(bboxX.x2 - 1, bboxX.y1, bboxX.x2, bboxX.y2), BM_MASK(PIXEL_UNAVAILABLE)) ) {
+            *isBeingRenderedElsewhere = true;
         }
     }
-    if ( !bboxB.isNull() ) { // empty boxes should not be pushed
-        ret.push_back(bboxB);
-    }
-
-    //find left
-    RectI bboxC = bboxX;
-    bboxC.set_right( bboxX.left() );
-    if ( bboxX.bottom() < bboxX.top() ) {
-        for (int j = bboxX.left(); j < bboxX.right(); ++j) {
-            const char* pix = BM_GET(bboxX.bottom(), j);
-            bool metUnavailablePixel = false;
 
-            for ( int i = bboxX.bottom(); i < bboxX.top(); ++i, pix += _bounds.width() ) {
-                if (*pix == 1) {
-                    pix = 0;
-                    break;
-                } else if ( trimap && (*pix == PIXEL_UNAVAILABLE) ) {
-                    pix = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-            }
-            if (pix) {
-                ++bboxX.x1;
-                bboxC.x2 = bboxX.x1;
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        }
+    // empty boxes should not be pushed
+    if ( !bboxA.isNull() ) {
+        ret.push_back(bboxA);
     }
-    if ( !bboxC.isNull() ) { // empty boxes should not be pushed
-        ret.push_back(bboxC);
+    if ( !bboxB.isNull() ) {
+        ret.push_back(bboxB);
     }
-
-    //find right
-    RectI bboxD = bboxX;
-    bboxD.set_left( bboxX.right() );
-    if ( bboxX.bottom() < bboxX.top() ) {
-        for (int j = bboxX.right() - 1; j >= bboxX.left(); --j) {
-            const char* pix = BM_GET(bboxX.bottom(), j);
-            bool metUnavailablePixel = false;
-
-            for ( int i = bboxX.bottom(); i < bboxX.top(); ++i, pix += _bounds.width() ) {
-                if (*pix == 1) {
-                    pix = 0;
-                    break;
-                } else if ( trimap && (*pix == PIXEL_UNAVAILABLE) ) {
-                    pix = 0;
-                    metUnavailablePixel = true;
-                    break;
-                }
-            }
-            if (pix) {
-                --bboxX.x2;
-                bboxD.x1 = bboxX.x2;
-            } else {
-                if (metUnavailablePixel) {
-                    *isBeingRenderedElsewhere = true;
-                }
-                break;
-            }
-        }
+    if ( !bboxC.isNull() ) {
+        ret.push_back(bboxC);
     }
-    if ( !bboxD.isNull() ) { // empty boxes should not be pushed
+    if ( !bboxD.isNull() ) {
         ret.push_back(bboxD);
     }
 
-    assert( bboxA.bottom() == bboxM.bottom() );
-    assert( bboxA.left() == bboxM.left() );
-    assert( bboxA.right() == bboxM.right() );
-    assert( bboxA.top() == bboxX.bottom() );
-
-    assert( bboxB.top() == bboxM.top() );
-    assert( bboxB.left() == bboxM.left() );
-    assert( bboxB.right() == bboxM.right() );
-    assert( bboxB.bottom() == bboxX.top() );
-
-    assert( bboxC.top() == bboxX.top() );
-    assert( bboxC.left() == bboxM.left() );
-    assert( bboxC.right() == bboxX.left() );
-    assert( bboxC.bottom() == bboxX.bottom() );
-
-    assert( bboxD.top() == bboxX.top() );
-    assert( bboxD.left() == bboxX.right() );
-    assert( bboxD.right() == bboxM.right() );
-    assert( bboxD.bottom() == bboxX.bottom() );
-
     // get the bounding box of what's left (the X rectangle in the drawing above)
-    bboxX = minimalNonMarkedBbox_internal<trimap>(bboxX, _bounds, _map, isBeingRenderedElsewhere);
+    bboxX = minimalNonMarkedBbox_internal<trimap>(bboxX, isBeingRenderedElsewhere);
 
     if ( !bboxX.isNull() ) { // empty boxes should not be pushed
         ret.push_back(bboxX);
@@ -476,9 +499,9 @@ Bitmap::minimalNonMarkedBbox(const RectI & roi) const
             return RectI();
         }
 
-        return minimalNonMarkedBbox_internal<0>(realRoi, _bounds, _map, NULL);
+        return minimalNonMarkedBbox_internal<0>(realRoi, NULL);
     } else {
-        return minimalNonMarkedBbox_internal<0>(roi, _bounds, _map, NULL);
+        return minimalNonMarkedBbox_internal<0>(roi, NULL);
     }
 }
 
@@ -491,9 +514,9 @@ Bitmap::minimalNonMarkedRects(const RectI & roi,
         if ( !roi.intersect(_dirtyZone, &realRoi) ) {
             return;
         }
-        minimalNonMarkedRects_internal<0>(realRoi, _bounds, _map, ret, NULL);
+        minimalNonMarkedRects_internal<0>(realRoi, ret, NULL);
     } else {
-        minimalNonMarkedRects_internal<0>(roi, _bounds, _map, ret, NULL);
+        minimalNonMarkedRects_internal<0>(roi, ret, NULL);
     }
 }
 
@@ -510,9 +533,9 @@ Bitmap::minimalNonMarkedBbox_trimap(const RectI & roi,
             return RectI();
         }
 
-        return minimalNonMarkedBbox_internal<1>(realRoi, _bounds, _map, isBeingRenderedElsewhere);
+        return minimalNonMarkedBbox_internal<1>(realRoi, isBeingRenderedElsewhere);
     } else {
-        return minimalNonMarkedBbox_internal<1>(roi, _bounds, _map, isBeingRenderedElsewhere);
+        return minimalNonMarkedBbox_internal<1>(roi, isBeingRenderedElsewhere);
     }
 }
 
@@ -528,51 +551,50 @@ Bitmap::minimalNonMarkedRects_trimap(const RectI & roi,
 
             return;
         }
-        minimalNonMarkedRects_internal<1>(realRoi, _bounds, _map, ret, isBeingRenderedElsewhere);
+        minimalNonMarkedRects_internal<1>(realRoi, ret, isBeingRenderedElsewhere);
     } else {
-        minimalNonMarkedRects_internal<1>(roi, _bounds, _map, ret, isBeingRenderedElsewhere);
+        minimalNonMarkedRects_internal<1>(roi, ret, isBeingRenderedElsewhere);
     }
 }
 
 #endif
 
 void
-Bitmap::markFor(const RectI & roi, char value)
+Bitmap::markFor(const RectI & roi,
+                char value)
 {
-    int x1 = std::max(roi.x1, _bounds.x1);
-    int y1 = std::max(roi.y1, _bounds.y1);
-    int x2 = std::min(roi.x2, _bounds.x2);
-    int y2 = std::min(roi.y2, _bounds.y2);
+    RectI rect;
 
-    char* buf = BM_GET(y1, x1);
-    int w = _bounds.width();
-    int roiw = x2 - x1;
-
-    for (int i = y1; i < y2; ++i, buf += w) {
-        std::memset( buf, value, roiw);
+    if ( roi.isNull() || !roi.intersect(_bounds, &rect) ) {
+        return;
+    }
+    const RectI tiles = rect.downscalePowerOfTwoSmallestEnclosing(NATRON_BITMAP_TILE_SIZE_LOG2);
+    for (int ty = tiles.y1; ty < tiles.y2; ++ty) {
+        for (int tx = tiles.x1; tx < tiles.x2; ++tx) {
+            const RectI tileRect = getTileRect(tx, ty);
+            RectI r;
+            tileRect.intersect(rect, &r);
+            if (r == tileRect) {
+                setTileValue(getTileIndex(tx, ty), value);
+            } else {
+                for (int y = r.y1; y < r.y2; ++y) {
+                    writeTilePixels(tx, ty, r.x1, r.x2, y, NULL, value);
+                }
+            }
+        }
     }
 }
 
 bool
 Bitmap::isNonMarked(const RectI & roi) const
 {
-    int x1 = std::max(roi.x1, _bounds.x1);
-    int y1 = std::max(roi.y1, _bounds.y1);
-    int x2 = std::min(roi.x2, _bounds.x2);
-    int y2 = std::min(roi.y2, _bounds.y2);
-
-    const char* buf = BM_GET(y1, x1);
-    int w = _bounds.width();
-    int roiw = x2 - x1;
+    return !hasValues( roi, BM_MASK(1) | BM_MASK(PIXEL_UNAVAILABLE) );
+}
 
-    for (int i = y1; i < y2; ++i, buf += w) {
-        for (int j = 0; j < roiw; ++j) {
-            if (buf[j]) {
-                return false;
-            }
-        }
-    }
-    return true;
+bool
+Bitmap::isMarkedForRendered(const RectI & roi) const
+{
+    return !hasValues(roi, BM_MASK_NOT_RENDERED);
 }
 
 #if NATRON_ENABLE_TRIMAP
@@ -587,34 +609,15 @@ Bitmap::markForRendering(const RectI & roi)
 void
 Bitmap::swap(Bitmap& other)
 {
-    _map.swap(other._map);
+    _tileStates.swap(other._tileStates);
+    _tilePixels.swap(other._tilePixels);
+    std::swap(_mixedTilesCount, other._mixedTilesCount);
+    _tiles = other._tiles;
     _bounds = other._bounds;
     _dirtyZone.clear(); //merge(other._dirtyZone);
     _dirtyZoneSet = false;
 }
 
-const char*
-Bitmap::getBitmapAt(int x,
-                    int y) const
-{
-    if ( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) ) {
-        return BM_GET(y, x);
-    } else {
-        return NULL;
-    }
-}
-
-char*
-Bitmap::getBitmapAt(int x,
-                    int y)
-{
-    if ( ( x >= _bounds.left() ) && ( x < _bounds.right() ) && ( y >= _bounds.bottom() ) && ( y < _bounds.top() ) ) {
-        return BM_GET(y, x);
-    } else {
-        return NULL;
-    }
-}
-
 #ifdef DEBUG
 void
 Image::printUnrenderedPixels(const RectI& roi) const
@@ -623,9 +626,6 @@ Image::printUnrenderedPixels(const RectI& roi) const
         return;
     }
     QReadLocker k(&_entryLock);
-    const char* bm = _bitmap.getBitmapAt(roi.x1, roi.y1);
-    int roiw = roi.x2 - roi.x1;
-    int boundsW = _bitmap.getBounds().width();
     RectD bboxUnrendered;
     bboxUnrendered.setupInfinity();
     RectD bboxUnavailable;
@@ -634,10 +634,10 @@ Image::printUnrenderedPixels(const RectI& roi) const
     bool hasUnrendered = false;
     bool hasUnavailable = false;
 
-    for ( int y = roi.y1; y < roi.y2; ++y,
-          bm += (boundsW - roiw) ) {
-        for (int x = roi.x1; x < roi.x2; ++x, ++bm) {
-            if (*bm == 0) {
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        for (int x = roi.x1; x < roi.x2; ++x) {
+            char bm = _bitmap.getValueAt(x, y);
+            if (bm == 0) {
                 if (x < bboxUnrendered.x1) {
                     bboxUnrendered.x1 = x;
                 }
@@ -651,7 +651,7 @@ Image::printUnrenderedPixels(const RectI& roi) const
                     bboxUnrendered.y2 = y;
                 }
                 hasUnrendered = true;
-            } else if (*bm == PIXEL_UNAVAILABLE) {
+            } else if (bm == PIXEL_UNAVAILABLE) {
                 if (x < bboxUnavailable.x1) {
                     bboxUnavailable.x1 = x;
                 }
@@ -917,7 +917,7 @@ Image::pasteFromForDepth(const Image & srcImg,
     ///Cannot copy images with different bit depth, this is not the purpose of this function.
     ///@see convert
     assert( getBitDepth() == srcImg.getBitDepth() );
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || ( (getBitDepth() == eImageBitDepthShort || getBitDepth() == eImageBitDepthHalf) && sizeof(PIX) == 2 ) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
     // NOTE: before removing the following asserts, please explain why an empty image may happen
 
     QWriteLocker k(&_entryLock);
@@ -1051,9 +1051,7 @@ Image::resizeInternal(const Image* srcImg,
             std::size_t memsize = a * pixelSize;
             std::memset(pix, 0, memsize);
             if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
-                char* bm = wacc.bitmapAt(aRect.x1, aRect.y1);
-                assert(bm);
-                std::memset(bm, 1, a);
+                wacc.markBitmapForRendered(aRect);
             }
         }
         if ( !cRect.isNull() ) {
@@ -1063,9 +1061,7 @@ Image::resizeInternal(const Image* srcImg,
             std::size_t memsize = a * pixelSize;
             std::memset(pix, 0, memsize);
             if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
-                char* bm = (char*)wacc.bitmapAt(cRect.x1, cRect.y1);
-                assert(bm);
-                std::memset(bm, 1, a);
+                wacc.markBitmapForRendered(cRect);
             }
         }
         if ( !bRect.isNull() ) {
@@ -1073,15 +1069,12 @@ Image::resizeInternal(const Image* srcImg,
             assert(pix);
             int mw = merge.width();
             std::size_t rowsize = mw * pixelSize;
-            int bw = bRect.width();
-            std::size_t rectRowSize = bw * pixelSize;
-            char* bm = ( setBitmapTo1 && (*outputImage)->usesBitMap() ) ? wacc.bitmapAt(bRect.x1, bRect.y1) : 0;
+            std::size_t rectRowSize = bRect.width() * pixelSize;
             for (int y = bRect.y1; y < bRect.y2; ++y, pix += rowsize) {
                 std::memset(pix, 0, rectRowSize);
-                if (bm) {
-                    std::memset(bm, 1, bw);
-                    bm += mw;
-                }
+            }
+            if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
+                wacc.markBitmapForRendered(bRect);
             }
         }
         if ( !dRect.isNull() ) {
@@ -1089,15 +1082,12 @@ Image::resizeInternal(const Image* srcImg,
             assert(pix);
             int mw = merge.width();
             std::size_t rowsize = mw * pixelSize;
-            int dw = dRect.width();
-            std::size_t rectRowSize = dw * pixelSize;
-            char* bm = ( setBitmapTo1 && (*outputImage)->usesBitMap() ) ? wacc.bitmapAt(dRect.x1, dRect.y1) : 0;
+            std::size_t rectRowSize = dRect.width() * pixelSize;
             for (int y = dRect.y1; y < dRect.y2; ++y, pix += rowsize) {
                 std::memset(pix, 0, rectRowSize);
-                if (bm) {
-                    std::memset(bm, 1, dw);
-                    bm += mw;
-                }
+            }
+            if ( setBitmapTo1 && (*outputImage)->usesBitMap() ) {
+                wacc.markBitmapForRendered(dRect);
             }
         }
     } // fillWithBlackAndTransparent
@@ -1111,7 +1101,7 @@ Image::resizeInternal(const Image* srcImg,
         (*outputImage)->pasteFromForDepth<unsigned short>(*srcImg, srcBounds, srcImg->usesBitMap(), false);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        (*outputImage)->pasteFromForDepth<Half>(*srcImg, srcBounds, srcImg->usesBitMap(), false);
         break;
     case eImageBitDepthFloat:
         (*outputImage)->pasteFromForDepth<float>(*srcImg, srcBounds, srcImg->usesBitMap(), false);
@@ -1392,7 +1382,7 @@ Image::pasteFrom(const Image & src,
             pasteFromForDepth<unsigned short>(src, srcRoi, copyBitmap, true);
             break;
         case eImageBitDepthHalf:
-            assert(false);
+            pasteFromForDepth<Half>(src, srcRoi, copyBitmap, true);
             break;
         case eImageBitDepthFloat:
             pasteFromForDepth<float>(src, srcRoi, copyBitmap, true);
@@ -1411,7 +1401,7 @@ Image::fillForDepthForComponents(const RectI & roi_,
                                  float b,
                                  float a)
 {
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || ( (getBitDepth() == eImageBitDepthShort || getBitDepth() == eImageBitDepthHalf) && sizeof(PIX) == 2 ) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
 
     RectI roi = roi_;
     bool doInteresect = roi.intersect(_bounds, &roi);
@@ -1528,7 +1518,7 @@ Image::fill(const RectI & roi,
         fillForDepth<unsigned short, 65535>(roi, r, g, b, a);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        fillForDepth<Half, 1>(roi, r, g, b, a);
         break;
     case eImageBitDepthFloat:
         fillForDepth<float, 1>(roi, r, g, b, a);
@@ -1776,6 +1766,18 @@ bool
 Image::isBitDepthConversionLossy(ImageBitDepthEnum from,
                                  ImageBitDepthEnum to)
 {
+    if (from == to) {
+        return false;
+    }
+    // half floats have 11 bits of precision: they hold bytes exactly, but not shorts. Shorts and bytes cannot hold
+    // values outside of [0,1]
+    if (to == eImageBitDepthHalf) {
+        return from != eImageBitDepthByte;
+    }
+    if (from == eImageBitDepthHalf) {
+        return to != eImageBitDepthFloat;
+    }
+
     int sizeOfFrom = getSizeOfForBitDepth(from);
     int sizeOfTo = getSizeOfForBitDepth(to);
 
@@ -1816,7 +1818,7 @@ Image::halveRoIForDepth(const RectI & roi,
                         Image* output) const
 {
     assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) ||
-            (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) ||
+            ( (getBitDepth() == eImageBitDepthShort || getBitDepth() == eImageBitDepthHalf) && sizeof(PIX) == 2 ) ||
             (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
 
     ///handle case where there is only 1 column/row
@@ -1834,10 +1836,8 @@ Image::halveRoIForDepth(const RectI & roi,
     ///The source rectangle, intersected to this image region of definition in pixels
     const RectI &srcBounds = _bounds;
     const RectI &dstBounds = output->_bounds;
-    const RectI &srcBmBounds = _bitmap.getBounds();
-    const RectI &dstBmBounds = output->_bitmap.getBounds();
     assert( !copyBitMap || usesBitMap() );
-    assert( !usesBitMap() || (srcBmBounds == srcBounds && dstBmBounds == dstBounds) );
+    assert( !usesBitMap() || (_bitmap.getBounds() == srcBounds && output->_bitmap.getBounds() == dstBounds) );
 
     // the srcRoD of the output should be enclosed in half the roi.
     // It does not have to be exactly half of the input.
@@ -1849,36 +1849,26 @@ Image::halveRoIForDepth(const RectI & roi,
     //           dstRoD.height()*2 <= roi.height());
     assert( getComponents() == output->getComponents() );
 
-    RectI dstRoI;
     RectI srcRoI = roi;
     srcRoI.intersect(srcBounds, &srcRoI); // intersect srcRoI with the region of definition
 
-    dstRoI.x1 = (srcRoI.x1 + 1) / 2; // equivalent to ceil(srcRoI.x1/2.0)
-    dstRoI.y1 = (srcRoI.y1 + 1) / 2; // equivalent to ceil(srcRoI.y1/2.0)
-    dstRoI.x2 = srcRoI.x2 / 2; // equivalent to floor(srcRoI.x2/2.0)
-    dstRoI.y2 = srcRoI.y2 / 2; // equivalent to floor(srcRoI.y2/2.0)
+    // ceil(srcRoI.x1/2.0), floor(srcRoI.x2/2.0), ... also for negative coordinates, so that halving bands of
+    // srcRoI yields the same pixels as halving srcRoI at once
+    RectI dstRoI = srcRoI.downscalePowerOfTwoLargestEnclosed(1);
 
 
     const PIX* const srcPixels      = (const PIX*)pixelAt(srcBounds.x1,   srcBounds.y1);
-    const char* const srcBmPixels   = _bitmap.getBitmapAt(srcBmBounds.x1, srcBmBounds.y1);
     PIX* const dstPixels          = (PIX*)output->pixelAt(dstBounds.x1,   dstBounds.y1);
-    char* const dstBmPixels = output->_bitmap.getBitmapAt(dstBmBounds.x1, dstBmBounds.y1);
     int srcRowSize = srcBounds.width() * _nbComponents;
     int dstRowSize = dstBounds.width() * _nbComponents;
 
     // offset pointers so that srcData and dstData correspond to pixel (0,0)
     const PIX* const srcData = srcPixels - (srcBounds.x1 * _nbComponents + srcRowSize * srcBounds.y1);
     PIX* const dstData       = dstPixels - (dstBounds.x1 * _nbComponents + dstRowSize * dstBounds.y1);
-    const int srcBmRowSize = srcBmBounds.width();
-    const int dstBmRowSize = dstBmBounds.width();
-    const char* const srcBmData = srcBmPixels - (srcBmBounds.x1 + srcBmRowSize * srcBmBounds.y1);
-    char* const dstBmData       = dstBmPixels - (dstBmBounds.x1 + dstBmRowSize * dstBmBounds.y1);
 
     for (int y = dstRoI.y1; y < dstRoI.y2; ++y) {
         const PIX* const srcLineStart    = srcData + y * 2 * srcRowSize;
         PIX* const dstLineStart          = dstData + y     * dstRowSize;
-        const char* const srcBmLineStart = srcBmData + y * 2 * srcBmRowSize;
-        char* const dstBmLineStart       = dstBmData + y     * dstBmRowSize;
 
         // The current dst row, at y, covers the src rows y*2 (thisRow) and y*2+1 (nextRow).
         // Check that if are within srcBounds.
@@ -1888,11 +1878,35 @@ Image::halveRoIForDepth(const RectI & roi,
         int sumH = (int)pickNextRow + (int)pickThisRow;
         assert(sumH == 1 || sumH == 2);
 
+        // Float pixels whose 2x2 block is inside srcBounds are box-filtered by SIMD kernels, from simdX1 to simdX2.
+        // The loop below handles the other pixels.
+        int simdX1 = dstRoI.x2;
+        int simdX2 = dstRoI.x2;
+        if ( (maxValue == 1) && ( sizeof(PIX) == sizeof(float) ) && (sumH == 2) ) {
+            simdX1 = dstRoI.x1;
+            while ( simdX1 < simdX2 && srcBounds.x1 > simdX1 * 2 ) {
+                ++simdX1;
+            }
+            while ( simdX2 > simdX1 && srcBounds.x2 <= simdX2 * 2 - 1 ) {
+                --simdX2;
+            }
+            if (simdX1 < simdX2) {
+                const PIX* const srcPixStart = srcLineStart + simdX1 * 2 * _nbComponents;
+                ImageMipMapSIMD::halveRows( (const float*)srcPixStart, (const float*)(srcPixStart + srcRowSize),
+                                            (float*)(dstLineStart + simdX1 * _nbComponents), simdX2 - simdX1, _nbComponents );
+            } else {
+                simdX1 = simdX2 = dstRoI.x2;
+            }
+        }
+
         for (int x = dstRoI.x1; x < dstRoI.x2; ++x) {
+            if (x == simdX1) {
+                // nothing left to do up to simdX2
+                x = simdX2 - 1;
+                continue;
+            }
             const PIX* const srcPixStart    = srcLineStart   + x * 2 * _nbComponents;
-            const char* const srcBmPixStart = srcBmLineStart + x * 2;
             PIX* const dstPixStart          = dstLineStart   + x * _nbComponents;
-            char* const dstBmPixStart       = dstBmLineStart + x;
 
             // The current dst col, at y, covers the src cols x*2 (thisCol) and x*2+1 (nextCol).
             // Check that if are within srcBounds.
@@ -1908,61 +1922,32 @@ Image::halveRoIForDepth(const RectI & roi,
                 for (int k = 0; k < _nbComponents; ++k) {
                     dstPixStart[k] = 0;
                 }
-                if (copyBitMap) {
-                    dstBmPixStart[0] = 0;
-                }
                 continue;
             }
 
-            for (int k = 0; k < _nbComponents; ++k) {
-                ///a b
-                ///c d
-
-                const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : 0;
-                const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + _nbComponents) : 0;
-                const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize) : 0;
-                const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + _nbComponents)  : 0;
-
-                assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
-                assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
-                dstPixStart[k] = (a + b + c + d) / sum;
-            }
+            // the pixels from simdX1 to simdX2 were box-filtered above
+            if ( (x < simdX1) || (x >= simdX2) ) {
+                for (int k = 0; k < _nbComponents; ++k) {
+                    ///a b
+                    ///c d
 
-            if (copyBitMap) {
-                ///a b
-                ///c d
+                    const PIX a = (pickThisCol && pickThisRow) ? *(srcPixStart + k) : PIX(0);
+                    const PIX b = (pickNextCol && pickThisRow) ? *(srcPixStart + k + _nbComponents) : PIX(0);
+                    const PIX c = (pickThisCol && pickNextRow) ? *(srcPixStart + k + srcRowSize) : PIX(0);
+                    const PIX d = (pickNextCol && pickNextRow) ? *(srcPixStart + k + srcRowSize  + _nbComponents)  : PIX(0);
 
-                char a = (pickThisCol && pickThisRow) ? *(srcBmPixStart) : 0;
-                char b = (pickNextCol && pickThisRow) ? *(srcBmPixStart + 1) : 0;
-                char c = (pickThisCol && pickNextRow) ? *(srcBmPixStart + srcBmRowSize) : 0;
-                char d = (pickNextCol && pickNextRow) ? *(srcBmPixStart + srcBmRowSize  + 1)  : 0;
-#if NATRON_ENABLE_TRIMAP
-                /*
-                   The only correct solution is to convert pixels being rendered to 0 otherwise the caller
-                   would have to wait for the original fullscale image render to be finished and then re-downscale again.
-                 */
-                if (a == PIXEL_UNAVAILABLE) {
-                    a = 0;
+                    assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
+                    assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
+                    dstPixStart[k] = (a + b + c + d) / sum;
                 }
-                if (b == PIXEL_UNAVAILABLE) {
-                    b = 0;
-                }
-                if (c == PIXEL_UNAVAILABLE) {
-                    c = 0;
-                }
-                if (d == PIXEL_UNAVAILABLE) {
-                    d = 0;
-                }
-#endif
-                assert( sumW == 2 || ( sumW == 1 && ( (a == 0 && c == 0) || (b == 0 && d == 0) ) ) );
-                assert( sumH == 2 || ( sumH == 1 && ( (a == 0 && b == 0) || (c == 0 && d == 0) ) ) );
-                assert(a + b + c + d <= sum); // bitmaps are 0 or 1
-                // the following is an integer division, the result can be 0 or 1
-                dstBmPixStart[0] = (a + b + c + d) / sum;
-                assert(dstBmPixStart[0] == 0 || dstBmPixStart[0] == 1);
             }
+
         }
     }
+
+    if (copyBitMap) {
+        output->_bitmap.halveRoI(dstRoI, _bitmap);
+    }
 } // halveRoIForDepth
 
 // code proofread and fixed by @devernay on 8/8/2014
@@ -1979,7 +1964,7 @@ Image::halveRoI(const RectI & roi,
         halveRoIForDepth<unsigned short, 65535>(roi, copyBitMap, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        halveRoIForDepth<Half, 1>(roi, copyBitMap, output);
         break;
     case eImageBitDepthFloat:
         halveRoIForDepth<float, 1>(roi, copyBitMap, output);
@@ -2055,7 +2040,7 @@ Image::halve1DImage(const RectI & roi,
         halve1DImageForDepth<unsigned short, 65535>(roi, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        halve1DImageForDepth<Half, 1>(roi, output);
         break;
     case eImageBitDepthFloat:
         halve1DImageForDepth<float, 1>(roi, output);
@@ -2088,7 +2073,7 @@ Image::downscaleMipMap(const RectD& dstRod,
 //    roiCanonical.toPixelEnclosing(toLevel, par , &dstRoI);
     unsigned int downscaleLvls = toLevel - fromLevel;
 
-    assert( !copyBitMap || _bitmap.getBitmap() );
+    assert( !copyBitMap || !_bitmap.getBounds().isNull() );
 
     RectI dstRoI  = roi.downscalePowerOfTwoSmallestEnclosing(downscaleLvls);
     ImagePtr tmpImg = boost::make_shared<Image>( getComponents(), dstRod, dstRoI, toLevel, par, getBitDepth(), getPremultiplication(), getFieldingOrder(), true);
@@ -2108,7 +2093,7 @@ Image::downscaleMipMap(const RectD& dstRod,
 bool
 Image::checkForNaNs(const RectI& roi)
 {
-    if (getBitDepth() != eImageBitDepthFloat) {
+    if ( (getBitDepth() != eImageBitDepthFloat) && (getBitDepth() != eImageBitDepthHalf) ) {
         return false;
     }
     if (getStorageMode() == eStorageModeGLTex) {
@@ -2118,6 +2103,21 @@ Image::checkForNaNs(const RectI& roi)
     QWriteLocker k(&_entryLock);
     unsigned int compsCount = getComponentsCount();
     bool hasnan = false;
+    if (getBitDepth() == eImageBitDepthHalf) {
+        for (int y = roi.y1; y < roi.y2; ++y) {
+            Half* pix = (Half*)pixelAt(roi.x1, y);
+            Half* const end = pix +  compsCount * roi.width();
+
+            for (; pix < end; ++pix) {
+                if ( pix->isNan() ) {
+                    *pix = 1.f;
+                    hasnan = true;
+                }
+            }
+        }
+
+        return hasnan;
+    }
     for (int y = roi.y1; y < roi.y2; ++y) {
         float* pix = (float*)pixelAt(roi.x1, y);
         float* const end = pix +  compsCount * roi.width();
@@ -2135,6 +2135,39 @@ Image::checkForNaNs(const RectI& roi)
     return hasnan;
 }
 
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+/**
+ * @brief Fills a line of an upscaled image from dstX1 to dstX2, replicating each pixel of the source line, which
+ * starts at srcX1, scale times. The number of channels is a template parameter so that the compiler vectorizes the copies.
+ **/
+template <typename PIX, int nComps>
+void
+upscaleMipMapLine(const PIX* srcPix,
+                  PIX* dstPix,
+                  int srcX1,
+                  int dstX1,
+                  int dstX2,
+                  int scale)
+{
+    int xi = srcX1;
+    int xcount; // how many pixels should be filled
+
+    for (int xo = dstX1; xo < dstX2; ++xi, srcPix += nComps, xo += xcount) {
+        xcount = scale - (xo - xi * scale);
+        xcount = std::min(xcount, dstX2 - xo);
+        //assert(0 < xcount && xcount <= scale);
+        // replicate srcPix as many times as necessary
+        for (int i = 0; i < xcount; ++i, dstPix += nComps) {
+            for (int c = 0; c < nComps; ++c) {
+                dstPix[c] = srcPix[c];
+            }
+        }
+    }
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
 // code proofread and fixed by @devernay on 8/8/2014
 template <typename PIX, int maxValue>
 void
@@ -2144,7 +2177,7 @@ Image::upscaleMipMapForDepth(const RectI & roi,
                              Image* output) const
 {
     assert( getBitDepth() == output->getBitDepth() );
-    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || (getBitDepth() == eImageBitDepthShort && sizeof(PIX) == 2) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
+    assert( (getBitDepth() == eImageBitDepthByte && sizeof(PIX) == 1) || ( (getBitDepth() == eImageBitDepthShort || getBitDepth() == eImageBitDepthHalf) && sizeof(PIX) == 2 ) || (getBitDepth() == eImageBitDepthFloat && sizeof(PIX) == 4) );
 
     ///You should not call this function with a level equal to 0.
     assert(fromLevel > toLevel);
@@ -2173,6 +2206,7 @@ Image::upscaleMipMapForDepth(const RectI & roi,
     QReadLocker k2(&_entryLock);
     int srcRowSize = _bounds.width() * _nbComponents;
     int dstRowSize = output->_bounds.width() * _nbComponents;
+    int dstRoiRowElements = dstRoi.width() * _nbComponents;
     const PIX *src = (const PIX*)pixelAt(srcRoi.x1, srcRoi.y1);
     PIX* dst = (PIX*)output->pixelAt(dstRoi.x1, dstRoi.y1);
     assert(src && dst);
@@ -2187,31 +2221,28 @@ Image::upscaleMipMapForDepth(const RectI & roi,
         ycount = scale - (yo - yi * scale); // how many lines should be filled
         ycount = std::min(ycount, dstRoi.y2 - yo);
         assert(0 < ycount && ycount <= scale);
-        int xi = srcRoi.x1;
-        int xcount = 0; // how many pixels should be filled
-        const PIX * srcPix = srcLineStart;
-        PIX * dstPixFirst = dstLineBatchStart;
         // fill the first line
-        for (int xo = dstRoi.x1; xo < dstRoi.x2; ++xi, srcPix += _nbComponents, xo += xcount, dstPixFirst += xcount * _nbComponents) {
-            xcount = scale - (xo - xi * scale);
-            xcount = std::min(xcount, dstRoi.x2 - xo);
-            //assert(0 < xcount && xcount <= scale);
-            // replicate srcPix as many times as necessary
-            PIX * dstPix = dstPixFirst;
-            //assert((srcPix-(PIX*)pixelAt(srcRoi.x1, srcRoi.y1)) % components == 0);
-            for (int i = 0; i < xcount; ++i, dstPix += _nbComponents) {
-                assert( ( dstPix - (PIX*)output->pixelAt(dstRoi.x1, dstRoi.y1) ) % _nbComponents == 0 );
-                assert(dstPix >= (PIX*)output->pixelAt(xo, yo) && dstPix < (PIX*)output->pixelAt(xo, yo) + xcount * _nbComponents);
-                for (int c = 0; c < _nbComponents; ++c) {
-                    dstPix[c] = srcPix[c];
-                }
-            }
-            //assert(dstPix == dstPixFirst + xcount*components);
+        switch (_nbComponents) {
+        case 1:
+            upscaleMipMapLine<PIX, 1>(srcLineStart, dstLineBatchStart, srcRoi.x1, dstRoi.x1, dstRoi.x2, scale);
+            break;
+        case 2:
+            upscaleMipMapLine<PIX, 2>(srcLineStart, dstLineBatchStart, srcRoi.x1, dstRoi.x1, dstRoi.x2, scale);
+            break;
+        case 3:
+            upscaleMipMapLine<PIX, 3>(srcLineStart, dstLineBatchStart, srcRoi.x1, dstRoi.x1, dstRoi.x2, scale);
+            break;
+        case 4:
+            upscaleMipMapLine<PIX, 4>(srcLineStart, dstLineBatchStart, srcRoi.x1, dstRoi.x1, dstRoi.x2, scale);
+            break;
+        default:
+            assert(false);
+            break;
         }
         PIX * dstLineStart = dstLineBatchStart + dstRowSize; // first line was filled already
         // now replicate the line as many times as necessary
         for (int i = 1; i < ycount; ++i, dstLineStart += dstRowSize) {
-            std::copy(dstLineBatchStart, dstLineBatchStart + dstRowSize, dstLineStart);
+            std::copy(dstLineBatchStart, dstLineBatchStart + dstRoiRowElements, dstLineStart);
         }
     }
 } // upscaleMipMapForDepth
@@ -2233,7 +2264,7 @@ Image::upscaleMipMap(const RectI & roi,
         upscaleMipMapForDepth<unsigned short, 65535>(roi, fromLevel, toLevel, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        upscaleMipMapForDepth<Half, 1>(roi, fromLevel, toLevel, output);
         break;
     case eImageBitDepthFloat:
         upscaleMipMapForDepth<float, 1>(roi, fromLevel, toLevel, output);
@@ -2266,44 +2297,81 @@ Image::buildMipMapLevel(const RectD& dstRoD,
         return;
     }
 
+    ///Split the roi in bands of rows whose limits inside the roi are multiples of 2^level, so that each band yields
+    ///exactly the rows of the last level it covers: all the levels of a band are built while it is in the CPU cache.
+    const int bandAlignment = 1 << level;
+    const int rowBytes = std::max(1, roi.width() * (int)getComponentsCount() * getSizeOfForBitDepth( getBitDepth() ) );
+    const int bandHeight = ( (std::max(1, NATRON_MIPMAP_BAND_BYTES / rowBytes) + bandAlignment - 1) / bandAlignment ) * bandAlignment;
+    std::vector<RectI> bands;
+    for (int y = roi.y1; y < roi.y2; ) {
+        // the first multiple of bandHeight above y
+        int bandEnd = ( (y >= 0) ? (y / bandHeight + 1) : ( -( (-y - 1) / bandHeight ) ) ) * bandHeight;
+        // bands are at least 2^level rows high so that no level is halved as a 1D image unless the roi is
+        if (bandEnd - y < bandAlignment) {
+            bandEnd += bandHeight;
+        }
+        if (roi.y2 - bandEnd < bandAlignment) {
+            bandEnd = roi.y2;
+        }
+        RectI band = roi;
+        band.y1 = y;
+        band.y2 = bandEnd;
+        bands.push_back(band);
+        y = band.y2;
+    }
+
+    bool runInCurrentThread = bands.size() <= 1 ||
+                              QThreadPool::globalInstance()->activeThreadCount() >= QThreadPool::globalInstance()->maxThreadCount();
+    if (runInCurrentThread) {
+        for (std::vector<RectI>::const_iterator it = bands.begin(); it != bands.end(); ++it) {
+            buildMipMapLevelForBand(dstRoD, *it, level, copyBitMap, output);
+        }
+    } else {
+        QtConcurrent::map( bands,
+                           boost::bind(&Image::buildMipMapLevelForBand,
+                                       this,
+                                       dstRoD,
+                                       _1,
+                                       level,
+                                       copyBitMap,
+                                       output) ).waitForFinished();
+    }
+} // buildMipMapLevel
+
+void
+Image::buildMipMapLevelForBand(const RectD& dstRoD,
+                               const RectI & band,
+                               unsigned int level,
+                               bool copyBitMap,
+                               Image* output) const
+{
     const Image* srcImg = this;
-    Image* dstImg = NULL;
-    bool mustFreeSrc = false;
-    RectI previousRoI = roi;
+    ImagePtr dstImg;
+    RectI previousRoI = band;
     ///Build all the mipmap levels until we reach the one we are interested in
     for (unsigned int i = 1; i <= level; ++i) {
         ///Halve the smallest enclosing po2 rect as we need to render a minimum of the renderWindow
         RectI halvedRoI = previousRoI.downscalePowerOfTwoSmallestEnclosing(1);
 
-        ///Allocate an image with half the size of the source image
-        dstImg = new Image( getComponents(), dstRoD, halvedRoI, getMipMapLevel() + i, getPixelAspectRatio(), getBitDepth(), getPremultiplication(), getFieldingOrder(), true);
+        ///Allocate an image with half the size of the source image. The previous one is released after halving it
+        ImagePtr srcHolder = dstImg;
+        dstImg = boost::make_shared<Image>( getComponents(), dstRoD, halvedRoI, getMipMapLevel() + i, getPixelAspectRatio(), getBitDepth(), getPremultiplication(), getFieldingOrder(), true);
 
         ///Half the source image into dstImg.
         ///We pass the closestPo2 roi which might not be the entire size of the source image
         ///If the source image'sroi was originally a po2.
-        srcImg->halveRoI(previousRoI, copyBitMap, dstImg);
-
-        ///Clean-up, we should use shared_ptrs for safety
-        if (mustFreeSrc) {
-            delete srcImg;
-        }
+        srcImg->halveRoI(previousRoI, copyBitMap, dstImg.get());
 
         ///Switch for next pass
         previousRoI = halvedRoI;
-        srcImg = dstImg;
-        mustFreeSrc = true;
+        srcImg = dstImg.get();
     }
 
-    assert(srcImg->getBounds() == lastLevelRoI);
+    assert( dstImg->getBounds() == band.downscalePowerOfTwoSmallestEnclosing(level) );
 
     ///Finally copy the last mipmap level into output.
-    output->pasteFrom( *srcImg, srcImg->getBounds(), copyBitMap);
-
-    ///Clean-up, we should use shared_ptrs for safety
-    if (mustFreeSrc) {
-        delete srcImg;
-    }
-} // buildMipMapLevel
+    output->pasteFrom( *dstImg, dstImg->getBounds(), copyBitMap);
+}
 
 double
 Image::getScaleFromMipMapLevel(unsigned int level)
@@ -2339,14 +2407,17 @@ Bitmap::copyRowPortion(int x1,
                        int y,
                        const Bitmap& other)
 {
-    const char* srcBitmap = other.getBitmapAt(x1, y);
-    char* dstBitmap = getBitmapAt(x1, y);
-    const char* end = dstBitmap + (x2 - x1);
+    if (x2 <= x1) {
+        return;
+    }
+    std::vector<char> values(x2 - x1);
+    other.getRow(x1, x2, y, &values.front());
 
-    while (dstBitmap < end) {
-        *dstBitmap = /**srcBitmap == PIXEL_UNAVAILABLE ? 0 : */ *srcBitmap;
-        ++dstBitmap;
-        ++srcBitmap;
+    const RectI tiles = RectI(x1, y, x2, y + 1).downscalePowerOfTwoSmallestEnclosing(NATRON_BITMAP_TILE_SIZE_LOG2);
+    for (int tx = tiles.x1; tx < tiles.x2; ++tx) {
+        int sx1 = std::max(x1, tx * NATRON_BITMAP_TILE_SIZE);
+        int sx2 = std::min(x2, (tx + 1) * NATRON_BITMAP_TILE_SIZE);
+        writeTilePixels(tx, tiles.y1, sx1, sx2, y, &values[sx1 - x1], 0);
     }
 }
 
@@ -2364,25 +2435,89 @@ Bitmap::copyBitmapPortion(const RectI& roi,
     assert(roi.x1 >= _bounds.x1 && roi.x2 <= _bounds.x2 && roi.y1 >= _bounds.y1 && roi.y2 <= _bounds.y2);
     assert(roi.x1 >= other._bounds.x1 && roi.x2 <= other._bounds.x2 && roi.y1 >= other._bounds.y1 && roi.y2 <= other._bounds.y2);
 
-    int srcRowSize = other._bounds.width();
-    int dstRowSize = _bounds.width();
-    const char* srcBitmap = other.getBitmapAt(roi.x1, roi.y1);
-    char* dstBitmap = getBitmapAt(roi.x1, roi.y1);
-
-    for (int y = roi.y1; y < roi.y2; ++y,
-         srcBitmap += srcRowSize,
-         dstBitmap += dstRowSize) {
-        const char* srcCur = srcBitmap;
-        const char* srcEnd = srcBitmap + roi.width();
-        char* dstCur = dstBitmap;
-        while (srcCur < srcEnd) {
-            *dstCur = /**srcCur == PIXEL_UNAVAILABLE ? 0 : */ *srcCur;
-            ++srcCur;
-            ++dstCur;
+    if ( roi.isNull() ) {
+        return;
+    }
+    // copy tile by tile, the parts of other that have a single value are just marked with it
+    const RectI tiles = roi.downscalePowerOfTwoSmallestEnclosing(NATRON_BITMAP_TILE_SIZE_LOG2);
+    for (int ty = tiles.y1; ty < tiles.y2; ++ty) {
+        for (int tx = tiles.x1; tx < tiles.x2; ++tx) {
+            RectI r;
+            getTileRect(tx, ty).intersect(roi, &r);
+            char value = other.getValueAt(r.x1, r.y1);
+            if ( !other.hasValues(r, ~BM_MASK(value) & 7) ) {
+                markFor(r, value);
+            } else {
+                for (int y = r.y1; y < r.y2; ++y) {
+                    copyRowPortion(r.x1, r.x2, y, other);
+                }
+            }
         }
     }
 }
 
+void
+Bitmap::halveRoI(const RectI& dstRoI,
+                 const Bitmap& other)
+{
+    RectI roi;
+
+    if ( dstRoI.isNull() || !dstRoI.intersect(_bounds, &roi) ) {
+        return;
+    }
+
+    std::vector<char> srcRows[2];
+    std::vector<char> dstRow;
+    const RectI tiles = roi.downscalePowerOfTwoSmallestEnclosing(NATRON_BITMAP_TILE_SIZE_LOG2);
+    for (int ty = tiles.y1; ty < tiles.y2; ++ty) {
+        for (int tx = tiles.x1; tx < tiles.x2; ++tx) {
+            RectI dstRect;
+            getTileRect(tx, ty).intersect(roi, &dstRect);
+            RectI srcRect;
+            if ( !RectI(dstRect.x1 * 2, dstRect.y1 * 2, dstRect.x2 * 2, dstRect.y2 * 2).intersect(other._bounds, &srcRect) ) {
+                markFor(dstRect, 0); // never happens
+                continue;
+            }
+
+            // most tiles cover source pixels that are all rendered, or none of them
+            if ( !other.hasValues(srcRect, BM_MASK_NOT_RENDERED) ) {
+                markFor(dstRect, 1);
+                continue;
+            }
+            if ( !other.hasValues( srcRect, BM_MASK(1) ) ) {
+                markFor(dstRect, 0);
+                continue;
+            }
+
+            srcRows[0].resize( srcRect.width() );
+            srcRows[1].resize( srcRect.width() );
+            dstRow.resize( dstRect.width() );
+            for (int y = dstRect.y1; y < dstRect.y2; ++y) {
+                // The current dst row covers the src rows y*2 and y*2+1, within srcRect
+                int srcy1 = std::max(y * 2, srcRect.y1);
+                int srcy2 = std::min(y * 2 + 2, srcRect.y2);
+                for (int srcy = srcy1; srcy < srcy2; ++srcy) {
+                    other.getRow(srcRect.x1, srcRect.x2, srcy, &srcRows[srcy - srcy1].front());
+                }
+                for (int x = dstRect.x1; x < dstRect.x2; ++x) {
+                    int srcx1 = std::max(x * 2, srcRect.x1);
+                    int srcx2 = std::min(x * 2 + 2, srcRect.x2);
+                    char value = (srcx1 < srcx2 && srcy1 < srcy2) ? 1 : 0;
+                    for (int r = 0; r < srcy2 - srcy1; ++r) {
+                        for (int srcx = srcx1; srcx < srcx2; ++srcx) {
+                            if (srcRows[r][srcx - srcRect.x1] != 1) {
+                                value = 0;
+                            }
+                        }
+                    }
+                    dstRow[x - dstRect.x1] = value;
+                }
+                writeTilePixels(tx, ty, dstRect.x1, dstRect.x2, y, &dstRow.front(), 0);
+            }
+        }
+    }
+} // Bitmap::halveRoI
+
 template <typename PIX, bool doPremult>
 void
 Image::premultInternal(const RectI& roi)
@@ -2426,6 +2561,9 @@ Image::premultForDepth(const RectI& roi)
     case eImageBitDepthShort:
         premultInternal<unsigned short, doPremult>(roi);
         break;
+    case eImageBitDepthHalf:
+        premultInternal<Half, doPremult>(roi);
+        break;
     case eImageBitDepthFloat:
         premultInternal<float, doPremult>(roi);
         break;
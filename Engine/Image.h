@@ -32,6 +32,7 @@
 #include <map>
 #include <algorithm> // min, max
 #include <bitset>
+#include <vector>
 
 #include "Global/GlobalDefines.h"
 
@@ -44,11 +45,15 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/ImagePlaneDesc.h"
 #include "Engine/ImageParams.h"
 #include "Engine/CacheEntry.h"
+#include "Engine/Half.h"
 #include "Engine/OutputSchedulerThread.h"
 #include "Engine/RectD.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/EngineFwd.h"
 
+///Width and height in pixels of the tiles of Bitmap, which divide the tiles of the node cache
+#define NATRON_BITMAP_TILE_SIZE_LOG2 6
+#define NATRON_BITMAP_TILE_SIZE (1 << NATRON_BITMAP_TILE_SIZE_LOG2)
 
 NATRON_NAMESPACE_ENTER
 
@@ -64,12 +69,24 @@ public:
     }
 };
 
+/**
+ * @brief Tells for each pixel of an image whether it is rendered (1), not rendered (0) or being rendered by another
+ * thread (2, only with NATRON_ENABLE_TRIMAP).
+ * The pixels are grouped in tiles of NATRON_BITMAP_TILE_SIZE pixels aligned on the origin, like the tiles of the node
+ * cache. A tile whose pixels all have the same value only stores that value, the value of each pixel is only stored
+ * for the tiles that have different values. Renders mark rectangles, so most tiles are uniform: the memory used is
+ * small and the rectangles left to render are found in a time that depends on the number of tiles rather than on the
+ * number of pixels.
+ **/
 class Bitmap
 {
 public:
     Bitmap(const RectI & bounds)
-        : _bounds(bounds)
-        , _map( bounds.area() )
+        : _bounds()
+        , _tiles()
+        , _tileStates()
+        , _tilePixels()
+        , _mixedTilesCount(0)
         , _dirtyZone()
         , _dirtyZoneSet(false)
     {
@@ -77,24 +94,21 @@ public:
         // "identities" images (i.e: images that are just a link to another image). See EffectInstance :
         // "!!!Note that if isIdentity is true it will allocate an empty image object with 0 bytes of data."
         //assert(!rod.isNull());
-        std::fill(_map.begin(), _map.end(), 0);
+        initialize(bounds);
     }
 
     Bitmap()
         : _bounds()
-        , _map()
+        , _tiles()
+        , _tileStates()
+        , _tilePixels()
+        , _mixedTilesCount(0)
         , _dirtyZone()
         , _dirtyZoneSet(false)
     {
     }
 
-    void initialize(const RectI & bounds)
-    {
-        _bounds = bounds;
-        _map.resize( _bounds.area() );
-
-        std::fill(_map.begin(), _map.end(), 0);
-    }
+    void initialize(const RectI & bounds);
 
     ~Bitmap()
     {
@@ -102,7 +116,7 @@ public:
 
     void setTo1()
     {
-        std::fill(_map.begin(), _map.end(), 1);
+        markFor(_bounds, 1);
     }
 
     const RectI & getBounds() const
@@ -110,6 +124,9 @@ public:
         return _bounds;
     }
 
+    ///Returns the number of bytes used to store the bitmap
+    std::size_t getMemorySize() const;
+
 #if NATRON_ENABLE_TRIMAP
     void minimalNonMarkedRects_trimap(const RectI & roi, std::list<RectI>& ret, bool* isBeingRenderedElsewhere) const;
     RectI minimalNonMarkedBbox_trimap(const RectI & roi, bool* isBeingRenderedElsewhere) const;
@@ -121,6 +138,9 @@ public:
     // returns true if the roi only contains 0s
     bool isNonMarked(const RectI & roi) const;
 
+    // returns true if the roi only contains 1s
+    bool isMarkedForRendered(const RectI & roi) const;
+
     ///Fill with 1 the roi
     void markForRendered(const RectI & roi) { markFor(roi, 1); }
 
@@ -133,23 +153,21 @@ public:
 
     void swap(Bitmap& other);
 
-    const char* getBitmap() const
-    {
-        return &_map.front();
-    }
-
-    char* getBitmap()
-    {
-        return &_map.front();
-    }
-
-    const char* getBitmapAt(int x, int y) const;
-    char* getBitmapAt(int x, int y);
+    ///Returns the value of the pixel (x,y), which must be within the bounds
+    char getValueAt(int x, int y) const;
 
     void copyRowPortion(int x1, int x2, int y, const Bitmap& other);
 
     void copyBitmapPortion(const RectI& roi, const Bitmap& other);
 
+    /**
+     * @brief Marks the pixels of dstRoI as rendered if all the pixels of other that they cover at the mipmap level
+     * below are rendered, and as not rendered otherwise. The pixels of other being rendered count as not rendered,
+     * otherwise the caller would have to wait for the original fullscale image render to be finished and then
+     * re-downscale again.
+     **/
+    void halveRoI(const RectI& dstRoI, const Bitmap& other);
+
     void setDirtyZone(const RectI& zone)
     {
         _dirtyZone = zone;
@@ -157,11 +175,62 @@ public:
     }
 
 private:
+
+    struct TileState
+    {
+        // the value of all the pixels of the tile, or eTileMixed if they have different values, in which case
+        // their values are in _tilePixels
+        char value;
+
+        // number of pixels of each value within the bounds, only maintained for mixed tiles
+        int count[3];
+    };
+
+    enum
+    {
+        eTileMixed = 3
+    };
+
     void markFor(const RectI & roi, char value);
 
+    RectI getTileRect(int tx, int ty) const;
+
+    int getTileIndex(int tx, int ty) const
+    {
+        return (ty - _tiles.y1) * _tiles.width() + (tx - _tiles.x1);
+    }
+
+    char* getTilePixelsForWrite(int tileIndex, const RectI& tileRect);
+
+    void setTileValue(int tileIndex, char value);
+
+    void writeTilePixels(int tx, int ty, int x1, int x2, int y, const char* values, char value);
+
+    bool hasValues(const RectI& rect, int valuesMask) const;
+
+    bool hasValuesOutside(const RectI& rect, const RectI& inner, int valuesMask) const;
+
+    RectI getValuesBbox(const RectI& rect, int valuesMask) const;
+
+    void getRow(int x1, int x2, int y, char* values) const;
+
+    template <int trimap>
+    RectI minimalNonMarkedBbox_internal(const RectI& roi, bool* isBeingRenderedElsewhere) const;
+
+    template <int trimap>
+    void minimalNonMarkedRects_internal(const RectI & roi, std::list<RectI>& ret, bool* isBeingRenderedElsewhere) const;
+
 private:
     RectI _bounds;
-    std::vector<char> _map;
+
+    // the tiles overlapping _bounds, in units of NATRON_BITMAP_TILE_SIZE pixels
+    RectI _tiles;
+    std::vector<TileState> _tileStates;
+
+    // the values of the pixels of the mixed tiles, row by row, NATRON_BITMAP_TILE_SIZE * NATRON_BITMAP_TILE_SIZE
+    // values including the pixels out of the bounds. Empty for the uniform tiles.
+    std::vector<std::vector<char> > _tilePixels;
+    int _mixedTilesCount;
 
     /**
      * This represents the zone that has potentially something to render. In minimalNonMarkedRects
@@ -303,7 +372,7 @@ public:
         std::size_t dt = dataSize();
         bool got = _entryLock.tryLockForRead();
 
-        dt += _bitmap.getBounds().area();
+        dt += _bitmap.getMemorySize();
         if (got) {
             _entryLock.unlock();
         }
@@ -317,7 +386,7 @@ public:
         return size();
     }
 
-    unsigned int getMipMapLevel() const
+    virtual unsigned int getMipMapLevel() const OVERRIDE FINAL
     {
         return this->_params->getMipMapLevel();
     }
@@ -410,14 +479,6 @@ public:
 
             return img->pixelAt(x, y);
         }
-
-        const char* bitmapAt(int x,
-                             int y) const
-        {
-            assert(img);
-
-            return img->getBitmapAt(x, y);
-        }
     };
 
     typedef boost::shared_ptr<ReadAccess> ReadAccessPtr;
@@ -463,12 +524,14 @@ public:
             return img->pixelAt(x, y);
         }
 
-        char* bitmapAt(int x,
-                       int y) const
+        /**
+         * @brief Marks the pixels of roi as rendered in the bitmap.
+         **/
+        void markBitmapForRendered(const RectI& roi)
         {
             assert(img);
 
-            return img->getBitmapAt(x, y);
+            img->_bitmap.markForRendered(roi);
         }
     };
 
@@ -496,18 +559,6 @@ private:
      * of an image.
      **/
 
-    const char* getBitmapAt(int x,
-                            int y) const
-    {
-        return this->_bitmap.getBitmapAt(x, y);
-    }
-
-    char* getBitmapAt(int x,
-                      int y)
-    {
-        return this->_bitmap.getBitmapAt(x, y);
-    }
-
     /**
      * @brief Access pixels. The pointer must be cast to the appropriate type afterwards.
      **/
@@ -589,6 +640,21 @@ private:
                                                      ViewerColorSpaceEnum dstColorSpace,
                                                      int channelForAlpha);
 
+    /**
+     * @brief Row by row version of convertToFormatInternalForColorSpace for linear float and half sources, using the
+     * kernels of ImageConvertSIMD. dstLut, the colorspace of byte destinations, may be NULL. If unpremult is true,
+     * RGBA sources are unpremultiplied before the colorspace conversion.
+     * channelForAlpha must have been validated by the caller.
+     **/
+    template <typename SRCPIX, typename DSTPIX, int dstMaxValue, int srcNComps, int dstNComps>
+    static void convertToFormatInternalRows(const RectI & renderWindow,
+                                            const Image & srcImg,
+                                            Image & dstImg,
+                                            const Color::Lut* dstLut,
+                                            bool unpremult,
+                                            bool useAlpha0,
+                                            int channelForAlpha);
+
 
     template <typename SRCPIX, typename DSTPIX, int srcMaxValue, int dstMaxValue>
     static void convertToFormatInternalForDepth(const RectI & renderWindow,
@@ -875,6 +941,23 @@ public:
                        float mix,
                        const OSGLContextPtr& glContext = OSGLContextPtr() );
 
+    /**
+     * @brief Same as copyUnProcessedChannels() followed by applyMaskMix() if useMaskMix is true, but the post-render
+     * processing of CPU images is done in a single pass over the RoI.
+     **/
+    void copyUnProcessedChannelsAndApplyMaskMix( const RectI& roi,
+                                                 ImagePremultiplicationEnum outputPremult,
+                                                 ImagePremultiplicationEnum originalImagePremult,
+                                                 std::bitset<4> processChannels,
+                                                 const ImagePtr& originalImage,
+                                                 bool ignorePremult,
+                                                 bool useMaskMix,
+                                                 const Image* maskImg,
+                                                 bool masked,
+                                                 bool maskInvert,
+                                                 float mix,
+                                                 const OSGLContextPtr& glContext = OSGLContextPtr() );
+
     /**
      * @brief Eeturns true if image contains NaNs or infinite values, and fix them.
      * Currently, no OpenGL implementation is provided.
@@ -980,6 +1063,31 @@ private:
                                          bool originalPremult,
                                          bool ignorePremult);
 
+    template <typename PIX, int maxValue, int srcNComps, int dstNComps, bool masked, bool maskInvert>
+    void copyUnProcessedChannelsAndApplyMaskMixForMaskInvert(const RectI& roi,
+                                                             std::bitset<4> processChannels,
+                                                             const Image* originalImg,
+                                                             const Image* maskImg,
+                                                             float mix);
+
+    template <typename PIX, int maxValue, int srcNComps, int dstNComps>
+    void copyUnProcessedChannelsAndApplyMaskMixForComponents(const RectI& roi,
+                                                             std::bitset<4> processChannels,
+                                                             const Image* originalImg,
+                                                             const Image* maskImg,
+                                                             bool masked,
+                                                             bool maskInvert,
+                                                             float mix);
+
+    template <typename PIX, int maxValue>
+    void copyUnProcessedChannelsAndApplyMaskMixForDepth(const RectI& roi,
+                                                        std::bitset<4> processChannels,
+                                                        const Image* originalImg,
+                                                        const Image* maskImg,
+                                                        bool masked,
+                                                        bool maskInvert,
+                                                        float mix);
+
 
     /**
      * @brief Given the output buffer,the region of interest and the mip map level, this
@@ -989,6 +1097,13 @@ private:
     void buildMipMapLevel(const RectD& dstRoD, const RectI & roiCanonical, unsigned int level, bool copyBitMap,
                           Image* output) const;
 
+    /**
+     * @brief Builds the mipmap levels of the rows of the roi of buildMipMapLevel() that the band covers.
+     * MT-safe: bands are built in parallel.
+     **/
+    void buildMipMapLevelForBand(const RectD& dstRoD, const RectI & band, unsigned int level, bool copyBitMap,
+                                 Image* output) const;
+
 
     /**
      * @brief Halve the given roi of this image into output.
@@ -1071,6 +1186,10 @@ template<>
 inline float
 Image::clampIfInt(float v) { return v; }
 
+template<>
+inline Half
+Image::clampIfInt(float v) { return v; }
+
 NATRON_NAMESPACE_EXIT
 
 #endif // NATRON_ENGINE_IMAGE_H
@@ -28,6 +28,7 @@
 #include <algorithm> // min, max
 #include <cassert>
 #include <stdexcept>
+#include <vector>
 
 #ifndef Q_MOC_RUN
 GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
@@ -38,6 +39,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include <QtCore/QDebug>
 
 #include "Engine/AppManager.h"
+#include "Engine/ImageConvertSIMD.h"
 #include "Engine/Lut.h"
 
 NATRON_NAMESPACE_ENTER
@@ -109,6 +111,55 @@ Image::convertPixelDepth(float pix)
     return pix;
 }
 
+template <>
+Half
+Image::convertPixelDepth(unsigned char pix)
+{
+    return Color::intToFloat<256>(pix);
+}
+
+template <>
+Half
+Image::convertPixelDepth(unsigned short pix)
+{
+    return Color::intToFloat<65536>(pix);
+}
+
+template <>
+Half
+Image::convertPixelDepth(float pix)
+{
+    return pix;
+}
+
+template <>
+Half
+Image::convertPixelDepth(Half pix)
+{
+    return pix;
+}
+
+template <>
+unsigned char
+Image::convertPixelDepth(Half pix)
+{
+    return (unsigned char)Color::floatToInt<256>(pix);
+}
+
+template <>
+unsigned short
+Image::convertPixelDepth(Half pix)
+{
+    return (unsigned short)Color::floatToInt<65536>(pix);
+}
+
+template <>
+float
+Image::convertPixelDepth(Half pix)
+{
+    return pix;
+}
+
 static const Color::Lut*
 lutFromColorspace(ViewerColorSpaceEnum cs)
 {
@@ -133,6 +184,156 @@ lutFromColorspace(ViewerColorSpaceEnum cs)
     return lut;
 }
 
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+///Converts rows of samples to another bit depth with the kernels of ImageConvertSIMD, if there is one for these depths
+template <typename SRCPIX, typename DSTPIX>
+struct RowDepthConverter
+{
+    static const bool supported = false;
+
+    static void convert(const SRCPIX* /*src*/,
+                        DSTPIX* /*dst*/,
+                        std::size_t /*count*/)
+    {
+        assert(false);
+    }
+};
+
+template <>
+struct RowDepthConverter<float, float>
+{
+    static const bool supported = true;
+
+    static void convert(const float* src,
+                        float* dst,
+                        std::size_t count)
+    {
+        std::copy(src, src + count, dst);
+    }
+};
+
+template <>
+struct RowDepthConverter<float, unsigned short>
+{
+    static const bool supported = true;
+
+    static void convert(const float* src,
+                        unsigned short* dst,
+                        std::size_t count)
+    {
+        ImageConvertSIMD::floatToUint16(src, dst, count, 65535);
+    }
+};
+
+template <>
+struct RowDepthConverter<float, unsigned char>
+{
+    static const bool supported = true;
+
+    static void convert(const float* src,
+                        unsigned char* dst,
+                        std::size_t count)
+    {
+        ImageConvertSIMD::floatToByte(src, dst, count);
+    }
+};
+
+template <>
+struct RowDepthConverter<unsigned short, float>
+{
+    static const bool supported = true;
+
+    static void convert(const unsigned short* src,
+                        float* dst,
+                        std::size_t count)
+    {
+        ImageConvertSIMD::shortToFloat(src, dst, count);
+    }
+};
+
+template <>
+struct RowDepthConverter<unsigned char, float>
+{
+    static const bool supported = true;
+
+    static void convert(const unsigned char* src,
+                        float* dst,
+                        std::size_t count)
+    {
+        ImageConvertSIMD::byteToFloat(src, dst, count);
+    }
+};
+
+template <>
+struct RowDepthConverter<Half, Half>
+{
+    static const bool supported = true;
+
+    static void convert(const Half* src,
+                        Half* dst,
+                        std::size_t count)
+    {
+        std::copy(src, src + count, dst);
+    }
+};
+
+template <>
+struct RowDepthConverter<Half, float>
+{
+    static const bool supported = true;
+
+    static void convert(const Half* src,
+                        float* dst,
+                        std::size_t count)
+    {
+        ImageConvertSIMD::halfToFloat(src, dst, count);
+    }
+};
+
+template <>
+struct RowDepthConverter<float, Half>
+{
+    static const bool supported = true;
+
+    static void convert(const float* src,
+                        Half* dst,
+                        std::size_t count)
+    {
+        ImageConvertSIMD::floatToHalf(src, dst, count);
+    }
+};
+
+/**
+ * @brief Converts the RGB samples of a row, quantized to 0-0xff00 by ImageConvertSIMD::floatToUint16() or
+ * Color::Lut::toColorSpaceUint8xxFromLinearFloatFast(), to bytes with the error diffusion of
+ * convertToFormatInternalForColorSpace: from start to the end of the row, then from start - 1 to the beginning of the row.
+ **/
+void
+diffuseRgbRowToByte(const unsigned short* rgb,
+                    unsigned char* dstPixels,
+                    int dstNComps,
+                    int width,
+                    int start)
+{
+    for (int backward = 0; backward < 2; ++backward) {
+        int step = backward ? -1 : 1;
+        int end = backward ? -1 : width;
+        unsigned error[3] = {
+            0x80, 0x80, 0x80
+        };
+
+        for (int x = backward ? start - 1 : start; x != end; x += step) {
+            for (int k = 0; k < 3; ++k) {
+                error[k] = (error[k] & 0xff) + rgb[x * 3 + k];
+                dstPixels[x * dstNComps + k] = (unsigned char)(error[k] >> 8);
+            }
+        }
+    }
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
 ///Fast version when components are the same
 template <typename SRCPIX, typename DSTPIX, int srcMaxValue, int dstMaxValue>
 void
@@ -163,6 +364,54 @@ Image::convertToFormatInternal_sameComps(const RectI & renderWindow,
     if ( intersection.isNull() ) {
         return;
     }
+    if ( (srcMaxValue == 1) && (dstMaxValue == 255) && !srcLut && dstLut && ( (nComp == 3) || (nComp == 4) ) ) {
+        ///Linear float and half to byte: the lookups of a row are done at once, only the error diffusion is sequential
+        const int width = intersection.width();
+        const bool srcIsFloat = sizeof(SRCPIX) == sizeof(float);
+        std::vector<float> srcRow(srcIsFloat ? 0 : width * nComp);
+        std::vector<float> rgbRow(width * 3);
+        std::vector<unsigned short> quantizedRow(width * 3);
+        for (int y = 0; y < intersection.height(); ++y) {
+            const float* srcPixels = (const float*)srcImg.pixelAt(intersection.x1, intersection.y1 + y);
+            if (!srcIsFloat) {
+                RowDepthConverter<SRCPIX, float>::convert( (const SRCPIX*)srcPixels, &srcRow[0], width * nComp );
+                srcPixels = &srcRow[0];
+            }
+            unsigned char* dstPixels = (unsigned char*)dstImg.pixelAt(intersection.x1, intersection.y1 + y);
+            const float* rgb = srcPixels;
+            if (nComp == 4) {
+                ImageConvertSIMD::rgbaToRgb(srcPixels, &rgbRow[0], width);
+                rgb = &rgbRow[0];
+            }
+            dstLut->toColorSpaceUint8xxFromLinearFloatFast(rgb, &quantizedRow[0], width * 3);
+            // coverity[dont_call]
+            diffuseRgbRowToByte(&quantizedRow[0], dstPixels, nComp, width, rand() % width);
+            if (nComp == 4) {
+                ///Alpha has no colorspace
+                for (int x = 0; x < width; ++x) {
+                    dstPixels[x * 4 + 3] = convertPixelDepth<float, unsigned char>(srcPixels[x * 4 + 3]);
+                }
+            }
+            if (copyBitmap) {
+                dstImg.copyBitmapRowPortion(intersection.x1, intersection.x2, intersection.y1 + y, srcImg);
+            }
+        }
+
+        return;
+    }
+    if ( !srcLut && !dstLut && RowDepthConverter<SRCPIX, DSTPIX>::supported ) {
+        ///There is no error diffusion without colorspace conversion: convert whole rows at once
+        for (int y = 0; y < intersection.height(); ++y) {
+            RowDepthConverter<SRCPIX, DSTPIX>::convert( (const SRCPIX*)srcImg.pixelAt(intersection.x1, intersection.y1 + y),
+                                                        (DSTPIX*)dstImg.pixelAt(intersection.x1, intersection.y1 + y),
+                                                        intersection.width() * nComp );
+            if (copyBitmap) {
+                dstImg.copyBitmapRowPortion(intersection.x1, intersection.x2, intersection.y1 + y, srcImg);
+            }
+        }
+
+        return;
+    }
     for (int y = 0; y < intersection.height(); ++y) {
         // coverity[dont_call]
         int start = rand() % intersection.width();
@@ -207,7 +456,7 @@ Image::convertToFormatInternal_sameComps(const RectI & renderWindow,
                                                              Color::floatToInt<0xff01>(pixFloat) );
                             pix = error[k] >> 8;
                         } else if (dstDepth == eImageBitDepthShort) {
-                            pix = dstLut ? dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) :
+                            pix = dstLut ? DSTPIX( dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) ) :
                                   convertPixelDepth<float, DSTPIX>(pixFloat);
                         } else {
                             if (dstLut) {
@@ -307,6 +556,23 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
     const Color::Lut* const srcLut = useColorspaces ? lutFromColorspace( (ViewerColorSpaceEnum)srcColorSpace ) : 0;
     const Color::Lut* const dstLut = useColorspaces ? lutFromColorspace( (ViewerColorSpaceEnum)dstColorSpace ) : 0;
 
+    ///Linear float and half images are converted row by row with SIMD kernels, byte destinations may have a colorspace
+    if ( (srcMaxValue == 1) && !srcLut && ( !dstLut || (dstMaxValue == 255) ) &&
+         ( ( (dstNComps == 1) && (channelForAlpha != -1) ) ||
+           ( (srcNComps == 4) && (dstNComps == 3) ) ||
+           ( (srcNComps == 3) && (dstNComps == 4) ) ) ) {
+        convertToFormatInternalRows<SRCPIX, DSTPIX, dstMaxValue, srcNComps, dstNComps>(renderWindow, srcImg, dstImg, dstLut, requiresUnpremult && dstLut, useAlpha0, channelForAlpha);
+        if (copyBitmap) {
+            dstImg.copyBitmapPortion(renderWindow, srcImg);
+        }
+
+        return;
+    }
+
+    ///Unpremultiplied float rows are computed with SIMD kernels before the colorspace conversion
+    const bool unpremultRows = ( sizeof(SRCPIX) == sizeof(float) ) && (srcMaxValue == 1) && requiresUnpremult && useColorspaces && (srcNComps == 4) && (dstNComps == 3);
+    std::vector<float> unpremultRow(unpremultRows ? renderWindow.width() * 3 : 0);
+
     for (int y = 0; y < renderWindow.height(); ++y) {
         ///Start of the line for error diffusion
         // coverity[dont_call]
@@ -316,6 +582,10 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
         const SRCPIX* srcStart = srcPixels;
         DSTPIX* dstStart = dstPixels;
 
+        if (unpremultRows) {
+            ImageConvertSIMD::unpremultRgbaToRgb( (const float*)srcImg.pixelAt(renderWindow.x1, renderWindow.y1 + y), &unpremultRow[0], renderWindow.width() );
+        }
+
         for (int backward = 0; backward < 2; ++backward) {
             ///We do twice the loop, once from starting point to end and once from starting point - 1 to real start
             int x = backward ? start - 1 : start;
@@ -341,11 +611,11 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
                         break;
                     case 3:
                         // RGB is opaque, so no alpha, unless channelForAlpha is 0-2
-                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? 0. : srcPixels[channelForAlpha]);
+                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? SRCPIX(0) : srcPixels[channelForAlpha]);
                         break;
                     case 2:
                         // XY is opaque unless channelForAlpha is  0-1
-                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? 0. : srcPixels[channelForAlpha]);
+                        pix = convertPixelDepth<SRCPIX, DSTPIX>(channelForAlpha == -1 ? SRCPIX(0) : srcPixels[channelForAlpha]);
                         break;
                     case 1:
                         // just copy alpha disregarding channelForAlpha
@@ -402,7 +672,12 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
                                 float pixFloat;
 
                                 ///Unpremult before doing colorspace conversion from linear to X
-                                if (unpremultChannel) {
+                                if (unpremultRows) {
+                                    pixFloat = unpremultRow[x * 3 + k];
+                                    if (srcLut) {
+                                        pixFloat = srcLut->fromColorSpaceFloatToLinearFloat(pixFloat);
+                                    }
+                                } else if (unpremultChannel) {
                                     pixFloat = convertPixelDepth<SRCPIX, float>(sourcePixel);
                                     pixFloat = alphaForUnPremult == 0.f ? 0. : pixFloat / alphaForUnPremult;
                                     if (srcLut) {
@@ -427,7 +702,7 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
                                                                      Color::floatToInt<0xff01>(pixFloat) );
                                     pix = error[k] >> 8;
                                 } else if (dstMaxValue == 65535) {
-                                    pix = dstLut ? dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) :
+                                    pix = dstLut ? DSTPIX( dstLut->toColorSpaceUint16FromLinearFloatFast(pixFloat) ) :
                                           convertPixelDepth<float, DSTPIX>(pixFloat);
                                 } else {
                                     if (dstLut) {
@@ -468,6 +743,77 @@ Image::convertToFormatInternalForColorSpace(const RectI & renderWindow,
     }
 } // Image::convertToFormatInternalForColorSpace
 
+template <typename SRCPIX, typename DSTPIX, int dstMaxValue, int srcNComps, int dstNComps>
+void
+Image::convertToFormatInternalRows(const RectI & renderWindow,
+                                   const Image & srcImg,
+                                   Image & dstImg,
+                                   const Color::Lut* dstLut,
+                                   bool unpremult,
+                                   bool useAlpha0,
+                                   int channelForAlpha)
+{
+    const int width = renderWindow.width();
+    const float alpha = useAlpha0 ? 0.f : 1.f;
+    ///Half rows are converted to float first
+    const bool srcIsFloat = sizeof(SRCPIX) == sizeof(float);
+    const bool dstIsFloat = sizeof(DSTPIX) == sizeof(float);
+    std::vector<float> srcRow(srcIsFloat ? 0 : width * srcNComps);
+    std::vector<float> floatRow(width * 4);
+    std::vector<unsigned short> quantizedRow(dstMaxValue == 255 ? width * 3 : 0);
+
+    for (int y = 0; y < renderWindow.height(); ++y) {
+        const float* srcPixels = (const float*)srcImg.pixelAt(renderWindow.x1, renderWindow.y1 + y);
+        if (!srcIsFloat) {
+            RowDepthConverter<SRCPIX, float>::convert( (const SRCPIX*)srcPixels, &srcRow[0], width * srcNComps );
+            srcPixels = &srcRow[0];
+        }
+        DSTPIX* dstPixels = (DSTPIX*)dstImg.pixelAt(renderWindow.x1, renderWindow.y1 + y);
+        ///Float destinations are written directly
+        float* converted = dstIsFloat ? (float*)dstPixels : &floatRow[0];
+
+        if (dstNComps == 1) {
+            ///No error diffusion when converting to alpha
+            ImageConvertSIMD::extractChannel(srcPixels, srcNComps, channelForAlpha, converted, width);
+            if (!dstIsFloat) {
+                RowDepthConverter<float, DSTPIX>::convert(converted, dstPixels, width);
+            }
+        } else if (dstMaxValue == 255) {
+            ///Quantize RGB, then diffuse the errors from a random start on the line
+            const float* rgb = srcPixels;
+            if (srcNComps == 4) {
+                if (unpremult) {
+                    ImageConvertSIMD::unpremultRgbaToRgb(srcPixels, &floatRow[0], width);
+                } else {
+                    ImageConvertSIMD::rgbaToRgb(srcPixels, &floatRow[0], width);
+                }
+                rgb = &floatRow[0];
+            }
+            if (dstLut) {
+                dstLut->toColorSpaceUint8xxFromLinearFloatFast(rgb, &quantizedRow[0], width * 3);
+            } else {
+                ImageConvertSIMD::floatToUint16(rgb, &quantizedRow[0], width * 3, 0xff00);
+            }
+            // coverity[dont_call]
+            diffuseRgbRowToByte(&quantizedRow[0], (unsigned char*)dstPixels, dstNComps, width, rand() % width);
+            if (dstNComps == 4) {
+                for (int x = 0; x < width; ++x) {
+                    dstPixels[x * 4 + 3] = convertPixelDepth<float, DSTPIX>(alpha);
+                }
+            }
+        } else {
+            if (srcNComps == 4) {
+                ImageConvertSIMD::rgbaToRgb(srcPixels, converted, width);
+            } else {
+                ImageConvertSIMD::rgbToRgba(srcPixels, converted, width, alpha);
+            }
+            if (!dstIsFloat) {
+                RowDepthConverter<float, DSTPIX>::convert(converted, dstPixels, width * dstNComps);
+            }
+        }
+    }
+} // Image::convertToFormatInternalRows
+
 template <typename SRCPIX, typename DSTPIX, int srcMaxValue, int dstMaxValue, int srcNComps, int dstNComps,
           bool requiresUnpremult>
 void
@@ -700,6 +1046,9 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                              dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternal_sameComps<Half, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
+                                                                               srcColorSpace,
+                                                                               dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternal_sameComps<float, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
@@ -726,6 +1075,9 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                                 dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternal_sameComps<Half, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
+                                                                                  srcColorSpace,
+                                                                                  dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternal_sameComps<float, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
@@ -738,8 +1090,34 @@ Image::convertToFormatCommon(const RectI & renderWindow,
             break;
         }
 
-        case eImageBitDepthHalf:
+        case eImageBitDepthHalf: {
+            switch ( getBitDepth() ) {
+            case eImageBitDepthByte:
+                convertToFormatInternal_sameComps<unsigned char, Half, 255, 1>(renderWindow, *this, *dstImg,
+                                                                               srcColorSpace,
+                                                                               dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthShort:
+                convertToFormatInternal_sameComps<unsigned short, Half, 65535, 1>(renderWindow, *this, *dstImg,
+                                                                                  srcColorSpace,
+                                                                                  dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthHalf:
+                ///Same as a copy
+                convertToFormatInternal_sameComps<Half, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                    srcColorSpace,
+                                                                    dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthFloat:
+                convertToFormatInternal_sameComps<float, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                     srcColorSpace,
+                                                                     dstColorSpace, copyBitmap);
+                break;
+            case eImageBitDepthNone:
+                break;
+            }
             break;
+        }
 
         case eImageBitDepthFloat: {
             switch ( getBitDepth() ) {
@@ -754,6 +1132,9 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                    dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternal_sameComps<Half, float, 1, 1>(renderWindow, *this, *dstImg,
+                                                                     srcColorSpace,
+                                                                     dstColorSpace, copyBitmap);
                 break;
             case eImageBitDepthFloat:
                 ///Same as a copy
@@ -791,6 +1172,12 @@ Image::convertToFormatCommon(const RectI & renderWindow,
                                                                                            copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
+                                                                             srcColorSpace,
+                                                                             dstColorSpace,
+                                                                             channelForAlpha,
+                                                                             useAlpha0,
+                                                                             copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternalForDepth<float, unsigned char, 1, 255>(renderWindow, *this, *dstImg,
@@ -827,6 +1214,12 @@ Image::convertToFormatCommon(const RectI & renderWindow,
 
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
+                                                                                srcColorSpace,
+                                                                                dstColorSpace,
+                                                                                channelForAlpha,
+                                                                                useAlpha0,
+                                                                                copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternalForDepth<float, unsigned short, 1, 65535>(renderWindow, *this, *dstImg,
@@ -841,8 +1234,45 @@ Image::convertToFormatCommon(const RectI & renderWindow,
             }
             break;
         }
-        case eImageBitDepthHalf:
+        case eImageBitDepthHalf: {
+            switch ( getBitDepth() ) {
+            case eImageBitDepthByte:
+                convertToFormatInternalForDepth<unsigned char, Half, 255, 1>(renderWindow, *this, *dstImg,
+                                                                             srcColorSpace,
+                                                                             dstColorSpace,
+                                                                             channelForAlpha,
+                                                                             useAlpha0,
+                                                                             copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthShort:
+                convertToFormatInternalForDepth<unsigned short, Half, 65535, 1>(renderWindow, *this, *dstImg,
+                                                                                srcColorSpace,
+                                                                                dstColorSpace,
+                                                                                channelForAlpha,
+                                                                                useAlpha0,
+                                                                                copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                  srcColorSpace,
+                                                                  dstColorSpace,
+                                                                  channelForAlpha,
+                                                                  useAlpha0,
+                                                                  copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthFloat:
+                convertToFormatInternalForDepth<float, Half, 1, 1>(renderWindow, *this, *dstImg,
+                                                                   srcColorSpace,
+                                                                   dstColorSpace,
+                                                                   channelForAlpha,
+                                                                   useAlpha0,
+                                                                   copyBitmap, requiresUnpremult);
+                break;
+            case eImageBitDepthNone:
+                break;
+            }
             break;
+        }
         case eImageBitDepthFloat: {
             switch ( getBitDepth() ) {
             case eImageBitDepthByte:
@@ -863,6 +1293,12 @@ Image::convertToFormatCommon(const RectI & renderWindow,
 
                 break;
             case eImageBitDepthHalf:
+                convertToFormatInternalForDepth<Half, float, 1, 1>(renderWindow, *this, *dstImg,
+                                                                   srcColorSpace,
+                                                                   dstColorSpace,
+                                                                   channelForAlpha,
+                                                                   useAlpha0,
+                                                                   copyBitmap, requiresUnpremult);
                 break;
             case eImageBitDepthFloat:
                 convertToFormatInternalForDepth<float, float, 1, 1>(renderWindow, *this, *dstImg,
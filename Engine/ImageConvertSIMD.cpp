@@ -0,0 +1,823 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ImageConvertSIMD.h"
+
+#include <cassert>
+
+#include "Engine/CPUFeatures.h"
+#include "Engine/Half.h"
+
+#ifdef NATRON_USE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/*
+ * The SIMD kernels must give exactly the results of the scalar code, so that an image does not depend on the CPU
+ * it was rendered on:
+ * - values are clamped with min/max before the multiplication, which also maps NaN to 0 like the scalar code does
+ *   in practice (the conversion of NaN to an integer yields 0x80000000),
+ * - multiplications and additions are not fused, and divisions are not replaced by multiplications by the inverse,
+ * - conversions to integers truncate, like C casts.
+ * Each kernel processes the bulk of the row and leaves the remainder to the scalar code.
+ */
+
+NATRON_NAMESPACE_ENTER
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scalar code
+
+/// Same as Color::floatToInt<maxValue + 1>()
+inline int
+quantize(float value,
+         int maxValue)
+{
+    if (value <= 0) {
+        return 0;
+    } else if (value >= 1.) {
+        return maxValue;
+    }
+    float v = value * maxValue + 0.5f;
+
+    return int(v);
+}
+
+void
+floatToUint16Scalar(const float* src,
+                    unsigned short* dst,
+                    std::size_t count,
+                    int maxValue)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = (unsigned short)quantize(src[i], maxValue);
+    }
+}
+
+void
+floatToByteScalar(const float* src,
+                  unsigned char* dst,
+                  std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = (unsigned char)quantize(src[i], 255);
+    }
+}
+
+void
+byteToFloatScalar(const unsigned char* src,
+                  float* dst,
+                  std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = src[i] / 255.f;
+    }
+}
+
+void
+shortToFloatScalar(const unsigned short* src,
+                   float* dst,
+                   std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = src[i] / 65535.f;
+    }
+}
+
+void
+halfToFloatScalar(const Half* src,
+                  float* dst,
+                  std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = src[i];
+    }
+}
+
+void
+floatToHalfScalar(const float* src,
+                  Half* dst,
+                  std::size_t count)
+{
+    for (std::size_t i = 0; i < count; ++i) {
+        dst[i] = src[i];
+    }
+}
+
+void
+rgbaToRgbScalar(const float* src,
+                float* dst,
+                std::size_t nPixels)
+{
+    for (std::size_t i = 0; i < nPixels; ++i, src += 4, dst += 3) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+    }
+}
+
+void
+rgbToRgbaScalar(const float* src,
+                float* dst,
+                std::size_t nPixels,
+                float alpha)
+{
+    for (std::size_t i = 0; i < nPixels; ++i, src += 3, dst += 4) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = alpha;
+    }
+}
+
+void
+extractChannelScalar(const float* src,
+                     int nComps,
+                     int channel,
+                     float* dst,
+                     std::size_t nPixels)
+{
+    src += channel;
+    for (std::size_t i = 0; i < nPixels; ++i, src += nComps) {
+        dst[i] = *src;
+    }
+}
+
+void
+unpremultRgbaToRgbScalar(const float* src,
+                         float* dst,
+                         std::size_t nPixels)
+{
+    for (std::size_t i = 0; i < nPixels; ++i, src += 4, dst += 3) {
+        float alpha = src[3];
+        for (int k = 0; k < 3; ++k) {
+            dst[k] = alpha == 0.f ? 0.f : src[k] / alpha;
+        }
+    }
+}
+
+#ifdef NATRON_USE_X86_SIMD
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SSE4.2 code, 4 floats per register
+
+/// Clamps to [0,1] and scales, as quantize() does. The result must be truncated to an integer.
+NATRON_TARGET_SSE42 inline __m128
+clampAndScaleSSE42(__m128 v,
+                   __m128 scale)
+{
+    // max returns its second operand if either is NaN
+    v = _mm_min_ps( _mm_max_ps( v, _mm_setzero_ps() ), _mm_set1_ps(1.f) );
+
+    return _mm_add_ps( _mm_mul_ps(v, scale), _mm_set1_ps(0.5f) );
+}
+
+/// Stores the RGB channels of 4 RGBA pixels in 12 floats
+NATRON_TARGET_SSE42 inline void
+storeRgbFromRgbaSSE42(__m128 p0,
+                      __m128 p1,
+                      __m128 p2,
+                      __m128 p3,
+                      float* dst)
+{
+    // r0 g0 b0 r1
+    _mm_storeu_ps( dst, _mm_blend_ps( p0, _mm_shuffle_ps( p1, p1, _MM_SHUFFLE(0, 0, 0, 0) ), 0x8 ) );
+    // g1 b1 r2 g2
+    _mm_storeu_ps( dst + 4, _mm_shuffle_ps( p1, p2, _MM_SHUFFLE(1, 0, 2, 1) ) );
+    // b2 r3 g3 b3
+    _mm_storeu_ps( dst + 8, _mm_blend_ps( _mm_shuffle_ps( p3, p3, _MM_SHUFFLE(2, 1, 0, 0) ), _mm_shuffle_ps( p2, p2, _MM_SHUFFLE(2, 2, 2, 2) ), 0x1 ) );
+}
+
+NATRON_TARGET_SSE42 void
+floatToUint16SSE42(const float* src,
+                   unsigned short* dst,
+                   std::size_t count,
+                   int maxValue)
+{
+    const __m128 scale = _mm_set1_ps( (float)maxValue );
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i a = _mm_cvttps_epi32( clampAndScaleSSE42(_mm_loadu_ps(src + i), scale) );
+        __m128i b = _mm_cvttps_epi32( clampAndScaleSSE42(_mm_loadu_ps(src + i + 4), scale) );
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi32(a, b) );
+    }
+    floatToUint16Scalar(src + i, dst + i, count - i, maxValue);
+}
+
+NATRON_TARGET_SSE42 void
+floatToByteSSE42(const float* src,
+                 unsigned char* dst,
+                 std::size_t count)
+{
+    const __m128 scale = _mm_set1_ps(255.f);
+    std::size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_cvttps_epi32( clampAndScaleSSE42(_mm_loadu_ps(src + i), scale) );
+        __m128i b = _mm_cvttps_epi32( clampAndScaleSSE42(_mm_loadu_ps(src + i + 4), scale) );
+        __m128i c = _mm_cvttps_epi32( clampAndScaleSSE42(_mm_loadu_ps(src + i + 8), scale) );
+        __m128i d = _mm_cvttps_epi32( clampAndScaleSSE42(_mm_loadu_ps(src + i + 12), scale) );
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm_packus_epi16( _mm_packus_epi32(a, b), _mm_packus_epi32(c, d) ) );
+    }
+    floatToByteScalar(src + i, dst + i, count - i);
+}
+
+NATRON_TARGET_SSE42 void
+byteToFloatSSE42(const unsigned char* src,
+                 float* dst,
+                 std::size_t count)
+{
+    const __m128 scale = _mm_set1_ps(255.f);
+    std::size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        for (int j = 0; j < 4; ++j) {
+            _mm_storeu_ps( dst + i + 4 * j, _mm_div_ps(_mm_cvtepi32_ps( _mm_cvtepu8_epi32(v) ), scale) );
+            v = _mm_srli_si128(v, 4);
+        }
+    }
+    byteToFloatScalar(src + i, dst + i, count - i);
+}
+
+NATRON_TARGET_SSE42 void
+shortToFloatSSE42(const unsigned short* src,
+                  float* dst,
+                  std::size_t count)
+{
+    const __m128 scale = _mm_set1_ps(65535.f);
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm_storeu_ps( dst + i, _mm_div_ps(_mm_cvtepi32_ps( _mm_cvtepu16_epi32(v) ), scale) );
+        _mm_storeu_ps( dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps( _mm_cvtepu16_epi32( _mm_srli_si128(v, 8) ) ), scale) );
+    }
+    shortToFloatScalar(src + i, dst + i, count - i);
+}
+
+NATRON_TARGET_SSE42 void
+rgbaToRgbSSE42(const float* src,
+               float* dst,
+               std::size_t nPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 4 <= nPixels; i += 4, src += 16, dst += 12) {
+        storeRgbFromRgbaSSE42(_mm_loadu_ps(src), _mm_loadu_ps(src + 4), _mm_loadu_ps(src + 8), _mm_loadu_ps(src + 12), dst);
+    }
+    rgbaToRgbScalar(src, dst, nPixels - i);
+}
+
+NATRON_TARGET_SSE42 void
+rgbToRgbaSSE42(const float* src,
+               float* dst,
+               std::size_t nPixels,
+               float alpha)
+{
+    const __m128 a = _mm_set1_ps(alpha);
+    std::size_t i = 0;
+
+    for (; i + 4 <= nPixels; i += 4, src += 12, dst += 16) {
+        // r0 g0 b0 r1, g1 b1 r2 g2, b2 r3 g3 b3
+        __m128 in0 = _mm_loadu_ps(src);
+        __m128 in1 = _mm_loadu_ps(src + 4);
+        __m128 in2 = _mm_loadu_ps(src + 8);
+        // r1 r1 g1 b1
+        __m128 p1 = _mm_shuffle_ps( in0, in1, _MM_SHUFFLE(1, 0, 3, 3) );
+
+        _mm_storeu_ps( dst, _mm_blend_ps(in0, a, 0x8) );
+        _mm_storeu_ps( dst + 4, _mm_blend_ps(_mm_shuffle_ps( p1, p1, _MM_SHUFFLE(0, 3, 2, 0) ), a, 0x8) );
+        _mm_storeu_ps( dst + 8, _mm_blend_ps(_mm_shuffle_ps( in1, in2, _MM_SHUFFLE(0, 0, 3, 2) ), a, 0x8) );
+        _mm_storeu_ps( dst + 12, _mm_blend_ps(_mm_shuffle_ps( in2, in2, _MM_SHUFFLE(3, 3, 2, 1) ), a, 0x8) );
+    }
+    rgbToRgbaScalar(src, dst, nPixels - i, alpha);
+}
+
+template <int channel>
+NATRON_TARGET_SSE42 void
+extractChannelRgbaSSE42(const float* src,
+                        float* dst,
+                        std::size_t nPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 4 <= nPixels; i += 4, src += 16) {
+        __m128 a = _mm_shuffle_ps( _mm_loadu_ps(src), _mm_loadu_ps(src + 4), _MM_SHUFFLE(channel, channel, channel, channel) );
+        __m128 b = _mm_shuffle_ps( _mm_loadu_ps(src + 8), _mm_loadu_ps(src + 12), _MM_SHUFFLE(channel, channel, channel, channel) );
+        _mm_storeu_ps( dst + i, _mm_shuffle_ps( a, b, _MM_SHUFFLE(2, 0, 2, 0) ) );
+    }
+    extractChannelScalar(src, 4, channel, dst + i, nPixels - i);
+}
+
+NATRON_TARGET_SSE42 void
+extractChannelSSE42(const float* src,
+                    int nComps,
+                    int channel,
+                    float* dst,
+                    std::size_t nPixels)
+{
+    if (nComps != 4) {
+        extractChannelScalar(src, nComps, channel, dst, nPixels);
+
+        return;
+    }
+    switch (channel) {
+    case 0:
+        extractChannelRgbaSSE42<0>(src, dst, nPixels);
+        break;
+    case 1:
+        extractChannelRgbaSSE42<1>(src, dst, nPixels);
+        break;
+    case 2:
+        extractChannelRgbaSSE42<2>(src, dst, nPixels);
+        break;
+    default:
+        extractChannelRgbaSSE42<3>(src, dst, nPixels);
+        break;
+    }
+}
+
+/// Divides the pixel by its alpha, or returns 0 if alpha is 0
+NATRON_TARGET_SSE42 inline __m128
+unpremultPixelSSE42(__m128 p)
+{
+    __m128 alpha = _mm_shuffle_ps( p, p, _MM_SHUFFLE(3, 3, 3, 3) );
+
+    return _mm_and_ps( _mm_div_ps(p, alpha), _mm_cmpneq_ps( alpha, _mm_setzero_ps() ) );
+}
+
+NATRON_TARGET_SSE42 void
+unpremultRgbaToRgbSSE42(const float* src,
+                        float* dst,
+                        std::size_t nPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 4 <= nPixels; i += 4, src += 16, dst += 12) {
+        storeRgbFromRgbaSSE42(unpremultPixelSSE42( _mm_loadu_ps(src) ), unpremultPixelSSE42( _mm_loadu_ps(src + 4) ),
+                              unpremultPixelSSE42( _mm_loadu_ps(src + 8) ), unpremultPixelSSE42( _mm_loadu_ps(src + 12) ), dst);
+    }
+    unpremultRgbaToRgbScalar(src, dst, nPixels - i);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////
+// AVX2 code, 8 floats per register
+
+NATRON_TARGET_AVX2 inline __m256
+clampAndScaleAVX2(__m256 v,
+                  __m256 scale)
+{
+    v = _mm256_min_ps( _mm256_max_ps( v, _mm256_setzero_ps() ), _mm256_set1_ps(1.f) );
+
+    return _mm256_add_ps( _mm256_mul_ps(v, scale), _mm256_set1_ps(0.5f) );
+}
+
+/// Stores the RGB channels of 8 RGBA pixels, 2 pixels per register, in 24 floats
+NATRON_TARGET_AVX2 inline void
+storeRgbFromRgbaAVX2(__m256 p01,
+                     __m256 p23,
+                     __m256 p45,
+                     __m256 p67,
+                     float* dst)
+{
+    // r0 g0 b0 r1 g1 b1 r2 g2
+    _mm256_storeu_ps( dst, _mm256_blend_ps(_mm256_permutevar8x32_ps( p01, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 0, 0) ),
+                                           _mm256_permutevar8x32_ps( p23, _mm256_setr_epi32(0, 0, 0, 0, 0, 0, 0, 1) ), 0xC0) );
+    // b2 r3 g3 b3 r4 g4 b4 r5
+    _mm256_storeu_ps( dst + 8, _mm256_blend_ps(_mm256_permutevar8x32_ps( p23, _mm256_setr_epi32(2, 4, 5, 6, 0, 0, 0, 0) ),
+                                               _mm256_permutevar8x32_ps( p45, _mm256_setr_epi32(0, 0, 0, 0, 0, 1, 2, 4) ), 0xF0) );
+    // g5 b5 r6 g6 b6 r7 g7 b7
+    _mm256_storeu_ps( dst + 16, _mm256_blend_ps(_mm256_permutevar8x32_ps( p45, _mm256_setr_epi32(5, 6, 0, 0, 0, 0, 0, 0) ),
+                                                _mm256_permutevar8x32_ps( p67, _mm256_setr_epi32(0, 0, 0, 1, 2, 4, 5, 6) ), 0xFC) );
+}
+
+NATRON_TARGET_AVX2 void
+floatToUint16AVX2(const float* src,
+                  unsigned short* dst,
+                  std::size_t count,
+                  int maxValue)
+{
+    const __m256 scale = _mm256_set1_ps( (float)maxValue );
+    std::size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256i a = _mm256_cvttps_epi32( clampAndScaleAVX2(_mm256_loadu_ps(src + i), scale) );
+        __m256i b = _mm256_cvttps_epi32( clampAndScaleAVX2(_mm256_loadu_ps(src + i + 8), scale) );
+        // packs within each 128-bit lane: a0-3 b0-3 a4-7 b4-7
+        __m256i packed = _mm256_packus_epi32(a, b);
+        _mm256_storeu_si256( (__m256i*)(dst + i), _mm256_permute4x64_epi64( packed, _MM_SHUFFLE(3, 1, 2, 0) ) );
+    }
+    floatToUint16Scalar(src + i, dst + i, count - i, maxValue);
+}
+
+NATRON_TARGET_AVX2 void
+floatToByteAVX2(const float* src,
+                unsigned char* dst,
+                std::size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(255.f);
+    std::size_t i = 0;
+
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_cvttps_epi32( clampAndScaleAVX2(_mm256_loadu_ps(src + i), scale) );
+        __m256i b = _mm256_cvttps_epi32( clampAndScaleAVX2(_mm256_loadu_ps(src + i + 8), scale) );
+        __m256i c = _mm256_cvttps_epi32( clampAndScaleAVX2(_mm256_loadu_ps(src + i + 16), scale) );
+        __m256i d = _mm256_cvttps_epi32( clampAndScaleAVX2(_mm256_loadu_ps(src + i + 24), scale) );
+        // packs within each 128-bit lane: a0-3 b0-3 c0-3 d0-3 a4-7 b4-7 c4-7 d4-7
+        __m256i packed = _mm256_packus_epi16( _mm256_packus_epi32(a, b), _mm256_packus_epi32(c, d) );
+        _mm256_storeu_si256( (__m256i*)(dst + i), _mm256_permutevar8x32_epi32( packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7) ) );
+    }
+    floatToByteScalar(src + i, dst + i, count - i);
+}
+
+NATRON_TARGET_AVX2 void
+byteToFloatAVX2(const unsigned char* src,
+                float* dst,
+                std::size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(255.f);
+    std::size_t i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm256_storeu_ps( dst + i, _mm256_div_ps(_mm256_cvtepi32_ps( _mm256_cvtepu8_epi32(v) ), scale) );
+        _mm256_storeu_ps( dst + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_srli_si128(v, 8) ) ), scale) );
+    }
+    byteToFloatScalar(src + i, dst + i, count - i);
+}
+
+NATRON_TARGET_AVX2 void
+shortToFloatAVX2(const unsigned short* src,
+                 float* dst,
+                 std::size_t count)
+{
+    const __m256 scale = _mm256_set1_ps(65535.f);
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128( (const __m128i*)(src + i) );
+        _mm256_storeu_ps( dst + i, _mm256_div_ps(_mm256_cvtepi32_ps( _mm256_cvtepu16_epi32(v) ), scale) );
+    }
+    shortToFloatScalar(src + i, dst + i, count - i);
+}
+
+/// F16C converts 8 values at once, rounding to the nearest half like floatToHalfBits()
+NATRON_TARGET_AVX2 void
+halfToFloatAVX2(const Half* src,
+                float* dst,
+                std::size_t count)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps( dst + i, _mm256_cvtph_ps( _mm_loadu_si128( (const __m128i*)(src + i) ) ) );
+    }
+    halfToFloatScalar(src + i, dst + i, count - i);
+}
+
+NATRON_TARGET_AVX2 void
+floatToHalfAVX2(const float* src,
+                Half* dst,
+                std::size_t count)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        _mm_storeu_si128( (__m128i*)(dst + i), _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT) );
+    }
+    floatToHalfScalar(src + i, dst + i, count - i);
+}
+
+NATRON_TARGET_AVX2 void
+rgbaToRgbAVX2(const float* src,
+              float* dst,
+              std::size_t nPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= nPixels; i += 8, src += 32, dst += 24) {
+        storeRgbFromRgbaAVX2(_mm256_loadu_ps(src), _mm256_loadu_ps(src + 8), _mm256_loadu_ps(src + 16), _mm256_loadu_ps(src + 24), dst);
+    }
+    rgbaToRgbScalar(src, dst, nPixels - i);
+}
+
+NATRON_TARGET_AVX2 void
+rgbToRgbaAVX2(const float* src,
+              float* dst,
+              std::size_t nPixels,
+              float alpha)
+{
+    const __m256 a = _mm256_set1_ps(alpha);
+    std::size_t i = 0;
+
+    for (; i + 8 <= nPixels; i += 8, src += 24, dst += 32) {
+        // r0 g0 b0 r1 g1 b1 r2 g2, b2 r3 g3 b3 r4 g4 b4 r5, g5 b5 r6 g6 b6 r7 g7 b7
+        __m256 in0 = _mm256_loadu_ps(src);
+        __m256 in1 = _mm256_loadu_ps(src + 8);
+        __m256 in2 = _mm256_loadu_ps(src + 16);
+        // r0 g0 b0 . r1 g1 b1 .
+        __m256 p01 = _mm256_permutevar8x32_ps( in0, _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0) );
+        // r2 g2 b2 . r3 g3 b3 .
+        __m256 p23 = _mm256_blend_ps(_mm256_permutevar8x32_ps( in0, _mm256_setr_epi32(6, 7, 0, 0, 0, 0, 0, 0) ),
+                                     _mm256_permutevar8x32_ps( in1, _mm256_setr_epi32(0, 0, 0, 0, 1, 2, 3, 0) ), 0x74);
+        // r4 g4 b4 . r5 g5 b5 .
+        __m256 p45 = _mm256_blend_ps(_mm256_permutevar8x32_ps( in1, _mm256_setr_epi32(4, 5, 6, 0, 7, 0, 0, 0) ),
+                                     _mm256_permutevar8x32_ps( in2, _mm256_setr_epi32(0, 0, 0, 0, 0, 0, 1, 0) ), 0x60);
+        // r6 g6 b6 . r7 g7 b7 .
+        __m256 p67 = _mm256_permutevar8x32_ps( in2, _mm256_setr_epi32(2, 3, 4, 0, 5, 6, 7, 0) );
+
+        _mm256_storeu_ps( dst, _mm256_blend_ps(p01, a, 0x88) );
+        _mm256_storeu_ps( dst + 8, _mm256_blend_ps(p23, a, 0x88) );
+        _mm256_storeu_ps( dst + 16, _mm256_blend_ps(p45, a, 0x88) );
+        _mm256_storeu_ps( dst + 24, _mm256_blend_ps(p67, a, 0x88) );
+    }
+    rgbToRgbaScalar(src, dst, nPixels - i, alpha);
+}
+
+NATRON_TARGET_AVX2 void
+extractChannelAVX2(const float* src,
+                   int nComps,
+                   int channel,
+                   float* dst,
+                   std::size_t nPixels)
+{
+    const __m256i offsets = _mm256_mullo_epi32( _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(nComps) );
+    std::size_t i = 0;
+
+    src += channel;
+    for (; i + 8 <= nPixels; i += 8, src += 8 * nComps) {
+        _mm256_storeu_ps( dst + i, _mm256_i32gather_ps(src, offsets, 4) );
+    }
+    extractChannelScalar(src - channel, nComps, channel, dst + i, nPixels - i);
+}
+
+NATRON_TARGET_AVX2 inline __m256
+unpremultPixelsAVX2(__m256 p)
+{
+    // Broadcasts the alpha of each pixel within its 128-bit lane
+    __m256 alpha = _mm256_permute_ps( p, _MM_SHUFFLE(3, 3, 3, 3) );
+
+    return _mm256_and_ps( _mm256_div_ps(p, alpha), _mm256_cmp_ps(alpha, _mm256_setzero_ps(), _CMP_NEQ_UQ) );
+}
+
+NATRON_TARGET_AVX2 void
+unpremultRgbaToRgbAVX2(const float* src,
+                       float* dst,
+                       std::size_t nPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= nPixels; i += 8, src += 32, dst += 24) {
+        storeRgbFromRgbaAVX2(unpremultPixelsAVX2( _mm256_loadu_ps(src) ), unpremultPixelsAVX2( _mm256_loadu_ps(src + 8) ),
+                             unpremultPixelsAVX2( _mm256_loadu_ps(src + 16) ), unpremultPixelsAVX2( _mm256_loadu_ps(src + 24) ), dst);
+    }
+    unpremultRgbaToRgbScalar(src, dst, nPixels - i);
+}
+
+#endif // NATRON_USE_X86_SIMD
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+namespace ImageConvertSIMD
+{
+void
+floatToUint16(const float* src,
+              unsigned short* dst,
+              std::size_t count,
+              int maxValue)
+{
+    assert(maxValue > 0 && maxValue <= 65535);
+#ifdef NATRON_USE_X86_SIMD
+    switch ( CPUFeatures::getSIMDInstructionSet() ) {
+    case eSIMDInstructionSetAVX2:
+        floatToUint16AVX2(src, dst, count, maxValue);
+
+        return;
+    case eSIMDInstructionSetSSE42:
+        floatToUint16SSE42(src, dst, count, maxValue);
+
+        return;
+    case eSIMDInstructionSetNone:
+        break;
+    }
+#endif
+    floatToUint16Scalar(src, dst, count, maxValue);
+}
+
+void
+floatToByte(const float* src,
+            unsigned char* dst,
+            std::size_t count)
+{
+#ifdef NATRON_USE_X86_SIMD
+    switch ( CPUFeatures::getSIMDInstructionSet() ) {
+    case eSIMDInstructionSetAVX2:
+        floatToByteAVX2(src, dst, count);
+
+        return;
+    case eSIMDInstructionSetSSE42:
+        floatToByteSSE42(src, dst, count);
+
+        return;
+    case eSIMDInstructionSetNone:
+        break;
+    }
+#endif
+    floatToByteScalar(src, dst, count);
+}
+
+void
+byteToFloat(const unsigned char* src,
+            float* dst,
+            std::size_t count)
+{
+#ifdef NATRON_USE_X86_SIMD
+    switch ( CPUFeatures::getSIMDInstructionSet() ) {
+    case eSIMDInstructionSetAVX2:
+        byteToFloatAVX2(src, dst, count);
+
+        return;
+    case eSIMDInstructionSetSSE42:
+        byteToFloatSSE42(src, dst, count);
+
+        return;
+    case eSIMDInstructionSetNone:
+        break;
+    }
+#endif
+    byteToFloatScalar(src, dst, count);
+}
+
+void
+shortToFloat(const unsigned short* src,
+             float* dst,
+             std::size_t count)
+{
+#ifdef NATRON_USE_X86_SIMD
+    switch ( CPUFeatures::getSIMDInstructionSet() ) {
+    case eSIMDInstructionSetAVX2:
+        shortToFloatAVX2(src, dst, count);
+
+        return;
+    case eSIMDInstructionSetSSE42:
+        shortToFloatSSE42(src, dst, count);
+
+        return;
+    case eSIMDInstructionSetNone:
+        break;
+    }
+#endif
+    shortToFloatScalar(src, dst, count);
+}
+
+void
+halfToFloat(const Half* src,
+            float* dst,
+            std::size_t count)
+{
+#ifdef NATRON_USE_X86_SIMD
+    // F16C is only used with AVX2, SSE4.2 CPUs do not necessarily have it
+    if (CPUFeatures::getSIMDInstructionSet() == eSIMDInstructionSetAVX2) {
+        halfToFloatAVX2(src, dst, count);
+
+        return;
+    }
+#endif
+    halfToFloatScalar(src, dst, count);
+}
+
+void
+floatToHalf(const float* src,
+            Half* dst,
+            std::size_t count)
+{
+#ifdef NATRON_USE_X86_SIMD
+    if (CPUFeatures::getSIMDInstructionSet() == eSIMDInstructionSetAVX2) {
+        floatToHalfAVX2(src, dst, count);
+
+        return;
+    }
+#endif
+    floatToHalfScalar(src, dst, count);
+}
+
+void
+rgbaToRgb(const float* src,
+          float* dst,
+          std::size_t nPixels)
+{
+#ifdef NATRON_USE_X86_SIMD
+    switch ( CPUFeatures::getSIMDInstructionSet() ) {
+    case eSIMDInstructionSetAVX2:
+        rgbaToRgbAVX2(src, dst, nPixels);
+
+        return;
+    case eSIMDInstructionSetSSE42:
+        rgbaToRgbSSE42(src, dst, nPixels);
+
+        return;
+    case eSIMDInstructionSetNone:
+        break;
+    }
+#endif
+    rgbaToRgbScalar(src, dst, nPixels);
+}
+
+void
+rgbToRgba(const float* src,
+          float* dst,
+          std::size_t nPixels,
+          float alpha)
+{
+#ifdef NATRON_USE_X86_SIMD
+    switch ( CPUFeatures::getSIMDInstructionSet() ) {
+    case eSIMDInstructionSetAVX2:
+        rgbToRgbaAVX2(src, dst, nPixels, alpha);
+
+        return;
+    case eSIMDInstructionSetSSE42:
+        rgbToRgbaSSE42(src, dst, nPixels, alpha);
+
+        return;
+    case eSIMDInstructionSetNone:
+        break;
+    }
+#endif
+    rgbToRgbaScalar(src, dst, nPixels, alpha);
+}
+
+void
+extractChannel(const float* src,
+               int nComps,
+               int channel,
+               float* dst,
+               std::size_t nPixels)
+{
+    assert(channel >= 0 && channel < nComps);
+#ifdef NATRON_USE_X86_SIMD
+    switch ( CPUFeatures::getSIMDInstructionSet() ) {
+    case eSIMDInstructionSetAVX2:
+        extractChannelAVX2(src, nComps, channel, dst, nPixels);
+
+        return;
+    case eSIMDInstructionSetSSE42:
+        extractChannelSSE42(src, nComps, channel, dst, nPixels);
+
+        return;
+    case eSIMDInstructionSetNone:
+        break;
+    }
+#endif
+    extractChannelScalar(src, nComps, channel, dst, nPixels);
+}
+
+void
+unpremultRgbaToRgb(const float* src,
+                   float* dst,
+                   std::size_t nPixels)
+{
+#ifdef NATRON_USE_X86_SIMD
+    switch ( CPUFeatures::getSIMDInstructionSet() ) {
+    case eSIMDInstructionSetAVX2:
+        unpremultRgbaToRgbAVX2(src, dst, nPixels);
+
+        return;
+    case eSIMDInstructionSetSSE42:
+        unpremultRgbaToRgbSSE42(src, dst, nPixels);
+
+        return;
+    case eSIMDInstructionSetNone:
+        break;
+    }
+#endif
+    unpremultRgbaToRgbScalar(src, dst, nPixels);
+}
+
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,95 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_IMAGECONVERTSIMD_H
+#define NATRON_ENGINE_IMAGECONVERTSIMD_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Kernels converting rows of pixels for Image::convertToFormat(), using the SIMD instruction set selected by
+ * CPUFeatures::getSIMDInstructionSet(), or scalar code.
+ * Whatever the instruction set, the results are exactly those of the scalar per-pixel conversions of ImageConvert.cpp.
+ * Pointers do not need to be aligned, source and destination must not overlap.
+ **/
+namespace ImageConvertSIMD
+{
+/**
+ * @brief Same as Color::floatToInt<maxValue + 1>(), maxValue must be at most 65535.
+ **/
+void floatToUint16(const float* src, unsigned short* dst, std::size_t count, int maxValue);
+
+/**
+ * @brief Same as Color::floatToInt<256>().
+ **/
+void floatToByte(const float* src, unsigned char* dst, std::size_t count);
+
+/**
+ * @brief Same as Color::intToFloat<256>().
+ **/
+void byteToFloat(const unsigned char* src, float* dst, std::size_t count);
+
+/**
+ * @brief Same as Color::intToFloat<65536>().
+ **/
+void shortToFloat(const unsigned short* src, float* dst, std::size_t count);
+
+/**
+ * @brief Same as the conversions of Half from and to float.
+ **/
+void halfToFloat(const Half* src, float* dst, std::size_t count);
+
+void floatToHalf(const float* src, Half* dst, std::size_t count);
+
+/**
+ * @brief Drops the alpha channel of RGBA pixels.
+ **/
+void rgbaToRgb(const float* src, float* dst, std::size_t nPixels);
+
+/**
+ * @brief Adds an alpha channel set to the given value to RGB pixels.
+ **/
+void rgbToRgba(const float* src, float* dst, std::size_t nPixels, float alpha);
+
+/**
+ * @brief Copies one channel of pixels with nComps channels.
+ **/
+void extractChannel(const float* src, int nComps, int channel, float* dst, std::size_t nPixels);
+
+/**
+ * @brief Divides the RGB channels of RGBA pixels by their alpha, pixels whose alpha is 0 become black.
+ **/
+void unpremultRgbaToRgb(const float* src, float* dst, std::size_t nPixels);
+}
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_IMAGECONVERTSIMD_H
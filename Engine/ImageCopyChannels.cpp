@@ -126,7 +126,7 @@ Image::copyUnProcessedChannelsForPremult(const std::bitset<4> processChannels,
                // Just copy the channels, after all if the user unchecked a channel,
                // we do not want to change the values behind his back.
                // Rather we display a warning in  the GUI.
-#           define DOCHANNEL(c) dst_pixels[c] = (!src_pixels || c >= srcNComps) ? 0 : src_pixels[c];
+#           define DOCHANNEL(c) dst_pixels[c] = (!src_pixels || c >= srcNComps) ? PIX(0) : src_pixels[c];
 #         endif // !NATRON_COPY_CHANNELS_UNPREMULT
 
             if ( (dstNComps == 1) || (dstNComps == 4) ) {
@@ -690,6 +690,9 @@ Image::copyUnProcessedChannels(const RectI& roi,
     case eImageBitDepthShort:
         copyUnProcessedChannelsForDepth<unsigned short, 65535>(premult, roi, processChannels, originalImage, originalPremult, ignorePremult);
         break;
+    case eImageBitDepthHalf:
+        copyUnProcessedChannelsForDepth<Half, 1>(premult, roi, processChannels, originalImage, originalPremult, ignorePremult);
+        break;
     case eImageBitDepthFloat:
         copyUnProcessedChannelsForDepth<float, 1>(premult, roi, processChannels, originalImage, originalPremult, ignorePremult);
         break;
@@ -699,4 +702,258 @@ Image::copyUnProcessedChannels(const RectI& roi,
     }
 } // copyUnProcessedChannels
 
+template <typename PIX, int maxValue, int srcNComps, int dstNComps, bool masked, bool maskInvert>
+void
+Image::copyUnProcessedChannelsAndApplyMaskMixForMaskInvert(const RectI& roi,
+                                                           const std::bitset<4> processChannels,
+                                                           const Image* originalImg,
+                                                           const Image* maskImg,
+                                                           float mix)
+{
+    const bool doChannel[4] = {
+        !processChannels[0] && (dstNComps >= 2),
+        !processChannels[1] && (dstNComps >= 2),
+        !processChannels[2] && (dstNComps >= 3),
+        !processChannels[3] && (dstNComps == 1 || dstNComps == 4)
+    };
+    const RectI& srcBounds = originalImg->_bounds;
+    const RectI maskBounds = maskImg ? maskImg->_bounds : RectI();
+
+    for (int y = roi.y1; y < roi.y2; ++y) {
+        PIX* dst_pixels = (PIX*)pixelAt(roi.x1, y);
+        assert(dst_pixels);
+        // Rows start at the left of the image bounds, pixels out of the bounds are NULL as with pixelAt()
+        const PIX* src_row = (const PIX*)originalImg->pixelAt(srcBounds.x1, y);
+        const PIX* mask_row = (masked && maskImg) ? (const PIX*)maskImg->pixelAt(maskBounds.x1, y) : 0;
+
+        for (int x = roi.x1; x < roi.x2; ++x, dst_pixels += dstNComps) {
+            const PIX* src_pixels = ( src_row && (x >= srcBounds.x1) && (x < srcBounds.x2) ) ? src_row + (x - srcBounds.x1) * srcNComps : 0;
+
+            // Copy the unprocessed channels, as copyUnProcessedChannelsForPremult() does
+            PIX srcA = src_pixels ? maxValue : 0; /* be opaque for anything that doesn't contain alpha */
+            if ( ( (srcNComps == 1) || (srcNComps == 4) ) && src_pixels ) {
+                srcA = src_pixels[srcNComps - 1];
+            }
+            if (dstNComps >= 2) {
+                for (int c = 0; c < 3 && c < dstNComps; ++c) {
+                    if (doChannel[c]) {
+                        dst_pixels[c] = (!src_pixels || c >= srcNComps) ? PIX(0) : src_pixels[c];
+                    }
+                }
+            }
+            if (doChannel[3]) {
+                dst_pixels[dstNComps - 1] = srcA;
+            }
+
+            // Then mask and mix, as applyMaskMixForMaskInvert() does
+            float alpha = mix;
+            if (masked) {
+                const PIX* maskPixels = ( mask_row && (x >= maskBounds.x1) && (x < maskBounds.x2) ) ? mask_row + (x - maskBounds.x1) : 0;
+                float maskScale;
+                if (maskPixels == 0) {
+                    maskScale = maskInvert ? 1.f : 0.f;
+                } else {
+                    maskScale = *maskPixels * (1.f / maxValue);
+                    if (maskInvert) {
+                        maskScale = 1.f - maskScale;
+                    }
+                }
+                alpha = mix * maskScale;
+            }
+            if (src_pixels) {
+                for (int c = 0; c < dstNComps && c < srcNComps; ++c) {
+                    float v = float(dst_pixels[c]) * alpha + (1.f - alpha) * float(src_pixels[c]);
+                    dst_pixels[c] = clampIfInt<PIX>(v);
+                }
+            } else {
+                for (int c = 0; c < dstNComps; ++c) {
+                    float v = float(dst_pixels[c]) * alpha;
+                    dst_pixels[c] = clampIfInt<PIX>(v);
+                }
+            }
+        }
+    }
+} // Image::copyUnProcessedChannelsAndApplyMaskMixForMaskInvert
+
+template <typename PIX, int maxValue, int srcNComps, int dstNComps>
+void
+Image::copyUnProcessedChannelsAndApplyMaskMixForComponents(const RectI& roi,
+                                                           const std::bitset<4> processChannels,
+                                                           const Image* originalImg,
+                                                           const Image* maskImg,
+                                                           bool masked,
+                                                           bool maskInvert,
+                                                           float mix)
+{
+    if (masked) {
+        if (maskInvert) {
+            copyUnProcessedChannelsAndApplyMaskMixForMaskInvert<PIX, maxValue, srcNComps, dstNComps, true, true>(roi, processChannels, originalImg, maskImg, mix);
+        } else {
+            copyUnProcessedChannelsAndApplyMaskMixForMaskInvert<PIX, maxValue, srcNComps, dstNComps, true, false>(roi, processChannels, originalImg, maskImg, mix);
+        }
+    } else {
+        copyUnProcessedChannelsAndApplyMaskMixForMaskInvert<PIX, maxValue, srcNComps, dstNComps, false, false>(roi, processChannels, originalImg, maskImg, mix);
+    }
+}
+
+template <typename PIX, int maxValue>
+void
+Image::copyUnProcessedChannelsAndApplyMaskMixForDepth(const RectI& roi,
+                                                      const std::bitset<4> processChannels,
+                                                      const Image* originalImg,
+                                                      const Image* maskImg,
+                                                      bool masked,
+                                                      bool maskInvert,
+                                                      float mix)
+{
+    int dstNComps = getComponents().getNumComponents();
+    int srcNComps = originalImg->getComponents().getNumComponents();
+
+    switch (dstNComps) {
+    case 1:
+        switch (srcNComps) {
+        case 1:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 1, 1>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 2:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 2, 1>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 3:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 3, 1>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 4:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 4, 1>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+        break;
+    case 2:
+        switch (srcNComps) {
+        case 1:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 1, 2>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 2:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 2, 2>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 3:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 3, 2>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 4:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 4, 2>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+        break;
+    case 3:
+        switch (srcNComps) {
+        case 1:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 1, 3>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 2:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 2, 3>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 3:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 3, 3>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 4:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 4, 3>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+        break;
+    case 4:
+        switch (srcNComps) {
+        case 1:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 1, 4>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 2:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 2, 4>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 3:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 3, 4>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        case 4:
+            copyUnProcessedChannelsAndApplyMaskMixForComponents<PIX, maxValue, 4, 4>(roi, processChannels, originalImg, maskImg, masked, maskInvert, mix);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+        break;
+    default:
+        assert(false);
+        break;
+    } // switch
+} // Image::copyUnProcessedChannelsAndApplyMaskMixForDepth
+
+void
+Image::copyUnProcessedChannelsAndApplyMaskMix(const RectI& roi,
+                                              const ImagePremultiplicationEnum outputPremult,
+                                              const ImagePremultiplicationEnum originalImagePremult,
+                                              const std::bitset<4> processChannels,
+                                              const ImagePtr& originalImage,
+                                              bool ignorePremult,
+                                              bool useMaskMix,
+                                              const Image* maskImg,
+                                              bool masked,
+                                              bool maskInvert,
+                                              float mix,
+                                              const OSGLContextPtr& glContext)
+{
+    ///The passes are fused only when both have something to do on CPU images, see copyUnProcessedChannels() and
+    ///applyMaskMix() for the cases where one of them returns early
+    bool fused = ( originalImage && useMaskMix && ( masked || (mix != 1) ) &&
+                   canCallCopyUnProcessedChannels(processChannels) &&
+                   (getStorageMode() != eStorageModeGLTex) &&
+                   ( getMipMapLevel() == originalImage->getMipMapLevel() ) );
+#ifdef NATRON_COPY_CHANNELS_UNPREMULT
+    // the unpremult variant of the copy is not fused
+    fused = false;
+#endif
+
+    if (!fused) {
+        copyUnProcessedChannels(roi, outputPremult, originalImagePremult, processChannels, originalImage, ignorePremult, glContext);
+        if (useMaskMix) {
+            applyMaskMix(roi, maskImg, originalImage.get(), masked, maskInvert, mix, glContext);
+        }
+
+        return;
+    }
+
+    QWriteLocker k(&_entryLock);
+    QReadLocker originalLock(&originalImage->_entryLock);
+    boost::scoped_ptr<QReadLocker> maskLock;
+    if (maskImg) {
+        maskLock.reset( new QReadLocker(&maskImg->_entryLock) );
+    }
+    assert( getBitDepth() == originalImage->getBitDepth() );
+    assert( !masked || !maskImg || maskImg->getComponents() == ImagePlaneDesc::getAlphaComponents() );
+
+    RectI realRoI;
+    roi.intersect(_bounds, &realRoI);
+
+    switch ( getBitDepth() ) {
+    case eImageBitDepthByte:
+        copyUnProcessedChannelsAndApplyMaskMixForDepth<unsigned char, 255>(realRoI, processChannels, originalImage.get(), maskImg, masked, maskInvert, mix);
+        break;
+    case eImageBitDepthShort:
+        copyUnProcessedChannelsAndApplyMaskMixForDepth<unsigned short, 65535>(realRoI, processChannels, originalImage.get(), maskImg, masked, maskInvert, mix);
+        break;
+    case eImageBitDepthHalf:
+        copyUnProcessedChannelsAndApplyMaskMixForDepth<Half, 1>(realRoI, processChannels, originalImage.get(), maskImg, masked, maskInvert, mix);
+        break;
+    case eImageBitDepthFloat:
+        copyUnProcessedChannelsAndApplyMaskMixForDepth<float, 1>(realRoI, processChannels, originalImage.get(), maskImg, masked, maskInvert, mix);
+        break;
+    default:
+        break;
+    }
+} // copyUnProcessedChannelsAndApplyMaskMix
+
 NATRON_NAMESPACE_EXIT
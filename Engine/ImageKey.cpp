@@ -42,6 +42,10 @@ ImageKey::ImageKey()
     , _draftMode(false)
     , _frameVaryingOrAnimated(false)
     , _fullScaleWithDownscaleInputs(false)
+    , _isTile(false)
+    , _tileX(0)
+    , _tileY(0)
+    , _tileMipMapLevel(0)
 {
 }
 
@@ -62,6 +66,10 @@ ImageKey::ImageKey(const CacheEntryHolder* holder,
     , _draftMode(draftMode)
     , _frameVaryingOrAnimated(frameVaryingOrAnimated)
     , _fullScaleWithDownscaleInputs(fullScaleWithDownscaleInputs)
+    , _isTile(false)
+    , _tileX(0)
+    , _tileY(0)
+    , _tileMipMapLevel(0)
 {
 }
 
@@ -76,11 +84,40 @@ ImageKey::fillHash(Hash64* hash) const
     hash->append(_pixelAspect);
     hash->append(_draftMode);
     hash->append(_fullScaleWithDownscaleInputs);
+    // Keys of entire images keep the same hash as before tiles were introduced
+    if (_isTile) {
+        hash->append(_tileX);
+        hash->append(_tileY);
+        hash->append(_tileMipMapLevel);
+    }
+}
+
+ImageKey
+ImageKey::makeTileKey(unsigned int mipMapLevel,
+                      int tileX,
+                      int tileY) const
+{
+    ImageKey ret(*this);
+
+    ret._isTile = true;
+    ret._tileX = tileX;
+    ret._tileY = tileY;
+    ret._tileMipMapLevel = mipMapLevel;
+    // The copy has the hash of this key
+    ret.resetHash();
+
+    return ret;
 }
 
 bool
 ImageKey::operator==(const ImageKey & other) const
 {
+    if (_isTile != other._isTile) {
+        return false;
+    }
+    if ( _isTile && ( (_tileX != other._tileX) || (_tileY != other._tileY) || (_tileMipMapLevel != other._tileMipMapLevel) ) ) {
+        return false;
+    }
     if (_frameVaryingOrAnimated) {
         return _nodeHashKey == other._nodeHashKey &&
                _time == other._time &&
@@ -50,6 +50,13 @@ public:
     //hence it is probably not very high quality, even though the mipmap level is 0
     bool _fullScaleWithDownscaleInputs;
 
+    //When true the key identifies a tile of the image of the other members, see ImageTiles. The tile covers the pixels
+    //[_tileX * NATRON_IMAGE_TILE_SIZE, (_tileX + 1) * NATRON_IMAGE_TILE_SIZE) horizontally (same for y) at _tileMipMapLevel
+    bool _isTile;
+    int _tileX;
+    int _tileY;
+    unsigned int _tileMipMapLevel;
+
     ImageKey();
 
     ImageKey(const CacheEntryHolder* holder,
@@ -63,6 +70,11 @@ public:
 
     void fillHash(Hash64* hash) const;
 
+    /**
+     * @brief Returns the key of a tile of the image identified by this key.
+     **/
+    ImageKey makeTileKey(unsigned int mipMapLevel, int tileX, int tileY) const;
+
     U64 getTreeVersion() const
     {
         return _nodeHashKey;
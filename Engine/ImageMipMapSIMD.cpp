@@ -0,0 +1,271 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ImageMipMapSIMD.h"
+
+#include <cassert>
+
+#include "Engine/CPUFeatures.h"
+
+#ifdef NATRON_USE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/*
+ * Like the kernels of ImageConvertSIMD, these give exactly the results of the scalar code: for each channel the
+ * sum is ((a + b) + c) + d, where a b are adjacent pixels of the upper row and c d the pixels below them, and it is
+ * then divided by 4.
+ */
+
+NATRON_NAMESPACE_ENTER
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+void
+halveRowsScalar(const float* row0,
+                const float* row1,
+                float* dst,
+                std::size_t nDstPixels,
+                int nComps)
+{
+    for (std::size_t i = 0; i < nDstPixels; ++i, row0 += 2 * nComps, row1 += 2 * nComps, dst += nComps) {
+        for (int k = 0; k < nComps; ++k) {
+            dst[k] = (row0[k] + row0[k + nComps] + row1[k] + row1[k + nComps]) / 4;
+        }
+    }
+}
+
+#ifdef NATRON_USE_X86_SIMD
+
+NATRON_TARGET_SSE42 inline __m128
+boxSSE42(__m128 a,
+         __m128 b,
+         __m128 c,
+         __m128 d)
+{
+    return _mm_div_ps( _mm_add_ps( _mm_add_ps( _mm_add_ps(a, b), c ), d ), _mm_set1_ps(4.f) );
+}
+
+/// 1 channel: 4 destination pixels per iteration
+NATRON_TARGET_SSE42 void
+halveRows1SSE42(const float* row0,
+                const float* row1,
+                float* dst,
+                std::size_t nDstPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 4 <= nDstPixels; i += 4, row0 += 8, row1 += 8, dst += 4) {
+        __m128 u0 = _mm_loadu_ps(row0);
+        __m128 u1 = _mm_loadu_ps(row0 + 4);
+        __m128 v0 = _mm_loadu_ps(row1);
+        __m128 v1 = _mm_loadu_ps(row1 + 4);
+        // even and odd pixels
+        _mm_storeu_ps( dst, boxSSE42( _mm_shuffle_ps( u0, u1, _MM_SHUFFLE(2, 0, 2, 0) ), _mm_shuffle_ps( u0, u1, _MM_SHUFFLE(3, 1, 3, 1) ),
+                                      _mm_shuffle_ps( v0, v1, _MM_SHUFFLE(2, 0, 2, 0) ), _mm_shuffle_ps( v0, v1, _MM_SHUFFLE(3, 1, 3, 1) ) ) );
+    }
+    halveRowsScalar(row0, row1, dst, nDstPixels - i, 1);
+}
+
+/// 2 channels: 2 destination pixels per iteration
+NATRON_TARGET_SSE42 void
+halveRows2SSE42(const float* row0,
+                const float* row1,
+                float* dst,
+                std::size_t nDstPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 2 <= nDstPixels; i += 2, row0 += 8, row1 += 8, dst += 4) {
+        __m128 u0 = _mm_loadu_ps(row0);
+        __m128 u1 = _mm_loadu_ps(row0 + 4);
+        __m128 v0 = _mm_loadu_ps(row1);
+        __m128 v1 = _mm_loadu_ps(row1 + 4);
+        _mm_storeu_ps( dst, boxSSE42( _mm_shuffle_ps( u0, u1, _MM_SHUFFLE(1, 0, 1, 0) ), _mm_shuffle_ps( u0, u1, _MM_SHUFFLE(3, 2, 3, 2) ),
+                                      _mm_shuffle_ps( v0, v1, _MM_SHUFFLE(1, 0, 1, 0) ), _mm_shuffle_ps( v0, v1, _MM_SHUFFLE(3, 2, 3, 2) ) ) );
+    }
+    halveRowsScalar(row0, row1, dst, nDstPixels - i, 2);
+}
+
+/// 3 channels: 1 destination pixel per iteration, reading and writing one float past the pixel. The float written
+/// past the pixel belongs to the next pixel, so the last pixel is left to the scalar code.
+NATRON_TARGET_SSE42 void
+halveRows3SSE42(const float* row0,
+                const float* row1,
+                float* dst,
+                std::size_t nDstPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 1 < nDstPixels; ++i, row0 += 6, row1 += 6, dst += 3) {
+        _mm_storeu_ps( dst, boxSSE42( _mm_loadu_ps(row0), _mm_loadu_ps(row0 + 3), _mm_loadu_ps(row1), _mm_loadu_ps(row1 + 3) ) );
+    }
+    halveRowsScalar(row0, row1, dst, nDstPixels - i, 3);
+}
+
+/// 4 channels: 1 destination pixel per iteration
+NATRON_TARGET_SSE42 void
+halveRows4SSE42(const float* row0,
+                const float* row1,
+                float* dst,
+                std::size_t nDstPixels)
+{
+    for (std::size_t i = 0; i < nDstPixels; ++i, row0 += 8, row1 += 8, dst += 4) {
+        _mm_storeu_ps( dst, boxSSE42( _mm_loadu_ps(row0), _mm_loadu_ps(row0 + 4), _mm_loadu_ps(row1), _mm_loadu_ps(row1 + 4) ) );
+    }
+}
+
+NATRON_TARGET_SSE42 void
+halveRowsSSE42(const float* row0,
+               const float* row1,
+               float* dst,
+               std::size_t nDstPixels,
+               int nComps)
+{
+    switch (nComps) {
+    case 1:
+        halveRows1SSE42(row0, row1, dst, nDstPixels);
+        break;
+    case 2:
+        halveRows2SSE42(row0, row1, dst, nDstPixels);
+        break;
+    case 3:
+        halveRows3SSE42(row0, row1, dst, nDstPixels);
+        break;
+    case 4:
+        halveRows4SSE42(row0, row1, dst, nDstPixels);
+        break;
+    default:
+        halveRowsScalar(row0, row1, dst, nDstPixels, nComps);
+        break;
+    }
+}
+
+NATRON_TARGET_AVX2 inline __m256
+boxAVX2(__m256 a,
+        __m256 b,
+        __m256 c,
+        __m256 d)
+{
+    return _mm256_div_ps( _mm256_add_ps( _mm256_add_ps( _mm256_add_ps(a, b), c ), d ), _mm256_set1_ps(4.f) );
+}
+
+/// 1 channel: 8 destination pixels per iteration
+NATRON_TARGET_AVX2 void
+halveRows1AVX2(const float* row0,
+               const float* row1,
+               float* dst,
+               std::size_t nDstPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 8 <= nDstPixels; i += 8, row0 += 16, row1 += 16, dst += 8) {
+        __m256 u0 = _mm256_loadu_ps(row0);
+        __m256 u1 = _mm256_loadu_ps(row0 + 8);
+        __m256 v0 = _mm256_loadu_ps(row1);
+        __m256 v1 = _mm256_loadu_ps(row1 + 8);
+        // even and odd pixels, shuffled within each 128-bit lane: 0 2 8 10 4 6 12 14
+        __m256 box = boxAVX2( _mm256_shuffle_ps( u0, u1, _MM_SHUFFLE(2, 0, 2, 0) ), _mm256_shuffle_ps( u0, u1, _MM_SHUFFLE(3, 1, 3, 1) ),
+                              _mm256_shuffle_ps( v0, v1, _MM_SHUFFLE(2, 0, 2, 0) ), _mm256_shuffle_ps( v0, v1, _MM_SHUFFLE(3, 1, 3, 1) ) );
+        _mm256_storeu_ps( dst, _mm256_castpd_ps( _mm256_permute4x64_pd( _mm256_castps_pd(box), _MM_SHUFFLE(3, 1, 2, 0) ) ) );
+    }
+    halveRowsScalar(row0, row1, dst, nDstPixels - i, 1);
+}
+
+/// 4 channels: 2 destination pixels per iteration
+NATRON_TARGET_AVX2 void
+halveRows4AVX2(const float* row0,
+               const float* row1,
+               float* dst,
+               std::size_t nDstPixels)
+{
+    std::size_t i = 0;
+
+    for (; i + 2 <= nDstPixels; i += 2, row0 += 16, row1 += 16, dst += 8) {
+        // pixels 0 1 and 2 3 of each row
+        __m256 u01 = _mm256_loadu_ps(row0);
+        __m256 u23 = _mm256_loadu_ps(row0 + 8);
+        __m256 v01 = _mm256_loadu_ps(row1);
+        __m256 v23 = _mm256_loadu_ps(row1 + 8);
+        _mm256_storeu_ps( dst, boxAVX2( _mm256_permute2f128_ps(u01, u23, 0x20), _mm256_permute2f128_ps(u01, u23, 0x31),
+                                        _mm256_permute2f128_ps(v01, v23, 0x20), _mm256_permute2f128_ps(v01, v23, 0x31) ) );
+    }
+    halveRowsScalar(row0, row1, dst, nDstPixels - i, 4);
+}
+
+NATRON_TARGET_AVX2 void
+halveRowsAVX2(const float* row0,
+              const float* row1,
+              float* dst,
+              std::size_t nDstPixels,
+              int nComps)
+{
+    switch (nComps) {
+    case 1:
+        halveRows1AVX2(row0, row1, dst, nDstPixels);
+        break;
+    case 4:
+        halveRows4AVX2(row0, row1, dst, nDstPixels);
+        break;
+    default:
+        // 2 and 3 channels do not map well to 256-bit registers
+        halveRowsSSE42(row0, row1, dst, nDstPixels, nComps);
+        break;
+    }
+}
+
+#endif // NATRON_USE_X86_SIMD
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+namespace ImageMipMapSIMD
+{
+void
+halveRows(const float* row0,
+          const float* row1,
+          float* dst,
+          std::size_t nDstPixels,
+          int nComps)
+{
+    assert(nComps > 0);
+#ifdef NATRON_USE_X86_SIMD
+    switch ( CPUFeatures::getSIMDInstructionSet() ) {
+    case eSIMDInstructionSetAVX2:
+        halveRowsAVX2(row0, row1, dst, nDstPixels, nComps);
+
+        return;
+    case eSIMDInstructionSetSSE42:
+        halveRowsSSE42(row0, row1, dst, nDstPixels, nComps);
+
+        return;
+    case eSIMDInstructionSetNone:
+        break;
+    }
+#endif
+    halveRowsScalar(row0, row1, dst, nDstPixels, nComps);
+}
+}
+
+NATRON_NAMESPACE_EXIT
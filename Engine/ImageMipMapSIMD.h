@@ -0,0 +1,55 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_IMAGEMIPMAPSIMD_H
+#define NATRON_ENGINE_IMAGEMIPMAPSIMD_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstddef>
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Kernels building mipmap levels of float images, using the SIMD instruction set selected by
+ * CPUFeatures::getSIMDInstructionSet(), or scalar code.
+ * Whatever the instruction set, the results are exactly those of the scalar code of Image::halveRoIForDepth().
+ * Pointers do not need to be aligned, source and destination must not overlap.
+ **/
+namespace ImageMipMapSIMD
+{
+/**
+ * @brief Box-filters 2x2 blocks of pixels with nComps channels: each destination pixel is the average of 2 adjacent
+ * pixels of row0 and the 2 pixels below them in row1, summed in the order of Image::halveRoIForDepth().
+ * row0 and row1 hold 2 * nDstPixels pixels.
+ **/
+void halveRows(const float* row0, const float* row1, float* dst, std::size_t nDstPixels, int nComps);
+}
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_IMAGEMIPMAPSIMD_H
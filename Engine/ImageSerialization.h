@@ -46,7 +46,8 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 
 // Note: these classes are used for cache serialization and do not have to maintain backward compatibility
 #define IMAGE_KEY_SERIALIZATION_INTRODUCES_CACHE_HOLDER_ID 2
-#define IMAGE_KEY_SERIALIZATION_VERSION IMAGE_KEY_SERIALIZATION_INTRODUCES_CACHE_HOLDER_ID
+#define IMAGE_KEY_SERIALIZATION_INTRODUCES_TILES 3
+#define IMAGE_KEY_SERIALIZATION_VERSION IMAGE_KEY_SERIALIZATION_INTRODUCES_TILES
 
 NATRON_NAMESPACE_ENTER
 
@@ -64,6 +65,12 @@ ImageKey::serialize(Archive & ar,
     ar & ::boost::serialization::make_nvp("View", _view);
     ar & ::boost::serialization::make_nvp("PixelAspect", _pixelAspect);
     ar & ::boost::serialization::make_nvp("Draft", _draftMode);
+    if (version >= IMAGE_KEY_SERIALIZATION_INTRODUCES_TILES) {
+        ar & ::boost::serialization::make_nvp("IsTile", _isTile);
+        ar & ::boost::serialization::make_nvp("TileX", _tileX);
+        ar & ::boost::serialization::make_nvp("TileY", _tileY);
+        ar & ::boost::serialization::make_nvp("TileMipMapLevel", _tileMipMapLevel);
+    }
 }
 
 NATRON_NAMESPACE_EXIT
@@ -0,0 +1,280 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "ImageTiles.h"
+
+#include <list>
+#include <vector>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
+#include <boost/make_shared.hpp>
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+#endif
+
+#include "Engine/AppManager.h"
+#include "Engine/Image.h"
+#include "Engine/ImageKey.h"
+#include "Engine/ImageParams.h"
+
+NATRON_NAMESPACE_ENTER
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// Index of the tile holding the pixel at coordinate x, rounded towards minus infinity for negative coordinates
+int
+getTileIndex(int x)
+{
+    return x >= 0 ? x / NATRON_IMAGE_TILE_SIZE : -( (-x + NATRON_IMAGE_TILE_SIZE - 1) / NATRON_IMAGE_TILE_SIZE );
+}
+
+RectI
+getTileRect(int tileX,
+            int tileY)
+{
+    return RectI(tileX * NATRON_IMAGE_TILE_SIZE, tileY * NATRON_IMAGE_TILE_SIZE,
+                 (tileX + 1) * NATRON_IMAGE_TILE_SIZE, (tileY + 1) * NATRON_IMAGE_TILE_SIZE);
+}
+
+bool
+isEntirelyRendered(const Image& image,
+                   const RectI& rect)
+{
+    std::list<RectI> restToRender;
+
+#if NATRON_ENABLE_TRIMAP
+    bool isBeingRenderedElsewhere = false;
+    image.getRestToRender_trimap(rect, restToRender, &isBeingRenderedElsewhere);
+    if (isBeingRenderedElsewhere) {
+        return false;
+    }
+#else
+    image.getRestToRender(rect, restToRender);
+#endif
+
+    return restToRender.empty();
+}
+
+// Returns a tile of the cache entries of a tile key that has the given format, or any usable format if components is NULL
+ImagePtr
+findTile(const std::list<ImagePtr>& entries,
+         const RectD* rod,
+         const ImagePlaneDesc& requestedComponents,
+         ImageBitDepthEnum requestedBitdepth,
+         const ImagePlaneDesc* components,
+         ImageBitDepthEnum bitdepth)
+{
+    for (std::list<ImagePtr>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        const ImagePtr& tile = *it;
+        if ( (tile->getStorageMode() != eStorageModeRAM) || ( rod && (tile->getRoD() != *rod) ) ) {
+            continue;
+        }
+        if (components) {
+            if ( (tile->getComponents() != *components) || (tile->getBitDepth() != bitdepth) ) {
+                continue;
+            }
+        } else {
+            const ImagePlaneDesc& tileComponents = tile->getComponents();
+            bool convertible = ( tileComponents.isColorPlane() && requestedComponents.isColorPlane() ) || (tileComponents == requestedComponents);
+            if ( !convertible || ( getSizeOfForBitDepth( tile->getBitDepth() ) < getSizeOfForBitDepth(requestedBitdepth) ) ) {
+                continue;
+            }
+        }
+        // The tile may be still being stored by another thread
+        if ( isEntirelyRendered( *tile, tile->getBounds() ) ) {
+            return tile;
+        }
+    }
+
+    return ImagePtr();
+}
+
+// Returns an image at the given mipmap level with the format of the tile, which is not in the cache
+ImagePtr
+makeImageForTile(const ImageKey& key,
+                 unsigned int mipMapLevel,
+                 const RectI& bounds,
+                 const Image& tile)
+{
+    ImageParamsPtr tileParams = tile.getParams();
+    ImageParamsPtr params = Image::makeParams(tileParams->getRoD(),
+                                              bounds,
+                                              tileParams->getPixelAspectRatio(),
+                                              mipMapLevel,
+                                              tileParams->isRodProjectFormat(),
+                                              tileParams->getComponents(),
+                                              tileParams->getBitDepth(),
+                                              tileParams->getPremultiplication(),
+                                              tileParams->getFieldingOrder(),
+                                              eStorageModeRAM);
+    // Not in the cache, but with a bitmap so that only the missing tiles are rendered
+    ImagePtr ret = boost::make_shared<Image>( key, params, (const CacheAPI*)0 );
+
+    ret->allocateMemory();
+
+    return ret;
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+namespace ImageTiles
+{
+ImagePtr
+assemble(const ImageKey& key,
+         unsigned int mipMapLevel,
+         const RectI& bounds,
+         const RectI& roi,
+         const RectD* rod,
+         const ImagePlaneDesc& components,
+         ImageBitDepthEnum bitdepth)
+{
+    // The tiles outside of the region of interest are not needed by this render
+    RectI tilesRect;
+    if ( bounds.isNull() || !roi.intersect(bounds, &tilesRect) ) {
+        return ImagePtr();
+    }
+
+    int tileX1 = getTileIndex(tilesRect.x1);
+    int tileX2 = getTileIndex(tilesRect.x2 - 1) + 1;
+    int tileY1 = getTileIndex(tilesRect.y1);
+    int tileY2 = getTileIndex(tilesRect.y2 - 1) + 1;
+    std::vector<ImagePtr> tiles;
+
+    for (int tileY = tileY1; tileY < tileY2; ++tileY) {
+        for (int tileX = tileX1; tileX < tileX2; ++tileX) {
+            std::list<ImagePtr> entries;
+            if ( !appPTR->getImage(key.makeTileKey(mipMapLevel, tileX, tileY), &entries, mipMapLevel) ) {
+                continue;
+            }
+
+            // All the tiles must have the format of the first one found
+            ImagePtr tile = !tiles.empty() ? findTile( entries, rod, components, bitdepth, &tiles.front()->getComponents(), tiles.front()->getBitDepth() ) :
+                            findTile( entries, rod, components, bitdepth, 0, bitdepth );
+            if (tile) {
+                tiles.push_back(tile);
+            }
+        }
+    }
+
+    if ( tiles.empty() ) {
+        return ImagePtr();
+    }
+    if ( (tiles.size() == 1) && tiles.front()->getBounds().contains(roi) ) {
+        // The tile is entirely rendered: it can be read as is
+        return tiles.front();
+    }
+
+    ImagePtr ret = makeImageForTile(key, mipMapLevel, bounds, *tiles.front());
+    for (std::vector<ImagePtr>::const_iterator it = tiles.begin(); it != tiles.end(); ++it) {
+        ret->pasteFrom( **it, (*it)->getBounds(), true );
+    }
+
+    return ret;
+} // assemble
+
+bool
+isTile(const ImagePtr& image)
+{
+    return image && image->getKey()._isTile;
+}
+
+ImagePtr
+detach(const ImagePtr& tile,
+       const RectI& bounds)
+{
+    assert( isTile(tile) );
+    // The key of the image the tile belongs to
+    ImageKey key = tile->getKey();
+    key._isTile = false;
+    key.resetHash();
+    ImagePtr ret = makeImageForTile(key, tile->getMipMapLevel(), bounds, *tile);
+    ret->pasteFrom( *tile, tile->getBounds(), true );
+
+    return ret;
+}
+
+void
+store(const ImagePtr& image)
+{
+    if ( !image || !image->usesBitMap() || (image->getStorageMode() != eStorageModeRAM) ||
+         image->getKey().getCacheHolderID().empty() || isTile(image) ) {
+        return;
+    }
+
+    const ImageKey& key = image->getKey();
+    unsigned int mipMapLevel = image->getMipMapLevel();
+    ImageParamsPtr imageParams = image->getParams();
+    RectI bounds = image->getBounds();
+
+    // Tiles at the borders are clipped to the region of definition, so that they can be entirely rendered
+    RectI rodBounds;
+    image->getRoD().toPixelEnclosing( mipMapLevel, image->getPixelAspectRatio(), &rodBounds );
+    if ( bounds.isNull() || rodBounds.isNull() ) {
+        return;
+    }
+
+    bool isNodeCacheShared = appPTR->isNodeCacheShared();
+    int tileX1 = getTileIndex(bounds.x1);
+    int tileX2 = getTileIndex(bounds.x2 - 1) + 1;
+    int tileY1 = getTileIndex(bounds.y1);
+    int tileY2 = getTileIndex(bounds.y2 - 1) + 1;
+
+    for (int tileY = tileY1; tileY < tileY2; ++tileY) {
+        for (int tileX = tileX1; tileX < tileX2; ++tileX) {
+            RectI tileBounds;
+            if ( !getTileRect(tileX, tileY).intersect(rodBounds, &tileBounds) || !bounds.contains(tileBounds) ||
+                 !isEntirelyRendered(*image, tileBounds) ) {
+                continue;
+            }
+
+            ImageParamsPtr params = Image::makeParams(imageParams->getRoD(),
+                                                      tileBounds,
+                                                      imageParams->getPixelAspectRatio(),
+                                                      mipMapLevel,
+                                                      imageParams->isRodProjectFormat(),
+                                                      imageParams->getComponents(),
+                                                      imageParams->getBitDepth(),
+                                                      imageParams->getPremultiplication(),
+                                                      imageParams->getFieldingOrder(),
+                                                      eStorageModeRAM);
+            ImagePtr tile;
+            if ( appPTR->getImageOrCreate(key.makeTileKey(mipMapLevel, tileX, tileY), params, &tile) || !tile ) {
+                // Already cached
+                continue;
+            }
+            tile->allocateMemory();
+
+            // The bitmap is copied with the pixels, the tile is only used by other threads once entirely rendered
+            tile->pasteFrom(*image, tileBounds, true);
+
+            if (isNodeCacheShared) {
+                appPTR->publishImageToSharedNodeCache(tile);
+            }
+        }
+    }
+} // store
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,94 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_IMAGETILES_H
+#define NATRON_ENGINE_IMAGETILES_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+///Width and height in pixels of the tiles of the node cache, see ImageTiles
+#define NATRON_IMAGE_TILE_SIZE 256
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief Storage of the output of the nodes in the node cache as fixed-size tiles instead of entire images, see
+ * AppManager::setNodeCacheTiled().
+ * The tiles of an image form a grid of NATRON_IMAGE_TILE_SIZE pixels aligned on the origin at each mipmap level,
+ * clipped to the region of definition of the image. Each tile is a separate cache entry, whose key is the key of
+ * the image plus the coordinates of the tile, see ImageKey::makeTileKey().
+ * Renders then work on images that are not in the cache: they are assembled from the tiles found in the cache, the
+ * bitmap marking the pixels of these tiles as rendered so that only the missing tiles are rendered, and the
+ * tiles entirely rendered are stored back once the render is done. Growing the region of interest of a cached image
+ * thus only renders the new tiles instead of reallocating and copying the whole image, and the cache evicts the
+ * tiles that are not used anymore instead of entire images.
+ * Plug-ins need contiguous images, so the tiles are still copied in the images they render to or read from.
+ * All functions are MT-safe.
+ **/
+namespace ImageTiles
+{
+/**
+ * @brief Returns an image with the given bounds at the given mipmap level, which is not in the cache, holding
+ * the tiles of the image identified by key found in the node cache. Only the tiles intersecting roi are looked up and
+ * copied, the bitmap marks the rest of the image as not rendered. Only tiles whose components can be converted
+ * to the given components and whose bit depth is at least as deep are used, and they must all have the same format.
+ * If rod is not NULL, tiles with another region of definition are ignored.
+ * If a single tile covers the whole roi, nothing is left to render: the tile itself is returned without copying it.
+ * It is a cache entry that must not be modified, see isTile() and detach().
+ * Returns NULL if no tile was found.
+ **/
+ImagePtr assemble(const ImageKey& key,
+                  unsigned int mipMapLevel,
+                  const RectI& bounds,
+                  const RectI& roi,
+                  const RectD* rod,
+                  const ImagePlaneDesc& components,
+                  ImageBitDepthEnum bitdepth);
+
+/**
+ * @brief Returns true if the image is a tile of the node cache returned by assemble().
+ **/
+bool isTile(const ImagePtr& image);
+
+/**
+ * @brief Returns an image of the given bounds, which is not in the cache, holding the pixels and bitmap of the given
+ * tile, so that the rest of the image the tile belongs to can be rendered without modifying the tile.
+ **/
+ImagePtr detach(const ImagePtr& tile,
+                const RectI& bounds);
+
+/**
+ * @brief Stores in the node cache the tiles of the given image that are entirely rendered and not cached yet.
+ * The image is not modified.
+ **/
+void store(const ImagePtr& image);
+}
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_IMAGETILES_H
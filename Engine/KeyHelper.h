@@ -32,6 +32,7 @@
 
 #include "Engine/Hash64.h"
 #include "Engine/CacheEntryHolder.h"
+#include "Engine/CacheStatistics.h"
 #include "Engine/EngineFwd.h"
 
 NATRON_NAMESPACE_ENTER
@@ -64,12 +65,12 @@ public:
      * @brief Constructs an empty key. This constructor is used by boost::serialization.
      **/
     KeyHelper()
-        : _holderID(), _hash(), _hashComputed(false)
+        : _holderID(), _holderIndex(-1), _hash(), _hashComputed(false)
     {
     }
 
     KeyHelper(const CacheEntryHolder* holder)
-        : _holderID(), _hash(), _hashComputed(false)
+        : _holderID(), _holderIndex(-1), _hash(), _hashComputed(false)
     {
         if (holder) {
             _holderID = holder->getCacheID();
@@ -87,6 +88,7 @@ public:
      **/
     KeyHelper(const KeyHelper & other)
         : _holderID( other.getCacheHolderID() )
+        , _holderIndex(other._holderIndex)
         , _hash( other.getHash() )
         , _hashComputed(true)
     {
@@ -95,6 +97,7 @@ public:
     KeyHelper& operator=(const KeyHelper & other)
     {
         _holderID = other.getCacheHolderID();
+        _holderIndex = other._holderIndex;
         _hash = other.getHash();
         _hashComputed = true;
 
@@ -125,6 +128,18 @@ public:
         return _holderID;
     }
 
+    /**
+     * @brief Returns the index of the holder ID in the cache statistics, see CacheStatistics::getHolderIndex()
+     **/
+    int getCacheHolderIndex() const
+    {
+        if (_holderIndex < 0) {
+            _holderIndex = CacheStatistics::getHolderIndex(_holderID);
+        }
+
+        return _holderIndex;
+    }
+
 protected:
     /*for now HashType can only be 64 bits...the implementation should
        fill the Hash64 using the append function with the values contained in the
@@ -144,6 +159,9 @@ private:
 protected:
     std::string _holderID;
 
+    // Computed from _holderID on demand, -1 until then
+    mutable int _holderIndex;
+
 private:
     mutable hash_type _hash;
     mutable bool _hashComputed;
@@ -5687,6 +5687,8 @@ KnobHolder::appendValueChange(const KnobIPtr& knob,
                               ValueChangedReasonEnum originalReason,
                               ValueChangedReasonEnum reason)
 {
+    onKnobValueChangeRegistered( knob.get() );
+
     if ( isInitializingKnobs() ) {
         return;
     }
@@ -2704,6 +2704,12 @@ protected:
 
     virtual void onSignificantEvaluateAboutToBeCalled(KnobI* /*knob*/) {}
 
+    /**
+     * @brief Called by appendValueChange() whenever a value change of the given knob is registered,
+     * even while knobs are being initialized. This should be cheap, it is called for every single change.
+     **/
+    virtual void onKnobValueChangeRegistered(KnobI* /*knob*/) {}
+
     /**
      * @brief Called when the knobHolder is made slave or unslaved.
      * @param master The master knobHolder.
@@ -220,6 +220,50 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    // Among the nCandidates least recently used values that can be evicted, purge the one with the
+    // lowest score, as returned by score(value). With nCandidates = 1 this is the same as evict().
+    template <typename ScoreFunctor>
+    std::pair<key_type, V> evictLowestScore(int nCandidates,
+                                            const ScoreFunctor& score)
+    {
+        typename key_to_value_type::iterator bestIt = _key_to_value.end();
+        typename std::list<V>::iterator bestIt2;
+        double bestScore = 0.;
+        int nExamined = 0;
+        for (typename key_tracker_type::iterator kit = _key_tracker.begin();
+             kit != _key_tracker.end() && nExamined < nCandidates;
+             ++kit) {
+            typename key_to_value_type::iterator it = _key_to_value.find(*kit);
+            for (typename std::list<V>::iterator it2 = it->second.first.begin();
+                 it2 != it->second.first.end() && nExamined < nCandidates;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    double s = score(*it2);
+                    if ( (bestIt == _key_to_value.end()) || (s < bestScore) ) {
+                        bestIt = it;
+                        bestIt2 = it2;
+                        bestScore = s;
+                    }
+                    ++nExamined;
+                }
+            }
+        }
+
+        if ( bestIt == _key_to_value.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+        std::pair<key_type, V> ret = std::make_pair(bestIt->first, *bestIt2);
+        if (bestIt->second.first.size() == 1) {
+            // Erase both elements to completely purge record
+            _key_tracker.erase(bestIt->second.second);
+            _key_to_value.erase(bestIt);
+        } else {
+            bestIt->second.first.erase(bestIt2);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -333,6 +377,47 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    // Among the nCandidates least recently used values that can be evicted, purge the one with the
+    // lowest score, as returned by score(value). With nCandidates = 1 this is the same as evict().
+    template <typename ScoreFunctor>
+    std::pair<key_type, V> evictLowestScore(int nCandidates,
+                                            const ScoreFunctor& score)
+    {
+        typename container_type::right_iterator bestIt = _container.right.end();
+        typename std::list<V>::iterator bestIt2;
+        double bestScore = 0.;
+        int nExamined = 0;
+        for (typename container_type::right_iterator it = _container.right.begin();
+             it != _container.right.end() && nExamined < nCandidates;
+             ++it) {
+            for (typename std::list<V>::iterator it2 = it->first.begin();
+                 it2 != it->first.end() && nExamined < nCandidates;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    double s = score(*it2);
+                    if ( (bestIt == _container.right.end()) || (s < bestScore) ) {
+                        bestIt = it;
+                        bestIt2 = it2;
+                        bestScore = s;
+                    }
+                    ++nExamined;
+                }
+            }
+        }
+
+        if ( bestIt == _container.right.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+        std::pair<key_type, V> ret = std::make_pair(bestIt->second, *bestIt2);
+        if (bestIt->first.size() == 1) {
+            _container.right.erase(bestIt);
+        } else {
+            bestIt->first.erase(bestIt2);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -454,6 +539,50 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    // Among the nCandidates least recently used values that can be evicted, purge the one with the
+    // lowest score, as returned by score(value). With nCandidates = 1 this is the same as evict().
+    template <typename ScoreFunctor>
+    std::pair<key_type, V> evictLowestScore(int nCandidates,
+                                            const ScoreFunctor& score)
+    {
+        typename key_to_value_type::iterator bestIt = _key_to_value.end();
+        typename std::list<V>::iterator bestIt2;
+        double bestScore = 0.;
+        int nExamined = 0;
+        for (typename key_tracker_type::iterator kit = _key_tracker.begin();
+             kit != _key_tracker.end() && nExamined < nCandidates;
+             ++kit) {
+            typename key_to_value_type::iterator it = _key_to_value.find(*kit);
+            for (typename std::list<V>::iterator it2 = it->second.first.begin();
+                 it2 != it->second.first.end() && nExamined < nCandidates;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    double s = score(*it2);
+                    if ( (bestIt == _key_to_value.end()) || (s < bestScore) ) {
+                        bestIt = it;
+                        bestIt2 = it2;
+                        bestScore = s;
+                    }
+                    ++nExamined;
+                }
+            }
+        }
+
+        if ( bestIt == _key_to_value.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+        std::pair<key_type, V> ret = std::make_pair(bestIt->first, *bestIt2);
+        if (bestIt->second.first.size() == 1) {
+            // Erase both elements to completely purge record
+            _key_tracker.erase(bestIt->second.second);
+            _key_to_value.erase(bestIt);
+        } else {
+            bestIt->second.first.erase(bestIt2);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _key_to_value.size();
@@ -561,6 +690,47 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    // Among the nCandidates least recently used values that can be evicted, purge the one with the
+    // lowest score, as returned by score(value). With nCandidates = 1 this is the same as evict().
+    template <typename ScoreFunctor>
+    std::pair<key_type, V> evictLowestScore(int nCandidates,
+                                            const ScoreFunctor& score)
+    {
+        typename container_type::right_iterator bestIt = _container.right.end();
+        typename std::list<V>::iterator bestIt2;
+        double bestScore = 0.;
+        int nExamined = 0;
+        for (typename container_type::right_iterator it = _container.right.begin();
+             it != _container.right.end() && nExamined < nCandidates;
+             ++it) {
+            for (typename std::list<V>::iterator it2 = it->first.begin();
+                 it2 != it->first.end() && nExamined < nCandidates;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    double s = score(*it2);
+                    if ( (bestIt == _container.right.end()) || (s < bestScore) ) {
+                        bestIt = it;
+                        bestIt2 = it2;
+                        bestScore = s;
+                    }
+                    ++nExamined;
+                }
+            }
+        }
+
+        if ( bestIt == _container.right.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+        std::pair<key_type, V> ret = std::make_pair(bestIt->second, *bestIt2);
+        if (bestIt->first.size() == 1) {
+            _container.right.erase(bestIt);
+        } else {
+            bestIt->first.erase(bestIt2);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -663,6 +833,47 @@ public:
         return std::make_pair( key_type(), V() );
     }
 
+    // Among the nCandidates least recently used values that can be evicted, purge the one with the
+    // lowest score, as returned by score(value). With nCandidates = 1 this is the same as evict().
+    template <typename ScoreFunctor>
+    std::pair<key_type, V> evictLowestScore(int nCandidates,
+                                            const ScoreFunctor& score)
+    {
+        typename container_type::right_iterator bestIt = _container.right.end();
+        typename std::list<V>::iterator bestIt2;
+        double bestScore = 0.;
+        int nExamined = 0;
+        for (typename container_type::right_iterator it = _container.right.begin();
+             it != _container.right.end() && nExamined < nCandidates;
+             ++it) {
+            for (typename std::list<V>::iterator it2 = it->first.begin();
+                 it2 != it->first.end() && nExamined < nCandidates;
+                 ++it2) {
+                if ( (*it2).use_count() == 1 ) {
+                    double s = score(*it2);
+                    if ( (bestIt == _container.right.end()) || (s < bestScore) ) {
+                        bestIt = it;
+                        bestIt2 = it2;
+                        bestScore = s;
+                    }
+                    ++nExamined;
+                }
+            }
+        }
+
+        if ( bestIt == _container.right.end() ) {
+            return std::make_pair( key_type(), V() );
+        }
+        std::pair<key_type, V> ret = std::make_pair(bestIt->second, *bestIt2);
+        if (bestIt->first.size() == 1) {
+            _container.right.erase(bestIt);
+        } else {
+            bestIt->first.erase(bestIt2);
+        }
+
+        return ret;
+    }
+
     unsigned int size()
     {
         return _container.size();
@@ -0,0 +1,205 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_LOCKFREEQUEUE_H
+#define NATRON_ENGINE_LOCKFREEQUEUE_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <climits> // ULONG_MAX
+#include <list>
+
+GCC_DIAG_OFF(deprecated)
+#include <QtCore/QAtomicInt>
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QWaitCondition>
+GCC_DIAG_ON(deprecated)
+
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+/**
+ * @brief An unbounded multiple-producers single-consumer FIFO queue.
+ * Pushing never takes a lock: a producer appends its values with a single atomic exchange, so that threads
+ * handing off values to a worker thread do not contend with each other nor with the consumer.
+ * The consumer may block in wait() until values are pushed. The mutex of the queue is only taken by a producer
+ * when the consumer is actually waiting.
+ * push() and wakeConsumer() may be called from any thread, the other functions only from the consumer thread.
+ **/
+template <typename T>
+class LockFreeQueue
+{
+    struct Node
+    {
+        T value;
+        QAtomicPointer<Node> next;
+
+        Node()
+            : value()
+            , next(0)
+        {
+        }
+
+        explicit Node(const T& v)
+            : value(v)
+            , next(0)
+        {
+        }
+    };
+
+    // The last node pushed, only accessed with atomic operations
+    QAtomicPointer<Node> _head;
+
+    // A node whose value was already popped, its successor holds the next value to pop. Only accessed by the consumer.
+    Node* _tail;
+
+    // Non-zero while the consumer is about to wait or waiting in wait()
+    QAtomicInt _consumerWaiting;
+    QMutex _waitMutex;
+    QWaitCondition _notEmptyCond;
+
+public:
+
+    LockFreeQueue()
+        : _head(0)
+        , _tail(0)
+        , _consumerWaiting(0)
+        , _waitMutex()
+        , _notEmptyCond()
+    {
+        _tail = new Node();
+        _head.fetchAndStoreRelaxed(_tail);
+    }
+
+    ~LockFreeQueue()
+    {
+        // Not MT-safe: no other thread may use the queue anymore
+        while (_tail) {
+            Node* next = _tail->next.fetchAndAddAcquire(0);
+            delete _tail;
+            _tail = next;
+        }
+    }
+
+    void push(const T& value)
+    {
+        Node* node = new Node(value);
+
+        link(node, node);
+    }
+
+    /**
+     * @brief Pushes all the values at once: they are contiguous in the queue.
+     **/
+    void push(const std::list<T>& values)
+    {
+        if ( values.empty() ) {
+            return;
+        }
+        typename std::list<T>::const_iterator it = values.begin();
+        Node* first = new Node(*it);
+        Node* last = first;
+        for (++it; it != values.end(); ++it) {
+            Node* node = new Node(*it);
+            last->next.fetchAndStoreRelaxed(node);
+            last = node;
+        }
+        link(first, last);
+    }
+
+    /**
+     * @brief Pops the oldest value. Returns false if the queue is empty.
+     * A value being pushed concurrently may not be visible yet.
+     **/
+    bool tryPop(T* value)
+    {
+        Node* next = _tail->next.fetchAndAddAcquire(0);
+
+        if (!next) {
+            return false;
+        }
+        *value = next->value;
+        // The node stays in the queue as the new tail: release what its value holds now
+        next->value = T();
+        delete _tail;
+        _tail = next;
+
+        return true;
+    }
+
+    bool isEmpty() const
+    {
+        return _tail->next.fetchAndAddAcquire(0) == 0;
+    }
+
+    /**
+     * @brief Blocks until the queue is not empty, wakeConsumer() is called or the timeout (in milliseconds) expires.
+     * Returns true if the queue is not empty.
+     **/
+    bool wait(unsigned long timeoutMS = ULONG_MAX)
+    {
+        QMutexLocker k(&_waitMutex);
+
+        // Pairs with the ordered operations of link(): either the producer sees the flag or the consumer sees the value
+        _consumerWaiting.fetchAndStoreOrdered(1);
+        if ( _tail->next.fetchAndAddOrdered(0) == 0 ) {
+            _notEmptyCond.wait(&_waitMutex, timeoutMS);
+        }
+        _consumerWaiting.fetchAndStoreOrdered(0);
+
+        return !isEmpty();
+    }
+
+    /**
+     * @brief Makes wait() return, even if the queue is empty.
+     **/
+    void wakeConsumer()
+    {
+        QMutexLocker k(&_waitMutex);
+
+        _notEmptyCond.wakeOne();
+    }
+
+private:
+
+    void link(Node* first,
+              Node* last)
+    {
+        Node* previous = _head.fetchAndStoreOrdered(last);
+
+        // Until this store the consumer sees the queue as ending at previous
+        previous->next.fetchAndStoreOrdered(first);
+        if ( _consumerWaiting.fetchAndAddOrdered(0) ) {
+            wakeConsumer();
+        }
+    }
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_LOCKFREEQUEUE_H
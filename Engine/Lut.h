@@ -34,6 +34,7 @@
 
 
 #include <cmath>
+#include <cstddef>
 #include <map>
 #include <string>
 
@@ -215,6 +216,11 @@ public:
      */
     unsigned short toColorSpaceUint8xxFromLinearFloatFast(float v) const;
 
+    /* @brief Same as toColorSpaceUint8xxFromLinearFloatFast(float) for count contiguous values, so that the
+     * callers can look up a whole row before the error diffusion pass. The results are exactly the same.
+     */
+    void toColorSpaceUint8xxFromLinearFloatFast(const float* from, unsigned short* to, std::size_t count) const;
+
     /* @brief Converts a float ranging in [0 - 1.f] in linear color-space using the look-up tables.
      * @return An unsigned short in [0 - 65535] in the destination color-space.
      * This function uses localluy linear approximations of the transfer function.
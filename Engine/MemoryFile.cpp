@@ -125,6 +125,7 @@ MemoryFilePrivate::openInternal(MemoryFile::FileOpenModeEnum open_mode)
      ********************************************************
      *********************************************************/
     int posix_open_mode = O_RDWR;
+    int mmap_flags = MAP_SHARED;
     switch (open_mode) {
     case MemoryFile::eFileOpenModeEnumIfExistsFailElseCreate:
         posix_open_mode |= O_EXCL | O_CREAT;
@@ -140,6 +141,10 @@ MemoryFilePrivate::openInternal(MemoryFile::FileOpenModeEnum open_mode)
     case MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate:
         posix_open_mode |= O_TRUNC | O_CREAT;
         break;
+    case MemoryFile::eFileOpenModeEnumIfExistsReadOnlyElseFail:
+        posix_open_mode = O_RDONLY;
+        mmap_flags = MAP_PRIVATE;
+        break;
     default:
 
         return;
@@ -182,7 +187,7 @@ MemoryFilePrivate::openInternal(MemoryFile::FileOpenModeEnum open_mode)
      *********************************************************/
     if (sbuf.st_size > 0) {
         data = static_cast<char*>( ::mmap(
-                                       0, sbuf.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, file_handle, 0) );
+                                       0, sbuf.st_size, PROT_READ | PROT_WRITE, mmap_flags, file_handle, 0) );
         if (data == MAP_FAILED) {
             data = 0;
             std::stringstream ss;
@@ -201,6 +206,9 @@ MemoryFilePrivate::openInternal(MemoryFile::FileOpenModeEnum open_mode)
      ********************************************************
      *********************************************************/
     int windows_open_mode;
+    DWORD windows_access = GENERIC_READ | GENERIC_WRITE;
+    DWORD windows_page_protection = PAGE_READWRITE;
+    DWORD windows_map_access = FILE_MAP_WRITE;
     switch (open_mode) {
     case MemoryFile::eFileOpenModeEnumIfExistsFailElseCreate:
         windows_open_mode = CREATE_NEW;
@@ -217,6 +225,12 @@ MemoryFilePrivate::openInternal(MemoryFile::FileOpenModeEnum open_mode)
     case MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate:
         windows_open_mode = CREATE_ALWAYS;
         break;
+    case MemoryFile::eFileOpenModeEnumIfExistsReadOnlyElseFail:
+        windows_open_mode = OPEN_EXISTING;
+        windows_access = GENERIC_READ;
+        windows_page_protection = PAGE_WRITECOPY;
+        windows_map_access = FILE_MAP_COPY;
+        break;
     default:
         std::string str("MemoryFile EXC : Invalid open mode. ");
         str.append(path);
@@ -233,7 +247,7 @@ MemoryFilePrivate::openInternal(MemoryFile::FileOpenModeEnum open_mode)
      ********************************************************
      *********************************************************/
     std::wstring wpath = StrUtils::utf8_to_utf16(path);
-    file_handle = ::CreateFileW(wpath.c_str(), GENERIC_READ | GENERIC_WRITE,
+    file_handle = ::CreateFileW(wpath.c_str(), windows_access,
                                 0, 0, windows_open_mode, FILE_ATTRIBUTE_NORMAL, 0);
 
 
@@ -260,8 +274,8 @@ MemoryFilePrivate::openInternal(MemoryFile::FileOpenModeEnum open_mode)
      ********************************************************
      *********************************************************/
     if (fileSize > 0) {
-        file_mapping_handle = ::CreateFileMapping(file_handle, 0, PAGE_READWRITE, 0, 0, 0);
-        data = static_cast<char*>( ::MapViewOfFile(file_mapping_handle, FILE_MAP_WRITE, 0, 0, 0) );
+        file_mapping_handle = ::CreateFileMapping(file_handle, 0, windows_page_protection, 0, 0, 0);
+        data = static_cast<char*>( ::MapViewOfFile(file_mapping_handle, windows_map_access, 0, 0, 0) );
         if (data) {
             size = fileSize;
         } else {
@@ -56,7 +56,11 @@ public:
 
         eFileOpenModeEnumIfExistsTruncateElseFail,
 
-        eFileOpenModeEnumIfExistsTruncateElseCreate
+        eFileOpenModeEnumIfExistsTruncateElseCreate,
+
+        // Opens an existing file without write access, e.g: a file owned by another process. The mapping is
+        // copy-on-write: the file is never created nor modified.
+        eFileOpenModeEnumIfExistsReadOnlyElseFail
     };
 
     /**
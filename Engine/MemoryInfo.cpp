@@ -37,6 +37,9 @@
 #include <algorithm> // min, max
 #include <stdexcept>
 #include <sstream> // stringstream
+#include <fstream>
+#include <string>
+#include <cstdlib> // strtoull, strtod
 
 #if defined(_WIN32)
 #  include <windows.h>
@@ -59,6 +62,7 @@
 #  elif defined(__linux__) || defined(__linux) || defined(linux) || defined(__gnu_linux__) || defined(__FreeBSD__)
 #    include <stdio.h>
 #    include <unistd.h>
+#    include <time.h> // clock_gettime
 #    if defined(__FreeBSD__)
 #      include <sys/sysctl.h>
 #      include <sys/types.h>
@@ -74,11 +78,336 @@
 #include <QtCore/QLocale>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDebug>
+#include <QtCore/QMutex>
 
 #include "Global/GlobalDefines.h"
 
+///Age (in milliseconds) above which the memory information of the control group is read again when queried.
+///The CacheMemoryBudgetThread refreshes it more often than that while it runs.
+#define NATRON_CGROUP_MEMORY_INFO_MAX_AGE_MS 2000
+
 NATRON_NAMESPACE_ENTER
 
+#if defined(__linux__) || defined(__linux) || defined(linux) || defined(__gnu_linux__)
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+// Reads a file of the cgroup file system holding a single value. Returns false if it does not exist or holds "max".
+bool
+readCgroupValue(const std::string& filePath,
+                U64* value)
+{
+    std::ifstream ifile( filePath.c_str() );
+    std::string str;
+
+    if ( !(ifile >> str) || (str == "max") ) {
+        return false;
+    }
+    *value = strtoull(str.c_str(), 0, 10);
+
+    return true;
+}
+
+// Reads the value of a key in a file of the cgroup file system made of "key value" lines, e.g: memory.stat
+bool
+readCgroupKeyValue(const std::string& filePath,
+                   const std::string& key,
+                   U64* value)
+{
+    std::ifstream ifile( filePath.c_str() );
+    std::string k;
+    U64 v;
+
+    while (ifile >> k >> v) {
+        if (k == key) {
+            *value = v;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Reads the "avg10" value of the "some" line of a pressure stall information file
+double
+readPressureAvg10(const std::string& filePath)
+{
+    std::ifstream ifile( filePath.c_str() );
+    std::string line;
+
+    while ( std::getline(ifile, line) ) {
+        if (line.compare(0, 5, "some ") != 0) {
+            continue;
+        }
+        std::size_t found = line.find("avg10=");
+        if (found == std::string::npos) {
+            return -1.;
+        }
+
+        return strtod(line.c_str() + found + 6, 0);
+    }
+
+    return -1.;
+}
+
+bool
+fileExists(const std::string& filePath)
+{
+    std::ifstream ifile( filePath.c_str() );
+
+    return (bool)ifile;
+}
+
+/*
+ * Finds the directory of the memory controller of the control group of this process from /proc/self/cgroup, whose
+ * lines are "hierarchy-ID:controller-list:cgroup-path". The controller list is empty for the cgroup v2 hierarchy.
+ * The memory controller of cgroup v1 is preferred, on hybrid systems the v2 hierarchy has no memory controller.
+ */
+bool
+getCgroupMemoryDirectory(std::string* directory,
+                         bool* isV2)
+{
+    std::ifstream ifile("/proc/self/cgroup");
+    std::string line;
+    std::string v1Path, v2Path;
+    bool hasV1 = false, hasV2 = false;
+
+    while ( std::getline(ifile, line) ) {
+        std::size_t first = line.find(':');
+        std::size_t second = first == std::string::npos ? std::string::npos : line.find(':', first + 1);
+        if (second == std::string::npos) {
+            continue;
+        }
+        std::string controllers = line.substr(first + 1, second - first - 1);
+        std::string path = line.substr(second + 1);
+        if ( path == "/" ) {
+            path.clear();
+        }
+        if ( controllers.empty() ) {
+            hasV2 = true;
+            v2Path = path;
+        } else if ( ( "," + controllers + "," ).find(",memory,") != std::string::npos ) {
+            hasV1 = true;
+            v1Path = path;
+        }
+    }
+
+    // In a container with its own cgroup namespace the cgroup of the process is mounted as the root
+    if (hasV1) {
+        *isV2 = false;
+        *directory = CGROUP_ROOT "/memory" + v1Path;
+        if ( !fileExists(*directory + "/memory.limit_in_bytes") ) {
+            *directory = CGROUP_ROOT "/memory";
+        }
+
+        return fileExists(*directory + "/memory.limit_in_bytes");
+    }
+    if (hasV2) {
+        *isV2 = true;
+        *directory = CGROUP_ROOT + v2Path;
+        if ( !fileExists(*directory + "/memory.current") ) {
+            *directory = CGROUP_ROOT;
+        }
+
+        return fileExists(*directory + "/memory.current");
+    }
+
+    return false;
+}
+
+// The control group of a process does not change, it is only looked up once
+struct CgroupMemoryDirectory
+{
+    std::string path;
+    bool isV2;
+    bool found;
+
+    CgroupMemoryDirectory()
+        : path()
+        , isV2(false)
+        , found(false)
+    {
+        found = getCgroupMemoryDirectory(&path, &isV2);
+    }
+};
+
+const CgroupMemoryDirectory&
+getCgroupMemoryDirectory()
+{
+    static const CgroupMemoryDirectory directory;
+
+    return directory;
+}
+
+// Reads the memory information of the control group from its files
+void
+readCgroupMemoryInfo(const CgroupMemoryDirectory& cgroupDirectory,
+                     CgroupMemoryInfo* info)
+{
+    const std::string& directory = cgroupDirectory.path;
+
+    *info = CgroupMemoryInfo();
+    U64 inactiveFile = 0;
+    if (cgroupDirectory.isV2) {
+        // The limits of the parents apply too. memory.high is where the kernel starts throttling and reclaiming.
+        for (std::string dir = directory; dir.size() > sizeof(CGROUP_ROOT) - 1; dir.erase( dir.find_last_of('/') ) ) {
+            U64 limit;
+            if ( readCgroupValue(dir + "/memory.max", &limit) && ( !info->limit || (limit < info->limit) ) ) {
+                info->limit = limit;
+            }
+            if ( readCgroupValue(dir + "/memory.high", &limit) && ( !info->limit || (limit < info->limit) ) ) {
+                info->limit = limit;
+            }
+        }
+        readCgroupValue(directory + "/memory.current", &info->usage);
+        readCgroupKeyValue(directory + "/memory.stat", "inactive_file", &inactiveFile);
+        U64 highCount = 0, maxCount = 0;
+        readCgroupKeyValue(directory + "/memory.events", "high", &highCount);
+        readCgroupKeyValue(directory + "/memory.events", "max", &maxCount);
+        info->limitReachedCount = highCount + maxCount;
+        info->pressure = readPressureAvg10(directory + "/memory.pressure");
+    } else {
+        // hierarchical_memory_limit accounts for the limits of the parents
+        U64 limit;
+        if ( readCgroupValue(directory + "/memory.limit_in_bytes", &limit) ) {
+            info->limit = limit;
+        }
+        if ( readCgroupKeyValue(directory + "/memory.stat", "hierarchical_memory_limit", &limit) && (limit < info->limit) ) {
+            info->limit = limit;
+        }
+        readCgroupValue(directory + "/memory.usage_in_bytes", &info->usage);
+        readCgroupKeyValue(directory + "/memory.stat", "total_inactive_file", &inactiveFile);
+        readCgroupValue(directory + "/memory.failcnt", &info->limitReachedCount);
+    }
+    if (info->pressure < 0) {
+        // Pressure of the whole system, cgroup v1 has no pressure stall information per control group
+        info->pressure = readPressureAvg10("/proc/pressure/memory");
+    }
+    info->usage = inactiveFile >= info->usage ? 0 : info->usage - inactiveFile;
+
+    // cgroup v1 reports a huge value when there is no limit
+    if ( info->limit >= getSystemTotalRAM() ) {
+        info->limit = 0;
+    }
+}
+
+U64
+getMonotonicTimeMS()
+{
+    struct timespec now;
+
+    // The coarse clock does not enter the kernel: it is cheap enough to be read for every query
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &now);
+#endif
+
+    return (U64)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// The last memory information read, so that the files of the control group are not read again on every query,
+// e.g: each time an image is cached
+struct CgroupMemoryInfoCache
+{
+    QMutex lock;
+    CgroupMemoryInfo info;
+    U64 readTimeMS;
+    bool valid;
+
+    CgroupMemoryInfoCache()
+        : lock()
+        , info()
+        , readTimeMS(0)
+        , valid(false)
+    {
+    }
+};
+
+CgroupMemoryInfoCache&
+getCgroupMemoryInfoCache()
+{
+    static CgroupMemoryInfoCache cache;
+
+    return cache;
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+#endif // linux
+
+bool
+refreshCgroupMemoryInfo(CgroupMemoryInfo* info)
+{
+#if defined(__linux__) || defined(__linux) || defined(linux) || defined(__gnu_linux__)
+    const CgroupMemoryDirectory& cgroupDirectory = getCgroupMemoryDirectory();
+
+    if (!cgroupDirectory.found) {
+        return false;
+    }
+
+    CgroupMemoryInfo newInfo;
+    readCgroupMemoryInfo(cgroupDirectory, &newInfo);
+    {
+        CgroupMemoryInfoCache& cache = getCgroupMemoryInfoCache();
+        QMutexLocker k(&cache.lock);
+        cache.info = newInfo;
+        cache.readTimeMS = getMonotonicTimeMS();
+        cache.valid = true;
+    }
+    if (info) {
+        *info = newInfo;
+    }
+
+    return true;
+#else
+    Q_UNUSED(info);
+
+    return false;
+#endif
+}
+
+bool
+getCgroupMemoryInfo(CgroupMemoryInfo* info)
+{
+#if defined(__linux__) || defined(__linux) || defined(linux) || defined(__gnu_linux__)
+    if (!getCgroupMemoryDirectory().found) {
+        return false;
+    }
+    {
+        CgroupMemoryInfoCache& cache = getCgroupMemoryInfoCache();
+        QMutexLocker k(&cache.lock);
+        if ( cache.valid && (getMonotonicTimeMS() - cache.readTimeMS <= NATRON_CGROUP_MEMORY_INFO_MAX_AGE_MS) ) {
+            *info = cache.info;
+
+            return true;
+        }
+    }
+
+    return refreshCgroupMemoryInfo(info);
+#else
+    Q_UNUSED(info);
+
+    return false;
+#endif
+}
+
+U64
+getEffectiveTotalRAM()
+{
+    U64 total = getSystemTotalRAM();
+    CgroupMemoryInfo cgroupInfo;
+
+    if ( getCgroupMemoryInfo(&cgroupInfo) && cgroupInfo.limit ) {
+        total = std::min(total, cgroupInfo.limit);
+    }
+
+    return total;
+}
+
 U64
 getSystemTotalRAM()
 {
@@ -155,9 +484,9 @@ U64
 getSystemTotalRAM_conditionnally()
 {
     if ( isApplication32Bits() ) {
-        return std::min( (U64)0x100000000ULL, getSystemTotalRAM() );
+        return std::min( (U64)0x100000000ULL, getEffectiveTotalRAM() );
     } else {
-        return getSystemTotalRAM();
+        return getEffectiveTotalRAM();
     }
 }
 
@@ -318,6 +647,12 @@ getAmountFreePhysicalRAM()
     long long totalAvailableRAM = memInfo.freeram;
     totalAvailableRAM *= memInfo.mem_unit;
 
+    CgroupMemoryInfo cgroupInfo;
+    if ( getCgroupMemoryInfo(&cgroupInfo) && cgroupInfo.limit ) {
+        long long cgroupAvailableRAM = cgroupInfo.usage >= cgroupInfo.limit ? 0 : (long long)(cgroupInfo.limit - cgroupInfo.usage);
+        totalAvailableRAM = std::min(totalAvailableRAM, cgroupAvailableRAM);
+    }
+
     return totalAvailableRAM;
 #elif defined(__FreeBSD__) || defined(__FreeBSD_kernel__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__DragonFly__) || defined(__APPLE__)
     // and http://source.winehq.org/git/wine.git/blob/HEAD:/dlls/kernel32/heap.c
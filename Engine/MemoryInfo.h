@@ -45,6 +45,7 @@ inline bool isApplication32Bits()
     return sizeof(void*) == 4;
 }
 
+// Same as getEffectiveTotalRAM(), limited to 4 GiB for 32-bit applications
 U64 getSystemTotalRAM_conditionnally();
 
 // prints RAM value as KB, MB or GB
@@ -65,8 +66,59 @@ std::size_t getPeakRSS( );
 std::size_t getCurrentRSS( );
 #endif // 0
 
+/**
+ * @brief Returns the amount of free RAM. If this process runs in a control group with a memory limit, e.g: in a
+ * container, the memory left before reaching the limit is returned if it is lower.
+ **/
 std::size_t getAmountFreePhysicalRAM();
 
+/**
+ * @brief Memory limit, usage and pressure of the control group (cgroup v1 or v2) this process belongs to, as set up
+ * by containers (Docker, Kubernetes...) or systemd. Sizes are in bytes.
+ **/
+struct CgroupMemoryInfo
+{
+    // Lowest memory limit of the control group and its parents, 0 if there is none
+    U64 limit;
+
+    // Memory used by all the processes of the control group, minus the file cache the kernel may reclaim
+    U64 usage;
+
+    // Number of times the memory usage reached a limit of the control group so far
+    U64 limitReachedCount;
+
+    // Percentage of the last 10 seconds during which some processes were stalled waiting for memory, -1 if unknown
+    double pressure;
+
+    CgroupMemoryInfo()
+        : limit(0)
+        , usage(0)
+        , limitReachedCount(0)
+        , pressure(-1.)
+    {
+    }
+};
+
+/**
+ * @brief Fills info with the memory information of the control group of this process. Returns false if the process
+ * does not belong to a control group with a memory controller, which is always the case on systems other than Linux.
+ * The values last read by refreshCgroupMemoryInfo() are returned, they are only read again if they are older than
+ * NATRON_CGROUP_MEMORY_INFO_MAX_AGE_MS.
+ **/
+bool getCgroupMemoryInfo(CgroupMemoryInfo* info);
+
+/**
+ * @brief Same as getCgroupMemoryInfo() but always reads the files of the control group, and stores the values for
+ * the next calls to getCgroupMemoryInfo(). Called periodically by the CacheMemoryBudgetThread. info may be NULL.
+ **/
+bool refreshCgroupMemoryInfo(CgroupMemoryInfo* info = 0);
+
+/**
+ * @brief Returns the amount of RAM this process may use: the total RAM of the system, or the memory limit of its
+ * control group if it is lower.
+ **/
+U64 getEffectiveTotalRAM();
+
 NATRON_NAMESPACE_EXIT
 
 #endif // ifndef Engine_MemoryInfo_h
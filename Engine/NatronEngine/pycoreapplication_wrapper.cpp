@@ -168,6 +168,32 @@ static PyObject* Sbk_PyCoreApplicationFunc_getBuildNumber(PyObject* self)
     return pyResult;
 }
 
+static PyObject* Sbk_PyCoreApplicationFunc_getCacheStatistics(PyObject* self)
+{
+    ::PyCoreApplication* cppSelf = 0;
+    SBK_UNUSED(cppSelf)
+    if (!Shiboken::Object::isValid(self))
+        return 0;
+    cppSelf = ((::PyCoreApplication*)Shiboken::Conversions::cppPointer(SbkNatronEngineTypes[SBK_PYCOREAPPLICATION_IDX], (SbkObject*)self));
+    PyObject* pyResult = 0;
+
+    // Call function/method
+    {
+
+        if (!PyErr_Occurred()) {
+            // getCacheStatistics()const
+            QMap<QString, QVariant > cppResult = const_cast<const ::PyCoreApplication*>(cppSelf)->getCacheStatistics();
+            pyResult = Shiboken::Conversions::copyToPython(SbkNatronEngineTypeConverters[SBK_NATRONENGINE_QMAP_QSTRING_QVARIANT_IDX], &cppResult);
+        }
+    }
+
+    if (PyErr_Occurred() || !pyResult) {
+        Py_XDECREF(pyResult);
+        return 0;
+    }
+    return pyResult;
+}
+
 static PyObject* Sbk_PyCoreApplicationFunc_getInstance(PyObject* self, PyObject* pyArg)
 {
     ::PyCoreApplication* cppSelf = 0;
@@ -707,6 +733,29 @@ static PyObject* Sbk_PyCoreApplicationFunc_isWindows(PyObject* self)
     return pyResult;
 }
 
+static PyObject* Sbk_PyCoreApplicationFunc_resetCacheStatistics(PyObject* self)
+{
+    ::PyCoreApplication* cppSelf = 0;
+    SBK_UNUSED(cppSelf)
+    if (!Shiboken::Object::isValid(self))
+        return 0;
+    cppSelf = ((::PyCoreApplication*)Shiboken::Conversions::cppPointer(SbkNatronEngineTypes[SBK_PYCOREAPPLICATION_IDX], (SbkObject*)self));
+
+    // Call function/method
+    {
+
+        if (!PyErr_Occurred()) {
+            // resetCacheStatistics()
+            cppSelf->resetCacheStatistics();
+        }
+    }
+
+    if (PyErr_Occurred()) {
+        return 0;
+    }
+    Py_RETURN_NONE;
+}
+
 static PyObject* Sbk_PyCoreApplicationFunc_setOnProjectCreatedCallback(PyObject* self, PyObject* pyArg)
 {
     ::PyCoreApplication* cppSelf = 0;
@@ -795,6 +844,7 @@ static PyMethodDef Sbk_PyCoreApplication_methods[] = {
     {"appendToNatronPath", (PyCFunction)Sbk_PyCoreApplicationFunc_appendToNatronPath, METH_O},
     {"getActiveInstance", (PyCFunction)Sbk_PyCoreApplicationFunc_getActiveInstance, METH_NOARGS},
     {"getBuildNumber", (PyCFunction)Sbk_PyCoreApplicationFunc_getBuildNumber, METH_NOARGS},
+    {"getCacheStatistics", (PyCFunction)Sbk_PyCoreApplicationFunc_getCacheStatistics, METH_NOARGS},
     {"getInstance", (PyCFunction)Sbk_PyCoreApplicationFunc_getInstance, METH_O},
     {"getNatronDevelopmentStatus", (PyCFunction)Sbk_PyCoreApplicationFunc_getNatronDevelopmentStatus, METH_NOARGS},
     {"getNatronPath", (PyCFunction)Sbk_PyCoreApplicationFunc_getNatronPath, METH_NOARGS},
@@ -813,6 +863,7 @@ static PyMethodDef Sbk_PyCoreApplication_methods[] = {
     {"isMacOSX", (PyCFunction)Sbk_PyCoreApplicationFunc_isMacOSX, METH_NOARGS},
     {"isUnix", (PyCFunction)Sbk_PyCoreApplicationFunc_isUnix, METH_NOARGS},
     {"isWindows", (PyCFunction)Sbk_PyCoreApplicationFunc_isWindows, METH_NOARGS},
+    {"resetCacheStatistics", (PyCFunction)Sbk_PyCoreApplicationFunc_resetCacheStatistics, METH_NOARGS},
     {"setOnProjectCreatedCallback", (PyCFunction)Sbk_PyCoreApplicationFunc_setOnProjectCreatedCallback, METH_O},
     {"setOnProjectLoadedCallback", (PyCFunction)Sbk_PyCoreApplicationFunc_setOnProjectLoadedCallback, METH_O},
 
@@ -60,6 +60,7 @@ GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #include "Engine/AppManager.h"
 #include "Engine/Backdrop.h"
 #include "Engine/CreateNodeArgs.h"
+#include "Engine/Curve.h"
 #include "Engine/DiskCacheNode.h"
 #include "Engine/Dot.h"
 #include "Engine/EffectInstance.h"
@@ -784,6 +785,119 @@ Node::getCacheID() const
     return _imp->cacheID;
 }
 
+static void
+appendCurveToHash(const Curve& curve,
+                  Hash64* hash)
+{
+    KeyFrameSet keys = curve.getKeyFrames_mt_safe();
+
+    hash->append( (U64)keys.size() );
+    for (KeyFrameSet::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+        hash->append( it->getTime() );
+        hash->append( it->getValue() );
+        hash->append( it->getLeftDerivative() );
+        hash->append( it->getRightDerivative() );
+        hash->append( (int)it->getInterpolation() );
+    }
+}
+
+/**
+ * @brief Computes a hash of the values, animation curves and parametric curves of all dimensions of the knob.
+ * @returns False if the knob cannot be described by its own values (expressions, slaved dimensions...),
+ * in which case the knobs age must be used instead.
+ **/
+static bool
+computeKnobContentHash(const KnobIPtr& knob,
+                       U64* contentHash)
+{
+    KnobIntBase* isInt = dynamic_cast<KnobIntBase*>( knob.get() );
+    KnobBoolBase* isBool = dynamic_cast<KnobBoolBase*>( knob.get() );
+    KnobDoubleBase* isDouble = dynamic_cast<KnobDoubleBase*>( knob.get() );
+    KnobStringBase* isString = dynamic_cast<KnobStringBase*>( knob.get() );
+    KnobParametric* isParametric = dynamic_cast<KnobParametric*>( knob.get() );
+    Hash64 hash;
+
+    Hash64_appendQString( &hash, QString::fromUtf8( knob->getName().c_str() ) );
+
+    int nDims = knob->getDimension();
+    for (int i = 0; i < nDims; ++i) {
+        if ( knob->isSlave(i) || !knob->getExpression(i).empty() ) {
+            return false;
+        }
+        CurvePtr curve = knob->getCurve(ViewIdx(0), i);
+        if ( curve && knob->isAnimated( i, ViewIdx(0) ) ) {
+            if (isString) {
+                // The keyframes of a string knob only hold indices in its animation manager
+                return false;
+            }
+            appendCurveToHash(*curve, &hash);
+        } else if (isInt) {
+            hash.append( isInt->getValue(i) );
+        } else if (isBool) {
+            hash.append( (int)isBool->getValue(i) );
+        } else if (isDouble) {
+            hash.append( isDouble->getValue(i) );
+        } else if (isString) {
+            Hash64_appendQString( &hash, QString::fromUtf8( isString->getValue(i).c_str() ) );
+        }
+        if (isParametric) {
+            CurvePtr parametricCurve = isParametric->getParametricCurve(i);
+            if (parametricCurve) {
+                appendCurveToHash(*parametricCurve, &hash);
+            }
+        }
+    }
+    hash.computeHash();
+    *contentHash = hash.value();
+
+    return true;
+}
+
+/**
+ * @brief Fills knobsHash with the content hash of all knobs of the effect that have an influence on the render.
+ * Only the knobs marked dirty since the last call are hashed again.
+ * @returns False if a knob cannot be hashed by content.
+ **/
+static bool
+getKnobsContentHash(Node::Implementation* imp,
+                    std::vector<U64>* knobsHash)
+{
+    KnobsVec knobs = imp->effect->getKnobs();
+
+    knobsHash->reserve( knobs.size() );
+    for (KnobsVec::const_iterator it = knobs.begin(); it != knobs.end(); ++it) {
+        if ( !(*it)->getEvaluateOnChange() ) {
+            continue;
+        }
+        U64 generation;
+        {
+            QMutexLocker k(&imp->knobsContentHashMutex);
+            KnobContentHashMap::const_iterator found = imp->knobsContentHash.find( it->get() );
+            if ( ( found != imp->knobsContentHash.end() ) && (found->second.knob.lock() == *it) ) {
+                knobsHash->push_back(found->second.hash);
+                continue;
+            }
+            generation = imp->knobsContentHashGeneration;
+        }
+
+        U64 contentHash;
+        if ( !computeKnobContentHash(*it, &contentHash) ) {
+            return false;
+        }
+        knobsHash->push_back(contentHash);
+
+        QMutexLocker k(&imp->knobsContentHashMutex);
+        // If a knob was made dirty while we were hashing, it may be this one: do not keep a stale hash
+        if (generation == imp->knobsContentHashGeneration) {
+            KnobContentHash& entry = imp->knobsContentHash[it->get()];
+            entry.knob = *it;
+            entry.hash = contentHash;
+        }
+    }
+
+    return true;
+}
+
 bool
 Node::computeHashInternal()
 {
@@ -796,6 +910,25 @@ Node::computeHashInternal()
         qDebug() << "Node::computeHash(): inputs not initialized";
     }
 
+    /*
+     * With content-based hashing, the node is identified by its plug-in, the values of its knobs and its inputs
+     * instead of its knobs age, script name and project. The same state of the graph thus always maps to the
+     * same cache entries, e.g: after an undo/redo, a copy/paste or when the project is loaded again.
+     * Nodes whose output is driven by more than their knobs (roto, tracker, expressions...) keep the knobs age.
+     */
+    RotoDrawableItemPtr attachedStroke = _imp->paintStroke.lock();
+    std::vector<U64> knobsContentHash;
+    bool contentBasedHash = appPTR->getCurrentSettings()->isContentBasedNodeHashEnabled() &&
+                            !attachedStroke && !_imp->rotoContext && !_imp->trackContext;
+    if (contentBasedHash) {
+        contentBasedHash = getKnobsContentHash(_imp.get(), &knobsContentHash);
+    }
+    U64 contentHashSalt = 0;
+    if (contentBasedHash) {
+        QMutexLocker k(&_imp->knobsContentHashMutex);
+        contentHashSalt = _imp->knobsContentHashSalt;
+    }
+
     U64 oldHash, newHash;
     {
         QWriteLocker l(&_imp->knobsAgeMutex);
@@ -805,11 +938,21 @@ Node::computeHashInternal()
         ///reset the hash value
         _imp->hash.reset();
 
-        ///append the effect's own age
-        _imp->hash.append(_imp->knobsAge);
+        if (contentBasedHash) {
+            ///append the plug-in identity and the values of the knobs
+            Hash64_appendQString( &_imp->hash, QString::fromUtf8( getPluginID().c_str() ) );
+            _imp->hash.append( getMajorVersion() );
+            _imp->hash.append( getMinorVersion() );
+            _imp->hash.append(contentHashSalt);
+            for (std::vector<U64>::const_iterator it = knobsContentHash.begin(); it != knobsContentHash.end(); ++it) {
+                _imp->hash.append(*it);
+            }
+        } else {
+            ///append the effect's own age
+            _imp->hash.append(_imp->knobsAge);
+        }
 
         ///append all inputs hash
-        RotoDrawableItemPtr attachedStroke = _imp->paintStroke.lock();
         NodePtr attachedStrokeContextNode;
         if (attachedStroke) {
             attachedStrokeContextNode = attachedStroke->getContext()->getNode();
@@ -854,13 +997,15 @@ Node::computeHashInternal()
         //            _imp->hash.append(rotoAge);
         //        }
 
-        ///Also append the effect's label to distinguish 2 instances with the same parameters
-        Hash64_appendQString( &_imp->hash, QString::fromUtf8( getScriptName().c_str() ) );
+        if (!contentBasedHash) {
+            ///Also append the effect's label to distinguish 2 instances with the same parameters
+            Hash64_appendQString( &_imp->hash, QString::fromUtf8( getScriptName().c_str() ) );
 
-        ///Also append the project's creation time in the hash because 2 projects opened concurrently
-        ///could reproduce the same (especially simple graphs like Viewer-Reader)
-        qint64 creationTime =  getApp()->getProject()->getProjectCreationTime();
-        _imp->hash.append(creationTime);
+            ///Also append the project's creation time in the hash because 2 projects opened concurrently
+            ///could reproduce the same (especially simple graphs like Viewer-Reader)
+            qint64 creationTime =  getApp()->getProject()->getProjectCreationTime();
+            _imp->hash.append(creationTime);
+        }
 
         _imp->hash.computeHash();
 
@@ -870,10 +1015,11 @@ Node::computeHashInternal()
 
     if (hashChanged) {
         _imp->effect->onNodeHashChanged(newHash);
-        if ( _imp->nodeCreated && !getApp()->getProject()->isProjectClosing() ) {
+        if ( !contentBasedHash && _imp->nodeCreated && !getApp()->getProject()->isProjectClosing() ) {
             /*
              * We changed the node hash. That means all cache entries for this node with a different hash
              * are impossible to re-create again. Just discard them all. This is done in a separate thread.
+             * With content-based hashing they are kept: going back to a previous state hits them again.
              */
             removeAllImagesFromCacheWithMatchingIDAndDifferentKey(newHash);
         }
@@ -1250,6 +1396,9 @@ Node::setKnobsAge(U64 newAge)
     ////Only called by the main-thread
     assert( QThread::currentThread() == qApp->thread() );
 
+    // The knobs were just loaded
+    invalidateKnobContentHash(0);
+
     bool changed;
     {
         QWriteLocker l(&_imp->knobsAgeMutex);
@@ -1309,6 +1458,23 @@ Node::getKnobsAge() const
     return _imp->knobsAge;
 }
 
+void
+Node::invalidateKnobContentHash(KnobI* knob)
+{
+    QMutexLocker k(&_imp->knobsContentHashMutex);
+
+    ++_imp->knobsContentHashGeneration;
+    if (!knob) {
+        _imp->knobsContentHash.clear();
+    } else {
+        _imp->knobsContentHash.erase(knob);
+        // Pressing a button is an explicit request to render again (e.g: reload a file)
+        if ( dynamic_cast<KnobButton*>(knob) && knob->getEvaluateOnChange() ) {
+            ++_imp->knobsContentHashSalt;
+        }
+    }
+}
+
 bool
 Node::isRenderingPreview() const
 {
@@ -1603,6 +1769,7 @@ Node::makeInfoForInput(int inputNumber) const
                 break;
             case eImageBitDepthHalf:
                 depthStr = tr("16fp");
+                break;
             case eImageBitDepthNone:
                 break;
         }
@@ -3342,6 +3509,7 @@ Node::makePreviewImage(SequenceTime time,
 
     {
         AbortableRenderInfoPtr abortInfo = AbortableRenderInfo::create(true, 0);
+        abortInfo->setRenderPriority(eRenderPriorityBackground);
         const bool isRenderUserInteraction = true;
         const bool isSequentialRender = false;
         AbortableThread* isAbortable = dynamic_cast<AbortableThread*>( QThread::currentThread() );
@@ -3424,8 +3592,10 @@ Node::makePreviewImage(SequenceTime time,
             renderPreviewForDepth<unsigned short, 65535>(*img, elemCount, width, height, convertToSrgb, buf);
             break;
         }
-        case eImageBitDepthHalf:
+        case eImageBitDepthHalf: {
+            renderPreviewForDepth<Half, 1>(*img, elemCount, width, height, convertToSrgb, buf);
             break;
+        }
         case eImageBitDepthFloat: {
             renderPreviewForDepth<float, 1>(*img, elemCount, width, height, convertToSrgb, buf);
             break;
@@ -878,6 +878,13 @@ public:
 
     U64 getKnobsAge() const;
 
+    /**
+     * @brief Marks the hash of the values of the given knob as dirty so that it gets recomputed
+     * the next time computeHashInternal() runs with content-based hashing.
+     * If knob is NULL, all knobs are marked dirty.
+     **/
+    void invalidateKnobContentHash(KnobI* knob);
+
     void onAllKnobsSlaved(bool isSlave, KnobHolder* master);
 
     void onKnobSlaved(const KnobIPtr& slave, const KnobIPtr& master, int dimension, bool isSlave);
@@ -882,21 +882,28 @@ Node::isSupportedComponent(int inputNb,
 ImageBitDepthEnum
 Node::getClosestSupportedBitDepth(ImageBitDepthEnum depth)
 {
+    if ( isSupportedBitDepth(depth) ) {
+        return depth;
+    }
+
+    bool foundHalf = false;
     bool foundShort = false;
     bool foundByte = false;
 
     for (std::list<ImageBitDepthEnum>::const_iterator it = _imp->supportedDepths.begin(); it != _imp->supportedDepths.end(); ++it) {
-        if (*it == depth) {
-            return depth;
-        } else if (*it == eImageBitDepthFloat) {
+        if (*it == eImageBitDepthFloat) {
             return eImageBitDepthFloat;
+        } else if (*it == eImageBitDepthHalf) {
+            foundHalf = true;
         } else if (*it == eImageBitDepthShort) {
             foundShort = true;
         } else if (*it == eImageBitDepthByte) {
             foundByte = true;
         }
     }
-    if (foundShort) {
+    if (foundHalf) {
+        return eImageBitDepthHalf;
+    } else if (foundShort) {
         return eImageBitDepthShort;
     } else if (foundByte) {
         return eImageBitDepthByte;
@@ -911,6 +918,7 @@ Node::getClosestSupportedBitDepth(ImageBitDepthEnum depth)
 ImageBitDepthEnum
 Node::getBestSupportedBitDepth() const
 {
+    bool foundHalf = false;
     bool foundShort = false;
     bool foundByte = false;
 
@@ -925,6 +933,7 @@ Node::getBestSupportedBitDepth() const
             break;
 
         case eImageBitDepthHalf:
+            foundHalf = true;
             break;
 
         case eImageBitDepthFloat:
@@ -936,7 +945,9 @@ Node::getBestSupportedBitDepth() const
         }
     }
 
-    if (foundShort) {
+    if (foundHalf) {
+        return eImageBitDepthHalf;
+    } else if (foundShort) {
         return eImageBitDepthShort;
     } else if (foundByte) {
         return eImageBitDepthByte;
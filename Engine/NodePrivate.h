@@ -43,6 +43,15 @@ typedef std::map<NodeWPtr, int > DeactivatedState;
 typedef std::list<Node::KnobLink> KnobLinkList;
 typedef std::vector<NodeWPtr> InputsV;
 
+/*Hash of the values of a knob, used when content-based node hashing is enabled*/
+struct KnobContentHash
+{
+    KnobIWPtr knob; //< to detect a knob destroyed and another allocated at the same address
+    U64 hash;
+};
+
+typedef std::map<KnobI*, KnobContentHash> KnobContentHashMap;
+
 
 class ChannelSelector
 {
@@ -176,6 +185,10 @@ public:
         , renderInstancesSharedMutex(QMutex::Recursive)
         , knobsAge(0)
         , knobsAgeMutex()
+        , knobsContentHashMutex()
+        , knobsContentHash()
+        , knobsContentHashGeneration(0)
+        , knobsContentHashSalt(0)
         , masterNodeMutex()
         , masterNode()
         , nodeLinks()
@@ -360,6 +373,10 @@ public:
     U64 knobsAge; //< the age of the knobs in this effect. It gets incremented every times the effect has its evaluate() function called.
     mutable QReadWriteLock knobsAgeMutex; //< protects knobsAge and hash
     Hash64 hash; //< recomputed every time knobsAge is changed.
+    mutable QMutex knobsContentHashMutex; //< protects knobsContentHash, knobsContentHashGeneration and knobsContentHashSalt
+    KnobContentHashMap knobsContentHash; //< per-knob hash of the values, only used with content-based hashing. A knob not in the map is dirty.
+    U64 knobsContentHashGeneration; //< incremented every time a knob is made dirty
+    U64 knobsContentHashSalt; //< incremented every time a button is pressed, since it is an explicit request to render again
     mutable QMutex masterNodeMutex; //< protects masterNode and nodeLinks
     NodeWPtr masterNode; //< this points to the master when the node is a clone
     KnobLinkList nodeLinks; //< these point to the parents of the params links
@@ -42,6 +42,8 @@ CLANG_DIAG_OFF(deprecated-register) //'register' storage class specifier is depr
 #include <QtCore/QDateTime>
 #include <QtCore/QDir>
 #include <QtCore/QMutex>
+#include <QtCore/QRunnable>
+#include <QtCore/QSemaphore>
 #include <QtCore/QThreadPool>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QDebug>
@@ -50,11 +52,6 @@ CLANG_DIAG_ON(deprecated-register)
 #ifdef OFX_SUPPORTS_MULTITHREAD
 #include <QtCore/QThread>
 #include <QtCore/QThreadStorage>
-#include <QtConcurrentMap> // QtCore on Qt4, QtConcurrent on Qt5
-GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
-// /usr/local/include/boost/bind/arg.hpp:37:9: warning: unused typedef 'boost_static_assert_typedef_37' [-Wunused-local-typedef]
-#include <boost/bind.hpp>
-GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
 #endif
 CLANG_DIAG_ON(deprecated)
 CLANG_DIAG_ON(uninitialized)
@@ -92,6 +89,7 @@ CLANG_DIAG_ON(unknown-pragmas)
 #include "Global/FloatingPointExceptions.h"
 #endif
 
+#include "Engine/AbortableRenderInfo.h"
 #include "Engine/AppInstance.h"
 #include "Engine/AppManager.h"
 #include "Engine/CreateNodeArgs.h"
@@ -1309,6 +1307,67 @@ private:
     OfxStatus *_stat;
 };
 
+// Runs the thread indexes firstThreadIndex, firstThreadIndex + nRunnables, ... of a multiThread call on the global thread pool
+class OfxThreadRunnable
+    : public QRunnable
+{
+public:
+    OfxThreadRunnable(OfxThreadFunctionV1 func,
+                      unsigned int firstThreadIndex,
+                      unsigned int nRunnables,
+                      unsigned int threadMax,
+                      QThread* spawnerThread,
+                      void *customArg,
+                      OfxStatus *stat,
+                      QSemaphore* finished)
+        : QRunnable()
+        , _func(func)
+        , _firstThreadIndex(firstThreadIndex)
+        , _nRunnables(nRunnables)
+        , _threadMax(threadMax)
+        , _spawnerThread(spawnerThread)
+        , _customArg(customArg)
+        , _stat(stat)
+        , _finished(finished)
+    {
+    }
+
+    void run() OVERRIDE
+    {
+        *_stat = kOfxStatOK;
+        for (unsigned int i = _firstThreadIndex; i < _threadMax && *_stat == kOfxStatOK; i += _nRunnables) {
+            *_stat = threadFunctionWrapper(_func, i, _threadMax, _spawnerThread, _customArg);
+        }
+        _finished->release();
+    }
+
+private:
+    OfxThreadFunctionV1 *_func;
+    unsigned int _firstThreadIndex;
+    unsigned int _nRunnables;
+    unsigned int _threadMax;
+    QThread* _spawnerThread;
+    void *_customArg;
+    OfxStatus *_stat;
+    QSemaphore* _finished;
+};
+
+// The priority class of the render calling the multi-thread suite on this thread
+RenderPriorityEnum
+getCurrentRenderPriority()
+{
+    AbortableThread* isAbortable = dynamic_cast<AbortableThread*>( QThread::currentThread() );
+    bool isRenderResponseToUserInteraction;
+    AbortableRenderInfoPtr abortInfo;
+    EffectInstancePtr treeRoot;
+
+    if ( isAbortable && isAbortable->getAbortInfo(&isRenderResponseToUserInteraction, &abortInfo, &treeRoot) && abortInfo ) {
+        return abortInfo->getRenderPriority();
+    }
+
+    return eRenderPriorityInteractive;
+}
+
 NATRON_NAMESPACE_ANONYMOUS_EXIT
 
 
@@ -1353,21 +1412,21 @@ OfxHost::multiThread(OfxThreadFunctionV1 func,
 
     QThread* spawnerThread = QThread::currentThread();
     bool useThreadPool = appPTR->getUseThreadPool();
+    RenderPriorityEnum priority = getCurrentRenderPriority();
 
     if (useThreadPool) {
-        std::vector<unsigned int> threadIndexes(nThreads);
-        for (unsigned int i = 0; i < nThreads; ++i) {
-            threadIndexes[i] = i;
-        }
-
         /// DON'T set the maximum thread count, this is a global application setting, and see the documentation excerpt above
-        //QThreadPool::globalInstance()->setMaxThreadCount(nThreads);
-        QFuture<OfxStatus> future = QtConcurrent::mapped( threadIndexes, boost::bind(threadFunctionWrapper, func, _1, nThreads, spawnerThread, customArg) );
-        future.waitForFinished();
-        ///DON'T reset back to the original value the maximum thread count
-        //QThreadPool::globalInstance()->setMaxThreadCount(QThread::idealThreadCount());
+        // Queue the runnables with the priority of the render, so that the pool starts those of the renders the user is waiting on first
+        unsigned int nRunnables = std::min(nThreads, maxConcurrentThread);
+        std::vector<OfxStatus> status(nRunnables, kOfxStatFailed);
+        QSemaphore finished(0);
+        for (unsigned int i = 0; i < nRunnables; ++i) {
+            QThreadPool::globalInstance()->start( new OfxThreadRunnable(func, i, nRunnables, nThreads, spawnerThread, customArg, &status[i], &finished),
+                                                  AbortableRenderInfo::getThreadPoolPriority(priority) );
+        }
+        finished.acquire(nRunnables);
 
-        for (QFuture<OfxStatus>::const_iterator it = future.begin(); it != future.end(); ++it) {
+        for (std::vector<OfxStatus>::const_iterator it = status.begin(); it != status.end(); ++it) {
             OfxStatus stat = *it;
             if (stat != kOfxStatOK) {
                 return stat;
@@ -1389,7 +1448,12 @@ OfxHost::multiThread(OfxThreadFunctionV1 func,
                 // have no more than maxConcurrentThread threads launched at the same time
                 int threadsStarted = 0;
                 while (i < nThreads && running < maxConcurrentThread) {
-                    threads[i]->start();
+                    // When rendering from the GUI, let the OS favour the threads the user is waiting on, see OutputSchedulerThread
+                    if ( (priority >= eRenderPriorityPrefetch) && !appPTR->isBackground() ) {
+                        threads[i]->start(QThread::LowPriority);
+                    } else {
+                        threads[i]->start();
+                    }
                     ++i;
                     ++running;
                     ++threadsStarted;
@@ -1475,6 +1539,11 @@ OfxHost::multiThreadNumCPUS(unsigned int *nCPUs) const
         ///+1 because the current thread is going to wait during the multiThread call so we're better off
         ///not counting it.
         *nCPUs = std::max( 1, std::min(maxThreadsCount - activeThreadsCount + 1, nThreadsPerEffect) );
+
+        // When rendering from the GUI, prefetching and background renders leave half of the threads to the renders the user is waiting on
+        if ( (getCurrentRenderPriority() >= eRenderPriorityPrefetch) && !appPTR->isBackground() ) {
+            *nCPUs = std::max(1u, *nCPUs / 2);
+        }
     }
 
     return kOfxStatOK;
@@ -404,9 +404,11 @@ void
 OutputEffectInstance::reportStats(int time,
                                   ViewIdx view,
                                   double wallTime,
-                                  const std::map<NodePtr, NodeRenderStats > & stats)
+                                  const std::map<NodePtr, NodeRenderStats > & stats,
+                                  const RenderTraceEventList& traceEvents)
 {
     std::string filename;
+    std::string traceFilename;
     KnobIPtr fileKnob = getKnobByName(kOfxImageEffectFileParamName);
 
     if (fileKnob) {
@@ -414,6 +416,7 @@ OutputEffectInstance::reportStats(int time,
         if  (strKnob) {
             QString qfileName = QString::fromUtf8( SequenceParsing::generateFileNameFromPattern(strKnob->getValue( 0, ViewIdx(view) ), getApp()->getProject()->getProjectViewNames(), time, view).c_str() );
             QtCompat::removeFileExtension(qfileName);
+            traceFilename = qfileName.toStdString() + "-trace.json";
             qfileName.append( QString::fromUtf8("-stats.txt") );
             filename = qfileName.toStdString();
         }
@@ -528,6 +531,19 @@ OutputEffectInstance::reportStats(int time,
             ofile << "x1 = " << it2->x1 << " y1 = " << it2->y1 << " x2 = " << it2->x2 << " y2 = " << it2->y2 << std::endl;
         }
     }
+
+    if ( !appPTR->isRenderTraceEnabled() || traceEvents.empty() || traceFilename.empty() ) {
+        return;
+    }
+
+    FStreamsSupport::ofstream traceFile;
+    FStreamsSupport::open(&traceFile, traceFilename);
+    if (!traceFile) {
+        std::cout << tr("Failure to write render trace file.").toStdString() << std::endl;
+
+        return;
+    }
+    RenderStats::writeChromeTrace(traceEvents, traceFile);
 } // OutputEffectInstance::reportStats
 
 NATRON_NAMESPACE_EXIT
@@ -57,9 +57,11 @@
 #include "Engine/KnobFile.h"
 #include "Engine/Node.h"
 #include "Engine/OpenGLViewerI.h"
+#include "Engine/PlaybackPrefetcher.h"
 #include "Engine/GenericSchedulerThreadWatcher.h"
 #include "Engine/Project.h"
 #include "Engine/RenderStats.h"
+#include "Engine/RenderTaskGraph.h"
 #include "Engine/RotoContext.h"
 #include "Engine/Settings.h"
 #include "Engine/Timer.h"
@@ -385,7 +387,8 @@ struct OutputSchedulerThreadPrivate
         }
     }
 
-    void appendRunnable(RenderThreadTask* runnable)
+    void appendRunnable(RenderThreadTask* runnable,
+                        RenderPriorityEnum priority)
     {
         assert( !renderThreadsMutex.tryLock() );
         RenderThread r;
@@ -393,9 +396,14 @@ struct OutputSchedulerThreadPrivate
         r.active = true;
         renderThreads.push_back(r);
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
-        runnable->start();
+        // When rendering from the GUI, let the OS favour the threads the user is waiting on
+        if ( (priority == eRenderPriorityBackground) && !appPTR->isBackground() ) {
+            runnable->start(QThread::LowPriority);
+        } else {
+            runnable->start();
+        }
 #else
-        threadPool->start(runnable);
+        threadPool->start( runnable, AbortableRenderInfo::getThreadPoolPriority(priority) );
 #endif
     }
 
@@ -954,7 +962,7 @@ OutputSchedulerThread::startTasks(int startingFrame)
     PlaybackModeEnum pMode = _imp->engine->getPlaybackMode();
     if (firstFrame == lastFrame) {
         RenderThreadTask* task = createRunnable(startingFrame, useStats, viewsToRender);
-        _imp->appendRunnable(task);
+        _imp->appendRunnable( task, getRenderPriority() );
 
         QMutexLocker k(&_imp->framesToRenderMutex);
         _imp->lastFramePushedIndex = startingFrame;
@@ -963,7 +971,7 @@ OutputSchedulerThread::startTasks(int startingFrame)
         RenderDirectionEnum newDirection = direction;
         for (int i = 0; i < nFrames; ++i) {
             RenderThreadTask* task = createRunnable(frame, useStats, viewsToRender);
-            _imp->appendRunnable(task);
+            _imp->appendRunnable( task, getRenderPriority() );
 
 
             {
@@ -1535,7 +1543,7 @@ OutputSchedulerThread::adjustNumberOfThreads(int* newNThreads,
         ///Launch 1 thread
         QMutexLocker l(&_imp->renderThreadsMutex);
 
-        _imp->appendRunnable( createRunnable() );
+        _imp->appendRunnable( createRunnable(), getRenderPriority() );
         *newNThreads = currentParallelRenders +  1;
     } else if ( (runningThreads > optimalNThreads) && (currentParallelRenders > optimalNThreads) ) {
         ////////
@@ -1568,7 +1576,7 @@ OutputSchedulerThread::notifyFrameRendered(int frame,
         double timeSpentForFrame;
         std::map<NodePtr, NodeRenderStats > statResults = stats->getStats(&timeSpentForFrame);
         if ( !statResults.empty() ) {
-            effect->reportStats(frame, viewIndex, timeSpentForFrame, statResults);
+            effect->reportStats( frame, viewIndex, timeSpentForFrame, statResults, stats->getTraceEvents() );
         }
     }
 
@@ -2307,6 +2315,7 @@ private:
 
 
                 AbortableRenderInfoPtr abortInfo = AbortableRenderInfo::create(true, 0);
+                abortInfo->setRenderPriority(eRenderPriorityBackground);
                 if (isAbortableThread) {
                     isAbortableThread->setAbortInfo(isRenderDueToRenderInteraction, abortInfo, activeInputToRender);
                 }
@@ -2333,6 +2342,9 @@ private:
                         return;
                     }
                     frameRenderArgs.updateNodesRequest(request);
+
+                    RenderTaskGraph taskGraph(request, activeInputNode, time, viewsToRender[view], mipMapLevel);
+                    taskGraph.run();
                 }
                 RenderingFlagSetter flagIsRendering( activeInputToRender->getNode() );
                 std::map<ImagePlaneDesc, ImagePtr> planes;
@@ -2433,6 +2445,7 @@ DefaultScheduler::processFrame(const BufferedFrames& frames)
 
     for (BufferedFrames::const_iterator it = frames.begin(); it != frames.end(); ++it) {
         AbortableRenderInfoPtr abortInfo = AbortableRenderInfo::create(true, 0);
+        abortInfo->setRenderPriority(eRenderPriorityBackground);
 
         setAbortInfo(isRenderDueToRenderInteraction, abortInfo, effect);
 
@@ -2687,6 +2700,7 @@ ViewerDisplayScheduler::ViewerDisplayScheduler(RenderEngine* engine,
                                                const ViewerInstancePtr& viewer)
     : OutputSchedulerThread(engine, viewer, eProcessFrameByMainThread) //< OpenGL rendering is done on the main-thread
     , _viewer(viewer)
+    , _prefetcher( new PlaybackPrefetcher(viewer) )
 {
 }
 
@@ -2714,6 +2728,7 @@ ViewerDisplayScheduler::processFrame(const BufferedFrames& frames)
             UpdateViewerParamsPtr params = boost::dynamic_pointer_cast<UpdateViewerParams>(it->frame);
             assert(params);
             viewer->updateViewer(params);
+            _prefetcher->onFrameDisplayed( params->time, params->mipMapLevel, getDesiredFPS() );
         }
         viewer->redrawViewerNow();
     } else {
@@ -2913,9 +2928,23 @@ ViewerDisplayScheduler::handleRenderFailure(const std::string& /*errorMessage*/)
     _viewer.lock()->disconnectViewer();
 }
 
+void
+ViewerDisplayScheduler::aboutToStartRender()
+{
+    RenderDirectionEnum direction;
+    std::vector<ViewIdx> viewsToRender;
+    int firstFrame, lastFrame;
+
+    getLastRunArgs(&direction, &viewsToRender);
+    getFrameRangeToRender(firstFrame, lastFrame);
+    _prefetcher->start( direction, viewsToRender, firstFrame, lastFrame, appPTR->getCurrentSettings()->getPlaybackPrefetchFrames() );
+}
+
 void
 ViewerDisplayScheduler::onRenderStopped(bool /*/aborted*/)
 {
+    _prefetcher->stop();
+
     ///Refresh all previews in the tree
     ViewerInstancePtr viewer = _viewer.lock();
 
@@ -3767,7 +3796,7 @@ ViewerCurrentFrameRequestSchedulerPrivate::processProducedFrame(const RenderStat
             if (stats) {
                 double timeSpent;
                 std::map<NodePtr, NodeRenderStats > ret = stats->getStats(&timeSpent);
-                viewer->reportStats(0, ViewIdx(0), timeSpent, ret);
+                viewer->reportStats( 0, ViewIdx(0), timeSpent, ret, stats->getTraceEvents() );
             }
 
             viewer->updateViewer(params);
@@ -3919,7 +3948,7 @@ ViewerCurrentFrameRequestScheduler::renderCurrentFrame(bool enableRenderStats,
                 if ( stats && (i == 0) ) {
                     double timeSpent;
                     std::map<NodePtr, NodeRenderStats > statResults = stats->getStats(&timeSpent);
-                    _imp->viewer->reportStats(frame, view, timeSpent, statResults);
+                    _imp->viewer->reportStats( frame, view, timeSpent, statResults, stats->getTraceEvents() );
                 }
                 _imp->viewer->updateViewer(args[i]->params);
                 args[i].reset();
@@ -360,6 +360,12 @@ protected:
      **/
     virtual bool isFPSRegulationNeeded() const { return false; }
 
+    /**
+     * @brief The priority of the renders launched by this scheduler on the render scheduler.
+     * Writers render in the background, the viewer overrides it.
+     **/
+    virtual RenderPriorityEnum getRenderPriority() const { return eRenderPriorityBackground; }
+
     /**
      * @brief Must return the frame range to render. For the viewer this is what is indicated on the global timeline,
      * for writers this is its internal timeline.
@@ -527,6 +533,8 @@ private:
     virtual int timelineGetTime() const OVERRIDE FINAL WARN_UNUSED_RETURN;
     virtual bool isFPSRegulationNeeded() const OVERRIDE FINAL WARN_UNUSED_RETURN { return true; }
 
+    virtual RenderPriorityEnum getRenderPriority() const OVERRIDE FINAL WARN_UNUSED_RETURN { return eRenderPriorityPlayback; }
+
     virtual void getFrameRangeToRender(int& first, int& last) const OVERRIDE FINAL;
 
 #ifndef NATRON_PLAYBACK_USES_THREAD_POOL
@@ -539,8 +547,10 @@ private:
     virtual SchedulingPolicyEnum getSchedulingPolicy() const OVERRIDE FINAL { return eSchedulingPolicyOrdered; }
 
     virtual int getLastRenderedTime() const OVERRIDE FINAL WARN_UNUSED_RETURN;
+    virtual void aboutToStartRender() OVERRIDE FINAL;
     virtual void onRenderStopped(bool aborted) OVERRIDE FINAL;
     ViewerInstanceWPtr _viewer;
+    boost::scoped_ptr<PlaybackPrefetcher> _prefetcher;
 };
 
 /**
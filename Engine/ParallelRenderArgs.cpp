@@ -595,6 +595,21 @@ NodeFrameRequest::getFrameViewRequest(double time,
     return 0;
 }
 
+FrameViewRequest*
+NodeFrameRequest::getFrameViewRequest(double time,
+                                      ViewIdx view)
+{
+    for (NodeFrameViewRequestData::iterator it = frames.begin(); it != frames.end(); ++it) {
+        if (it->first.time == time) {
+            if ( (it->first.view == -1) || (it->first.view == view) ) {
+                return &it->second;
+            }
+        }
+    }
+
+    return 0;
+}
+
 bool
 NodeFrameRequest::getFrameViewCanonicalRoI(double time,
                                            ViewIdx view,
@@ -187,6 +187,16 @@ struct FrameViewRequestGlobalData
 struct FrameViewRequestFinalData
 {
     RectD finalRoi;
+
+    ///If true, this frame/view is pre-rendered by a RenderTaskGraph task and must be cached
+    ///so that its outputs find it
+    bool isPreRendered;
+
+    FrameViewRequestFinalData()
+        : finalRoi()
+        , isPreRendered(false)
+    {
+    }
 };
 
 struct FrameViewPerRequestData
@@ -241,6 +251,8 @@ public:
     bool getFrameViewCanonicalRoI(double time, ViewIdx view, RectD* roi) const;
 
     const FrameViewRequest* getFrameViewRequest(double time, ViewIdx view) const;
+
+    FrameViewRequest* getFrameViewRequest(double time, ViewIdx view);
 };
 
 typedef std::map<NodePtr, NodeFrameRequestPtr> FrameRequestMap;
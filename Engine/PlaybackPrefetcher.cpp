@@ -0,0 +1,473 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "PlaybackPrefetcher.h"
+
+#include <cmath> // ceil
+#include <list>
+#include <set>
+#include <stdexcept>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
+#include <boost/make_shared.hpp>
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+#endif
+
+#include <QtCore/QDebug>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
+#include <QtCore/QWaitCondition>
+
+#include "Engine/AbortableRenderInfo.h"
+#include "Engine/AppInstance.h"
+#include "Engine/AppManager.h"
+#include "Engine/EffectInstance.h"
+#include "Engine/Image.h"
+#include "Engine/Node.h"
+#include "Engine/ParallelRenderArgs.h"
+#include "Engine/ThreadPool.h"
+#include "Engine/TimeLine.h"
+#include "Engine/Timer.h"
+#include "Engine/ViewerInstance.h"
+
+NATRON_NAMESPACE_ENTER
+
+class PlaybackPrefetchThread
+    : public QThread
+      , public AbortableThread
+{
+public:
+
+    PlaybackPrefetchThread(PlaybackPrefetcherPrivate* imp)
+        : QThread()
+        , AbortableThread(this)
+        , _imp(imp)
+    {
+        setObjectName( QString::fromUtf8("PlaybackPrefetch") );
+        setThreadName("PlaybackPrefetch");
+    }
+
+    virtual ~PlaybackPrefetchThread()
+    {
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL;
+
+    PlaybackPrefetcherPrivate* _imp;
+};
+
+typedef boost::shared_ptr<PlaybackPrefetchThread> PlaybackPrefetchThreadPtr;
+
+struct PlaybackPrefetcherPrivate
+{
+    ViewerInstanceWPtr viewer;
+    std::vector<PlaybackPrefetchThreadPtr> threads;
+
+    // Protects all the fields below
+    QMutex lock;
+    QWaitCondition cond;
+    bool mustQuit;
+    NodesWList nodes;
+    RenderDirectionEnum direction;
+    std::vector<ViewIdx> viewsToRender;
+    int firstFrame, lastFrame;
+    int nFramesAhead;
+
+    // The last frame displayed by the playback, playhead is meaningless until hasPlayhead is true
+    bool hasPlayhead;
+    int playhead;
+    unsigned int mipMapLevel;
+    double fps;
+
+    // Average time it takes to prefetch a frame
+    double frameSeconds;
+
+    // Frames picked by a thread since the start of the playback
+    std::set<int> pickedFrames;
+
+    // Prefetches in progress, aborted by stop()
+    std::list<AbortableRenderInfoPtr> abortInfos;
+
+    PlaybackPrefetcherPrivate(const ViewerInstancePtr& viewer)
+        : viewer(viewer)
+        , threads()
+        , lock()
+        , cond()
+        , mustQuit(false)
+        , nodes()
+        , direction(eRenderDirectionForward)
+        , viewsToRender()
+        , firstFrame(0)
+        , lastFrame(0)
+        , nFramesAhead(0)
+        , hasPlayhead(false)
+        , playhead(0)
+        , mipMapLevel(0)
+        , fps(24.)
+        , frameSeconds(0.)
+        , pickedFrames()
+        , abortInfos()
+    {
+    }
+
+    void collectNodes(const NodePtr& node, std::set<Node*>* visitedNodes);
+
+    /**
+     * @brief Returns true if the frame is still ahead of the playhead. Must be called with lock held.
+     **/
+    bool isFrameAhead(int time) const
+    {
+        return direction == eRenderDirectionForward ? time > playhead : time < playhead;
+    }
+
+    /**
+     * @brief Picks the next frame to prefetch. Must be called with lock held.
+     **/
+    bool pickFrame(int* time);
+
+    /**
+     * @brief Waits until the playback leaves some cores unused. Must be called with lock held.
+     * Returns false if the threads must quit.
+     **/
+    bool waitForIdleCores();
+
+    void prefetchFrame(PlaybackPrefetchThread* thread, const NodePtr& node, int time, ViewIdx view, unsigned int mipMapLevel);
+};
+
+void
+PlaybackPrefetcherPrivate::collectNodes(const NodePtr& node,
+                                        std::set<Node*>* visitedNodes)
+{
+    if ( !node || !visitedNodes->insert( node.get() ).second ) {
+        return;
+    }
+    EffectInstancePtr effect = node->getEffectInstance();
+    if ( !effect ) {
+        return;
+    }
+    // The nodes whose output is worth caching ahead: Readers decode files, the caching of other nodes is forced by the user
+    if ( effect->isReader() || node->isForceCachingEnabled() ) {
+        nodes.push_back(node);
+    }
+
+    int nInputs = node->getNInputs();
+    for (int i = 0; i < nInputs; ++i) {
+        collectNodes(node->getInput(i), visitedNodes);
+    }
+}
+
+bool
+PlaybackPrefetcherPrivate::pickFrame(int* time)
+{
+    if ( !hasPlayhead || nodes.empty() ) {
+        return false;
+    }
+
+    // The playback renders the frames it reaches before they could be prefetched
+    int firstOffset = std::max( 1, (int)std::ceil(fps * frameSeconds) );
+    int step = (direction == eRenderDirectionForward) ? 1 : -1;
+    for (int offset = firstOffset; offset <= nFramesAhead; ++offset) {
+        int t = playhead + offset * step;
+        if ( (t < firstFrame) || (t > lastFrame) ) {
+            break;
+        }
+        if ( pickedFrames.insert(t).second ) {
+            *time = t;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool
+PlaybackPrefetcherPrivate::waitForIdleCores()
+{
+    for (;;) {
+        if (mustQuit) {
+            return false;
+        }
+        int runningThreads = appPTR->getNRunningThreads() + QThreadPool::globalInstance()->activeThreadCount();
+        if ( runningThreads < appPTR->getHardwareIdealThreadCount() ) {
+            return true;
+        }
+        cond.wait(&lock, NATRON_PLAYBACK_PREFETCH_PAUSE_MS);
+    }
+}
+
+void
+PlaybackPrefetcherPrivate::prefetchFrame(PlaybackPrefetchThread* thread,
+                                         const NodePtr& node,
+                                         int time,
+                                         ViewIdx view,
+                                         unsigned int mipMapLevel)
+{
+    EffectInstancePtr effect = node->getEffectInstance();
+
+    if (!effect) {
+        return;
+    }
+
+    AbortableRenderInfoPtr abortInfo = AbortableRenderInfo::create(true, 0);
+    abortInfo->setRenderPriority(eRenderPriorityPrefetch);
+    {
+        QMutexLocker k(&lock);
+        if (mustQuit) {
+            return;
+        }
+        abortInfos.push_back(abortInfo);
+    }
+
+    const bool isRenderUserInteraction = false;
+    const bool isSequentialRender = true;
+    thread->setAbortInfo(isRenderUserInteraction, abortInfo, effect);
+
+    {
+        // The node is the root of an analysis render so that its output is cached, see shouldCacheOutput()
+        ParallelRenderArgsSetter frameRenderArgs( time,
+                                                  view,
+                                                  isRenderUserInteraction,
+                                                  isSequentialRender,
+                                                  abortInfo,
+                                                  node, // tree root
+                                                  0, // texture index
+                                                  node->getApp()->getTimeLine().get(),
+                                                  NodePtr(), // rotoPaint node
+                                                  true, // isAnalysis
+                                                  node->getApp()->isDraftRenderEnabled(), // draftMode, as the viewer renders
+                                                  RenderStatsPtr() );
+        RenderScale scale( Image::getScaleFromMipMapLevel(mipMapLevel) );
+        RectD rod;
+        bool isProjectFormat;
+        StatusEnum stat = effect->getRegionOfDefinition_public(effect->getHash(), time, scale, view, &rod, &isProjectFormat);
+        if ( (stat != eStatusFailed) && !rod.isNull() ) {
+            FrameRequestMap request;
+            stat = EffectInstance::computeRequestPass(time, view, mipMapLevel, rod, node, request);
+            if (stat != eStatusFailed) {
+                frameRenderArgs.updateNodesRequest(request);
+
+                std::list<ImagePlaneDesc> requestedComps;
+                {
+                    ImagePlaneDesc plane, pairedPlane;
+                    effect->getMetadataComponents(-1, &plane, &pairedPlane);
+                    requestedComps.push_back(plane);
+                }
+                RectI renderWindow;
+                rod.toPixelEnclosing( mipMapLevel, effect->getAspectRatio(-1), &renderWindow );
+
+                RenderingFlagSetter flagIsRendering(node);
+                std::map<ImagePlaneDesc, ImagePtr> planes;
+                // A failed prefetch is not an error: the playback renders the frame and reports the error
+                try {
+                    boost::scoped_ptr<EffectInstance::RenderRoIArgs> renderArgs( new EffectInstance::RenderRoIArgs(time,
+                                                                                                                   scale,
+                                                                                                                   mipMapLevel,
+                                                                                                                   view,
+                                                                                                                   false, // byPassCache
+                                                                                                                   renderWindow,
+                                                                                                                   rod,
+                                                                                                                   requestedComps,
+                                                                                                                   effect->getBitDepth(-1),
+                                                                                                                   false,
+                                                                                                                   effect.get(),
+                                                                                                                   eStorageModeRAM /*returnStorage*/,
+                                                                                                                   time /*callerRenderTime*/) );
+                    ignore_result( effect->renderRoI(*renderArgs, &planes) );
+                } catch (const std::exception& e) {
+                    qDebug() << "Playback prefetch of" << node->getScriptName_mt_safe().c_str() << "failed:" << e.what();
+                } catch (...) {
+                    qDebug() << "Playback prefetch of" << node->getScriptName_mt_safe().c_str() << "failed";
+                }
+            }
+        }
+    } // ParallelRenderArgsSetter
+
+    thread->clearAbortInfo();
+    {
+        QMutexLocker k(&lock);
+        abortInfos.remove(abortInfo);
+    }
+} // PlaybackPrefetcherPrivate::prefetchFrame
+
+void
+PlaybackPrefetchThread::run()
+{
+    for (;;) {
+        int time;
+        unsigned int mipMapLevel;
+        std::vector<ViewIdx> viewsToRender;
+        NodesList nodes;
+        {
+            QMutexLocker k(&_imp->lock);
+            bool picked = false;
+            while ( !picked && _imp->waitForIdleCores() ) {
+                picked = _imp->pickFrame(&time);
+                if (!picked) {
+                    // Woken up when a frame is displayed
+                    _imp->cond.wait(&_imp->lock, NATRON_PLAYBACK_PREFETCH_PAUSE_MS);
+                }
+            }
+            if (!picked) {
+                break;
+            }
+            mipMapLevel = _imp->mipMapLevel;
+            viewsToRender = _imp->viewsToRender;
+            for (NodesWList::const_iterator it = _imp->nodes.begin(); it != _imp->nodes.end(); ++it) {
+                NodePtr node = it->lock();
+                if (node) {
+                    nodes.push_back(node);
+                }
+            }
+        }
+
+        TimeLapse timer;
+        bool frameAbandoned = false;
+        for (NodesList::const_iterator it = nodes.begin(); it != nodes.end() && !frameAbandoned; ++it) {
+            for (std::vector<ViewIdx>::const_iterator it2 = viewsToRender.begin(); it2 != viewsToRender.end(); ++it2) {
+                {
+                    // The playback may need the cores or may have reached the frame while this thread was paused
+                    QMutexLocker k(&_imp->lock);
+                    if ( !_imp->waitForIdleCores() || !_imp->isFrameAhead(time) ) {
+                        frameAbandoned = true;
+                        break;
+                    }
+                }
+                _imp->prefetchFrame(this, *it, time, *it2, mipMapLevel);
+            }
+        }
+
+        if (!frameAbandoned) {
+            QMutexLocker k(&_imp->lock);
+            double seconds = timer.getTimeSinceCreation();
+            _imp->frameSeconds = (_imp->frameSeconds == 0.) ? seconds : (_imp->frameSeconds * 3. + seconds) / 4.;
+        }
+    }
+
+    ///Exit of the thread
+    appPTR->getAppTLS()->cleanupTLSForThread();
+} // PlaybackPrefetchThread::run
+
+PlaybackPrefetcher::PlaybackPrefetcher(const ViewerInstancePtr& viewer)
+    : _imp( new PlaybackPrefetcherPrivate(viewer) )
+{
+}
+
+PlaybackPrefetcher::~PlaybackPrefetcher()
+{
+    stop();
+}
+
+void
+PlaybackPrefetcher::start(RenderDirectionEnum direction,
+                          const std::vector<ViewIdx>& viewsToRender,
+                          int firstFrame,
+                          int lastFrame,
+                          int nFramesAhead)
+{
+    stop();
+
+    ViewerInstancePtr viewer = _imp->viewer.lock();
+    if ( !viewer || (nFramesAhead <= 0) ) {
+        return;
+    }
+
+    {
+        QMutexLocker k(&_imp->lock);
+        _imp->mustQuit = false;
+        _imp->nodes.clear();
+        std::set<Node*> visitedNodes;
+        int activeInputs[2];
+        viewer->getActiveInputs(activeInputs[0], activeInputs[1]);
+        for (int i = 0; i < 2; ++i) {
+            if (activeInputs[i] != -1) {
+                _imp->collectNodes(viewer->getNode()->getInput(activeInputs[i]), &visitedNodes);
+            }
+        }
+        if ( _imp->nodes.empty() ) {
+            return;
+        }
+        _imp->direction = direction;
+        _imp->viewsToRender = viewsToRender;
+        _imp->firstFrame = firstFrame;
+        _imp->lastFrame = lastFrame;
+        _imp->nFramesAhead = nFramesAhead;
+        _imp->hasPlayhead = false;
+        _imp->frameSeconds = 0.;
+        _imp->pickedFrames.clear();
+    }
+
+    int nThreads = std::max( 1, std::min(NATRON_PLAYBACK_PREFETCH_MAX_THREADS, appPTR->getHardwareIdealThreadCount() / 4) );
+    for (int i = 0; i < nThreads; ++i) {
+        PlaybackPrefetchThreadPtr thread = boost::make_shared<PlaybackPrefetchThread>( _imp.get() );
+        thread->start(QThread::LowPriority);
+        _imp->threads.push_back(thread);
+    }
+}
+
+void
+PlaybackPrefetcher::stop()
+{
+    if ( _imp->threads.empty() ) {
+        return;
+    }
+    {
+        QMutexLocker k(&_imp->lock);
+        _imp->mustQuit = true;
+        for (std::list<AbortableRenderInfoPtr>::const_iterator it = _imp->abortInfos.begin(); it != _imp->abortInfos.end(); ++it) {
+            (*it)->setAborted();
+        }
+        _imp->cond.wakeAll();
+    }
+    for (std::vector<PlaybackPrefetchThreadPtr>::const_iterator it = _imp->threads.begin(); it != _imp->threads.end(); ++it) {
+        (*it)->wait();
+    }
+    _imp->threads.clear();
+}
+
+void
+PlaybackPrefetcher::onFrameDisplayed(int time,
+                                     unsigned int mipMapLevel,
+                                     double fps)
+{
+    QMutexLocker k(&_imp->lock);
+
+    // Frames prefetched at another mipmap level would not be used by the playback
+    if ( _imp->hasPlayhead && (mipMapLevel != _imp->mipMapLevel) ) {
+        _imp->pickedFrames.clear();
+    }
+    _imp->hasPlayhead = true;
+    _imp->playhead = time;
+    _imp->mipMapLevel = mipMapLevel;
+    _imp->fps = fps;
+    _imp->cond.wakeAll();
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,95 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_PLAYBACKPREFETCHER_H
+#define NATRON_ENGINE_PLAYBACKPREFETCHER_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Engine/OutputSchedulerThread.h" // RenderDirectionEnum
+#include "Engine/ViewIdx.h"
+#include "Engine/EngineFwd.h"
+
+///Maximum number of threads prefetching frames for one viewer
+#define NATRON_PLAYBACK_PREFETCH_MAX_THREADS 2
+
+///Interval at which paused prefetch threads check again whether the playback leaves cores unused
+#define NATRON_PLAYBACK_PREFETCH_PAUSE_MS 20
+
+NATRON_NAMESPACE_ENTER
+
+struct PlaybackPrefetcherPrivate;
+
+/**
+ * @brief Renders ahead of the playback of a viewer the output of the Readers and of the nodes whose caching is
+ * forced upstream of the viewer, so that the playback finds them in the node cache instead of stalling on them,
+ * e.g: on the first playback of a heavy comp.
+ * The frames are prefetched in the direction of the playback, skipping the frames the playback is about to reach
+ * at its frame rate before their prefetch could be done, at the mipmap level of the last frame displayed.
+ * Prefetching runs on low priority threads and pauses as soon as the playback needs all the cores, see
+ * Settings::getPlaybackPrefetchFrames().
+ **/
+class PlaybackPrefetcher
+{
+public:
+
+    PlaybackPrefetcher(const ViewerInstancePtr& viewer);
+
+    ~PlaybackPrefetcher();
+
+    /**
+     * @brief Starts prefetching up to nFramesAhead frames ahead of the playback. The nodes to prefetch are those
+     * upstream of the viewer when this is called. Prefetching only starts once the first frame is displayed.
+     **/
+    void start(RenderDirectionEnum direction,
+               const std::vector<ViewIdx>& viewsToRender,
+               int firstFrame,
+               int lastFrame,
+               int nFramesAhead);
+
+    /**
+     * @brief Aborts the ongoing prefetches and waits for the threads to return.
+     **/
+    void stop();
+
+    /**
+     * @brief Must be called whenever the playback displays a frame.
+     **/
+    void onFrameDisplayed(int time, unsigned int mipMapLevel, double fps);
+
+private:
+
+    boost::scoped_ptr<PlaybackPrefetcherPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_PLAYBACKPREFETCHER_H
@@ -190,6 +190,16 @@ public:
         return appPTR->getHardwareIdealThreadCount();
     }
 
+    inline QMap<QString, QVariant> getCacheStatistics() const
+    {
+        return appPTR->getCachesStatistics();
+    }
+
+    inline void resetCacheStatistics()
+    {
+        appPTR->resetCachesStatistics();
+    }
+
     inline App* getInstance(int idx) const
     {
         AppInstancePtr app = appPTR->getAppInstance(idx);
@@ -27,9 +27,16 @@
 
 #include <bitset>
 #include <cassert>
+#include <iomanip>
 #include <stdexcept>
+#include <time.h>
+
+#ifdef __NATRON_OSX__
+#include <mach/mach_time.h>
+#endif
 
 #include <QtCore/QMutex>
+#include <QtCore/QThread>
 
 #include "Engine/Node.h"
 #include "Engine/Timer.h"
@@ -38,6 +45,19 @@
 
 NATRON_NAMESPACE_ENTER
 
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// The renders profiled in depth, which also trace the work done for all renders, see addTraceEventToProfiledRenders()
+struct ProfiledRenders
+{
+    QMutex lock;
+    std::list<RenderStats*> stats;
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+static ProfiledRenders profiledRenders;
+
 struct NodeRenderStatsPrivate
 {
     //The accumulated time spent in the EffectInstance::renderHandler function
@@ -315,12 +335,16 @@ struct RenderStatsPrivate
     typedef std::map<NodeWPtr, NodeRenderStats > NodeInfosMap;
     NodeInfosMap nodeInfos;
 
+    //The spans of work recorded on each thread, only with in-depth profiling
+    RenderTraceEventList traceEvents;
+
 
     RenderStatsPrivate()
         : lock()
         , totalTimeSpentForFrameTimer()
         , doNodesProfiling(false)
         , nodeInfos()
+        , traceEvents()
     {
     }
 
@@ -356,10 +380,18 @@ RenderStats::RenderStats(bool enableInDepthProfiling)
     : _imp( new RenderStatsPrivate() )
 {
     _imp->doNodesProfiling = enableInDepthProfiling;
+    if (enableInDepthProfiling) {
+        QMutexLocker k(&profiledRenders.lock);
+        profiledRenders.stats.push_back(this);
+    }
 }
 
 RenderStats::~RenderStats()
 {
+    if (_imp->doNodesProfiling) {
+        QMutexLocker k(&profiledRenders.lock);
+        profiledRenders.stats.remove(this);
+    }
 }
 
 bool
@@ -454,4 +486,200 @@ RenderStats::getStats(double *totalTimeSpent) const
     return ret;
 }
 
+void
+RenderStats::addTraceEvent(const NodePtr& node,
+                           RenderTraceEventTypeEnum type,
+                           double startTime,
+                           double duration)
+{
+    RenderTraceEvent e;
+
+    e.type = type;
+    e.nodeName = node ? node->getScriptName_mt_safe() : std::string();
+    e.threadId = (U64)reinterpret_cast<quintptr>( QThread::currentThreadId() );
+    e.startTime = startTime;
+    e.duration = duration;
+
+    QMutexLocker k(&_imp->lock);
+
+    assert(_imp->doNodesProfiling);
+
+    _imp->traceEvents.push_back(e);
+}
+
+RenderTraceEventList
+RenderStats::getTraceEvents() const
+{
+    QMutexLocker k(&_imp->lock);
+
+    return _imp->traceEvents;
+}
+
+void
+RenderStats::addTraceEventToProfiledRenders(RenderTraceEventTypeEnum type,
+                                            double startTime,
+                                            double duration)
+{
+    QMutexLocker k(&profiledRenders.lock);
+
+    for (std::list<RenderStats*>::iterator it = profiledRenders.stats.begin(); it != profiledRenders.stats.end(); ++it) {
+        (*it)->addTraceEvent(NodePtr(), type, startTime, duration);
+    }
+}
+
+bool
+RenderStats::hasProfiledRenders()
+{
+    QMutexLocker k(&profiledRenders.lock);
+
+    return !profiledRenders.stats.empty();
+}
+
+double
+RenderStats::getCurrentTraceTime()
+{
+#if defined(__NATRON_WIN32__)
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#elif defined(__NATRON_OSX__)
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+
+    return mach_absolute_time() * 1e-9 * timebase.numer / timebase.denom;
+#else
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+static const char*
+getTraceEventTypeLabel(RenderTraceEventTypeEnum type)
+{
+    switch (type) {
+    case eRenderTraceEventTypeRenderRoI:
+        return "renderRoI";
+    case eRenderTraceEventTypeRenderAction:
+        return "render";
+    case eRenderTraceEventTypeGetRegionOfDefinition:
+        return "getRegionOfDefinition";
+    case eRenderTraceEventTypeCacheLookup:
+        return "cacheLookup";
+    case eRenderTraceEventTypeImageConversion:
+        return "imageConversion";
+    case eRenderTraceEventTypeDiskCacheIO:
+        return "diskCacheIO";
+    case eRenderTraceEventTypeDiskCacheWrite:
+        return "diskCacheWrite";
+    }
+
+    return "";
+}
+
+static void
+writeJSONString(const std::string& str,
+                std::ostream& stream)
+{
+    stream << '"';
+    for (std::size_t i = 0; i < str.size(); ++i) {
+        unsigned char c = (unsigned char)str[i];
+        if ( (c == '"') || (c == '\\') ) {
+            stream << '\\' << (char)c;
+        } else if (c < 0x20) {
+            stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+        } else {
+            stream << (char)c;
+        }
+    }
+    stream << '"';
+}
+
+void
+RenderStats::writeChromeTrace(const RenderTraceEventList& events,
+                              std::ostream& stream)
+{
+    // Timestamps are written in microseconds from the first event
+    double origin = 0.;
+
+    for (RenderTraceEventList::const_iterator it = events.begin(); it != events.end(); ++it) {
+        if ( (it == events.begin()) || (it->startTime < origin) ) {
+            origin = it->startTime;
+        }
+    }
+
+    stream << std::fixed << std::setprecision(3);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    // Threads are numbered in the order they first appear
+    std::map<U64, int> threadIndices;
+    bool first = true;
+    for (RenderTraceEventList::const_iterator it = events.begin(); it != events.end(); ++it) {
+        if ( threadIndices.find(it->threadId) != threadIndices.end() ) {
+            continue;
+        }
+        int index = (int)threadIndices.size() + 1;
+        threadIndices[it->threadId] = index;
+        stream << (first ? "\n" : ",\n");
+        first = false;
+        // The threads writing the cache to disk only record their writes
+        stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << index
+               << ",\"args\":{\"name\":\"" << (it->type == eRenderTraceEventTypeDiskCacheWrite ? "Cache writer thread " : "Render thread ") << index << "\"}}";
+    }
+
+    for (RenderTraceEventList::const_iterator it = events.begin(); it != events.end(); ++it) {
+        const char* label = getTraceEventTypeLabel(it->type);
+        stream << (first ? "\n" : ",\n");
+        first = false;
+        stream << "{\"name\":";
+        writeJSONString(it->nodeName.empty() ? std::string(label) : it->nodeName + ' ' + label, stream);
+        stream << ",\"cat\":\"" << label << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << threadIndices[it->threadId]
+               << ",\"ts\":" << (it->startTime - origin) * 1e6 << ",\"dur\":" << it->duration * 1e6
+               << ",\"args\":{\"node\":";
+        writeJSONString(it->nodeName, stream);
+        stream << "}}";
+    }
+    stream << "\n]}\n";
+} // RenderStats::writeChromeTrace
+
+RenderTraceSpan::RenderTraceSpan(const RenderStatsPtr& stats,
+                                 const NodePtr& node,
+                                 RenderTraceEventTypeEnum type)
+    : _stats()
+    , _node()
+    , _type(type)
+    , _allProfiledRenders(false)
+    , _startTime(0.)
+{
+    if ( stats && stats->isInDepthProfilingEnabled() ) {
+        _stats = stats;
+        _node = node;
+        _startTime = RenderStats::getCurrentTraceTime();
+    }
+}
+
+RenderTraceSpan::RenderTraceSpan(RenderTraceEventTypeEnum type)
+    : _stats()
+    , _node()
+    , _type(type)
+    , _allProfiledRenders( RenderStats::hasProfiledRenders() )
+    , _startTime(0.)
+{
+    if (_allProfiledRenders) {
+        _startTime = RenderStats::getCurrentTraceTime();
+    }
+}
+
+RenderTraceSpan::~RenderTraceSpan()
+{
+    if (_stats) {
+        _stats->addTraceEvent(_node, _type, _startTime, RenderStats::getCurrentTraceTime() - _startTime);
+    } else if (_allProfiledRenders) {
+        RenderStats::addTraceEventToProfiledRenders(_type, _startTime, RenderStats::getCurrentTraceTime() - _startTime);
+    }
+}
+
 NATRON_NAMESPACE_EXIT
@@ -33,6 +33,7 @@
 #include <set>
 #include <string>
 #include <bitset>
+#include <ostream>
 
 #if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
 #include <boost/shared_ptr.hpp>
@@ -48,6 +49,34 @@
 
 NATRON_NAMESPACE_ENTER
 
+/**
+ * @brief The kind of work recorded by a RenderTraceEvent
+ **/
+enum RenderTraceEventTypeEnum
+{
+    eRenderTraceEventTypeRenderRoI = 0, //< a call to EffectInstance::renderRoI, including the render of its inputs
+    eRenderTraceEventTypeRenderAction, //< the render action of the plug-in on a tile
+    eRenderTraceEventTypeGetRegionOfDefinition, //< the getRegionOfDefinition action of the plug-in
+    eRenderTraceEventTypeCacheLookup, //< a lookup of an image in the cache
+    eRenderTraceEventTypeImageConversion, //< a conversion of an image to another mipmap level, bit depth or components
+    eRenderTraceEventTypeDiskCacheIO, //< reading an image from the disk cache
+    eRenderTraceEventTypeDiskCacheWrite, //< writing a cache entry to disk, see RenderTraceSpan(RenderTraceEventTypeEnum)
+};
+
+/**
+ * @brief A span of work done for a node on one thread during a render. Times are in seconds, see RenderStats::getCurrentTraceTime()
+ **/
+struct RenderTraceEvent
+{
+    RenderTraceEventTypeEnum type;
+    std::string nodeName;
+    U64 threadId;
+    double startTime;
+    double duration;
+};
+
+typedef std::list<RenderTraceEvent> RenderTraceEventList;
+
 /**
  * @brief Holds render infos for one frame for one node. Not MT-safe: MT-safety is handled by RenderStats.
  **/
@@ -145,11 +174,71 @@ public:
 
     std::map<NodePtr, NodeRenderStats > getStats(double *totalTimeSpent) const;
 
+    /**
+     * @brief Records a span of work done for the node on the calling thread, see RenderTraceSpan.
+     **/
+    void addTraceEvent(const NodePtr& node,
+                       RenderTraceEventTypeEnum type,
+                       double startTime,
+                       double duration);
+
+    RenderTraceEventList getTraceEvents() const;
+
+    /**
+     * @brief Records a span of work done on the calling thread for all renders, e.g. by the threads writing the cache
+     * to disk, in the trace of each render being profiled in depth.
+     **/
+    static void addTraceEventToProfiledRenders(RenderTraceEventTypeEnum type,
+                                               double startTime,
+                                               double duration);
+
+    static bool hasProfiledRenders();
+
+    /**
+     * @brief The clock used to timestamp trace events, in seconds. It is the same for all threads and all frames, and
+     * monotonic: the spans are not shifted when the system time is adjusted during a render.
+     **/
+    static double getCurrentTraceTime();
+
+    /**
+     * @brief Writes the events in the Chrome trace event format, which can be opened in chrome://tracing or Perfetto
+     * to see the timeline of each render thread.
+     **/
+    static void writeChromeTrace(const RenderTraceEventList& events, std::ostream& stream);
+
 private:
 
     boost::scoped_ptr<RenderStatsPrivate> _imp;
 };
 
+/**
+ * @brief Records a trace event spanning the lifetime of this object, if in-depth profiling is enabled for the given stats.
+ **/
+class RenderTraceSpan
+{
+public:
+
+    RenderTraceSpan(const RenderStatsPtr& stats,
+                    const NodePtr& node,
+                    RenderTraceEventTypeEnum type);
+
+    /**
+     * @brief Records the span in the trace of all the renders being profiled in depth, for work that is not done for a
+     * render in particular, see RenderStats::addTraceEventToProfiledRenders()
+     **/
+    explicit RenderTraceSpan(RenderTraceEventTypeEnum type);
+
+    ~RenderTraceSpan();
+
+private:
+
+    RenderStatsPtr _stats;
+    NodePtr _node;
+    RenderTraceEventTypeEnum _type;
+    bool _allProfiledRenders;
+    double _startTime;
+};
+
 NATRON_NAMESPACE_EXIT
 
 
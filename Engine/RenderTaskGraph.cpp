@@ -0,0 +1,610 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+#include "RenderTaskGraph.h"
+#include "RenderTaskGraphPrivate.h"
+
+#include <algorithm> // std::find, std::max
+#include <bitset>
+#include <cassert>
+#include <exception>
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#endif
+
+#include <QtCore/QDebug>
+#include <QtCore/QThread>
+
+#include "Engine/AbortableRenderInfo.h"
+#include "Engine/AppManager.h"
+#include "Engine/EffectInstance.h"
+#include "Engine/Image.h"
+#include "Engine/ImagePlaneDesc.h"
+#include "Engine/Node.h"
+#include "Engine/Settings.h"
+#include "Engine/ThreadPool.h"
+#include "Engine/TLSHolder.h"
+#include "Engine/WorkStealingScheduler.h"
+
+NATRON_NAMESPACE_ENTER
+
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+typedef RenderTaskGraphNode GraphNode;
+
+typedef boost::shared_ptr<GraphNode> GraphNodePtr;
+
+struct GraphNodeKey
+{
+    NodePtr node;
+    double time;
+    ViewIdx view;
+    unsigned int mipMapLevel;
+
+    bool operator<(const GraphNodeKey& other) const
+    {
+        if (node != other.node) {
+            return node < other.node;
+        }
+        if (time != other.time) {
+            return time < other.time;
+        }
+        if (view != other.view) {
+            return view < other.view;
+        }
+
+        return mipMapLevel < other.mipMapLevel;
+    }
+};
+
+typedef std::map<GraphNodeKey, GraphNodePtr> GraphNodesMap;
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+
+struct RenderTaskGraphPrivate
+{
+    const FrameRequestMap& request;
+    bool useTransforms;
+    GraphNodesMap nodes;
+
+    // All nodes of the graph, inputs before their outputs
+    std::vector<GraphNode*> sortedNodes;
+
+    // The tasks that do not depend on any other task, the others are started by the last of their dependencies
+    std::vector<GraphNode*> firstTasks;
+    std::size_t nTasks;
+
+    // Thread-local storage of the planning thread, copied by the threads running tasks
+    QThread* planningThread;
+    const TLSSnapshot* tlsSnapshot;
+
+    RenderTaskGraphPrivate(const FrameRequestMap& request)
+        : request(request)
+        , useTransforms( appPTR->getCurrentSettings()->isTransformConcatenationEnabled() )
+        , nodes()
+        , sortedNodes()
+        , firstTasks()
+        , nTasks(0)
+        , planningThread( QThread::currentThread() )
+        , tlsSnapshot(0)
+    {
+    }
+
+    FrameViewRequest* getFrameViewRequest(const NodePtr& node, double time, ViewIdx view) const;
+
+    bool resolveIdentity(NodePtr* node, double* time, ViewIdx* view) const;
+
+    GraphNode* getOrCreateNode(const NodePtr& node, double time, ViewIdx view, unsigned int mipMapLevel, bool* created);
+
+    void addInputs(GraphNode* graphNode);
+
+    bool canPreRender(const GraphNode* graphNode) const;
+
+    void plan();
+
+    static void runTask(RenderTaskGraphPrivate* imp, GraphNode* task);
+
+    void renderTask(GraphNode* task);
+};
+
+FrameViewRequest*
+RenderTaskGraphPrivate::getFrameViewRequest(const NodePtr& node,
+                                            double time,
+                                            ViewIdx view) const
+{
+    FrameRequestMap::const_iterator found = request.find(node);
+
+    if ( ( found == request.end() ) || !found->second ) {
+        return 0;
+    }
+
+    return found->second->getFrameViewRequest(time, view);
+}
+
+/*
+ * Follows identities the way renderRoI does, so that the graph holds the frame that will actually be rendered.
+ * Returns false if nothing is rendered for this frame.
+ */
+bool
+RenderTaskGraphPrivate::resolveIdentity(NodePtr* node,
+                                        double* time,
+                                        ViewIdx* view) const
+{
+    // Guard against identities pointing at each other
+    for (int i = 0; i < 100; ++i) {
+        FrameViewRequest* fv = getFrameViewRequest(*node, *time, *view);
+        if ( !fv || fv->finalData.finalRoi.isNull() ) {
+            return false;
+        }
+        int identityInputNb = fv->globalData.identityInputNb;
+        if (identityInputNb == -1) {
+            return true;
+        } else if (identityInputNb == -2) {
+            if ( (*view != 0) && ( (*node)->getEffectInstance()->isViewInvariant() == eViewInvarianceAllViewsInvariant ) ) {
+                *view = ViewIdx(0);
+            } else if (fv->globalData.inputIdentityTime == *time) {
+                return false;
+            }
+            *time = fv->globalData.inputIdentityTime;
+        } else {
+            EffectInstancePtr input = (*node)->getEffectInstance()->getInput(identityInputNb);
+            if (!input) {
+                return false;
+            }
+            *node = input->getNode();
+            *time = fv->globalData.inputIdentityTime;
+            *view = fv->globalData.identityView;
+        }
+    }
+
+    return false;
+}
+
+GraphNode*
+RenderTaskGraphPrivate::getOrCreateNode(const NodePtr& node,
+                                        double time,
+                                        ViewIdx view,
+                                        unsigned int mipMapLevel,
+                                        bool* created)
+{
+    GraphNodeKey key;
+
+    key.node = node;
+    key.time = time;
+    key.view = view;
+    key.mipMapLevel = mipMapLevel;
+    GraphNodesMap::iterator found = nodes.find(key);
+    if ( found != nodes.end() ) {
+        *created = false;
+
+        return found->second.get();
+    }
+    GraphNodePtr graphNode = boost::make_shared<GraphNode>();
+    graphNode->node = node;
+    graphNode->time = time;
+    graphNode->view = view;
+    graphNode->mipMapLevel = mipMapLevel;
+    graphNode->request = getFrameViewRequest(node, time, view);
+    nodes.insert( std::make_pair(key, graphNode) );
+    *created = true;
+
+    return graphNode.get();
+}
+
+/*
+ * Adds the frames needed in input by graphNode, with the same rules as EffectInstance::treeRecurseFunctor
+ * when it renders the inputs, then recurses on the new ones. graphNode is appended to sortedNodes once all its
+ * inputs were.
+ */
+void
+RenderTaskGraphPrivate::addInputs(GraphNode* graphNode)
+{
+    const FrameViewRequest* fv = graphNode->request;
+
+    if (!fv) {
+        sortedNodes.push_back(graphNode);
+
+        return;
+    }
+
+    const NodePtr& node = graphNode->node;
+    EffectInstancePtr effect = node->getEffectInstance();
+    FrameRequestMap::const_iterator foundNodeRequest = request.find(node);
+    assert( foundNodeRequest != request.end() );
+
+    EffectInstance::ComponentsNeededMap neededComps;
+    {
+        std::list<ImagePlaneDesc> passThroughPlanes;
+        bool processAllRequested;
+        double passThroughTime;
+        int passThroughView;
+        std::bitset<4> processChannels;
+        int passThroughInput;
+        effect->getComponentsNeededAndProduced_public(foundNodeRequest->second->nodeHash, graphNode->time, graphNode->view, &neededComps, &passThroughPlanes, &processAllRequested, &passThroughTime, &passThroughView, &processChannels, &passThroughInput);
+    }
+
+    const unsigned int inputMipMapLevel = ( node->useScaleOneImagesWhenRenderScaleSupportIsDisabled() || !effect->supportsMultiResolution() ) ? 0 : graphNode->mipMapLevel;
+    const FramesNeededMap& framesNeeded = fv->globalData.frameViewsNeeded;
+    for (FramesNeededMap::const_iterator it = framesNeeded.begin(); it != framesNeeded.end(); ++it) {
+        int inputNb = it->first;
+        if ( !effect->isMaskEnabled(inputNb) ) {
+            continue;
+        }
+        if ( effect->isInputMask(inputNb) ) {
+            std::list<ImagePlaneDesc> availableLayers;
+            effect->getAvailableLayers(graphNode->time, graphNode->view, inputNb, &availableLayers);
+            ImagePlaneDesc maskComps;
+            int channelForAlphaInput = effect->getMaskChannel(inputNb, availableLayers, &maskComps);
+            if ( (channelForAlphaInput == -1) || (maskComps.getNumComponents() == 0) ) {
+                continue;
+            }
+        }
+
+        EffectInstance::ComponentsNeededMap::const_iterator foundComps = neededComps.find(inputNb);
+        if ( ( foundComps == neededComps.end() ) || foundComps->second.empty() ) {
+            continue;
+        }
+
+        EffectInstancePtr inputEffect;
+        if (useTransforms && fv->globalData.transforms) {
+            InputMatrixMap::const_iterator foundReroute = fv->globalData.transforms->find(inputNb);
+            if ( foundReroute != fv->globalData.transforms->end() ) {
+                inputEffect = foundReroute->second.newInputEffect->getInput(foundReroute->second.newInputNbToFetchFrom);
+            }
+        }
+        if (!inputEffect) {
+            inputEffect = effect->getInput(inputNb);
+        }
+        if ( !inputEffect || ( node->getAttachedRotoItem() && inputEffect->isRotoPaintNode() ) ) {
+            continue;
+        }
+
+        for (FrameRangesMap::const_iterator viewIt = it->second.begin(); viewIt != it->second.end(); ++viewIt) {
+            for (U32 range = 0; range < viewIt->second.size(); ++range) {
+                const OfxRangeD& frameRange = viewIt->second[range];
+                // Non integer ranges are not pre-rendered by treeRecurseFunctor either
+                if ( (frameRange.min != (int)frameRange.min) || (frameRange.max != (int)frameRange.max) ) {
+                    continue;
+                }
+                int nbFrames = 0;
+                for (double f = frameRange.min; f <= frameRange.max && nbFrames < NATRON_MAX_FRAMES_NEEDED_PRE_FETCHING; f += 1., ++nbFrames) {
+                    NodePtr inputNode = inputEffect->getNode();
+                    double inputTime = f;
+                    ViewIdx inputView = viewIt->first;
+                    if ( !resolveIdentity(&inputNode, &inputTime, &inputView) ) {
+                        continue;
+                    }
+
+                    bool created;
+                    GraphNode* input = getOrCreateNode(inputNode, inputTime, inputView, inputMipMapLevel, &created);
+                    if (input == graphNode) {
+                        continue;
+                    }
+                    if (created) {
+                        input->caller = effect;
+                        input->callerRenderTime = graphNode->time;
+                    }
+                    for (std::list<ImagePlaneDesc>::const_iterator it2 = foundComps->second.begin(); it2 != foundComps->second.end(); ++it2) {
+                        if ( std::find(input->components.begin(), input->components.end(), *it2) == input->components.end() ) {
+                            input->components.push_back(*it2);
+                        }
+                    }
+                    if ( std::find(graphNode->inputs.begin(), graphNode->inputs.end(), input) == graphNode->inputs.end() ) {
+                        graphNode->inputs.push_back(input);
+                        input->outputs.push_back(graphNode);
+                    }
+                    if (graphNode->isRoot) {
+                        input->isRootInput = true;
+                    }
+                    if (created) {
+                        addInputs(input);
+                    }
+                }
+            }
+        }
+    }
+
+    if (graphNode->inputs.size() > 1) {
+        for (std::list<GraphNode*>::iterator it = graphNode->inputs.begin(); it != graphNode->inputs.end(); ++it) {
+            (*it)->isSiblingBranch = true;
+        }
+    }
+
+    sortedNodes.push_back(graphNode);
+} // RenderTaskGraphPrivate::addInputs
+
+bool
+RenderTaskGraphPrivate::canPreRender(const GraphNode* graphNode) const
+{
+    // The root and its direct inputs are rendered by the caller right after the graph
+    if ( graphNode->isRoot || graphNode->isRootInput || !graphNode->request || graphNode->components.empty() ) {
+        return false;
+    }
+    EffectInstancePtr effect = graphNode->node->getEffectInstance();
+    // Writers must call their render action when rendered by their output
+    if ( effect->isWriter() ) {
+        return false;
+    }
+    ParallelRenderArgsPtr frameArgs = effect->getParallelRenderArgsTLS();
+    if (!frameArgs) {
+        return false;
+    }
+    // There is no cache for OpenGL textures
+    if ( frameArgs->openGLContext.lock() && frameArgs->abortInfo.lock() &&
+         ( (frameArgs->currentOpenglSupport == ePluginOpenGLRenderSupportNeeded) || (frameArgs->currentOpenglSupport == ePluginOpenGLRenderSupportYes) ) ) {
+        return false;
+    }
+
+    return true;
+}
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+/*
+ * Same as EffectInstance::isFrameVaryingOrAnimated_Recursive(), remembering the result for each effect:
+ * the nodes of the graph share most of their upstream.
+ */
+bool
+isFrameVaryingOrAnimated(const EffectInstance* effect,
+                         std::map<const EffectInstance*, bool>* results)
+{
+    std::map<const EffectInstance*, bool>::iterator found = results->find(effect);
+
+    if ( found != results->end() ) {
+        return found->second;
+    }
+    bool& ret = (*results)[effect];
+    ret = false;
+    if ( effect->isFrameVarying() || effect->getHasAnimation() || effect->getNode()->getRotoContext() ) {
+        ret = true;
+
+        return true;
+    }
+    int maxInputs = effect->getNInputs();
+    for (int i = 0; i < maxInputs; ++i) {
+        EffectInstancePtr input = effect->getInput(i);
+        if ( input && isFrameVaryingOrAnimated(input.get(), results) ) {
+            (*results)[effect] = true;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * The tasks a task depends on are the nearest tasks upstream: frames in between are rendered recursively by the task.
+ */
+void
+addTaskDependencies(GraphNode* graphNode,
+                    std::set<GraphNode*>* visited,
+                    std::set<GraphNode*>* dependencies)
+{
+    for (std::list<GraphNode*>::const_iterator it = graphNode->inputs.begin(); it != graphNode->inputs.end(); ++it) {
+        if ( !visited->insert(*it).second ) {
+            continue;
+        }
+        if ( (*it)->isTask ) {
+            dependencies->insert(*it);
+        } else {
+            addTaskDependencies(*it, visited, dependencies);
+        }
+    }
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+std::size_t
+planRenderTasks(const std::vector<RenderTaskGraphNode*>& sortedNodes,
+                std::vector<RenderTaskGraphNode*>* firstTasks)
+{
+    // Outputs come after their inputs in sortedNodes: walk it backwards to decide on the tasks from the root upstream
+    for (std::vector<GraphNode*>::const_reverse_iterator it = sortedNodes.rbegin(); it != sortedNodes.rend(); ++it) {
+        GraphNode* graphNode = *it;
+        if (graphNode->isRoot) {
+            continue;
+        }
+        graphNode->depth = 1;
+        for (std::list<GraphNode*>::const_iterator it2 = graphNode->outputs.begin(); it2 != graphNode->outputs.end(); ++it2) {
+            if ( !(*it2)->isRoot && !(*it2)->isTask ) {
+                graphNode->depth = std::max(graphNode->depth, (*it2)->depth + 1);
+            }
+        }
+        graphNode->isTask = graphNode->canPreRender &&
+                            ( graphNode->isSiblingBranch || graphNode->depth >= NATRON_RENDER_TASK_GRAPH_MAX_DEPTH || graphNode->cachesOutput );
+    }
+
+    std::size_t nTasks = 0;
+    for (std::vector<GraphNode*>::const_iterator it = sortedNodes.begin(); it != sortedNodes.end(); ++it) {
+        GraphNode* graphNode = *it;
+        if (!graphNode->isTask) {
+            continue;
+        }
+        std::set<GraphNode*> visited, dependencies;
+        addTaskDependencies(graphNode, &visited, &dependencies);
+        for (std::set<GraphNode*>::iterator it2 = dependencies.begin(); it2 != dependencies.end(); ++it2) {
+            (*it2)->dependentTasks.push_back(graphNode);
+        }
+        graphNode->nPendingDependencies.fetchAndStoreRelaxed( (int)dependencies.size() );
+        if ( dependencies.empty() ) {
+            firstTasks->push_back(graphNode);
+        }
+        ++nTasks;
+    }
+
+    return nTasks;
+}
+
+void
+RenderTaskGraphPrivate::plan()
+{
+    std::map<const EffectInstance*, bool> frameVaryingEffects;
+
+    for (std::vector<GraphNode*>::iterator it = sortedNodes.begin(); it != sortedNodes.end(); ++it) {
+        GraphNode* graphNode = *it;
+        graphNode->canPreRender = canPreRender(graphNode);
+        if (!graphNode->canPreRender) {
+            continue;
+        }
+        EffectInstancePtr effect = graphNode->node->getEffectInstance();
+        ParallelRenderArgsPtr frameArgs = effect->getParallelRenderArgsTLS();
+        graphNode->cachesOutput = effect->shouldCacheOutput(isFrameVaryingOrAnimated(effect.get(), &frameVaryingEffects), graphNode->time, graphNode->view, frameArgs->visitsCount);
+    }
+    nTasks = planRenderTasks(sortedNodes, &firstTasks);
+}
+
+void
+RenderTaskGraphPrivate::runTask(RenderTaskGraphPrivate* imp,
+                                GraphNode* task)
+{
+    QThread* curThread = QThread::currentThread();
+
+    if (curThread == imp->planningThread) {
+        imp->renderTask(task);
+    } else {
+        // The planning thread runs tasks too and may modify its TLS meanwhile: copy the snapshot taken before
+        imp->tlsSnapshot->copyTo(curThread);
+        imp->renderTask(task);
+        appPTR->getAppTLS()->cleanupTLSForThread();
+    }
+
+    // Start the tasks that were only waiting for this one, they are joined before this task returns
+    std::vector<WorkStealingScheduler::Task> readyTasks;
+    for (std::list<GraphNode*>::iterator it = task->dependentTasks.begin(); it != task->dependentTasks.end(); ++it) {
+        if ( (*it)->nPendingDependencies.fetchAndAddOrdered(-1) == 1 ) {
+            readyTasks.push_back( boost::bind(&RenderTaskGraphPrivate::runTask, imp, *it) );
+        }
+    }
+    if ( !readyTasks.empty() ) {
+        appPTR->getRenderScheduler()->run( readyTasks, imp->tlsSnapshot->getAbortInfo() );
+    }
+}
+
+void
+RenderTaskGraphPrivate::renderTask(GraphNode* task)
+{
+    EffectInstancePtr effect = task->node->getEffectInstance();
+    RectI roi;
+
+    task->request->finalData.finalRoi.toPixelEnclosing( task->mipMapLevel, effect->getAspectRatio(-1), &roi );
+
+    // Make renderRoI cache the result. Tasks skipped because the render was aborted leave it unset, so that
+    // their outputs do not cache images that would not be cached otherwise.
+    task->request->finalData.isPreRendered = true;
+
+    std::map<ImagePlaneDesc, ImagePtr> planes;
+    try {
+        boost::scoped_ptr<EffectInstance::RenderRoIArgs> renderArgs( new EffectInstance::RenderRoIArgs( task->time,
+                                                                                                         RenderScale( Image::getScaleFromMipMapLevel(task->mipMapLevel) ),
+                                                                                                         task->mipMapLevel,
+                                                                                                         task->view,
+                                                                                                         false, // byPassCache
+                                                                                                         roi,
+                                                                                                         RectD(),
+                                                                                                         task->components,
+                                                                                                         effect->getBitDepth(-1),
+                                                                                                         false,
+                                                                                                         task->caller.get(),
+                                                                                                         eStorageModeRAM,
+                                                                                                         task->callerRenderTime) );
+        // The result is left in the cache, on failure the output renders it again and reports the error
+        effect->renderRoI(*renderArgs, &planes);
+    } catch (const std::exception& e) {
+        qDebug() << "Error while pre-rendering" << task->node->getScriptName_mt_safe().c_str() << ":" << e.what();
+    }
+}
+
+RenderTaskGraph::RenderTaskGraph(const FrameRequestMap& request,
+                                 const NodePtr& treeRoot,
+                                 double time,
+                                 ViewIdx view,
+                                 unsigned int mipMapLevel)
+    : _imp( new RenderTaskGraphPrivate(request) )
+{
+    EffectInstancePtr rootEffect = treeRoot->getEffectInstance();
+    ParallelRenderArgsPtr frameArgs = rootEffect->getParallelRenderArgsTLS();
+
+    // Paint strokes render incrementally from the root
+    if ( !frameArgs || frameArgs->isDuringPaintStrokeCreation ) {
+        return;
+    }
+
+    NodePtr rootNode = treeRoot;
+    if ( !_imp->resolveIdentity(&rootNode, &time, &view) ) {
+        return;
+    }
+    bool created;
+    GraphNode* root = _imp->getOrCreateNode(rootNode, time, view, mipMapLevel, &created);
+    root->isRoot = true;
+    _imp->addInputs(root);
+    _imp->plan();
+}
+
+RenderTaskGraph::~RenderTaskGraph()
+{
+}
+
+std::size_t
+RenderTaskGraph::getTasksCount() const
+{
+    return _imp->nTasks;
+}
+
+void
+RenderTaskGraph::run()
+{
+    assert(QThread::currentThread() == _imp->planningThread);
+    if (_imp->nTasks == 0) {
+        return;
+    }
+
+    TLSSnapshot tlsSnapshot;
+    _imp->tlsSnapshot = &tlsSnapshot;
+
+    // Each task starts the tasks depending on it once it is done: running the first tasks runs all of them
+    std::vector<WorkStealingScheduler::Task> tasks;
+    tasks.reserve( _imp->firstTasks.size() );
+    for (std::vector<GraphNode*>::iterator it = _imp->firstTasks.begin(); it != _imp->firstTasks.end(); ++it) {
+        tasks.push_back( boost::bind(&RenderTaskGraphPrivate::runTask, _imp.get(), *it) );
+    }
+    try {
+        appPTR->getRenderScheduler()->run( tasks, tlsSnapshot.getAbortInfo() );
+    } catch (const std::exception& e) {
+        qDebug() << "Error while pre-rendering:" << e.what();
+    }
+    _imp->tlsSnapshot = 0;
+}
+
+NATRON_NAMESPACE_EXIT
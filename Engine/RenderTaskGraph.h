@@ -0,0 +1,94 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_RenderTaskGraph_h
+#define Natron_Engine_RenderTaskGraph_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Engine/ParallelRenderArgs.h"
+#include "Engine/ViewIdx.h"
+#include "Engine/EngineFwd.h"
+
+///Maximum number of nodes rendered recursively by a renderRoI call before a node is pre-rendered by its own task
+#define NATRON_RENDER_TASK_GRAPH_MAX_DEPTH 8
+
+NATRON_NAMESPACE_ENTER
+
+
+/**
+ * @brief The tasks to pre-render upstream of the root of a frame render, planned from the request pass
+ * (see EffectInstance::computeRequestPass) which already holds the frames/views needed by each node and their RoI.
+ *
+ * A task renders one frame/view of a node at a mipmap level on its final RoI and leaves the images in the cache.
+ * Tasks run on the render scheduler of the application once all tasks upstream of them are done, so that sibling
+ * branches (e.g. both inputs of a Merge) render concurrently. When the root is then rendered, renderRoI finds the
+ * pre-rendered images in the cache and only recurses down to the nearest task, which bounds the depth of the recursion.
+ *
+ * A node gets a task for a frame/view if it is not a direct input of the root, does not render with OpenGL and either:
+ * - its output would be cached anyway
+ * - it is one of several inputs of the same node
+ * - NATRON_RENDER_TASK_GRAPH_MAX_DEPTH nodes would otherwise be rendered recursively from the nearest task downstream
+ *
+ * Failures are not reported: the render of the root renders whatever was not pre-rendered and reports the errors.
+ **/
+struct RenderTaskGraphPrivate;
+class RenderTaskGraph
+{
+public:
+
+    /**
+     * @brief Plans the tasks to render the given frame/view of treeRoot. The TLS of the frame render must be set
+     * on the calling thread, see ParallelRenderArgsSetter::updateNodesRequest().
+     **/
+    RenderTaskGraph(const FrameRequestMap& request,
+                    const NodePtr& treeRoot,
+                    double time,
+                    ViewIdx view,
+                    unsigned int mipMapLevel);
+
+    ~RenderTaskGraph();
+
+    std::size_t getTasksCount() const;
+
+    /**
+     * @brief Runs all tasks and returns once they are finished or the render is aborted. Each task starts
+     * as soon as the tasks it depends on are done.
+     * This must be called once, from the thread that planned the tasks.
+     **/
+    void run();
+
+private:
+
+    boost::scoped_ptr<RenderTaskGraphPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_RenderTaskGraph_h
@@ -0,0 +1,116 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_RenderTaskGraphPrivate_h
+#define Natron_Engine_RenderTaskGraphPrivate_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <vector>
+
+#include <QtCore/QAtomicInt>
+
+#include "Engine/ImagePlaneDesc.h"
+#include "Engine/ViewIdx.h"
+#include "Engine/EngineFwd.h"
+
+NATRON_NAMESPACE_ENTER
+
+
+/**
+ * @brief A frame/view of a node at a mipmap level in a RenderTaskGraph. Identity frames are not part of the graph,
+ * they are replaced by the frame they forward to.
+ **/
+struct RenderTaskGraphNode
+{
+    NodePtr node;
+    double time;
+    ViewIdx view;
+    unsigned int mipMapLevel;
+    FrameViewRequest* request;
+
+    // The first node that requested this frame, passed as the caller of renderRoI
+    EffectInstancePtr caller;
+    double callerRenderTime;
+
+    // The union of the components needed by all nodes that requested this frame
+    std::list<ImagePlaneDesc> components;
+
+    std::list<RenderTaskGraphNode*> inputs;
+    std::list<RenderTaskGraphNode*> outputs;
+
+    bool isRoot;
+    bool isRootInput;
+    bool isSiblingBranch;
+
+    // Whether this frame may be rendered by a task, and whether its output is cached anyway
+    bool canPreRender;
+    bool cachesOutput;
+
+    bool isTask;
+
+    // Number of nodes rendered recursively from the nearest task (or the root) downstream, including this one
+    int depth;
+
+    // The tasks that depend on this task, and the number of tasks this task depends on that are not done yet
+    std::list<RenderTaskGraphNode*> dependentTasks;
+    QAtomicInt nPendingDependencies;
+
+    RenderTaskGraphNode()
+        : node()
+        , time(0.)
+        , view(0)
+        , mipMapLevel(0)
+        , request(0)
+        , caller()
+        , callerRenderTime(0.)
+        , components()
+        , inputs()
+        , outputs()
+        , isRoot(false)
+        , isRootInput(false)
+        , isSiblingBranch(false)
+        , canPreRender(false)
+        , cachesOutput(false)
+        , isTask(false)
+        , depth(0)
+        , dependentTasks()
+        , nPendingDependencies(0)
+    {
+    }
+};
+
+/**
+ * @brief Decides which nodes get a task from their flags, see RenderTaskGraph, and links each task to the tasks
+ * it depends on. sortedNodes holds all nodes of the graph, inputs before their outputs.
+ * @returns The number of tasks. firstTasks is filled with the tasks that do not depend on any other task.
+ **/
+std::size_t planRenderTasks(const std::vector<RenderTaskGraphNode*>& sortedNodes,
+                            std::vector<RenderTaskGraphNode*>* firstTasks);
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_RenderTaskGraphPrivate_h
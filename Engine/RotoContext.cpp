@@ -2222,7 +2222,7 @@ convertCairoImageToNatronImageForInverted_noColor(cairo_surface_t* cairoImg,
             }
 #         ifdef DEBUG
             for (int c = 0; c < dstNComps; ++c) {
-                assert( !(boost::math::isnan)(dstPix[c]) ); // check for NaN
+                assert( !(boost::math::isnan)( (float)dstPix[c] ) ); // check for NaN
             }
 #         endif
         }
@@ -2948,6 +2948,8 @@ RotoDrawableItem::renderMaskInternal(const RectI & roi,
         convertCairoImageToNatronImage_noColor<unsigned short, 65535>(imgWrapper.cairoImg, srcNComps, image.get(), roi, shapeColor, opacity, inverted, useOpacityToConvert);
         break;
     case eImageBitDepthHalf:
+        convertCairoImageToNatronImage_noColor<Half, 1>(imgWrapper.cairoImg, srcNComps, image.get(), roi, shapeColor, opacity, inverted, useOpacityToConvert);
+        break;
     case eImageBitDepthNone:
         assert(false);
         break;
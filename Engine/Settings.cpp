@@ -43,11 +43,12 @@
 
 #include "Engine/AppManager.h"
 #include "Engine/AppInstance.h"
+#include "Engine/ImageTiles.h" // NATRON_IMAGE_TILE_SIZE
 #include "Engine/KnobFactory.h"
 #include "Engine/KnobFile.h"
 #include "Engine/KnobTypes.h"
 #include "Engine/LibraryBinary.h"
-#include "Engine/MemoryInfo.h" // getSystemTotalRAM, isApplication32Bits, printAsRAM
+#include "Engine/MemoryInfo.h" // getSystemTotalRAM, getEffectiveTotalRAM, isApplication32Bits, printAsRAM
 #include "Engine/Node.h"
 #include "Engine/OSGLContext.h"
 #include "Engine/OutputSchedulerThread.h"
@@ -57,6 +58,7 @@
 #include "Engine/Utils.h"
 #include "Engine/ViewIdx.h"
 #include "Engine/ViewerInstance.h"
+#include "Engine/WorkStealingScheduler.h"
 
 #include "Gui/GuiDefines.h"
 
@@ -327,6 +329,17 @@ Settings::initializeKnobsThreading()
     _nThreadsPerEffect->disableSlider();
     _threadingPage->addKnob(_nThreadsPerEffect);
 
+    _playbackPrefetchFrames = AppManager::createKnob<KnobInt>( this, tr("Playback prefetch (frames ahead, 0=off)") );
+    _playbackPrefetchFrames->setName("playbackPrefetchFrames");
+    _playbackPrefetchFrames->setHintToolTip( tr("Controls how many frames ahead of the playback the Readers, and the nodes whose "
+                                                "caching is forced, upstream of the viewer are rendered and cached. "
+                                                "Prefetching runs on low priority threads that pause as soon as the playback "
+                                                "needs all the cores. This reduces the stalls on the first playback of heavy comps, "
+                                                "at the cost of cache memory. Set to 0 to disable prefetching.") );
+    _playbackPrefetchFrames->setMinimum(0);
+    _playbackPrefetchFrames->disableSlider();
+    _threadingPage->addKnob(_playbackPrefetchFrames);
+
     _renderInSeparateProcess = AppManager::createKnob<KnobBool>( this, tr("Render in a separate process") );
     _renderInSeparateProcess->setName("renderNewProcess");
     _renderInSeparateProcess->setHintToolTip( tr("If true, %1 will render frames to disk in "
@@ -1205,13 +1218,93 @@ Settings::initializeKnobsCaching()
                                            "output has its settings panel opened.").arg( QString::fromUtf8(NATRON_APPLICATION_NAME) ) );
     _cachingTab->addKnob(_aggressiveCaching);
 
+    _contentBasedNodeHash = AppManager::createKnob<KnobBool>( this, tr("Content-based node hashing") );
+    _contentBasedNodeHash->setName("contentBasedNodeHash");
+    _contentBasedNodeHash->setHintToolTip( tr("When checked, the cache entries of a node are identified by the values and animation "
+                                              "of its parameters, its plug-in and its inputs, instead of the history of the changes "
+                                              "made to the node. Going back to a previous state of a parameter, undo/redo, "
+                                              "copy/paste or reopening a project will then reuse the images already in the RAM and disk caches.\n"
+                                              "Nodes with expressions, linked parameters, roto shapes or tracks always use the history of their changes.") );
+    _cachingTab->addKnob(_contentBasedNodeHash);
+
+    _compressedCaching = AppManager::createKnob<KnobBool>( this, tr("Compress images evicted from the RAM cache") );
+    _compressedCaching->setName("compressedCaching");
+    _compressedCaching->setHintToolTip( tr("When checked, images that do not fit in the RAM cache anymore are compressed and kept "
+                                           "in RAM instead of being discarded. Up to half of the RAM cache may be used by compressed images. "
+                                           "Compressed images are decompressed when they are needed again, which is much faster than rendering them again. "
+                                           "The compression is lossless.") );
+    _compressedCaching->setAddNewLine(false);
+    _cachingTab->addKnob(_compressedCaching);
+
+    _compressedCachingHalfFloat = AppManager::createKnob<KnobBool>( this, tr("Store as half-float when lossless") );
+    _compressedCachingHalfFloat->setName("compressedCachingHalfFloat");
+    _compressedCachingHalfFloat->setHintToolTip( tr("When checked, compressed 32-bit floating point images whose values can all be represented "
+                                                    "exactly as 16-bit floating point values, such as images read from half-float EXR files, "
+                                                    "are stored as 16-bit floating point values, which halves their size before compression.") );
+    _cachingTab->addKnob(_compressedCachingHalfFloat);
+
+    _cacheEvictionPolicy = AppManager::createKnob<KnobChoice>( this, tr("RAM cache eviction policy") );
+    _cacheEvictionPolicy->setName("cacheEvictionPolicy");
+    std::vector<ChoiceOption> evictionPolicies;
+    evictionPolicies.push_back(ChoiceOption("lru",
+                                            tr("Least recently used").toStdString(),
+                                            tr("The images that were not used for the longest time are discarded first.").toStdString() ));
+    evictionPolicies.push_back(ChoiceOption("costAware",
+                                            tr("Cost-aware").toStdString(),
+                                            tr("Among the images that were not used for a long time, those that were the fastest to render "
+                                               "for their size and that were used the least are discarded first. "
+                                               "Images that were expensive to render, such as the output of heavy filters reused at each frame, "
+                                               "then stay in the cache during playback.").toStdString() ));
+    _cacheEvictionPolicy->populateChoices(evictionPolicies);
+    _cacheEvictionPolicy->setHintToolTip( tr("Selects which images are discarded first when the RAM cache is full.") );
+    _cachingTab->addKnob(_cacheEvictionPolicy);
+
+    _freeEvictedImagesOnIdle = AppManager::createKnob<KnobBool>( this, tr("Free discarded images when idle") );
+    _freeEvictedImagesOnIdle->setName("freeEvictedImagesOnIdle");
+    _freeEvictedImagesOnIdle->setHintToolTip( tr("When checked, the memory of the images discarded from the cache is only given back "
+                                                 "once the cache stopped discarding images for a short while or needs memory, "
+                                                 "instead of as soon as possible. This may speed up renders discarding many images, "
+                                                 "at the expense of a higher memory usage.") );
+    _cachingTab->addKnob(_freeEvictedImagesOnIdle);
+
+    _hugePagesForImages = AppManager::createKnob<KnobBool>( this, tr("Use huge pages for large images") );
+    _hugePagesForImages->setName("hugePagesForImages");
+    _hugePagesForImages->setHintToolTip( tr("When checked, the memory of large images is allocated with 2 MB pages instead of 4 KB pages, "
+                                            "which speeds up the processing of high resolution images. "
+                                            "Explicit huge pages are used if the system reserved some, otherwise transparent huge pages. "
+                                            "The proportion of the memory of large images backed by huge pages is displayed with the cache size in the node graph.\n"
+                                            "This is only available on Linux.") );
+#ifndef __NATRON_LINUX__
+    _hugePagesForImages->setSecret(true);
+#endif
+    _cachingTab->addKnob(_hugePagesForImages);
+
+    _sharedNodeCache = AppManager::createKnob<KnobBool>( this, tr("Share the node cache between processes") );
+    _sharedNodeCache->setName("sharedNodeCache");
+    _sharedNodeCache->setHintToolTip( tr("When checked, the images rendered by the nodes are shared between the %1 processes running "
+                                         "on this computer with the same cache location, e.g: several background renders of "
+                                         "different frame ranges of the same project. An image rendered by one process is then "
+                                         "read by the other processes instead of being rendered again, and its memory is shared by all of them.\n"
+                                         "Shared images are copied to files in the cache location, which should be on a local disk.\n"
+                                         "Changing this requires a restart of the application to take effect.").arg( QString::fromUtf8(NATRON_APPLICATION_NAME) ) );
+    _cachingTab->addKnob(_sharedNodeCache);
+
+    _tiledNodeCache = AppManager::createKnob<KnobBool>( this, tr("Cache images as tiles") );
+    _tiledNodeCache->setName("tiledNodeCache");
+    _tiledNodeCache->setHintToolTip( tr("When checked, the images rendered by the nodes are stored in the cache as tiles of %1x%1 pixels "
+                                        "instead of entire images. When panning or zooming out in the viewer, only the tiles that "
+                                        "are not cached yet are rendered, and the cache discards the tiles that are no longer used "
+                                        "instead of entire images. This uses more memory bandwidth, as the tiles are copied "
+                                        "to and from the images rendered by the plug-ins.").arg(NATRON_IMAGE_TILE_SIZE) );
+    _cachingTab->addKnob(_tiledNodeCache);
+
     _maxRAMPercent = AppManager::createKnob<KnobInt>( this, tr("Maximum amount of RAM memory used for caching (% of total RAM)") );
     _maxRAMPercent->setName("maxRAMPercent");
     _maxRAMPercent->disableSlider();
     _maxRAMPercent->setMinimum(0);
     _maxRAMPercent->setMaximum(100);
     QString ramHint( tr("This setting indicates the percentage of the total RAM which can be used by the memory caches. "
-                        "This system has %1 of RAM.").arg( printAsRAM( getSystemTotalRAM() ) ) );
+                        "This system has %1 of RAM.").arg( printAsRAM( getEffectiveTotalRAM() ) ) );
     if ( isApplication32Bits() && (getSystemTotalRAM() > 4ULL * 1024ULL * 1024ULL * 1024ULL) ) {
         ramHint.append( QString::fromUtf8("\n") );
         ramHint.append( tr("The version of %1 you are running is 32 bits, which means the available RAM "
@@ -1251,6 +1344,19 @@ Settings::initializeKnobsCaching()
     _unreachableRAMLabel->setAsLabel();
     _cachingTab->addKnob(_unreachableRAMLabel);
 
+    _cacheMemoryPressureAdaptation = AppManager::createKnob<KnobBool>( this, tr("Adapt the caches to memory pressure") );
+    _cacheMemoryPressureAdaptation->setName("cacheMemoryPressureAdaptation");
+    _cacheMemoryPressureAdaptation->setHintToolTip( tr("When checked and %1 runs with a memory limit, e.g: in a Docker or Kubernetes container, "
+                                                       "the memory caches shrink as soon as the memory usage gets close to the limit "
+                                                       "or the system reports memory pressure, and grow back once the pressure is gone. "
+                                                       "This avoids the process being killed for using more memory than its limit.\n"
+                                                       "The percentages of RAM above are then relative to the memory limit of the process.\n"
+                                                       "This is only available on Linux.").arg( QString::fromUtf8(NATRON_APPLICATION_NAME) ) );
+#ifndef __NATRON_LINUX__
+    _cacheMemoryPressureAdaptation->setSecret(true);
+#endif
+    _cachingTab->addKnob(_cacheMemoryPressureAdaptation);
+
     _maxViewerDiskCacheGB = AppManager::createKnob<KnobInt>( this, tr("Maximum playback disk cache size (GiB)") );
     _maxViewerDiskCacheGB->setName("maxViewerDiskCache");
     _maxViewerDiskCacheGB->disableSlider();
@@ -1419,7 +1525,7 @@ void
 Settings::setCachingLabels()
 {
     int maxTotalRam = _maxRAMPercent->getValue();
-    U64 systemTotalRam = getSystemTotalRAM();
+    U64 systemTotalRam = getEffectiveTotalRAM();
     U64 maxRAM = (U64)( ( (double)maxTotalRam / 100. ) * systemTotalRam );
 
     _maxRAMLabel->setValue( printAsRAM(maxRAM).toStdString() );
@@ -1450,6 +1556,7 @@ Settings::setDefaultValues()
 #endif
     _useThreadPool->setDefaultValue(true);
     _nThreadsPerEffect->setDefaultValue(0);
+    _playbackPrefetchFrames->setDefaultValue(8);
     _renderInSeparateProcess->setDefaultValue(false, 0);
     _queueRenders->setDefaultValue(false);
 
@@ -1500,8 +1607,17 @@ Settings::setDefaultValues()
 
     // Caching
     _aggressiveCaching->setDefaultValue(false);
+    _contentBasedNodeHash->setDefaultValue(false);
+    _compressedCaching->setDefaultValue(false);
+    _compressedCachingHalfFloat->setDefaultValue(true);
+    _cacheEvictionPolicy->setDefaultValue(0);
+    _freeEvictedImagesOnIdle->setDefaultValue(false);
+    _hugePagesForImages->setDefaultValue(false);
+    _sharedNodeCache->setDefaultValue(false);
+    _tiledNodeCache->setDefaultValue(false);
     _maxRAMPercent->setDefaultValue(50, 0);
     _unreachableRAMPercent->setDefaultValue(5);
+    _cacheMemoryPressureAdaptation->setDefaultValue(true);
     _maxViewerDiskCacheGB->setDefaultValue(5, 0);
     _maxDiskCacheNodeGB->setDefaultValue(10, 0);
     //_diskCachePath
@@ -2256,6 +2372,30 @@ Settings::onKnobValueChanged(KnobI* k,
             appPTR->setApplicationsCachesMaximumMemoryPercent( getRamMaximumPercent() );
         }
         setCachingLabels();
+    } else if ( ( k == _compressedCaching.get() ) || ( k == _compressedCachingHalfFloat.get() ) ) {
+        if (!_restoringSettings) {
+            appPTR->setApplicationsCachesCompression( isCompressedCachingEnabled(), isCompressedCachingHalfFloatEnabled() );
+        }
+    } else if ( k == _cacheEvictionPolicy.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setApplicationsCachesCostAwareEviction( isCostAwareCacheEvictionEnabled() );
+        }
+    } else if ( k == _cacheMemoryPressureAdaptation.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setCachesMemoryPressureAdaptationEnabled( isCacheMemoryPressureAdaptationEnabled() );
+        }
+    } else if ( k == _tiledNodeCache.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setNodeCacheTiled( isTiledNodeCacheEnabled() );
+        }
+    } else if ( k == _freeEvictedImagesOnIdle.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setApplicationsCachesFreeOnIdle( isFreeEvictedImagesOnIdleEnabled() );
+        }
+    } else if ( k == _hugePagesForImages.get() ) {
+        if (!_restoringSettings) {
+            appPTR->setImageBuffersHugePagesEnabled( isHugePagesForImagesEnabled() );
+        }
     } else if ( k == _diskCachePath.get() ) {
         QString path = QString::fromUtf8(_diskCachePath->getValue().c_str());
         qputenv(NATRON_DISK_CACHE_PATH_ENV_VAR, path.toUtf8());
@@ -2265,14 +2405,21 @@ Settings::onKnobValueChanged(KnobI* k,
     } else if ( k == _numberOfThreads.get() ) {
         int nbThreads = getNumberOfThreads();
         appPTR->setNThreadsToRender(nbThreads);
+        int maxThreads;
         if (nbThreads == -1) {
+            maxThreads = 0;
             QThreadPool::globalInstance()->setMaxThreadCount(1);
             appPTR->abortAnyProcessing();
         } else if (nbThreads == 0) {
+            maxThreads = QThread::idealThreadCount();
             QThreadPool::globalInstance()->setMaxThreadCount( QThread::idealThreadCount() );
         } else {
+            maxThreads = nbThreads;
             QThreadPool::globalInstance()->setMaxThreadCount(nbThreads);
         }
+        if ( appPTR->getRenderScheduler() ) {
+            appPTR->getRenderScheduler()->setMaxWorkerCount(maxThreads);
+        }
     } else if ( k == _nThreadsPerEffect.get() ) {
         appPTR->setNThreadsPerEffect( getNumberOfThreadsPerEffect() );
     } else if ( k == _ocioConfigKnob.get() ) {
@@ -2480,6 +2627,60 @@ Settings::isAggressiveCachingEnabled() const
     return _aggressiveCaching->getValue();
 }
 
+bool
+Settings::isContentBasedNodeHashEnabled() const
+{
+    return _contentBasedNodeHash->getValue();
+}
+
+bool
+Settings::isCompressedCachingEnabled() const
+{
+    return _compressedCaching->getValue();
+}
+
+bool
+Settings::isCompressedCachingHalfFloatEnabled() const
+{
+    return _compressedCachingHalfFloat->getValue();
+}
+
+bool
+Settings::isCostAwareCacheEvictionEnabled() const
+{
+    return _cacheEvictionPolicy->getValue() == 1;
+}
+
+bool
+Settings::isCacheMemoryPressureAdaptationEnabled() const
+{
+    return _cacheMemoryPressureAdaptation->getValue();
+}
+
+bool
+Settings::isFreeEvictedImagesOnIdleEnabled() const
+{
+    return _freeEvictedImagesOnIdle->getValue();
+}
+
+bool
+Settings::isHugePagesForImagesEnabled() const
+{
+    return _hugePagesForImages->getValue();
+}
+
+bool
+Settings::isSharedNodeCacheEnabled() const
+{
+    return _sharedNodeCache->getValue();
+}
+
+bool
+Settings::isTiledNodeCacheEnabled() const
+{
+    return _tiledNodeCache->getValue();
+}
+
 double
 Settings::getRamMaximumPercent() const
 {
@@ -3136,6 +3337,12 @@ Settings::isAutoFixRelativeFilePathEnabled() const
     return _fixPathsOnProjectPathChanged->getValue();
 }
 
+int
+Settings::getPlaybackPrefetchFrames() const
+{
+    return _playbackPrefetchFrames->getValue();
+}
+
 int
 Settings::getNumberOfParallelRenders() const
 {
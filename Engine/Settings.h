@@ -121,6 +121,8 @@ public:
 
     int getNumberOfParallelRenders() const;
 
+    int getPlaybackPrefetchFrames() const;
+
     void setNumberOfParallelRenders(int nb);
 
     int getNumberOfThreadsPerEffect() const;
@@ -274,6 +276,24 @@ public:
 
     bool isAggressiveCachingEnabled() const;
 
+    bool isContentBasedNodeHashEnabled() const;
+
+    bool isCompressedCachingEnabled() const;
+
+    bool isCompressedCachingHalfFloatEnabled() const;
+
+    bool isCostAwareCacheEvictionEnabled() const;
+
+    bool isFreeEvictedImagesOnIdleEnabled() const;
+
+    bool isCacheMemoryPressureAdaptationEnabled() const;
+
+    bool isHugePagesForImagesEnabled() const;
+
+    bool isSharedNodeCacheEnabled() const;
+
+    bool isTiledNodeCacheEnabled() const;
+
     bool isAutoTurboEnabled() const;
 
     void setAutoTurboModeEnabled(bool e);
@@ -436,6 +456,7 @@ private:
     KnobIntPtr _numberOfParallelRenders;
     KnobBoolPtr _useThreadPool;
     KnobIntPtr _nThreadsPerEffect;
+    KnobIntPtr _playbackPrefetchFrames;
     KnobBoolPtr _renderInSeparateProcess;
     KnobBoolPtr _queueRenders;
 
@@ -493,6 +514,14 @@ private:
     // Caching
     KnobPagePtr _cachingTab;
     KnobBoolPtr _aggressiveCaching;
+    KnobBoolPtr _contentBasedNodeHash;
+    KnobBoolPtr _compressedCaching;
+    KnobBoolPtr _compressedCachingHalfFloat;
+    KnobChoicePtr _cacheEvictionPolicy;
+    KnobBoolPtr _freeEvictedImagesOnIdle;
+    KnobBoolPtr _hugePagesForImages;
+    KnobBoolPtr _sharedNodeCache;
+    KnobBoolPtr _tiledNodeCache;
     ///The percentage of the value held by _maxRAMPercent to dedicate to playback cache (viewer cache's in-RAM portion) only
     KnobStringPtr _maxPlaybackLabel;
 
@@ -509,6 +538,7 @@ private:
     ///10% seems a reasonable value.
     KnobIntPtr _unreachableRAMPercent;
     KnobStringPtr _unreachableRAMLabel;
+    KnobBoolPtr _cacheMemoryPressureAdaptation;
 
     ///The total disk space allowed for all Natron's caches
     KnobIntPtr _maxViewerDiskCacheGB;
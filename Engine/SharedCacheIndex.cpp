@@ -0,0 +1,496 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "SharedCacheIndex.h"
+
+#include <cstring> // memcpy, memset
+#include <sstream> // stringstream
+#include <stdexcept>
+
+#if defined(__NATRON_WIN32__)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <signal.h> // kill
+#include <sys/types.h>
+#endif
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QDebug>
+
+#include "Global/ProcInfo.h"
+#include "Global/QtCompat.h" // for removeRecursively
+
+#include "Engine/MemoryFile.h"
+
+// Identifies a shared index file
+#define NATRON_SHARED_CACHE_INDEX_MAGIC 0x4E435348
+// Increment when the layout of the shared index changes
+#define NATRON_SHARED_CACHE_INDEX_VERSION 2
+
+NATRON_NAMESPACE_ENTER
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+struct SharedIndexHeader
+{
+    U32 magic;
+    U32 indexVersion;
+    U32 cacheVersion;
+    U32 nSlots;
+    U32 recordMaxBytes;
+    U32 reserved[3];
+};
+
+struct SharedIndexSlot
+{
+    // Even when the slot is stable, odd while a process modifies it. Only accessed through getSequence()
+    int sequence;
+
+    // PID of the process modifying the slot, 0 if none. Only accessed through getWriter()
+    int writer;
+    U64 hash;
+
+    // 0 if the slot is empty
+    U32 recordSize;
+    char record[NATRON_SHARED_CACHE_INDEX_RECORD_MAX_BYTES];
+};
+
+// QAtomicInt holds a single int and its operations are lock-free, so that it can be used on memory shared between
+// processes
+QAtomicInt&
+getSequence(SharedIndexSlot& slot)
+{
+    return reinterpret_cast<QAtomicInt&>(slot.sequence);
+}
+
+QAtomicInt&
+getWriter(SharedIndexSlot& slot)
+{
+    return reinterpret_cast<QAtomicInt&>(slot.writer);
+}
+
+std::size_t
+getIndexFileSize(U32 nSlots)
+{
+    return sizeof(SharedIndexHeader) + (std::size_t)nSlots * sizeof(SharedIndexSlot);
+}
+
+bool
+isProcessRunning(long long pid)
+{
+#if defined(__NATRON_WIN32__)
+    HANDLE processHandle = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, (DWORD)pid);
+    if (!processHandle) {
+        return false;
+    }
+    DWORD exitCode = 0;
+    bool caughtExitCode = GetExitCodeProcess(processHandle, &exitCode);
+    CloseHandle(processHandle);
+
+    return !caughtExitCode || exitCode == STILL_ACTIVE;
+#else
+    // EPERM: the process exists but belongs to another user
+
+    return ::kill( (pid_t)pid, 0 ) == 0 || errno == EPERM;
+#endif
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+struct SharedCacheIndexPrivate
+{
+    boost::scoped_ptr<MemoryFile> file;
+    SharedIndexSlot* slots;
+    U32 nSlots;
+    std::string processFilesPath;
+
+    // Written in the slots modified by this process
+    int processID;
+
+    SharedCacheIndexPrivate()
+        : file()
+        , slots(0)
+        , nSlots(0)
+        , processFilesPath()
+        , processID( (int)ProcInfo::getCurrentProcessPID() )
+    {
+    }
+
+    /**
+     * @brief Maps the existing index file. Returns false if it does not exist or is not valid for this version.
+     **/
+    bool mapIndexFile(const std::string& filePath, unsigned int cacheVersion);
+
+    /**
+     * @brief Creates the index file aside and moves it in place, so that other processes never map an index
+     * partially initialized. If another process created it meanwhile, its index is kept.
+     **/
+    void createIndexFile(const std::string& filePath, unsigned int cacheVersion);
+
+    SharedIndexSlot& getSlot(U64 hash, int probe) const
+    {
+        return slots[(hash + (U64)probe) % nSlots];
+    }
+
+    /**
+     * @brief Copies the record of the slot if it holds one for the given hash and was not modified while being read.
+     * sequence is set to the value of the sequence number of the slot when it was read.
+     **/
+    bool readSlot(SharedIndexSlot& slot, U64 hash, std::string* record, int* sequence) const;
+
+    /**
+     * @brief Takes the slot to modify it. Fails if another process is modifying it or modified it since sequence was read
+     * by readSlot(). On success, the slot must be released with endSlotWrite().
+     **/
+    bool beginSlotWrite(SharedIndexSlot& slot, int sequence) const;
+
+    void endSlotWrite(SharedIndexSlot& slot, int sequence) const;
+
+    /**
+     * @brief If the slot was left taken by a process killed while modifying it, clears the record it may have
+     * partially written and releases the slot. Otherwise the slot would never be readable nor writable again.
+     **/
+    void reclaimSlot(SharedIndexSlot& slot) const;
+};
+
+bool
+SharedCacheIndexPrivate::mapIndexFile(const std::string& filePath,
+                                      unsigned int cacheVersion)
+{
+    if ( !QFile::exists( QString::fromUtf8( filePath.c_str() ) ) ) {
+        return false;
+    }
+    try {
+        file.reset( new MemoryFile(filePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail) );
+    } catch (const std::exception& e) {
+        qDebug() << "Failed to open the shared cache index" << filePath.c_str() << ":" << e.what();
+        file.reset();
+
+        return false;
+    }
+    if ( !file->data() || (file->size() < sizeof(SharedIndexHeader) ) ) {
+        file.reset();
+
+        return false;
+    }
+
+    SharedIndexHeader header;
+    std::memcpy( &header, file->data(), sizeof(header) );
+    if ( (header.magic != NATRON_SHARED_CACHE_INDEX_MAGIC) ||
+         (header.indexVersion != NATRON_SHARED_CACHE_INDEX_VERSION) ||
+         (header.cacheVersion != cacheVersion) ||
+         (header.recordMaxBytes != NATRON_SHARED_CACHE_INDEX_RECORD_MAX_BYTES) ||
+         (header.nSlots == 0) ||
+         ( file->size() < getIndexFileSize(header.nSlots) ) ) {
+        file.reset();
+
+        return false;
+    }
+    nSlots = header.nSlots;
+    slots = reinterpret_cast<SharedIndexSlot*>( file->data() + sizeof(SharedIndexHeader) );
+
+    return true;
+}
+
+void
+SharedCacheIndexPrivate::createIndexFile(const std::string& filePath,
+                                         unsigned int cacheVersion)
+{
+    std::stringstream ss;
+
+    ss << filePath << '.' << ProcInfo::getCurrentProcessPID() << ".tmp";
+    std::string tmpFilePath = ss.str();
+    {
+        MemoryFile tmpFile(tmpFilePath, getIndexFileSize(NATRON_SHARED_CACHE_INDEX_SLOTS), MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate);
+        if ( !tmpFile.data() ) {
+            throw std::runtime_error("Failed to create the shared cache index " + tmpFilePath);
+        }
+        std::memset( tmpFile.data(), 0, tmpFile.size() );
+
+        SharedIndexHeader header;
+        std::memset( &header, 0, sizeof(header) );
+        header.magic = NATRON_SHARED_CACHE_INDEX_MAGIC;
+        header.indexVersion = NATRON_SHARED_CACHE_INDEX_VERSION;
+        header.cacheVersion = cacheVersion;
+        header.nSlots = NATRON_SHARED_CACHE_INDEX_SLOTS;
+        header.recordMaxBytes = NATRON_SHARED_CACHE_INDEX_RECORD_MAX_BYTES;
+        std::memcpy( tmpFile.data(), &header, sizeof(header) );
+        tmpFile.flush(MemoryFile::eFlushTypeSync, NULL, 0);
+    }
+
+    // QFile::rename does not overwrite an existing file: if it fails, another process created the index meanwhile
+    QString tmpFileName = QString::fromUtf8( tmpFilePath.c_str() );
+    if ( !QFile::rename( tmpFileName, QString::fromUtf8( filePath.c_str() ) ) ) {
+        QFile::remove(tmpFileName);
+    }
+}
+
+bool
+SharedCacheIndexPrivate::readSlot(SharedIndexSlot& slot,
+                                  U64 hash,
+                                  std::string* record,
+                                  int* sequence) const
+{
+    *sequence = getSequence(slot).fetchAndAddAcquire(0);
+    if (*sequence & 1) {
+        return false;
+    }
+    U32 recordSize = slot.recordSize;
+    if ( (recordSize == 0) || (recordSize > NATRON_SHARED_CACHE_INDEX_RECORD_MAX_BYTES) || (slot.hash != hash) ) {
+        return false;
+    }
+    std::string copy(slot.record, recordSize);
+
+    // The copy must be complete before the sequence is read again
+    if (getSequence(slot).fetchAndAddOrdered(0) != *sequence) {
+        return false;
+    }
+    record->swap(copy);
+
+    return true;
+}
+
+bool
+SharedCacheIndexPrivate::beginSlotWrite(SharedIndexSlot& slot,
+                                        int sequence) const
+{
+    // The writer is set before the sequence number so that a process killed at any point leaves its PID in the slot
+    if ( !getWriter(slot).testAndSetAcquire(0, processID) ) {
+        return false;
+    }
+    if ( !getSequence(slot).testAndSetOrdered(sequence, sequence + 1) ) {
+        getWriter(slot).fetchAndStoreRelease(0);
+
+        return false;
+    }
+
+    return true;
+}
+
+void
+SharedCacheIndexPrivate::endSlotWrite(SharedIndexSlot& slot,
+                                      int sequence) const
+{
+    getSequence(slot).fetchAndStoreRelease(sequence + 2);
+    getWriter(slot).fetchAndStoreRelease(0);
+}
+
+void
+SharedCacheIndexPrivate::reclaimSlot(SharedIndexSlot& slot) const
+{
+    int writer = getWriter(slot).fetchAndAddAcquire(0);
+
+    // The slots taken by this process are being written by another thread
+    if ( (writer == 0) || (writer == processID) || isProcessRunning(writer) ) {
+        return;
+    }
+    // Fails if another process is reclaiming it
+    if ( !getWriter(slot).testAndSetAcquire(writer, processID) ) {
+        return;
+    }
+    int sequence = getSequence(slot).fetchAndAddAcquire(0);
+    if (sequence & 1) {
+        // The record may be partially written
+        slot.recordSize = 0;
+        slot.hash = 0;
+        getSequence(slot).fetchAndStoreRelease(sequence + 1);
+    }
+    getWriter(slot).fetchAndStoreRelease(0);
+}
+
+SharedCacheIndex::SharedCacheIndex()
+    : _imp( new SharedCacheIndexPrivate() )
+{
+}
+
+SharedCacheIndex::~SharedCacheIndex()
+{
+}
+
+void
+SharedCacheIndex::open(const std::string& directoryPath,
+                       unsigned int cacheVersion)
+{
+    close();
+
+    QString directoryName = QString::fromUtf8( directoryPath.c_str() );
+    if ( !directoryName.endsWith( QLatin1Char('/') ) ) {
+        directoryName += QLatin1Char('/');
+    }
+    QDir directory(directoryName);
+    if ( !directory.exists() && !directory.mkpath( QString::fromUtf8(".") ) ) {
+        throw std::runtime_error("Failed to create the shared cache directory " + directoryPath);
+    }
+
+    std::string filePath = directoryName.toStdString() + NATRON_SHARED_CACHE_INDEX_FILE_NAME;
+    if ( !_imp->mapIndexFile(filePath, cacheVersion) ) {
+        // Obsolete or corrupted: the processes still using it keep their mapping until they close it
+        QFile::remove( QString::fromUtf8( filePath.c_str() ) );
+        _imp->createIndexFile(filePath, cacheVersion);
+        if ( !_imp->mapIndexFile(filePath, cacheVersion) ) {
+            throw std::runtime_error("Invalid shared cache index " + filePath);
+        }
+    }
+
+    // Release the slots left taken by the processes killed while modifying them
+    for (U32 i = 0; i < _imp->nSlots; ++i) {
+        _imp->reclaimSlot(_imp->slots[i]);
+    }
+
+    // Remove the files of the processes that did not close the index, their records refer to files that are gone
+    long long currentPID = ProcInfo::getCurrentProcessPID();
+    QStringList processDirectories = directory.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (QStringList::const_iterator it = processDirectories.begin(); it != processDirectories.end(); ++it) {
+        bool isPID = false;
+        long long pid = it->toLongLong(&isPID);
+        if ( isPID && ( (pid == currentPID) || !isProcessRunning(pid) ) ) {
+            QtCompat::removeRecursively( directory.absoluteFilePath(*it) );
+        }
+    }
+
+    QString processFilesPath = directoryName + QString::number(currentPID) + QLatin1Char('/');
+    if ( !QDir(processFilesPath).mkpath( QString::fromUtf8(".") ) ) {
+        close();
+        throw std::runtime_error("Failed to create the shared cache directory " + processFilesPath.toStdString());
+    }
+    _imp->processFilesPath = processFilesPath.toStdString();
+}
+
+void
+SharedCacheIndex::close()
+{
+    if ( !_imp->processFilesPath.empty() ) {
+        QtCompat::removeRecursively( QString::fromUtf8( _imp->processFilesPath.c_str() ) );
+        _imp->processFilesPath.clear();
+    }
+    _imp->file.reset();
+    _imp->slots = 0;
+    _imp->nSlots = 0;
+}
+
+bool
+SharedCacheIndex::isOpened() const
+{
+    return _imp->slots != 0;
+}
+
+const std::string&
+SharedCacheIndex::getProcessFilesPath() const
+{
+    return _imp->processFilesPath;
+}
+
+bool
+SharedCacheIndex::publish(U64 hash,
+                          const std::string& record)
+{
+    if ( !_imp->slots || record.empty() || (record.size() > NATRON_SHARED_CACHE_INDEX_RECORD_MAX_BYTES) ) {
+        return false;
+    }
+
+    SharedIndexSlot* freeSlot = 0;
+    int freeSlotSequence = 0;
+    for (int i = 0; i < NATRON_SHARED_CACHE_INDEX_MAX_PROBES; ++i) {
+        SharedIndexSlot& slot = _imp->getSlot(hash, i);
+        // The process that took the slot may have been killed since this process opened the index
+        _imp->reclaimSlot(slot);
+        std::string existing;
+        int sequence;
+        if ( _imp->readSlot(slot, hash, &existing, &sequence) ) {
+            if (existing == record) {
+                return true;
+            }
+        } else if ( !freeSlot && !(sequence & 1) && (slot.recordSize == 0) ) {
+            freeSlot = &slot;
+            freeSlotSequence = sequence;
+        }
+    }
+
+    // No free slot: replace the record of the slot the hash maps to
+    if (!freeSlot) {
+        freeSlot = &_imp->getSlot(hash, 0);
+        freeSlotSequence = getSequence(*freeSlot).fetchAndAddAcquire(0);
+        if (freeSlotSequence & 1) {
+            return false;
+        }
+    }
+
+    // Fails if another process modified the slot since it was read
+    if ( !_imp->beginSlotWrite(*freeSlot, freeSlotSequence) ) {
+        return false;
+    }
+    freeSlot->hash = hash;
+    freeSlot->recordSize = (U32)record.size();
+    std::memcpy( freeSlot->record, record.c_str(), record.size() );
+    _imp->endSlotWrite(*freeSlot, freeSlotSequence);
+
+    return true;
+}
+
+void
+SharedCacheIndex::unpublish(U64 hash,
+                            const std::string& record)
+{
+    if (!_imp->slots) {
+        return;
+    }
+    for (int i = 0; i < NATRON_SHARED_CACHE_INDEX_MAX_PROBES; ++i) {
+        SharedIndexSlot& slot = _imp->getSlot(hash, i);
+        std::string existing;
+        int sequence;
+        if ( !_imp->readSlot(slot, hash, &existing, &sequence) || (existing != record) ) {
+            continue;
+        }
+        // If the slot was modified meanwhile, the record was replaced
+        if ( _imp->beginSlotWrite(slot, sequence) ) {
+            slot.recordSize = 0;
+            slot.hash = 0;
+            _imp->endSlotWrite(slot, sequence);
+        }
+
+        return;
+    }
+}
+
+void
+SharedCacheIndex::lookup(U64 hash,
+                         std::list<std::string>* records) const
+{
+    if (!_imp->slots) {
+        return;
+    }
+    for (int i = 0; i < NATRON_SHARED_CACHE_INDEX_MAX_PROBES; ++i) {
+        std::string record;
+        int sequence;
+        if ( _imp->readSlot(_imp->getSlot(hash, i), hash, &record, &sequence) ) {
+            records->push_back(record);
+        }
+    }
+}
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,126 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef NATRON_ENGINE_SHAREDCACHEINDEX_H
+#define NATRON_ENGINE_SHAREDCACHEINDEX_H
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <list>
+#include <string>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Global/GlobalDefines.h"
+#include "Engine/EngineFwd.h"
+
+///Name of the index of the shared cache, located at the root of the shared cache directory
+#define NATRON_SHARED_CACHE_INDEX_FILE_NAME "shared." NATRON_CACHE_FILE_EXT
+
+///Number of records the shared index can hold
+#define NATRON_SHARED_CACHE_INDEX_SLOTS 8192
+
+///Maximum size of a record of the shared index, larger records are not shared
+#define NATRON_SHARED_CACHE_INDEX_RECORD_MAX_BYTES 2028
+
+///Number of slots examined from the slot a hash maps to
+#define NATRON_SHARED_CACHE_INDEX_MAX_PROBES 8
+
+NATRON_NAMESPACE_ENTER
+
+struct SharedCacheIndexPrivate;
+
+/**
+ * @brief An index of cache entries shared by all the processes on a host using the same cache directory, e.g: several
+ * NatronRenderer processes rendering different frame ranges of the same project.
+ * The index is a fixed-size hash table of records mapped in memory from a file by each process. It is lock-free:
+ * each slot carries a sequence number that a writer makes odd with an atomic compare-and-swap while it modifies the
+ * slot, so that readers detect and skip the slots modified while they were reading them. The writer also stores its
+ * PID in the slot before taking it. A record is an opaque string, it is up to the caller to check that a record
+ * found for a hash is really the one it is looking for.
+ * When all the slots a hash may use are taken, publishing a record replaces the record of another entry: this is
+ * a cache, records may disappear at any time.
+ * A slot left taken by a process killed while writing it is released, and its record dropped, by the next process
+ * opening the index or publishing a record in that slot.
+ * The shared directory contains the index file and one sub-directory per process, named after its pid, in which
+ * the process writes the files the records refer to. Directories of processes that are no longer running are
+ * removed when a process opens the index.
+ * This class is MT-safe once opened.
+ **/
+class SharedCacheIndex
+{
+public:
+
+    SharedCacheIndex();
+
+    ~SharedCacheIndex();
+
+    /**
+     * @brief Maps the index file of the given shared directory in memory, creating it if it does not exist or was
+     * written for another version of the cache, and creates an empty directory for the files of this process.
+     * This function might throw an exception upon failure to create or map the file.
+     **/
+    void open(const std::string& directoryPath, unsigned int cacheVersion);
+
+    /**
+     * @brief Unmaps the index and removes the directory of this process. The records of this process must have been
+     * unpublished before. No other function may be called concurrently.
+     **/
+    void close();
+
+    bool isOpened() const;
+
+    /**
+     * @brief Returns the directory in which this process writes the files its records refer to, with a trailing
+     * separator.
+     **/
+    const std::string& getProcessFilesPath() const;
+
+    /**
+     * @brief Inserts the record for the given hash, unless it is already in the index.
+     * @returns False if the record is too large or all the slots the hash may use are being written.
+     **/
+    bool publish(U64 hash, const std::string& record);
+
+    /**
+     * @brief Removes the record previously inserted for the given hash, if it is still in the index.
+     **/
+    void unpublish(U64 hash, const std::string& record);
+
+    /**
+     * @brief Appends to records all the records currently in the index for the given hash.
+     **/
+    void lookup(U64 hash, std::list<std::string>* records) const;
+
+private:
+
+    boost::scoped_ptr<SharedCacheIndexPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // NATRON_ENGINE_SHAREDCACHEINDEX_H
@@ -29,6 +29,7 @@
 #include <cassert>
 #include <stdexcept>
 
+#include "Engine/AppManager.h"
 #include "Engine/OfxClipInstance.h"
 #include "Engine/OfxHost.h"
 #include "Engine/OfxParamInstance.h"
@@ -120,7 +121,12 @@ AppTLS::softCopy(QThread* fromThread,
 void
 AppTLS::cleanupTLSForThread()
 {
-    QThread* curThread = QThread::currentThread();
+    cleanupTLSForThread( QThread::currentThread() );
+}
+
+void
+AppTLS::cleanupTLSForThread(QThread* curThread)
+{
     AbortableThread* isAbortableThread = dynamic_cast<AbortableThread*>(curThread);
 
     if (isAbortableThread) {
@@ -189,6 +195,76 @@ AppTLS::cleanupTLSForThread()
     }
 } // AppTLS::cleanupTLSForThread
 
+AppTLS::SnapshotThreads::~SnapshotThreads()
+{
+    assert(nUsed == 0);
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+        delete threads[i];
+    }
+}
+
+QThread*
+AppTLS::takeTLSSnapshot()
+{
+    if ( !_snapshotThreads.hasLocalData() ) {
+        _snapshotThreads.setLocalData(new SnapshotThreads);
+    }
+    SnapshotThreads* snapshots = _snapshotThreads.localData();
+
+    // Renders started while rendering with a snapshot (e.g. of the inputs) need their own
+    if ( snapshots->nUsed == snapshots->threads.size() ) {
+        snapshots->threads.push_back(new QThread);
+    }
+    QThread* snapshotThread = snapshots->threads[snapshots->nUsed];
+    ++snapshots->nUsed;
+    copyTLS(QThread::currentThread(), snapshotThread);
+
+    return snapshotThread;
+}
+
+void
+AppTLS::releaseTLSSnapshot(QThread* snapshotThread)
+{
+    assert( _snapshotThreads.hasLocalData() );
+    SnapshotThreads* snapshots = _snapshotThreads.localData();
+    assert(snapshots->nUsed > 0 && snapshots->threads[snapshots->nUsed - 1] == snapshotThread);
+    cleanupTLSForThread(snapshotThread);
+    --snapshots->nUsed;
+}
+
+TLSSnapshot::TLSSnapshot()
+    : _ownerThread( QThread::currentThread() )
+    , _snapshotThread( appPTR->getAppTLS()->takeTLSSnapshot() )
+    , _isRenderResponseToUserInteraction(false)
+    , _abortInfo()
+    , _abortTreeRoot()
+{
+    // The snapshot is not an AbortableThread: keep the abort info of the owner thread apart
+    AbortableThread* isAbortable = dynamic_cast<AbortableThread*>(_ownerThread);
+    if (isAbortable) {
+        isAbortable->getAbortInfo(&_isRenderResponseToUserInteraction, &_abortInfo, &_abortTreeRoot);
+    }
+}
+
+TLSSnapshot::~TLSSnapshot()
+{
+    assert(QThread::currentThread() == _ownerThread);
+    appPTR->getAppTLS()->releaseTLSSnapshot(_snapshotThread);
+}
+
+void
+TLSSnapshot::copyTo(QThread* toThread) const
+{
+    if (toThread == _ownerThread) {
+        return;
+    }
+    appPTR->getAppTLS()->copyTLS(_snapshotThread, toThread);
+    AbortableThread* isAbortable = dynamic_cast<AbortableThread*>(toThread);
+    if (isAbortable && _abortInfo) {
+        isAbortable->setAbortInfo(_isRenderResponseToUserInteraction, _abortInfo, _abortTreeRoot);
+    }
+}
+
 template class TLSHolder<EffectInstance::EffectTLSData>;
 template class TLSHolder<NATRON_NAMESPACE::OfxHost::OfxHostTLSData>;
 template class TLSHolder<KnobHelper::KnobTLSData>;
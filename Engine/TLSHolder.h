@@ -44,6 +44,7 @@
 
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QThread>
+#include <QtCore/QThreadStorage>
 
 #include "Engine/EngineFwd.h"
 
@@ -106,6 +107,21 @@ class AppTLS
     //<spawned thread, spawner thread>
     typedef std::map<const QThread*, const QThread*> ThreadSpawnMap;
 
+    // The thread objects holding the snapshots taken by a thread, reused by its next snapshots
+    struct SnapshotThreads
+    {
+        std::vector<QThread*> threads;
+        std::size_t nUsed;
+
+        SnapshotThreads()
+            : threads()
+            , nUsed(0)
+        {
+        }
+
+        ~SnapshotThreads();
+    };
+
 public:
 
     AppTLS();
@@ -150,6 +166,21 @@ public:
      **/
     void cleanupTLSForThread();
 
+    /**
+     * @brief Same as cleanupTLSForThread() for the given thread. This is used to cleanup the TLS copied
+     * onto a thread object that is never run, see takeTLSSnapshot()
+     **/
+    void cleanupTLSForThread(QThread* curThread);
+
+    /**
+     * @brief Copy the TLS of the current thread onto a thread object that is never run, so that other threads
+     * can copy it while the current thread keeps on modifying its own TLS. The thread objects are owned by the
+     * current thread and reused by its next snapshots: each call must be matched by a call to releaseTLSSnapshot()
+     * from the same thread, in reverse order. Use TLSSnapshot rather than calling these directly.
+     **/
+    QThread* takeTLSSnapshot();
+    void releaseTLSSnapshot(QThread* snapshotThread);
+
 private:
 
     template <typename T>
@@ -166,6 +197,48 @@ private:
     //of creating a new object and no longer mark it as spawned
     mutable QReadWriteLock _spawnsMutex;
     ThreadSpawnMap _spawns;
+
+    QThreadStorage<SnapshotThreads*> _snapshotThreads;
+};
+
+/**
+ * @brief A snapshot of the TLS and of the abort info of the thread that constructs it, taken
+ * before it starts rendering along with other threads, see EffectInstance::renderRoIInternal()
+ * and RenderTaskGraph::run(). It must be destroyed by the same thread.
+ **/
+class TLSSnapshot
+{
+public:
+
+    TLSSnapshot();
+
+    ~TLSSnapshot();
+
+    QThread* getOwnerThread() const
+    {
+        return _ownerThread;
+    }
+
+    AbortableRenderInfoPtr getAbortInfo() const
+    {
+        return _abortInfo;
+    }
+
+    /**
+     * @brief Copy the TLS and the abort info of the snapshot to the given thread
+     **/
+    void copyTo(QThread* toThread) const;
+
+private:
+
+    TLSSnapshot(const TLSSnapshot&);
+    TLSSnapshot& operator=(const TLSSnapshot&);
+
+    QThread* _ownerThread;
+    QThread* _snapshotThread;
+    bool _isRenderResponseToUserInteraction;
+    AbortableRenderInfoPtr _abortInfo;
+    EffectInstancePtr _abortTreeRoot;
 };
 
 
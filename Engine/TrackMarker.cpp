@@ -1139,6 +1139,7 @@ TrackMarker::getMarkerImage(int time,
     }
 
     AbortableRenderInfoPtr abortInfo = AbortableRenderInfo::create(false, 0);
+    abortInfo->setRenderPriority(eRenderPriorityPlayback);
     const bool isRenderUserInteraction = true;
     const bool isSequentialRender = false;
     AbortableThread* isAbortable = dynamic_cast<AbortableThread*>( QThread::currentThread() );
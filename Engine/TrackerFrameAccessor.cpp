@@ -357,6 +357,7 @@ TrackerFrameAccessor::GetImage(int /*clip*/,
     const bool isRenderUserInteraction = true;
     const bool isSequentialRender = false;
     AbortableRenderInfoPtr abortInfo = AbortableRenderInfo::create(false, 0);
+    abortInfo->setRenderPriority(eRenderPriorityPlayback);
     AbortableThread* isAbortable = dynamic_cast<AbortableThread*>( QThread::currentThread() );
     if (isAbortable) {
         isAbortable->setAbortInfo( isRenderUserInteraction, abortInfo, node->getEffectInstance() );
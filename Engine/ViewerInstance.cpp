@@ -31,6 +31,7 @@
 #include <cassert>
 #include <cstring> // for std::memcpy
 #include <cfloat> // DBL_MAX
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -54,6 +55,7 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/AppManager.h"
 #include "Engine/Cache.h"
 #include "Engine/Image.h"
+#include "Engine/ImageConvertSIMD.h"
 #include "Engine/Log.h"
 #include "Engine/Lut.h"
 #include "Engine/MemoryFile.h"
@@ -64,6 +66,7 @@ CLANG_DIAG_ON(deprecated)
 #include "Engine/OutputSchedulerThread.h"
 #include "Engine/Project.h"
 #include "Engine/RenderStats.h"
+#include "Engine/RenderTaskGraph.h"
 #include "Engine/RotoContext.h"
 #include "Engine/RotoPaint.h"
 #include "Engine/RotoStrokeItem.h"
@@ -822,6 +825,9 @@ ViewerInstance::getRenderViewerArgsAndCheckCache_public(SequenceTime time,
                                                         ViewerArgs* outArgs)
 {
     AbortableRenderInfoPtr abortInfo = _imp->createNewRenderRequest(textureIndex, canAbort);
+    if (isSequential) {
+        abortInfo->setRenderPriority(eRenderPriorityPlayback);
+    }
     ViewerRenderRetCode stat = getRenderViewerArgsAndCheckCache(time, isSequential, view, textureIndex, viewerHash, rotoPaintNode, abortInfo, stats, outArgs);
 
     if ( (stat == eViewerRenderRetCodeFail) || (stat == eViewerRenderRetCodeBlack) ) {
@@ -1436,6 +1442,11 @@ ViewerInstance::renderViewer_internal(ViewIdx view,
 
 
         frameArgs->updateNodesRequest(requestPassData);
+
+        if (!inArgs.forceRender) {
+            RenderTaskGraph taskGraph(requestPassData, inArgs.activeInputToRender->getNode(), inArgs.params->time, view, inArgs.params->mipMapLevel);
+            taskGraph.run();
+        }
     }
 
     const double par = inArgs.activeInputToRender->getAspectRatio(-1);
@@ -2044,7 +2055,7 @@ renderFunctor(const RectI& roi,
     }
 }
 
-inline
+template <typename PIX>
 MinMaxVal
 findAutoContrastVminVmax_generic(const ImagePtr inputImage,
                                  int nComps,
@@ -2056,7 +2067,7 @@ findAutoContrastVminVmax_generic(const ImagePtr inputImage,
     Image::ReadAccess acc = inputImage->getReadRights();
 
     for (int y = rect.bottom(); y < rect.top(); ++y) {
-        const float* src_pixels = (const float*)acc.pixelAt(rect.left(), y);
+        const PIX* src_pixels = (const PIX*)acc.pixelAt(rect.left(), y);
         ///we fill the scan-line with all the pixels of the input image
         for (int x = rect.left(); x < rect.right(); ++x) {
             double r = 0.;
@@ -2135,31 +2146,44 @@ findAutoContrastVminVmax_generic(const ImagePtr inputImage,
     return MinMaxVal(localVmin, localVmax);
 } // findAutoContrastVminVmax_generic
 
-template <int nComps>
+template <typename PIX, int nComps>
 MinMaxVal
 findAutoContrastVminVmax_internal(const ImagePtr inputImage,
                                   DisplayChannelsEnum channels,
                                   const RectI & rect)
 {
-    return findAutoContrastVminVmax_generic(inputImage, nComps, channels, rect);
+    return findAutoContrastVminVmax_generic<PIX>(inputImage, nComps, channels, rect);
 }
 
+template <typename PIX>
 MinMaxVal
-findAutoContrastVminVmax(const ImagePtr inputImage,
-                         DisplayChannelsEnum channels,
-                         const RectI & rect)
+findAutoContrastVminVmaxForDepth(const ImagePtr inputImage,
+                                 DisplayChannelsEnum channels,
+                                 const RectI & rect)
 {
     int nComps = inputImage->getComponents().getNumComponents();
 
     if (nComps == 4) {
-        return findAutoContrastVminVmax_internal<4>(inputImage, channels, rect);
+        return findAutoContrastVminVmax_internal<PIX, 4>(inputImage, channels, rect);
     } else if (nComps == 3) {
-        return findAutoContrastVminVmax_internal<3>(inputImage, channels, rect);
+        return findAutoContrastVminVmax_internal<PIX, 3>(inputImage, channels, rect);
     } else if (nComps == 1) {
-        return findAutoContrastVminVmax_internal<1>(inputImage, channels, rect);
+        return findAutoContrastVminVmax_internal<PIX, 1>(inputImage, channels, rect);
     } else {
-        return findAutoContrastVminVmax_generic(inputImage, nComps, channels, rect);
+        return findAutoContrastVminVmax_generic<PIX>(inputImage, nComps, channels, rect);
+    }
+}
+
+MinMaxVal
+findAutoContrastVminVmax(const ImagePtr inputImage,
+                         DisplayChannelsEnum channels,
+                         const RectI & rect)
+{
+    if (inputImage->getBitDepth() == eImageBitDepthHalf) {
+        return findAutoContrastVminVmaxForDepth<Half>(inputImage, channels, rect);
     }
+
+    return findAutoContrastVminVmaxForDepth<float>(inputImage, channels, rect);
 } // findAutoContrastVminVmax
 
 template <typename PIX, int maxValue, bool opaque, bool applyMatte, int rOffset, int gOffset, int bOffset>
@@ -2171,7 +2195,6 @@ scaleToTexture8bits_generic(const RectI& roi,
                             const UpdateViewerParams::CachedTile& tile,
                             U32* tileBuffer)
 {
-    const size_t pixelSize = sizeof(PIX);
     const bool luminance = (args.channels == eDisplayChannelsY);
     Image::ReadAccess acc = Image::ReadAccess( args.inputImage.get() );
     const RectI srcImgBounds = args.inputImage->getBounds();
@@ -2202,131 +2225,191 @@ scaleToTexture8bits_generic(const RectI& roi,
         matteAcc = boost::make_shared<Image::ReadAccess>( args.matteImage.get() );
     }
 
+    ///The pixels of a row are converted to linear RGB first, so that the colorspace lookups of the whole row are done
+    ///at once: only the error diffusion depends on the order of the pixels
+    const int width = x2 - x1;
+    std::vector<float> rgbRow(width * 3);
+    std::vector<unsigned short> uint8xxRow(args.colorSpace ? width * 3 : 0);
+    std::vector<U8> alphaRow(width);
+    std::vector<U8> matteRow(applyMatte ? width : 0);
+
     for (int y = y1; y < y2;
          ++y,
          dst_pixels += dstRowElements) {
         // coverity[dont_call]
-        int start = (int)( rand() % (x2 - x1) );
-
+        int start = (int)( rand() % width );
 
-        for (int backward = 0; backward < 2; ++backward) {
-            int index = backward ? start - 1 : start;
+        for (int index = 0; index < width; ++index) {
+            double r = 0.;
+            double g = 0.;
+            double b = 0.;
+            int uA = 0;
+            double a = 0;
+            if (nComps >= 4) {
+                r = (src_pixels ? (double)src_pixels[index * nComps + rOffset] : 0.);
+                g = (src_pixels ? (double)src_pixels[index * nComps + gOffset] : 0.);
+                b = (src_pixels ? (double)src_pixels[index * nComps + bOffset] : 0.);
+                if (opaque) {
+                    a = 1;
+                    uA = 255;
+                } else {
+                    a = src_pixels ? (double)src_pixels[index * nComps + 3] : 0;
+                    uA = Color::floatToInt<256>(a);
+                }
+            } else if (nComps == 3) {
+                // coverity[dead_error_line]
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[index * nComps + rOffset] : 0.;
+                // coverity[dead_error_line]
+                g = (src_pixels && gOffset < nComps) ? (double)src_pixels[index * nComps + gOffset] : 0.;
+                // coverity[dead_error_line]
+                b = (src_pixels && bOffset < nComps) ? (double)src_pixels[index * nComps + bOffset] : 0.;
+                a = (src_pixels ? 1 : 0);
+                uA = a * 255;
+            } else if (nComps == 2) {
+                // coverity[dead_error_line]
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[index * nComps + rOffset] : 0.;
+                // coverity[dead_error_line]
+                g = (src_pixels && gOffset < nComps) ? (double)src_pixels[index * nComps + gOffset] : 0.;
+                b = 0;
+                a = (src_pixels ? 1 : 0);
+                uA = a * 255;
+            } else if (nComps == 1) {
+                // coverity[dead_error_line]
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[index * nComps + rOffset] : 0.;
+                g = b = r;
+                a = (src_pixels ? 1 : 0);
+                uA = a * 255;
+            } else {
+                assert(false);
+            }
 
-            assert( backward == 1 || ( index >= 0 && index < (x2 - x1) ) );
 
-            unsigned error_r = 0x80;
-            unsigned error_g = 0x80;
-            unsigned error_b = 0x80;
-
-            while (index < (x2 - x1) && index >= 0) {
-                double r = 0.;
-                double g = 0.;
-                double b = 0.;
-                int uA = 0;
-                double a = 0;
-                if (nComps >= 4) {
-                    r = (src_pixels ? src_pixels[index * nComps + rOffset] : 0.);
-                    g = (src_pixels ? src_pixels[index * nComps + gOffset] : 0.);
-                    b = (src_pixels ? src_pixels[index * nComps + bOffset] : 0.);
-                    if (opaque) {
-                        a = 1;
-                        uA = 255;
-                    } else {
-                        a = src_pixels ? src_pixels[index * nComps + 3] : 0;
-                        uA = Color::floatToInt<256>(a);
-                    }
-                } else if (nComps == 3) {
-                    // coverity[dead_error_line]
-                    r = (src_pixels && rOffset < nComps) ? src_pixels[index * nComps + rOffset] : 0.;
-                    // coverity[dead_error_line]
-                    g = (src_pixels && gOffset < nComps) ? src_pixels[index * nComps + gOffset] : 0.;
-                    // coverity[dead_error_line]
-                    b = (src_pixels && bOffset < nComps) ? src_pixels[index * nComps + bOffset] : 0.;
-                    a = (src_pixels ? 1 : 0);
-                    uA = a * 255;
-                } else if (nComps == 2) {
-                    // coverity[dead_error_line]
-                    r = (src_pixels && rOffset < nComps) ? src_pixels[index * nComps + rOffset] : 0.;
-                    // coverity[dead_error_line]
-                    g = (src_pixels && gOffset < nComps) ? src_pixels[index * nComps + gOffset] : 0.;
-                    b = 0;
-                    a = (src_pixels ? 1 : 0);
-                    uA = a * 255;
-                } else if (nComps == 1) {
-                    // coverity[dead_error_line]
-                    r = (src_pixels && rOffset < nComps) ? src_pixels[index * nComps + rOffset] : 0.;
-                    g = b = r;
-                    a = (src_pixels ? 1 : 0);
-                    uA = a * 255;
+            switch (maxValue) {
+            case 255:     //byte
+                if (args.srcColorSpace) {
+                    r = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)r );
+                    g = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)g );
+                    b = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)b );
+                } else {
+                    r = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)r );
+                    g = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)g );
+                    b = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)b );
+                }
+                break;
+            case 65535:     //short
+                if (args.srcColorSpace) {
+                    r = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)r );
+                    g = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)g );
+                    b = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)b );
                 } else {
-                    assert(false);
+                    r = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned char)r );
+                    g = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned char)g );
+                    b = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned char)b );
                 }
+                break;
+            case 1:     //float or half
+                if (args.srcColorSpace) {
+                    r = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(r);
+                    g = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(g);
+                    b = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(b);
+                }
+                break;
+            default:
+                break;
+            }
 
+            r = r * args.gain + args.offset;
+            g = g * args.gain + args.offset;
+            b = b * args.gain + args.offset;
+            if  (args.gamma <= 0) {
+                r = (r < 1.) ? 0. : (r == 1. ? 1. : std::numeric_limits<double>::infinity() );
+                g = (g < 1.) ? 0. : (g == 1. ? 1. : std::numeric_limits<double>::infinity() );
+                b = (b < 1.) ? 0. : (b == 1. ? 1. : std::numeric_limits<double>::infinity() );
+            } else if (args.gamma != 1.) {
+                r = viewer->interpolateGammaLut(r);
+                g = viewer->interpolateGammaLut(g);
+                b = viewer->interpolateGammaLut(b);
+            }
 
-                switch (pixelSize) {
-                case sizeof(unsigned char):     //byte
-                    if (args.srcColorSpace) {
-                        r = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)r );
-                        g = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)g );
-                        b = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)b );
-                    } else {
-                        r = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)r );
-                        g = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)g );
-                        b = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)b );
-                    }
-                    break;
-                case sizeof(unsigned short):     //short
-                    if (args.srcColorSpace) {
-                        r = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)r );
-                        g = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)g );
-                        b = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)b );
-                    } else {
-                        r = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned char)r );
-                        g = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned char)g );
-                        b = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned char)b );
+
+            if (luminance) {
+                r = 0.299 * r + 0.587 * g + 0.114 * b;
+                g = r;
+                b = r;
+            }
+
+            rgbRow[index * 3] = r;
+            rgbRow[index * 3 + 1] = g;
+            rgbRow[index * 3 + 2] = b;
+            alphaRow[index] = uA;
+
+            if (applyMatte) {
+                double alphaMatteValue = 0;
+                if (args.matteImage == args.inputImage) {
+                    switch (args.alphaChannelIndex) {
+                    case 0:
+                        alphaMatteValue = r;
+                        break;
+                    case 1:
+                        alphaMatteValue = g;
+                        break;
+                    case 2:
+                        alphaMatteValue = b;
+                        break;
+                    case 3:
+                        alphaMatteValue = a;
+                        break;
+                    default:
+                        break;
                     }
-                    break;
-                case sizeof(float):     //float
-                    if (args.srcColorSpace) {
-                        r = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(r);
-                        g = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(g);
-                        b = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(b);
+                } else {
+                    const PIX* src_pixels = (const PIX*)matteAcc->pixelAt(x1 + index, y);
+                    if (src_pixels) {
+                        alphaMatteValue = (double)src_pixels[args.alphaChannelIndex];
+                        switch (maxValue) {
+                        case 255:     //byte
+                            alphaMatteValue = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)r );
+                            break;
+                        case 65535:     //short
+                            alphaMatteValue = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned short)r );
+                            break;
+                        default:
+                            break;
+                        }
                     }
-                    break;
-                default:
-                    break;
                 }
-
-                r = r * args.gain + args.offset;
-                g = g * args.gain + args.offset;
-                b = b * args.gain + args.offset;
-                if  (args.gamma <= 0) {
-                    r = (r < 1.) ? 0. : (r == 1. ? 1. : std::numeric_limits<double>::infinity() );
-                    g = (g < 1.) ? 0. : (g == 1. ? 1. : std::numeric_limits<double>::infinity() );
-                    b = (b < 1.) ? 0. : (b == 1. ? 1. : std::numeric_limits<double>::infinity() );
-                } else if (args.gamma != 1.) {
-                    r = viewer->interpolateGammaLut(r);
-                    g = viewer->interpolateGammaLut(g);
-                    b = viewer->interpolateGammaLut(b);
+                U8 matteA;
+                if (args.colorSpace) {
+                    matteA = args.colorSpace->toColorSpaceUint8FromLinearFloatFast(alphaMatteValue) / 2;
+                } else {
+                    matteA = Color::floatToInt<256>(alphaMatteValue) / 2;
                 }
+                matteRow[index] = matteA;
+            }
+        }
+        if (args.colorSpace) {
+            args.colorSpace->toColorSpaceUint8xxFromLinearFloatFast(&rgbRow[0], &uint8xxRow[0], width * 3);
+        }
 
+        for (int backward = 0; backward < 2; ++backward) {
+            int index = backward ? start - 1 : start;
 
-                if (luminance) {
-                    r = 0.299 * r + 0.587 * g + 0.114 * b;
-                    g = r;
-                    b = r;
-                }
+            assert( backward == 1 || ( index >= 0 && index < width ) );
 
+            unsigned error_r = 0x80;
+            unsigned error_g = 0x80;
+            unsigned error_b = 0x80;
 
+            while (index < width && index >= 0) {
                 U8 uR, uG, uB;
                 if (!args.colorSpace) {
-                    uR = Color::floatToInt<256>(r);
-                    uG = Color::floatToInt<256>(g);
-                    uB = Color::floatToInt<256>(b);
+                    uR = Color::floatToInt<256>(rgbRow[index * 3]);
+                    uG = Color::floatToInt<256>(rgbRow[index * 3 + 1]);
+                    uB = Color::floatToInt<256>(rgbRow[index * 3 + 2]);
                 } else {
-                    error_r = (error_r & 0xff) + args.colorSpace->toColorSpaceUint8xxFromLinearFloatFast(r);
-                    error_g = (error_g & 0xff) + args.colorSpace->toColorSpaceUint8xxFromLinearFloatFast(g);
-                    error_b = (error_b & 0xff) + args.colorSpace->toColorSpaceUint8xxFromLinearFloatFast(b);
+                    error_r = (error_r & 0xff) + uint8xxRow[index * 3];
+                    error_g = (error_g & 0xff) + uint8xxRow[index * 3 + 1];
+                    error_b = (error_b & 0xff) + uint8xxRow[index * 3 + 2];
                     assert(error_r < 0x10000 && error_g < 0x10000 && error_b < 0x10000);
                     uR = (U8)(error_r >> 8);
                     uG = (U8)(error_g >> 8);
@@ -2334,57 +2417,17 @@ scaleToTexture8bits_generic(const RectI& roi,
                 }
 
                 if (applyMatte) {
-                    double alphaMatteValue = 0;
-                    if (args.matteImage == args.inputImage) {
-                        switch (args.alphaChannelIndex) {
-                        case 0:
-                            alphaMatteValue = r;
-                            break;
-                        case 1:
-                            alphaMatteValue = g;
-                            break;
-                        case 2:
-                            alphaMatteValue = b;
-                            break;
-                        case 3:
-                            alphaMatteValue = a;
-                            break;
-                        default:
-                            break;
-                        }
-                    } else {
-                        const PIX* src_pixels = (const PIX*)matteAcc->pixelAt(x1 + index, y);
-                        if (src_pixels) {
-                            alphaMatteValue = (double)src_pixels[args.alphaChannelIndex];
-                            switch (pixelSize) {
-                            case sizeof(unsigned char):     //byte
-                                alphaMatteValue = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)r );
-                                break;
-                            case sizeof(unsigned short):     //short
-                                alphaMatteValue = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned short)r );
-                                break;
-                            default:
-                                break;
-                            }
-                        }
-                    }
-                    U8 matteA;
-                    if (args.colorSpace) {
-                        matteA = args.colorSpace->toColorSpaceUint8FromLinearFloatFast(alphaMatteValue) / 2;
-                    } else {
-                        matteA = Color::floatToInt<256>(alphaMatteValue) / 2;
-                    }
-                    uR = Image::clampIfInt<U8>( (double)uR + matteA );
+                    uR = Image::clampIfInt<U8>( (double)uR + matteRow[index] );
                 }
 
-                dst_pixels[index] = toBGRA(uR, uG, uB, uA);
+                dst_pixels[index] = toBGRA(uR, uG, uB, alphaRow[index]);
 
                 if (backward) {
                     --index;
                 } else {
                     ++index;
                 }
-            } // while (index < args.texRect.w && index >= 0) {
+            } // while (index < width && index >= 0) {
         } // for (int backward = 0; backward < 2; ++backward) {
         if (src_pixels) {
             src_pixels += srcRowElements;
@@ -2544,7 +2587,7 @@ scaleToTexture8bits(const RectI& roi,
         scaleToTexture8bitsForDepth<unsigned short, 65535>(roi, args, viewer, tile, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        scaleToTexture8bitsForDepth<Half, 1>(roi, args, viewer, tile, output);
         break;
     case eImageBitDepthNone:
         break;
@@ -2589,7 +2632,6 @@ scaleToTexture32bitsGeneric(const RectI& roi,
                             const UpdateViewerParams::CachedTile& tile,
                             float *tileBuffer)
 {
-    const size_t pixelSize = sizeof(PIX);
     const bool luminance = (args.channels == eDisplayChannelsY);
     const int dstRowElements = args.renderOnlyRoI ? tile.rect.width() * 4 : args.tileRowElements;
     Image::ReadAccess acc = Image::ReadAccess( args.inputImage.get() );
@@ -2613,7 +2655,7 @@ scaleToTexture32bitsGeneric(const RectI& roi,
     const int y2 = args.renderOnlyRoI ? roi.y2 : tile.rect.y2;
     const int x1 = args.renderOnlyRoI ? roi.x1 : tile.rect.x1;
     const int x2 = args.renderOnlyRoI ? roi.x2 : tile.rect.x2;
-    const float* src_pixels = (const float*)acc.pixelAt(x1, y1);
+    const PIX* src_pixels = (const PIX*)acc.pixelAt(x1, y1);
     const int srcRowElements = (const int)args.inputImage->getRowElements();
 
     for (int y = y1; y < y2;
@@ -2627,32 +2669,32 @@ scaleToTexture32bitsGeneric(const RectI& roi,
             double a = 0.;
 
             if (nComps >= 4) {
-                r = (src_pixels && rOffset < nComps) ? src_pixels[x * nComps + rOffset] : 0.;
-                g = (src_pixels && gOffset < nComps) ? src_pixels[x * nComps + gOffset] : 0.;
-                b = (src_pixels && bOffset < nComps) ? src_pixels[x * nComps + bOffset] : 0.;
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[x * nComps + rOffset] : 0.;
+                g = (src_pixels && gOffset < nComps) ? (double)src_pixels[x * nComps + gOffset] : 0.;
+                b = (src_pixels && bOffset < nComps) ? (double)src_pixels[x * nComps + bOffset] : 0.;
                 if (opaque) {
                     a = 1.;
                 } else {
-                    a = src_pixels ? src_pixels[x * nComps + 3] : 0.;
+                    a = src_pixels ? (double)src_pixels[x * nComps + 3] : 0.;
                 }
             } else if (nComps == 3) {
                 // coverity[dead_error_line]
-                r = (src_pixels && rOffset < nComps) ? src_pixels[x * nComps + rOffset] : 0.;
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[x * nComps + rOffset] : 0.;
                 // coverity[dead_error_line]
-                g = (src_pixels && gOffset < nComps) ? src_pixels[x * nComps + gOffset] : 0.;
+                g = (src_pixels && gOffset < nComps) ? (double)src_pixels[x * nComps + gOffset] : 0.;
                 // coverity[dead_error_line]
-                b = (src_pixels && bOffset < nComps) ? src_pixels[x * nComps + bOffset] : 0.;
+                b = (src_pixels && bOffset < nComps) ? (double)src_pixels[x * nComps + bOffset] : 0.;
                 a = 1.;
             } else if (nComps == 2) {
                 // coverity[dead_error_line]
-                r = (src_pixels && rOffset < nComps) ? src_pixels[x * nComps + rOffset] : 0.;
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[x * nComps + rOffset] : 0.;
                 // coverity[dead_error_line]
-                g = (src_pixels && gOffset < nComps) ? src_pixels[x * nComps + gOffset] : 0.;
+                g = (src_pixels && gOffset < nComps) ? (double)src_pixels[x * nComps + gOffset] : 0.;
                 b = 0.;
                 a = 1.;
             } else if (nComps == 1) {
                 // coverity[dead_error_line]
-                r = (src_pixels && rOffset < nComps) ? src_pixels[x * nComps + rOffset] : 0.;
+                r = (src_pixels && rOffset < nComps) ? (double)src_pixels[x * nComps + rOffset] : 0.;
                 g = b = r;
                 a = 1.;
             } else {
@@ -2660,8 +2702,8 @@ scaleToTexture32bitsGeneric(const RectI& roi,
             }
 
 
-            switch (pixelSize) {
-            case sizeof(unsigned char):
+            switch (maxValue) {
+            case 255:
                 if (args.srcColorSpace) {
                     r = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)r );
                     g = args.srcColorSpace->fromColorSpaceUint8ToLinearFloatFast( (unsigned char)g );
@@ -2672,7 +2714,7 @@ scaleToTexture32bitsGeneric(const RectI& roi,
                     b = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)b );
                 }
                 break;
-            case sizeof(unsigned short):
+            case 65535:
                 if (args.srcColorSpace) {
                     r = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)r );
                     g = args.srcColorSpace->fromColorSpaceUint16ToLinearFloatFast( (unsigned short)g );
@@ -2683,7 +2725,7 @@ scaleToTexture32bitsGeneric(const RectI& roi,
                     b = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned char)b );
                 }
                 break;
-            case sizeof(float):
+            case 1:
                 if (args.srcColorSpace) {
                     r = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(r);
                     g = args.srcColorSpace->fromColorSpaceFloatToLinearFloat(g);
@@ -2724,11 +2766,11 @@ scaleToTexture32bitsGeneric(const RectI& roi,
                     const PIX* src_pixels = (const PIX*)matteAcc->pixelAt(x, y);
                     if (src_pixels) {
                         alphaMatteValue = (double)src_pixels[args.alphaChannelIndex];
-                        switch (pixelSize) {
-                        case sizeof(unsigned char):     //byte
+                        switch (maxValue) {
+                        case 255:     //byte
                             alphaMatteValue = (double)Image::convertPixelDepth<unsigned char, float>( (unsigned char)r );
                             break;
-                        case sizeof(unsigned short):     //short
+                        case 65535:     //short
                             alphaMatteValue = (double)Image::convertPixelDepth<unsigned short, float>( (unsigned short)r );
                             break;
                         default:
@@ -2751,6 +2793,44 @@ scaleToTexture32bitsGeneric(const RectI& roi,
     }
 } // scaleToTexture32bitsGeneric
 
+/**
+ * @brief Same as scaleToTexture32bitsGeneric for RGBA half images displayed as they are: without input colorspace,
+ * luminance nor matte overlay, the rows just have to be converted to float, with F16C instructions if the CPU has them.
+ **/
+static void
+scaleToTexture32bitsHalfRGBA(const RectI& roi,
+                             const RenderViewerArgs & args,
+                             const UpdateViewerParams::CachedTile& tile,
+                             float *tileBuffer)
+{
+    const int dstRowElements = args.renderOnlyRoI ? tile.rect.width() * 4 : args.tileRowElements;
+    Image::ReadAccess acc = Image::ReadAccess( args.inputImage.get() );
+
+    assert(tile.rect.x2 > tile.rect.x1);
+
+    float* dst_pixels;
+    if (args.renderOnlyRoI) {
+        dst_pixels = tileBuffer + (roi.y1 - tile.rect.y1) * dstRowElements + (roi.x1 - tile.rect.x1) * 4;
+    } else {
+        dst_pixels = tileBuffer + (tile.rect.y1 - tile.rectRounded.y1) * dstRowElements + (tile.rect.x1 - tile.rectRounded.x1) * 4;
+    }
+
+    const int y1 = args.renderOnlyRoI ? roi.y1 : tile.rect.y1;
+    const int y2 = args.renderOnlyRoI ? roi.y2 : tile.rect.y2;
+    const int x1 = args.renderOnlyRoI ? roi.x1 : tile.rect.x1;
+    const int x2 = args.renderOnlyRoI ? roi.x2 : tile.rect.x2;
+    const int rowElements = (x2 - x1) * 4;
+
+    for (int y = y1; y < y2; ++y, dst_pixels += dstRowElements) {
+        const Half* src_pixels = (const Half*)acc.pixelAt(x1, y);
+        if (src_pixels) {
+            ImageConvertSIMD::halfToFloat(src_pixels, dst_pixels, rowElements);
+        } else {
+            std::fill(dst_pixels, dst_pixels + rowElements, 0.f);
+        }
+    }
+} // scaleToTexture32bitsHalfRGBA
+
 template <typename PIX, int maxValue, int nComps, bool opaque, bool applyMatte, int rOffset, int gOffset, int bOffset>
 void
 scaleToTexture32bitsInternal(const RectI& roi,
@@ -2758,6 +2838,12 @@ scaleToTexture32bitsInternal(const RectI& roi,
                              const UpdateViewerParams::CachedTile& tile,
                              float *output)
 {
+    if ( (maxValue == 1) && ( sizeof(PIX) == sizeof(Half) ) && (nComps == 4) && !opaque && !applyMatte &&
+         (rOffset == 0) && (gOffset == 1) && (bOffset == 2) && !args.srcColorSpace && (args.channels != eDisplayChannelsY) ) {
+        scaleToTexture32bitsHalfRGBA(roi, args, tile, output);
+
+        return;
+    }
     scaleToTexture32bitsGeneric<PIX, maxValue, opaque, applyMatte, rOffset, gOffset, bOffset>(roi, args, nComps, tile, output);
 }
 
@@ -2897,7 +2983,7 @@ scaleToTexture32bits(const RectI& roi,
         scaleToTexture32bitsForPremult<unsigned short, 65535>(roi, args, tile, output);
         break;
     case eImageBitDepthHalf:
-        assert(false);
+        scaleToTexture32bitsForPremult<Half, 1>(roi, args, tile, output);
         break;
     case eImageBitDepthNone:
         break;
@@ -3385,6 +3471,7 @@ void
 ViewerInstance::addSupportedBitDepth(std::list<ImageBitDepthEnum>* depths) const
 {
     depths->push_back(eImageBitDepthFloat);
+    depths->push_back(eImageBitDepthHalf);
     depths->push_back(eImageBitDepthShort);
     depths->push_back(eImageBitDepthByte);
 }
@@ -3539,9 +3626,10 @@ void
 ViewerInstance::reportStats(int time,
                             ViewIdx view,
                             double wallTime,
-                            const RenderStatsMap& stats)
+                            const RenderStatsMap& stats,
+                            const RenderTraceEventList& traceEvents)
 {
-    Q_EMIT renderStatsAvailable(time, view, wallTime, stats);
+    Q_EMIT renderStatsAvailable(time, view, wallTime, stats, traceEvents);
 }
 
 NATRON_NAMESPACE_EXIT
@@ -0,0 +1,531 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "WorkStealingScheduler.h"
+
+#include <cassert>
+#include <deque>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include "Engine/AbortableRenderInfo.h"
+#include "Engine/ThreadPool.h"
+
+// How long a render waits for the tasks of renders with a higher priority to start before checking again
+#define NATRON_RENDER_PRIORITY_YIELD_MS 10
+
+#define NATRON_RENDER_PRIORITY_COUNT ( (int)eRenderPriorityBackground + 1 )
+
+NATRON_NAMESPACE_ENTER
+
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// The tasks forked by one call to WorkStealingScheduler::run()
+struct TaskGroup
+{
+    QMutex mutex;
+    QWaitCondition finishedCond;
+    int pending; // tasks not finished yet
+    int skipped; // tasks skipped because the render was aborted
+    bool failed;
+    std::string error;
+    AbortableRenderInfoPtr abortInfo;
+    RenderPriorityEnum priority;
+
+    TaskGroup(int nTasks,
+              const AbortableRenderInfoPtr& abortInfo)
+        : mutex()
+        , finishedCond()
+        , pending(nTasks)
+        , skipped(0)
+        , failed(false)
+        , error()
+        , abortInfo(abortInfo)
+        , priority(abortInfo ? abortInfo->getRenderPriority() : eRenderPriorityInteractive)
+    {
+    }
+};
+
+typedef boost::shared_ptr<TaskGroup> TaskGroupPtr;
+
+struct QueuedTask
+{
+    WorkStealingScheduler::Task func;
+    TaskGroupPtr group;
+};
+
+struct TaskDeque
+{
+    QMutex mutex;
+    std::deque<QueuedTask> tasks;
+    int nRuns; // number of nested run() calls using this deque, for threads that are not workers
+
+    TaskDeque()
+        : mutex()
+        , tasks()
+        , nRuns(0)
+    {
+    }
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+
+class WorkStealingWorkerThread;
+
+struct WorkStealingSchedulerPrivate
+{
+    // All the deques tasks can be stolen from, either owned by a worker or by a thread calling run()
+    QMutex dequesMutex;
+    std::list<TaskDeque*> deques;
+    std::map<QThread*, TaskDeque*> externalDeques;
+
+    // Worker threads wait on idleCond while there is nothing to steal
+    QMutex idleMutex;
+    QWaitCondition idleCond;
+    bool quit;
+    QAtomicInt nQueuedTasks;
+    QAtomicInt maxWorkers;
+
+    // Queued and started tasks per priority, so that renders can yield to the ones with a higher priority
+    QAtomicInt nQueuedTasksPerPriority[NATRON_RENDER_PRIORITY_COUNT];
+    QAtomicInt nStartedTasksPerPriority[NATRON_RENDER_PRIORITY_COUNT];
+    QMutex yieldMutex;
+    QWaitCondition yieldCond;
+
+    QMutex workersMutex;
+    std::vector<WorkStealingWorkerThread*> workers;
+
+    WorkStealingSchedulerPrivate(int maxWorkers)
+        : dequesMutex()
+        , deques()
+        , externalDeques()
+        , idleMutex()
+        , idleCond()
+        , quit(false)
+        , nQueuedTasks(0)
+        , maxWorkers(maxWorkers)
+        , yieldMutex()
+        , yieldCond()
+        , workersMutex()
+        , workers()
+    {
+    }
+
+    void startWorkers();
+
+    TaskDeque* acquireDequeForCurrentThread();
+
+    void releaseDeque(TaskDeque* deque);
+
+    bool popOwnTask(TaskDeque* deque, const TaskGroupPtr& group, QueuedTask* task);
+
+    bool stealTask(QueuedTask* task);
+
+    void onTasksQueued(RenderPriorityEnum priority, int nTasks);
+
+    void onTaskDequeued(RenderPriorityEnum priority);
+
+    int getTasksCountWithHigherPriority(QAtomicInt* counts, RenderPriorityEnum priority);
+
+    void yieldToHigherPriorities(RenderPriorityEnum priority);
+
+    void executeTask(const QueuedTask& task);
+
+    void workerLoop(int index);
+};
+
+
+class WorkStealingWorkerThread
+    : public QThread
+      , public AbortableThread
+{
+public:
+
+    WorkStealingWorkerThread(WorkStealingSchedulerPrivate* scheduler,
+                             int index)
+        : QThread()
+        , AbortableThread(this)
+        , deque()
+        , _scheduler(scheduler)
+        , _index(index)
+    {
+        setThreadName("Render Worker (Work-Stealing)");
+    }
+
+    virtual ~WorkStealingWorkerThread() {}
+
+    TaskDeque deque;
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _scheduler->workerLoop(_index);
+    }
+
+    WorkStealingSchedulerPrivate* _scheduler;
+    int _index;
+};
+
+
+void
+WorkStealingSchedulerPrivate::startWorkers()
+{
+    int nWorkers = maxWorkers.fetchAndAddAcquire(0);
+    QMutexLocker k(&workersMutex);
+
+    while ( (int)workers.size() < nWorkers ) {
+        WorkStealingWorkerThread* thread = new WorkStealingWorkerThread(this, (int)workers.size());
+        {
+            QMutexLocker l(&dequesMutex);
+            deques.push_back(&thread->deque);
+        }
+        workers.push_back(thread);
+        thread->start();
+    }
+}
+
+TaskDeque*
+WorkStealingSchedulerPrivate::acquireDequeForCurrentThread()
+{
+    QThread* curThread = QThread::currentThread();
+
+    // The deque of a worker lives as long as the worker, but only the worker pushes to it
+    WorkStealingWorkerThread* isWorker = dynamic_cast<WorkStealingWorkerThread*>(curThread);
+    if (isWorker) {
+        return &isWorker->deque;
+    }
+
+    QMutexLocker k(&dequesMutex);
+    std::map<QThread*, TaskDeque*>::iterator found = externalDeques.find(curThread);
+    TaskDeque* ret;
+    if ( found != externalDeques.end() ) {
+        ret = found->second;
+    } else {
+        ret = new TaskDeque;
+        externalDeques.insert( std::make_pair(curThread, ret) );
+        deques.push_back(ret);
+    }
+    ++ret->nRuns;
+
+    return ret;
+}
+
+void
+WorkStealingSchedulerPrivate::releaseDeque(TaskDeque* deque)
+{
+    QThread* curThread = QThread::currentThread();
+
+    if ( dynamic_cast<WorkStealingWorkerThread*>(curThread) ) {
+        return;
+    }
+
+    QMutexLocker k(&dequesMutex);
+    assert(deque->nRuns > 0);
+    if (--deque->nRuns > 0) {
+        return;
+    }
+    assert( deque->tasks.empty() );
+    externalDeques.erase(curThread);
+    deques.remove(deque);
+    delete deque;
+}
+
+bool
+WorkStealingSchedulerPrivate::popOwnTask(TaskDeque* deque,
+                                         const TaskGroupPtr& group,
+                                         QueuedTask* task)
+{
+    // Tasks forked by nested runs are all finished when we get here, so the tasks of the group
+    // are the last ones of the deque, if they were not all stolen.
+    QMutexLocker k(&deque->mutex);
+
+    if ( deque->tasks.empty() || (deque->tasks.back().group != group) ) {
+        return false;
+    }
+    *task = deque->tasks.back();
+    deque->tasks.pop_back();
+    onTaskDequeued(group->priority);
+
+    return true;
+}
+
+bool
+WorkStealingSchedulerPrivate::stealTask(QueuedTask* task)
+{
+    QMutexLocker k(&dequesMutex);
+
+    for (;;) {
+        // Steal the oldest task of the render with the highest priority, it is the one most likely to fork more work
+        std::list<TaskDeque*>::iterator best = deques.end();
+        int bestPriority = NATRON_RENDER_PRIORITY_COUNT;
+        for (std::list<TaskDeque*>::iterator it = deques.begin(); it != deques.end() && bestPriority != eRenderPriorityInteractive; ++it) {
+            QMutexLocker l(&(*it)->mutex);
+            if ( !(*it)->tasks.empty() && ( (int)(*it)->tasks.front().group->priority < bestPriority ) ) {
+                best = it;
+                bestPriority = (int)(*it)->tasks.front().group->priority;
+            }
+        }
+        if ( best == deques.end() ) {
+            return false;
+        }
+
+        QMutexLocker l(&(*best)->mutex);
+        if ( (*best)->tasks.empty() ) {
+            // The owner popped it in the meantime
+            continue;
+        }
+        *task = (*best)->tasks.front();
+        (*best)->tasks.pop_front();
+        onTaskDequeued(task->group->priority);
+        // Move that deque to the end of the list so that the next steal starts from another thread
+        deques.splice( deques.end(), deques, best );
+
+        return true;
+    }
+}
+
+void
+WorkStealingSchedulerPrivate::onTasksQueued(RenderPriorityEnum priority,
+                                            int nTasks)
+{
+    nQueuedTasksPerPriority[priority].fetchAndAddRelease(nTasks);
+    nQueuedTasks.fetchAndAddRelease(nTasks);
+}
+
+void
+WorkStealingSchedulerPrivate::onTaskDequeued(RenderPriorityEnum priority)
+{
+    nQueuedTasks.fetchAndAddRelease(-1);
+    nStartedTasksPerPriority[priority].fetchAndAddRelease(1);
+    if ( (nQueuedTasksPerPriority[priority].fetchAndAddRelease(-1) == 1) && (priority != eRenderPriorityBackground) ) {
+        // No more tasks of this priority are waiting: renders with a lower priority may resume
+        QMutexLocker k(&yieldMutex);
+        yieldCond.wakeAll();
+    }
+}
+
+int
+WorkStealingSchedulerPrivate::getTasksCountWithHigherPriority(QAtomicInt* counts,
+                                                              RenderPriorityEnum priority)
+{
+    int ret = 0;
+
+    for (int i = 0; i < (int)priority; ++i) {
+        ret += counts[i].fetchAndAddAcquire(0);
+    }
+
+    return ret;
+}
+
+/*
+ * Preempts a render at a tile boundary while renders with a higher priority have tasks waiting for a thread.
+ * The calling thread cannot run these tasks itself since it is in the middle of a render, so it just leaves its core to them.
+ */
+void
+WorkStealingSchedulerPrivate::yieldToHigherPriorities(RenderPriorityEnum priority)
+{
+    while (getTasksCountWithHigherPriority(nQueuedTasksPerPriority, priority) > 0) {
+        int nStarted = getTasksCountWithHigherPriority(nStartedTasksPerPriority, priority);
+        {
+            QMutexLocker k(&yieldMutex);
+            yieldCond.wait(&yieldMutex, NATRON_RENDER_PRIORITY_YIELD_MS);
+        }
+        // If none of them started, they may be waiting on something held by this render: do not wait any longer
+        if (getTasksCountWithHigherPriority(nStartedTasksPerPriority, priority) == nStarted) {
+            return;
+        }
+    }
+}
+
+void
+WorkStealingSchedulerPrivate::executeTask(const QueuedTask& task)
+{
+    TaskGroup* group = task.group.get();
+    bool skip = group->abortInfo && group->abortInfo->isAborted();
+    bool failed = false;
+    std::string error;
+
+    if (!skip) {
+        try {
+            task.func();
+        } catch (const std::exception& e) {
+            failed = true;
+            error = e.what();
+        } catch (...) {
+            failed = true;
+            error = "Unknown exception in a render task";
+        }
+    }
+
+    QMutexLocker k(&group->mutex);
+    if (skip) {
+        ++group->skipped;
+    }
+    if (failed && !group->failed) {
+        group->failed = true;
+        group->error = error;
+    }
+    assert(group->pending > 0);
+    if (--group->pending == 0) {
+        group->finishedCond.wakeAll();
+    }
+}
+
+void
+WorkStealingSchedulerPrivate::workerLoop(int index)
+{
+    for (;;) {
+        QueuedTask task;
+        if ( ( index < maxWorkers.fetchAndAddAcquire(0) ) && stealTask(&task) ) {
+            executeTask(task);
+            continue;
+        }
+
+        QMutexLocker k(&idleMutex);
+        if (quit) {
+            return;
+        }
+        // Producers increment nQueuedTasks before taking idleMutex to wake us, so no wake-up can be missed
+        if ( ( index >= maxWorkers.fetchAndAddAcquire(0) ) || (nQueuedTasks.fetchAndAddAcquire(0) <= 0) ) {
+            idleCond.wait(&idleMutex);
+        }
+    }
+}
+
+WorkStealingScheduler::WorkStealingScheduler(int maxWorkers)
+    : _imp( new WorkStealingSchedulerPrivate(maxWorkers) )
+{
+}
+
+WorkStealingScheduler::~WorkStealingScheduler()
+{
+    {
+        QMutexLocker k(&_imp->idleMutex);
+        _imp->quit = true;
+        _imp->idleCond.wakeAll();
+    }
+
+    QMutexLocker k(&_imp->workersMutex);
+    for (std::size_t i = 0; i < _imp->workers.size(); ++i) {
+        _imp->workers[i]->wait();
+        delete _imp->workers[i];
+    }
+    _imp->workers.clear();
+}
+
+void
+WorkStealingScheduler::setMaxWorkerCount(int maxWorkers)
+{
+    _imp->maxWorkers.fetchAndStoreRelease(maxWorkers);
+
+    // Wake the workers that may now run tasks again
+    QMutexLocker k(&_imp->idleMutex);
+    _imp->idleCond.wakeAll();
+}
+
+int
+WorkStealingScheduler::getMaxWorkerCount() const
+{
+    return _imp->maxWorkers.fetchAndAddAcquire(0);
+}
+
+int
+WorkStealingScheduler::run(const std::vector<Task>& tasks,
+                           const AbortableRenderInfoPtr& abortInfo)
+{
+    if ( tasks.empty() ) {
+        return 0;
+    }
+
+    _imp->startWorkers();
+
+    TaskGroupPtr group( new TaskGroup( (int)tasks.size(), abortInfo ) );
+    TaskDeque* deque = _imp->acquireDequeForCurrentThread();
+
+    // Fork: tasks are pushed in reverse order so that the calling thread pops them in order
+    // and thieves take the last ones first.
+    {
+        QMutexLocker k(&deque->mutex);
+        for (std::vector<Task>::const_reverse_iterator it = tasks.rbegin(); it != tasks.rend(); ++it) {
+            QueuedTask t;
+            t.func = *it;
+            t.group = group;
+            deque->tasks.push_back(t);
+        }
+        _imp->onTasksQueued( group->priority, (int)tasks.size() );
+    }
+    {
+        QMutexLocker k(&_imp->idleMutex);
+        _imp->idleCond.wakeAll();
+    }
+
+    // Join: run our own tasks until they are all gone, then wait for the stolen ones
+    QueuedTask task;
+    for (;;) {
+        if (group->priority != eRenderPriorityInteractive) {
+            _imp->yieldToHigherPriorities(group->priority);
+        }
+        if ( !_imp->popOwnTask(deque, group, &task) ) {
+            break;
+        }
+        _imp->executeTask(task);
+    }
+    task = QueuedTask();
+
+    int skipped;
+    bool failed;
+    std::string error;
+    {
+        QMutexLocker k(&group->mutex);
+        while (group->pending > 0) {
+            group->finishedCond.wait(&group->mutex);
+        }
+        skipped = group->skipped;
+        failed = group->failed;
+        error = group->error;
+    }
+
+    _imp->releaseDeque(deque);
+
+    if (failed) {
+        throw std::runtime_error(error);
+    }
+
+    return skipped;
+} // WorkStealingScheduler::run
+
+NATRON_NAMESPACE_EXIT
@@ -0,0 +1,103 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+#ifndef Natron_Engine_WorkStealingScheduler_h
+#define Natron_Engine_WorkStealingScheduler_h
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+
+#if !defined(Q_MOC_RUN) && !defined(SBK_RUN)
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+#endif
+
+#include "Engine/EngineFwd.h"
+
+
+NATRON_NAMESPACE_ENTER
+
+
+/**
+ * @brief A fork/join scheduler for the tiles rendered with host frame threading.
+ *
+ * Each thread that forks tasks pushes them on its own deque. Idle worker threads steal tasks
+ * from the front of the deques of other threads, while the forking thread pops its own tasks
+ * from the back and runs them until none are left, then waits for the stolen ones.
+ * A thread that waits on a join only ever runs tasks of that join: tasks of unrelated renders
+ * would clobber its thread-local storage. Since every task only depends on the tasks it forked
+ * itself, nested renders can fork again from a worker thread without deadlocking, unlike
+ * QtConcurrent which has to run serially once the global thread pool is saturated.
+ *
+ * Worker threads are AbortableThread, so that the abort info copied along with the TLS of the
+ * forking thread is seen by EffectInstance::aborted().
+ *
+ * Idle workers steal the tasks of the render with the highest RenderPriorityEnum first. A render
+ * with a lower priority is preempted between two of its tasks while tasks of a higher priority are
+ * waiting for a thread, for as long as these keep starting.
+ **/
+struct WorkStealingSchedulerPrivate;
+class WorkStealingScheduler
+{
+public:
+
+    typedef boost::function<void ()> Task;
+
+    /**
+     * @brief Creates a scheduler with at most maxWorkers worker threads. The threads are only
+     * started the first time tasks are run.
+     **/
+    WorkStealingScheduler(int maxWorkers);
+
+    /**
+     * @brief Stops the worker threads, waiting for the tasks they are running to finish.
+     **/
+    ~WorkStealingScheduler();
+
+    /**
+     * @brief Sets the number of worker threads that may run tasks. With 0 workers, all tasks are
+     * run by the calling thread.
+     **/
+    void setMaxWorkerCount(int maxWorkers);
+
+    int getMaxWorkerCount() const;
+
+    /**
+     * @brief Runs all tasks and returns once they are finished. The calling thread runs tasks as well.
+     * If abortInfo is set and aborted, tasks that did not start yet are skipped.
+     * @returns The number of tasks that were skipped.
+     * Throws std::runtime_error if one of the tasks threw an exception.
+     **/
+    int run(const std::vector<Task>& tasks, const AbortableRenderInfoPtr& abortInfo);
+
+private:
+
+    boost::scoped_ptr<WorkStealingSchedulerPrivate> _imp;
+};
+
+NATRON_NAMESPACE_EXIT
+
+#endif // Natron_Engine_WorkStealingScheduler_h
@@ -481,6 +481,15 @@ enum PlaybackModeEnum
     ePlaybackModeOnce
 };
 
+///The priority class of a render, the render scheduler runs the tasks of the highest priority first
+enum RenderPriorityEnum
+{
+    eRenderPriorityInteractive = 0, ///renders in response to a user interaction
+    eRenderPriorityPlayback, ///viewer playback and tracking
+    eRenderPriorityPrefetch, ///frames prefetched ahead of playback
+    eRenderPriorityBackground, ///writers and previews
+};
+
 enum SchedulingPolicyEnum
 {
     eSchedulingPolicyFFA = 0, ///frames will be rendered concurrently without ordering (free for all)
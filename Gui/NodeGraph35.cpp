@@ -264,6 +264,11 @@ NodeGraph::updateCacheSizeText()
     quint64 diskSize = appPTR->getCachesTotalDiskSize();
     QString diskCacheSizeStr = QDirModelPrivate_size(diskSize);
     QString newText = tr("Memory cache: %1 / Disk cache: %2").arg(cacheSizeStr).arg(diskCacheSizeStr);
+    U64 hugePageRequestedBytes, hugePageBytes;
+    appPTR->getImageBuffersHugePagesStats(&hugePageRequestedBytes, &hugePageBytes);
+    if (hugePageRequestedBytes > 0) {
+        newText += tr(" / Huge pages: %1%").arg( (int)(hugePageBytes * 100 / hugePageRequestedBytes) );
+    }
     if (newText != oldText) {
         _imp->_cacheSizeText->setText(newText);
     }
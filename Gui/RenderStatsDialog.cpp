@@ -36,6 +36,10 @@
 #include <QItemSelectionModel>
 #include <QtCore/QRegExp>
 
+#include "Global/FStreamsSupport.h"
+#include "Global/QtCompat.h" // removeFileExtension
+
+#include "Engine/AppManager.h" // Dialogs
 #include "Engine/Node.h"
 #include "Engine/Timer.h"
 #include "Engine/Utils.h" // convertFromPlainText
@@ -46,6 +50,7 @@
 #include "Gui/Label.h"
 #include "Gui/LineEdit.h"
 #include "Gui/NodeGui.h"
+#include "Gui/SequenceFileDialog.h"
 #include "Gui/TableModelView.h"
 
 
@@ -704,7 +709,9 @@ struct RenderStatsDialogPrivate
     Label* totalTimeSpentDescLabel;
     Label* totalTimeSpentValueLabel;
     double totalSpentTime;
+    RenderTraceEventList traceEvents;
     Button* resetButton;
+    Button* exportTraceButton;
     QWidget* filterContainer;
     QHBoxLayout* filterLayout;
     Label* filtersLabel;
@@ -730,7 +737,9 @@ struct RenderStatsDialogPrivate
         , totalTimeSpentDescLabel(0)
         , totalTimeSpentValueLabel(0)
         , totalSpentTime(0)
+        , traceEvents()
         , resetButton(0)
+        , exportTraceButton(0)
         , filterContainer(0)
         , filterLayout(0)
         , filtersLabel(0)
@@ -816,6 +825,13 @@ RenderStatsDialog::RenderStatsDialog(Gui* gui)
     QObject::connect( _imp->resetButton, SIGNAL(clicked(bool)), this, SLOT(resetStats()) );
     _imp->globalInfosLayout->addWidget(_imp->resetButton);
 
+    _imp->exportTraceButton = new Button(tr("Export Trace..."), _imp->globalInfosContainer);
+    _imp->exportTraceButton->setToolTip( NATRON_NAMESPACE::convertFromPlainText(tr("Saves the timeline of the renders in the statistics to a JSON file "
+                                                                                   "in the Chrome trace event format, which can be opened in Perfetto "
+                                                                                   "or chrome://tracing to see what each render thread did."), NATRON_NAMESPACE::WhiteSpaceNormal) );
+    QObject::connect( _imp->exportTraceButton, SIGNAL(clicked(bool)), this, SLOT(exportTrace()) );
+    _imp->globalInfosLayout->addWidget(_imp->exportTraceButton);
+
     _imp->globalInfosLayout->addStretch();
 
     _imp->mainLayout->addWidget(_imp->globalInfosContainer);
@@ -973,18 +989,50 @@ RenderStatsDialog::resetStats()
     _imp->model->clearRows();
     _imp->totalTimeSpentValueLabel->setText( QString::fromUtf8("0.0 sec") );
     _imp->totalSpentTime = 0;
+    _imp->traceEvents.clear();
+}
+
+void
+RenderStatsDialog::exportTrace()
+{
+    std::vector<std::string> filters;
+
+    filters.push_back("json");
+    SequenceFileDialog dialog( this, filters, false, SequenceFileDialog::eFileDialogModeSave, std::string(), _imp->gui, false );
+    if ( !dialog.exec() ) {
+        return;
+    }
+    std::string filename = dialog.filesToSave();
+    QString filenameCpy( QString::fromUtf8( filename.c_str() ) );
+    QString ext = QtCompat::removeFileExtension(filenameCpy);
+    if ( ext != QString::fromUtf8("json") ) {
+        filename.append(".json");
+    }
+
+    FStreamsSupport::ofstream ofile;
+    FStreamsSupport::open(&ofile, filename);
+    if (!ofile) {
+        Dialogs::errorDialog( tr("Error").toStdString()
+                              , tr("Failed to open file ").toStdString() + filename, false );
+
+        return;
+    }
+    RenderStats::writeChromeTrace(_imp->traceEvents, ofile);
 }
 
 void
 RenderStatsDialog::addStats(int /*time*/,
                             ViewIdx /*view*/,
                             double wallTime,
-                            const std::map<NodePtr, NodeRenderStats >& stats)
+                            const std::map<NodePtr, NodeRenderStats >& stats,
+                            const RenderTraceEventList& traceEvents)
 {
     if ( !_imp->accumulateCheckbox->isChecked() ) {
         _imp->model->clearRows();
         _imp->totalSpentTime = 0;
+        _imp->traceEvents.clear();
     }
+    _imp->traceEvents.insert( _imp->traceEvents.end(), traceEvents.begin(), traceEvents.end() );
 
     _imp->totalSpentTime += wallTime;
     _imp->totalTimeSpentValueLabel->setText( Timer::printAsTime(_imp->totalSpentTime, false) );
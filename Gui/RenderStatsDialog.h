@@ -62,11 +62,12 @@ public:
 
     virtual ~RenderStatsDialog();
 
-    void addStats(int time, ViewIdx view, double wallTime, const std::map<NodePtr, NodeRenderStats >& stats);
+    void addStats(int time, ViewIdx view, double wallTime, const std::map<NodePtr, NodeRenderStats >& stats, const RenderTraceEventList& traceEvents);
 
 public Q_SLOTS:
 
     void resetStats();
+    void exportTrace();
     void refreshAdvancedColsVisibility();
     void onSelectionChanged(const QItemSelection &selected, const QItemSelection &deselected);
 
@@ -4541,6 +4541,12 @@ ViewerGL::getColorAtRect(const RectD &rect, // rectangle in canonical coordinate
                                                                    &rPix, &gPix, &bPix, &aPix);
                 break;
             case eImageBitDepthHalf:
+                gotval = getColorAtInternal<Half, 1>(image,
+                                                     xPixel, yPixel,
+                                                     forceLinear,
+                                                     srcColorSpace,
+                                                     dstColorSpace,
+                                                     &rPix, &gPix, &bPix, &aPix);
                 break;
             case eImageBitDepthFloat:
                 gotval = getColorAtInternal<float, 1>(image,
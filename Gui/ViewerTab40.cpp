@@ -1273,12 +1273,13 @@ void
 ViewerTab::onRenderStatsAvailable(int time,
                                   ViewIdx view,
                                   double wallTime,
-                                  const RenderStatsMap& stats)
+                                  const RenderStatsMap& stats,
+                                  const RenderTraceEventList& traceEvents)
 {
     assert( QThread::currentThread() == qApp->thread() );
     RenderStatsDialog* dialog = getGui()->getRenderStatsDialog();
     if (dialog) {
-        dialog->addStats(time, view, wallTime, stats);
+        dialog->addStats(time, view, wallTime, stats, traceEvents);
     }
 }
 
@@ -0,0 +1,81 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Engine/AdaptiveTileSplitter.h"
+#include "Engine/RectI.h"
+
+NATRON_NAMESPACE_USING
+
+// Until a plug-in was timed, rectangles are split in one tile per thread
+TEST(AdaptiveTileSplitter, Untimed) {
+    AdaptiveTileSplitter splitter;
+    RectI rect(0, 0, 1920, 1080);
+
+    EXPECT_EQ( 8, splitter.getTilesCount("untimed", rect, 8) );
+    EXPECT_EQ( 1, splitter.getTilesCount("untimed", rect, 1) );
+    EXPECT_EQ( 1, (int)splitter.splitRect("untimed", rect, 1).size() );
+}
+
+// A cheap effect is split in fewer tiles than there are threads
+TEST(AdaptiveTileSplitter, CheapEffect) {
+    AdaptiveTileSplitter splitter;
+    RectI rect(0, 0, 1920, 1080);
+
+    // 0.004s for the whole rectangle: only 2 tiles take longer than NATRON_TILE_MIN_RENDER_TIME
+    std::vector<RectI> tiles = splitter.splitRect("cheap", rect, 8);
+    std::vector<double> times(tiles.size(), 0.004 / tiles.size());
+    splitter.addRenderTimes("cheap", tiles, times);
+    EXPECT_EQ( 2, splitter.getTilesCount("cheap", rect, 8) );
+
+    // Too small to be worth splitting
+    EXPECT_EQ( 1, splitter.getTilesCount("cheap", RectI(0, 0, 100, 100), 8) );
+}
+
+// An expensive effect whose tiles take uneven times is split finer so that the tiles can be balanced across threads
+TEST(AdaptiveTileSplitter, UnbalancedEffect) {
+    AdaptiveTileSplitter splitter;
+    RectI rect(0, 0, 1920, 1080);
+    std::vector<RectI> tiles = splitter.splitRect("unbalanced", rect, 4);
+
+    ASSERT_EQ( 4, (int)tiles.size() );
+    std::vector<double> times(tiles.size(), 1.);
+    times[0] = 4.;
+    splitter.addRenderTimes("unbalanced", tiles, times);
+    EXPECT_EQ( 8, splitter.getTilesCount("unbalanced", rect, 4) );
+
+    // Balanced tiles slowly go back to fewer tiles
+    tiles = splitter.splitRect("unbalanced", rect, 4);
+    EXPECT_EQ( 8, (int)tiles.size() );
+    times.assign(tiles.size(), 1.);
+    splitter.addRenderTimes("unbalanced", tiles, times);
+    EXPECT_EQ( 8, splitter.getTilesCount("unbalanced", rect, 4) );
+    EXPECT_LT( splitter.getTilesCount("unbalanced", rect, 8), 16 );
+}
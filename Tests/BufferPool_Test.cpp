@@ -0,0 +1,178 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Engine/BufferPool.h"
+
+NATRON_NAMESPACE_USING
+
+static U64
+getIdleBytes()
+{
+    U64 reservedBytes, inUseBytes;
+
+    BufferPool::getMemoryStats(&reservedBytes, &inUseBytes);
+
+    return reservedBytes - inUseBytes;
+}
+
+TEST(BufferPool,
+     SizeClasses)
+{
+    // Small and huge buffers are not pooled
+    EXPECT_EQ( (std::size_t)100, BufferPool::getAllocationSize(100) );
+    EXPECT_EQ( (std::size_t)NATRON_BUFFER_POOL_MAX_BYTES + 1, BufferPool::getAllocationSize(NATRON_BUFFER_POOL_MAX_BYTES + 1) );
+
+    // Powers of 2 are size classes
+    for (std::size_t n = NATRON_BUFFER_POOL_MIN_BYTES; n <= NATRON_BUFFER_POOL_MAX_BYTES; n *= 2) {
+        EXPECT_EQ( n, BufferPool::getAllocationSize(n) );
+    }
+
+    // Sizes are rounded up to the next class, wasting at most 1/8th of the buffer
+    std::size_t previous = 0;
+    for (std::size_t n = NATRON_BUFFER_POOL_MIN_BYTES; n <= NATRON_BUFFER_POOL_MAX_BYTES; n += n / 37 + 1) {
+        std::size_t classBytes = BufferPool::getAllocationSize(n);
+        EXPECT_GE(classBytes, n);
+        EXPECT_LE(classBytes - n, n / 8);
+        EXPECT_GE(classBytes, previous);
+        // The class size maps to itself
+        EXPECT_EQ( classBytes, BufferPool::getAllocationSize(classBytes) );
+        previous = classBytes;
+    }
+    EXPECT_EQ( (std::size_t)NATRON_BUFFER_POOL_MIN_BYTES + NATRON_BUFFER_POOL_MIN_BYTES / 8, BufferPool::getAllocationSize(NATRON_BUFFER_POOL_MIN_BYTES + 1) );
+}
+
+TEST(BufferPool,
+     ReuseAndAccounting)
+{
+    BufferPool::releaseIdleMemory();
+    U64 reservedBefore, inUseBefore;
+    BufferPool::getMemoryStats(&reservedBefore, &inUseBefore);
+    EXPECT_EQ( (U64)0, getIdleBytes() );
+
+    std::size_t nBytes = 100000;
+    std::size_t classBytes = BufferPool::getAllocationSize(nBytes);
+    void* buffer = BufferPool::allocate(nBytes);
+    ASSERT_TRUE(buffer != 0);
+    std::memset(buffer, 1, nBytes);
+
+    U64 reservedBytes, inUseBytes;
+    BufferPool::getMemoryStats(&reservedBytes, &inUseBytes);
+    EXPECT_EQ(inUseBefore + classBytes, inUseBytes);
+
+    // A freed buffer is kept idle and reused for the same size class
+    BufferPool::deallocate(buffer, nBytes);
+    EXPECT_EQ( (U64)classBytes, getIdleBytes() );
+    void* reused = BufferPool::allocate(classBytes);
+    EXPECT_EQ(buffer, reused);
+    EXPECT_EQ( (U64)0, getIdleBytes() );
+    BufferPool::deallocate(reused, classBytes);
+
+    BufferPool::releaseIdleMemory();
+    BufferPool::getMemoryStats(&reservedBytes, &inUseBytes);
+    EXPECT_EQ(reservedBefore, reservedBytes);
+    EXPECT_EQ(inUseBefore, inUseBytes);
+}
+
+TEST(BufferPool,
+     ThreadCacheCountsInIdleBudget)
+{
+    BufferPool::releaseIdleMemory();
+
+    // Much less than what a thread cache may hold on its own
+    const U64 maximumIdleBytes = 1024 * 1024;
+    BufferPool::setMaximumIdleBytes(maximumIdleBytes);
+
+    const std::size_t nBytes = 65536;
+    std::vector<void*> buffers;
+    for (int i = 0; i < 64; ++i) {
+        buffers.push_back( BufferPool::allocate(nBytes) );
+    }
+    for (std::size_t i = 0; i < buffers.size(); ++i) {
+        BufferPool::deallocate(buffers[i], nBytes);
+    }
+    EXPECT_LE(getIdleBytes(), maximumIdleBytes);
+    EXPECT_GT( getIdleBytes(), (U64)0 );
+
+    // Moving the idle buffers of the thread to the global pool does not change the idle memory
+    U64 idleBytes = getIdleBytes();
+    BufferPool::flushThreadCache();
+    EXPECT_EQ( idleBytes, getIdleBytes() );
+
+    // Lowering the budget frees the idle buffers of the thread caches too
+    for (int i = 0; i < 8; ++i) {
+        buffers[i] = BufferPool::allocate(nBytes);
+    }
+    for (int i = 0; i < 8; ++i) {
+        BufferPool::deallocate(buffers[i], nBytes);
+    }
+    BufferPool::setMaximumIdleBytes(nBytes);
+    EXPECT_LE( getIdleBytes(), (U64)nBytes );
+
+    BufferPool::setMaximumIdleBytes(NATRON_BUFFER_POOL_THREAD_CACHE_BYTES * 4);
+    BufferPool::releaseIdleMemory();
+    EXPECT_EQ( (U64)0, getIdleBytes() );
+}
+
+TEST(BufferPool,
+     HugePages)
+{
+    const std::size_t nBytes = 4 * NATRON_BUFFER_POOL_HUGE_PAGE_BYTES;
+    U64 requestedBytes, hugePageBytes;
+
+    BufferPool::releaseIdleMemory();
+
+    // Large buffers come from malloc while huge pages are disabled
+    BufferPool::setHugePagesEnabled(false);
+    void* buffer = BufferPool::allocate(nBytes);
+    BufferPool::getHugePagesStats(&requestedBytes, &hugePageBytes);
+    EXPECT_EQ( (U64)0, requestedBytes );
+    BufferPool::deallocate(buffer, nBytes);
+
+    BufferPool::setHugePagesEnabled(true);
+    buffer = BufferPool::allocate(nBytes);
+    ASSERT_TRUE(buffer != 0);
+    std::memset(buffer, 1, nBytes);
+    BufferPool::getHugePagesStats(&requestedBytes, &hugePageBytes);
+#ifdef __NATRON_LINUX__
+    EXPECT_GE( requestedBytes, (U64)nBytes );
+    EXPECT_EQ( (std::size_t)0, (std::size_t)buffer % NATRON_BUFFER_POOL_HUGE_PAGE_BYTES );
+#endif
+    EXPECT_LE(hugePageBytes, requestedBytes);
+
+    // A buffer mapped with huge pages may be freed after they were disabled
+    BufferPool::setHugePagesEnabled(false);
+    BufferPool::deallocate(buffer, nBytes);
+    BufferPool::releaseIdleMemory();
+    BufferPool::getHugePagesStats(&requestedBytes, &hugePageBytes);
+    EXPECT_EQ( (U64)0, requestedBytes );
+    EXPECT_EQ( (U64)0, hugePageBytes );
+}
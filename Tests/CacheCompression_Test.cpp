@@ -0,0 +1,163 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Engine/CacheCompression.h"
+
+NATRON_NAMESPACE_USING
+
+// A 4-channel 32-bit float image with smooth gradients, as produced by most renders
+static std::vector<float>
+makeImageLikeData(int width,
+                  int height)
+{
+    std::vector<float> data(width * height * 4);
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            float* pix = &data[(y * width + x) * 4];
+            pix[0] = (float)x / width;
+            pix[1] = (float)y / height;
+            pix[2] = 0.5f;
+            pix[3] = 1.f;
+        }
+    }
+
+    return data;
+}
+
+static void
+checkRoundTrip(const void* data,
+               std::size_t nBytes,
+               std::size_t elementSize,
+               bool packHalfFloat)
+{
+    std::vector<unsigned char> compressed;
+
+    ASSERT_TRUE( CacheCompression::compress(data, nBytes, elementSize, packHalfFloat, &compressed) );
+    EXPECT_LE( compressed.size(), (std::size_t)(nBytes * NATRON_CACHE_COMPRESSION_MAX_RATIO) );
+
+    std::vector<unsigned char> decompressed(nBytes, 0xcd);
+    ASSERT_TRUE( CacheCompression::decompress(compressed, &decompressed[0], nBytes) );
+    EXPECT_EQ( 0, std::memcmp(data, &decompressed[0], nBytes) );
+}
+
+TEST(CacheCompression,
+     ImageRoundTrip)
+{
+    std::vector<float> data = makeImageLikeData(257, 131);
+
+    checkRoundTrip(&data[0], data.size() * sizeof(float), sizeof(float), false);
+}
+
+TEST(CacheCompression,
+     RepetitiveRoundTrip)
+{
+    // Overlapping matches: a short pattern repeated many times
+    std::vector<unsigned char> data(100000);
+
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        data[i] = (unsigned char)(i % 3);
+    }
+    checkRoundTrip(&data[0], data.size(), 1, false);
+
+    // Long runs of zeros, longer than what fits in a single length byte
+    std::vector<unsigned short> zeros(50000, 0);
+    zeros[12345] = 7;
+    checkRoundTrip(&zeros[0], zeros.size() * sizeof(unsigned short), sizeof(unsigned short), false);
+}
+
+TEST(CacheCompression,
+     RandomDataIsNotKept)
+{
+    srand(2000);
+    std::vector<unsigned char> data(65536);
+    for (std::size_t i = 0; i < data.size(); ++i) {
+        // coverity[dont_call]
+        data[i] = (unsigned char)(rand() & 0xff);
+    }
+
+    std::vector<unsigned char> compressed;
+    EXPECT_FALSE( CacheCompression::compress(&data[0], data.size(), 1, false, &compressed) );
+    EXPECT_TRUE( compressed.empty() );
+}
+
+TEST(CacheCompression,
+     HalfFloatRoundTrip)
+{
+    // All these values are exactly representable as 16-bit floats: they must be restored bit for bit
+    std::vector<float> data = makeImageLikeData(256, 64);
+    data[5] = -0.f;
+    data[6] = 65504.f;
+    data[7] = -2.f;
+    std::vector<unsigned char> compressed;
+    std::size_t nBytes = data.size() * sizeof(float);
+    ASSERT_TRUE( CacheCompression::compress(&data[0], nBytes, sizeof(float), true, &compressed) );
+
+    std::vector<unsigned char> compressedFull;
+    ASSERT_TRUE( CacheCompression::compress(&data[0], nBytes, sizeof(float), false, &compressedFull) );
+    EXPECT_LT( compressed.size(), compressedFull.size() ) << "Packing as 16-bit floats should give a smaller buffer";
+
+    std::vector<float> decompressed( data.size() );
+    ASSERT_TRUE( CacheCompression::decompress(compressed, &decompressed[0], nBytes) );
+    EXPECT_EQ( 0, std::memcmp(&data[0], &decompressed[0], nBytes) );
+}
+
+TEST(CacheCompression,
+     HalfFloatFallsBackWhenLossy)
+{
+    // 0.1 is not representable as a 16-bit float: the data must not be packed, and must still be restored exactly
+    std::vector<float> data = makeImageLikeData(128, 64);
+    data[0] = 0.1f;
+    checkRoundTrip(&data[0], data.size() * sizeof(float), sizeof(float), true);
+}
+
+TEST(CacheCompression,
+     CorruptedDataIsRejected)
+{
+    std::vector<float> data = makeImageLikeData(64, 64);
+    std::size_t nBytes = data.size() * sizeof(float);
+    std::vector<unsigned char> compressed;
+
+    ASSERT_TRUE( CacheCompression::compress(&data[0], nBytes, sizeof(float), false, &compressed) );
+
+    std::vector<float> decompressed( data.size() );
+    // Wrong size
+    EXPECT_FALSE( CacheCompression::decompress(compressed, &decompressed[0], nBytes - sizeof(float)) );
+
+    // Truncated
+    std::vector<unsigned char> truncated( compressed.begin(), compressed.begin() + compressed.size() / 2 );
+    EXPECT_FALSE( CacheCompression::decompress(truncated, &decompressed[0], nBytes) );
+
+    // Empty
+    EXPECT_FALSE( CacheCompression::decompress(std::vector<unsigned char>(), &decompressed[0], nBytes) );
+}
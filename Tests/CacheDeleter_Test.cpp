@@ -0,0 +1,288 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <iostream>
+#include <list>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QThread>
+
+#include "Engine/Cache.h"
+#include "Engine/Timer.h"
+
+// Benchmark of the hand-off of evicted entries to the DeleterThread of a cache, by as many threads as a render
+// may evict entries from
+
+#define DELETER_TEST_PRODUCERS 32
+#define DELETER_TEST_LISTS_PER_PRODUCER 2000
+#define DELETER_TEST_ENTRIES_PER_LIST 8
+
+NATRON_NAMESPACE_USING
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+QAtomicInt destroyedEntriesCount(0);
+
+class DeleterTestEntry
+{
+    std::vector<char> _data;
+
+public:
+
+    DeleterTestEntry()
+        : _data(256)
+    {
+    }
+
+    ~DeleterTestEntry()
+    {
+        destroyedEntriesCount.fetchAndAddRelaxed(1);
+    }
+
+    void scheduleForDestruction()
+    {
+    }
+
+    bool isStoredOnDisk() const
+    {
+        return false;
+    }
+
+    std::size_t size() const
+    {
+        return _data.size();
+    }
+};
+
+typedef boost::shared_ptr<DeleterTestEntry> DeleterTestEntryPtr;
+
+// Only the deleter thread notification is used by the test
+class DeleterTestCache
+    : public CacheAPI
+{
+public:
+
+    mutable QAtomicInt notificationsCount;
+
+    DeleterTestCache()
+        : notificationsCount(0)
+    {
+    }
+
+    virtual QString getCachePath() const OVERRIDE FINAL { return QString(); }
+
+    virtual bool isTileCache() const OVERRIDE FINAL { return false; }
+
+    virtual std::size_t getTileSizeBytes() const OVERRIDE FINAL { return 0; }
+
+    virtual void notifyEntrySizeChanged(U64 /*hash*/, size_t /*oldSize*/, size_t /*newSize*/) const OVERRIDE FINAL {}
+
+    virtual void notifyEntryAllocated(U64 /*hash*/, double /*time*/, size_t /*size*/, StorageModeEnum /*storage*/) const OVERRIDE FINAL {}
+
+    virtual void notifyEntryDestroyed(U64 /*hash*/, double /*time*/, size_t /*size*/, StorageModeEnum /*storage*/) const OVERRIDE FINAL {}
+
+    virtual void notifyMemoryDeallocated() const OVERRIDE FINAL
+    {
+        notificationsCount.fetchAndAddRelaxed(1);
+    }
+
+    virtual void backingFileClosed() const OVERRIDE FINAL {}
+
+    virtual void notifyEntryStorageChanged(U64 /*hash*/, StorageModeEnum /*oldStorage*/, StorageModeEnum /*newStorage*/,
+                                           double /*time*/, size_t /*size*/) const OVERRIDE FINAL {}
+
+    virtual void notifyEntryDataRemovedFromDisk(U64 /*hash*/, const std::string& /*filePath*/, std::size_t /*dataOffset*/) const OVERRIDE FINAL {}
+
+    virtual void notifyEntryCompressedSizeChanged(U64 /*hash*/, std::size_t /*oldCompressedSize*/, std::size_t /*newCompressedSize*/) const OVERRIDE FINAL {}
+
+    virtual void removeAllEntriesWithDifferentNodeHashForHolderPrivate(const std::string& /*holderID*/, U64 /*nodeHash*/, bool /*removeAll*/) OVERRIDE FINAL {}
+
+    virtual TileCacheFilePtr allocTile(std::size_t* /*dataOffset*/) OVERRIDE FINAL { return TileCacheFilePtr(); }
+
+    virtual TileCacheFilePtr getTileCacheFile(const std::string& /*filepath*/, std::size_t /*dataOffset*/) OVERRIDE FINAL { return TileCacheFilePtr(); }
+
+    virtual void freeTile(U64 /*hash*/, const TileCacheFilePtr& /*file*/, std::size_t /*dataOffset*/) OVERRIDE FINAL {}
+
+    virtual bool reserveEntryFilePath(const std::string& /*filePath*/) const OVERRIDE FINAL { return true; }
+
+    virtual void releaseEntryFilePath(const std::string& /*filePath*/) const OVERRIDE FINAL {}
+};
+
+class DeleterTestProducer
+    : public QThread
+{
+    DeleterThread<DeleterTestEntry>* _deleter;
+    int _nLists;
+
+public:
+
+    DeleterTestProducer(DeleterThread<DeleterTestEntry>* deleter,
+                        int nLists = DELETER_TEST_LISTS_PER_PRODUCER)
+        : QThread()
+        , _deleter(deleter)
+        , _nLists(nLists)
+    {
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        for (int i = 0; i < _nLists; ++i) {
+            std::list<DeleterTestEntryPtr> evicted;
+            for (int j = 0; j < DELETER_TEST_ENTRIES_PER_LIST; ++j) {
+                evicted.push_back( boost::make_shared<DeleterTestEntry>() );
+            }
+            _deleter->appendToQueue(evicted);
+        }
+    }
+};
+
+void
+runDeleterBenchmark(bool freeOnIdle)
+{
+    const int nEntries = DELETER_TEST_PRODUCERS * DELETER_TEST_LISTS_PER_PRODUCER * DELETER_TEST_ENTRIES_PER_LIST;
+    DeleterTestCache cache;
+    DeleterThread<DeleterTestEntry> deleter(&cache);
+
+    deleter.setFreeOnIdle(freeOnIdle);
+    destroyedEntriesCount.fetchAndStoreOrdered(0);
+
+    std::vector<DeleterTestProducer*> producers;
+    for (int i = 0; i < DELETER_TEST_PRODUCERS; ++i) {
+        producers.push_back( new DeleterTestProducer(&deleter) );
+    }
+
+    TimeLapse timer;
+    for (std::size_t i = 0; i < producers.size(); ++i) {
+        producers[i]->start();
+    }
+    for (std::size_t i = 0; i < producers.size(); ++i) {
+        producers[i]->wait();
+    }
+    double handOffSeconds = timer.getTimeSinceCreation();
+
+    while ( deleter.isWorking() ) {
+        QThread::yieldCurrentThread();
+    }
+    double totalSeconds = timer.getTimeSinceCreation();
+
+    deleter.quitThread();
+    for (std::size_t i = 0; i < producers.size(); ++i) {
+        delete producers[i];
+    }
+
+    EXPECT_EQ( nEntries, destroyedEntriesCount.fetchAndAddAcquire(0) ) << "All the entries handed off must be destroyed";
+    EXPECT_GT(cache.notificationsCount.fetchAndAddAcquire(0), 0);
+    // The cache is notified once per batch, not once per entry
+    EXPECT_LE(cache.notificationsCount.fetchAndAddAcquire(0), nEntries);
+    if (freeOnIdle) {
+        // Entries are collected until the batch is full while producers keep handing them off. A few batches
+        // may be destroyed early if the producers are not scheduled for NATRON_CACHE_DELETER_IDLE_MS.
+        EXPECT_LE(cache.notificationsCount.fetchAndAddAcquire(0), nEntries / NATRON_CACHE_DELETER_MAX_BATCH + DELETER_TEST_PRODUCERS);
+    }
+    EXPECT_EQ( (std::size_t)0, deleter.getPendingBytes() );
+
+    std::cout << "DeleterThread" << (freeOnIdle ? " (free on idle)" : "") << ": " << DELETER_TEST_PRODUCERS << " producers handed off "
+              << nEntries << " entries in " << handOffSeconds << " s (" << (nEntries / handOffSeconds) << " entries/s), all destroyed after "
+              << totalSeconds << " s (" << (nEntries / totalSeconds) << " entries/s), "
+              << cache.notificationsCount.fetchAndAddAcquire(0) << " notifications" << std::endl;
+}
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+TEST(CacheDeleter,
+     EvictionThroughput)
+{
+    runDeleterBenchmark(false);
+}
+
+TEST(CacheDeleter,
+     EvictionThroughputFreeOnIdle)
+{
+    runDeleterBenchmark(true);
+}
+
+TEST(CacheDeleter,
+     QuitWithPendingEntries)
+{
+    DeleterTestCache cache;
+    DeleterThread<DeleterTestEntry> deleter(&cache);
+
+    deleter.setFreeOnIdle(true);
+    destroyedEntriesCount.fetchAndStoreOrdered(0);
+
+    std::list<DeleterTestEntryPtr> evicted;
+    for (int i = 0; i < 10; ++i) {
+        evicted.push_back( boost::make_shared<DeleterTestEntry>() );
+    }
+    deleter.appendToQueue(evicted);
+    evicted.clear();
+
+    // The RAM held by the entries is known until they are destroyed
+    EXPECT_EQ( (std::size_t)10 * 1024, deleter.getPendingBytes() );
+
+    // Quitting destroys the entries held by the thread, even if the queue was not idle long enough
+    deleter.quitThread();
+    EXPECT_EQ( 10, destroyedEntriesCount.fetchAndAddAcquire(0) );
+    EXPECT_FALSE( deleter.isWorking() );
+    EXPECT_EQ( (std::size_t)0, deleter.getPendingBytes() );
+}
+
+TEST(CacheDeleter,
+     QuitWhileAppending)
+{
+    const int nLists = 200;
+    DeleterTestCache cache;
+    DeleterThread<DeleterTestEntry> deleter(&cache);
+
+    destroyedEntriesCount.fetchAndStoreOrdered(0);
+
+    std::vector<DeleterTestProducer*> producers;
+    for (int i = 0; i < 4; ++i) {
+        producers.push_back( new DeleterTestProducer(&deleter, nLists) );
+    }
+    for (std::size_t i = 0; i < producers.size(); ++i) {
+        producers[i]->start();
+    }
+
+    // Entries handed off while the thread quits must not be left in the queue with no thread to destroy them
+    while ( destroyedEntriesCount.fetchAndAddAcquire(0) < (int)producers.size() * nLists * DELETER_TEST_ENTRIES_PER_LIST / 2 ) {
+        deleter.quitThread();
+    }
+    for (std::size_t i = 0; i < producers.size(); ++i) {
+        producers[i]->wait();
+        delete producers[i];
+    }
+    deleter.quitThread();
+
+    EXPECT_EQ( 4 * nLists * DELETER_TEST_ENTRIES_PER_LIST, destroyedEntriesCount.fetchAndAddAcquire(0) );
+    EXPECT_FALSE( deleter.isWorking() );
+}
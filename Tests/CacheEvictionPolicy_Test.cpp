@@ -0,0 +1,175 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <gtest/gtest.h>
+
+#include "Engine/CacheEntry.h"
+#include "Engine/CacheEvictionPolicy.h"
+
+NATRON_NAMESPACE_USING
+
+class EvictionPolicyEntry
+    : public AbstractCacheEntryBase
+{
+    std::size_t _size;
+
+public:
+
+    EvictionPolicyEntry(std::size_t size)
+        : AbstractCacheEntryBase()
+        , _size(size)
+    {
+    }
+
+    virtual TileCacheFilePtr allocTile(std::size_t* /*dataOffset*/) OVERRIDE FINAL
+    {
+        return TileCacheFilePtr();
+    }
+
+    virtual void freeTile(const TileCacheFilePtr& /*file*/,
+                          std::size_t /*dataOffset*/) OVERRIDE FINAL
+    {
+    }
+
+    virtual TileCacheFilePtr getTileCacheFile(const std::string& /*filepath*/,
+                                              std::size_t /*dataOffset*/) OVERRIDE FINAL
+    {
+        return TileCacheFilePtr();
+    }
+
+    virtual std::size_t getCacheTileSizeBytes() const OVERRIDE FINAL
+    {
+        return 0;
+    }
+
+    virtual size_t size() const OVERRIDE FINAL
+    {
+        return _size;
+    }
+
+    virtual double getTime() const OVERRIDE FINAL
+    {
+        return 0.;
+    }
+
+    virtual U64 getElementsCountFromParams() const OVERRIDE FINAL
+    {
+        return _size;
+    }
+
+    virtual unsigned int getMipMapLevel() const OVERRIDE FINAL
+    {
+        return 0;
+    }
+
+    virtual void syncBackingFile() const OVERRIDE FINAL
+    {
+    }
+};
+
+static const std::size_t kMB = 1024 * 1024;
+
+TEST(CacheEvictionPolicy,
+     LRUScoring)
+{
+    // The least recently used entry is evicted, whatever its cost, size or access count
+    LRUCacheEvictionPolicy policy;
+
+    EXPECT_EQ(1, policy.getEvictionCandidatesCount());
+
+    EvictionPolicyEntry cheap(kMB), expensive(kMB);
+    expensive.addComputationCost(10.);
+    policy.onEntryAccessed(&expensive);
+    policy.onEntryAccessed(&expensive);
+    EXPECT_EQ( policy.getEvictionScore(&cheap), policy.getEvictionScore(&expensive) );
+}
+
+TEST(CacheEvictionPolicy,
+     CostAwareFrequencyScoring)
+{
+    // With the same cost and size, the score is proportional to the access count: the least frequently used entry
+    // is evicted first
+    CostAwareCacheEvictionPolicy policy;
+
+    EXPECT_GT(policy.getEvictionCandidatesCount(), 1);
+
+    EvictionPolicyEntry rare(kMB), frequent(kMB);
+    rare.addComputationCost(1.);
+    frequent.addComputationCost(1.);
+    policy.onEntryAccessed(&rare);
+    for (int i = 0; i < 5; ++i) {
+        policy.onEntryAccessed(&frequent);
+    }
+    EXPECT_DOUBLE_EQ( 1., policy.getEvictionScore(&rare) );
+    EXPECT_DOUBLE_EQ( 5., policy.getEvictionScore(&frequent) );
+}
+
+TEST(CacheEvictionPolicy,
+     CostAwareCostAndSizeScoring)
+{
+    CostAwareCacheEvictionPolicy policy;
+    EvictionPolicyEntry cheap(kMB), expensive(kMB), large(4 * kMB), unknownCost(kMB);
+
+    cheap.addComputationCost(0.01);
+    expensive.addComputationCost(1.);
+    large.addComputationCost(1.);
+    policy.onEntryAccessed(&cheap);
+    policy.onEntryAccessed(&expensive);
+    policy.onEntryAccessed(&large);
+    policy.onEntryAccessed(&unknownCost);
+
+    EXPECT_LT( policy.getEvictionScore(&cheap), policy.getEvictionScore(&expensive) );
+    EXPECT_DOUBLE_EQ( policy.getEvictionScore(&expensive) / 4., policy.getEvictionScore(&large) );
+    // Entries whose cost is not known yet get the minimum cost
+    EXPECT_DOUBLE_EQ( NATRON_CACHE_COST_AWARE_MIN_COST, policy.getEvictionScore(&unknownCost) );
+}
+
+TEST(CacheEvictionPolicy,
+     CostAwareClockAging)
+{
+    // Evicting an entry raises the clock to its score: entries accessed afterwards outlive expensive entries
+    // that are not accessed anymore
+    CostAwareCacheEvictionPolicy policy;
+    EvictionPolicyEntry old(kMB), evicted(kMB), recent(kMB);
+
+    old.addComputationCost(2.);
+    evicted.addComputationCost(3.);
+    recent.addComputationCost(0.01);
+    policy.onEntryAccessed(&old);
+    policy.onEntryAccessed(&evicted);
+    policy.onEntryEvicted(&evicted);
+    policy.onEntryAccessed(&recent);
+
+    EXPECT_DOUBLE_EQ( 3.01, policy.getEvictionScore(&recent) );
+    EXPECT_LT( policy.getEvictionScore(&old), policy.getEvictionScore(&recent) );
+
+    // Evicting an entry with a lower score does not move the clock backwards
+    policy.onEntryEvicted(&old);
+    EvictionPolicyEntry next(kMB);
+    policy.onEntryAccessed(&next);
+    EXPECT_DOUBLE_EQ( 3. + NATRON_CACHE_COST_AWARE_MIN_COST, policy.getEvictionScore(&next) );
+}
@@ -0,0 +1,185 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <gtest/gtest.h>
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+
+#include "Engine/CacheStatistics.h"
+
+NATRON_NAMESPACE_USING
+
+static CacheEvictionRecord
+makeRecord(int holderIndex,
+           unsigned int mipMapLevel,
+           CacheEvictionReasonEnum reason)
+{
+    CacheEvictionRecord ret;
+
+    ret.holderIndex = holderIndex;
+    ret.mipMapLevel = mipMapLevel;
+    ret.reason = reason;
+
+    return ret;
+}
+
+TEST(CacheStatistics,
+     HolderIndexIsStable)
+{
+    int blur = CacheStatistics::getHolderIndex("CacheStatistics_Test.Blur1");
+    int grade = CacheStatistics::getHolderIndex("CacheStatistics_Test.Grade1");
+
+    EXPECT_GE(blur, 0);
+    EXPECT_NE(blur, grade);
+    EXPECT_EQ( blur, CacheStatistics::getHolderIndex("CacheStatistics_Test.Blur1") );
+}
+
+TEST(CacheStatistics,
+     LookupsByMipMapLevel)
+{
+    CacheStatistics stats;
+    int holder = CacheStatistics::getHolderIndex("CacheStatistics_Test.Lookups");
+
+    stats.recordLookup(holder, 2, false);
+    stats.recordLookup(holder, 2, true);
+    stats.recordLookup(holder, 0, false);
+    // Unknown level: the hit is counted at the level of the entry returned, the miss is not broken down
+    stats.recordLookup(holder, -1, true);
+    stats.recordHit(1);
+    stats.recordLookup(holder, -1, false);
+
+    CacheStatisticsData data;
+    stats.accumulate(&data);
+    EXPECT_EQ(2U, data.totals.hits);
+    EXPECT_EQ(3U, data.totals.misses);
+    EXPECT_EQ(2U, data.holders["CacheStatistics_Test.Lookups"].hits);
+    EXPECT_EQ(3U, data.holders["CacheStatistics_Test.Lookups"].misses);
+    EXPECT_EQ(1U, data.mipMapLevels[0].misses);
+    EXPECT_EQ(1U, data.mipMapLevels[1].hits);
+    EXPECT_EQ(1U, data.mipMapLevels[2].hits);
+    EXPECT_EQ(1U, data.mipMapLevels[2].misses);
+}
+
+TEST(CacheStatistics,
+     EvictionsAndPruning)
+{
+    CacheStatistics stats;
+    int deleted = CacheStatistics::getHolderIndex("CacheStatistics_Test.Deleted");
+    int kept = CacheStatistics::getHolderIndex("CacheStatistics_Test.Kept");
+    CacheEvictionRecords evictions;
+
+    evictions.push_back( makeRecord(deleted, 0, eCacheEvictionReasonDestroyed) );
+    evictions.push_back( makeRecord(deleted, 1, eCacheEvictionReasonCompressed) );
+    evictions.push_back( makeRecord(kept, 1, eCacheEvictionReasonDestroyed) );
+    stats.recordInsert(deleted, 0);
+    stats.recordInsert(kept, 1);
+    stats.recordEvictions(evictions);
+
+    CacheStatisticsData data;
+    stats.accumulate(&data);
+    EXPECT_EQ(2U, data.totals.evictions[eCacheEvictionReasonDestroyed]);
+    EXPECT_EQ(1U, data.totals.evictions[eCacheEvictionReasonCompressed]);
+    EXPECT_EQ(1U, data.holders["CacheStatistics_Test.Deleted"].evictions[eCacheEvictionReasonDestroyed]);
+    EXPECT_EQ(1U, data.mipMapLevels[1].evictions[eCacheEvictionReasonCompressed]);
+    EXPECT_EQ(2U, data.holders.size());
+
+    // The counters of a removed holder are dropped, the totals are kept
+    stats.removeHolder(deleted);
+    CacheStatisticsData pruned;
+    stats.accumulate(&pruned);
+    EXPECT_EQ(1U, pruned.holders.size());
+    EXPECT_EQ(1U, pruned.holders.count("CacheStatistics_Test.Kept"));
+    EXPECT_EQ(2U, pruned.totals.inserts);
+
+    stats.reset();
+    CacheStatisticsData empty;
+    stats.accumulate(&empty);
+    EXPECT_TRUE( empty.holders.empty() );
+    EXPECT_TRUE( empty.totals.isNull() );
+}
+
+class HoldMutexThread
+    : public QThread
+{
+public:
+
+    HoldMutexThread(QMutex* mutex)
+        : _mutex(mutex)
+        , _locked()
+    {
+    }
+
+    bool isHoldingMutex() const
+    {
+        return (int)_locked == 1;
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        _mutex->lock();
+        _locked.fetchAndStoreOrdered(1);
+        QThread::msleep(50);
+        _mutex->unlock();
+    }
+
+    QMutex* _mutex;
+    QAtomicInt _locked;
+};
+
+TEST(CacheStatistics,
+     LockWaitIsMeasured)
+{
+    CacheStatistics stats;
+    QMutex mutex;
+
+    {
+        // Uncontended: nothing is recorded
+        CacheStatisticsMutexLocker locker(&mutex, &stats);
+    }
+    CacheStatisticsData uncontended;
+    stats.accumulate(&uncontended);
+    EXPECT_EQ(0., uncontended.lockWaitSeconds);
+
+    HoldMutexThread thread(&mutex);
+    thread.start();
+    while ( !thread.isHoldingMutex() ) {
+        QThread::msleep(1);
+    }
+    {
+        CacheStatisticsMutexLocker locker(&mutex, &stats);
+        locker.unlock();
+    }
+    thread.wait();
+
+    CacheStatisticsData contended;
+    stats.accumulate(&contended);
+    EXPECT_GT(contended.lockWaitSeconds, 0.02);
+}
@@ -0,0 +1,160 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <gtest/gtest.h>
+
+#include <QtCore/QAtomicInt>
+
+#include "Engine/Cache.h"
+
+NATRON_NAMESPACE_USING
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+struct WriteBehindTestEntry
+{
+    // Number of times processWriteBehindEntry() has to report the entry in use before it is released
+    QAtomicInt inUseCount;
+
+    WriteBehindTestEntry()
+        : inUseCount(0)
+    {
+    }
+};
+
+typedef boost::shared_ptr<WriteBehindTestEntry> WriteBehindTestEntryPtr;
+
+// Stands for the cache owning the queue, see Cache::processWriteBehindEntry()
+class WriteBehindTestCache
+{
+public:
+
+    mutable QAtomicInt writesCount;
+    mutable QAtomicInt processedCount;
+    mutable QAtomicInt publishedCount;
+
+    WriteBehindTestCache()
+        : writesCount(0)
+        , processedCount(0)
+        , publishedCount(0)
+    {
+    }
+
+    bool processWriteBehindEntry(const WriteBehindTestEntryPtr& entry,
+                                 bool* written) const
+    {
+        processedCount.fetchAndAddRelaxed(1);
+        if (!*written) {
+            writesCount.fetchAndAddRelaxed(1);
+            *written = true;
+        }
+
+        return entry->inUseCount.fetchAndAddRelaxed(-1) <= 0;
+    }
+
+    void writeSharedEntry(const WriteBehindTestEntryPtr& /*entry*/) const
+    {
+        publishedCount.fetchAndAddRelaxed(1);
+    }
+};
+
+typedef CacheWriteBehindQueue<WriteBehindTestEntry, WriteBehindTestCache> WriteBehindTestQueue;
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+TEST(CacheWriteBehind,
+     QueueIsBounded)
+{
+    WriteBehindTestCache cache;
+    WriteBehindTestQueue queue(&cache);
+
+    queue.setMaximumQueuedBytes(1000);
+
+    // Keep the entries in use so that the queue does not drain during the test
+    std::vector<WriteBehindTestEntryPtr> entries;
+    for (int i = 0; i < 4; ++i) {
+        entries.push_back( boost::make_shared<WriteBehindTestEntry>() );
+        entries.back()->inUseCount = 1000000;
+    }
+
+    // An entry larger than the queue is accepted when nothing else is waiting
+    EXPECT_TRUE( queue.appendToQueue(entries[0], 2000) );
+    EXPECT_FALSE( queue.appendToQueue(entries[1], 10) );
+    EXPECT_EQ( (U64)1, queue.getDroppedEntriesCount() );
+
+    queue.setMaximumQueuedBytes(3000);
+    EXPECT_TRUE( queue.appendToQueue(entries[1], 500) );
+    EXPECT_FALSE( queue.appendToQueue(entries[2], 600) );
+    EXPECT_EQ( (U64)2, queue.getDroppedEntriesCount() );
+    EXPECT_EQ( (std::size_t)2500, queue.getQueuedBytes() );
+
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        entries[i]->inUseCount = 0;
+    }
+    queue.waitForIdle();
+    EXPECT_EQ( (std::size_t)0, queue.getQueuedBytes() );
+    queue.quitThreads();
+
+    // Entries are refused once the threads were asked to quit, without counting them as dropped
+    EXPECT_FALSE( queue.appendToQueue(entries[3], 10) );
+    EXPECT_EQ( (U64)2, queue.getDroppedEntriesCount() );
+}
+
+TEST(CacheWriteBehind,
+     EntryInUseIsWrittenOnce)
+{
+    WriteBehindTestCache cache;
+    WriteBehindTestQueue queue(&cache);
+
+    // The entry is reported in use a few times before being released: it must only be written once
+    WriteBehindTestEntryPtr entry = boost::make_shared<WriteBehindTestEntry>();
+    entry->inUseCount = 3;
+    ASSERT_TRUE( queue.appendToQueue(entry, 100) );
+    queue.waitForIdle();
+
+    EXPECT_EQ( 4, (int)cache.processedCount );
+    EXPECT_EQ( 1, (int)cache.writesCount );
+    EXPECT_EQ( (std::size_t)0, queue.getQueuedBytes() );
+    queue.quitThreads();
+}
+
+TEST(CacheWriteBehind,
+     PublishedEntryIsNotWrittenBack)
+{
+    WriteBehindTestCache cache;
+    WriteBehindTestQueue queue(&cache);
+
+    // Entries published to the other processes are copied by the write-behind threads, not written to their own file
+    WriteBehindTestEntryPtr entry = boost::make_shared<WriteBehindTestEntry>();
+    ASSERT_TRUE( queue.appendToQueue(entry, 100, true) );
+    queue.waitForIdle();
+
+    EXPECT_EQ( 1, (int)cache.publishedCount );
+    EXPECT_EQ( 0, (int)cache.processedCount );
+    EXPECT_EQ( (std::size_t)0, queue.getQueuedBytes() );
+    queue.quitThreads();
+}
@@ -0,0 +1,348 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "Engine/CPUFeatures.h"
+#include "Engine/Half.h"
+#include "Engine/ImageConvertSIMD.h"
+#include "Engine/ImageMipMapSIMD.h"
+#include "Engine/Lut.h"
+#include "Engine/Timer.h"
+
+NATRON_NAMESPACE_USING
+using namespace NATRON_NAMESPACE::Color;
+
+namespace {
+// Mostly values in [0,1], with values out of range and exact 0, 1 and byte values
+float
+randomSample()
+{
+    switch (std::rand() % 8) {
+    case 0:
+        return -1.f + 3.f * std::rand() / RAND_MAX;
+    case 1:
+        return intToFloat<256>(std::rand() % 256);
+    case 2:
+        return (std::rand() % 2) ? 0.f : 1.f;
+    default:
+        return (float)std::rand() / RAND_MAX;
+    }
+}
+
+std::vector<float>
+randomRgbaRow(int nPixels)
+{
+    std::vector<float> row(nPixels * 4);
+
+    for (std::size_t i = 0; i < row.size(); ++i) {
+        row[i] = randomSample();
+    }
+    // Transparent pixels, for the unpremult
+    for (int i = 0; i < nPixels; i += 5) {
+        row[i * 4 + 3] = (i % 2) ? -0.f : 0.f;
+    }
+
+    return row;
+}
+
+// Runs the test with the scalar code and every supported instruction set, restores the default one
+class SIMDInstructionSetsTest
+    : public ::testing::Test
+{
+protected:
+    virtual void TearDown()
+    {
+        CPUFeatures::setSIMDInstructionSet( CPUFeatures::getSupportedSIMDInstructionSet() );
+    }
+
+    static int getInstructionSetsCount()
+    {
+        return (int)CPUFeatures::getSupportedSIMDInstructionSet() + 1;
+    }
+};
+
+// Row sizes covering empty rows, rows shorter than a register and remainders
+const int rowSizes[] = {
+    0, 1, 3, 4, 7, 8, 15, 16, 17, 31, 33, 100, 257
+};
+const int rowSizesCount = sizeof(rowSizes) / sizeof(rowSizes[0]);
+}
+
+TEST_F(SIMDInstructionSetsTest, DepthConversions) {
+    for (int i = 0; i < rowSizesCount; ++i) {
+        int count = rowSizes[i] * 4;
+        std::vector<float> src = randomRgbaRow(rowSizes[i]);
+        std::vector<unsigned char> bytes(count);
+        std::vector<unsigned short> shorts(count);
+        for (int j = 0; j < count; ++j) {
+            bytes[j] = (unsigned char)(std::rand() % 256);
+            shorts[j] = (unsigned short)(std::rand() % 65536);
+        }
+        for (int set = 0; set < getInstructionSetsCount(); ++set) {
+            CPUFeatures::setSIMDInstructionSet( (SIMDInstructionSetEnum)set );
+            // one more element to check that nothing is written past the end
+            std::vector<unsigned short> dstShorts(count + 1, 42);
+            ImageConvertSIMD::floatToUint16(src.empty() ? 0 : &src[0], &dstShorts[0], count, 65535);
+            for (int j = 0; j < count; ++j) {
+                EXPECT_EQ( floatToInt<65536>(src[j]), dstShorts[j] );
+            }
+            EXPECT_EQ(42, dstShorts[count]);
+            ImageConvertSIMD::floatToUint16(src.empty() ? 0 : &src[0], &dstShorts[0], count, 0xff00);
+            for (int j = 0; j < count; ++j) {
+                EXPECT_EQ( floatToInt<0xff01>(src[j]), dstShorts[j] );
+            }
+
+            std::vector<unsigned char> dstBytes(count + 1, 42);
+            ImageConvertSIMD::floatToByte(src.empty() ? 0 : &src[0], &dstBytes[0], count);
+            for (int j = 0; j < count; ++j) {
+                EXPECT_EQ( floatToInt<256>(src[j]), dstBytes[j] );
+            }
+            EXPECT_EQ(42, dstBytes[count]);
+
+            std::vector<float> dstFloats(count + 1, 42.f);
+            ImageConvertSIMD::byteToFloat(bytes.empty() ? 0 : &bytes[0], &dstFloats[0], count);
+            for (int j = 0; j < count; ++j) {
+                EXPECT_EQ( intToFloat<256>(bytes[j]), dstFloats[j] );
+            }
+            EXPECT_EQ(42.f, dstFloats[count]);
+            ImageConvertSIMD::shortToFloat(shorts.empty() ? 0 : &shorts[0], &dstFloats[0], count);
+            for (int j = 0; j < count; ++j) {
+                EXPECT_EQ( intToFloat<65536>(shorts[j]), dstFloats[j] );
+            }
+            EXPECT_EQ(42.f, dstFloats[count]);
+        }
+    }
+}
+
+TEST(HalfTest, Conversions) {
+    EXPECT_EQ( 0x0000, Half(0.f).bits() );
+    EXPECT_EQ( 0x8000, Half(-0.f).bits() );
+    EXPECT_EQ( 0x3c00, Half(1.f).bits() );
+    EXPECT_EQ( 0xc000, Half(-2.f).bits() );
+    EXPECT_EQ( 0x3555, Half(1.f / 3.f).bits() );
+    EXPECT_EQ( 0x7bff, Half(65504.f).bits() );
+    // 65520 is halfway between the largest half and infinity
+    EXPECT_EQ( 0x7bff, Half(65519.f).bits() );
+    EXPECT_EQ( 0x7c00, Half(65520.f).bits() );
+    EXPECT_EQ( 0x0400, Half(1.f / 16384.f).bits() );
+    // denormals, ties round to even
+    EXPECT_EQ( 0x0001, Half(1.f / 16777216.f).bits() );
+    EXPECT_EQ( 0x0000, Half(1.f / 33554432.f).bits() );
+    EXPECT_EQ( 0x0002, Half(3.f / 33554432.f).bits() );
+    // 1 + 2^-11 is halfway between 1 and the next half
+    EXPECT_EQ( 0x3c00, Half(1.f + 1.f / 2048.f).bits() );
+    EXPECT_EQ( 0x3c02, Half(1.f + 3.f / 2048.f).bits() );
+    EXPECT_TRUE( Half( std::numeric_limits<float>::quiet_NaN() ).isNan() );
+    EXPECT_EQ( 0x7c00, Half( std::numeric_limits<float>::infinity() ).bits() );
+
+    // every half that is not a NaN converts to a float that converts back to the same half
+    for (int i = 0; i < 65536; ++i) {
+        Half h = Half::fromBits( (unsigned short)i );
+        if ( !h.isNan() ) {
+            EXPECT_EQ( i, Half( (float)h ).bits() );
+        }
+    }
+}
+
+TEST_F(SIMDInstructionSetsTest, HalfConversions) {
+    std::vector<Half> halves(65536);
+    for (int i = 0; i < 65536; ++i) {
+        halves[i] = Half::fromBits( (unsigned short)i );
+    }
+    // floats around each half, to check the rounding
+    std::vector<float> floats(65536 * 4);
+    for (std::size_t i = 0; i < floats.size(); ++i) {
+        unsigned int bits = ( (unsigned int)i << 15 ) + (unsigned int)(std::rand() % 0x8000);
+        std::memcpy( &floats[i], &bits, sizeof(float) );
+    }
+
+    for (int set = 0; set < getInstructionSetsCount(); ++set) {
+        CPUFeatures::setSIMDInstructionSet( (SIMDInstructionSetEnum)set );
+        for (int i = 0; i < rowSizesCount; ++i) {
+            int count = rowSizes[i];
+            // one more element to check that nothing is written past the end
+            std::vector<float> dstFloats(count + 1, 42.f);
+            ImageConvertSIMD::halfToFloat(&halves[1000], &dstFloats[0], count);
+            for (int j = 0; j < count; ++j) {
+                EXPECT_EQ( (float)halves[1000 + j], dstFloats[j] );
+            }
+            EXPECT_EQ(42.f, dstFloats[count]);
+
+            std::vector<Half> dstHalves( count + 1, Half(42.f) );
+            ImageConvertSIMD::floatToHalf(&floats[1000], &dstHalves[0], count);
+            for (int j = 0; j < count; ++j) {
+                EXPECT_EQ( Half(floats[1000 + j]).bits(), dstHalves[j].bits() );
+            }
+            EXPECT_EQ( Half(42.f).bits(), dstHalves[count].bits() );
+        }
+
+        std::vector<float> dstFloats( halves.size() );
+        ImageConvertSIMD::halfToFloat(&halves[0], &dstFloats[0], halves.size());
+        for (std::size_t i = 0; i < halves.size(); ++i) {
+            float f = halves[i];
+            EXPECT_EQ( 0, std::memcmp( &f, &dstFloats[i], sizeof(float) ) );
+        }
+        std::vector<Half> dstHalves( floats.size() );
+        ImageConvertSIMD::floatToHalf(&floats[0], &dstHalves[0], floats.size());
+        for (std::size_t i = 0; i < floats.size(); ++i) {
+            EXPECT_EQ( Half(floats[i]).bits(), dstHalves[i].bits() );
+        }
+    }
+}
+
+TEST_F(SIMDInstructionSetsTest, ComponentsConversions) {
+    for (int i = 0; i < rowSizesCount; ++i) {
+        int nPixels = rowSizes[i];
+        std::vector<float> src = randomRgbaRow(nPixels);
+        const float* srcPixels = src.empty() ? 0 : &src[0];
+        for (int set = 0; set < getInstructionSetsCount(); ++set) {
+            CPUFeatures::setSIMDInstructionSet( (SIMDInstructionSetEnum)set );
+            std::vector<float> dst(nPixels * 4 + 1, 42.f);
+            ImageConvertSIMD::rgbaToRgb(srcPixels, &dst[0], nPixels);
+            for (int j = 0; j < nPixels * 3; ++j) {
+                EXPECT_EQ(src[(j / 3) * 4 + j % 3], dst[j]);
+            }
+            EXPECT_EQ(42.f, dst[nPixels * 3]);
+
+            // the source is read as RGB
+            ImageConvertSIMD::rgbToRgba(srcPixels, &dst[0], nPixels, 0.5f);
+            for (int j = 0; j < nPixels * 4; ++j) {
+                EXPECT_EQ(j % 4 == 3 ? 0.5f : src[(j / 4) * 3 + j % 4], dst[j]);
+            }
+            EXPECT_EQ(42.f, dst[nPixels * 4]);
+
+            for (int nComps = 1; nComps <= 4; ++nComps) {
+                for (int channel = 0; channel < nComps; ++channel) {
+                    std::fill(dst.begin(), dst.end(), 42.f);
+                    ImageConvertSIMD::extractChannel(srcPixels, nComps, channel, &dst[0], nPixels);
+                    for (int j = 0; j < nPixels; ++j) {
+                        EXPECT_EQ(src[j * nComps + channel], dst[j]);
+                    }
+                    EXPECT_EQ(42.f, dst[nPixels]);
+                }
+            }
+
+            std::fill(dst.begin(), dst.end(), 42.f);
+            ImageConvertSIMD::unpremultRgbaToRgb(srcPixels, &dst[0], nPixels);
+            for (int j = 0; j < nPixels * 3; ++j) {
+                float alpha = src[(j / 3) * 4 + 3];
+                float expected = alpha == 0.f ? 0.f : src[(j / 3) * 4 + j % 3] / alpha;
+                // compare the bits: the sign of zero and infinities must be the same
+                EXPECT_EQ( 0, std::memcmp( &expected, &dst[j], sizeof(float) ) );
+            }
+            EXPECT_EQ(42.f, dst[nPixels * 3]);
+        }
+    }
+}
+
+TEST_F(SIMDInstructionSetsTest, MipMapHalveRows) {
+    for (int i = 0; i < rowSizesCount; ++i) {
+        int nDstPixels = rowSizes[i];
+        // 2 source pixels per destination pixel, with up to 4 channels
+        std::vector<float> row0 = randomRgbaRow(nDstPixels * 2);
+        std::vector<float> row1 = randomRgbaRow(nDstPixels * 2);
+        const float* row0Pixels = row0.empty() ? 0 : &row0[0];
+        const float* row1Pixels = row1.empty() ? 0 : &row1[0];
+        for (int nComps = 1; nComps <= 4; ++nComps) {
+            // the sums are done in the order of the scalar code, so that all instruction sets give the same bits
+            std::vector<float> expected(nDstPixels * nComps);
+            for (int j = 0; j < nDstPixels * nComps; ++j) {
+                int k = (j / nComps) * 2 * nComps + j % nComps;
+                expected[j] = (row0[k] + row0[k + nComps] + row1[k] + row1[k + nComps]) / 4;
+            }
+            for (int set = 0; set < getInstructionSetsCount(); ++set) {
+                CPUFeatures::setSIMDInstructionSet( (SIMDInstructionSetEnum)set );
+                // one more element to check that nothing is written past the end
+                std::vector<float> dst(nDstPixels * nComps + 1, 42.f);
+                ImageMipMapSIMD::halveRows(row0Pixels, row1Pixels, &dst[0], nDstPixels, nComps);
+                for (int j = 0; j < nDstPixels * nComps; ++j) {
+                    EXPECT_EQ( 0, std::memcmp( &expected[j], &dst[j], sizeof(float) ) );
+                }
+                EXPECT_EQ(42.f, dst[nDstPixels * nComps]);
+            }
+        }
+    }
+}
+
+// Not a correctness test: prints the time taken by the conversions of a 4K RGBA image with each instruction set
+TEST_F(SIMDInstructionSetsTest, Benchmark) {
+    const int nPixels = 4096 * 2160;
+    const int nRuns = 5;
+    std::vector<float> src = randomRgbaRow(nPixels);
+    std::vector<unsigned char> bytes(nPixels * 4);
+    std::vector<unsigned short> shorts(nPixels * 4);
+    std::vector<float> floats(nPixels * 4);
+    std::vector<Half> halves(nPixels * 4);
+    const char* const setNames[] = {
+        "scalar", "SSE4.2", "AVX2"
+    };
+
+    for (int set = 0; set < getInstructionSetsCount(); ++set) {
+        CPUFeatures::setSIMDInstructionSet( (SIMDInstructionSetEnum)set );
+        double times[9] = {
+            0., 0., 0., 0., 0., 0., 0., 0., 0.
+        };
+        for (int run = 0; run < nRuns; ++run) {
+            TimeLapse timer;
+            ImageConvertSIMD::floatToByte(&src[0], &bytes[0], nPixels * 4);
+            times[0] += timer.getTimeElapsedReset();
+            ImageConvertSIMD::floatToUint16(&src[0], &shorts[0], nPixels * 4, 65535);
+            times[1] += timer.getTimeElapsedReset();
+            ImageConvertSIMD::byteToFloat(&bytes[0], &floats[0], nPixels * 4);
+            times[2] += timer.getTimeElapsedReset();
+            ImageConvertSIMD::shortToFloat(&shorts[0], &floats[0], nPixels * 4);
+            times[3] += timer.getTimeElapsedReset();
+            ImageConvertSIMD::rgbaToRgb(&src[0], &floats[0], nPixels);
+            times[4] += timer.getTimeElapsedReset();
+            ImageConvertSIMD::extractChannel(&src[0], 4, 3, &floats[0], nPixels);
+            times[5] += timer.getTimeElapsedReset();
+            ImageConvertSIMD::unpremultRgbaToRgb(&src[0], &floats[0], nPixels);
+            times[6] += timer.getTimeElapsedReset();
+            ImageConvertSIMD::floatToHalf(&src[0], &halves[0], nPixels * 4);
+            times[7] += timer.getTimeElapsedReset();
+            ImageConvertSIMD::halfToFloat(&halves[0], &floats[0], nPixels * 4);
+            times[8] += timer.getTimeElapsedReset();
+        }
+        std::cout << "ImageConvertSIMD " << setNames[set] << " (ms per 4K RGBA image):"
+                  << " floatToByte " << times[0] * 1000. / nRuns
+                  << " floatToUint16 " << times[1] * 1000. / nRuns
+                  << " byteToFloat " << times[2] * 1000. / nRuns
+                  << " shortToFloat " << times[3] * 1000. / nRuns
+                  << " rgbaToRgb " << times[4] * 1000. / nRuns
+                  << " extractChannel " << times[5] * 1000. / nRuns
+                  << " unpremultRgbaToRgb " << times[6] * 1000. / nRuns
+                  << " floatToHalf " << times[7] * 1000. / nRuns
+                  << " halfToFloat " << times[8] * 1000. / nRuns << std::endl;
+    }
+}
@@ -0,0 +1,163 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <gtest/gtest.h>
+
+#include "BaseTest.h"
+
+#include "Engine/AppManager.h"
+#include "Engine/ImageKey.h"
+#include "Engine/Knob.h"
+#include "Engine/KnobTypes.h"
+#include "Engine/Node.h"
+#include "Engine/Settings.h"
+#include "Engine/ViewIdx.h"
+
+NATRON_NAMESPACE_USING
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+class ContentBasedHashTest
+    : public BaseTest
+{
+protected:
+
+    virtual void SetUp() OVERRIDE FINAL
+    {
+        BaseTest::SetUp();
+        setContentBasedHashEnabled(true);
+    }
+
+    virtual void TearDown() OVERRIDE FINAL
+    {
+        setContentBasedHashEnabled(false);
+        BaseTest::TearDown();
+    }
+
+    static void setContentBasedHashEnabled(bool enabled)
+    {
+        KnobIPtr knob = appPTR->getCurrentSettings()->getKnobByName("contentBasedNodeHash");
+        KnobBool* isBool = dynamic_cast<KnobBool*>( knob.get() );
+
+        ASSERT_TRUE(isBool);
+        isBool->setValue(enabled);
+    }
+
+    static ImageKey getKey(const NodePtr& node)
+    {
+        // Forces the hash to be computed again
+        node->incrementKnobsAge();
+
+        return ImageKey(node.get(), node->getHashValue(), false, 0., ViewIdx(0), 1., false, false);
+    }
+
+    /**
+     * @brief Adds delta to the value of the given dimension of the knob, or toggles it for a boolean.
+     * @returns False if the knob type is not handled or the knob refused the value, e.g: out of its range.
+     **/
+    static bool offsetKnobValue(const KnobIPtr& knob,
+                                int dimension,
+                                int delta)
+    {
+        if ( dynamic_cast<KnobChoice*>( knob.get() ) ) {
+            return false;
+        }
+        KnobBoolBase* isBool = dynamic_cast<KnobBoolBase*>( knob.get() );
+        KnobIntBase* isInt = dynamic_cast<KnobIntBase*>( knob.get() );
+        KnobDoubleBase* isDouble = dynamic_cast<KnobDoubleBase*>( knob.get() );
+        if (isBool) {
+            bool value = isBool->getValue(dimension);
+            isBool->setValue(!value, ViewSpec::all(), dimension);
+
+            return isBool->getValue(dimension) != value;
+        } else if (isInt) {
+            int value = isInt->getValue(dimension);
+            isInt->setValue(value + delta, ViewSpec::all(), dimension);
+
+            return isInt->getValue(dimension) == value + delta;
+        } else if (isDouble) {
+            double value = isDouble->getValue(dimension);
+            isDouble->setValue(value + delta, ViewSpec::all(), dimension);
+
+            return isDouble->getValue(dimension) == value + delta;
+        }
+
+        return false;
+    }
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+// Two nodes of the same plug-in with the same knob values have the same key, whatever their name
+TEST_F(ContentBasedHashTest, EqualContentEqualKeys)
+{
+    NodePtr first = createNode(_generatorPluginID);
+    NodePtr second = createNode(_generatorPluginID);
+
+    ASSERT_TRUE(first && second);
+    ASSERT_NE( first->getScriptName(), second->getScriptName() );
+
+    EXPECT_EQ( getKey(first).getHash(), getKey(second).getHash() );
+    EXPECT_TRUE( getKey(first) == getKey(second) );
+}
+
+// Changing any knob that has an influence on the render changes the key, changing it back gives the same key again
+TEST_F(ContentBasedHashTest, KnobChangeChangesKey)
+{
+    NodePtr first = createNode(_generatorPluginID);
+    NodePtr second = createNode(_generatorPluginID);
+
+    ASSERT_TRUE(first && second);
+
+    int nChangedKnobs = 0;
+    const KnobsVec& knobs = first->getKnobs();
+    for (KnobsVec::const_iterator it = knobs.begin(); it != knobs.end(); ++it) {
+        if ( !(*it)->getEvaluateOnChange() ) {
+            continue;
+        }
+        for (int i = 0; i < (*it)->getDimension(); ++i) {
+            if ( !offsetKnobValue(*it, i, 1) ) {
+                continue;
+            }
+            ++nChangedKnobs;
+            EXPECT_FALSE( getKey(first) == getKey(second) ) << (*it)->getName() << " dimension " << i;
+
+            ASSERT_TRUE( offsetKnobValue(*it, i, -1) );
+            EXPECT_TRUE( getKey(first) == getKey(second) ) << (*it)->getName() << " dimension " << i;
+        }
+    }
+    EXPECT_GT(nChangedKnobs, 0);
+
+    // Animating a knob without changing its value at the current time also changes the key
+    KnobIPtr knob = first->getKnobByName("noiseZSlope");
+    KnobDouble* isDouble = dynamic_cast<KnobDouble*>( knob.get() );
+    ASSERT_TRUE(isDouble);
+    double value = isDouble->getValue();
+    isDouble->setValueAtTime(0, value, ViewSpec::all(), 0);
+    isDouble->setValueAtTime(100, value + 1., ViewSpec::all(), 0);
+    EXPECT_FALSE( getKey(first) == getKey(second) );
+}
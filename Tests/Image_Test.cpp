@@ -25,10 +25,16 @@
 
 #include "Global/Macros.h"
 
+#include <bitset>
 #include <cstring>
+#include <cstdlib>
+#include <list>
+#include <vector>
 #include <gtest/gtest.h>
 
+#include "Engine/Half.h"
 #include "Engine/Image.h"
+#include "Engine/ImagePlaneDesc.h"
 #include "Engine/ViewIdx.h"
 
 NATRON_NAMESPACE_USING
@@ -52,8 +58,6 @@ TEST(BitmapTest,
     ASSERT_TRUE(rod == nonRenderedRectsUnion);
 
     ///assert that the "underlying" bitmap is clean
-    const char* map = bm.getBitmap();
-    ASSERT_TRUE( !std::memchr( map, 1, rod.area() ) );
     ASSERT_TRUE( bm.isNonMarked(rod) );
 
     RectI halfRoD(0, 0, 100, 50);
@@ -69,14 +73,12 @@ TEST(BitmapTest,
 
 
     ///assert that the underlying bitmap is marked as expected
-    const char* start = map;
 
     ///check that there are only ones in the rendered half
-    ASSERT_TRUE( !memchr( start, 0, halfRoD.area() ) );
+    ASSERT_TRUE( bm.isMarkedForRendered(halfRoD) );
 
     ///check that there are only 0s in the non rendered half
-    start = map + halfRoD.area();
-    ASSERT_TRUE( !memchr( start, 1, halfRoD.area() ) );
+    ASSERT_TRUE( bm.isNonMarked(nonRenderedHalf) );
 
     ///mark for renderer the other half of the rod
     bm.markForRendered(nonRenderedHalf);
@@ -85,7 +87,7 @@ TEST(BitmapTest,
     nonRenderedRects.clear();
     bm.minimalNonMarkedRects(rod, nonRenderedRects);
     ASSERT_TRUE( nonRenderedRects.empty() );
-    ASSERT_TRUE( !memchr( map, 0, rod.area() ) );
+    ASSERT_TRUE( bm.isMarkedForRendered(rod) );
 
     ///More complex example where A,B,C,D are not rendered check that both trimap & bitmap yield the same result
     // BBBBBBBBBBBBBB
@@ -117,6 +119,307 @@ TEST(BitmapTest,
     EXPECT_TRUE(nonRenderedRects.size() == 3);
 } // TEST
 
+///Compares the bitmap with one value per pixel, on bounds that do not start on a tile and with random marks
+TEST(BitmapTest,
+     RandomRects)
+{
+    const RectI rod(-70, -30, 190, 150);
+    Bitmap bm(rod);
+    std::vector<char> values(rod.area(), 0);
+
+    srand(2000);
+    for (int i = 0; i < 200; ++i) {
+        // coverity[dont_call]
+        int x1 = rod.x1 - 10 + rand() % (rod.width() + 20);
+        // coverity[dont_call]
+        int y1 = rod.y1 - 10 + rand() % (rod.height() + 20);
+        // coverity[dont_call]
+        RectI rect(x1, y1, x1 + 1 + rand() % 100, y1 + 1 + rand() % 100);
+        // coverity[dont_call]
+        int value = rand() % 3;
+        if (value == 0) {
+            bm.clear(rect);
+        } else if (value == 1) {
+            bm.markForRendered(rect);
+        } else {
+            bm.markForRendering(rect);
+        }
+        RectI inter;
+        if ( rect.intersect(rod, &inter) ) {
+            for (int y = inter.y1; y < inter.y2; ++y) {
+                for (int x = inter.x1; x < inter.x2; ++x) {
+                    values[(y - rod.y1) * rod.width() + (x - rod.x1)] = (char)value;
+                }
+            }
+        }
+
+        // all the pixels that are not rendered are in the rects left to render, and with the trimap the pixels being
+        // rendered elsewhere that are not are flagged
+        std::list<RectI> rects;
+        bm.minimalNonMarkedRects(rod, rects);
+        std::list<RectI> rectsTrimap;
+        bool beingRenderedElseWhere = false;
+        bm.minimalNonMarkedRects_trimap(rod, rectsTrimap, &beingRenderedElseWhere);
+        bool hasUnavailable = false;
+        for (int y = rod.y1; y < rod.y2; ++y) {
+            for (int x = rod.x1; x < rod.x2; ++x) {
+                char v = values[(y - rod.y1) * rod.width() + (x - rod.x1)];
+                ASSERT_EQ( v, bm.getValueAt(x, y) );
+                hasUnavailable |= (v == 2);
+                bool inRects = false;
+                for (std::list<RectI>::iterator it = rects.begin(); it != rects.end(); ++it) {
+                    inRects |= it->contains(x, y);
+                }
+                if (v != 1) {
+                    ASSERT_TRUE(inRects);
+                }
+                bool inRectsTrimap = false;
+                for (std::list<RectI>::iterator it = rectsTrimap.begin(); it != rectsTrimap.end(); ++it) {
+                    inRectsTrimap |= it->contains(x, y);
+                }
+                if (v == 0) {
+                    ASSERT_TRUE(inRectsTrimap);
+                } else if ( (v == 2) && !inRectsTrimap ) {
+                    ASSERT_TRUE(beingRenderedElseWhere);
+                }
+            }
+        }
+        if (!hasUnavailable) {
+            ASSERT_FALSE(beingRenderedElseWhere);
+        }
+    }
+
+    ///the mipmap at the level below is rendered where all the pixels it covers are rendered
+    const RectI halfRoD = rod.downscalePowerOfTwoLargestEnclosed(1);
+    Bitmap halfBm(halfRoD);
+    halfBm.halveRoI(halfRoD, bm);
+    for (int y = halfRoD.y1; y < halfRoD.y2; ++y) {
+        for (int x = halfRoD.x1; x < halfRoD.x2; ++x) {
+            bool rendered = true;
+            for (int sy = y * 2; sy < y * 2 + 2; ++sy) {
+                for (int sx = x * 2; sx < x * 2 + 2; ++sx) {
+                    rendered &= (values[(sy - rod.y1) * rod.width() + (sx - rod.x1)] == 1);
+                }
+            }
+            ASSERT_EQ( rendered ? 1 : 0, halfBm.getValueAt(x, y) );
+        }
+    }
+
+    ///copies are exact
+    Bitmap copy(rod);
+    copy.markForRendered(rod);
+    const RectI portion(-50, -20, 150, 100);
+    copy.copyBitmapPortion(portion, bm);
+    copy.copyRowPortion(rod.x1, rod.x2, rod.y2 - 1, bm);
+    for (int y = rod.y1; y < rod.y2; ++y) {
+        for (int x = rod.x1; x < rod.x2; ++x) {
+            char expected = ( portion.contains(x, y) || (y == rod.y2 - 1) ) ? bm.getValueAt(x, y) : 1;
+            ASSERT_EQ( expected, copy.getValueAt(x, y) );
+        }
+    }
+} // TEST
+
+// Fills the image with random values and marks random rectangles of it as rendered
+static void
+fillRandom(Image* image)
+{
+    const RectI& bounds = image->getBounds();
+    int rowElements = bounds.width() * (int)image->getComponentsCount();
+    Image::WriteAccess acc(image);
+
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        unsigned char* row = acc.pixelAt(bounds.x1, y);
+        for (int i = 0; i < rowElements; ++i) {
+            // coverity[dont_call]
+            int value = rand();
+            switch ( image->getBitDepth() ) {
+            case eImageBitDepthByte:
+                row[i] = (unsigned char)(value % 256);
+                break;
+            case eImageBitDepthShort:
+                ( (unsigned short*)row )[i] = (unsigned short)(value % 65536);
+                break;
+            case eImageBitDepthHalf:
+                ( (Half*)row )[i] = Half( (float)value / RAND_MAX );
+                break;
+            default:
+                ( (float*)row )[i] = (float)value / RAND_MAX;
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < 20; ++i) {
+        // coverity[dont_call]
+        int x1 = bounds.x1 + rand() % bounds.width();
+        // coverity[dont_call]
+        int y1 = bounds.y1 + rand() % bounds.height();
+        // coverity[dont_call]
+        acc.markBitmapForRendered( RectI(x1, y1, x1 + 1 + rand() % 300, y1 + 1 + rand() % 300) );
+    }
+}
+
+// downscaleMipMap() builds all the levels of a band of rows before the next band: the result must be exactly the one
+// of building each level from the whole previous level
+TEST(ImageMipMapTest,
+     BandsMatchWholeImage)
+{
+    srand(2000);
+    // odd limits, and tall enough to be split in many bands
+    const RectI bounds(-101, -67, 499, 1533);
+    const RectD rod(bounds.x1, bounds.y1, bounds.x2, bounds.y2);
+    const ImagePlaneDesc* components[] = {
+        &ImagePlaneDesc::getAlphaComponents(), &ImagePlaneDesc::getXYComponents(),
+        &ImagePlaneDesc::getRGBComponents(), &ImagePlaneDesc::getRGBAComponents()
+    };
+    const ImageBitDepthEnum depths[] = {
+        eImageBitDepthByte, eImageBitDepthShort, eImageBitDepthFloat
+    };
+    const RectI roi(bounds.x1 + 3, bounds.y1 + 5, bounds.x2, bounds.y2 - 1);
+
+    for (int c = 0; c < 4; ++c) {
+        for (int d = 0; d < 3; ++d) {
+            Image src(*components[c], rod, bounds, 0, 1., depths[d], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone, true);
+            fillRandom(&src);
+
+            // one level at a time: there is a single band of 2 rows per destination row
+            std::vector<ImagePtr> wholeLevels;
+            RectI levelRoI = roi;
+            for (unsigned int level = 1; level <= 3; ++level) {
+                const Image& previous = wholeLevels.empty() ? src : *wholeLevels.back();
+                RectI levelBounds = levelRoI.downscalePowerOfTwoSmallestEnclosing(1);
+                wholeLevels.push_back( ImagePtr( new Image(*components[c], rod, levelBounds, level, 1., depths[d], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone, true) ) );
+                previous.downscaleMipMap(rod, levelRoI, level - 1, level, true, wholeLevels.back().get() );
+                levelRoI = levelBounds;
+            }
+
+            for (unsigned int level = 1; level <= 3; ++level) {
+                const Image& whole = *wholeLevels[level - 1];
+                const RectI& levelBounds = whole.getBounds();
+                ASSERT_TRUE( levelBounds == roi.downscalePowerOfTwoSmallestEnclosing(level) );
+                Image banded(*components[c], rod, levelBounds, level, 1., depths[d], eImagePremultiplicationPremultiplied, eImageFieldingOrderNone, true);
+                src.downscaleMipMap(rod, roi, 0, level, true, &banded);
+
+                int rowBytes = levelBounds.width() * (int)src.getComponentsCount() * getSizeOfForBitDepth(depths[d]);
+                Image::ReadAccess bandedAcc(&banded);
+                Image::ReadAccess wholeAcc(&whole);
+                for (int y = levelBounds.y1; y < levelBounds.y2; ++y) {
+                    ASSERT_EQ( 0, std::memcmp(bandedAcc.pixelAt(levelBounds.x1, y), wholeAcc.pixelAt(levelBounds.x1, y), rowBytes) );
+
+                    const RectI row(levelBounds.x1, y, levelBounds.x2, y + 1);
+                    std::list<RectI> bandedRestToRender, wholeRestToRender;
+                    banded.getRestToRender(row, bandedRestToRender);
+                    whole.getRestToRender(row, wholeRestToRender);
+                    ASSERT_TRUE(bandedRestToRender == wholeRestToRender);
+                }
+            }
+        }
+    }
+}
+
+static ImagePtr
+makeRandomImage(const ImagePlaneDesc& components,
+                const RectD& rod,
+                const RectI& bounds,
+                ImageBitDepthEnum depth)
+{
+    ImagePtr ret( new Image(components, rod, bounds, 0, 1., depth, eImagePremultiplicationPremultiplied, eImageFieldingOrderNone, true) );
+
+    fillRandom( ret.get() );
+
+    return ret;
+}
+
+static ImagePtr
+copyImage(const Image& image)
+{
+    ImagePtr ret( new Image(image.getComponents(), image.getRoD(), image.getBounds(), image.getMipMapLevel(), image.getPixelAspectRatio(),
+                            image.getBitDepth(), image.getPremultiplication(), image.getFieldingOrder(), true) );
+
+    ret->pasteFrom( image, image.getBounds(), true );
+
+    return ret;
+}
+
+static bool
+hasSamePixels(const Image& a,
+              const Image& b)
+{
+    const RectI& bounds = a.getBounds();
+
+    if ( ( bounds != b.getBounds() ) || ( a.getComponentsCount() != b.getComponentsCount() ) || ( a.getBitDepth() != b.getBitDepth() ) ) {
+        return false;
+    }
+    int rowBytes = bounds.width() * (int)a.getComponentsCount() * getSizeOfForBitDepth( a.getBitDepth() );
+    Image::ReadAccess aAcc(&a);
+    Image::ReadAccess bAcc(&b);
+    for (int y = bounds.y1; y < bounds.y2; ++y) {
+        if ( std::memcmp(aAcc.pixelAt(bounds.x1, y), bAcc.pixelAt(bounds.x1, y), rowBytes) != 0 ) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// copyUnProcessedChannelsAndApplyMaskMix() does both passes over each pixel: it must give exactly
+// copyUnProcessedChannels() followed by applyMaskMix()
+TEST(ImageMaskMixTest,
+     FusedMatchesSeparatePasses)
+{
+    srand(2000);
+    const RectD rod(-20, -15, 100, 60);
+    const RectI bounds(-20, -10, 80, 60);
+    // the original image and the mask only cover parts of the output image
+    const RectI originalBounds(-5, -15, 70, 50);
+    const RectI maskBounds(10, 0, 100, 45);
+    const RectI roi(-15, -8, 75, 55);
+    const ImagePlaneDesc* components[] = {
+        &ImagePlaneDesc::getAlphaComponents(), &ImagePlaneDesc::getXYComponents(),
+        &ImagePlaneDesc::getRGBComponents(), &ImagePlaneDesc::getRGBAComponents()
+    };
+    const ImageBitDepthEnum depths[] = {
+        eImageBitDepthByte, eImageBitDepthShort, eImageBitDepthHalf, eImageBitDepthFloat
+    };
+    // bit 0 is R, bit 3 is A
+    const std::bitset<4> processChannels[] = {
+        std::bitset<4>(0x1), std::bitset<4>(0x5), std::bitset<4>(0x7), std::bitset<4>(0x8)
+    };
+
+    for (int d = 0; d < 4; ++d) {
+        ImagePtr mask = makeRandomImage(ImagePlaneDesc::getAlphaComponents(), rod, maskBounds, depths[d]);
+        for (int dstComps = 0; dstComps < 4; ++dstComps) {
+            ImagePtr output = makeRandomImage(*components[dstComps], rod, bounds, depths[d]);
+            // only RGBA images can be premultiplied
+            ImagePremultiplicationEnum outputPremult = (dstComps == 3) ? eImagePremultiplicationPremultiplied : eImagePremultiplicationOpaque;
+            for (int srcComps = 0; srcComps < 4; ++srcComps) {
+                ImagePtr original = makeRandomImage(*components[srcComps], rod, originalBounds, depths[d]);
+                ImagePremultiplicationEnum originalPremult = (srcComps == 3) ? eImagePremultiplicationPremultiplied : eImagePremultiplicationOpaque;
+                for (int p = 0; p < 4; ++p) {
+                    // unmasked, masked, masked and inverted
+                    for (int maskMode = 0; maskMode < 3; ++maskMode) {
+                        bool masked = maskMode > 0;
+                        bool maskInvert = maskMode == 2;
+                        float mix = masked ? 0.7f : 0.4f;
+
+                        ImagePtr separate = copyImage(*output);
+                        separate->copyUnProcessedChannels(roi, outputPremult, originalPremult, processChannels[p], original, false);
+                        separate->applyMaskMix(roi, mask.get(), original.get(), masked, maskInvert, mix);
+
+                        ImagePtr fused = copyImage(*output);
+                        fused->copyUnProcessedChannelsAndApplyMaskMix(roi, outputPremult, originalPremult, processChannels[p], original, false,
+                                                                      true, mask.get(), masked, maskInvert, mix);
+
+                        EXPECT_TRUE( hasSamePixels(*separate, *fused) ) << "depth " << depths[d] << " output components " << dstComps + 1
+                                                                        << " original components " << srcComps + 1
+                                                                        << " processed channels " << processChannels[p].to_string()
+                                                                        << " mask mode " << maskMode;
+                    }
+                }
+            }
+        }
+    }
+}
+
 TEST(ImageKeyTest, Equality) {
     srand(2000);
     // coverity[dont_call]
@@ -25,9 +25,17 @@
 
 #include "Global/Macros.h"
 
+#include <cmath>
 #include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+
 #include <gtest/gtest.h>
+
 #include "Engine/Lut.h"
+#include "Engine/RectI.h"
+#include "Engine/Timer.h"
 
 NATRON_NAMESPACE_USING
 using namespace NATRON_NAMESPACE::Color;
@@ -52,3 +60,163 @@ TEST(Lut, IntConversions) {
         EXPECT_EQ( i, uint8xxToChar( charToUint8xx(i) ) );
     }
 }
+
+namespace {
+const Lut*
+getTestedLut(int i)
+{
+    switch (i) {
+    case 0:
+        return LutManager::sRGBLut();
+    case 1:
+        return LutManager::Rec709Lut();
+    case 2:
+        return LutManager::Gamma2_2Lut();
+    default:
+        return LutManager::CineonLut();
+    }
+}
+
+const int testedLutsCount = 4;
+
+// Values in [0,1] and out of range, with NaN, infinities and negative zero
+std::vector<float>
+randomLinearValues(int count)
+{
+    std::vector<float> values(count);
+
+    for (int i = 0; i < count; ++i) {
+        switch (std::rand() % 16) {
+        case 0:
+            values[i] = std::numeric_limits<float>::quiet_NaN();
+            break;
+        case 1:
+            values[i] = (std::rand() % 2) ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+            break;
+        case 2:
+            values[i] = -0.f;
+            break;
+        case 3:
+            values[i] = -1.f + 3.f * std::rand() / RAND_MAX;
+            break;
+        default:
+            values[i] = (float)std::rand() / RAND_MAX;
+            break;
+        }
+    }
+
+    return values;
+}
+}
+
+// The row lookups must give exactly the per-value lookups
+TEST(Lut, Uint8xxRows) {
+    const int rowSizes[] = {
+        0, 1, 7, 8, 15, 16, 17, 33, 1000
+    };
+
+    for (int l = 0; l < testedLutsCount; ++l) {
+        const Lut* lut = getTestedLut(l);
+        lut->validate();
+        for (std::size_t i = 0; i < sizeof(rowSizes) / sizeof(rowSizes[0]); ++i) {
+            int count = rowSizes[i];
+            std::vector<float> src = randomLinearValues(count);
+            // one more element to check that nothing is written past the end
+            std::vector<unsigned short> dst(count + 1, 42);
+            lut->toColorSpaceUint8xxFromLinearFloatFast(src.empty() ? 0 : &src[0], &dst[0], count);
+            for (int j = 0; j < count; ++j) {
+                EXPECT_EQ(lut->toColorSpaceUint8xxFromLinearFloatFast(src[j]), dst[j]);
+            }
+            EXPECT_EQ(42, dst[count]);
+        }
+    }
+}
+
+// The table lookups are within 1 LSB of the transfer function rounded to a byte
+TEST(Lut, Uint8ErrorBound) {
+    for (int l = 0; l < testedLutsCount; ++l) {
+        const Lut* lut = getTestedLut(l);
+        lut->validate();
+        int maxError = 0;
+        for (int i = 0; i <= 0x100000; ++i) {
+            float v = i / (float)0x100000;
+            int exact = floatToInt<256>( lut->toColorSpaceFloatFromLinearFloat(v) );
+            int error = std::abs( (int)lut->toColorSpaceUint8FromLinearFloatFast(v) - exact );
+            maxError = std::max(maxError, error);
+        }
+        EXPECT_LE(maxError, 1) << lut->getName();
+        // byte values are exact
+        for (int b = 0; b < 256; ++b) {
+            EXPECT_EQ( b, lut->toColorSpaceUint8FromLinearFloatFast( lut->fromColorSpaceUint8ToLinearFloatFast(b) ) );
+        }
+    }
+}
+
+// Error diffusion adds less than 1 LSB to the error of the lookups, but keeps the mean of a row within 1/2 LSB of the
+// transfer function. The alpha is not dithered.
+TEST(Lut, BytePackedErrorBound) {
+    const int width = 301;
+    const int height = 5;
+    std::vector<float> src(width * height * 4);
+
+    for (std::size_t i = 0; i < src.size(); ++i) {
+        src[i] = (float)std::rand() / RAND_MAX;
+    }
+    RectI bounds(0, 0, width, height);
+    for (int l = 0; l < testedLutsCount; ++l) {
+        const Lut* lut = getTestedLut(l);
+        for (int premult = 0; premult < 2; ++premult) {
+            std::vector<unsigned char> dst(width * height * 4);
+            lut->to_byte_packed(&dst[0], &src[0], bounds, bounds, bounds, ePixelPackingRGBA, ePixelPackingBGRA, true, premult);
+            for (int y = 0; y < height; ++y) {
+                const float* srcPix = &src[(height - 1 - y) * width * 4];
+                const unsigned char* dstPix = &dst[y * width * 4];
+                double sumError[3] = {
+                    0., 0., 0.
+                };
+                for (int x = 0; x < width; ++x, srcPix += 4, dstPix += 4) {
+                    float a = premult ? srcPix[3] : 1.f;
+                    for (int k = 0; k < 3; ++k) {
+                        float exact = lut->toColorSpaceFloatFromLinearFloat(srcPix[k] * a) * 255.f;
+                        EXPECT_LT(std::fabs(dstPix[2 - k] - exact), 2.f);
+                        sumError[k] += dstPix[2 - k] - exact;
+                    }
+                    EXPECT_EQ(floatToInt<256>(a), dstPix[3]);
+                }
+                for (int k = 0; k < 3; ++k) {
+                    EXPECT_LE(std::fabs(sumError[k] / width), 0.5) << lut->getName();
+                }
+            }
+        }
+    }
+}
+
+// Not a correctness test: prints the time taken by the sRGB lookups of a 4K RGBA image, value by value and a row at
+// a time
+TEST(Lut, Benchmark) {
+    const int nSamples = 4096 * 2160 * 4;
+    const int nRuns = 5;
+    const Lut* lut = LutManager::sRGBLut();
+    std::vector<float> src(nSamples);
+    std::vector<unsigned short> uint8xx(nSamples);
+
+    for (std::size_t i = 0; i < src.size(); ++i) {
+        src[i] = (float)std::rand() / RAND_MAX;
+    }
+    lut->validate();
+    double times[2] = {
+        0., 0.
+    };
+    for (int run = 0; run < nRuns; ++run) {
+        TimeLapse timer;
+        for (std::size_t i = 0; i < src.size(); ++i) {
+            uint8xx[i] = lut->toColorSpaceUint8xxFromLinearFloatFast(src[i]);
+        }
+        times[0] += timer.getTimeElapsedReset();
+        lut->toColorSpaceUint8xxFromLinearFloatFast(&src[0], &uint8xx[0], src.size());
+        times[1] += timer.getTimeElapsedReset();
+    }
+    std::cout << "Lut (ms per 4K RGBA image):"
+              << " per-value lookups " << times[0] * 1000. / nRuns
+              << " row lookups " << times[1] * 1000. / nRuns << std::endl;
+}
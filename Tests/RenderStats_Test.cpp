@@ -0,0 +1,111 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#if !defined(SBK_RUN) && !defined(Q_MOC_RUN)
+#include <boost/make_shared.hpp>
+#endif
+
+#include "Engine/RenderStats.h"
+
+NATRON_NAMESPACE_USING
+
+// Spans are only recorded with in-depth profiling
+TEST(RenderStats, TraceSpans) {
+    RenderStatsPtr stats = boost::make_shared<RenderStats>(true);
+    RenderStatsPtr globalStats = boost::make_shared<RenderStats>(false);
+    {
+        RenderTraceSpan renderRoISpan(stats, NodePtr(), eRenderTraceEventTypeRenderRoI);
+        RenderTraceSpan renderSpan(stats, NodePtr(), eRenderTraceEventTypeRenderAction);
+        RenderTraceSpan globalSpan(globalStats, NodePtr(), eRenderTraceEventTypeRenderAction);
+    }
+    EXPECT_TRUE( globalStats->getTraceEvents().empty() );
+
+    RenderTraceEventList events = stats->getTraceEvents();
+    ASSERT_EQ( 2, (int)events.size() );
+    // The inner span ends first and is nested in the outer one
+    EXPECT_EQ(eRenderTraceEventTypeRenderAction, events.front().type);
+    EXPECT_EQ(eRenderTraceEventTypeRenderRoI, events.back().type);
+    EXPECT_EQ(events.front().threadId, events.back().threadId);
+    EXPECT_LE(events.back().startTime, events.front().startTime);
+    EXPECT_GE(events.back().startTime + events.back().duration, events.front().startTime + events.front().duration);
+}
+
+// Work done for all renders, such as writing the cache to disk, is recorded by each render profiled in depth
+TEST(RenderStats, ProfiledRendersSpans) {
+    RenderStatsPtr stats = boost::make_shared<RenderStats>(true);
+    RenderStatsPtr otherStats = boost::make_shared<RenderStats>(true);
+    RenderStatsPtr globalStats = boost::make_shared<RenderStats>(false);
+    {
+        RenderTraceSpan writeSpan(eRenderTraceEventTypeDiskCacheWrite);
+    }
+    EXPECT_TRUE( globalStats->getTraceEvents().empty() );
+    ASSERT_EQ( 1, (int)stats->getTraceEvents().size() );
+    ASSERT_EQ( 1, (int)otherStats->getTraceEvents().size() );
+    EXPECT_EQ(eRenderTraceEventTypeDiskCacheWrite, stats->getTraceEvents().front().type);
+    EXPECT_TRUE( stats->getTraceEvents().front().nodeName.empty() );
+    EXPECT_GE(stats->getTraceEvents().front().duration, 0.);
+
+    // Destroyed stats no longer record anything
+    otherStats.reset();
+    {
+        RenderTraceSpan writeSpan(eRenderTraceEventTypeDiskCacheWrite);
+    }
+    EXPECT_EQ( 2, (int)stats->getTraceEvents().size() );
+}
+
+TEST(RenderStats, ChromeTrace) {
+    RenderTraceEventList events;
+    RenderTraceEvent e;
+
+    e.type = eRenderTraceEventTypeCacheLookup;
+    e.nodeName = "Read\"1";
+    e.threadId = 42;
+    e.startTime = 10.;
+    e.duration = 0.5;
+    events.push_back(e);
+    e.type = eRenderTraceEventTypeRenderAction;
+    e.nodeName = "Blur1";
+    e.threadId = 43;
+    e.startTime = 10.25;
+    e.duration = 0.001;
+    events.push_back(e);
+
+    std::stringstream ss;
+    RenderStats::writeChromeTrace(events, ss);
+    std::string trace = ss.str();
+
+    EXPECT_NE( std::string::npos, trace.find("\"traceEvents\":[") );
+    // Threads are numbered from 1, timestamps are in microseconds from the first event
+    EXPECT_NE( std::string::npos, trace.find("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"Render thread 2\"}}") );
+    EXPECT_NE( std::string::npos, trace.find("{\"name\":\"Read\\\"1 cacheLookup\",\"cat\":\"cacheLookup\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":0.000,\"dur\":500000.000") );
+    EXPECT_NE( std::string::npos, trace.find("{\"name\":\"Blur1 render\",\"cat\":\"render\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":250000.000,\"dur\":1000.000") );
+}
@@ -0,0 +1,199 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <gtest/gtest.h>
+
+#include "Engine/RenderTaskGraph.h"
+#include "Engine/RenderTaskGraphPrivate.h"
+
+NATRON_NAMESPACE_USING
+
+typedef boost::shared_ptr<RenderTaskGraphNode> RenderTaskGraphNodePtr;
+
+// Builds the graph nodes in the order of RenderTaskGraph::sortedNodes: nodes must be added after their inputs
+class RenderTaskGraphBuilder
+{
+public:
+
+    RenderTaskGraphNode* addNode(const std::vector<RenderTaskGraphNode*>& inputs)
+    {
+        RenderTaskGraphNodePtr graphNode(new RenderTaskGraphNode);
+
+        graphNode->canPreRender = true;
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            graphNode->inputs.push_back(inputs[i]);
+            inputs[i]->outputs.push_back( graphNode.get() );
+            if (inputs.size() > 1) {
+                inputs[i]->isSiblingBranch = true;
+            }
+        }
+        _nodes.push_back(graphNode);
+        _sortedNodes.push_back( graphNode.get() );
+
+        return graphNode.get();
+    }
+
+    RenderTaskGraphNode* addNode(RenderTaskGraphNode* input)
+    {
+        std::vector<RenderTaskGraphNode*> inputs;
+
+        if (input) {
+            inputs.push_back(input);
+        }
+
+        return addNode(inputs);
+    }
+
+    // The root and its direct inputs are rendered by the caller
+    RenderTaskGraphNode* addRoot(RenderTaskGraphNode* input)
+    {
+        input->isRootInput = true;
+        input->canPreRender = false;
+        RenderTaskGraphNode* root = addNode(input);
+        root->isRoot = true;
+        root->canPreRender = false;
+
+        return root;
+    }
+
+    std::size_t plan(std::vector<RenderTaskGraphNode*>* firstTasks)
+    {
+        return planRenderTasks(_sortedNodes, firstTasks);
+    }
+
+private:
+
+    std::vector<RenderTaskGraphNodePtr> _nodes;
+    std::vector<RenderTaskGraphNode*> _sortedNodes;
+};
+
+static bool
+contains(const std::vector<RenderTaskGraphNode*>& tasks,
+         const RenderTaskGraphNode* task)
+{
+    return std::find(tasks.begin(), tasks.end(), task) != tasks.end();
+}
+
+// Both inputs of a Merge get a task, so that they render concurrently
+TEST(RenderTaskGraph, SiblingBranches) {
+    RenderTaskGraphBuilder builder;
+    RenderTaskGraphNode* readA = builder.addNode(0);
+    RenderTaskGraphNode* blurA = builder.addNode(readA);
+    RenderTaskGraphNode* readB = builder.addNode(0);
+    RenderTaskGraphNode* blurB = builder.addNode(readB);
+    std::vector<RenderTaskGraphNode*> mergeInputs;
+
+    mergeInputs.push_back(blurA);
+    mergeInputs.push_back(blurB);
+    RenderTaskGraphNode* merge = builder.addNode(mergeInputs);
+    RenderTaskGraphNode* grade = builder.addNode(merge);
+    builder.addRoot(grade);
+
+    std::vector<RenderTaskGraphNode*> firstTasks;
+    EXPECT_EQ( 2, (int)builder.plan(&firstTasks) );
+    EXPECT_TRUE(blurA->isTask);
+    EXPECT_TRUE(blurB->isTask);
+    EXPECT_FALSE(readA->isTask);
+    EXPECT_FALSE(readB->isTask);
+    EXPECT_FALSE(merge->isTask);
+    EXPECT_FALSE(grade->isTask);
+
+    // Nothing upstream of the branches is a task: both start right away
+    EXPECT_EQ( 2, (int)firstTasks.size() );
+    EXPECT_TRUE( contains(firstTasks, blurA) );
+    EXPECT_TRUE( contains(firstTasks, blurB) );
+    EXPECT_TRUE( blurA->dependentTasks.empty() );
+    EXPECT_TRUE( blurB->dependentTasks.empty() );
+}
+
+// A task waits for the tasks upstream of it, and only for these
+TEST(RenderTaskGraph, Dependencies) {
+    RenderTaskGraphBuilder builder;
+    RenderTaskGraphNode* readA = builder.addNode(0);
+    RenderTaskGraphNode* blurA = builder.addNode(readA);
+    RenderTaskGraphNode* readB = builder.addNode(0);
+    RenderTaskGraphNode* blurB = builder.addNode(readB);
+
+    readA->cachesOutput = true;
+    std::vector<RenderTaskGraphNode*> mergeInputs;
+    mergeInputs.push_back(blurA);
+    mergeInputs.push_back(blurB);
+    builder.addRoot( builder.addNode(mergeInputs) );
+
+    std::vector<RenderTaskGraphNode*> firstTasks;
+    EXPECT_EQ( 3, (int)builder.plan(&firstTasks) );
+    EXPECT_TRUE(readA->isTask);
+    EXPECT_FALSE(readB->isTask);
+
+    EXPECT_EQ( 2, (int)firstTasks.size() );
+    EXPECT_TRUE( contains(firstTasks, readA) );
+    EXPECT_TRUE( contains(firstTasks, blurB) );
+    ASSERT_EQ( 1, (int)readA->dependentTasks.size() );
+    EXPECT_EQ( blurA, readA->dependentTasks.front() );
+    EXPECT_EQ( 1, blurA->nPendingDependencies.fetchAndAddRelaxed(0) );
+    EXPECT_EQ( 0, blurB->nPendingDependencies.fetchAndAddRelaxed(0) );
+}
+
+// A long chain is cut in tasks so that renderRoI never recurses through more than NATRON_RENDER_TASK_GRAPH_MAX_DEPTH nodes
+TEST(RenderTaskGraph, DepthCap) {
+    const int chainLength = 3 * NATRON_RENDER_TASK_GRAPH_MAX_DEPTH + 2;
+    RenderTaskGraphBuilder builder;
+    std::vector<RenderTaskGraphNode*> chain(chainLength);
+
+    // chain[0] is the farthest from the root
+    chain[0] = builder.addNode(0);
+    for (int i = 1; i < chainLength; ++i) {
+        chain[i] = builder.addNode(chain[i - 1]);
+    }
+    builder.addRoot(chain[chainLength - 1]);
+
+    std::vector<RenderTaskGraphNode*> firstTasks;
+    EXPECT_EQ( 3, (int)builder.plan(&firstTasks) );
+
+    RenderTaskGraphNode* previousTask = 0;
+    for (int i = 0; i < chainLength; ++i) {
+        const int distanceToRoot = chainLength - i;
+        EXPECT_LE(chain[i]->depth, NATRON_RENDER_TASK_GRAPH_MAX_DEPTH);
+        EXPECT_EQ(distanceToRoot % NATRON_RENDER_TASK_GRAPH_MAX_DEPTH == 0, chain[i]->isTask) << "node " << i;
+        if (chain[i]->isTask) {
+            // Each task waits for the previous one upstream
+            if (previousTask) {
+                ASSERT_EQ( 1, (int)previousTask->dependentTasks.size() );
+                EXPECT_EQ( chain[i], previousTask->dependentTasks.front() );
+            } else {
+                ASSERT_EQ( 1, (int)firstTasks.size() );
+                EXPECT_EQ( chain[i], firstTasks.front() );
+            }
+            previousTask = chain[i];
+        }
+    }
+}
@@ -0,0 +1,219 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <cstring> // memset
+#include <list>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include <QtCore/QDir>
+#include <QtCore/QString>
+
+#include "Global/ProcInfo.h"
+#include "Global/QtCompat.h" // for removeRecursively
+
+#include "Engine/MemoryFile.h"
+#include "Engine/SharedCacheIndex.h"
+#include "Engine/StandardPaths.h"
+
+// PID of no running process: larger than the maximum PID of the systems Natron runs on
+#define SHARED_INDEX_TEST_DEAD_PID 0x7FFFFFF0
+
+NATRON_NAMESPACE_USING
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+// Layout of the index file, see SharedCacheIndex.cpp
+struct TestIndexSlot
+{
+    int sequence;
+    int writer;
+    U64 hash;
+    U32 recordSize;
+    char record[NATRON_SHARED_CACHE_INDEX_RECORD_MAX_BYTES];
+};
+
+#define SHARED_INDEX_TEST_HEADER_BYTES 32
+
+class SharedCacheIndexTest
+    : public ::testing::Test
+{
+protected:
+
+    QString _directoryPath;
+
+    virtual void SetUp() OVERRIDE FINAL
+    {
+        QString tempPath = StandardPaths::writableLocation(StandardPaths::eStandardLocationTemp);
+
+        _directoryPath = QDir(tempPath).absoluteFilePath( QString::fromUtf8("NatronUnitTest") + QString::number( qrand() ) ) + QLatin1Char('/');
+    }
+
+    virtual void TearDown() OVERRIDE FINAL
+    {
+        QtCompat::removeRecursively(_directoryPath);
+    }
+
+    std::string getDirectoryPath() const
+    {
+        return _directoryPath.toStdString();
+    }
+
+    std::string getIndexFilePath() const
+    {
+        return getDirectoryPath() + NATRON_SHARED_CACHE_INDEX_FILE_NAME;
+    }
+
+    /**
+     * @brief Returns the slot the hash maps to first
+     **/
+    static TestIndexSlot& getSlot(MemoryFile& indexFile,
+                                  U64 hash)
+    {
+        return reinterpret_cast<TestIndexSlot*>( indexFile.data() + SHARED_INDEX_TEST_HEADER_BYTES )[hash % NATRON_SHARED_CACHE_INDEX_SLOTS];
+    }
+
+    /**
+     * @brief Leaves the slot as a process killed while writing a record in it would
+     **/
+    static void interruptWriter(TestIndexSlot& slot)
+    {
+        slot.writer = SHARED_INDEX_TEST_DEAD_PID;
+        ++slot.sequence;
+        std::memset( slot.record, 'x', slot.recordSize / 2 );
+    }
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+// A process opening the index releases the slots left taken by the processes killed while writing them
+TEST_F(SharedCacheIndexTest, InterruptedWriterReclaimedOnOpen)
+{
+    const U64 hash = 1234;
+    SharedCacheIndex index;
+
+    index.open(getDirectoryPath(), 1);
+    ASSERT_TRUE( index.publish( hash, std::string("record") ) );
+
+    MemoryFile indexFile(getIndexFilePath(), MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail);
+    TestIndexSlot& slot = getSlot(indexFile, hash);
+    ASSERT_EQ( (U32)6, slot.recordSize );
+    ASSERT_EQ( hash, slot.hash );
+
+    interruptWriter(slot);
+
+    // The partially written record is never read
+    std::list<std::string> records;
+    index.lookup(hash, &records);
+    EXPECT_TRUE( records.empty() );
+
+    SharedCacheIndex otherIndex;
+    otherIndex.open(getDirectoryPath(), 1);
+    EXPECT_EQ(0, slot.sequence & 1);
+    EXPECT_EQ(0, slot.writer);
+
+    otherIndex.lookup(hash, &records);
+    EXPECT_TRUE( records.empty() );
+
+    EXPECT_TRUE( otherIndex.publish( hash, std::string("other record") ) );
+    index.lookup(hash, &records);
+    ASSERT_EQ( 1, (int)records.size() );
+    EXPECT_EQ( std::string("other record"), records.front() );
+
+    otherIndex.close();
+    index.close();
+}
+
+// A process publishing a record in a slot left taken by a process killed while writing it releases the slot
+TEST_F(SharedCacheIndexTest, InterruptedWriterReclaimedOnPublish)
+{
+    const U64 hash = 5678;
+    SharedCacheIndex index;
+
+    index.open(getDirectoryPath(), 1);
+    ASSERT_TRUE( index.publish( hash, std::string("record") ) );
+
+    MemoryFile indexFile(getIndexFilePath(), MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail);
+    TestIndexSlot& slot = getSlot(indexFile, hash);
+    ASSERT_EQ( (U32)6, slot.recordSize );
+
+    interruptWriter(slot);
+
+    EXPECT_TRUE( index.publish( hash, std::string("new record") ) );
+    EXPECT_EQ(0, slot.sequence & 1);
+    EXPECT_EQ(0, slot.writer);
+
+    std::list<std::string> records;
+    index.lookup(hash, &records);
+    ASSERT_EQ( 1, (int)records.size() );
+    EXPECT_EQ( std::string("new record"), records.front() );
+
+    // A slot taken by a running process, here another thread of this process, is left alone
+    int sequence = slot.sequence;
+    slot.writer = (int)ProcInfo::getCurrentProcessPID();
+    index.unpublish( hash, std::string("new record") );
+    EXPECT_EQ(sequence, slot.sequence);
+    records.clear();
+    index.lookup(hash, &records);
+    EXPECT_EQ( 1, (int)records.size() );
+
+    slot.writer = 0;
+    index.close();
+}
+
+// The files published by another process are mapped without write access, and never created again once withdrawn
+TEST_F(SharedCacheIndexTest, SharedFileOpenedReadOnly)
+{
+    SharedCacheIndex index;
+
+    index.open(getDirectoryPath(), 1);
+    std::string filePath = index.getProcessFilesPath() + "published." NATRON_CACHE_FILE_EXT;
+    {
+        MemoryFile published(filePath, 64, MemoryFile::eFileOpenModeEnumIfExistsTruncateElseCreate);
+        std::memset(published.data(), 'p', 64);
+        ASSERT_TRUE( published.flush(MemoryFile::eFlushTypeSync, 0, 0) );
+    }
+    {
+        MemoryFile mapped(filePath, MemoryFile::eFileOpenModeEnumIfExistsReadOnlyElseFail);
+        ASSERT_EQ( (std::size_t)64, mapped.size() );
+        EXPECT_EQ( 'p', mapped.data()[63] );
+
+        // The mapping is copy-on-write
+        mapped.data()[0] = 'x';
+    }
+    {
+        MemoryFile published(filePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail);
+        EXPECT_EQ( 'p', published.data()[0] );
+        published.remove();
+    }
+
+    EXPECT_THROW( MemoryFile(filePath, MemoryFile::eFileOpenModeEnumIfExistsReadOnlyElseFail), std::exception );
+    EXPECT_THROW( MemoryFile(filePath, MemoryFile::eFileOpenModeEnumIfExistsKeepElseFail), std::exception );
+
+    index.close();
+}
@@ -49,7 +49,20 @@ SOURCES += \
     Lut_Test.cpp \
     KnobFile_Test.cpp \
     Curve_Test.cpp \
+    CacheDeleter_Test.cpp \
+    ImageConvert_Test.cpp \
     Tracker_Test.cpp \
+    SharedCacheIndex_Test.cpp \
+    WorkStealingScheduler_Test.cpp \
+    AdaptiveTileSplitter_Test.cpp \
+    RenderStats_Test.cpp \
+    ImageKey_Test.cpp \
+    CacheCompression_Test.cpp \
+    CacheEvictionPolicy_Test.cpp \
+    BufferPool_Test.cpp \
+    CacheWriteBehind_Test.cpp \
+    CacheStatistics_Test.cpp \
+    RenderTaskGraph_Test.cpp \
     wmain.cpp
 
 HEADERS += \
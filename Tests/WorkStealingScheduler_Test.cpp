@@ -0,0 +1,236 @@
+/* ***** BEGIN LICENSE BLOCK *****
+ * This file is part of Natron <https://natrongithub.github.io/>,
+ * Copyright (C) 2013-2018 INRIA and Alexandre Gauthier-Foichat
+ * Copyright (C) 2018-2020 The Natron developers
+ *
+ * Natron is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Natron is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Natron.  If not, see <http://www.gnu.org/licenses/gpl-2.0.html>
+ * ***** END LICENSE BLOCK ***** */
+
+// ***** BEGIN PYTHON BLOCK *****
+// from <https://docs.python.org/3/c-api/intro.html#include-files>:
+// "Since Python may define some pre-processor definitions which affect the standard headers on some systems, you must include Python.h before any standard headers are included."
+#include <Python.h>
+// ***** END PYTHON BLOCK *****
+
+#include "Global/Macros.h"
+
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#if !defined(SBK_RUN) && !defined(Q_MOC_RUN)
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_OFF
+#include <boost/bind.hpp>
+GCC_DIAG_UNUSED_LOCAL_TYPEDEFS_ON
+#endif
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+
+#include "Engine/AbortableRenderInfo.h"
+#include "Engine/WorkStealingScheduler.h"
+
+// Each task of a level forks WS_TEST_FANOUT tasks of the level below, as nested renders fork the tiles of their inputs
+#define WS_TEST_FANOUT 4
+#define WS_TEST_DEPTH 5
+#define WS_TEST_LEAVES (4 * 4 * 4 * 4 * 4)
+
+NATRON_NAMESPACE_USING
+
+NATRON_NAMESPACE_ANONYMOUS_ENTER
+
+QAtomicInt leavesCount(0);
+QMutex threadsMutex;
+std::set<QThread*> threadsUsed;
+
+void
+runNestedTask(WorkStealingScheduler* scheduler,
+              int depth)
+{
+    {
+        QMutexLocker k(&threadsMutex);
+        threadsUsed.insert( QThread::currentThread() );
+    }
+    if (depth == 0) {
+        volatile double x = 0.;
+        for (int i = 0; i < 20000; ++i) {
+            x += i;
+        }
+        leavesCount.fetchAndAddRelaxed(1);
+
+        return;
+    }
+    std::vector<WorkStealingScheduler::Task> tasks;
+    for (int i = 0; i < WS_TEST_FANOUT; ++i) {
+        tasks.push_back( boost::bind(&runNestedTask, scheduler, depth - 1) );
+    }
+    scheduler->run( tasks, AbortableRenderInfoPtr() );
+}
+
+void
+throwingTask()
+{
+    throw std::runtime_error("task failed");
+}
+
+void
+sleepMs(unsigned long ms)
+{
+    QMutex mutex;
+    QWaitCondition cond;
+    QMutexLocker k(&mutex);
+
+    cond.wait(&mutex, ms);
+}
+
+QAtomicInt backgroundTasksCount(0);
+
+void
+runBackgroundTask()
+{
+    sleepMs(5);
+    backgroundTasksCount.fetchAndAddRelaxed(1);
+}
+
+void
+runInteractiveTask()
+{
+    sleepMs(2);
+}
+
+class BackgroundRenderThread
+    : public QThread
+{
+    WorkStealingScheduler* _scheduler;
+
+public:
+
+    BackgroundRenderThread(WorkStealingScheduler* scheduler)
+        : QThread()
+        , _scheduler(scheduler)
+    {
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        AbortableRenderInfoPtr abortInfo = AbortableRenderInfo::create();
+
+        abortInfo->setRenderPriority(eRenderPriorityBackground);
+        std::vector<WorkStealingScheduler::Task> tasks( 200, &runBackgroundTask );
+        _scheduler->run(tasks, abortInfo);
+    }
+};
+
+class NestedRenderThread
+    : public QThread
+{
+    WorkStealingScheduler* _scheduler;
+
+public:
+
+    NestedRenderThread(WorkStealingScheduler* scheduler)
+        : QThread()
+        , _scheduler(scheduler)
+    {
+    }
+
+private:
+
+    virtual void run() OVERRIDE FINAL
+    {
+        for (int i = 0; i < 10; ++i) {
+            runNestedTask(_scheduler, WS_TEST_DEPTH);
+        }
+    }
+};
+
+NATRON_NAMESPACE_ANONYMOUS_EXIT
+
+// Nested fork/join from several threads at once must neither deadlock nor lose tasks
+TEST(WorkStealingScheduler, NestedForkJoin) {
+    WorkStealingScheduler scheduler(4);
+
+    leavesCount.fetchAndStoreOrdered(0);
+    threadsUsed.clear();
+
+    std::vector<NestedRenderThread*> threads;
+    for (int i = 0; i < 3; ++i) {
+        threads.push_back( new NestedRenderThread(&scheduler) );
+        threads.back()->start();
+    }
+    for (std::size_t i = 0; i < threads.size(); ++i) {
+        threads[i]->wait();
+        delete threads[i];
+    }
+
+    EXPECT_EQ( 3 * 10 * WS_TEST_LEAVES, leavesCount.fetchAndAddAcquire(0) );
+    // The workers must have stolen tasks from the nested levels
+    EXPECT_GT( (int)threadsUsed.size(), 3 );
+}
+
+TEST(WorkStealingScheduler, NoWorkers) {
+    WorkStealingScheduler scheduler(0);
+
+    leavesCount.fetchAndStoreOrdered(0);
+    threadsUsed.clear();
+    runNestedTask(&scheduler, 3);
+
+    EXPECT_EQ( 4 * 4 * 4, leavesCount.fetchAndAddAcquire(0) );
+    EXPECT_EQ( 1, (int)threadsUsed.size() );
+}
+
+// Tasks that did not start when the render is aborted are skipped
+TEST(WorkStealingScheduler, Abort) {
+    WorkStealingScheduler scheduler(4);
+    AbortableRenderInfoPtr abortInfo = AbortableRenderInfo::create();
+
+    abortInfo->setAborted();
+    leavesCount.fetchAndStoreOrdered(0);
+    std::vector<WorkStealingScheduler::Task> tasks( 100, boost::bind(&runNestedTask, &scheduler, 0) );
+    EXPECT_EQ( 100, scheduler.run(tasks, abortInfo) );
+    EXPECT_EQ( 0, leavesCount.fetchAndAddAcquire(0) );
+}
+
+TEST(WorkStealingScheduler, Exception) {
+    WorkStealingScheduler scheduler(4);
+    std::vector<WorkStealingScheduler::Task> tasks(10, &throwingTask);
+
+    EXPECT_THROW(scheduler.run( tasks, AbortableRenderInfoPtr() ), std::runtime_error);
+}
+
+// An interactive render started while a background render occupies all threads must not wait for it
+TEST(WorkStealingScheduler, Priority) {
+    WorkStealingScheduler scheduler(1);
+
+    backgroundTasksCount.fetchAndStoreOrdered(0);
+    BackgroundRenderThread backgroundThread(&scheduler);
+    backgroundThread.start();
+    sleepMs(20);
+
+    int nBackgroundTasksBefore = backgroundTasksCount.fetchAndAddAcquire(0);
+    std::vector<WorkStealingScheduler::Task> tasks( 32, &runInteractiveTask );
+    scheduler.run( tasks, AbortableRenderInfo::create() );
+    int nBackgroundTasksDuring = backgroundTasksCount.fetchAndAddAcquire(0) - nBackgroundTasksBefore;
+
+    backgroundThread.wait();
+    EXPECT_EQ( 200, backgroundTasksCount.fetchAndAddAcquire(0) );
+    // Only the tasks already running on the background thread and the worker may finish meanwhile
+    EXPECT_LE(nBackgroundTasksDuring, 3);
+}